@@ -0,0 +1,128 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/crypto/ctr_drbg.h"
+
+#include <openssl/aes.h>
+#include <openssl/mem.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+constexpr size_t kKeySize = 32;
+
+// Adds |count| to the big-endian 128-bit counter |block|, modulo 2^128.
+void AddToCounter(uint8_t *block, uint64_t count) {
+  for (int i = AES_BLOCK_SIZE - 1; i >= 0 && count != 0; --i) {
+    count += block[i];
+    block[i] = static_cast<uint8_t>(count);
+    count >>= 8;
+  }
+}
+
+Status CheckSeedSize(ByteContainerView entropy) {
+  if (entropy.size() != CtrDrbg::kSeedSize) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Entropy input must be ", CtrDrbg::kSeedSize,
+                     " bytes, but is ", entropy.size(), " bytes"));
+  }
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+constexpr size_t CtrDrbg::kSeedSize;
+constexpr size_t CtrDrbg::kMaxRequestSize;
+
+Status CtrDrbg::Instantiate(ByteContainerView entropy) {
+  ASYLO_RETURN_IF_ERROR(CheckSeedSize(entropy));
+  Clear();
+  uint8_t zero_key[kKeySize] = {};
+  AES_set_encrypt_key(zero_key, kKeySize * 8, &key_);
+  Update(entropy.data());
+  reseed_counter_ = 1;
+  return absl::OkStatus();
+}
+
+Status CtrDrbg::Reseed(ByteContainerView entropy) {
+  ASYLO_RETURN_IF_ERROR(CheckSeedSize(entropy));
+  if (!instantiated()) {
+    return absl::FailedPreconditionError("CtrDrbg is not instantiated");
+  }
+  Update(entropy.data());
+  reseed_counter_ = 1;
+  return absl::OkStatus();
+}
+
+Status CtrDrbg::Generate(absl::Span<uint8_t> output) {
+  if (!instantiated()) {
+    return absl::FailedPreconditionError("CtrDrbg is not instantiated");
+  }
+  static constexpr uint8_t kNoAdditionalInput[kSeedSize] = {};
+  while (!output.empty()) {
+    size_t request_size = std::min(output.size(), kMaxRequestSize);
+
+    // Encrypt the counter blocks following V in place of the output.
+    uint8_t counter[AES_BLOCK_SIZE];
+    memcpy(counter, v_, sizeof(counter));
+    AddToCounter(counter, 1);
+    uint8_t unused_block[AES_BLOCK_SIZE];
+    unsigned int unused_block_offset = 0;
+    memset(output.data(), 0, request_size);
+    AES_ctr128_encrypt(output.data(), output.data(), request_size, &key_,
+                       counter, unused_block, &unused_block_offset);
+    OPENSSL_cleanse(unused_block, sizeof(unused_block));
+    AddToCounter(v_, (request_size + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE);
+
+    Update(kNoAdditionalInput);
+    ++reseed_counter_;
+    output.remove_prefix(request_size);
+  }
+  return absl::OkStatus();
+}
+
+void CtrDrbg::Clear() {
+  OPENSSL_cleanse(&key_, sizeof(key_));
+  OPENSSL_cleanse(v_, sizeof(v_));
+  reseed_counter_ = 0;
+}
+
+void CtrDrbg::Update(const uint8_t *provided_data) {
+  uint8_t temp[kSeedSize];
+  for (size_t offset = 0; offset < kSeedSize; offset += AES_BLOCK_SIZE) {
+    AddToCounter(v_, 1);
+    AES_encrypt(v_, temp + offset, &key_);
+  }
+  for (size_t i = 0; i < kSeedSize; ++i) {
+    temp[i] ^= provided_data[i];
+  }
+  AES_set_encrypt_key(temp, kKeySize * 8, &key_);
+  memcpy(v_, temp + kKeySize, AES_BLOCK_SIZE);
+  OPENSSL_cleanse(temp, sizeof(temp));
+}
+
+}  // namespace asylo
@@ -0,0 +1,91 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_CRYPTO_CTR_DRBG_H_
+#define ASYLO_CRYPTO_CTR_DRBG_H_
+
+#include <openssl/aes.h>
+
+#include <cstddef>
+#include <cstdint>
+
+#include "absl/types/span.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+
+// CtrDrbg is the CTR_DRBG deterministic random bit generator of NIST SP
+// 800-90A Rev. 1, instantiated with AES-256 and without a derivation function.
+// It expands a seed of kSeedSize bytes of full entropy into a stream of
+// pseudorandom bytes. The caller supplies the entropy, and decides when to
+// reseed based on reseed_counter().
+//
+// Unlike most classes in this directory, CtrDrbg is constant-initialized and
+// trivially destructible, so that it can be held in thread-local storage in an
+// enclave. Call Clear() to erase its state once it is no longer needed.
+//
+// CtrDrbg is not thread-safe.
+class CtrDrbg {
+ public:
+  // Size in bytes of the entropy input to Instantiate() and Reseed().
+  static constexpr size_t kSeedSize = 48;
+
+  // Maximum number of bytes produced by a single generate request. Longer
+  // outputs of Generate() are produced by several requests.
+  static constexpr size_t kMaxRequestSize = 1 << 16;
+
+  constexpr CtrDrbg() = default;
+
+  // Seeds the generator with |entropy|, which must be kSeedSize bytes. Any
+  // previous state is discarded.
+  Status Instantiate(ByteContainerView entropy);
+
+  // Mixes |entropy|, which must be kSeedSize bytes, into the state of an
+  // instantiated generator and resets reseed_counter().
+  Status Reseed(ByteContainerView entropy);
+
+  // Fills |output| with pseudorandom bytes. Returns a non-OK Status if the
+  // generator is not instantiated.
+  Status Generate(absl::Span<uint8_t> output);
+
+  // Returns whether the generator has been instantiated and not cleared.
+  bool instantiated() const { return reseed_counter_ != 0; }
+
+  // Returns the number of generate requests made since the generator was last
+  // seeded, plus one.
+  uint64_t reseed_counter() const { return reseed_counter_; }
+
+  // Erases the state of the generator, returning it to the uninstantiated
+  // state.
+  void Clear();
+
+ private:
+  // The CTR_DRBG_Update function, applied to |provided_data| of kSeedSize
+  // bytes.
+  void Update(const uint8_t *provided_data);
+
+  AES_KEY key_ = {};
+  uint8_t v_[AES_BLOCK_SIZE] = {};
+  uint64_t reseed_counter_ = 0;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_CRYPTO_CTR_DRBG_H_
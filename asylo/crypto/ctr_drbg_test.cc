@@ -0,0 +1,143 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/crypto/ctr_drbg.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/strings/escaping.h"
+#include "absl/types/span.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/test/util/status_matchers.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+
+// Expected outputs of CTR_DRBG with AES-256 and no derivation function,
+// computed from the algorithm of SP 800-90A for the entropy input of
+// MakeEntropy().
+constexpr char kFirstOutputHex[] =
+    "495392e47beea407edf8b36504ea2384d20a8ce93b3f48bb01cf24d1c6e4e815"
+    "0be853d482b3e855dffcde48c54c4c1ae05c62e992a5e2102dd291c123822983";
+constexpr char kSecondOutputHex[] =
+    "650e65d2db75f5a98d58202e5b75dfd8f0cb27823a76cc79f4324d01e7f687bd"
+    "9e824c295e";
+constexpr char kOutputAfterReseedHex[] =
+    "ba747f52d2c45341c8858478ed7a4bc8833a09cad75436a11e0893d5947425fb"
+    "4189b7043c873afe1305330f61f88fc6b0371022d62ec7deb996bbe97ff6c530";
+
+// Returns kSeedSize bytes of entropy input, starting from |offset| in a fixed
+// sequence.
+std::vector<uint8_t> MakeEntropy(size_t offset) {
+  std::vector<uint8_t> entropy(CtrDrbg::kSeedSize);
+  for (size_t i = 0; i < entropy.size(); ++i) {
+    entropy[i] = static_cast<uint8_t>((offset + i) * 7 + 3);
+  }
+  return entropy;
+}
+
+std::string Generate(CtrDrbg *drbg, size_t size) {
+  std::string output(size, '\0');
+  EXPECT_THAT(drbg->Generate(absl::MakeSpan(
+                  reinterpret_cast<uint8_t *>(&output[0]), output.size())),
+              IsOk());
+  return output;
+}
+
+TEST(CtrDrbgTest, GeneratesKnownAnswers) {
+  CtrDrbg drbg;
+  ASYLO_ASSERT_OK(drbg.Instantiate(MakeEntropy(0)));
+  EXPECT_THAT(absl::BytesToHexString(Generate(&drbg, 64)),
+              Eq(kFirstOutputHex));
+  EXPECT_THAT(absl::BytesToHexString(Generate(&drbg, 37)),
+              Eq(kSecondOutputHex));
+  EXPECT_THAT(drbg.reseed_counter(), Eq(3));
+
+  ASYLO_ASSERT_OK(drbg.Reseed(MakeEntropy(CtrDrbg::kSeedSize)));
+  EXPECT_THAT(drbg.reseed_counter(), Eq(1));
+  EXPECT_THAT(absl::BytesToHexString(Generate(&drbg, 64)),
+              Eq(kOutputAfterReseedHex));
+}
+
+// Tests that a request longer than kMaxRequestSize is split into several
+// requests, each of which updates the state of the generator.
+TEST(CtrDrbgTest, SplitsLongRequests) {
+  CtrDrbg drbg;
+  ASYLO_ASSERT_OK(drbg.Instantiate(MakeEntropy(0)));
+  std::string output = Generate(&drbg, 2 * CtrDrbg::kMaxRequestSize + 1);
+  EXPECT_THAT(drbg.reseed_counter(), Eq(4));
+
+  CtrDrbg split_drbg;
+  ASYLO_ASSERT_OK(split_drbg.Instantiate(MakeEntropy(0)));
+  EXPECT_THAT(Generate(&split_drbg, CtrDrbg::kMaxRequestSize),
+              Eq(output.substr(0, CtrDrbg::kMaxRequestSize)));
+  EXPECT_THAT(Generate(&split_drbg, CtrDrbg::kMaxRequestSize),
+              Eq(output.substr(CtrDrbg::kMaxRequestSize,
+                               CtrDrbg::kMaxRequestSize)));
+  EXPECT_THAT(Generate(&split_drbg, 1),
+              Eq(output.substr(2 * CtrDrbg::kMaxRequestSize)));
+}
+
+TEST(CtrDrbgTest, DifferentSeedsGenerateDifferentOutputs) {
+  CtrDrbg drbg1;
+  CtrDrbg drbg2;
+  ASYLO_ASSERT_OK(drbg1.Instantiate(MakeEntropy(0)));
+  ASYLO_ASSERT_OK(drbg2.Instantiate(MakeEntropy(1)));
+  EXPECT_THAT(Generate(&drbg1, 32), Ne(Generate(&drbg2, 32)));
+}
+
+TEST(CtrDrbgTest, RejectsBadEntropySize) {
+  CtrDrbg drbg;
+  std::vector<uint8_t> entropy(CtrDrbg::kSeedSize - 1);
+  EXPECT_THAT(drbg.Instantiate(entropy),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_FALSE(drbg.instantiated());
+
+  ASYLO_ASSERT_OK(drbg.Instantiate(MakeEntropy(0)));
+  entropy.resize(CtrDrbg::kSeedSize + 1);
+  EXPECT_THAT(drbg.Reseed(entropy),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(CtrDrbgTest, FailsWhenNotInstantiated) {
+  CtrDrbg drbg;
+  uint8_t output[16];
+  EXPECT_THAT(drbg.Generate(absl::MakeSpan(output)),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+  EXPECT_THAT(drbg.Reseed(MakeEntropy(0)),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+
+  ASYLO_ASSERT_OK(drbg.Instantiate(MakeEntropy(0)));
+  EXPECT_TRUE(drbg.instantiated());
+  drbg.Clear();
+  EXPECT_FALSE(drbg.instantiated());
+  EXPECT_THAT(drbg.Generate(absl::MakeSpan(output)),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+}  // namespace
+}  // namespace asylo
@@ -29,6 +29,10 @@
 #include "asylo/crypto/util/bssl_util.h"
 #include "asylo/util/status.h"
 
+#ifdef __ASYLO__
+#include "asylo/platform/primitives/util/trusted_drbg.h"
+#endif  // __ASYLO__
+
 namespace asylo {
 namespace {
 
@@ -50,6 +54,13 @@ Status RandomNonceGenerator::NextNonce(absl::Span<uint8_t> nonce) {
                   absl::StrCat("Invalid vector parameter size: ", nonce.size(),
                                " (vector size must be >= ", nonce_size_, ")"));
   }
+#ifdef __ASYLO__
+  // Inside an enclave, serve nonces from the thread's generator rather than
+  // from the locked BoringSSL generator.
+  if (primitives::TrustedDrbgRandomBytes(nonce.data(), nonce_size_)) {
+    return absl::OkStatus();
+  }
+#endif  // __ASYLO__
   if (RAND_bytes(nonce.data(), nonce_size_) != 1) {
     return Status(absl::StatusCode::kInternal,
                   absl::StrCat("RAND_bytes failed: ", BsslLastErrorString()));
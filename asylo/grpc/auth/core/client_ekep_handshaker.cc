@@ -22,6 +22,8 @@
 #include <openssl/rand.h>
 
 #include <algorithm>
+#include <string>
+#include <utility>
 
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include "absl/memory/memory.h"
@@ -32,6 +34,7 @@
 #include "asylo/grpc/auth/core/ekep_crypto.h"
 #include "asylo/grpc/auth/core/ekep_errors.h"
 #include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
 #include "asylo/grpc/auth/core/handshake.pb.h"
 #include "asylo/identity/identity.pb.h"
 #include "asylo/util/cleansing_types.h"
@@ -58,8 +61,11 @@ ClientEkepHandshaker::ClientEkepHandshaker(const EkepHandshakerOptions &options)
       available_record_protocols_({ALTSRP_AES128_GCM}),
       available_ekep_versions_({"EKEP v1"}),
       additional_authenticated_data_(options.additional_authenticated_data),
+      session_cache_(options.session_cache),
+      session_cache_key_(options.session_cache_key),
       selected_cipher_suite_(UNKNOWN_HANDSHAKE_CIPHER),
       selected_record_protocol_(UNKNOWN_RECORD_PROTOCOL),
+      session_resumed_(false),
       expected_message_type_(SERVER_PRECOMMIT),
       handshaker_state_(EkepHandshaker::HandshakeState::NOT_STARTED) {}
 
@@ -226,6 +232,16 @@ Status ClientEkepHandshaker::HandleServerPrecommit(
                                   server_precommit.challenge().size()));
   }
 
+  if (server_precommit.has_resumption()) {
+    return ResumeSession(server_precommit);
+  }
+  if (offered_session_.has_value()) {
+    // The server declined to resume the offered session, so its ticket is of
+    // no further use.
+    session_cache_->Remove(session_cache_key_);
+    offered_session_.reset();
+  }
+
   // Verify that the server requested a non-empty subset of the assertions that
   // were offered by the client.
   if (server_precommit.server_requests().empty()) {
@@ -330,9 +346,18 @@ Status ClientEkepHandshaker::HandleServerId(const google::protobuf::Message &mes
   // and the server's public key.
   std::string transcript_hash;
   ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&transcript_hash));
-  return DeriveSecrets(selected_cipher_suite_, transcript_hash,
-                       server_public_key, dh_private_key_, &primary_secret_,
-                       &authenticator_secret_);
+  ASYLO_RETURN_IF_ERROR(DeriveSecrets(selected_cipher_suite_, transcript_hash,
+                                      server_public_key, dh_private_key_,
+                                      &primary_secret_,
+                                      &authenticator_secret_));
+
+  // Derive the resumption secret of the session in case the server issues a
+  // session ticket.
+  if (!session_cache_) {
+    return absl::OkStatus();
+  }
+  return DeriveResumptionSecret(selected_cipher_suite_, transcript_hash,
+                                primary_secret_, &resumption_secret_);
 }
 
 Status ClientEkepHandshaker::HandleServerFinish(const google::protobuf::Message &message,
@@ -363,6 +388,17 @@ Status ClientEkepHandshaker::HandleServerFinish(const google::protobuf::Message
                      "Server handshake authenticator value is incorrect");
   }
 
+  if (session_cache_ && !session_resumed_ &&
+      !server_finish.session_ticket().empty()) {
+    EkepSessionCache::Entry entry;
+    entry.session_ticket = server_finish.session_ticket();
+    entry.resumption_secret = resumption_secret_;
+    entry.cipher_suite = selected_cipher_suite_;
+    entry.record_protocol = selected_record_protocol_;
+    entry.peer_identities = PeerIdentities();
+    session_cache_->Insert(session_cache_key_, std::move(entry));
+  }
+
   return WriteClientFinish(output);
 }
 
@@ -423,6 +459,20 @@ Status ClientEkepHandshaker::WriteClientPrecommit(std::string *output) {
     }
   }
 
+  // Offer to resume a cached session with the server, if there is one. The
+  // Diffie-Hellman key-pair is generated now because a resumed handshake has
+  // no ClientId message.
+  if (session_cache_) {
+    offered_session_ = session_cache_->Lookup(session_cache_key_);
+  }
+  if (offered_session_.has_value()) {
+    ASYLO_RETURN_IF_ERROR(GenerateDhKeyPair(offered_session_->cipher_suite));
+    SessionResumption *resumption = client_precommit.mutable_resumption();
+    resumption->set_session_ticket(offered_session_->session_ticket);
+    resumption->set_dh_public_key(dh_public_key_.data(),
+                                  dh_public_key_.size());
+  }
+
   // There is no need to save the transcript at this point in the handshake.
   return WriteFrameAndUpdateTranscript(CLIENT_PRECOMMIT, client_precommit,
                                        output);
@@ -432,19 +482,7 @@ Status ClientEkepHandshaker::WriteClientId(
     google::protobuf::RepeatedPtrField<AssertionRequest>::const_iterator requests_first,
     google::protobuf::RepeatedPtrField<AssertionRequest>::const_iterator requests_last,
     std::string *output) {
-  // Generate an ephemeral Diffie-Hellman key-pair for the negotiated cipher
-  // suite.
-  switch (selected_cipher_suite_) {
-    case CURVE25519_SHA256:
-      dh_public_key_.resize(X25519_PUBLIC_VALUE_LEN);
-      dh_private_key_.resize(X25519_PRIVATE_KEY_LEN);
-      X25519_keypair(dh_public_key_.data(), dh_private_key_.data());
-      break;
-    default:
-      LOG(ERROR) << "Client handshaker has bad cipher suite configuration";
-      return EkepError(Abort::INTERNAL_ERROR,
-                       "Unable to use selected cipher suite");
-  }
+  ASYLO_RETURN_IF_ERROR(GenerateDhKeyPair(selected_cipher_suite_));
 
   ClientId client_id;
   client_id.set_dh_public_key(dh_public_key_.data(), dh_public_key_.size());
@@ -492,6 +530,48 @@ Status ClientEkepHandshaker::WriteClientId(
   return GetTranscriptHash(&server_assertion_transcript_);
 }
 
+Status ClientEkepHandshaker::ResumeSession(
+    const ServerPrecommit &server_precommit) {
+  if (!offered_session_.has_value()) {
+    return EkepError(Abort::PROTOCOL_ERROR,
+                     "Server resumed a session that was not offered");
+  }
+
+  // The resumed session must use the parameters that were negotiated for the
+  // original session, and no assertions are exchanged.
+  if (selected_cipher_suite_ != offered_session_->cipher_suite ||
+      selected_record_protocol_ != offered_session_->record_protocol) {
+    return EkepError(Abort::PROTOCOL_ERROR,
+                     "Server changed the parameters of the resumed session");
+  }
+  if (!server_precommit.server_offers().empty() ||
+      !server_precommit.server_requests().empty()) {
+    return EkepError(Abort::PROTOCOL_ERROR,
+                     "Server exchanged assertions in a resumed session");
+  }
+
+  // At this stage in the protocol, the transcript is:
+  //   hash(ClientPrecommit || ServerPrecommit)
+  //
+  // This transcript is used by both the client and server to derive the EKEP
+  // secrets of the resumed session.
+  std::string transcript_hash;
+  ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&transcript_hash));
+  ASYLO_RETURN_IF_ERROR(DeriveResumedSecrets(
+      selected_cipher_suite_, transcript_hash,
+      server_precommit.resumption().dh_public_key(), dh_private_key_,
+      offered_session_->resumption_secret, &primary_secret_,
+      &authenticator_secret_));
+
+  for (const EnclaveIdentity &identity :
+       offered_session_->peer_identities.identities()) {
+    AddPeerIdentity(identity);
+  }
+  session_resumed_ = true;
+  expected_message_type_ = SERVER_FINISH;
+  return absl::OkStatus();
+}
+
 Status ClientEkepHandshaker::WriteClientFinish(std::string *output) {
   CleansingVector<uint8_t> handshake_authenticator;
   ASYLO_RETURN_IF_ERROR(ComputeClientHandshakeAuthenticator(
@@ -504,6 +584,21 @@ Status ClientEkepHandshaker::WriteClientFinish(std::string *output) {
   return WriteFrameAndUpdateTranscript(CLIENT_FINISH, client_finish, output);
 }
 
+Status ClientEkepHandshaker::GenerateDhKeyPair(HandshakeCipher cipher_suite) {
+  // Generate an ephemeral Diffie-Hellman key-pair for the cipher suite.
+  switch (cipher_suite) {
+    case CURVE25519_SHA256:
+      dh_public_key_.resize(X25519_PUBLIC_VALUE_LEN);
+      dh_private_key_.resize(X25519_PRIVATE_KEY_LEN);
+      X25519_keypair(dh_public_key_.data(), dh_private_key_.data());
+      return absl::OkStatus();
+    default:
+      LOG(ERROR) << "Client handshaker has bad cipher suite configuration";
+      return EkepError(Abort::INTERNAL_ERROR,
+                       "Unable to use selected cipher suite");
+  }
+}
+
 bool ClientEkepHandshaker::SetSelectedEkepVersion(
     const std::string &ekep_version) {
   // Verify that the selected EKEP version was offered by the client.
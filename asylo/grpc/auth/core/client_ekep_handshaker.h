@@ -26,8 +26,11 @@
 
 #include <google/protobuf/io/zero_copy_stream.h>
 #include <google/protobuf/message.h>
+#include "absl/types/optional.h"
 #include "asylo/grpc/auth/core/ekep_handshaker.h"
 #include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
 #include "asylo/util/cleansing_types.h"
 
 namespace asylo {
@@ -91,8 +94,17 @@ class ClientEkepHandshaker final : public EkepHandshaker {
                             std::string *output);
 
   // Writes the ClientPrecommit frame to |output| and updates the transcript.
+  // The ClientPrecommit offers to resume a session if the session cache has an
+  // entry for the server.
   Status WriteClientPrecommit(std::string *output);
 
+  // Derives the secrets of the resumed session accepted by |server_precommit|
+  // and restores the peer identities of the original session.
+  Status ResumeSession(const ServerPrecommit &server_precommit);
+
+  // Generates an ephemeral Diffie-Hellman key-pair for |cipher_suite|.
+  Status GenerateDhKeyPair(HandshakeCipher cipher_suite);
+
   // Generates an assertion for each assertion request in the range
   // [|requests_first|, |requests_last|) and adds the resulting assertions to a
   // ClientId frame that is written to |output|. Updates the handshake
@@ -140,6 +152,11 @@ class ClientEkepHandshaker final : public EkepHandshaker {
   // Additional data that is authenticated during the handshake.
   const std::string additional_authenticated_data_;
 
+  // The cache of session tickets and the key of the server in it. If
+  // |session_cache_| is nullptr, sessions are not resumable.
+  const std::shared_ptr<EkepSessionCache> session_cache_;
+  const std::string session_cache_key_;
+
   // Assertions expected from the peer. This field is populated after validation
   // of the ServerPrecommit message.
   std::vector<AssertionDescription> expected_peer_assertions_;
@@ -165,6 +182,17 @@ class ClientEkepHandshaker final : public EkepHandshaker {
   CleansingVector<uint8_t> authenticator_secret_;
   CleansingVector<uint8_t> primary_secret_;
 
+  // The cached session offered for resumption in the ClientPrecommit, if any.
+  absl::optional<EkepSessionCache::Entry> offered_session_;
+
+  // Whether the server accepted the offered session. This field is populated
+  // after validation of the ServerPrecommit message.
+  bool session_resumed_;
+
+  // The resumption secret of a session established by a full handshake. This
+  // field is populated after validation of the ServerId message.
+  CleansingVector<uint8_t> resumption_secret_;
+
   // A snapshot of the transcript to which the server's assertions are bound:
   //   hash(ClientPrecommit || ServerPrecommit || ClientId)
   std::string server_assertion_transcript_;
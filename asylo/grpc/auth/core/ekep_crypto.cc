@@ -25,8 +25,11 @@
 #include <openssl/mem.h>
 #include <openssl/rand.h>
 
+#include <algorithm>
 #include <cstdint>
+#include <iterator>
 #include <memory>
+#include <string>
 
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
@@ -37,6 +40,7 @@
 #include "asylo/grpc/auth/core/ekep_errors.h"
 #include "asylo/util/proto_enum_util.h"
 #include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
 
 namespace asylo {
 namespace {
@@ -46,9 +50,84 @@ constexpr size_t kEkepSecretSize =
 
 constexpr char kEkepHkdfSalt[] = "EKEP Handshake v1";
 constexpr char kEkepHkdfSaltRecordProtocol[] = "EKEP Record Protocol v1";
+constexpr char kEkepHkdfSaltResumptionSecret[] = "EKEP Resumption Secret v1";
+constexpr char kEkepHkdfSaltResumption[] = "EKEP Resumption v1";
 constexpr char kServerAuthenticatedText[] = "EKEP Handshake v1: Server Finish";
 constexpr char kClientAuthenticatedText[] = "EKEP Handshake v1: Client Finish";
 
+// Computes the Diffie-Hellman shared secret of |peer_dh_public_key| and
+// |self_dh_private_key| for |ciphersuite| and writes it to |shared_secret|. On
+// success, also sets |digest| to the hash function of |ciphersuite|.
+//
+// If the ciphersuite is unsupported, returns BAD_HANDSHAKE_CIPHER.
+// If the peer's public key has an invalid size, returns PROTOCOL_ERROR.
+// If self's private key has an invalid size, returns INTERNAL_ERROR.
+// Returns INTERNAL_ERROR on other errors.
+Status ComputeSharedSecret(const HandshakeCipher &ciphersuite,
+                           ByteContainerView peer_dh_public_key,
+                           ByteContainerView self_dh_private_key,
+                           const EVP_MD **digest,
+                           CleansingVector<uint8_t> *shared_secret) {
+  switch (ciphersuite) {
+    case CURVE25519_SHA256:
+      // Validate the arguments.
+      if (peer_dh_public_key.size() != X25519_PUBLIC_VALUE_LEN) {
+        return EkepError(Abort::PROTOCOL_ERROR,
+                         absl::StrCat("Public parameter has incorrect size: ",
+                                      peer_dh_public_key.size()));
+      }
+      if (self_dh_private_key.size() != X25519_PRIVATE_KEY_LEN) {
+        return EkepError(Abort::INTERNAL_ERROR,
+                         absl::StrCat("Private parameter has incorrect size: ",
+                                      self_dh_private_key.size()));
+      }
+
+      // Compute the shared secret.
+      shared_secret->resize(X25519_SHARED_KEY_LEN);
+      if (!X25519(shared_secret->data(), self_dh_private_key.data(),
+                  peer_dh_public_key.data())) {
+        LOG(ERROR) << "X25519 failed: " << BsslLastErrorString();
+        return EkepError(Abort::INTERNAL_ERROR, "Internal error");
+      }
+
+      // Initialize a SHA256-digest for HKDF.
+      *digest = EVP_sha256();
+      return absl::OkStatus();
+    default:
+      return EkepError(
+          Abort::BAD_HANDSHAKE_CIPHER,
+          "Ciphersuite not supported: " + ProtoEnumValueName(ciphersuite));
+  }
+}
+
+// Derives the primary and authenticator secrets from |input_key| using HKDF
+// with the given |digest|, |salt|, and |transcript_hash|, and appends them to
+// |primary_secret| and |authenticator_secret|.
+Status ExpandSecrets(const EVP_MD *digest, ByteContainerView input_key,
+                     const char *salt_string, ByteContainerView transcript_hash,
+                     CleansingVector<uint8_t> *primary_secret,
+                     CleansingVector<uint8_t> *authenticator_secret) {
+  std::string salt(salt_string);
+  CleansingVector<uint8_t> output_key;
+  output_key.resize(kEkepSecretSize);
+  if (!HKDF(output_key.data(), kEkepSecretSize, digest, input_key.data(),
+            input_key.size(), reinterpret_cast<const uint8_t *>(salt.data()),
+            salt.size(), transcript_hash.data(), transcript_hash.size())) {
+    LOG(ERROR) << "HKDF failed: " << BsslLastErrorString();
+    return EkepError(Abort::INTERNAL_ERROR, "Internal error");
+  }
+
+  // Copy the primary secret.
+  std::copy(output_key.cbegin(), output_key.cbegin() + kEkepPrimarySecretSize,
+            std::back_inserter(*primary_secret));
+
+  // Copy the authenticator secret.
+  std::copy(output_key.cbegin() + kEkepPrimarySecretSize, output_key.cend(),
+            std::back_inserter(*authenticator_secret));
+
+  return absl::OkStatus();
+}
+
 // Computes the HMAC of |authenticated_text| using the given |key|. The HMAC
 // function is initialized using the hash function from |ciphersuite|. On
 // success, writes the message authentication code to |mac|.
@@ -89,32 +168,21 @@ Status DeriveSecrets(const HandshakeCipher &ciphersuite,
                      CleansingVector<uint8_t> *authenticator_secret) {
   const EVP_MD *digest = nullptr;
   CleansingVector<uint8_t> shared_secret;
+  ASYLO_RETURN_IF_ERROR(ComputeSharedSecret(ciphersuite, peer_dh_public_key,
+                                            self_dh_private_key, &digest,
+                                            &shared_secret));
+  return ExpandSecrets(digest, shared_secret, kEkepHkdfSalt, transcript_hash,
+                       primary_secret, authenticator_secret);
+}
 
-  // Generate the shared secret and initialize a hash function for HKDF based on
-  // the ciphersuite.
+Status DeriveResumptionSecret(const HandshakeCipher &ciphersuite,
+                              ByteContainerView transcript_hash,
+                              ByteContainerView primary_secret,
+                              CleansingVector<uint8_t> *resumption_secret) {
+  resumption_secret->clear();
+  const EVP_MD *digest = nullptr;
   switch (ciphersuite) {
     case CURVE25519_SHA256:
-      // Validate the arguments.
-      if (peer_dh_public_key.size() != X25519_PUBLIC_VALUE_LEN) {
-        return EkepError(Abort::PROTOCOL_ERROR,
-                         absl::StrCat("Public parameter has incorrect size: ",
-                                      peer_dh_public_key.size()));
-      }
-      if (self_dh_private_key.size() != X25519_PRIVATE_KEY_LEN) {
-        return EkepError(Abort::INTERNAL_ERROR,
-                         absl::StrCat("Private parameter has incorrect size: ",
-                                      self_dh_private_key.size()));
-      }
-
-      // Compute the shared secret.
-      shared_secret.resize(X25519_SHARED_KEY_LEN);
-      if (!X25519(shared_secret.data(), self_dh_private_key.data(),
-                  peer_dh_public_key.data())) {
-        LOG(ERROR) << "X25519 failed: " << BsslLastErrorString();
-        return EkepError(Abort::INTERNAL_ERROR, "Internal error");
-      }
-
-      // Initialize a SHA256-digest for HKDF.
       digest = EVP_sha256();
       break;
     default:
@@ -123,27 +191,46 @@ Status DeriveSecrets(const HandshakeCipher &ciphersuite,
           "Ciphersuite not supported: " + ProtoEnumValueName(ciphersuite));
   }
 
-  // Derive the primary and authenticator secrets using HKDF.
-  std::string salt(kEkepHkdfSalt);
-  CleansingVector<uint8_t> output_key;
-  output_key.resize(kEkepSecretSize);
-  if (!HKDF(output_key.data(), kEkepSecretSize, digest, shared_secret.data(),
-            shared_secret.size(),
+  std::string salt(kEkepHkdfSaltResumptionSecret);
+  resumption_secret->resize(kEkepResumptionSecretSize);
+  if (!HKDF(resumption_secret->data(), resumption_secret->size(), digest,
+            primary_secret.data(), primary_secret.size(),
             reinterpret_cast<const uint8_t *>(salt.data()), salt.size(),
             transcript_hash.data(), transcript_hash.size())) {
     LOG(ERROR) << "HKDF failed: " << BsslLastErrorString();
+    resumption_secret->clear();
     return EkepError(Abort::INTERNAL_ERROR, "Internal error");
   }
+  return absl::OkStatus();
+}
 
-  // Copy the primary secret.
-  std::copy(output_key.cbegin(), output_key.cbegin() + kEkepPrimarySecretSize,
-            std::back_inserter(*primary_secret));
+Status DeriveResumedSecrets(const HandshakeCipher &ciphersuite,
+                            ByteContainerView transcript_hash,
+                            ByteContainerView peer_dh_public_key,
+                            ByteContainerView self_dh_private_key,
+                            ByteContainerView resumption_secret,
+                            CleansingVector<uint8_t> *primary_secret,
+                            CleansingVector<uint8_t> *authenticator_secret) {
+  if (resumption_secret.size() != kEkepResumptionSecretSize) {
+    return EkepError(Abort::INTERNAL_ERROR,
+                     absl::StrCat("Resumption secret has incorrect size: ",
+                                  resumption_secret.size()));
+  }
 
-  // Copy the authenticator secret.
-  std::copy(output_key.cbegin() + kEkepPrimarySecretSize, output_key.cend(),
-            std::back_inserter(*authenticator_secret));
+  const EVP_MD *digest = nullptr;
+  CleansingVector<uint8_t> input_key;
+  ASYLO_RETURN_IF_ERROR(ComputeSharedSecret(
+      ciphersuite, peer_dh_public_key, self_dh_private_key, &digest,
+      &input_key));
 
-  return absl::OkStatus();
+  // The input key material is the fresh shared secret followed by the
+  // resumption secret, so that the resumed session has forward secrecy with
+  // respect to the ticket and can only be completed by a holder of the
+  // resumption secret.
+  std::copy(resumption_secret.cbegin(), resumption_secret.cend(),
+            std::back_inserter(input_key));
+  return ExpandSecrets(digest, input_key, kEkepHkdfSaltResumption,
+                       transcript_hash, primary_secret, authenticator_secret);
 }
 
 Status DeriveRecordProtocolKey(const HandshakeCipher &ciphersuite,
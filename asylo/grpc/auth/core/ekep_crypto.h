@@ -32,6 +32,7 @@ namespace asylo {
 
 constexpr size_t kEkepPrimarySecretSize = 64;
 constexpr size_t kEkepAuthenticatorSecretSize = 64;
+constexpr size_t kEkepResumptionSecretSize = 64;
 constexpr size_t kAltsRecordProtocolAes128GcmKeySize = 16;
 
 // Derives EKEP secrets based on the selected |ciphersuite| and the input
@@ -55,6 +56,33 @@ Status DeriveSecrets(const HandshakeCipher &ciphersuite,
                      CleansingVector<uint8_t> *primary_secret,
                      CleansingVector<uint8_t> *authenticator_secret);
 
+// Derives an EKEP resumption secret from the |primary_secret| of a completed
+// handshake using HKDF initialized with the hash function from |ciphersuite|
+// and the input |transcript_hash|. On success, writes the resumption secret to
+// |resumption_secret|. The resumption secret is sealed into a session ticket
+// by the server and kept by the client to resume the session later.
+//
+// If the ciphersuite is unsupported, returns BAD_HANDSHAKE_CIPHER.
+// Returns INTERNAL_ERROR on other errors.
+Status DeriveResumptionSecret(const HandshakeCipher &ciphersuite,
+                              ByteContainerView transcript_hash,
+                              ByteContainerView primary_secret,
+                              CleansingVector<uint8_t> *resumption_secret);
+
+// Derives EKEP secrets for a resumed session. Behaves like DeriveSecrets(),
+// except that the HKDF input key material is the Diffie-Hellman shared secret
+// followed by the |resumption_secret| of the session being resumed.
+//
+// If the resumption secret has an invalid size, returns INTERNAL_ERROR.
+// Otherwise returns the same errors as DeriveSecrets().
+Status DeriveResumedSecrets(const HandshakeCipher &ciphersuite,
+                            ByteContainerView transcript_hash,
+                            ByteContainerView peer_dh_public_key,
+                            ByteContainerView self_dh_private_key,
+                            ByteContainerView resumption_secret,
+                            CleansingVector<uint8_t> *primary_secret,
+                            CleansingVector<uint8_t> *authenticator_secret);
+
 // Derives a record protocol key for the given |record_protocol| using HKDF
 // initialized with the hash function from |ciphersuite| and the input key
 // material |primary_secret|. On success, writes the record protocol key to
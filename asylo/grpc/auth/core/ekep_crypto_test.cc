@@ -67,6 +67,28 @@ constexpr char kTestAuthenticatorSecret[] =
 //     kTestRecordProtocolKey
 constexpr char kTestRecordProtocolKey[] = "c7e0f5436c0fe4efdb6327469651b9fe";
 
+// Test vector for resumption secret derivation.
+//   Inputs:
+//     kTestPrimarySecret, kTestTranscriptHash
+//   Outputs:
+//     kTestResumptionSecret
+constexpr char kTestResumptionSecret[] =
+    "f278e2c2aa9bd4915654f2b89c91a091020e93855a5da4afcc9d8cb1ade96193"
+    "75484cca0bf0d09c05e673eefd16267dfec5977b1b58befaeb3891263b5cd01c";
+
+// Test vector for resumed EKEP secret derivation.
+//   Inputs:
+//     kTestPrivKey, kTestPubKey, kTestTranscriptHash, kTestResumptionSecret
+//   Outputs:
+//     kTestResumedPrimarySecret, kTestResumedAuthenticatorSecret
+constexpr char kTestResumedPrimarySecret[] =
+    "b83eee72414ca9a1a8c198d578541c17ba8e747015493f2034c5277f42b19d83"
+    "26730585dc4a4ea7088342a6bd5687f55bcc7404fb211a3004ccfd54d0cee05b";
+
+constexpr char kTestResumedAuthenticatorSecret[] =
+    "c84de0ea00f8efc689a2f563cf8885cd8ae064a7b8a1e0be59bf95649967d9f3"
+    "c7713a5c20c16028efb26955d6a6a090f133a3871f1ddb983dd699640a6c9344";
+
 // Test vector for server handshake-authenticator computation.
 //   Inputs:
 //     kTestAuthenticatorSecret
@@ -185,6 +207,117 @@ TEST(EkepCryptoTest, DeriveSecretsWithCurve25519Sha256) {
   EXPECT_EQ(*actual_authenticator_secret, expected_authenticator_secret);
 }
 
+// Verify that DeriveResumptionSecret fails and returns BAD_HANDSHAKE_CIPHER
+// when passed an unsupported ciphersuite.
+TEST(EkepCryptoTest, DeriveResumptionSecretBadCiphersuite) {
+  std::string transcript_hash;
+  std::vector<uint8_t> primary_secret;
+  CleansingVector<uint8_t> resumption_secret;
+
+  Status status = DeriveResumptionSecret(UNKNOWN_HANDSHAKE_CIPHER,
+                                         transcript_hash, primary_secret,
+                                         &resumption_secret);
+  EXPECT_THAT(status, Not(IsOk()));
+  EXPECT_THAT(status, EkepErrorIs(Abort::BAD_HANDSHAKE_CIPHER));
+}
+
+// Verify success of DeriveResumptionSecret using the ciphersuite consisting of
+// Curve25519 and SHA256.
+TEST(EkepCryptoTest, DeriveResumptionSecretWithCurve25519Sha256) {
+  UnsafeBytes<kSha256DigestLength> transcript_hash;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestTranscriptHash, &transcript_hash));
+
+  SafeBytes<kEkepPrimarySecretSize> primary_secret;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestPrimarySecret, &primary_secret));
+
+  SafeBytes<kEkepResumptionSecretSize> expected_resumption_secret;
+  ASYLO_ASSERT_OK(SetTrivialObjectFromHexString(kTestResumptionSecret,
+                                                &expected_resumption_secret));
+
+  CleansingVector<uint8_t> resumption_secret;
+  ASYLO_ASSERT_OK(DeriveResumptionSecret(CURVE25519_SHA256, transcript_hash,
+                                         primary_secret, &resumption_secret));
+
+  ASSERT_EQ(resumption_secret.size(), kEkepResumptionSecretSize);
+  SafeBytes<kEkepResumptionSecretSize> *actual_resumption_secret =
+      SafeBytes<kEkepResumptionSecretSize>::Place(&resumption_secret,
+                                                  /*offset=*/0);
+  EXPECT_EQ(*actual_resumption_secret, expected_resumption_secret);
+}
+
+// Verify that DeriveResumedSecrets fails and returns INTERNAL_ERROR when passed
+// a resumption secret that has an invalid size.
+TEST(EkepCryptoTest, DeriveResumedSecretsBadResumptionSecretSize) {
+  std::string transcript_hash;
+  SafeBytes<X25519_PUBLIC_VALUE_LEN> peer_dh_public_key =
+      TrivialRandomObject<SafeBytes<X25519_PUBLIC_VALUE_LEN>>();
+  SafeBytes<X25519_PRIVATE_KEY_LEN> self_dh_private_key =
+      TrivialRandomObject<SafeBytes<X25519_PRIVATE_KEY_LEN>>();
+
+  // Resumption secret is empty.
+  CleansingVector<uint8_t> resumption_secret;
+
+  CleansingVector<uint8_t> authenticator_secret;
+  CleansingVector<uint8_t> primary_secret;
+
+  Status status = DeriveResumedSecrets(
+      CURVE25519_SHA256, transcript_hash, peer_dh_public_key,
+      self_dh_private_key, resumption_secret, &primary_secret,
+      &authenticator_secret);
+  EXPECT_THAT(status, Not(IsOk()));
+  EXPECT_THAT(status, EkepErrorIs(Abort::INTERNAL_ERROR));
+}
+
+// Verify success of DeriveResumedSecrets using the ciphersuite consisting of
+// Curve25519 and SHA256.
+TEST(EkepCryptoTest, DeriveResumedSecretsWithCurve25519Sha256) {
+  UnsafeBytes<kSha256DigestLength> transcript_hash;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestTranscriptHash, &transcript_hash));
+
+  UnsafeBytes<X25519_PUBLIC_VALUE_LEN> peer_dh_public_key;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestPubKey, &peer_dh_public_key));
+
+  SafeBytes<X25519_PRIVATE_KEY_LEN> self_dh_private_key;
+  ASYLO_ASSERT_OK(
+      SetTrivialObjectFromHexString(kTestPrivKey, &self_dh_private_key));
+
+  SafeBytes<kEkepResumptionSecretSize> resumption_secret;
+  ASYLO_ASSERT_OK(SetTrivialObjectFromHexString(kTestResumptionSecret,
+                                                &resumption_secret));
+
+  SafeBytes<kEkepPrimarySecretSize> expected_primary_secret;
+  ASYLO_ASSERT_OK(SetTrivialObjectFromHexString(kTestResumedPrimarySecret,
+                                                &expected_primary_secret));
+
+  SafeBytes<kEkepAuthenticatorSecretSize> expected_authenticator_secret;
+  ASYLO_ASSERT_OK(SetTrivialObjectFromHexString(
+      kTestResumedAuthenticatorSecret, &expected_authenticator_secret));
+
+  CleansingVector<uint8_t> authenticator_secret;
+  CleansingVector<uint8_t> primary_secret;
+
+  ASYLO_ASSERT_OK(DeriveResumedSecrets(
+      CURVE25519_SHA256, transcript_hash, peer_dh_public_key,
+      self_dh_private_key, resumption_secret, &primary_secret,
+      &authenticator_secret));
+
+  // Verify that the primary secret is as expected.
+  SafeBytes<kEkepPrimarySecretSize> *actual_primary_secret =
+      SafeBytes<kEkepPrimarySecretSize>::Place(&primary_secret,
+                                               /*offset=*/0);
+  EXPECT_EQ(*actual_primary_secret, expected_primary_secret);
+
+  // Verify that the authenticator secret is as expected.
+  SafeBytes<kEkepAuthenticatorSecretSize> *actual_authenticator_secret =
+      SafeBytes<kEkepAuthenticatorSecretSize>::Place(&authenticator_secret,
+                                                     /*offset=*/0);
+  EXPECT_EQ(*actual_authenticator_secret, expected_authenticator_secret);
+}
+
 // Verify that DeriveRecordProtocolKey fails and returns BAD_HANDSHAKE_CIPHER
 // when passed an unsupported ciphersuite.
 TEST(EkepCryptoTest, DeriveRecordProtocolKeyBadCiphersuite) {
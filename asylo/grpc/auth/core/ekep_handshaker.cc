@@ -335,6 +335,10 @@ void EkepHandshaker::AddPeerIdentity(const EnclaveIdentity &identity) {
   *peer_identities_->add_identities() = identity;
 }
 
+const EnclaveIdentities &EkepHandshaker::PeerIdentities() const {
+  return *peer_identities_;
+}
+
 void EkepHandshaker::SetRecordProtocol(RecordProtocol record_protocol) {
   record_protocol_ = record_protocol;
 }
@@ -19,9 +19,11 @@
 #ifndef ASYLO_GRPC_AUTH_CORE_EKEP_HANDSHAKER_UTIL_H_
 #define ASYLO_GRPC_AUTH_CORE_EKEP_HANDSHAKER_UTIL_H_
 
+#include <memory>
 #include <string>
 #include <vector>
 
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
 #include "asylo/identity/attestation/enclave_assertion_generator.h"
 #include "asylo/identity/attestation/enclave_assertion_verifier.h"
 #include "asylo/identity/identity.pb.h"
@@ -45,6 +47,19 @@ struct EkepHandshakerOptions {
   // Additional data presented by the EKEP participant during the handshake.
   std::string additional_authenticated_data;
 
+  // Issuer of session tickets, used only by servers. If set, the server issues
+  // a session ticket at the end of each full handshake and accepts tickets
+  // from the same issuer to resume sessions.
+  std::shared_ptr<EkepSessionTicketIssuer> session_ticket_issuer;
+
+  // Cache of session tickets, used only by clients. If set, the client stores
+  // the ticket issued at the end of a full handshake under session_cache_key
+  // and presents it to resume the session in later handshakes.
+  std::shared_ptr<EkepSessionCache> session_cache;
+
+  // The key identifying the server in session_cache.
+  std::string session_cache_key;
+
   // Validates the handshaker options. All of the following conditions must
   // hold, otherwise returns INVALID_ARGUMENT:
   //   * max_frame_size is non-zero and does not exceed
@@ -0,0 +1,175 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+
+#include <openssl/rand.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/types/span.h"
+#include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace {
+
+// Size of the key used to seal session tickets. Selects AES-256-GCM-SIV.
+constexpr size_t kTicketKeySize = 32;
+
+// Data authenticated with every session ticket.
+constexpr char kTicketAssociatedData[] = "EKEP Session Ticket v1";
+
+}  // namespace
+
+StatusOr<std::unique_ptr<EkepSessionTicketIssuer>>
+EkepSessionTicketIssuer::Create(absl::Duration ticket_lifetime) {
+  if (ticket_lifetime <= absl::ZeroDuration()) {
+    return Status(absl::StatusCode::kInvalidArgument,
+                  "Session ticket lifetime must be positive");
+  }
+
+  CleansingVector<uint8_t> key(kTicketKeySize);
+  if (RAND_bytes(key.data(), key.size()) != 1) {
+    return Status(absl::StatusCode::kInternal,
+                  "Failed to generate session ticket key");
+  }
+  std::unique_ptr<AeadCryptor> cryptor;
+  ASYLO_ASSIGN_OR_RETURN(cryptor, AeadCryptor::CreateAesGcmSivCryptor(key));
+  return absl::WrapUnique(
+      new EkepSessionTicketIssuer(ticket_lifetime, std::move(cryptor)));
+}
+
+EkepSessionTicketIssuer::EkepSessionTicketIssuer(
+    absl::Duration ticket_lifetime, std::unique_ptr<AeadCryptor> cryptor)
+    : ticket_lifetime_(ticket_lifetime), cryptor_(std::move(cryptor)) {}
+
+StatusOr<std::string> EkepSessionTicketIssuer::Issue(
+    SessionTicketContents contents) {
+  contents.set_expiration_time_micros(
+      absl::ToUnixMicros(absl::Now() + ticket_lifetime_));
+
+  // The serialized contents include the resumption secret.
+  CleansingVector<uint8_t> plaintext(contents.ByteSizeLong());
+  if (!contents.SerializeToArray(plaintext.data(), plaintext.size())) {
+    return Status(absl::StatusCode::kInternal,
+                  "Failed to serialize session ticket contents");
+  }
+
+  absl::MutexLock lock(&mu_);
+  // A ticket is the nonce followed by the sealed contents.
+  size_t nonce_size = cryptor_->NonceSize();
+  std::vector<uint8_t> ticket(nonce_size + plaintext.size() +
+                              cryptor_->MaxSealOverhead());
+  size_t ciphertext_size = 0;
+  ASYLO_RETURN_IF_ERROR(cryptor_->Seal(
+      plaintext, kTicketAssociatedData,
+      absl::MakeSpan(ticket.data(), nonce_size),
+      absl::MakeSpan(ticket.data() + nonce_size, ticket.size() - nonce_size),
+      &ciphertext_size));
+  return std::string(reinterpret_cast<const char *>(ticket.data()),
+                     nonce_size + ciphertext_size);
+}
+
+StatusOr<SessionTicketContents> EkepSessionTicketIssuer::Redeem(
+    ByteContainerView ticket) {
+  CleansingVector<uint8_t> plaintext(ticket.size());
+  size_t plaintext_size = 0;
+  {
+    absl::MutexLock lock(&mu_);
+    size_t nonce_size = cryptor_->NonceSize();
+    if (ticket.size() < nonce_size) {
+      return Status(absl::StatusCode::kInvalidArgument,
+                    "Session ticket is malformed");
+    }
+    Status status = cryptor_->Open(
+        ByteContainerView(ticket.data() + nonce_size,
+                          ticket.size() - nonce_size),
+        kTicketAssociatedData, ByteContainerView(ticket.data(), nonce_size),
+        absl::MakeSpan(plaintext), &plaintext_size);
+    if (!status.ok()) {
+      return Status(absl::StatusCode::kInvalidArgument,
+                    "Session ticket could not be opened");
+    }
+  }
+
+  SessionTicketContents contents;
+  if (!contents.ParseFromArray(plaintext.data(), plaintext_size)) {
+    return Status(absl::StatusCode::kInvalidArgument,
+                  "Session ticket contents could not be parsed");
+  }
+  if (absl::FromUnixMicros(contents.expiration_time_micros()) <= absl::Now()) {
+    return Status(absl::StatusCode::kFailedPrecondition,
+                  "Session ticket has expired");
+  }
+  return contents;
+}
+
+EkepSessionCache::EkepSessionCache(absl::Duration entry_lifetime,
+                                   size_t max_entries)
+    : entry_lifetime_(entry_lifetime), max_entries_(max_entries) {}
+
+void EkepSessionCache::Insert(const std::string &key, Entry entry) {
+  if (max_entries_ == 0) {
+    return;
+  }
+  entry.expiration_time = absl::Now() + entry_lifetime_;
+
+  absl::MutexLock lock(&mu_);
+  if (entries_.size() >= max_entries_ && !entries_.contains(key)) {
+    auto oldest = std::min_element(
+        entries_.begin(), entries_.end(),
+        [](const std::pair<const std::string, Entry> &lhs,
+           const std::pair<const std::string, Entry> &rhs) {
+          return lhs.second.expiration_time < rhs.second.expiration_time;
+        });
+    entries_.erase(oldest);
+  }
+  entries_[key] = std::move(entry);
+}
+
+absl::optional<EkepSessionCache::Entry> EkepSessionCache::Lookup(
+    const std::string &key) {
+  absl::MutexLock lock(&mu_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return absl::nullopt;
+  }
+  if (it->second.expiration_time <= absl::Now()) {
+    entries_.erase(it);
+    return absl::nullopt;
+  }
+  return it->second;
+}
+
+void EkepSessionCache::Remove(const std::string &key) {
+  absl::MutexLock lock(&mu_);
+  entries_.erase(key);
+}
+
+size_t EkepSessionCache::size() const {
+  absl::MutexLock lock(&mu_);
+  return entries_.size();
+}
+
+}  // namespace asylo
@@ -0,0 +1,139 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_GRPC_AUTH_CORE_EKEP_SESSION_TICKET_H_
+#define ASYLO_GRPC_AUTH_CORE_EKEP_SESSION_TICKET_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "asylo/crypto/aead_cryptor.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/identity/identity.pb.h"
+#include "asylo/util/cleansing_types.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+
+// EkepSessionTicketIssuer issues and redeems the session tickets that let an
+// EKEP client resume a session without repeating the exchange of assertions.
+//
+// A session ticket is a SessionTicketContents message sealed with an
+// AES-GCM-SIV key that is generated when the issuer is created and never
+// leaves it. Only the issuer can open its tickets, and tickets do not survive
+// the issuer. EkepSessionTicketIssuer is thread-safe.
+class EkepSessionTicketIssuer {
+ public:
+  // Creates an issuer whose tickets are accepted for |ticket_lifetime| after
+  // they are issued. Returns INVALID_ARGUMENT if |ticket_lifetime| is not
+  // positive.
+  static StatusOr<std::unique_ptr<EkepSessionTicketIssuer>> Create(
+      absl::Duration ticket_lifetime);
+
+  // Returns the lifetime of tickets issued by this issuer.
+  absl::Duration ticket_lifetime() const { return ticket_lifetime_; }
+
+  // Sets the expiration time of |contents| and seals it into a session ticket.
+  StatusOr<std::string> Issue(SessionTicketContents contents);
+
+  // Opens |ticket| and returns its contents. Returns INVALID_ARGUMENT if
+  // |ticket| was not issued by this issuer, and FAILED_PRECONDITION if it has
+  // expired.
+  StatusOr<SessionTicketContents> Redeem(ByteContainerView ticket);
+
+ private:
+  EkepSessionTicketIssuer(absl::Duration ticket_lifetime,
+                          std::unique_ptr<AeadCryptor> cryptor);
+
+  const absl::Duration ticket_lifetime_;
+
+  absl::Mutex mu_;
+
+  // The cryptor that seals and opens tickets.
+  const std::unique_ptr<AeadCryptor> cryptor_ ABSL_GUARDED_BY(mu_);
+};
+
+// EkepSessionCache holds the session tickets received by an EKEP client,
+// together with the state needed to resume each session. Entries are keyed by
+// a string that identifies the server, such as the channel target.
+//
+// Entries expire after the lifetime given at construction. When the cache is
+// full, inserting a new entry evicts the entry that expires first.
+// EkepSessionCache is thread-safe.
+class EkepSessionCache {
+ public:
+  // The default maximum number of entries held by the cache.
+  static constexpr size_t kDefaultMaxEntries = 1024;
+
+  // The state of a resumable session.
+  struct Entry {
+    // The session ticket issued by the server.
+    std::string session_ticket;
+
+    // The resumption secret of the session.
+    CleansingVector<uint8_t> resumption_secret;
+
+    // The cipher suite and record protocol negotiated for the session.
+    HandshakeCipher cipher_suite = UNKNOWN_HANDSHAKE_CIPHER;
+    RecordProtocol record_protocol = UNKNOWN_RECORD_PROTOCOL;
+
+    // The server identities that were verified during the session.
+    EnclaveIdentities peer_identities;
+
+    // The time after which the entry is dropped. Set by Insert().
+    absl::Time expiration_time;
+  };
+
+  // Creates a cache whose entries expire |entry_lifetime| after insertion and
+  // which holds at most |max_entries| entries.
+  explicit EkepSessionCache(absl::Duration entry_lifetime,
+                            size_t max_entries = kDefaultMaxEntries);
+
+  // Stores |entry| under |key|, replacing any existing entry.
+  void Insert(const std::string &key, Entry entry);
+
+  // Returns a copy of the unexpired entry stored under |key|, if any.
+  absl::optional<Entry> Lookup(const std::string &key);
+
+  // Removes the entry stored under |key|, if any.
+  void Remove(const std::string &key);
+
+  // Returns the number of entries in the cache, including any expired entries
+  // that have not been dropped yet.
+  size_t size() const;
+
+ private:
+  const absl::Duration entry_lifetime_;
+  const size_t max_entries_;
+
+  mutable absl::Mutex mu_;
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mu_);
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_GRPC_AUTH_CORE_EKEP_SESSION_TICKET_H_
@@ -0,0 +1,184 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+
+#include <memory>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
+#include "asylo/identity/identity.pb.h"
+#include "asylo/test/util/proto_matchers.h"
+#include "asylo/test/util/status_matchers.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Field;
+using ::testing::Gt;
+using ::testing::Not;
+using ::testing::Optional;
+
+constexpr char kResumptionSecret[] = "resumption secret";
+
+SessionTicketContents MakeContents() {
+  SessionTicketContents contents;
+  contents.set_resumption_secret(kResumptionSecret);
+  contents.set_cipher_suite(CURVE25519_SHA256);
+  contents.set_record_protocol(ALTSRP_AES128_GCM);
+  EnclaveIdentity *identity =
+      contents.mutable_peer_identities()->add_identities();
+  identity->set_identity("peer identity");
+  return contents;
+}
+
+EkepSessionCache::Entry MakeEntry(const std::string &ticket) {
+  EkepSessionCache::Entry entry;
+  entry.session_ticket = ticket;
+  entry.cipher_suite = CURVE25519_SHA256;
+  entry.record_protocol = ALTSRP_AES128_GCM;
+  return entry;
+}
+
+TEST(EkepSessionTicketIssuerTest, CreateRejectsNonPositiveLifetime) {
+  EXPECT_THAT(EkepSessionTicketIssuer::Create(absl::ZeroDuration()),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+// Verify that a ticket opens to the contents it was issued with.
+TEST(EkepSessionTicketIssuerTest, RedeemReturnsIssuedContents) {
+  std::unique_ptr<EkepSessionTicketIssuer> issuer;
+  ASYLO_ASSERT_OK_AND_ASSIGN(issuer,
+                             EkepSessionTicketIssuer::Create(absl::Hours(1)));
+
+  SessionTicketContents contents = MakeContents();
+  std::string ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer->Issue(contents));
+
+  // The resumption secret must not be visible in the ticket.
+  EXPECT_THAT(ticket.find(kResumptionSecret), Eq(std::string::npos));
+
+  SessionTicketContents redeemed;
+  ASYLO_ASSERT_OK_AND_ASSIGN(redeemed, issuer->Redeem(ticket));
+  EXPECT_THAT(redeemed.expiration_time_micros(),
+              Gt(absl::ToUnixMicros(absl::Now())));
+  redeemed.clear_expiration_time_micros();
+  EXPECT_THAT(redeemed, EqualsProto(contents));
+}
+
+// Verify that tickets can only be redeemed by the issuer that sealed them.
+TEST(EkepSessionTicketIssuerTest, RedeemRejectsTicketFromOtherIssuer) {
+  std::unique_ptr<EkepSessionTicketIssuer> issuer;
+  ASYLO_ASSERT_OK_AND_ASSIGN(issuer,
+                             EkepSessionTicketIssuer::Create(absl::Hours(1)));
+  std::unique_ptr<EkepSessionTicketIssuer> other_issuer;
+  ASYLO_ASSERT_OK_AND_ASSIGN(other_issuer,
+                             EkepSessionTicketIssuer::Create(absl::Hours(1)));
+
+  std::string ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer->Issue(MakeContents()));
+  EXPECT_THAT(other_issuer->Redeem(ticket),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+// Verify that a modified ticket is rejected.
+TEST(EkepSessionTicketIssuerTest, RedeemRejectsModifiedTicket) {
+  std::unique_ptr<EkepSessionTicketIssuer> issuer;
+  ASYLO_ASSERT_OK_AND_ASSIGN(issuer,
+                             EkepSessionTicketIssuer::Create(absl::Hours(1)));
+
+  std::string ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer->Issue(MakeContents()));
+  ticket.back() ^= 1;
+  EXPECT_THAT(issuer->Redeem(ticket),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(issuer->Redeem(ticket.substr(0, 4)),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+// Verify that a ticket is rejected after its lifetime elapses.
+TEST(EkepSessionTicketIssuerTest, RedeemRejectsExpiredTicket) {
+  std::unique_ptr<EkepSessionTicketIssuer> issuer;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      issuer, EkepSessionTicketIssuer::Create(absl::Milliseconds(1)));
+
+  std::string ticket;
+  ASYLO_ASSERT_OK_AND_ASSIGN(ticket, issuer->Issue(MakeContents()));
+  absl::SleepFor(absl::Milliseconds(10));
+  EXPECT_THAT(issuer->Redeem(ticket),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(EkepSessionCacheTest, LookupReturnsInsertedEntry) {
+  EkepSessionCache cache(absl::Hours(1));
+  EXPECT_THAT(cache.Lookup("server"), Eq(absl::nullopt));
+
+  cache.Insert("server", MakeEntry("ticket"));
+  EXPECT_THAT(cache.Lookup("server"),
+              Optional(Field(&EkepSessionCache::Entry::session_ticket,
+                             Eq("ticket"))));
+  EXPECT_THAT(cache.Lookup("other server"), Eq(absl::nullopt));
+
+  cache.Insert("server", MakeEntry("new ticket"));
+  EXPECT_THAT(cache.Lookup("server"),
+              Optional(Field(&EkepSessionCache::Entry::session_ticket,
+                             Eq("new ticket"))));
+  EXPECT_THAT(cache.size(), Eq(size_t{1}));
+}
+
+TEST(EkepSessionCacheTest, RemoveDropsEntry) {
+  EkepSessionCache cache(absl::Hours(1));
+  cache.Insert("server", MakeEntry("ticket"));
+  cache.Remove("server");
+  EXPECT_THAT(cache.Lookup("server"), Eq(absl::nullopt));
+  EXPECT_THAT(cache.size(), Eq(size_t{0}));
+}
+
+TEST(EkepSessionCacheTest, LookupDropsExpiredEntry) {
+  EkepSessionCache cache(absl::Milliseconds(1));
+  cache.Insert("server", MakeEntry("ticket"));
+  absl::SleepFor(absl::Milliseconds(10));
+  EXPECT_THAT(cache.Lookup("server"), Eq(absl::nullopt));
+  EXPECT_THAT(cache.size(), Eq(size_t{0}));
+}
+
+// Verify that inserting into a full cache evicts the entry that expires first.
+TEST(EkepSessionCacheTest, InsertEvictsWhenFull) {
+  EkepSessionCache cache(absl::Hours(1), /*max_entries=*/2);
+  cache.Insert("first", MakeEntry("first ticket"));
+  absl::SleepFor(absl::Milliseconds(1));
+  cache.Insert("second", MakeEntry("second ticket"));
+  absl::SleepFor(absl::Milliseconds(1));
+  cache.Insert("third", MakeEntry("third ticket"));
+
+  EXPECT_THAT(cache.size(), Eq(size_t{2}));
+  EXPECT_THAT(cache.Lookup("first"), Eq(absl::nullopt));
+  EXPECT_THAT(cache.Lookup("second"), Not(Eq(absl::nullopt)));
+  EXPECT_THAT(cache.Lookup("third"), Not(Eq(absl::nullopt)));
+}
+
+}  // namespace
+}  // namespace asylo
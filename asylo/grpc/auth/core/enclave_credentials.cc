@@ -19,10 +19,13 @@
 #include "asylo/grpc/auth/core/enclave_credentials.h"
 
 #include <iterator>
+#include <memory>
 #include <utility>
 
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
 #include "asylo/grpc/auth/core/enclave_security_connector.h"
 #include "asylo/grpc/auth/enclave_credentials_options.h"
+#include "include/grpc/support/log.h"
 #include "src/core/lib/channel/channel_args.h"
 #include "src/core/lib/gprpp/ref_counted_ptr.h"
 #include "src/core/lib/security/credentials/credentials.h"
@@ -54,7 +57,13 @@ grpc_enclave_channel_credentials::grpc_enclave_channel_credentials(
       accepted_peer_assertions(
           std::make_move_iterator(options.accepted_peer_assertions.begin()),
           std::make_move_iterator(options.accepted_peer_assertions.end())),
-      peer_acl(std::move(options.peer_acl)) {}
+      peer_acl(std::move(options.peer_acl)),
+      max_frame_size(options.max_frame_size) {
+  if (options.session_ticket_lifetime.has_value()) {
+    session_cache = std::make_shared<asylo::EkepSessionCache>(
+        options.session_ticket_lifetime.value());
+  }
+}
 
 grpc_enclave_server_credentials::grpc_enclave_server_credentials(
     asylo::EnclaveCredentialsOptions options)
@@ -66,4 +75,16 @@ grpc_enclave_server_credentials::grpc_enclave_server_credentials(
       accepted_peer_assertions(
           std::make_move_iterator(options.accepted_peer_assertions.begin()),
           std::make_move_iterator(options.accepted_peer_assertions.end())),
-      peer_acl(std::move(options.peer_acl)) {}
+      peer_acl(std::move(options.peer_acl)),
+      max_frame_size(options.max_frame_size) {
+  if (options.session_ticket_lifetime.has_value()) {
+    auto issuer_result = asylo::EkepSessionTicketIssuer::Create(
+        options.session_ticket_lifetime.value());
+    if (issuer_result.ok()) {
+      session_ticket_issuer = std::move(issuer_result).value();
+    } else {
+      gpr_log(GPR_ERROR, "Session resumption is disabled: %s",
+              issuer_result.status().ToString().c_str());
+    }
+  }
+}
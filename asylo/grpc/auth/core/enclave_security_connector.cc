@@ -189,6 +189,8 @@ class grpc_enclave_channel_security_connector final
         /*is_client=*/true, absl::MakeSpan(channel_creds->self_assertions),
         absl::MakeSpan(channel_creds->accepted_peer_assertions),
         channel_creds->additional_authenticated_data, channel_creds->peer_acl,
+        channel_creds->max_frame_size, /*session_ticket_issuer=*/nullptr,
+        channel_creds->session_cache, /*session_cache_key=*/target_,
         &tsi_handshaker);
     if (result != TSI_OK) {
       gpr_log(GPR_ERROR, "Enclave handshaker creation failed with error %s.",
@@ -239,7 +241,8 @@ class grpc_enclave_server_security_connector final
         /*is_client=*/false, absl::MakeSpan(server_creds->self_assertions),
         absl::MakeSpan(server_creds->accepted_peer_assertions),
         server_creds->additional_authenticated_data, server_creds->peer_acl,
-        &tsi_handshaker);
+        server_creds->max_frame_size, server_creds->session_ticket_issuer,
+        /*session_cache=*/nullptr, /*session_cache_key=*/"", &tsi_handshaker);
     if (result != TSI_OK) {
       gpr_log(GPR_ERROR, "Enclave handshaker creation failed with error %s.",
               tsi_result_to_string(result));
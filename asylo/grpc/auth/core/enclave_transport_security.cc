@@ -19,6 +19,7 @@
 #include "asylo/grpc/auth/core/enclave_transport_security.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <vector>
@@ -43,6 +44,7 @@
 #include "src/core/lib/gpr/string.h"
 #include "src/core/lib/surface/api_trace.h"
 #include "src/core/tsi/alts/frame_protector/alts_frame_protector.h"
+#include "src/core/tsi/alts/zero_copy_frame_protector/alts_zero_copy_grpc_protector.h"
 #include "src/core/tsi/transport_security.h"
 #include "src/core/tsi/transport_security_interface.h"
 
@@ -51,6 +53,20 @@ namespace {
 
 constexpr int kEnclavePeerPropertyCount = 4;
 
+// Returns |requested_max_frame_size| if non-null. Otherwise, stores
+// |configured_max_frame_size| in |storage| and returns |storage|, or returns
+// nullptr if |configured_max_frame_size| is unset so that the protector uses
+// its default.
+size_t *SelectMaxFrameSize(size_t *requested_max_frame_size,
+                           absl::optional<size_t> configured_max_frame_size,
+                           size_t *storage) {
+  if (requested_max_frame_size || !configured_max_frame_size.has_value()) {
+    return requested_max_frame_size;
+  }
+  *storage = configured_max_frame_size.value();
+  return storage;
+}
+
 }  // namespace
 
 // --- tsi_handshaker_result implementation. ---
@@ -62,23 +78,50 @@ class TsiEnclaveHandshakerResult {
       bool is_client, RecordProtocol record_protocol,
       const CleansingVector<uint8_t> &record_protocol_key,
       std::unique_ptr<EnclaveIdentities> peer_identities,
-      std::string unused_bytes)
+      std::string unused_bytes, absl::optional<size_t> max_frame_size)
       : is_client_(is_client),
         record_protocol_(record_protocol),
         record_protocol_key_(record_protocol_key),
         peer_identities_(std::move(peer_identities)),
-        unused_bytes_(std::move(unused_bytes)) {}
+        unused_bytes_(std::move(unused_bytes)),
+        max_frame_size_(max_frame_size) {}
+
+  // Creates a zero-copy gRPC protector that uses a max frame size of
+  // |max_output_protected_frame_size|, if non-null, or else the max frame size
+  // of the handshaker, and places the result in |protector|. The protector
+  // seals and unseals gRPC slice buffers in place, avoiding the copies made by
+  // the adapter gRPC wraps around a frame protector.
+  tsi_result CreateZeroCopyGrpcProtector(
+      size_t *max_output_protected_frame_size,
+      tsi_zero_copy_grpc_protector **protector) {
+    size_t max_frame_size;
+    switch (record_protocol_) {
+      case ALTSRP_AES128_GCM:
+        return alts_zero_copy_grpc_protector_create(
+            record_protocol_key_.data(), record_protocol_key_.size(),
+            /*is_rekey=*/false, is_client_, /*is_integrity_only=*/false,
+            /*enable_extra_copy=*/false,
+            SelectMaxFrameSize(max_output_protected_frame_size,
+                               max_frame_size_, &max_frame_size),
+            protector);
+      default:
+        return TSI_INTERNAL_ERROR;
+    }
+  }
 
   // Creates a frame protector that uses a max frame size of
-  // |max_output_protected_frame_size|, if non-null, and places the result in
-  // |protector|.
+  // |max_output_protected_frame_size|, if non-null, or else the max frame size
+  // of the handshaker, and places the result in |protector|.
   tsi_result CreateFrameProtector(size_t *max_output_protected_frame_size,
                                   tsi_frame_protector **protector) {
+    size_t max_frame_size;
     switch (record_protocol_) {
       case ALTSRP_AES128_GCM:
         return alts_create_frame_protector(
             record_protocol_key_.data(), record_protocol_key_.size(),
-            is_client_, /*is_rekey=*/false, max_output_protected_frame_size,
+            is_client_, /*is_rekey=*/false,
+            SelectMaxFrameSize(max_output_protected_frame_size,
+                               max_frame_size_, &max_frame_size),
             protector);
       default:
         return TSI_INTERNAL_ERROR;
@@ -168,6 +211,9 @@ class TsiEnclaveHandshakerResult {
 
   // Unused bytes leftover at the end of the EKEP handshake.
   std::string unused_bytes_;
+
+  // The max frame size used when the protector's creator does not request one.
+  absl::optional<size_t> max_frame_size_;
 };
 
 // Implementation of tsi_handshaker_result that delegates all calls to a
@@ -185,6 +231,16 @@ tsi_result enclave_handshaker_result_extract_peer(
   return result->impl->ExtractPeer(peer);
 }
 
+tsi_result enclave_handshaker_result_create_zero_copy_grpc_protector(
+    const tsi_handshaker_result *self, size_t *max_output_protected_frame_size,
+    tsi_zero_copy_grpc_protector **protector) {
+  const tsi_enclave_handshaker_result *result =
+      reinterpret_cast<const tsi_enclave_handshaker_result *>(self);
+
+  return result->impl->CreateZeroCopyGrpcProtector(
+      max_output_protected_frame_size, protector);
+}
+
 tsi_result enclave_handshaker_result_create_frame_protector(
     const tsi_handshaker_result *self, size_t *max_output_protected_frame_size,
     tsi_frame_protector **protector) {
@@ -212,7 +268,7 @@ void enclave_handshaker_result_destroy(tsi_handshaker_result *self) {
 
 const tsi_handshaker_result_vtable handshaker_result_vtable = {
     enclave_handshaker_result_extract_peer,
-    nullptr /* create_zero_copy_grpc_protector */,
+    enclave_handshaker_result_create_zero_copy_grpc_protector,
     enclave_handshaker_result_create_frame_protector,
     enclave_handshaker_result_get_unused_bytes,
     enclave_handshaker_result_destroy,
@@ -241,11 +297,13 @@ struct tsi_enclave_handshaker {
   tsi_handshaker base;
   bool is_client;
   const absl::optional<IdentityAclPredicate> peer_acl;
+  const absl::optional<size_t> max_frame_size;
   std::unique_ptr<EkepHandshaker> handshaker;
   std::string outgoing_bytes;
 
   tsi_enclave_handshaker(bool is_client,
                          const absl::optional<IdentityAclPredicate> &peer_acl,
+                         absl::optional<size_t> max_frame_size,
                          std::unique_ptr<EkepHandshaker> ekep_handshaker);
 
   tsi_result evaluate_acl(const std::vector<EnclaveIdentity> &identities);
@@ -342,7 +400,7 @@ tsi_result enclave_handshaker_next(
           absl::make_unique<TsiEnclaveHandshakerResult>(
               tsi_handshaker->is_client, record_protocol_result.value(),
               key_result.value(), std::move(identities),
-              unused_bytes_result.value()),
+              unused_bytes_result.value(), tsi_handshaker->max_frame_size),
           handshaker_result);
       if (result == TSI_OK) {
         self->handshaker_result_created = true;
@@ -367,9 +425,11 @@ const tsi_handshaker_vtable handshaker_vtable = {
 
 tsi_enclave_handshaker::tsi_enclave_handshaker(
     bool is_client, const absl::optional<IdentityAclPredicate> &peer_acl,
+    absl::optional<size_t> max_frame_size,
     std::unique_ptr<EkepHandshaker> ekep_handshaker)
     : is_client(is_client),
       peer_acl(peer_acl),
+      max_frame_size(max_frame_size),
       handshaker(std::move(ekep_handshaker)) {
   base.handshaker_result_created = false;
   base.handshake_shutdown = false;
@@ -404,14 +464,20 @@ tsi_result tsi_enclave_handshaker_create(
     absl::Span<asylo::AssertionDescription> accepted_peer_assertions,
     absl::string_view additional_authenticated_data,
     const absl::optional<asylo::IdentityAclPredicate> &peer_acl,
-    tsi_handshaker **handshaker) {
+    absl::optional<size_t> max_frame_size,
+    std::shared_ptr<asylo::EkepSessionTicketIssuer> session_ticket_issuer,
+    std::shared_ptr<asylo::EkepSessionCache> session_cache,
+    absl::string_view session_cache_key, tsi_handshaker **handshaker) {
   GRPC_API_TRACE(
       "tsi_enclave_handshaker_create(is_client=%d, self_assertions=%p, "
       "accepted_peer_assertions=%p, additional_authenticated_data=%p, "
-      "peer_acl=%d, handshaker=%p)",
-      6,
+      "peer_acl=%d, max_frame_size=%zu, session_ticket_issuer=%p, "
+      "session_cache=%p, handshaker=%p)",
+      9,
       (is_client, self_assertions.data(), accepted_peer_assertions.data(),
-       additional_authenticated_data.data(), peer_acl.has_value(), handshaker));
+       additional_authenticated_data.data(), peer_acl.has_value(),
+       max_frame_size.value_or(0), session_ticket_issuer.get(),
+       session_cache.get(), handshaker));
 
   // Convert arguments to handshaker options.
   asylo::EkepHandshakerOptions options;
@@ -420,6 +486,9 @@ tsi_result tsi_enclave_handshaker_create(
   options.self_assertions = {self_assertions.cbegin(), self_assertions.cend()};
   options.accepted_peer_assertions = {accepted_peer_assertions.cbegin(),
                                       accepted_peer_assertions.cend()};
+  options.session_ticket_issuer = std::move(session_ticket_issuer);
+  options.session_cache = std::move(session_cache);
+  options.session_cache_key = std::string(session_cache_key);
 
   if (!options.additional_authenticated_data.empty()) {
     gpr_log(GPR_DEBUG, "additional authenticated data: %s",
@@ -448,7 +517,7 @@ tsi_result tsi_enclave_handshaker_create(
   }
 
   asylo::tsi_enclave_handshaker *tsi_handshaker =
-      new asylo::tsi_enclave_handshaker(is_client, peer_acl,
+      new asylo::tsi_enclave_handshaker(is_client, peer_acl, max_frame_size,
                                         std::move(ekep_handshaker));
 
   *handshaker = &tsi_handshaker->base;
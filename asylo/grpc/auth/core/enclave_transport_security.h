@@ -19,9 +19,13 @@
 #ifndef ASYLO_GRPC_AUTH_CORE_ENCLAVE_TRANSPORT_SECURITY_H_
 #define ASYLO_GRPC_AUTH_CORE_ENCLAVE_TRANSPORT_SECURITY_H_
 
+#include <cstddef>
+#include <memory>
+
 #include "absl/strings/string_view.h"
 #include "absl/types/optional.h"
 #include "absl/types/span.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
 #include "asylo/identity/identity.pb.h"
 #include "asylo/identity/identity_acl.pb.h"
 #include "src/core/tsi/transport_security_interface.h"
@@ -47,11 +51,25 @@
 //   the handshake
 //   * |peer_acl| is the ACL evaluated using the authenticated peer's
 //   identities.
+//   * |max_frame_size| is the maximum size of protected frames, used when the
+//   caller of the handshaker result's protector factories does not request a
+//   size.
+//   * |session_ticket_issuer| is the issuer of session tickets, used only by
+//   server handshakers. It may be nullptr.
+//   * |session_cache| is the cache of session tickets, used only by client
+//   handshakers. It may be nullptr.
+//   * |session_cache_key| identifies the server in |session_cache|.
+//
+// Handshaker results produced by the handshaker create both zero-copy gRPC
+// protectors and frame protectors.
 tsi_result tsi_enclave_handshaker_create(
     bool is_client, absl::Span<asylo::AssertionDescription> self_assertions,
     absl::Span<asylo::AssertionDescription> accepted_peer_assertions,
     absl::string_view additional_authenticated_data,
     const absl::optional<asylo::IdentityAclPredicate> &peer_acl,
-    tsi_handshaker **handshaker);
+    absl::optional<size_t> max_frame_size,
+    std::shared_ptr<asylo::EkepSessionTicketIssuer> session_ticket_issuer,
+    std::shared_ptr<asylo::EkepSessionCache> session_cache,
+    absl::string_view session_cache_key, tsi_handshaker **handshaker);
 
 #endif  // ASYLO_GRPC_AUTH_CORE_ENCLAVE_TRANSPORT_SECURITY_H_
@@ -0,0 +1,591 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/grpc/auth/core/enclave_transport_security.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "absl/types/span.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+#include "asylo/identity/attestation/null/null_identity_util.h"
+#include "asylo/identity/descriptions.h"
+#include "asylo/identity/enclave_assertion_authority_config.pb.h"
+#include "asylo/identity/identity.pb.h"
+#include "asylo/identity/identity_acl.pb.h"
+#include "asylo/identity/init.h"
+#include "asylo/test/util/enclave_assertion_authority_configs.h"
+#include "asylo/test/util/proto_matchers.h"
+#include "asylo/test/util/status_matchers.h"
+#include "include/grpc/grpc.h"
+#include "include/grpc/slice.h"
+#include "include/grpc/slice_buffer.h"
+#include "src/core/tsi/transport_security_grpc.h"
+#include "src/core/tsi/transport_security_interface.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Field;
+using ::testing::Gt;
+using ::testing::Le;
+using ::testing::Ne;
+using ::testing::Optional;
+
+constexpr char kSessionCacheKey[] = "ekep server";
+
+// The number of handshake messages the client sends in a full handshake
+// (ClientPrecommit, ClientId, ClientFinish) and in a resumed handshake
+// (ClientPrecommit, ClientFinish).
+constexpr int kFullHandshakeClientFlights = 3;
+constexpr int kResumedHandshakeClientFlights = 2;
+
+// An upper bound on the number of exchanges in a handshake.
+constexpr int kMaxHandshakeExchanges = 10;
+
+// The max frame size given to the handshakers, and the one requested from their
+// results as the GRPC_ARG_TSI_MAX_FRAME_SIZE channel argument would.
+constexpr size_t kConfiguredMaxFrameSize = 4096;
+constexpr size_t kRequestedMaxFrameSize = 2048;
+
+// The size of the messages passed through protectors, which spans several
+// frames of either max size, and of the slices holding them.
+constexpr size_t kProtectedMessageSize = 5 * kConfiguredMaxFrameSize + 123;
+constexpr size_t kMessageSliceSize = 1000;
+
+// The size of the length field that starts each protected frame.
+constexpr size_t kFrameLengthSize = 4;
+
+// The result of a handshake between a client and a server handshaker.
+struct HandshakeOutcome {
+  tsi_result client_result = TSI_OK;
+  tsi_result server_result = TSI_OK;
+
+  // The number of times the client sent bytes to the server.
+  int client_flights = 0;
+
+  // The peer identities reported by each side once its handshake completed.
+  EnclaveIdentities client_peer_identities;
+  EnclaveIdentities server_peer_identities;
+};
+
+// Returns an ACL that matches the null identity.
+IdentityAclPredicate NullIdentityAcl() {
+  IdentityAclPredicate acl;
+  *acl.mutable_expectation() = CreateNullIdentityExpectation();
+  return acl;
+}
+
+// Returns an ACL that has the description of a null-identity ACL but does not
+// match the null identity.
+IdentityAclPredicate MismatchedNullIdentityAcl() {
+  IdentityAclPredicate acl = NullIdentityAcl();
+  acl.mutable_expectation()->mutable_reference_identity()->set_identity(
+      "not the null identity");
+  return acl;
+}
+
+// Passes |input| to |handshaker| and appends the bytes it produces to |output|.
+tsi_result HandshakeStep(tsi_handshaker *handshaker, const std::string &input,
+                         std::string *output, tsi_handshaker_result **result) {
+  const unsigned char *bytes_to_send = nullptr;
+  size_t bytes_to_send_size = 0;
+  tsi_result status = tsi_handshaker_next(
+      handshaker, reinterpret_cast<const unsigned char *>(input.data()),
+      input.size(), &bytes_to_send, &bytes_to_send_size, result,
+      /*cb=*/nullptr, /*user_data=*/nullptr);
+  if (bytes_to_send_size > 0) {
+    output->append(reinterpret_cast<const char *>(bytes_to_send),
+                   bytes_to_send_size);
+  }
+  return status;
+}
+
+// Extracts the peer identities from |result| into |identities| and destroys
+// |result|.
+void ConsumeHandshakerResult(tsi_handshaker_result *result,
+                             EnclaveIdentities *identities) {
+  tsi_peer peer;
+  ASSERT_THAT(tsi_handshaker_result_extract_peer(result, &peer), Eq(TSI_OK));
+  tsi_handshaker_result_destroy(result);
+
+  bool found = false;
+  for (size_t i = 0; i < peer.property_count; ++i) {
+    const tsi_peer_property &property = peer.properties[i];
+    if (std::strcmp(property.name,
+                    TSI_ENCLAVE_IDENTITIES_PROTO_PEER_PROPERTY) == 0) {
+      found = identities->ParseFromArray(
+          property.value.data, static_cast<int>(property.value.length));
+    }
+  }
+  tsi_peer_destruct(&peer);
+  EXPECT_TRUE(found);
+}
+
+bool InProgress(tsi_result result) {
+  return result == TSI_OK || result == TSI_INCOMPLETE_DATA;
+}
+
+// Returns the bytes in |slices|.
+std::string Flatten(const grpc_slice_buffer &slices) {
+  std::string bytes;
+  for (size_t i = 0; i < slices.count; ++i) {
+    bytes.append(
+        reinterpret_cast<const char *>(GRPC_SLICE_START_PTR(slices.slices[i])),
+        GRPC_SLICE_LENGTH(slices.slices[i]));
+  }
+  return bytes;
+}
+
+// Protects a message spanning several frames with |sender| and unprotects it
+// with |receiver|. Checks that the message is intact and that no protected
+// frame exceeds |max_frame_size|.
+void ExpectProtectedRoundTrip(tsi_zero_copy_grpc_protector *sender,
+                              tsi_zero_copy_grpc_protector *receiver,
+                              size_t max_frame_size) {
+  std::string message(kProtectedMessageSize, '\0');
+  for (size_t i = 0; i < message.size(); ++i) {
+    message[i] = static_cast<char>(i % 251);
+  }
+
+  grpc_slice_buffer unprotected_slices;
+  grpc_slice_buffer protected_slices;
+  grpc_slice_buffer received_slices;
+  grpc_slice_buffer_init(&unprotected_slices);
+  grpc_slice_buffer_init(&protected_slices);
+  grpc_slice_buffer_init(&received_slices);
+  for (size_t offset = 0; offset < message.size();
+       offset += kMessageSliceSize) {
+    grpc_slice_buffer_add(
+        &unprotected_slices,
+        grpc_slice_from_copied_buffer(
+            message.data() + offset,
+            std::min(kMessageSliceSize, message.size() - offset)));
+  }
+
+  EXPECT_THAT(tsi_zero_copy_grpc_protector_protect(sender, &unprotected_slices,
+                                                   &protected_slices),
+              Eq(TSI_OK));
+  EXPECT_THAT(unprotected_slices.length, Eq(0));
+
+  // Each frame is a little-endian length followed by that many bytes.
+  std::string frames = Flatten(protected_slices);
+  int frame_count = 0;
+  size_t offset = 0;
+  while (offset + kFrameLengthSize <= frames.size()) {
+    uint32_t length = 0;
+    for (size_t i = 0; i < kFrameLengthSize; ++i) {
+      length |= static_cast<uint32_t>(static_cast<uint8_t>(frames[offset + i]))
+                << (8 * i);
+    }
+    EXPECT_THAT(kFrameLengthSize + length, Le(max_frame_size));
+    offset += kFrameLengthSize + length;
+    ++frame_count;
+  }
+  EXPECT_THAT(offset, Eq(frames.size()));
+  EXPECT_THAT(frame_count, Gt(1));
+
+  EXPECT_THAT(tsi_zero_copy_grpc_protector_unprotect(
+                  receiver, &protected_slices, &received_slices),
+              Eq(TSI_OK));
+  EXPECT_THAT(Flatten(received_slices), Eq(message));
+
+  grpc_slice_buffer_destroy(&unprotected_slices);
+  grpc_slice_buffer_destroy(&protected_slices);
+  grpc_slice_buffer_destroy(&received_slices);
+}
+
+// Drives a pair of enclave TSI handshakers, and through them a
+// ClientEkepHandshaker and a ServerEkepHandshaker, through EKEP handshakes.
+// All handshakes share one client session cache, so the tests can observe
+// session resumption across connections.
+class EnclaveTransportSecurityTest : public ::testing::Test {
+ protected:
+  static void SetUpTestSuite() {
+    std::vector<EnclaveAssertionAuthorityConfig> authority_configs = {
+        GetNullAssertionAuthorityTestConfig()};
+    ASSERT_THAT(InitializeEnclaveAssertionAuthorities(
+                    authority_configs.cbegin(), authority_configs.cend()),
+                IsOk());
+    grpc_init();
+  }
+
+  static void TearDownTestSuite() { grpc_shutdown(); }
+
+  void SetUp() override {
+    AssertionDescription null_assertion_description;
+    SetNullAssertionDescription(&null_assertion_description);
+    assertions_ = {null_assertion_description};
+
+    ASYLO_ASSERT_OK_AND_ASSIGN(issuer_,
+                               EkepSessionTicketIssuer::Create(absl::Hours(1)));
+    session_cache_ = std::make_shared<EkepSessionCache>(absl::Hours(1));
+  }
+
+  // Runs a handshake between a client that uses session_cache_ and a server
+  // that issues and redeems tickets with |issuer|, and writes its result to
+  // |outcome|. |client_acl| and |server_acl| are the peer ACLs of the client
+  // and the server.
+  void RunHandshake(std::shared_ptr<EkepSessionTicketIssuer> issuer,
+                    const absl::optional<IdentityAclPredicate> &client_acl,
+                    const absl::optional<IdentityAclPredicate> &server_acl,
+                    HandshakeOutcome *outcome) {
+    tsi_handshaker_result *client_result = nullptr;
+    tsi_handshaker_result *server_result = nullptr;
+    ASSERT_NO_FATAL_FAILURE(RunHandshake(
+        std::move(issuer), client_acl, server_acl,
+        /*max_frame_size=*/absl::nullopt, outcome, &client_result,
+        &server_result));
+    if (client_result) {
+      ConsumeHandshakerResult(client_result, &outcome->client_peer_identities);
+    }
+    if (server_result) {
+      ConsumeHandshakerResult(server_result, &outcome->server_peer_identities);
+    }
+  }
+
+  // As above, but with handshakers that use |max_frame_size|. Places the
+  // handshaker results of the client and the server, which the caller must
+  // destroy, in |client_result| and |server_result|, and does not extract the
+  // peer identities.
+  void RunHandshake(std::shared_ptr<EkepSessionTicketIssuer> issuer,
+                    const absl::optional<IdentityAclPredicate> &client_acl,
+                    const absl::optional<IdentityAclPredicate> &server_acl,
+                    absl::optional<size_t> max_frame_size,
+                    HandshakeOutcome *outcome,
+                    tsi_handshaker_result **client_result,
+                    tsi_handshaker_result **server_result) {
+    std::vector<AssertionDescription> client_assertions = assertions_;
+    std::vector<AssertionDescription> server_assertions = assertions_;
+
+    tsi_handshaker *client = nullptr;
+    ASSERT_THAT(
+        tsi_enclave_handshaker_create(
+            /*is_client=*/true, absl::MakeSpan(client_assertions),
+            absl::MakeSpan(client_assertions),
+            /*additional_authenticated_data=*/"", client_acl, max_frame_size,
+            /*session_ticket_issuer=*/nullptr, session_cache_,
+            kSessionCacheKey, &client),
+        Eq(TSI_OK));
+    tsi_handshaker *server = nullptr;
+    ASSERT_THAT(
+        tsi_enclave_handshaker_create(
+            /*is_client=*/false, absl::MakeSpan(server_assertions),
+            absl::MakeSpan(server_assertions),
+            /*additional_authenticated_data=*/"", server_acl, max_frame_size,
+            std::move(issuer),
+            /*session_cache=*/nullptr, /*session_cache_key=*/"", &server),
+        Eq(TSI_OK));
+
+    std::string to_server;
+    std::string to_client;
+
+    outcome->client_result =
+        HandshakeStep(client, /*input=*/"", &to_server, client_result);
+    if (!to_server.empty()) {
+      ++outcome->client_flights;
+    }
+    for (int i = 0; i < kMaxHandshakeExchanges &&
+                    InProgress(outcome->client_result) &&
+                    InProgress(outcome->server_result) &&
+                    !(*client_result && *server_result);
+         ++i) {
+      if (!to_server.empty()) {
+        std::string input;
+        input.swap(to_server);
+        outcome->server_result =
+            HandshakeStep(server, input, &to_client, server_result);
+        if (!InProgress(outcome->server_result)) {
+          break;
+        }
+      }
+      if (!to_client.empty()) {
+        std::string input;
+        input.swap(to_client);
+        outcome->client_result =
+            HandshakeStep(client, input, &to_server, client_result);
+        if (!to_server.empty()) {
+          ++outcome->client_flights;
+        }
+      }
+    }
+    tsi_handshaker_destroy(client);
+    tsi_handshaker_destroy(server);
+  }
+
+  // Runs a handshake with handshakers that use kConfiguredMaxFrameSize, and
+  // creates zero-copy protectors from both results with a max frame size of
+  // |requested_max_frame_size|, if set. Checks that the protectors use
+  // |expected_max_frame_size| and that they exchange messages spanning
+  // several frames in both directions.
+  void ExpectZeroCopyProtectorsExchangeMessages(
+      absl::optional<size_t> requested_max_frame_size,
+      size_t expected_max_frame_size) {
+    HandshakeOutcome outcome;
+    tsi_handshaker_result *client_result = nullptr;
+    tsi_handshaker_result *server_result = nullptr;
+    ASSERT_NO_FATAL_FAILURE(RunHandshake(
+        issuer_, /*client_acl=*/absl::nullopt, /*server_acl=*/absl::nullopt,
+        kConfiguredMaxFrameSize, &outcome, &client_result, &server_result));
+    ASSERT_THAT(outcome.client_result, Eq(TSI_OK));
+    ASSERT_THAT(outcome.server_result, Eq(TSI_OK));
+    ASSERT_NE(client_result, nullptr);
+    ASSERT_NE(server_result, nullptr);
+
+    size_t client_max_frame_size = requested_max_frame_size.value_or(0);
+    size_t server_max_frame_size = requested_max_frame_size.value_or(0);
+    tsi_zero_copy_grpc_protector *client_protector = nullptr;
+    tsi_zero_copy_grpc_protector *server_protector = nullptr;
+    EXPECT_THAT(tsi_handshaker_result_create_zero_copy_grpc_protector(
+                    client_result,
+                    requested_max_frame_size.has_value()
+                        ? &client_max_frame_size
+                        : nullptr,
+                    &client_protector),
+                Eq(TSI_OK));
+    EXPECT_THAT(tsi_handshaker_result_create_zero_copy_grpc_protector(
+                    server_result,
+                    requested_max_frame_size.has_value()
+                        ? &server_max_frame_size
+                        : nullptr,
+                    &server_protector),
+                Eq(TSI_OK));
+    tsi_handshaker_result_destroy(client_result);
+    tsi_handshaker_result_destroy(server_result);
+    ASSERT_NE(client_protector, nullptr);
+    ASSERT_NE(server_protector, nullptr);
+
+    for (tsi_zero_copy_grpc_protector *protector :
+         {client_protector, server_protector}) {
+      size_t max_frame_size = 0;
+      EXPECT_THAT(
+          tsi_zero_copy_grpc_protector_max_frame_size(protector,
+                                                      &max_frame_size),
+          Eq(TSI_OK));
+      EXPECT_THAT(max_frame_size, Eq(expected_max_frame_size));
+    }
+    ExpectProtectedRoundTrip(client_protector, server_protector,
+                             expected_max_frame_size);
+    ExpectProtectedRoundTrip(server_protector, client_protector,
+                             expected_max_frame_size);
+
+    tsi_zero_copy_grpc_protector_destroy(client_protector);
+    tsi_zero_copy_grpc_protector_destroy(server_protector);
+  }
+
+  // Runs a handshake without peer ACLs against a server that uses issuer_.
+  void RunHandshake(HandshakeOutcome *outcome) {
+    RunHandshake(issuer_, /*client_acl=*/absl::nullopt,
+                 /*server_acl=*/absl::nullopt, outcome);
+  }
+
+  // Returns the session ticket cached by the client, or an empty string if
+  // there is none.
+  std::string CachedTicket() {
+    absl::optional<EkepSessionCache::Entry> entry =
+        session_cache_->Lookup(kSessionCacheKey);
+    return entry.has_value() ? entry->session_ticket : "";
+  }
+
+  std::vector<AssertionDescription> assertions_;
+  std::shared_ptr<EkepSessionTicketIssuer> issuer_;
+  std::shared_ptr<EkepSessionCache> session_cache_;
+};
+
+// Verify that a full handshake leaves a ticket in the client's cache and that
+// the next handshake resumes the session with it, restoring the identities
+// that were verified in the full handshake on both sides.
+TEST_F(EnclaveTransportSecurityTest, ResumesSessionWithTicket) {
+  HandshakeOutcome full;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(&full));
+  ASSERT_THAT(full.client_result, Eq(TSI_OK));
+  ASSERT_THAT(full.server_result, Eq(TSI_OK));
+  EXPECT_THAT(full.client_flights, Eq(kFullHandshakeClientFlights));
+  EXPECT_THAT(full.client_peer_identities.identities_size(), Eq(1));
+  EXPECT_THAT(full.server_peer_identities.identities_size(), Eq(1));
+
+  std::string ticket = CachedTicket();
+  ASSERT_THAT(ticket, Ne(""));
+
+  HandshakeOutcome resumed;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(&resumed));
+  ASSERT_THAT(resumed.client_result, Eq(TSI_OK));
+  ASSERT_THAT(resumed.server_result, Eq(TSI_OK));
+  EXPECT_THAT(resumed.client_flights, Eq(kResumedHandshakeClientFlights));
+  EXPECT_THAT(resumed.client_peer_identities,
+              EqualsProto(full.client_peer_identities));
+  EXPECT_THAT(resumed.server_peer_identities,
+              EqualsProto(full.server_peer_identities));
+
+  // A resumed handshake does not issue a new ticket, so the original ticket
+  // stays in the cache.
+  EXPECT_THAT(CachedTicket(), Eq(ticket));
+}
+
+// Verify that the server declines a tampered ticket and that the handshake
+// falls back to a full exchange, after which the client holds a fresh ticket
+// that resumes the next session.
+TEST_F(EnclaveTransportSecurityTest, FallsBackToFullHandshakeOnTamperedTicket) {
+  HandshakeOutcome full;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(&full));
+  ASSERT_THAT(full.client_result, Eq(TSI_OK));
+
+  absl::optional<EkepSessionCache::Entry> entry =
+      session_cache_->Lookup(kSessionCacheKey);
+  ASSERT_TRUE(entry.has_value());
+  entry->session_ticket.back() ^= 1;
+  std::string tampered_ticket = entry->session_ticket;
+  session_cache_->Insert(kSessionCacheKey, *std::move(entry));
+
+  HandshakeOutcome fallback;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(&fallback));
+  ASSERT_THAT(fallback.client_result, Eq(TSI_OK));
+  ASSERT_THAT(fallback.server_result, Eq(TSI_OK));
+  EXPECT_THAT(fallback.client_flights, Eq(kFullHandshakeClientFlights));
+  EXPECT_THAT(CachedTicket(), Ne(tampered_ticket));
+  EXPECT_THAT(CachedTicket(), Ne(""));
+
+  HandshakeOutcome resumed;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(&resumed));
+  ASSERT_THAT(resumed.client_result, Eq(TSI_OK));
+  ASSERT_THAT(resumed.server_result, Eq(TSI_OK));
+  EXPECT_THAT(resumed.client_flights, Eq(kResumedHandshakeClientFlights));
+}
+
+// Verify that the server declines a ticket whose lifetime has elapsed and that
+// the handshake falls back to a full exchange.
+TEST_F(EnclaveTransportSecurityTest, FallsBackToFullHandshakeOnExpiredTicket) {
+  std::shared_ptr<EkepSessionTicketIssuer> short_lived_issuer;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      short_lived_issuer,
+      EkepSessionTicketIssuer::Create(absl::Milliseconds(1)));
+
+  HandshakeOutcome full;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(short_lived_issuer,
+                                       /*client_acl=*/absl::nullopt,
+                                       /*server_acl=*/absl::nullopt, &full));
+  ASSERT_THAT(full.client_result, Eq(TSI_OK));
+  std::string stale_ticket = CachedTicket();
+  ASSERT_THAT(stale_ticket, Ne(""));
+
+  absl::SleepFor(absl::Milliseconds(10));
+
+  HandshakeOutcome fallback;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(short_lived_issuer,
+                                       /*client_acl=*/absl::nullopt,
+                                       /*server_acl=*/absl::nullopt,
+                                       &fallback));
+  ASSERT_THAT(fallback.client_result, Eq(TSI_OK));
+  ASSERT_THAT(fallback.server_result, Eq(TSI_OK));
+  EXPECT_THAT(fallback.client_flights, Eq(kFullHandshakeClientFlights));
+  EXPECT_THAT(CachedTicket(), Ne(stale_ticket));
+}
+
+// Verify that a server that did not issue the ticket, such as one that was
+// restarted, declines it and completes a full handshake.
+TEST_F(EnclaveTransportSecurityTest,
+       FallsBackToFullHandshakeOnTicketFromOtherIssuer) {
+  HandshakeOutcome full;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(&full));
+  ASSERT_THAT(full.client_result, Eq(TSI_OK));
+  std::string ticket = CachedTicket();
+  ASSERT_THAT(ticket, Ne(""));
+
+  std::shared_ptr<EkepSessionTicketIssuer> other_issuer;
+  ASYLO_ASSERT_OK_AND_ASSIGN(other_issuer,
+                             EkepSessionTicketIssuer::Create(absl::Hours(1)));
+
+  HandshakeOutcome fallback;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(other_issuer,
+                                       /*client_acl=*/absl::nullopt,
+                                       /*server_acl=*/absl::nullopt,
+                                       &fallback));
+  ASSERT_THAT(fallback.client_result, Eq(TSI_OK));
+  ASSERT_THAT(fallback.server_result, Eq(TSI_OK));
+  EXPECT_THAT(fallback.client_flights, Eq(kFullHandshakeClientFlights));
+  EXPECT_THAT(CachedTicket(), Ne(ticket));
+}
+
+// Verify that the server evaluates its peer ACL against the client identities
+// restored from a ticket.
+TEST_F(EnclaveTransportSecurityTest, ServerAppliesAclToResumedSession) {
+  HandshakeOutcome full;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(issuer_, /*client_acl=*/absl::nullopt,
+                                       NullIdentityAcl(), &full));
+  ASSERT_THAT(full.server_result, Eq(TSI_OK));
+
+  HandshakeOutcome allowed;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(issuer_, /*client_acl=*/absl::nullopt,
+                                       NullIdentityAcl(), &allowed));
+  EXPECT_THAT(allowed.server_result, Eq(TSI_OK));
+  EXPECT_THAT(allowed.client_flights, Eq(kResumedHandshakeClientFlights));
+
+  HandshakeOutcome denied;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(issuer_, /*client_acl=*/absl::nullopt,
+                                       MismatchedNullIdentityAcl(), &denied));
+  EXPECT_THAT(denied.client_flights, Eq(kResumedHandshakeClientFlights));
+  EXPECT_THAT(denied.server_result, Eq(TSI_PERMISSION_DENIED));
+}
+
+// Verify that the client evaluates its peer ACL against the server identities
+// restored from its session cache.
+TEST_F(EnclaveTransportSecurityTest, ClientAppliesAclToResumedSession) {
+  HandshakeOutcome full;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(issuer_, NullIdentityAcl(),
+                                       /*server_acl=*/absl::nullopt, &full));
+  ASSERT_THAT(full.client_result, Eq(TSI_OK));
+  ASSERT_THAT(session_cache_->Lookup(kSessionCacheKey),
+              Optional(Field(&EkepSessionCache::Entry::peer_identities,
+                             EqualsProto(full.client_peer_identities))));
+
+  HandshakeOutcome denied;
+  ASSERT_NO_FATAL_FAILURE(RunHandshake(issuer_, MismatchedNullIdentityAcl(),
+                                       /*server_acl=*/absl::nullopt, &denied));
+  EXPECT_THAT(denied.client_flights, Eq(kResumedHandshakeClientFlights));
+  EXPECT_THAT(denied.client_result, Eq(TSI_PERMISSION_DENIED));
+}
+
+// Verify that zero-copy protectors created from the handshaker results use the
+// max frame size given to the handshakers when none is requested.
+TEST_F(EnclaveTransportSecurityTest,
+       ZeroCopyProtectorsUseConfiguredMaxFrameSize) {
+  ExpectZeroCopyProtectorsExchangeMessages(
+      /*requested_max_frame_size=*/absl::nullopt, kConfiguredMaxFrameSize);
+}
+
+// Verify that a max frame size requested through the channel arguments takes
+// precedence over the one given to the handshakers.
+TEST_F(EnclaveTransportSecurityTest,
+       ZeroCopyProtectorsPreferRequestedMaxFrameSize) {
+  ExpectZeroCopyProtectorsExchangeMessages(kRequestedMaxFrameSize,
+                                           kRequestedMaxFrameSize);
+}
+
+}  // namespace
+}  // namespace asylo
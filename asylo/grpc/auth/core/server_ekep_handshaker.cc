@@ -21,6 +21,9 @@
 #include <openssl/curve25519.h>
 #include <openssl/rand.h>
 
+#include <string>
+#include <utility>
+
 #include <google/protobuf/io/zero_copy_stream_impl_lite.h>
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
@@ -29,11 +32,13 @@
 #include "asylo/grpc/auth/core/ekep_crypto.h"
 #include "asylo/grpc/auth/core/ekep_errors.h"
 #include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
 #include "asylo/grpc/auth/core/handshake.pb.h"
 #include "asylo/identity/identity.pb.h"
 #include "asylo/util/cleansing_types.h"
 #include "asylo/util/proto_enum_util.h"
 #include "asylo/util/status_macros.h"
+#include "asylo/util/statusor.h"
 
 namespace asylo {
 namespace {
@@ -64,8 +69,10 @@ ServerEkepHandshaker::ServerEkepHandshaker(const EkepHandshakerOptions &options)
       available_record_protocols_({ALTSRP_AES128_GCM}),
       available_ekep_versions_({"EKEP v1"}),
       additional_authenticated_data_(options.additional_authenticated_data),
+      session_ticket_issuer_(options.session_ticket_issuer),
       selected_cipher_suite_(UNKNOWN_HANDSHAKE_CIPHER),
       selected_record_protocol_(UNKNOWN_RECORD_PROTOCOL),
+      session_resumed_(false),
       expected_message_type_(CLIENT_PRECOMMIT),
       // The handshake is in progress for the server because it relies on the
       // client to act first.
@@ -231,6 +238,15 @@ Status ServerEkepHandshaker::HandleClientPrecommit(
                      "Received a challenge with incorrect size");
   }
 
+  // If the client presented a valid session ticket, skip the exchange of
+  // assertions and finish the handshake right after the ServerPrecommit.
+  if (RedeemSessionTicket(client_precommit)) {
+    session_resumed_ = true;
+    expected_message_type_ = CLIENT_FINISH;
+    ASYLO_RETURN_IF_ERROR(WriteServerPrecommit(output));
+    return WriteServerFinish(output);
+  }
+
   for (const AssertionOffer &offer : client_precommit.client_offers()) {
     const AssertionDescription &offer_desc = offer.description();
     // Request any assertion that the peer offered and that this handshaker is
@@ -375,6 +391,12 @@ Status ServerEkepHandshaker::WriteServerPrecommit(std::string *output) {
   }
   server_precommit.set_challenge(challenge.data(), challenge.size());
 
+  if (session_resumed_) {
+    ASYLO_RETURN_IF_ERROR(GenerateDhKeyPair());
+    server_precommit.mutable_resumption()->set_dh_public_key(
+        dh_public_key_.data(), dh_public_key_.size());
+  }
+
   for (const AssertionRequest &request : promised_assertions_) {
     const AssertionDescription &description = request.description();
     // Note that assertion generators were verified during creation of the
@@ -404,19 +426,7 @@ Status ServerEkepHandshaker::WriteServerPrecommit(std::string *output) {
 }
 
 Status ServerEkepHandshaker::WriteServerId(std::string *output) {
-  // Generate an ephemeral Diffie-Hellman key-pair for the negotiated cipher
-  // suite.
-  switch (selected_cipher_suite_) {
-    case CURVE25519_SHA256:
-      dh_public_key_.resize(X25519_PUBLIC_VALUE_LEN);
-      dh_private_key_.resize(X25519_PRIVATE_KEY_LEN);
-      X25519_keypair(dh_public_key_.data(), dh_private_key_.data());
-      break;
-    default:
-      LOG(ERROR) << "Server handshaker has bad cipher suite configuration";
-      return EkepError(Abort::INTERNAL_ERROR,
-                       "Error using selected cipher suite");
-  }
+  ASYLO_RETURN_IF_ERROR(GenerateDhKeyPair());
 
   ServerId server_id;
   server_id.set_dh_public_key(dh_public_key_.data(), dh_public_key_.size());
@@ -463,26 +473,122 @@ Status ServerEkepHandshaker::WriteServerFinish(std::string *output) {
   // At this stage in the protocol, the transcript is:
   //   hash(ClientPrecommit || ServerPrecommit || ClientId || ServerId)
   //
+  // or, when resuming a session:
+  //   hash(ClientPrecommit || ServerPrecommit)
+  //
   // This transcript is used by both the client and server to derive the EKEP
   // secrets.
   std::string transcript_hash;
   ASYLO_RETURN_IF_ERROR(GetTranscriptHash(&transcript_hash));
 
-  ASYLO_RETURN_IF_ERROR(
-      DeriveSecrets(selected_cipher_suite_, transcript_hash, client_public_key_,
-                    dh_private_key_, &primary_secret_, &authenticator_secret_));
+  ServerFinish server_finish;
+  if (session_resumed_) {
+    ASYLO_RETURN_IF_ERROR(DeriveResumedSecrets(
+        selected_cipher_suite_, transcript_hash, client_public_key_,
+        dh_private_key_, resumption_secret_, &primary_secret_,
+        &authenticator_secret_));
+  } else {
+    ASYLO_RETURN_IF_ERROR(DeriveSecrets(
+        selected_cipher_suite_, transcript_hash, client_public_key_,
+        dh_private_key_, &primary_secret_, &authenticator_secret_));
+    IssueSessionTicket(transcript_hash, &server_finish);
+  }
 
   CleansingVector<uint8_t> authenticator;
   ASYLO_RETURN_IF_ERROR(ComputeServerHandshakeAuthenticator(
       selected_cipher_suite_, authenticator_secret_, &authenticator));
 
-  ServerFinish server_finish;
   server_finish.set_handshake_authenticator(authenticator.data(),
                                             authenticator.size());
 
   return WriteFrameAndUpdateTranscript(SERVER_FINISH, server_finish, output);
 }
 
+Status ServerEkepHandshaker::GenerateDhKeyPair() {
+  // Generate an ephemeral Diffie-Hellman key-pair for the negotiated cipher
+  // suite.
+  switch (selected_cipher_suite_) {
+    case CURVE25519_SHA256:
+      dh_public_key_.resize(X25519_PUBLIC_VALUE_LEN);
+      dh_private_key_.resize(X25519_PRIVATE_KEY_LEN);
+      X25519_keypair(dh_public_key_.data(), dh_private_key_.data());
+      return absl::OkStatus();
+    default:
+      LOG(ERROR) << "Server handshaker has bad cipher suite configuration";
+      return EkepError(Abort::INTERNAL_ERROR,
+                       "Error using selected cipher suite");
+  }
+}
+
+bool ServerEkepHandshaker::RedeemSessionTicket(
+    const ClientPrecommit &client_precommit) {
+  if (!session_ticket_issuer_ || !client_precommit.has_resumption()) {
+    return false;
+  }
+  const SessionResumption &resumption = client_precommit.resumption();
+
+  StatusOr<SessionTicketContents> contents_result =
+      session_ticket_issuer_->Redeem(resumption.session_ticket());
+  if (!contents_result.ok()) {
+    VLOG(1) << "Declining session resumption: " << contents_result.status();
+    return false;
+  }
+  const SessionTicketContents &contents = contents_result.value();
+
+  // The resumed session must use the parameters that were negotiated for the
+  // original session.
+  if (contents.cipher_suite() != selected_cipher_suite_ ||
+      contents.record_protocol() != selected_record_protocol_) {
+    VLOG(1) << "Declining session resumption: negotiated parameters differ "
+            << "from those of the original session";
+    return false;
+  }
+
+  for (const EnclaveIdentity &identity :
+       contents.peer_identities().identities()) {
+    AddPeerIdentity(identity);
+  }
+  resumption_secret_.assign(contents.resumption_secret().cbegin(),
+                            contents.resumption_secret().cend());
+  client_public_key_.assign(resumption.dh_public_key().cbegin(),
+                            resumption.dh_public_key().cend());
+  return true;
+}
+
+void ServerEkepHandshaker::IssueSessionTicket(
+    const std::string &transcript_hash, ServerFinish *server_finish) {
+  if (!session_ticket_issuer_) {
+    return;
+  }
+
+  // A failure to issue a ticket only prevents the client from resuming the
+  // session later, so it does not abort the handshake.
+  CleansingVector<uint8_t> resumption_secret;
+  Status status = DeriveResumptionSecret(selected_cipher_suite_,
+                                         transcript_hash, primary_secret_,
+                                         &resumption_secret);
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to derive resumption secret: " << status;
+    return;
+  }
+
+  SessionTicketContents contents;
+  contents.set_resumption_secret(resumption_secret.data(),
+                                 resumption_secret.size());
+  contents.set_cipher_suite(selected_cipher_suite_);
+  contents.set_record_protocol(selected_record_protocol_);
+  *contents.mutable_peer_identities() = PeerIdentities();
+
+  StatusOr<std::string> ticket_result =
+      session_ticket_issuer_->Issue(std::move(contents));
+  if (!ticket_result.ok()) {
+    LOG(WARNING) << "Failed to issue session ticket: "
+                 << ticket_result.status();
+    return;
+  }
+  server_finish->set_session_ticket(ticket_result.value());
+}
+
 bool ServerEkepHandshaker::SetSelectedEkepVersion(
     const google::protobuf::RepeatedPtrField<EkepVersion> &ekep_versions) {
   // Choose the first compatible EKEP version available.
@@ -28,6 +28,8 @@
 #include <google/protobuf/message.h>
 #include "asylo/grpc/auth/core/ekep_handshaker.h"
 #include "asylo/grpc/auth/core/ekep_handshaker_util.h"
+#include "asylo/grpc/auth/core/ekep_session_ticket.h"
+#include "asylo/grpc/auth/core/handshake.pb.h"
 #include "asylo/util/cleansing_types.h"
 
 namespace asylo {
@@ -97,9 +99,27 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   Status WriteServerId(std::string *output);
 
   // Writes the ServerFinish frame to |output| and updates the handshake
-  // transcript.
+  // transcript. At the end of a full handshake, the ServerFinish carries a
+  // session ticket if the handshaker has a ticket issuer.
   Status WriteServerFinish(std::string *output);
 
+  // Generates an ephemeral Diffie-Hellman key-pair for the selected cipher
+  // suite.
+  Status GenerateDhKeyPair();
+
+  // Returns true if |client_precommit| requests the resumption of a session
+  // with a valid session ticket from this server's issuer, in which case the
+  // handshaker takes the peer identities and resumption secret from the
+  // ticket. Returns false if the handshake should fall back to a full
+  // handshake.
+  bool RedeemSessionTicket(const ClientPrecommit &client_precommit);
+
+  // Issues a session ticket for the current session into |server_finish|,
+  // using the resumption secret derived from |transcript_hash|. Does nothing
+  // if the handshaker has no ticket issuer or if issuance fails.
+  void IssueSessionTicket(const std::string &transcript_hash,
+                          ServerFinish *server_finish);
+
   // Sets the handshaker's selected EKEP version to first compatible EKEP
   // version in |ekep_versions|. Returns false if there is no compatible EKEP
   // version in |ekep_versions|.
@@ -136,6 +156,9 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   // Additional data that is authenticated during the handshake.
   const std::string additional_authenticated_data_;
 
+  // The issuer of session tickets, or nullptr if sessions are not resumable.
+  const std::shared_ptr<EkepSessionTicketIssuer> session_ticket_issuer_;
+
   // Assertions requested by the client that the server is willing to offer.
   // This field is populated after validation of the ClientPrecommit message.
   std::vector<AssertionRequest> promised_assertions_;
@@ -169,6 +192,14 @@ class ServerEkepHandshaker final : public EkepHandshaker {
   CleansingVector<uint8_t> primary_secret_;
   CleansingVector<uint8_t> authenticator_secret_;
 
+  // Whether the handshake resumes a previous session. This field is populated
+  // after validation of the ClientPrecommit message.
+  bool session_resumed_;
+
+  // The resumption secret of the session being resumed, taken from the
+  // client's session ticket.
+  CleansingVector<uint8_t> resumption_secret_;
+
   // A snapshot of the transcript to which the client's assertions are bound:
   //   hash(ClientPrecommit || ServerPrecommit)
   std::string client_assertion_transcript_;
@@ -17,6 +17,8 @@
  */
 #include "asylo/grpc/auth/enclave_credentials_options.h"
 
+#include <algorithm>
+
 #include "asylo/identity/identity_acl.pb.h"
 
 namespace asylo {
@@ -48,6 +50,19 @@ EnclaveCredentialsOptions &EnclaveCredentialsOptions::Add(
       peer_acl = additional.peer_acl;
     }
   }
+  if (additional.max_frame_size.has_value()) {
+    max_frame_size = max_frame_size.has_value()
+                         ? std::min(max_frame_size.value(),
+                                    additional.max_frame_size.value())
+                         : additional.max_frame_size;
+  }
+  if (additional.session_ticket_lifetime.has_value()) {
+    session_ticket_lifetime =
+        session_ticket_lifetime.has_value()
+            ? std::min(session_ticket_lifetime.value(),
+                       additional.session_ticket_lifetime.value())
+            : additional.session_ticket_lifetime;
+  }
 
   return *this;
 }
@@ -19,8 +19,10 @@
 #ifndef ASYLO_GRPC_AUTH_ENCLAVE_CREDENTIALS_OPTIONS_H_
 #define ASYLO_GRPC_AUTH_ENCLAVE_CREDENTIALS_OPTIONS_H_
 
+#include <cstddef>
 #include <string>
 
+#include "absl/time/time.h"
 #include "absl/types/optional.h"
 #include "asylo/identity/assertion_description_util.h"
 #include "asylo/identity/identity.pb.h"
@@ -53,6 +55,21 @@ struct EnclaveCredentialsOptions {
   /// authenticated peer's identities will cause gRPC channel establishment to
   /// fail.
   absl::optional<IdentityAclPredicate> peer_acl;
+
+  /// The maximum size of a protected frame written to the peer. Large frames
+  /// let bulk RPCs amortize the cost of record protection. If unset, the value
+  /// of the `GRPC_ARG_TSI_MAX_FRAME_SIZE` channel argument is used, or gRPC's
+  /// default if that is also unset. The channel argument takes precedence
+  /// when both are set.
+  absl::optional<size_t> max_frame_size;
+
+  /// The lifetime of EKEP session tickets. If set, the server issues a session
+  /// ticket at the end of each handshake, and the client presents its ticket
+  /// when it reconnects to the same target. A handshake that resumes a
+  /// session skips the exchange of assertions and restores the peer
+  /// identities verified in the original handshake. If unset, every handshake
+  /// exchanges assertions.
+  absl::optional<absl::Duration> session_ticket_lifetime;
 };
 
 }  // namespace asylo
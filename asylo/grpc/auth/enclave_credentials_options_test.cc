@@ -20,6 +20,7 @@
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include "absl/time/time.h"
 #include "asylo/grpc/auth/null_credentials_options.h"
 #include "asylo/grpc/auth/sgx_local_credentials_options.h"
 #include "asylo/identity/descriptions.h"
@@ -30,6 +31,7 @@
 namespace asylo {
 namespace {
 
+using ::testing::Optional;
 using ::testing::Test;
 using ::testing::UnorderedElementsAre;
 
@@ -151,5 +153,37 @@ TEST_F(EnclaveCredentialsOptionsTest, CombineIdentityAclPredicates) {
   EXPECT_THAT(lhs.Add(rhs).peer_acl, Optional(EqualsProto(combined)));
 }
 
+TEST_F(EnclaveCredentialsOptionsTest, CombineMaxFrameSizeOnlyRhs) {
+  EnclaveCredentialsOptions rhs = BidirectionalNullCredentialsOptions();
+  rhs.max_frame_size = size_t{1} << 20;
+  EXPECT_THAT(BidirectionalSgxLocalCredentialsOptions().Add(rhs).max_frame_size,
+              Optional(size_t{1} << 20));
+}
+
+TEST_F(EnclaveCredentialsOptionsTest, CombineMaxFrameSizeTakesSmaller) {
+  EnclaveCredentialsOptions lhs = BidirectionalSgxLocalCredentialsOptions();
+  lhs.max_frame_size = size_t{1} << 20;
+  EnclaveCredentialsOptions rhs = BidirectionalNullCredentialsOptions();
+  rhs.max_frame_size = size_t{64} << 10;
+  EXPECT_THAT(lhs.Add(rhs).max_frame_size, Optional(size_t{64} << 10));
+}
+
+TEST_F(EnclaveCredentialsOptionsTest, CombineSessionTicketLifetimeOnlyLhs) {
+  EnclaveCredentialsOptions lhs = BidirectionalSgxLocalCredentialsOptions();
+  lhs.session_ticket_lifetime = absl::Hours(1);
+  EXPECT_THAT(lhs.Add(BidirectionalNullCredentialsOptions())
+                  .session_ticket_lifetime,
+              Optional(absl::Hours(1)));
+}
+
+TEST_F(EnclaveCredentialsOptionsTest, CombineSessionTicketLifetimeTakesShorter) {
+  EnclaveCredentialsOptions lhs = BidirectionalSgxLocalCredentialsOptions();
+  lhs.session_ticket_lifetime = absl::Hours(1);
+  EnclaveCredentialsOptions rhs = BidirectionalNullCredentialsOptions();
+  rhs.session_ticket_lifetime = absl::Minutes(5);
+  EXPECT_THAT(lhs.Add(rhs).session_ticket_lifetime,
+              Optional(absl::Minutes(5)));
+}
+
 }  // namespace
 }  // namespace asylo
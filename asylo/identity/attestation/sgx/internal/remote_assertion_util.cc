@@ -45,6 +45,7 @@
 #include "asylo/crypto/x509_certificate.h"
 #include "asylo/identity/attestation/sgx/internal/attestation_key_certificate_impl.h"
 #include "asylo/identity/attestation/sgx/internal/remote_assertion.pb.h"
+#include "asylo/identity/attestation/sgx/internal/verified_certificate_chain_cache.h"
 #include "asylo/identity/identity.pb.h"
 #include "asylo/identity/identity_acl.pb.h"
 #include "asylo/identity/identity_acl_evaluator.h"
@@ -84,48 +85,63 @@ StatusOr<std::unique_ptr<VerifyingKey>> CreateVerifyingKey(
                       key_proto.signature_scheme()));
 }
 
-StatusOr<CertificateInterfaceVector>
+StatusOr<std::shared_ptr<const VerifiedCertificateChain>>
 VerifyCertificateChainsAndExtractIntelCertificateChain(
     const google::protobuf::RepeatedPtrField<CertificateChain> &certificate_chains,
     const CertificateInterface &intel_root,
     CertificateInterfaceSpan additional_root_certificates,
     absl::string_view verifying_key_der) {
-  CertificateInterfaceVector intel_cert_chain;
+  std::shared_ptr<const VerifiedCertificateChain> intel_cert_chain;
   CertificateFactoryMap factory_map;
   factory_map.emplace(Certificate::X509_DER, X509Certificate::Create);
   factory_map.emplace(Certificate::X509_PEM, X509Certificate::Create);
   factory_map.emplace(Certificate::SGX_ATTESTATION_KEY_CERTIFICATE,
                       AttestationKeyCertificateImpl::Create);
 
-  std::vector<std::unique_ptr<CertificateInterface>> verified_root_certificates;
+  VerifiedCertificateChainCache *cache =
+      VerifiedCertificateChainCache::GetInstance();
+  std::vector<std::shared_ptr<const CertificateInterface>>
+      verified_root_certificates;
   VerificationConfig config(/*all_fields=*/true);
   for (const CertificateChain &certificate_chain : certificate_chains) {
-    CertificateInterfaceVector certificate_vector;
+    if (certificate_chain.certificates().empty()) {
+      return absl::InvalidArgumentError(
+          "Certificate chain must include at least one certificate");
+    }
+
+    // Only the chains that certify |verifying_key_der| are verified, so the
+    // leaf certificate is checked before the chain is handed to the cache.
+    CertificateChain end_user_chain;
+    *end_user_chain.add_certificates() = certificate_chain.certificates(0);
+    CertificateInterfaceVector end_user_certificate;
     ASYLO_ASSIGN_OR_RETURN(
-        certificate_vector,
-        CreateCertificateChain(factory_map, certificate_chain));
+        end_user_certificate,
+        CreateCertificateChain(factory_map, end_user_chain));
 
     std::string cert_chain_end_user_key_der;
     ASYLO_ASSIGN_OR_RETURN(cert_chain_end_user_key_der,
-                           certificate_vector[0]->SubjectKeyDer());
+                           end_user_certificate[0]->SubjectKeyDer());
     if (cert_chain_end_user_key_der != verifying_key_der) {
       continue;
     }
-    ASYLO_RETURN_IF_ERROR(WithContext(
-        VerifyCertificateChain(absl::MakeConstSpan(certificate_vector), config),
-        absl::StrCat(
-            "Failed to verify certificate chain with root cert ",
-            certificate_chain.certificates().rbegin()->ShortDebugString())));
-
-    if (*certificate_vector.back() == intel_root) {
-      intel_cert_chain = std::move(certificate_vector);
+    std::shared_ptr<const VerifiedCertificateChain> verified_chain;
+    ASYLO_ASSIGN_OR_RETURN(
+        verified_chain,
+        WithContext(
+            cache->Verify(factory_map, certificate_chain, config),
+            absl::StrCat(
+                "Failed to verify certificate chain with root cert ",
+                certificate_chain.certificates().rbegin()->ShortDebugString())));
+
+    if (*verified_chain->certificates.back() == intel_root) {
+      intel_cert_chain = std::move(verified_chain);
     } else {
-      verified_root_certificates.emplace_back(
-          certificate_vector.rbegin()->release());
+      verified_root_certificates.push_back(
+          verified_chain->certificates.back());
     }
   }
 
-  if (intel_cert_chain.empty()) {
+  if (intel_cert_chain == nullptr) {
     return Status(absl::StatusCode::kUnauthenticated,
                   "Intel certificate chain not found");
   }
@@ -137,7 +153,8 @@ VerifyCertificateChainsAndExtractIntelCertificateChain(
     if (!std::any_of(verified_root_certificates.begin(),
                      verified_root_certificates.end(),
                      [&required_root_certificate](
-                         const std::unique_ptr<CertificateInterface> &other) {
+                         const std::shared_ptr<const CertificateInterface>
+                             &other) {
                        return *required_root_certificate == *other;
                      })) {
       std::string subject_key;
@@ -150,7 +167,7 @@ VerifyCertificateChainsAndExtractIntelCertificateChain(
     }
   }
 
-  return std::move(intel_cert_chain);
+  return intel_cert_chain;
 }
 
 Status VerifyAgeExpectation(const IdentityAclPredicate &age_expectation,
@@ -257,26 +274,28 @@ Status VerifyRemoteAssertion(
   ASYLO_RETURN_IF_ERROR(
       verifying_key->Verify(assertion.payload(), assertion.signature()));
 
-  CertificateInterfaceVector intel_cert_chain;
+  std::shared_ptr<const VerifiedCertificateChain> intel_cert_chain;
   ASYLO_ASSIGN_OR_RETURN(intel_cert_chain,
                          VerifyCertificateChainsAndExtractIntelCertificateChain(
                              assertion.certificate_chains(), intel_root,
                              additional_root_certificates, verifying_key_der));
-  if (intel_cert_chain.size() < kIntelCertChainMinimumLength) {
+  const auto &intel_certificates = intel_cert_chain->certificates;
+  if (intel_certificates.size() < kIntelCertChainMinimumLength) {
     return absl::InvalidArgumentError(
         absl::StrFormat("Length of Intel certificate chain (%d) is shorter "
                         "than the minimum length (%d)",
-                        intel_cert_chain.size(), kIntelCertChainMinimumLength));
+                        intel_certificates.size(),
+                        kIntelCertChainMinimumLength));
   }
 
   MachineConfiguration peer_machine_config;
   ASYLO_ASSIGN_OR_RETURN(peer_machine_config,
                          ExtractMachineConfigurationFromPckCert(
-                             intel_cert_chain[kPckCertificateIndex].get()));
+                             intel_certificates[kPckCertificateIndex].get()));
 
   ASYLO_RETURN_IF_ERROR(VerifyAgeExpectation(
       age_identity_expectation,
-      intel_cert_chain[kAttestationKeyCertificateIndex].get(),
+      intel_certificates[kAttestationKeyCertificateIndex].get(),
       peer_machine_config));
 
   // Extract the code identity.
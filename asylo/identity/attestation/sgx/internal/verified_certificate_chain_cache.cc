@@ -0,0 +1,436 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/identity/attestation/sgx/internal/verified_certificate_chain_cache.h"
+
+#include <openssl/asn1.h>
+#include <openssl/base.h>
+#include <openssl/bio.h>
+#include <openssl/err.h>
+#include <openssl/mem.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "asylo/crypto/ecdsa_p256_sha256_signing_key.h"
+#include "asylo/crypto/sha256_hash.h"
+#include "asylo/crypto/util/bssl_util.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/util/status_helpers.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+// The lifetime of the entries of the process-wide cache.
+constexpr absl::Duration kDefaultEntryLifetime = absl::Hours(1);
+
+using CertificatePtr = std::shared_ptr<const CertificateInterface>;
+
+// Adds the size of |data| followed by |data| to |hash|, so that adjacent
+// fields cannot be confused with each other.
+void UpdateWithLengthPrefix(ByteContainerView data, Sha256Hash *hash) {
+  uint64_t size = data.size();
+  hash->Update(ByteContainerView(&size, sizeof(size)));
+  hash->Update(data);
+}
+
+// Returns the cache key of the certificates in |chain| starting at index
+// |first|, verified under |config|. The time at which validity periods are
+// checked is not part of the key, since it is checked again on every lookup.
+StatusOr<std::string> ChainKey(const CertificateChain &chain, int first,
+                               const VerificationConfig &config) {
+  const uint8_t checks[] = {config.issuer_ca, config.max_pathlen,
+                            config.issuer_key_usage,
+                            config.subject_validity_period.has_value()};
+  Sha256Hash hash;
+  hash.Update(checks);
+  for (int i = first; i < chain.certificates_size(); ++i) {
+    const Certificate &certificate = chain.certificates(i);
+    int32_t format = certificate.format();
+    hash.Update(ByteContainerView(&format, sizeof(format)));
+    UpdateWithLengthPrefix(certificate.data(), &hash);
+  }
+
+  std::vector<uint8_t> digest;
+  ASYLO_RETURN_IF_ERROR(hash.CumulativeHash(&digest));
+  return std::string(digest.begin(), digest.end());
+}
+
+// Returns the DER encoding of |value| produced by |encode|, which is one of the
+// BoringSSL i2d functions.
+template <typename T, typename Encoder>
+StatusOr<std::string> EncodeDer(T *value, Encoder encode) {
+  uint8_t *der = nullptr;
+  int length = encode(value, &der);
+  if (length < 0) {
+    return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+  }
+  bssl::UniquePtr<uint8_t> deleter(der);
+  return std::string(reinterpret_cast<const char *>(der), length);
+}
+
+// Parses |crl|.
+StatusOr<bssl::UniquePtr<X509_CRL>> ParseRevocationList(
+    const CertificateRevocationList &crl) {
+  bssl::UniquePtr<BIO> crl_bio(
+      BIO_new_mem_buf(crl.data().data(), crl.data().size()));
+  bssl::UniquePtr<X509_CRL> x509_crl;
+  switch (crl.format()) {
+    case CertificateRevocationList::X509_DER:
+      x509_crl.reset(d2i_X509_CRL_bio(crl_bio.get(), /*crl=*/nullptr));
+      break;
+    case CertificateRevocationList::X509_PEM:
+      x509_crl.reset(PEM_read_bio_X509_CRL(crl_bio.get(), /*x=*/nullptr,
+                                           /*cb=*/nullptr, /*u=*/nullptr));
+      break;
+    default:
+      return Status(absl::StatusCode::kInvalidArgument,
+                    "Unsupported CRL format");
+  }
+  if (x509_crl == nullptr) {
+    return Status(absl::StatusCode::kInvalidArgument, BsslLastErrorString());
+  }
+  return std::move(x509_crl);
+}
+
+// Sets |issuer| and |serial_number| to the DER encodings of the issuer name
+// and the serial number of |certificate|. Leaves both empty if |certificate| is
+// not an X.509 certificate.
+Status GetX509Id(const Certificate &certificate, std::string *issuer,
+                 std::string *serial_number) {
+  issuer->clear();
+  serial_number->clear();
+  bssl::UniquePtr<BIO> cert_bio(BIO_new_mem_buf(certificate.data().data(),
+                                                certificate.data().size()));
+  bssl::UniquePtr<X509> x509;
+  switch (certificate.format()) {
+    case Certificate::X509_DER:
+      x509.reset(d2i_X509_bio(cert_bio.get(), /*x509=*/nullptr));
+      break;
+    case Certificate::X509_PEM:
+      x509.reset(PEM_read_bio_X509(cert_bio.get(), /*x=*/nullptr,
+                                   /*cb=*/nullptr, /*u=*/nullptr));
+      break;
+    default:
+      return absl::OkStatus();
+  }
+  if (x509 == nullptr) {
+    // Certificates that do not parse are rejected by the certificate factory.
+    ERR_clear_error();
+    return absl::OkStatus();
+  }
+  ASYLO_ASSIGN_OR_RETURN(
+      *issuer, EncodeDer(X509_get_issuer_name(x509.get()), i2d_X509_NAME));
+  ASYLO_ASSIGN_OR_RETURN(
+      *serial_number,
+      EncodeDer(X509_get_serialNumber(x509.get()), i2d_ASN1_INTEGER));
+  return absl::OkStatus();
+}
+
+// Checks that every certificate in |certificates| is valid at the time given
+// by |config|. Cached chains were verified at an earlier time, so this part of
+// the verification is repeated on every lookup.
+Status CheckValidityPeriods(const std::vector<CertificatePtr> &certificates,
+                            const VerificationConfig &config) {
+  if (!config.subject_validity_period.has_value()) {
+    return absl::OkStatus();
+  }
+  for (size_t i = 0; i < certificates.size(); ++i) {
+    bool within_period;
+    ASYLO_ASSIGN_OR_RETURN(within_period,
+                           certificates[i]->WithinValidityPeriod(
+                               config.subject_validity_period.value()));
+    if (!within_period) {
+      return Status(absl::StatusCode::kUnauthenticated,
+                    absl::StrCat("Certificate at index ", i,
+                                 " is not valid at this time"));
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Checks the path length constraints of |certificates| as
+// VerifyCertificateChain() does. Prepending a certificate to a verified chain
+// changes the path lengths of all the certificates above it, so the
+// constraints are checked for the whole chain.
+Status CheckPathLengths(const std::vector<CertificatePtr> &certificates,
+                        const VerificationConfig &config) {
+  if (!config.max_pathlen) {
+    return absl::OkStatus();
+  }
+  int64_t ca_count = 0;
+  for (size_t i = 0; i + 1 < certificates.size(); ++i) {
+    const CertificateInterface &issuer = *certificates[i + 1];
+    absl::optional<int64_t> max_pathlength = issuer.CertPathLength();
+    if (max_pathlength.has_value() && max_pathlength.value() < ca_count) {
+      return Status(absl::StatusCode::kUnauthenticated,
+                    absl::StrCat("Maximum pathlength of certificate at index ",
+                                 i, " exceeded. Maximum pathlength: ",
+                                 max_pathlength.value(),
+                                 ", current pathlength: ", ca_count));
+    }
+    if (issuer.IsCa().value_or(true)) {
+      ca_count++;
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Creates a VerifiedCertificateChain from the verified |certificates|.
+StatusOr<std::shared_ptr<const VerifiedCertificateChain>> MakeVerifiedChain(
+    std::vector<CertificatePtr> certificates) {
+  auto verified = std::make_shared<VerifiedCertificateChain>();
+  ASYLO_ASSIGN_OR_RETURN(verified->subject_key_der,
+                         certificates.front()->SubjectKeyDer());
+
+  // PCK certificates certify ECDSA P-256 keys. Other keys are left for the
+  // caller to parse.
+  auto verifying_key =
+      EcdsaP256Sha256VerifyingKey::CreateFromDer(verified->subject_key_der);
+  if (verifying_key.ok()) {
+    verified->subject_verifying_key = std::move(verifying_key).value();
+  }
+  verified->certificates = std::move(certificates);
+  return std::shared_ptr<const VerifiedCertificateChain>(std::move(verified));
+}
+
+}  // namespace
+
+VerifiedCertificateChainCache::VerifiedCertificateChainCache(
+    absl::Duration entry_lifetime, size_t max_entries)
+    : entry_lifetime_(entry_lifetime), max_entries_(max_entries) {}
+
+VerifiedCertificateChainCache *VerifiedCertificateChainCache::GetInstance() {
+  static VerifiedCertificateChainCache *instance =
+      new VerifiedCertificateChainCache(kDefaultEntryLifetime);
+  return instance;
+}
+
+StatusOr<std::shared_ptr<const VerifiedCertificateChain>>
+VerifiedCertificateChainCache::Verify(const CertificateFactoryMap &factory_map,
+                                      const CertificateChain &chain,
+                                      const VerificationConfig &config) {
+  if (chain.certificates().empty()) {
+    return Status(absl::StatusCode::kInvalidArgument,
+                  "Certificate chain must include at least one certificate");
+  }
+
+  const uint64_t start_generation = generation();
+  std::string key;
+  ASYLO_ASSIGN_OR_RETURN(key, ChainKey(chain, /*first=*/0, config));
+  std::vector<CertificateId> certificate_ids;
+  std::shared_ptr<const VerifiedCertificateChain> verified =
+      Lookup(key, &certificate_ids);
+  if (verified) {
+    ASYLO_RETURN_IF_ERROR(CheckValidityPeriods(verified->certificates, config));
+    return verified;
+  }
+
+  std::string issuer_key;
+  std::shared_ptr<const VerifiedCertificateChain> issuer_chain;
+  if (chain.certificates_size() > 1) {
+    ASYLO_ASSIGN_OR_RETURN(issuer_key, ChainKey(chain, /*first=*/1, config));
+    issuer_chain = Lookup(issuer_key, &certificate_ids);
+  }
+
+  // Cached chains carry the identifiers of their certificates, so only the
+  // certificates that are not covered by |issuer_chain| are parsed here.
+  const int first_cached = issuer_chain ? 1 : chain.certificates_size();
+  std::vector<CertificateId> uncached_ids(first_cached);
+  for (int i = 0; i < first_cached; ++i) {
+    ASYLO_RETURN_IF_ERROR(GetX509Id(chain.certificates(i),
+                                    &uncached_ids[i].issuer,
+                                    &uncached_ids[i].serial_number));
+  }
+  certificate_ids.insert(certificate_ids.begin(),
+                         std::make_move_iterator(uncached_ids.begin()),
+                         std::make_move_iterator(uncached_ids.end()));
+  ASYLO_RETURN_IF_ERROR(CheckNotRevoked(certificate_ids));
+
+  std::vector<CertificatePtr> certificates;
+  if (issuer_chain) {
+    // Only the leaf certificate has not been verified.
+    ASYLO_RETURN_IF_ERROR(
+        CheckValidityPeriods(issuer_chain->certificates, config));
+    CertificateChain leaf_chain;
+    *leaf_chain.add_certificates() = chain.certificates(0);
+    CertificateInterfaceVector leaf;
+    ASYLO_ASSIGN_OR_RETURN(leaf,
+                           CreateCertificateChain(factory_map, leaf_chain));
+    certificates.push_back(std::move(leaf.front()));
+    certificates.insert(certificates.end(), issuer_chain->certificates.begin(),
+                        issuer_chain->certificates.end());
+    ASYLO_RETURN_IF_ERROR(CheckPathLengths(certificates, config));
+    ASYLO_RETURN_IF_ERROR(
+        WithContext(certificates[0]->Verify(*certificates[1], config),
+                    "Failed to verify certificate at index 0"));
+  } else {
+    CertificateInterfaceVector parsed;
+    ASYLO_ASSIGN_OR_RETURN(parsed, CreateCertificateChain(factory_map, chain));
+    ASYLO_RETURN_IF_ERROR(
+        VerifyCertificateChain(absl::MakeConstSpan(parsed), config));
+    certificates.assign(std::make_move_iterator(parsed.begin()),
+                        std::make_move_iterator(parsed.end()));
+    if (certificates.size() > 1) {
+      ASYLO_ASSIGN_OR_RETURN(
+          issuer_chain,
+          MakeVerifiedChain({certificates.begin() + 1, certificates.end()}));
+      Insert(issuer_key, std::move(issuer_chain),
+             {certificate_ids.begin() + 1, certificate_ids.end()},
+             start_generation);
+    }
+  }
+
+  ASYLO_ASSIGN_OR_RETURN(verified, MakeVerifiedChain(std::move(certificates)));
+  Insert(key, verified, std::move(certificate_ids), start_generation);
+  return verified;
+}
+
+Status VerifiedCertificateChainCache::UpdateRevocationList(
+    const CertificateRevocationList &crl) {
+  ASYLO_RETURN_IF_ERROR(ValidateCertificateRevocationList(crl));
+  bssl::UniquePtr<X509_CRL> x509_crl;
+  ASYLO_ASSIGN_OR_RETURN(x509_crl, ParseRevocationList(crl));
+
+  std::string issuer;
+  ASYLO_ASSIGN_OR_RETURN(
+      issuer, EncodeDer(X509_CRL_get_issuer(x509_crl.get()), i2d_X509_NAME));
+  absl::flat_hash_set<std::string> serial_numbers;
+  STACK_OF(X509_REVOKED) *revoked = X509_CRL_get_REVOKED(x509_crl.get());
+  for (size_t i = 0; i < sk_X509_REVOKED_num(revoked); ++i) {
+    ASN1_INTEGER *serial_number = const_cast<ASN1_INTEGER *>(
+        X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, i)));
+    std::string serial_number_der;
+    ASYLO_ASSIGN_OR_RETURN(serial_number_der,
+                           EncodeDer(serial_number, i2d_ASN1_INTEGER));
+    serial_numbers.insert(std::move(serial_number_der));
+  }
+
+  absl::MutexLock lock(&mu_);
+  absl::flat_hash_set<std::string> &current = revoked_[issuer];
+  if (current == serial_numbers) {
+    return absl::OkStatus();
+  }
+  current = std::move(serial_numbers);
+  for (auto it = entries_.begin(); it != entries_.end();) {
+    const std::vector<CertificateId> &ids = it->second.certificate_ids;
+    if (std::any_of(ids.begin(), ids.end(), [this](const CertificateId &id) {
+          mu_.AssertHeld();
+          return IsRevoked(id);
+        })) {
+      entries_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+
+  // Chains that were being verified under the previous list are not inserted.
+  generation_++;
+  return absl::OkStatus();
+}
+
+void VerifiedCertificateChainCache::Clear() {
+  absl::MutexLock lock(&mu_);
+  entries_.clear();
+  generation_++;
+}
+
+size_t VerifiedCertificateChainCache::size() const {
+  absl::MutexLock lock(&mu_);
+  return entries_.size();
+}
+
+uint64_t VerifiedCertificateChainCache::generation() const {
+  absl::MutexLock lock(&mu_);
+  return generation_;
+}
+
+std::shared_ptr<const VerifiedCertificateChain>
+VerifiedCertificateChainCache::Lookup(
+    const std::string &key, std::vector<CertificateId> *certificate_ids) {
+  absl::MutexLock lock(&mu_);
+  auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    return nullptr;
+  }
+  if (it->second.expiration_time <= absl::Now()) {
+    entries_.erase(it);
+    return nullptr;
+  }
+  *certificate_ids = it->second.certificate_ids;
+  return it->second.chain;
+}
+
+Status VerifiedCertificateChainCache::CheckNotRevoked(
+    const std::vector<CertificateId> &certificate_ids) const {
+  absl::MutexLock lock(&mu_);
+  for (size_t i = 0; i < certificate_ids.size(); ++i) {
+    if (IsRevoked(certificate_ids[i])) {
+      return Status(absl::StatusCode::kUnauthenticated,
+                    absl::StrCat("Certificate at index ", i,
+                                 " has been revoked"));
+    }
+  }
+  return absl::OkStatus();
+}
+
+bool VerifiedCertificateChainCache::IsRevoked(const CertificateId &id) const {
+  if (id.issuer.empty()) {
+    return false;
+  }
+  auto it = revoked_.find(id.issuer);
+  return it != revoked_.end() && it->second.contains(id.serial_number);
+}
+
+void VerifiedCertificateChainCache::Insert(
+    const std::string &key,
+    std::shared_ptr<const VerifiedCertificateChain> chain,
+    std::vector<CertificateId> certificate_ids, uint64_t generation) {
+  if (max_entries_ == 0) {
+    return;
+  }
+  Entry entry{std::move(chain), std::move(certificate_ids),
+              absl::Now() + entry_lifetime_};
+
+  absl::MutexLock lock(&mu_);
+  if (generation != generation_) {
+    return;
+  }
+  if (entries_.size() >= max_entries_ && !entries_.contains(key)) {
+    auto oldest = std::min_element(
+        entries_.begin(), entries_.end(),
+        [](const std::pair<const std::string, Entry> &lhs,
+           const std::pair<const std::string, Entry> &rhs) {
+          return lhs.second.expiration_time < rhs.second.expiration_time;
+        });
+    entries_.erase(oldest);
+  }
+  entries_[key] = std::move(entry);
+}
+
+}  // namespace sgx
+}  // namespace asylo
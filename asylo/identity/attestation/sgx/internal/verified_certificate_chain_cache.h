@@ -0,0 +1,167 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_IDENTITY_ATTESTATION_SGX_INTERNAL_VERIFIED_CERTIFICATE_CHAIN_CACHE_H_
+#define ASYLO_IDENTITY_ATTESTATION_SGX_INTERNAL_VERIFIED_CERTIFICATE_CHAIN_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "asylo/crypto/certificate.pb.h"
+#include "asylo/crypto/certificate_interface.h"
+#include "asylo/crypto/certificate_util.h"
+#include "asylo/crypto/signing_key.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+namespace sgx {
+
+// A certificate chain that has been verified by VerifiedCertificateChainCache.
+// The certificates are ordered as in the CertificateChain they were parsed
+// from, so the leaf certificate is first and the root certificate is last.
+struct VerifiedCertificateChain {
+  std::vector<std::shared_ptr<const CertificateInterface>> certificates;
+
+  // The DER-encoded subject key of the leaf certificate.
+  std::string subject_key_der;
+
+  // The subject key of the leaf certificate, or nullptr if it is not an ECDSA
+  // P-256 key.
+  std::shared_ptr<const VerifyingKey> subject_verifying_key;
+};
+
+// VerifiedCertificateChainCache remembers the certificate chains that it has
+// verified, together with the parsed certificates and the leaf verifying key.
+// Verifying a chain that is already cached only re-checks the validity periods
+// of its certificates.
+//
+// Each verified chain is also cached without its leaf certificate. The PCK,
+// intermediate, and root certificates are shared by many peers, so verifying a
+// chain whose issuer chain is cached costs one signature check over the leaf.
+//
+// Entries are keyed by a SHA-256 digest of the certificates and of the
+// VerificationConfig they were verified under. They expire after the lifetime
+// given at construction. X.509 certificates revoked by an installed certificate
+// revocation list are dropped from the cache and fail verification. When the
+// cache is full, inserting a new entry evicts the entry that expires first.
+// VerifiedCertificateChainCache is thread-safe.
+class VerifiedCertificateChainCache {
+ public:
+  // The default maximum number of entries held by the cache.
+  static constexpr size_t kDefaultMaxEntries = 1024;
+
+  // Creates a cache whose entries expire |entry_lifetime| after insertion and
+  // which holds at most |max_entries| entries.
+  explicit VerifiedCertificateChainCache(
+      absl::Duration entry_lifetime, size_t max_entries = kDefaultMaxEntries);
+
+  // Returns the process-wide cache used by the SGX remote assertion verifiers.
+  static VerifiedCertificateChainCache *GetInstance();
+
+  // Parses |chain| using |factory_map| and verifies it as
+  // VerifyCertificateChain() would under |config|. Returns the cached result if
+  // |chain| was verified before. Chains that fail verification are not cached.
+  StatusOr<std::shared_ptr<const VerifiedCertificateChain>> Verify(
+      const CertificateFactoryMap &factory_map, const CertificateChain &chain,
+      const VerificationConfig &config);
+
+  // Installs |crl| as the certificate revocation list of its issuer, replacing
+  // the list previously installed for that issuer. Drops the cached chains
+  // holding an X.509 certificate revoked by |crl|, and fails the verification
+  // of such chains from then on. The signature of |crl| is not verified, since
+  // a revocation list can only cause chains to be rejected.
+  Status UpdateRevocationList(const CertificateRevocationList &crl);
+
+  // Drops all cached chains. Installed revocation lists are kept.
+  void Clear();
+
+  // Returns the number of cached chains, including expired chains that have not
+  // been dropped yet.
+  size_t size() const;
+
+ private:
+  // The DER-encoded issuer name and serial number of an X.509 certificate, as
+  // listed in the revocation lists of its issuer.
+  struct CertificateId {
+    std::string issuer;
+    std::string serial_number;
+  };
+
+  struct Entry {
+    std::shared_ptr<const VerifiedCertificateChain> chain;
+
+    // The identifiers of the X.509 certificates in |chain|.
+    std::vector<CertificateId> certificate_ids;
+
+    absl::Time expiration_time;
+  };
+
+  // Returns the unexpired chain stored under |key| and sets |certificate_ids|
+  // to the identifiers of its X.509 certificates, or returns nullptr.
+  std::shared_ptr<const VerifiedCertificateChain> Lookup(
+      const std::string &key, std::vector<CertificateId> *certificate_ids);
+
+  // Returns an error if any of |certificate_ids| is revoked by an installed
+  // revocation list.
+  Status CheckNotRevoked(const std::vector<CertificateId> &certificate_ids)
+      const;
+
+  // Returns true if |id| is revoked by an installed revocation list.
+  bool IsRevoked(const CertificateId &id) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns the current generation of the cache.
+  uint64_t generation() const;
+
+  // Stores |chain| under |key|, evicting an entry if the cache is full. Does
+  // nothing if the cache was cleared since |generation|, as |chain| may have
+  // been verified before the clear.
+  void Insert(const std::string &key,
+              std::shared_ptr<const VerifiedCertificateChain> chain,
+              std::vector<CertificateId> certificate_ids, uint64_t generation);
+
+  const absl::Duration entry_lifetime_;
+  const size_t max_entries_;
+
+  mutable absl::Mutex mu_;
+
+  absl::flat_hash_map<std::string, Entry> entries_ ABSL_GUARDED_BY(mu_);
+
+  // The serial numbers of the revoked certificates, keyed by the issuer of the
+  // revocation list which lists them.
+  absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> revoked_
+      ABSL_GUARDED_BY(mu_);
+
+  // Incremented whenever the cache is cleared or a revocation list changes.
+  uint64_t generation_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+}  // namespace sgx
+}  // namespace asylo
+
+#endif  // ASYLO_IDENTITY_ATTESTATION_SGX_INTERNAL_VERIFIED_CERTIFICATE_CHAIN_CACHE_H_
@@ -0,0 +1,547 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/identity/attestation/sgx/internal/verified_certificate_chain_cache.h"
+
+#include <openssl/asn1.h>
+#include <openssl/base.h>
+#include <openssl/bio.h>
+#include <openssl/bn.h>
+#include <openssl/digest.h>
+#include <openssl/ec_key.h>
+#include <openssl/evp.h>
+#include <openssl/mem.h>
+#include <openssl/nid.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "absl/types/optional.h"
+#include "asylo/crypto/asn1.h"
+#include "asylo/crypto/certificate.pb.h"
+#include "asylo/crypto/certificate_interface.h"
+#include "asylo/crypto/certificate_util.h"
+#include "asylo/crypto/ecdsa_p256_sha256_signing_key.h"
+#include "asylo/crypto/fake_certificate.h"
+#include "asylo/crypto/fake_certificate.pb.h"
+#include "asylo/crypto/signing_key.h"
+#include "asylo/crypto/util/bssl_util.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/crypto/x509_certificate.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/status_macros.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+using ::testing::Eq;
+using ::testing::IsNull;
+using ::testing::NotNull;
+
+constexpr char kRootKey[] = "Root key";
+constexpr char kIntermediateKey[] = "Intermediate key";
+constexpr char kLeafKey[] = "Leaf key";
+constexpr char kOtherLeafKey[] = "Other leaf key";
+
+constexpr absl::Duration kEntryLifetime = absl::Hours(1);
+
+Certificate CreateFakeCertificate(const std::string &subject_key,
+                                  const std::string &issuer_key,
+                                  absl::optional<bool> is_ca,
+                                  absl::optional<int64_t> pathlength) {
+  FakeCertificateProto fake_cert;
+  fake_cert.set_subject_key(subject_key);
+  fake_cert.set_issuer_key(issuer_key);
+  if (is_ca.has_value()) {
+    fake_cert.set_is_ca(is_ca.value());
+  }
+  if (pathlength.has_value()) {
+    fake_cert.set_pathlength(pathlength.value());
+  }
+
+  Certificate certificate;
+  certificate.set_format(Certificate::X509_PEM);
+  fake_cert.SerializeToString(certificate.mutable_data());
+  return certificate;
+}
+
+// Returns a chain of |leaf_key| certified by an intermediate CA certified by a
+// self-signed root.
+CertificateChain CreateChain(const std::string &leaf_key) {
+  CertificateChain chain;
+  *chain.add_certificates() =
+      CreateFakeCertificate(leaf_key, kIntermediateKey, /*is_ca=*/false,
+                            /*pathlength=*/absl::nullopt);
+  *chain.add_certificates() = CreateFakeCertificate(
+      kIntermediateKey, kRootKey, /*is_ca=*/true, /*pathlength=*/0);
+  *chain.add_certificates() = CreateFakeCertificate(
+      kRootKey, kRootKey, /*is_ca=*/true, /*pathlength=*/1);
+  return chain;
+}
+
+class VerifiedCertificateChainCacheTest : public ::testing::Test {
+ protected:
+  VerifiedCertificateChainCacheTest()
+      : cache_(kEntryLifetime), config_(/*all_fields=*/true) {
+    // Counts the certificates parsed by the cache.
+    factory_map_.emplace(
+        Certificate::X509_PEM, [this](const Certificate &certificate)
+                                   -> StatusOr<std::unique_ptr<CertificateInterface>> {
+          parse_count_++;
+          return FakeCertificate::Create(certificate);
+        });
+  }
+
+  VerifiedCertificateChainCache cache_;
+  VerificationConfig config_;
+  CertificateFactoryMap factory_map_;
+  std::atomic<int> parse_count_{0};
+};
+
+TEST_F(VerifiedCertificateChainCacheTest, VerifySucceeds) {
+  std::shared_ptr<const VerifiedCertificateChain> verified;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      verified, cache_.Verify(factory_map_, CreateChain(kLeafKey), config_));
+  ASSERT_THAT(verified->certificates.size(), Eq(3));
+  EXPECT_THAT(verified->subject_key_der, Eq(kLeafKey));
+
+  // Fake certificates do not certify ECDSA P-256 keys.
+  EXPECT_THAT(verified->subject_verifying_key, IsNull());
+
+  // The issuer chain is cached along with the full chain.
+  EXPECT_THAT(cache_.size(), Eq(2));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, CachedChainIsNotParsedAgain) {
+  std::shared_ptr<const VerifiedCertificateChain> first;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      first, cache_.Verify(factory_map_, CreateChain(kLeafKey), config_));
+  EXPECT_THAT(parse_count_, Eq(3));
+
+  std::shared_ptr<const VerifiedCertificateChain> second;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      second, cache_.Verify(factory_map_, CreateChain(kLeafKey), config_));
+  EXPECT_THAT(parse_count_, Eq(3));
+  EXPECT_THAT(second, Eq(first));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, CachedIssuerChainIsShared) {
+  std::shared_ptr<const VerifiedCertificateChain> first;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      first, cache_.Verify(factory_map_, CreateChain(kLeafKey), config_));
+
+  // Only the new leaf certificate is parsed and verified.
+  std::shared_ptr<const VerifiedCertificateChain> second;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      second, cache_.Verify(factory_map_, CreateChain(kOtherLeafKey), config_));
+  EXPECT_THAT(parse_count_, Eq(4));
+  EXPECT_THAT(second->subject_key_der, Eq(kOtherLeafKey));
+  EXPECT_THAT(second->certificates[1], Eq(first->certificates[1]));
+  EXPECT_THAT(second->certificates[2], Eq(first->certificates[2]));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, LeafIsVerifiedAgainstCachedIssuer) {
+  ASYLO_ASSERT_OK(
+      cache_.Verify(factory_map_, CreateChain(kLeafKey), config_).status());
+
+  CertificateChain chain = CreateChain(kOtherLeafKey);
+  *chain.mutable_certificates(0) =
+      CreateFakeCertificate(kOtherLeafKey, "Unknown issuer", /*is_ca=*/false,
+                            /*pathlength=*/absl::nullopt);
+  EXPECT_THAT(cache_.Verify(factory_map_, chain, config_).status(),
+              StatusIs(absl::StatusCode::kUnauthenticated));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest,
+       PathLengthIsCheckedAgainstCachedIssuer) {
+  // The root only allows the certificates that it issues directly.
+  CertificateChain issuer_chain;
+  *issuer_chain.add_certificates() = CreateFakeCertificate(
+      kIntermediateKey, kRootKey, /*is_ca=*/true, /*pathlength=*/absl::nullopt);
+  *issuer_chain.add_certificates() = CreateFakeCertificate(
+      kRootKey, kRootKey, /*is_ca=*/true, /*pathlength=*/0);
+  ASYLO_ASSERT_OK(cache_.Verify(factory_map_, issuer_chain, config_).status());
+
+  CertificateChain chain;
+  *chain.add_certificates() =
+      CreateFakeCertificate(kLeafKey, kIntermediateKey, /*is_ca=*/false,
+                            /*pathlength=*/absl::nullopt);
+  chain.MergeFrom(issuer_chain);
+  EXPECT_THAT(cache_.Verify(factory_map_, chain, config_).status(),
+              StatusIs(absl::StatusCode::kUnauthenticated));
+  EXPECT_THAT(parse_count_, Eq(3));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, FailedChainIsNotCached) {
+  CertificateChain chain = CreateChain(kLeafKey);
+  chain.mutable_certificates()->SwapElements(0, 1);
+  EXPECT_THAT(cache_.Verify(factory_map_, chain, config_).status(),
+              StatusIs(absl::StatusCode::kUnauthenticated));
+  EXPECT_THAT(cache_.size(), Eq(0));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, EmptyChainFails) {
+  EXPECT_THAT(
+      cache_.Verify(factory_map_, CertificateChain(), config_).status(),
+      StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, ConfigIsPartOfKey) {
+  ASYLO_ASSERT_OK(
+      cache_.Verify(factory_map_, CreateChain(kLeafKey), config_).status());
+  ASYLO_ASSERT_OK(cache_
+                      .Verify(factory_map_, CreateChain(kLeafKey),
+                              VerificationConfig(/*all_fields=*/false))
+                      .status());
+  EXPECT_THAT(parse_count_, Eq(6));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, ExpiredEntriesAreDropped) {
+  VerifiedCertificateChainCache cache(absl::ZeroDuration());
+  ASYLO_ASSERT_OK(
+      cache.Verify(factory_map_, CreateChain(kLeafKey), config_).status());
+  ASYLO_ASSERT_OK(
+      cache.Verify(factory_map_, CreateChain(kLeafKey), config_).status());
+  EXPECT_THAT(parse_count_, Eq(6));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, CacheIsBounded) {
+  VerifiedCertificateChainCache cache(kEntryLifetime, /*max_entries=*/2);
+  ASYLO_ASSERT_OK(
+      cache.Verify(factory_map_, CreateChain(kLeafKey), config_).status());
+  ASYLO_ASSERT_OK(
+      cache.Verify(factory_map_, CreateChain(kOtherLeafKey), config_)
+          .status());
+  EXPECT_THAT(cache.size(), Eq(2));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, ClearDropsAllEntries) {
+  ASYLO_ASSERT_OK(
+      cache_.Verify(factory_map_, CreateChain(kLeafKey), config_).status());
+  cache_.Clear();
+  EXPECT_THAT(cache_.size(), Eq(0));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, InvalidRevocationListFails) {
+  EXPECT_THAT(cache_.UpdateRevocationList(CertificateRevocationList()),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST_F(VerifiedCertificateChainCacheTest, MalformedRevocationListFails) {
+  CertificateRevocationList crl;
+  crl.set_format(CertificateRevocationList::X509_DER);
+  crl.set_data("CRL");
+  EXPECT_THAT(cache_.UpdateRevocationList(crl),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+// A CA that issues X.509 certificates and revocation lists.
+struct X509Issuer {
+  std::string name;
+  bssl::UniquePtr<EVP_PKEY> crl_key;
+  std::unique_ptr<SigningKey> signing_key;
+};
+
+StatusOr<X509Issuer> CreateX509Issuer(const std::string &name) {
+  bssl::UniquePtr<EC_KEY> ec_key(
+      EC_KEY_new_by_curve_name(NID_X9_62_prime256v1));
+  if (ec_key == nullptr || !EC_KEY_generate_key(ec_key.get())) {
+    return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+  }
+  uint8_t *der = nullptr;
+  int length = i2d_ECPrivateKey(ec_key.get(), &der);
+  if (length <= 0) {
+    return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+  }
+  bssl::UniquePtr<uint8_t> deleter(der);
+
+  X509Issuer issuer;
+  issuer.name = name;
+  ASYLO_ASSIGN_OR_RETURN(issuer.signing_key,
+                         EcdsaP256Sha256SigningKey::CreateFromDer(
+                             ByteContainerView(der, length)));
+  issuer.crl_key.reset(EVP_PKEY_new());
+  if (issuer.crl_key == nullptr ||
+      !EVP_PKEY_assign_EC_KEY(issuer.crl_key.get(), ec_key.release())) {
+    return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+  }
+  return std::move(issuer);
+}
+
+StatusOr<X509Name> CommonName(const std::string &name) {
+  X509NameEntry entry;
+  ASYLO_ASSIGN_OR_RETURN(entry.field, ObjectId::CreateFromShortName("CN"));
+  entry.value = name;
+  return X509Name{entry};
+}
+
+// Returns a certificate with serial number |serial_number| for a new key named
+// |subject_name|, issued by |issuer|.
+StatusOr<Certificate> CreateX509Certificate(const X509Issuer &issuer,
+                                            const std::string &subject_name,
+                                            uint64_t serial_number,
+                                            bool is_ca) {
+  X509CertificateBuilder builder;
+  builder.serial_number.reset(BN_new());
+  if (builder.serial_number == nullptr ||
+      !BN_set_word(builder.serial_number.get(), serial_number)) {
+    return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+  }
+  ASYLO_ASSIGN_OR_RETURN(builder.issuer, CommonName(issuer.name));
+  ASYLO_ASSIGN_OR_RETURN(builder.subject, CommonName(subject_name));
+  builder.validity = {absl::Now() - absl::Hours(1),
+                      absl::Now() + absl::Hours(1)};
+  BasicConstraints basic_constraints;
+  basic_constraints.is_ca = is_ca;
+  builder.basic_constraints = basic_constraints;
+
+  std::unique_ptr<SigningKey> subject_key;
+  ASYLO_ASSIGN_OR_RETURN(subject_key, EcdsaP256Sha256SigningKey::Create());
+  std::unique_ptr<VerifyingKey> subject_verifying_key;
+  ASYLO_ASSIGN_OR_RETURN(subject_verifying_key,
+                         subject_key->GetVerifyingKey());
+  ASYLO_ASSIGN_OR_RETURN(builder.subject_public_key_der,
+                         subject_verifying_key->SerializeToDer());
+
+  std::unique_ptr<X509Certificate> certificate;
+  ASYLO_ASSIGN_OR_RETURN(certificate,
+                         builder.SignAndBuild(*issuer.signing_key));
+  return certificate->ToCertificateProto(Certificate::X509_PEM);
+}
+
+// Parses the PEM-encoded X.509 |certificate|.
+StatusOr<bssl::UniquePtr<X509>> ParseX509(const Certificate &certificate) {
+  bssl::UniquePtr<BIO> cert_bio(
+      BIO_new_mem_buf(certificate.data().data(), certificate.data().size()));
+  bssl::UniquePtr<X509> x509(PEM_read_bio_X509(cert_bio.get(), /*x=*/nullptr,
+                                               /*cb=*/nullptr, /*u=*/nullptr));
+  if (x509 == nullptr) {
+    return Status(absl::StatusCode::kInvalidArgument, BsslLastErrorString());
+  }
+  return std::move(x509);
+}
+
+// Returns a revocation list of |issuer|, whose certificate is |issuer_cert|,
+// that revokes the certificates in |revoked|.
+StatusOr<CertificateRevocationList> CreateRevocationList(
+    const X509Issuer &issuer, const Certificate &issuer_cert,
+    const std::vector<Certificate> &revoked) {
+  bssl::UniquePtr<X509> issuer_x509;
+  ASYLO_ASSIGN_OR_RETURN(issuer_x509, ParseX509(issuer_cert));
+  bssl::UniquePtr<X509_CRL> crl(X509_CRL_new());
+  bssl::UniquePtr<ASN1_TIME> now(
+      ASN1_TIME_set(/*s=*/nullptr, absl::ToTimeT(absl::Now())));
+  if (crl == nullptr || now == nullptr ||
+      !X509_CRL_set_version(crl.get(), /*version=*/1) ||
+      !X509_CRL_set_issuer_name(crl.get(),
+                                X509_get_subject_name(issuer_x509.get())) ||
+      !X509_CRL_set1_lastUpdate(crl.get(), now.get())) {
+    return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+  }
+  for (const Certificate &certificate : revoked) {
+    bssl::UniquePtr<X509> x509;
+    ASYLO_ASSIGN_OR_RETURN(x509, ParseX509(certificate));
+    bssl::UniquePtr<X509_REVOKED> entry(X509_REVOKED_new());
+    if (entry == nullptr ||
+        !X509_REVOKED_set_serialNumber(entry.get(),
+                                       X509_get_serialNumber(x509.get())) ||
+        !X509_REVOKED_set_revocationDate(entry.get(), now.get()) ||
+        !X509_CRL_add0_revoked(crl.get(), entry.get())) {
+      return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+    }
+    entry.release();
+  }
+  if (!X509_CRL_sort(crl.get()) ||
+      !X509_CRL_sign(crl.get(), issuer.crl_key.get(), EVP_sha256())) {
+    return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+  }
+
+  uint8_t *der = nullptr;
+  int length = i2d_X509_CRL(crl.get(), &der);
+  if (length <= 0) {
+    return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+  }
+  bssl::UniquePtr<uint8_t> deleter(der);
+  CertificateRevocationList crl_proto;
+  crl_proto.set_format(CertificateRevocationList::X509_DER);
+  crl_proto.set_data(reinterpret_cast<const char *>(der), length);
+  return crl_proto;
+}
+
+class VerifiedCertificateChainCacheRevocationTest : public ::testing::Test {
+ protected:
+  VerifiedCertificateChainCacheRevocationTest()
+      : cache_(kEntryLifetime), config_(/*all_fields=*/true) {
+    factory_map_.emplace(Certificate::X509_PEM, X509Certificate::Create);
+  }
+
+  void SetUp() override {
+    ASYLO_ASSERT_OK_AND_ASSIGN(root_, CreateX509Issuer("Root CA"));
+    ASYLO_ASSERT_OK_AND_ASSIGN(intermediate_,
+                               CreateX509Issuer("Intermediate CA"));
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        root_cert_,
+        CreateX509Certificate(root_, root_.name, /*serial_number=*/1,
+                              /*is_ca=*/true));
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        intermediate_cert_,
+        CreateX509Certificate(root_, intermediate_.name, /*serial_number=*/2,
+                              /*is_ca=*/true));
+  }
+
+  // Returns a chain of a new leaf certificate with |serial_number| issued by
+  // the intermediate CA.
+  StatusOr<CertificateChain> CreateLeafChain(uint64_t serial_number,
+                                             Certificate *leaf) {
+    ASYLO_ASSIGN_OR_RETURN(
+        *leaf, CreateX509Certificate(intermediate_, "Leaf", serial_number,
+                                     /*is_ca=*/false));
+    CertificateChain chain;
+    *chain.add_certificates() = *leaf;
+    *chain.add_certificates() = intermediate_cert_;
+    *chain.add_certificates() = root_cert_;
+    return chain;
+  }
+
+  VerifiedCertificateChainCache cache_;
+  VerificationConfig config_;
+  CertificateFactoryMap factory_map_;
+  X509Issuer root_;
+  X509Issuer intermediate_;
+  Certificate root_cert_;
+  Certificate intermediate_cert_;
+};
+
+TEST_F(VerifiedCertificateChainCacheRevocationTest,
+       NewRevocationListClearsCache) {
+  Certificate leaf;
+  CertificateChain chain;
+  ASYLO_ASSERT_OK_AND_ASSIGN(chain,
+                             CreateLeafChain(/*serial_number=*/3, &leaf));
+  CertificateRevocationList empty_crl;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      empty_crl, CreateRevocationList(intermediate_, intermediate_cert_, {}));
+  ASYLO_ASSERT_OK(cache_.UpdateRevocationList(empty_crl));
+  ASYLO_ASSERT_OK(cache_.Verify(factory_map_, chain, config_).status());
+  EXPECT_THAT(cache_.size(), Eq(2));
+
+  // Reinstalling the same list keeps the cache.
+  ASYLO_ASSERT_OK(cache_.UpdateRevocationList(empty_crl));
+  EXPECT_THAT(cache_.size(), Eq(2));
+
+  // Revoking the leaf drops the full chain but keeps the issuer chain.
+  CertificateRevocationList crl;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      crl, CreateRevocationList(intermediate_, intermediate_cert_, {leaf}));
+  ASYLO_ASSERT_OK(cache_.UpdateRevocationList(crl));
+  EXPECT_THAT(cache_.size(), Eq(1));
+  EXPECT_THAT(cache_.Verify(factory_map_, chain, config_).status(),
+              StatusIs(absl::StatusCode::kUnauthenticated));
+}
+
+TEST_F(VerifiedCertificateChainCacheRevocationTest,
+       RevocationOnlyDropsChainsWithRevokedCertificates) {
+  Certificate leaf;
+  Certificate other_leaf;
+  CertificateChain chain;
+  CertificateChain other_chain;
+  ASYLO_ASSERT_OK_AND_ASSIGN(chain,
+                             CreateLeafChain(/*serial_number=*/3, &leaf));
+  ASYLO_ASSERT_OK_AND_ASSIGN(other_chain,
+                             CreateLeafChain(/*serial_number=*/4, &other_leaf));
+  ASYLO_ASSERT_OK(cache_.Verify(factory_map_, chain, config_).status());
+  ASYLO_ASSERT_OK(cache_.Verify(factory_map_, other_chain, config_).status());
+  EXPECT_THAT(cache_.size(), Eq(3));
+
+  // A list of another issuer does not revoke certificates with the same serial
+  // number.
+  CertificateRevocationList root_crl;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      root_crl,
+      CreateRevocationList(root_, root_cert_, {intermediate_cert_}));
+  Certificate root_issued;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      root_issued, CreateX509Certificate(root_, "Other CA", /*serial_number=*/3,
+                                         /*is_ca=*/true));
+  CertificateRevocationList unrelated_crl;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      unrelated_crl, CreateRevocationList(root_, root_cert_, {root_issued}));
+  ASYLO_ASSERT_OK(cache_.UpdateRevocationList(unrelated_crl));
+  EXPECT_THAT(cache_.size(), Eq(3));
+
+  CertificateRevocationList crl;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      crl, CreateRevocationList(intermediate_, intermediate_cert_, {leaf}));
+  ASYLO_ASSERT_OK(cache_.UpdateRevocationList(crl));
+  EXPECT_THAT(cache_.size(), Eq(2));
+  ASYLO_EXPECT_OK(cache_.Verify(factory_map_, other_chain, config_).status());
+  EXPECT_THAT(cache_.Verify(factory_map_, chain, config_).status(),
+              StatusIs(absl::StatusCode::kUnauthenticated));
+
+  // Revoking the intermediate CA drops every chain that it is part of.
+  ASYLO_ASSERT_OK(cache_.UpdateRevocationList(root_crl));
+  EXPECT_THAT(cache_.size(), Eq(0));
+  EXPECT_THAT(cache_.Verify(factory_map_, other_chain, config_).status(),
+              StatusIs(absl::StatusCode::kUnauthenticated));
+}
+
+TEST_F(VerifiedCertificateChainCacheRevocationTest,
+       RevokedLeafIsRejectedWithCachedIssuer) {
+  Certificate leaf;
+  Certificate other_leaf;
+  CertificateChain chain;
+  CertificateChain other_chain;
+  ASYLO_ASSERT_OK_AND_ASSIGN(chain,
+                             CreateLeafChain(/*serial_number=*/3, &leaf));
+  ASYLO_ASSERT_OK_AND_ASSIGN(other_chain,
+                             CreateLeafChain(/*serial_number=*/4, &other_leaf));
+  CertificateRevocationList crl;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      crl,
+      CreateRevocationList(intermediate_, intermediate_cert_, {other_leaf}));
+  ASYLO_ASSERT_OK(cache_.UpdateRevocationList(crl));
+
+  ASYLO_ASSERT_OK(cache_.Verify(factory_map_, chain, config_).status());
+  EXPECT_THAT(cache_.Verify(factory_map_, other_chain, config_).status(),
+              StatusIs(absl::StatusCode::kUnauthenticated));
+  EXPECT_THAT(cache_.size(), Eq(2));
+}
+
+TEST(VerifiedCertificateChainCacheInstanceTest, GetInstanceIsShared) {
+  EXPECT_THAT(VerifiedCertificateChainCache::GetInstance(), NotNull());
+  EXPECT_THAT(VerifiedCertificateChainCache::GetInstance(),
+              Eq(VerifiedCertificateChainCache::GetInstance()));
+}
+
+}  // namespace
+}  // namespace sgx
+}  // namespace asylo
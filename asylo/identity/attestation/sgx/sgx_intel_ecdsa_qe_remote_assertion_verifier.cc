@@ -22,6 +22,7 @@
 
 #include <algorithm>
 #include <iterator>
+#include <memory>
 #include <string>
 
 #include "absl/status/status.h"
@@ -43,6 +44,7 @@
 #include "asylo/identity/additional_authenticated_data_generator.h"
 #include "asylo/identity/attestation/sgx/internal/intel_ecdsa_quote.h"
 #include "asylo/identity/attestation/sgx/internal/pce_util.h"
+#include "asylo/identity/attestation/sgx/internal/verified_certificate_chain_cache.h"
 #include "asylo/identity/attestation/sgx/sgx_intel_ecdsa_qe_remote_assertion_authority_config.pb.h"
 #include "asylo/identity/descriptions.h"
 #include "asylo/identity/enclave_assertion_authority.h"
@@ -171,63 +173,35 @@ Status VerifyQeReportDataMatchesQuoteSigningKey(
   return absl::OkStatus();
 }
 
-Status VerifyPckSignatureFromPckCertChain(
-    const std::vector<uint8_t> &cert_data,
-    const sgx::IntelEcdsaP256QuoteSignature &signature) {
-  CertificateChain pck_cert_chain;
-  ASYLO_ASSIGN_OR_RETURN(pck_cert_chain,
-                         GetPckCertificateChainFromCertData(cert_data));
-
-  std::unique_ptr<X509Certificate> pck_cert;
-  ASYLO_ASSIGN_OR_RETURN(pck_cert, X509Certificate::Create(
-                                       *pck_cert_chain.certificates().begin()));
-
-  std::string pck_der;
-  ASYLO_ASSIGN_OR_RETURN(pck_der, pck_cert->SubjectKeyDer());
-
-  std::unique_ptr<EcdsaP256Sha256VerifyingKey> pck_pub;
-  ASYLO_ASSIGN_OR_RETURN(pck_pub,
-                         EcdsaP256Sha256VerifyingKey::CreateFromDer(pck_der));
-
-  Signature qe_report_signature;
-  ASYLO_ASSIGN_OR_RETURN(qe_report_signature,
-                         sgx::CreateSignatureFromPckEcdsaP256Sha256Signature(
-                             signature.qe_report_signature));
-  return pck_pub->Verify(
-      ConvertTrivialObjectToBinaryString(signature.qe_report),
-      qe_report_signature);
-}
-
-Status VerifyPckSignatureOverQuotingEnclave(const sgx::IntelQeQuote &quote) {
-  switch (quote.cert_data.qe_cert_data_type) {
-    case PCK_CERT_CHAIN:
-      return VerifyPckSignatureFromPckCertChain(quote.cert_data.qe_cert_data,
-                                                quote.signature);
-  }
-  return absl::UnimplementedError(
-      absl::StrFormat("Verification not supported for QE cert data type %d",
-                      quote.cert_data.qe_cert_data_type));
-}
-
-Status VerifyPckCertificateChain(
-    const sgx::IntelQeQuote &quote,
+// Parses and verifies the PCK certificate chain in |cert_data|, and checks
+// that it ends in one of |trusted_root_certificates|. The chain is identical
+// for every quote generated on a platform, so it is verified through the
+// process-wide VerifiedCertificateChainCache.
+StatusOr<std::shared_ptr<const sgx::VerifiedCertificateChain>>
+VerifyPckCertificateChain(
+    const sgx::IntelCertData &cert_data,
     const std::vector<std::unique_ptr<CertificateInterface>>
         &trusted_root_certificates) {
+  if (cert_data.qe_cert_data_type != PCK_CERT_CHAIN) {
+    return absl::UnimplementedError(
+        absl::StrFormat("Verification not supported for QE cert data type %d",
+                        cert_data.qe_cert_data_type));
+  }
+
   CertificateChain pck_cert_chain;
   ASYLO_ASSIGN_OR_RETURN(pck_cert_chain, GetPckCertificateChainFromCertData(
-                                             quote.cert_data.qe_cert_data));
+                                             cert_data.qe_cert_data));
 
-  CertificateInterfaceVector certificate_chain;
+  std::shared_ptr<const sgx::VerifiedCertificateChain> certificate_chain;
+  VerificationConfig verification_config(/*all_fields=*/true);
   ASYLO_ASSIGN_OR_RETURN(
       certificate_chain,
-      CreateCertificateChain({{Certificate::X509_PEM, X509Certificate::Create}},
-                             pck_cert_chain));
-
-  VerificationConfig verification_config(/*all_fields=*/true);
-  ASYLO_RETURN_IF_ERROR(
-      VerifyCertificateChain(certificate_chain, verification_config));
+      sgx::VerifiedCertificateChainCache::GetInstance()->Verify(
+          {{Certificate::X509_PEM, X509Certificate::Create}}, pck_cert_chain,
+          verification_config));
 
-  const CertificateInterface &root_certificate = *certificate_chain.back();
+  const CertificateInterface &root_certificate =
+      *certificate_chain->certificates.back();
 
   if (std::none_of(
           trusted_root_certificates.begin(), trusted_root_certificates.end(),
@@ -240,53 +214,45 @@ Status VerifyPckCertificateChain(
                      root_certificate.SubjectName().value_or("Unknown CA")));
   }
 
-  return absl::OkStatus();
+  return certificate_chain;
 }
 
-Status ParseAndAppendPeerMachineConfigurationFromPckCertChain(
-    const sgx::IntelCertData &cert_data, SgxIdentity *identity) {
-  CertificateChain pck_cert_chain;
-  ASYLO_ASSIGN_OR_RETURN(pck_cert_chain, GetPckCertificateChainFromCertData(
-                                             cert_data.qe_cert_data));
-
-  std::unique_ptr<X509Certificate> pck_cert;
-  ASYLO_ASSIGN_OR_RETURN(pck_cert, X509Certificate::Create(
-                                       *pck_cert_chain.certificates().begin()));
-
-  ASYLO_ASSIGN_OR_RETURN(
-      *identity->mutable_machine_configuration(),
-      sgx::ExtractMachineConfigurationFromPckCert(pck_cert.get()));
+Status VerifyPckSignatureOverQuotingEnclave(
+    const sgx::VerifiedCertificateChain &pck_cert_chain,
+    const sgx::IntelEcdsaP256QuoteSignature &signature) {
+  if (pck_cert_chain.subject_verifying_key == nullptr) {
+    return absl::InvalidArgumentError(
+        "PCK certificate does not certify an ECDSA P-256 key");
+  }
 
-  return absl::OkStatus();
+  Signature qe_report_signature;
+  ASYLO_ASSIGN_OR_RETURN(qe_report_signature,
+                         sgx::CreateSignatureFromPckEcdsaP256Sha256Signature(
+                             signature.qe_report_signature));
+  return pck_cert_chain.subject_verifying_key->Verify(
+      ConvertTrivialObjectToBinaryString(signature.qe_report),
+      qe_report_signature);
 }
 
-Status ParseEnclaveIdentityFromQuote(const sgx::ReportBody &report_body,
-                                     const sgx::IntelCertData &cert_data,
-                                     EnclaveIdentity *enclave_identity) {
+Status ParseEnclaveIdentityFromQuote(
+    const sgx::ReportBody &report_body,
+    const sgx::VerifiedCertificateChain &pck_cert_chain,
+    EnclaveIdentity *enclave_identity) {
   SgxIdentity identity = ParseSgxIdentityFromHardwareReport(report_body);
-
-  switch (cert_data.qe_cert_data_type) {
-    case PCK_CERT_CHAIN: {
-      ASYLO_RETURN_IF_ERROR(
-          ParseAndAppendPeerMachineConfigurationFromPckCertChain(cert_data,
-                                                                 &identity));
-      ASYLO_ASSIGN_OR_RETURN(*enclave_identity, SerializeSgxIdentity(identity));
-      return absl::OkStatus();
-    }
-  }
-
-  return absl::UnimplementedError(
-      absl::StrFormat("Extracting peer machine identity not "
-                      "supported for QE cert data type %d",
-                      cert_data.qe_cert_data_type));
+  ASYLO_ASSIGN_OR_RETURN(*identity.mutable_machine_configuration(),
+                         sgx::ExtractMachineConfigurationFromPckCert(
+                             pck_cert_chain.certificates.front().get()));
+  ASYLO_ASSIGN_OR_RETURN(*enclave_identity, SerializeSgxIdentity(identity));
+  return absl::OkStatus();
 }
 
 Status VerifyQeIdentityMatchesExpectation(
     const sgx::IntelQeQuote &quote,
+    const sgx::VerifiedCertificateChain &pck_cert_chain,
     const IdentityAclPredicate &qe_expectation) {
   EnclaveIdentity qe_identity;
   ASYLO_RETURN_IF_ERROR(ParseEnclaveIdentityFromQuote(
-      quote.signature.qe_report, quote.cert_data, &qe_identity));
+      quote.signature.qe_report, pck_cert_chain, &qe_identity));
 
   std::string explanation;
   SgxIdentityExpectationMatcher matcher;
@@ -394,14 +360,20 @@ Status SgxIntelEcdsaQeRemoteAssertionVerifier::Verify(
   ASYLO_RETURN_IF_ERROR(
       VerifyQuoteBodySignature(*members_view->aad_generator, user_data, quote));
   ASYLO_RETURN_IF_ERROR(VerifyQeReportDataMatchesQuoteSigningKey(quote));
-  ASYLO_RETURN_IF_ERROR(VerifyPckSignatureOverQuotingEnclave(quote));
+
+  // The PCK key is only trusted once the chain that certifies it is verified.
+  std::shared_ptr<const sgx::VerifiedCertificateChain> pck_cert_chain;
+  ASYLO_ASSIGN_OR_RETURN(
+      pck_cert_chain,
+      VerifyPckCertificateChain(quote.cert_data,
+                                members_view->root_certificates));
   ASYLO_RETURN_IF_ERROR(
-      VerifyPckCertificateChain(quote, members_view->root_certificates));
+      VerifyPckSignatureOverQuotingEnclave(*pck_cert_chain, quote.signature));
   ASYLO_RETURN_IF_ERROR(VerifyQeIdentityMatchesExpectation(
-      quote, members_view->qe_identity_expectation));
+      quote, *pck_cert_chain, members_view->qe_identity_expectation));
 
-  ASYLO_RETURN_IF_ERROR(ParseEnclaveIdentityFromQuote(
-      quote.body, quote.cert_data, peer_identity));
+  ASYLO_RETURN_IF_ERROR(
+      ParseEnclaveIdentityFromQuote(quote.body, *pck_cert_chain, peer_identity));
 
   return absl::OkStatus();
 }
@@ -0,0 +1,524 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/identity/provisioning/sgx/internal/caching_sgx_pcs_client.h"
+
+#include <fcntl.h>
+#include <openssl/asn1.h>
+#include <openssl/base.h>
+#include <openssl/bio.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/crypto/certificate.pb.h"
+#include "asylo/crypto/util/bssl_util.h"
+#include "asylo/identity/attestation/sgx/internal/verified_certificate_chain_cache.h"
+#include "asylo/identity/provisioning/sgx/internal/tcb.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/tcb_info_from_json.h"
+#include "asylo/util/fd_utils.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/posix_errors.h"
+#include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+#include "asylo/util/time_conversions.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+// Returns the time at which |entry| expires, or absl::InfinitePast() if its
+// expiration time is invalid.
+absl::Time EntryExpirationTime(const SgxPcsCacheEntry &entry) {
+  StatusOr<absl::Time> expiration_time =
+      ConvertTime<absl::Time>(entry.expiration_time());
+  return expiration_time.ok() ? expiration_time.value() : absl::InfinitePast();
+}
+
+// Returns the "nextUpdate" time of |signed_tcb_info|.
+StatusOr<absl::Time> TcbInfoNextUpdate(const SignedTcbInfo &signed_tcb_info) {
+  TcbInfo tcb_info;
+  ASYLO_ASSIGN_OR_RETURN(tcb_info,
+                         TcbInfoFromJson(signed_tcb_info.tcb_info_json()));
+  if (!tcb_info.impl().has_next_update()) {
+    return Status(absl::StatusCode::kInvalidArgument,
+                  "TCB info has no \"nextUpdate\" field");
+  }
+  return ConvertTime<absl::Time>(tcb_info.impl().next_update());
+}
+
+// Returns the "nextUpdate" time of |crl|.
+StatusOr<absl::Time> CrlNextUpdate(const CertificateRevocationList &crl) {
+  constexpr absl::Duration kOneDay = absl::Hours(24);
+
+  bssl::UniquePtr<BIO> crl_bio(
+      BIO_new_mem_buf(crl.data().data(), crl.data().size()));
+  bssl::UniquePtr<X509_CRL> x509_crl;
+  switch (crl.format()) {
+    case CertificateRevocationList::X509_DER:
+      x509_crl.reset(d2i_X509_CRL_bio(crl_bio.get(), /*crl=*/nullptr));
+      break;
+    case CertificateRevocationList::X509_PEM:
+      x509_crl.reset(PEM_read_bio_X509_CRL(crl_bio.get(), /*x=*/nullptr,
+                                           /*cb=*/nullptr, /*u=*/nullptr));
+      break;
+    default:
+      return Status(absl::StatusCode::kInvalidArgument,
+                    "Unsupported CRL format");
+  }
+  if (x509_crl == nullptr) {
+    return Status(absl::StatusCode::kInvalidArgument, BsslLastErrorString());
+  }
+
+  const ASN1_TIME *next_update = X509_CRL_get0_nextUpdate(x509_crl.get());
+  if (next_update == nullptr) {
+    return Status(absl::StatusCode::kInvalidArgument,
+                  "CRL has no nextUpdate field");
+  }
+  bssl::UniquePtr<ASN1_TIME> unix_epoch(ASN1_TIME_set(nullptr, 0));
+  int num_days;
+  int num_seconds;
+  if (unix_epoch == nullptr ||
+      ASN1_TIME_diff(&num_days, &num_seconds, unix_epoch.get(), next_update) !=
+          1) {
+    return Status(absl::StatusCode::kInternal, BsslLastErrorString());
+  }
+  return absl::UnixEpoch() + num_days * kOneDay + absl::Seconds(num_seconds);
+}
+
+// Installs |crl| in the process-wide cache of verified certificate chains, so
+// that chains holding a revoked PCK certificate are no longer trusted.
+void InstallRevocationList(const CertificateRevocationList &crl) {
+  Status status =
+      VerifiedCertificateChainCache::GetInstance()->UpdateRevocationList(crl);
+  if (!status.ok()) {
+    LOG(WARNING) << "Failed to install PCK certificate revocation list: "
+                 << status;
+  }
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<CachingSgxPcsClient>> CachingSgxPcsClient::Create(
+    std::unique_ptr<SgxPcsClient> client, Options options) {
+  if (client == nullptr) {
+    return Status(absl::StatusCode::kInvalidArgument,
+                  "The underlying SgxPcsClient must not be null");
+  }
+  if (options.default_lifetime < absl::ZeroDuration() ||
+      options.refresh_ahead < absl::ZeroDuration() ||
+      options.refresh_interval < absl::ZeroDuration()) {
+    return Status(absl::StatusCode::kInvalidArgument,
+                  "Cache durations must not be negative");
+  }
+
+  auto caching_client = absl::WrapUnique(
+      new CachingSgxPcsClient(std::move(client), std::move(options)));
+  caching_client->LoadCacheFile();
+  if (caching_client->options_.refresh_interval > absl::ZeroDuration()) {
+    caching_client->refresh_thread_ = absl::make_unique<Thread>(
+        [client = caching_client.get()] { client->RefreshLoop(); });
+  }
+  return std::move(caching_client);
+}
+
+CachingSgxPcsClient::CachingSgxPcsClient(std::unique_ptr<SgxPcsClient> client,
+                                         Options options)
+    : client_(std::move(client)), options_(std::move(options)) {}
+
+CachingSgxPcsClient::~CachingSgxPcsClient() {
+  {
+    absl::MutexLock lock(&mu_);
+    shutting_down_ = true;
+  }
+  if (refresh_thread_ != nullptr) {
+    refresh_thread_->Join();
+  }
+}
+
+StatusOr<GetPckCertificateResult> CachingSgxPcsClient::GetPckCertificate(
+    const Ppid &ppid, const CpuSvn &cpu_svn, const PceSvn &pce_svn,
+    const PceId &pce_id) {
+  SgxPcsRequest request;
+  SgxPcsRequest::GetPckCertificate *arguments =
+      request.mutable_get_pck_certificate();
+  *arguments->mutable_ppid() = ppid;
+  *arguments->mutable_cpu_svn() = cpu_svn;
+  *arguments->mutable_pce_svn() = pce_svn;
+  *arguments->mutable_pce_id() = pce_id;
+
+  SgxPcsResponse response;
+  ASYLO_ASSIGN_OR_RETURN(response, Fetch(request));
+  SgxPcsResponse::GetPckCertificate *cached =
+      response.mutable_get_pck_certificate();
+  GetPckCertificateResult result;
+  result.pck_cert = std::move(*cached->mutable_pck_cert());
+  result.issuer_cert_chain = std::move(*cached->mutable_issuer_cert_chain());
+  result.tcbm = std::move(*cached->mutable_tcbm());
+  return result;
+}
+
+StatusOr<GetPckCertificatesResult> CachingSgxPcsClient::GetPckCertificates(
+    const Ppid &ppid, const PceId &pce_id) {
+  SgxPcsRequest request;
+  SgxPcsRequest::GetPckCertificates *arguments =
+      request.mutable_get_pck_certificates();
+  *arguments->mutable_ppid() = ppid;
+  *arguments->mutable_pce_id() = pce_id;
+
+  SgxPcsResponse response;
+  ASYLO_ASSIGN_OR_RETURN(response, Fetch(request));
+  SgxPcsResponse::GetPckCertificates *cached =
+      response.mutable_get_pck_certificates();
+  GetPckCertificatesResult result;
+  result.pck_certs = std::move(*cached->mutable_pck_certs());
+  result.issuer_cert_chain = std::move(*cached->mutable_issuer_cert_chain());
+  return result;
+}
+
+StatusOr<GetCrlResult> CachingSgxPcsClient::GetCrl(SgxCaType sgx_ca_type) {
+  SgxPcsRequest request;
+  request.set_get_crl(sgx_ca_type);
+
+  SgxPcsResponse response;
+  ASYLO_ASSIGN_OR_RETURN(response, Fetch(request));
+  SgxPcsResponse::GetCrl *cached = response.mutable_get_crl();
+  InstallRevocationList(cached->pck_crl());
+  GetCrlResult result;
+  result.pck_crl = std::move(*cached->mutable_pck_crl());
+  result.issuer_cert_chain = std::move(*cached->mutable_issuer_cert_chain());
+  return result;
+}
+
+StatusOr<GetTcbInfoResult> CachingSgxPcsClient::GetTcbInfo(const Fmspc &fmspc) {
+  SgxPcsRequest request;
+  *request.mutable_get_tcb_info() = fmspc;
+
+  SgxPcsResponse response;
+  ASYLO_ASSIGN_OR_RETURN(response, Fetch(request));
+  SgxPcsResponse::GetTcbInfo *cached = response.mutable_get_tcb_info();
+  GetTcbInfoResult result;
+  result.tcb_info = std::move(*cached->mutable_tcb_info());
+  result.issuer_cert_chain = std::move(*cached->mutable_issuer_cert_chain());
+  return result;
+}
+
+void CachingSgxPcsClient::RefreshExpiringEntries() {
+  absl::Time now = absl::Now();
+  std::vector<std::pair<std::string, SgxPcsRequest>> expiring;
+  bool dropped_expired = false;
+  {
+    absl::MutexLock lock(&mu_);
+    for (auto it = entries_.begin(); it != entries_.end();) {
+      absl::Time expiration_time = EntryExpirationTime(it->second);
+      if (expiration_time <= now) {
+        entries_.erase(it++);
+        dropped_expired = true;
+        continue;
+      }
+      if (expiration_time - now <= options_.refresh_ahead) {
+        expiring.emplace_back(it->first, it->second.request());
+      }
+      ++it;
+    }
+  }
+
+  for (const auto &key_and_request : expiring) {
+    StatusOr<SgxPcsResponse> result =
+        FetchFromClient(key_and_request.first, key_and_request.second);
+    if (!result.ok()) {
+      LOG(WARNING) << "Failed to refresh cached SGX PCS response: "
+                   << result.status();
+    }
+  }
+
+  if (dropped_expired) {
+    Status status = SaveCacheFile();
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to save SGX PCS cache: " << status;
+    }
+  }
+}
+
+StatusOr<SgxPcsResponse> CachingSgxPcsClient::Fetch(
+    const SgxPcsRequest &request) {
+  std::string key = request.SerializeAsString();
+  {
+    absl::MutexLock lock(&mu_);
+    auto it = entries_.find(key);
+    if (it != entries_.end()) {
+      if (absl::Now() < EntryExpirationTime(it->second)) {
+        return it->second.response();
+      }
+      entries_.erase(it);
+    }
+  }
+  return FetchFromClient(key, request);
+}
+
+StatusOr<SgxPcsResponse> CachingSgxPcsClient::FetchFromClient(
+    const std::string &key, const SgxPcsRequest &request) {
+  std::shared_ptr<InFlightFetch> fetch;
+  {
+    absl::MutexLock lock(&mu_);
+    auto it = in_flight_.find(key);
+    if (it != in_flight_.end()) {
+      fetch = it->second;
+      mu_.Await(absl::Condition(&fetch->done));
+      return fetch->result;
+    }
+    fetch = std::make_shared<InFlightFetch>();
+    in_flight_.emplace(key, fetch);
+  }
+
+  StatusOr<SgxPcsResponse> result = CallClient(request);
+
+  // Only successful responses that have not already expired are cached.
+  bool cached = false;
+  SgxPcsCacheEntry entry;
+  if (result.ok()) {
+    absl::Time now = absl::Now();
+    absl::Time expiration_time = ExpirationTime(result.value(), now);
+    StatusOr<google::protobuf::Timestamp> expiration_timestamp =
+        ConvertTime<google::protobuf::Timestamp>(expiration_time);
+    if (expiration_time > now && expiration_timestamp.ok()) {
+      *entry.mutable_request() = request;
+      *entry.mutable_response() = result.value();
+      *entry.mutable_expiration_time() = expiration_timestamp.value();
+      cached = true;
+    }
+  }
+
+  {
+    absl::MutexLock lock(&mu_);
+    if (cached) {
+      entries_[key] = std::move(entry);
+    }
+    fetch->result = result;
+    fetch->done = true;
+    in_flight_.erase(key);
+  }
+
+  if (cached) {
+    Status status = SaveCacheFile();
+    if (!status.ok()) {
+      LOG(WARNING) << "Failed to save SGX PCS cache: " << status;
+    }
+  }
+  return result;
+}
+
+StatusOr<SgxPcsResponse> CachingSgxPcsClient::CallClient(
+    const SgxPcsRequest &request) {
+  SgxPcsResponse response;
+  switch (request.request_case()) {
+    case SgxPcsRequest::kGetPckCertificate: {
+      const SgxPcsRequest::GetPckCertificate &arguments =
+          request.get_pck_certificate();
+      GetPckCertificateResult result;
+      ASYLO_ASSIGN_OR_RETURN(
+          result, client_->GetPckCertificate(
+                      arguments.ppid(), arguments.cpu_svn(),
+                      arguments.pce_svn(), arguments.pce_id()));
+      SgxPcsResponse::GetPckCertificate *cached =
+          response.mutable_get_pck_certificate();
+      *cached->mutable_pck_cert() = std::move(result.pck_cert);
+      *cached->mutable_issuer_cert_chain() =
+          std::move(result.issuer_cert_chain);
+      *cached->mutable_tcbm() = std::move(result.tcbm);
+      break;
+    }
+    case SgxPcsRequest::kGetPckCertificates: {
+      const SgxPcsRequest::GetPckCertificates &arguments =
+          request.get_pck_certificates();
+      GetPckCertificatesResult result;
+      ASYLO_ASSIGN_OR_RETURN(result, client_->GetPckCertificates(
+                                         arguments.ppid(), arguments.pce_id()));
+      SgxPcsResponse::GetPckCertificates *cached =
+          response.mutable_get_pck_certificates();
+      *cached->mutable_pck_certs() = std::move(result.pck_certs);
+      *cached->mutable_issuer_cert_chain() =
+          std::move(result.issuer_cert_chain);
+      break;
+    }
+    case SgxPcsRequest::kGetCrl: {
+      GetCrlResult result;
+      ASYLO_ASSIGN_OR_RETURN(result, client_->GetCrl(request.get_crl()));
+      // Refreshed lists take effect before they are next requested.
+      InstallRevocationList(result.pck_crl);
+      SgxPcsResponse::GetCrl *cached = response.mutable_get_crl();
+      *cached->mutable_pck_crl() = std::move(result.pck_crl);
+      *cached->mutable_issuer_cert_chain() =
+          std::move(result.issuer_cert_chain);
+      break;
+    }
+    case SgxPcsRequest::kGetTcbInfo: {
+      GetTcbInfoResult result;
+      ASYLO_ASSIGN_OR_RETURN(result,
+                             client_->GetTcbInfo(request.get_tcb_info()));
+      SgxPcsResponse::GetTcbInfo *cached = response.mutable_get_tcb_info();
+      *cached->mutable_tcb_info() = std::move(result.tcb_info);
+      *cached->mutable_issuer_cert_chain() =
+          std::move(result.issuer_cert_chain);
+      break;
+    }
+    default:
+      return Status(absl::StatusCode::kInvalidArgument,
+                    "SGX PCS request has no call set");
+  }
+  return response;
+}
+
+absl::Time CachingSgxPcsClient::ExpirationTime(const SgxPcsResponse &response,
+                                               absl::Time now) {
+  StatusOr<absl::Time> next_update;
+  switch (response.response_case()) {
+    case SgxPcsResponse::kGetCrl:
+      next_update = CrlNextUpdate(response.get_crl().pck_crl());
+      break;
+    case SgxPcsResponse::kGetTcbInfo:
+      next_update = TcbInfoNextUpdate(response.get_tcb_info().tcb_info());
+      break;
+    default:
+      return now + options_.default_lifetime;
+  }
+  if (!next_update.ok()) {
+    LOG(WARNING) << "Could not determine when SGX PCS response expires: "
+                 << next_update.status();
+    return now + options_.default_lifetime;
+  }
+  return next_update.value();
+}
+
+void CachingSgxPcsClient::LoadCacheFile() {
+  if (options_.cache_file_path.empty()) {
+    return;
+  }
+
+  int fd = open(options_.cache_file_path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    if (errno != ENOENT) {
+      LOG(WARNING) << "Failed to open SGX PCS cache: "
+                   << LastPosixError(options_.cache_file_path);
+    }
+    return;
+  }
+  StatusOr<std::string> contents = ReadAll(fd);
+  close(fd);
+  if (!contents.ok()) {
+    LOG(WARNING) << "Failed to read SGX PCS cache: " << contents.status();
+    return;
+  }
+
+  SgxPcsCache cache;
+  if (!cache.ParseFromString(contents.value())) {
+    LOG(WARNING) << "Ignoring unparsable SGX PCS cache at "
+                 << options_.cache_file_path;
+    return;
+  }
+
+  absl::Time now = absl::Now();
+  absl::MutexLock lock(&mu_);
+  for (SgxPcsCacheEntry &entry : *cache.mutable_entries()) {
+    // The cases of the request and response oneofs are numbered identically.
+    if (static_cast<int>(entry.request().request_case()) !=
+            static_cast<int>(entry.response().response_case()) ||
+        EntryExpirationTime(entry) <= now) {
+      continue;
+    }
+    std::string key = entry.request().SerializeAsString();
+    entries_[key] = std::move(entry);
+  }
+}
+
+Status CachingSgxPcsClient::SaveCacheFile() {
+  if (options_.cache_file_path.empty()) {
+    return absl::OkStatus();
+  }
+
+  // Holding |file_mu_| while taking the snapshot ensures that the last write
+  // of the file reflects the latest contents of the cache.
+  absl::MutexLock file_lock(&file_mu_);
+  SgxPcsCache cache;
+  {
+    absl::MutexLock lock(&mu_);
+    for (const auto &key_and_entry : entries_) {
+      *cache.add_entries() = key_and_entry.second;
+    }
+  }
+
+  // Write to a uniquely-named temporary file in the same directory, flush it
+  // to disk and rename it over the cache file, so that neither a crash nor a
+  // concurrent writer ever leaves a partially-written cache behind.
+  std::string temp_path = absl::StrCat(options_.cache_file_path, ".XXXXXX");
+  int fd = mkstemp(&temp_path[0]);
+  if (fd < 0) {
+    return LastPosixError(
+        absl::StrCat("Failed to create temporary file for ",
+                     options_.cache_file_path));
+  }
+  Status status = WriteAll(fd, cache.SerializeAsString());
+  if (status.ok() && fsync(fd) != 0) {
+    status = LastPosixError(absl::StrCat("Failed to sync ", temp_path));
+  }
+  if (close(fd) != 0 && status.ok()) {
+    status = LastPosixError(absl::StrCat("Failed to close ", temp_path));
+  }
+  if (status.ok() &&
+      rename(temp_path.c_str(), options_.cache_file_path.c_str()) != 0) {
+    status = LastPosixError(absl::StrCat("Failed to rename ", temp_path,
+                                         " to ", options_.cache_file_path));
+  }
+  if (!status.ok()) {
+    unlink(temp_path.c_str());
+  }
+  return status;
+}
+
+void CachingSgxPcsClient::RefreshLoop() {
+  while (true) {
+    {
+      absl::MutexLock lock(&mu_);
+      mu_.AwaitWithTimeout(absl::Condition(&shutting_down_),
+                           options_.refresh_interval);
+      if (shutting_down_) {
+        return;
+      }
+    }
+    RefreshExpiringEntries();
+  }
+}
+
+}  // namespace sgx
+}  // namespace asylo
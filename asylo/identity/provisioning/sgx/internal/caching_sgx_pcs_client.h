@@ -0,0 +1,172 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_IDENTITY_PROVISIONING_SGX_INTERNAL_CACHING_SGX_PCS_CLIENT_H_
+#define ASYLO_IDENTITY_PROVISIONING_SGX_INTERNAL_CACHING_SGX_PCS_CLIENT_H_
+
+#include <memory>
+#include <string>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "asylo/identity/platform/sgx/machine_configuration.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/caching_sgx_pcs_client.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/platform_provisioning.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/sgx_pcs_client.h"
+#include "asylo/identity/provisioning/sgx/internal/sgx_pcs_client.pb.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+namespace sgx {
+
+// An SgxPcsClient that caches the responses of another SgxPcsClient.
+//
+// Responses are cached until they expire. TCB infos and CRLs expire at their
+// "nextUpdate" time. PCK certificates, and any response whose "nextUpdate"
+// cannot be determined, expire |default_lifetime| after they are fetched.
+// Errors are never cached.
+//
+// Concurrent calls with the same arguments are coalesced: only one call is
+// made to the underlying client, and all callers receive its result.
+//
+// If |refresh_interval| is non-zero, a background thread periodically
+// re-fetches cached responses that expire within |refresh_ahead|, so that
+// callers do not observe the latency of the PCS once the cache is warm.
+//
+// If |cache_file_path| is non-empty, the cache is loaded from that file on
+// creation and written back to it whenever it changes, so that the cache
+// survives restarts. The file contains platform identifiers such as PPIDs and
+// is created with owner-only permissions.
+//
+// CachingSgxPcsClient is thread-safe.
+class CachingSgxPcsClient : public SgxPcsClient {
+ public:
+  // Options for a CachingSgxPcsClient.
+  struct Options {
+    // The lifetime of responses with no known "nextUpdate" time.
+    absl::Duration default_lifetime = absl::Hours(24);
+
+    // How long before their expiration cached responses are refreshed.
+    absl::Duration refresh_ahead = absl::Hours(1);
+
+    // How often the background thread looks for responses to refresh. A value
+    // of zero disables background refreshes.
+    absl::Duration refresh_interval = absl::Minutes(10);
+
+    // The file in which the cache is persisted. If empty, the cache is kept
+    // only in memory.
+    std::string cache_file_path;
+  };
+
+  // Creates a CachingSgxPcsClient that caches the responses of |client|.
+  // Returns an error if |client| is null. A missing or unparsable cache file
+  // results in an empty cache rather than an error.
+  static StatusOr<std::unique_ptr<CachingSgxPcsClient>> Create(
+      std::unique_ptr<SgxPcsClient> client, Options options);
+
+  CachingSgxPcsClient(const CachingSgxPcsClient &) = delete;
+  CachingSgxPcsClient &operator=(const CachingSgxPcsClient &) = delete;
+
+  // Stops the background refresh thread, if any.
+  ~CachingSgxPcsClient() override;
+
+  // From SgxPcsClient.
+  StatusOr<GetPckCertificateResult> GetPckCertificate(
+      const Ppid &ppid, const CpuSvn &cpu_svn, const PceSvn &pce_svn,
+      const PceId &pce_id) override;
+
+  StatusOr<GetPckCertificatesResult> GetPckCertificates(
+      const Ppid &ppid, const PceId &pce_id) override;
+
+  StatusOr<GetCrlResult> GetCrl(SgxCaType sgx_ca_type) override;
+
+  StatusOr<GetTcbInfoResult> GetTcbInfo(const Fmspc &fmspc) override;
+
+  // Re-fetches every cached response that expires within |refresh_ahead| and
+  // drops responses that have already expired. Responses that fail to refresh
+  // are kept until they expire. This is called periodically by the background
+  // refresh thread, but may also be called directly.
+  void RefreshExpiringEntries() ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // A call to the underlying client that is in progress.
+  struct InFlightFetch {
+    bool done = false;
+    StatusOr<SgxPcsResponse> result;
+  };
+
+  CachingSgxPcsClient(std::unique_ptr<SgxPcsClient> client, Options options);
+
+  // Returns the response to |request| from the cache, or fetches it from the
+  // underlying client if it is not cached.
+  StatusOr<SgxPcsResponse> Fetch(const SgxPcsRequest &request)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Fetches the response to |request| from the underlying client, coalescing
+  // the call with any other in-progress call for |key|, and caches the result.
+  StatusOr<SgxPcsResponse> FetchFromClient(const std::string &key,
+                                           const SgxPcsRequest &request)
+      ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Makes the call described by |request| on the underlying client.
+  StatusOr<SgxPcsResponse> CallClient(const SgxPcsRequest &request);
+
+  // Returns the time at which |response| should be fetched again.
+  absl::Time ExpirationTime(const SgxPcsResponse &response, absl::Time now);
+
+  // Loads the cache from |options_.cache_file_path|.
+  void LoadCacheFile() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Writes the cache to |options_.cache_file_path|. Does nothing if the path is
+  // empty.
+  Status SaveCacheFile() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Periodically calls RefreshExpiringEntries() until |shutting_down_| is set.
+  void RefreshLoop() ABSL_LOCKS_EXCLUDED(mu_);
+
+  const std::unique_ptr<SgxPcsClient> client_;
+  const Options options_;
+
+  // Serializes writes of the cache file.
+  absl::Mutex file_mu_;
+
+  absl::Mutex mu_;
+
+  // Cached entries, keyed by the serialized request.
+  absl::flat_hash_map<std::string, SgxPcsCacheEntry> entries_
+      ABSL_GUARDED_BY(mu_);
+
+  // Calls to the underlying client that are in progress, keyed by the
+  // serialized request.
+  absl::flat_hash_map<std::string, std::shared_ptr<InFlightFetch>> in_flight_
+      ABSL_GUARDED_BY(mu_);
+
+  // Set when the background refresh thread should exit.
+  bool shutting_down_ ABSL_GUARDED_BY(mu_) = false;
+  std::unique_ptr<Thread> refresh_thread_;
+};
+
+}  // namespace sgx
+}  // namespace asylo
+
+#endif  // ASYLO_IDENTITY_PROVISIONING_SGX_INTERNAL_CACHING_SGX_PCS_CLIENT_H_
@@ -0,0 +1,311 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/identity/provisioning/sgx/internal/caching_sgx_pcs_client.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/flags/flag.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/time.h"
+#include "asylo/identity/provisioning/sgx/internal/fake_sgx_pcs_client.h"
+#include "asylo/identity/provisioning/sgx/internal/mock_sgx_pcs_client.h"
+#include "asylo/identity/provisioning/sgx/internal/platform_provisioning.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/sgx_pcs_client.h"
+#include "asylo/identity/provisioning/sgx/internal/sgx_pcs_client.pb.h"
+#include "asylo/identity/provisioning/sgx/internal/tcb.pb.h"
+#include "asylo/test/util/proto_matchers.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/test/util/test_flags.h"
+#include "asylo/util/fd_utils.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/status.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+namespace sgx {
+namespace {
+
+using ::testing::_;
+using ::testing::Invoke;
+using ::testing::Return;
+
+constexpr int kNumConcurrentCallers = 8;
+
+class CachingSgxPcsClientTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    FakeSgxPcsClient::PlatformProperties platform_properties;
+    platform_properties.ca = SgxCaType::PROCESSOR;
+    platform_properties.pce_id.set_value(0);
+    pce_id_ = platform_properties.pce_id;
+
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        fmspc_, fake_client_.CreateFmspcWithProperties(platform_properties));
+    ASSERT_THAT(fake_client_.AddFmspc(fmspc_, SomeTcbInfo()),
+                IsOkAndHolds(true));
+    ASYLO_ASSERT_OK_AND_ASSIGN(ppid_,
+                               FakeSgxPcsClient::CreatePpidForFmspc(fmspc_));
+
+    options_.refresh_interval = absl::ZeroDuration();
+  }
+
+  // Returns a version 2 TCB info for |fmspc_|.
+  TcbInfo SomeTcbInfo() {
+    TcbInfo tcb_info;
+    TcbInfoImpl *impl = tcb_info.mutable_impl();
+    impl->set_version(2);
+    impl->mutable_issue_date()->set_seconds(0);
+    impl->mutable_next_update()->set_seconds(1);
+    *impl->mutable_fmspc() = fmspc_;
+    *impl->mutable_pce_id() = pce_id_;
+    impl->set_tcb_type(TcbType::TCB_TYPE_0);
+    impl->set_tcb_evaluation_data_number(2);
+    TcbLevel *tcb_level = impl->add_tcb_levels();
+    tcb_level->mutable_tcb()->set_components("0123456789abcdef");
+    tcb_level->mutable_tcb()->mutable_pce_svn()->set_value(7);
+    tcb_level->mutable_status()->set_known_status(TcbStatus::UP_TO_DATE);
+    tcb_level->mutable_tcb_date()->set_seconds(1000);
+    return tcb_info;
+  }
+
+  // Returns a mock SgxPcsClient whose calls are forwarded to |fake_client_|
+  // unless overridden.
+  std::unique_ptr<MockSgxPcsClient> CreateMockClient() {
+    auto mock_client = absl::make_unique<MockSgxPcsClient>();
+    ON_CALL(*mock_client, GetPckCertificates(_, _))
+        .WillByDefault(Invoke(&fake_client_,
+                              &FakeSgxPcsClient::GetPckCertificates));
+    ON_CALL(*mock_client, GetTcbInfo(_))
+        .WillByDefault(Invoke(&fake_client_, &FakeSgxPcsClient::GetTcbInfo));
+    return mock_client;
+  }
+
+  // Creates a CachingSgxPcsClient wrapping |mock_client|, which is left
+  // pointing at the mock so that expectations can still be set on it.
+  std::unique_ptr<CachingSgxPcsClient> CreateCachingClient(
+      std::unique_ptr<MockSgxPcsClient> mock_client) {
+    auto caching_client =
+        CachingSgxPcsClient::Create(std::move(mock_client), options_);
+    CHECK(caching_client.ok()) << caching_client.status();
+    return std::move(caching_client).value();
+  }
+
+  // Returns a path for a cache file that does not exist yet.
+  std::string CacheFilePath(const std::string &name) {
+    std::string path =
+        absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir), "/", name);
+    unlink(path.c_str());
+    return path;
+  }
+
+  FakeSgxPcsClient fake_client_;
+  Fmspc fmspc_;
+  Ppid ppid_;
+  PceId pce_id_;
+  CachingSgxPcsClient::Options options_;
+};
+
+TEST_F(CachingSgxPcsClientTest, CreateFailsWithNullClient) {
+  EXPECT_THAT(CachingSgxPcsClient::Create(/*client=*/nullptr, options_),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST_F(CachingSgxPcsClientTest, CreateFailsWithNegativeDuration) {
+  options_.default_lifetime = -absl::Seconds(1);
+  EXPECT_THAT(CachingSgxPcsClient::Create(CreateMockClient(), options_),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST_F(CachingSgxPcsClientTest, RepeatedGetTcbInfoCallsAreCached) {
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetTcbInfo(_)).Times(1);
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+
+  GetTcbInfoResult first;
+  ASYLO_ASSERT_OK_AND_ASSIGN(first, caching_client->GetTcbInfo(fmspc_));
+  GetTcbInfoResult second;
+  ASYLO_ASSERT_OK_AND_ASSIGN(second, caching_client->GetTcbInfo(fmspc_));
+  EXPECT_THAT(second.tcb_info, EqualsProto(first.tcb_info));
+  EXPECT_THAT(second.issuer_cert_chain, EqualsProto(first.issuer_cert_chain));
+}
+
+TEST_F(CachingSgxPcsClientTest, RepeatedGetPckCertificatesCallsAreCached) {
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetPckCertificates(_, _)).Times(1);
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+
+  // FakeSgxPcsClient re-signs its certificates on every call, so equal results
+  // show that the second call was served from the cache.
+  GetPckCertificatesResult first;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      first, caching_client->GetPckCertificates(ppid_, pce_id_));
+  GetPckCertificatesResult second;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      second, caching_client->GetPckCertificates(ppid_, pce_id_));
+  EXPECT_THAT(second.pck_certs, EqualsProto(first.pck_certs));
+}
+
+TEST_F(CachingSgxPcsClientTest, CallsWithDifferentArgumentsAreCachedSeparately) {
+  Fmspc other_fmspc = fmspc_;
+  other_fmspc.mutable_value()->back() ^= 1;
+
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetTcbInfo(EqualsProto(fmspc_))).Times(1);
+  EXPECT_CALL(*mock_client, GetTcbInfo(EqualsProto(other_fmspc)))
+      .Times(2)
+      .WillRepeatedly(Return(Status(absl::StatusCode::kNotFound, "")));
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+
+  ASYLO_EXPECT_OK(caching_client->GetTcbInfo(fmspc_));
+  EXPECT_THAT(caching_client->GetTcbInfo(other_fmspc),
+              StatusIs(absl::StatusCode::kNotFound));
+  ASYLO_EXPECT_OK(caching_client->GetTcbInfo(fmspc_));
+  EXPECT_THAT(caching_client->GetTcbInfo(other_fmspc),
+              StatusIs(absl::StatusCode::kNotFound));
+}
+
+TEST_F(CachingSgxPcsClientTest, ErrorsAreNotCached) {
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetCrl(SgxCaType::PROCESSOR))
+      .Times(2)
+      .WillRepeatedly(Return(Status(absl::StatusCode::kUnavailable, "")));
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+
+  EXPECT_THAT(caching_client->GetCrl(SgxCaType::PROCESSOR),
+              StatusIs(absl::StatusCode::kUnavailable));
+  EXPECT_THAT(caching_client->GetCrl(SgxCaType::PROCESSOR),
+              StatusIs(absl::StatusCode::kUnavailable));
+}
+
+TEST_F(CachingSgxPcsClientTest, ZeroDefaultLifetimeDisablesPckCaching) {
+  options_.default_lifetime = absl::ZeroDuration();
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetPckCertificates(_, _)).Times(2);
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+
+  ASYLO_EXPECT_OK(caching_client->GetPckCertificates(ppid_, pce_id_));
+  ASYLO_EXPECT_OK(caching_client->GetPckCertificates(ppid_, pce_id_));
+}
+
+TEST_F(CachingSgxPcsClientTest, ConcurrentCallsAreCoalesced) {
+  absl::Notification first_call_started;
+  absl::Notification release_first_call;
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetTcbInfo(_))
+      .WillOnce(Invoke([&](const Fmspc &fmspc) {
+        first_call_started.Notify();
+        release_first_call.WaitForNotification();
+        return fake_client_.GetTcbInfo(fmspc);
+      }));
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+
+  std::vector<StatusOr<GetTcbInfoResult>> results(kNumConcurrentCallers);
+  std::vector<Thread> threads;
+  threads.emplace_back([&] { results[0] = caching_client->GetTcbInfo(fmspc_); });
+  first_call_started.WaitForNotification();
+  for (int i = 1; i < kNumConcurrentCallers; ++i) {
+    threads.emplace_back(
+        [&, i] { results[i] = caching_client->GetTcbInfo(fmspc_); });
+  }
+  release_first_call.Notify();
+  for (Thread &thread : threads) {
+    thread.Join();
+  }
+
+  ASYLO_ASSERT_OK(results[0]);
+  for (const auto &result : results) {
+    ASYLO_ASSERT_OK(result);
+    EXPECT_THAT(result.value().tcb_info,
+                EqualsProto(results[0].value().tcb_info));
+  }
+}
+
+TEST_F(CachingSgxPcsClientTest, RefreshRefetchesResponsesAboutToExpire) {
+  // FakeSgxPcsClient sets the "nextUpdate" of its TCB infos 30 days ahead.
+  options_.refresh_ahead = absl::Hours(24 * 60);
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetTcbInfo(_)).Times(2);
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+
+  ASYLO_ASSERT_OK(caching_client->GetTcbInfo(fmspc_));
+  caching_client->RefreshExpiringEntries();
+  ASYLO_ASSERT_OK(caching_client->GetTcbInfo(fmspc_));
+}
+
+TEST_F(CachingSgxPcsClientTest, RefreshLeavesFreshResponsesAlone) {
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetTcbInfo(_)).Times(1);
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+
+  ASYLO_ASSERT_OK(caching_client->GetTcbInfo(fmspc_));
+  caching_client->RefreshExpiringEntries();
+  ASYLO_ASSERT_OK(caching_client->GetTcbInfo(fmspc_));
+}
+
+TEST_F(CachingSgxPcsClientTest, CacheIsPersistedAcrossClients) {
+  options_.cache_file_path = CacheFilePath("persisted_sgx_pcs_cache");
+
+  GetPckCertificatesResult expected;
+  {
+    auto mock_client = CreateMockClient();
+    EXPECT_CALL(*mock_client, GetPckCertificates(_, _)).Times(1);
+    auto caching_client = CreateCachingClient(std::move(mock_client));
+    ASYLO_ASSERT_OK_AND_ASSIGN(
+        expected, caching_client->GetPckCertificates(ppid_, pce_id_));
+  }
+
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetPckCertificates(_, _)).Times(0);
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+  GetPckCertificatesResult result;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      result, caching_client->GetPckCertificates(ppid_, pce_id_));
+  EXPECT_THAT(result.pck_certs, EqualsProto(expected.pck_certs));
+  EXPECT_THAT(result.issuer_cert_chain,
+              EqualsProto(expected.issuer_cert_chain));
+}
+
+TEST_F(CachingSgxPcsClientTest, UnparsableCacheFileIsIgnored) {
+  options_.cache_file_path = CacheFilePath("unparsable_sgx_pcs_cache");
+  int fd = open(options_.cache_file_path.c_str(), O_WRONLY | O_CREAT, 0600);
+  ASSERT_GE(fd, 0);
+  ASYLO_ASSERT_OK(WriteAll(fd, "\xff\xff\xff\xff not a cache"));
+  close(fd);
+
+  auto mock_client = CreateMockClient();
+  EXPECT_CALL(*mock_client, GetTcbInfo(_)).Times(1);
+  auto caching_client = CreateCachingClient(std::move(mock_client));
+  ASYLO_EXPECT_OK(caching_client->GetTcbInfo(fmspc_));
+}
+
+}  // namespace
+}  // namespace sgx
+}  // namespace asylo
@@ -0,0 +1,156 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_PLATFORM_COMMON_EPOLL_READINESS_RING_H_
+#define ASYLO_PLATFORM_COMMON_EPOLL_READINESS_RING_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace asylo {
+
+// A batch of epoll readiness events published by an untrusted poller thread
+// and consumed by an enclave, letting the enclave answer epoll_wait() from
+// memory while events are pending instead of exiting to the host.
+//
+// The ring holds one batch at a time and alternates between two states, kept in
+// a futex word so that either side can block on the other:
+//
+//   kArmed --(poller publishes a batch)--> kPublished
+//   kPublished --(consumer takes the last event of the batch)--> kArmed
+//
+// The poller only writes the batch while the ring is armed, and the consumer
+// only reads it while it is published. A poller which fails stores kFailed,
+// after which the consumer is expected to stop using the ring.
+//
+// NOTE: The ring is intended to be shared with an enclave through untrusted
+// memory. A consumer must treat the published events as a hint from the host,
+// no more trustworthy than the result of an epoll_wait() host call. Consume()
+// bounds every index it reads from the ring, so a corrupted ring can only yield
+// bogus events, never an out-of-bounds access.
+//
+// A simple versioning scheme is supported to confirm the compatibility of
+// objects and types at runtime, as for SharedClock:
+//
+// EpollReadinessRing::TypeVersion() == instance->InstanceVersion();
+//
+class EpollReadinessRing {
+ public:
+  static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t),
+                "std::atomic<int32_t> cannot be used as a futex word.");
+
+  // Maximum number of events in a batch.
+  static constexpr int kCapacity = 64;
+
+  // States of the ring.
+  static constexpr int32_t kArmed = 0;
+  static constexpr int32_t kPublished = 1;
+  static constexpr int32_t kFailed = 2;
+
+  // A readiness event, as reported by the host kernel.
+  struct Event {
+    uint32_t events;
+    uint64_t data;
+  };
+
+  EpollReadinessRing()
+      : instance_version_(TypeVersion()), state_(kArmed), count_(0), head_(0) {}
+
+  EpollReadinessRing(const EpollReadinessRing &) = delete;
+  EpollReadinessRing &operator=(const EpollReadinessRing &) = delete;
+
+  // Returns a signature reflecting the layout of this concrete instance.
+  uint64_t InstanceVersion() const { return instance_version_; }
+
+  // Returns a signature reflecting the layout of this abstract type.
+  static constexpr uint64_t TypeVersion() {
+    return offsetof(EpollReadinessRing, state_) << 0 |
+           offsetof(EpollReadinessRing, count_) << 8 |
+           offsetof(EpollReadinessRing, head_) << 16 |
+           offsetof(EpollReadinessRing, events_) << 24 |
+           sizeof(EpollReadinessRing) << 32;
+  }
+
+  // Returns the futex word holding the state of the ring.
+  int32_t *state_word() { return reinterpret_cast<int32_t *>(&state_); }
+
+  // Returns the current state of the ring.
+  int32_t state() const { return state_.load(std::memory_order_acquire); }
+
+  // Publishes the first |count| events of |events|, up to kCapacity. Must only
+  // be called by a single poller. Returns false if the ring is not armed or
+  // |count| is not positive.
+  bool Publish(const Event *events, int count) {
+    if (count <= 0 || state_.load(std::memory_order_acquire) != kArmed) {
+      return false;
+    }
+    count = std::min(count, kCapacity);
+    std::copy(events, events + count, events_);
+    count_.store(count, std::memory_order_relaxed);
+    head_.store(0, std::memory_order_relaxed);
+    // The ring may have failed since it was checked.
+    int32_t expected = kArmed;
+    return state_.compare_exchange_strong(expected, kPublished,
+                                          std::memory_order_release,
+                                          std::memory_order_relaxed);
+  }
+
+  // Marks the ring as failed. May be called by either side; a failed ring is
+  // never published or re-armed again.
+  void Fail() { state_.store(kFailed, std::memory_order_release); }
+
+  // Takes up to |max_events| published events into |events| and re-arms the
+  // ring once every event of the batch has been taken. Returns the number of
+  // events taken, which is zero if no batch is published. Must only be called
+  // by one consumer at a time.
+  int Consume(Event *events, int max_events) {
+    if (max_events <= 0 ||
+        state_.load(std::memory_order_acquire) != kPublished) {
+      return 0;
+    }
+    uint32_t count =
+        std::min<uint32_t>(count_.load(std::memory_order_relaxed), kCapacity);
+    uint32_t head = std::min(head_.load(std::memory_order_relaxed), count);
+    uint32_t taken = std::min<uint32_t>(count - head, max_events);
+    std::copy(events_ + head, events_ + head + taken, events);
+    head += taken;
+    if (head == count) {
+      int32_t expected = kPublished;
+      state_.compare_exchange_strong(expected, kArmed,
+                                     std::memory_order_release,
+                                     std::memory_order_relaxed);
+    } else {
+      head_.store(head, std::memory_order_relaxed);
+    }
+    return taken;
+  }
+
+ private:
+  const uint64_t instance_version_;  // Layout of the ring.
+  std::atomic<int32_t> state_;       // kArmed, kPublished or kFailed.
+  std::atomic<uint32_t> count_;      // Number of events in the batch.
+  std::atomic<uint32_t> head_;       // Index of the first event not taken.
+  Event events_[kCapacity];          // The published batch.
+} __attribute__((aligned(64)));
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_COMMON_EPOLL_READINESS_RING_H_
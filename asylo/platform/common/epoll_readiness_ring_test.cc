@@ -0,0 +1,166 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/platform/common/epoll_readiness_ring.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+namespace asylo {
+namespace {
+
+using Event = EpollReadinessRing::Event;
+
+std::vector<Event> MakeEvents(int count, uint64_t first_data) {
+  std::vector<Event> events(count);
+  for (int i = 0; i < count; ++i) {
+    events[i].events = 1;
+    events[i].data = first_data + i;
+  }
+  return events;
+}
+
+TEST(EpollReadinessRingTest, LayoutVersionMatches) {
+  EpollReadinessRing ring;
+  EXPECT_EQ(ring.InstanceVersion(), EpollReadinessRing::TypeVersion());
+  EXPECT_EQ(ring.state(), EpollReadinessRing::kArmed);
+}
+
+TEST(EpollReadinessRingTest, ConsumeFromArmedRingTakesNothing) {
+  EpollReadinessRing ring;
+  Event event;
+  EXPECT_EQ(ring.Consume(&event, 1), 0);
+  EXPECT_EQ(ring.state(), EpollReadinessRing::kArmed);
+}
+
+TEST(EpollReadinessRingTest, PublishRequiresArmedRing) {
+  EpollReadinessRing ring;
+  std::vector<Event> events = MakeEvents(2, 10);
+  EXPECT_FALSE(ring.Publish(events.data(), 0));
+  ASSERT_TRUE(ring.Publish(events.data(), 2));
+  EXPECT_EQ(ring.state(), EpollReadinessRing::kPublished);
+  EXPECT_FALSE(ring.Publish(events.data(), 2));
+}
+
+// Ensure a batch larger than the caller's buffer is handed out across several
+// calls, and that the ring is re-armed only after its last event is taken.
+TEST(EpollReadinessRingTest, BatchIsTakenAcrossCalls) {
+  EpollReadinessRing ring;
+  std::vector<Event> published = MakeEvents(5, 100);
+  ASSERT_TRUE(ring.Publish(published.data(), published.size()));
+
+  Event taken[3];
+  ASSERT_EQ(ring.Consume(taken, 3), 3);
+  EXPECT_EQ(taken[0].data, 100);
+  EXPECT_EQ(taken[2].data, 102);
+  EXPECT_EQ(ring.state(), EpollReadinessRing::kPublished);
+
+  ASSERT_EQ(ring.Consume(taken, 3), 2);
+  EXPECT_EQ(taken[0].data, 103);
+  EXPECT_EQ(taken[1].data, 104);
+  EXPECT_EQ(ring.state(), EpollReadinessRing::kArmed);
+  EXPECT_EQ(ring.Consume(taken, 3), 0);
+}
+
+TEST(EpollReadinessRingTest, PublishTruncatesToCapacity) {
+  EpollReadinessRing ring;
+  std::vector<Event> published =
+      MakeEvents(EpollReadinessRing::kCapacity + 1, 0);
+  ASSERT_TRUE(ring.Publish(published.data(), published.size()));
+  std::vector<Event> taken(published.size());
+  EXPECT_EQ(ring.Consume(taken.data(), taken.size()),
+            EpollReadinessRing::kCapacity);
+}
+
+// Ensure a consumer never reads past the batch when the untrusted count is
+// corrupted.
+TEST(EpollReadinessRingTest, CorruptedCountIsBounded) {
+  EpollReadinessRing ring;
+  std::vector<Event> published = MakeEvents(1, 0);
+  ASSERT_TRUE(ring.Publish(published.data(), published.size()));
+  // Overwrite the count, which immediately follows the state word.
+  uint32_t corrupted_count = 1 << 20;
+  memcpy(reinterpret_cast<char *>(ring.state_word()) + sizeof(int32_t),
+         &corrupted_count, sizeof(corrupted_count));
+  std::vector<Event> taken(2 * EpollReadinessRing::kCapacity);
+  EXPECT_EQ(ring.Consume(taken.data(), taken.size()),
+            EpollReadinessRing::kCapacity);
+  EXPECT_EQ(ring.state(), EpollReadinessRing::kArmed);
+}
+
+TEST(EpollReadinessRingTest, FailedRingIsNotConsumed) {
+  EpollReadinessRing ring;
+  ring.Fail();
+  std::vector<Event> published = MakeEvents(1, 0);
+  EXPECT_FALSE(ring.Publish(published.data(), published.size()));
+  Event event;
+  EXPECT_EQ(ring.Consume(&event, 1), 0);
+  EXPECT_EQ(ring.state(), EpollReadinessRing::kFailed);
+}
+
+TEST(EpollReadinessRingTest, FailedRingIsNotRearmed) {
+  EpollReadinessRing ring;
+  std::vector<Event> published = MakeEvents(2, 0);
+  ASSERT_TRUE(ring.Publish(published.data(), published.size()));
+  Event event;
+  ASSERT_EQ(ring.Consume(&event, 1), 1);
+  ring.Fail();
+  EXPECT_EQ(ring.Consume(&event, 1), 0);
+  EXPECT_EQ(ring.state(), EpollReadinessRing::kFailed);
+}
+
+// Ensure every published event is consumed exactly once and in order.
+TEST(EpollReadinessRingTest, ConcurrentPublishAndConsume) {
+  constexpr uint64_t kEventCount = 100000;
+  EpollReadinessRing ring;
+
+  std::thread poller([&ring] {
+    uint64_t next = 0;
+    while (next < kEventCount) {
+      int count = std::min<uint64_t>(1 + next % 7, kEventCount - next);
+      std::vector<Event> events = MakeEvents(count, next);
+      if (ring.Publish(events.data(), count)) {
+        next += count;
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  uint64_t expected = 0;
+  Event taken[3];
+  while (expected < kEventCount) {
+    int count = ring.Consume(taken, 3);
+    for (int i = 0; i < count; ++i) {
+      ASSERT_EQ(taken[i].data, expected++);
+    }
+    if (count == 0) {
+      std::this_thread::yield();
+    }
+  }
+  poller.join();
+}
+
+}  // namespace
+}  // namespace asylo
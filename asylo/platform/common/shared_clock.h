@@ -0,0 +1,156 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_COMMON_SHARED_CLOCK_H_
+#define ASYLO_PLATFORM_COMMON_SHARED_CLOCK_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace asylo {
+
+// A sample of the host's monotonic and realtime clocks, published by a single
+// writer and read concurrently by any number of readers under a sequence lock.
+//
+// The writer bumps the sequence number to an odd value, stores a new sample and
+// bumps the sequence number to the next even value. A reader retries while the
+// sequence number is odd or changed while it was reading the sample, so it
+// never observes a torn sample.
+//
+// NOTE: The clock is intended to be shared with an enclave through untrusted
+// memory. A reader must treat the sample as a hint from the host, no more
+// trustworthy than the result of a clock_gettime() host call, and must not
+// assume that the writer makes progress. Reads are therefore bounded: a reader
+// gives up after a fixed number of retries rather than spinning on a writer
+// that may never finish.
+//
+// A simple versioning scheme is supported to confirm the compatibility of
+// objects and types at runtime, as for RingBuffer:
+//
+// SharedClock::TypeVersion() == instance->InstanceVersion();
+//
+class SharedClock {
+ public:
+  static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+                "std::atomic<uint64_t> is not lock free.");
+
+  // Number of times a reader retries a read which raced with the writer.
+  static constexpr int kMaxReadRetries = 16;
+
+  // A consistent sample of the published clocks.
+  struct Sample {
+    // Sequence number of the sample. Even, and strictly increasing with every
+    // publication.
+    uint64_t sequence;
+
+    // CLOCK_MONOTONIC at the time of publication, in nanoseconds.
+    int64_t monotonic_ns;
+
+    // CLOCK_REALTIME at the time of publication, in nanoseconds.
+    int64_t realtime_ns;
+  };
+
+  SharedClock()
+      : instance_version_(TypeVersion()),
+        active_(0),
+        sequence_(0),
+        monotonic_ns_(0),
+        realtime_ns_(0) {}
+
+  SharedClock(const SharedClock &) = delete;
+  SharedClock &operator=(const SharedClock &) = delete;
+
+  // Returns a signature reflecting the layout of this concrete instance.
+  uint64_t InstanceVersion() const { return instance_version_; }
+
+  // Returns a signature reflecting the layout of this abstract type.
+  static constexpr uint64_t TypeVersion() {
+    return offsetof(SharedClock, active_) << 0 |
+           offsetof(SharedClock, sequence_) << 8 |
+           offsetof(SharedClock, monotonic_ns_) << 16 |
+           offsetof(SharedClock, realtime_ns_) << 24 |
+           sizeof(SharedClock) << 32;
+  }
+
+  // Marks the published sample as valid or invalid. Readers fail while the
+  // clock is inactive.
+  void set_active(bool active) {
+    active_.store(active ? 1 : 0, std::memory_order_release);
+  }
+
+  // Returns true if the published sample is valid.
+  bool is_active() const {
+    return active_.load(std::memory_order_acquire) != 0;
+  }
+
+  // Publishes a new sample. Must only be called by a single writer.
+  void Publish(int64_t monotonic_ns, int64_t realtime_ns) {
+    uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+    sequence_.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    monotonic_ns_.store(monotonic_ns, std::memory_order_relaxed);
+    realtime_ns_.store(realtime_ns, std::memory_order_relaxed);
+    sequence_.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Reads the current sample into |sample|. Returns false if the clock is
+  // inactive or no consistent sample could be read within kMaxReadRetries
+  // attempts.
+  bool Read(Sample *sample) const {
+    if (!is_active()) {
+      return false;
+    }
+    for (int i = 0; i < kMaxReadRetries; ++i) {
+      uint64_t begin = sequence_.load(std::memory_order_acquire);
+      if (begin & 1) {
+        Pause();
+        continue;
+      }
+      int64_t monotonic_ns = monotonic_ns_.load(std::memory_order_relaxed);
+      int64_t realtime_ns = realtime_ns_.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (sequence_.load(std::memory_order_relaxed) != begin) {
+        Pause();
+        continue;
+      }
+      sample->sequence = begin;
+      sample->monotonic_ns = monotonic_ns;
+      sample->realtime_ns = realtime_ns;
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  static void Pause() {
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  const uint64_t instance_version_;    // Layout of the clock.
+  std::atomic<uint32_t> active_;       // Sample is valid.
+  std::atomic<uint64_t> sequence_;     // Sequence lock.
+  std::atomic<int64_t> monotonic_ns_;  // Published CLOCK_MONOTONIC.
+  std::atomic<int64_t> realtime_ns_;   // Published CLOCK_REALTIME.
+} __attribute__((aligned(64)));
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_COMMON_SHARED_CLOCK_H_
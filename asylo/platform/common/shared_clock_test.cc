@@ -0,0 +1,93 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/common/shared_clock.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+namespace asylo {
+namespace {
+
+TEST(SharedClockTest, LayoutVersionMatches) {
+  SharedClock clock;
+  EXPECT_EQ(clock.InstanceVersion(), SharedClock::TypeVersion());
+}
+
+TEST(SharedClockTest, InactiveClockFailsReads) {
+  SharedClock clock;
+  clock.Publish(1, 2);
+  SharedClock::Sample sample;
+  EXPECT_FALSE(clock.Read(&sample));
+}
+
+TEST(SharedClockTest, ReadsLatestSample) {
+  SharedClock clock;
+  clock.set_active(true);
+  SharedClock::Sample first;
+  clock.Publish(100, 200);
+  ASSERT_TRUE(clock.Read(&first));
+  EXPECT_EQ(first.monotonic_ns, 100);
+  EXPECT_EQ(first.realtime_ns, 200);
+  EXPECT_EQ(first.sequence % 2, 0);
+
+  SharedClock::Sample second;
+  clock.Publish(300, 400);
+  ASSERT_TRUE(clock.Read(&second));
+  EXPECT_EQ(second.monotonic_ns, 300);
+  EXPECT_EQ(second.realtime_ns, 400);
+  EXPECT_GT(second.sequence, first.sequence);
+
+  clock.set_active(false);
+  EXPECT_FALSE(clock.Read(&second));
+}
+
+// Ensure readers never observe a sample mixing two publications.
+TEST(SharedClockTest, ConcurrentReadsAreConsistent) {
+  constexpr int64_t kPublications = 100000;
+  SharedClock clock;
+  clock.Publish(0, 0);
+  clock.set_active(true);
+
+  std::atomic<bool> done(false);
+  std::thread writer([&clock, &done] {
+    for (int64_t i = 1; i <= kPublications; ++i) {
+      clock.Publish(i, -i);
+    }
+    done = true;
+  });
+
+  int64_t last = 0;
+  while (!done) {
+    SharedClock::Sample sample;
+    if (!clock.Read(&sample)) {
+      continue;
+    }
+    ASSERT_EQ(sample.realtime_ns, -sample.monotonic_ns);
+    ASSERT_GE(sample.monotonic_ns, last);
+    last = sample.monotonic_ns;
+    std::this_thread::yield();
+  }
+  writer.join();
+}
+
+}  // namespace
+}  // namespace asylo
@@ -22,7 +22,9 @@
 #include <sys/ucontext.h>
 #include <time.h>
 
+#include <memory>
 #include <thread>
+#include <utility>
 
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
@@ -30,6 +32,7 @@
 #include "asylo/enclave.pb.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/common/time_util.h"
+#include "asylo/platform/core/enclave_pool.h"
 #include "asylo/platform/core/generic_enclave_client.h"
 #include "asylo/platform/primitives/enclave_loader.h"
 #include "asylo/platform/primitives/extent.h"
@@ -332,6 +335,15 @@ Status EnclaveManager::LoadEnclave(const EnclaveLoadConfig &load_config) {
   }
 
   Status status = client->EnterAndInitialize(config);
+  if (status.ok() && load_config.switchless_config().worker_count() > 0) {
+    status = static_cast<GenericEnclaveClient *>(client)
+                 ->EnableSwitchlessExitCalls(load_config.switchless_config());
+  }
+  if (status.ok() &&
+      load_config.shared_clock_config().update_interval_microseconds() > 0) {
+    status = static_cast<GenericEnclaveClient *>(client)->EnableSharedClock(
+        load_config.shared_clock_config());
+  }
   // If initialization fails, don't keep the enclave registered. GetClient will
   // return a nullptr rather than an enclave in a bad state.
   if (!status.ok()) {
@@ -350,6 +362,91 @@ Status EnclaveManager::LoadEnclave(const EnclaveLoadConfig &load_config) {
   return status;
 }
 
+Status EnclaveManager::CreateEnclavePool(const EnclaveLoadConfig &load_config,
+                                         const EnclavePoolConfig &pool_config) {
+  const std::string &pool_name = load_config.name();
+  if (pool_name.empty()) {
+    return absl::InvalidArgumentError("Enclave pool name is empty");
+  }
+  if (load_config.HasExtension(sgx_load_config) &&
+      load_config.GetExtension(sgx_load_config).has_fork_config()) {
+    return absl::InvalidArgumentError(
+        "Forked enclaves cannot be loaded into a pool");
+  }
+
+  absl::MutexLock lock(&pool_table_lock_);
+  if (pool_by_name_.contains(pool_name)) {
+    return absl::AlreadyExistsError(
+        absl::StrCat("Enclave pool already exists: ", pool_name));
+  }
+  auto load = [this, load_config](
+                  absl::string_view name) -> StatusOr<EnclaveClient *> {
+    EnclaveLoadConfig enclave_load_config = load_config;
+    enclave_load_config.set_name(name.data(), name.size());
+    ASYLO_RETURN_IF_ERROR(LoadEnclave(enclave_load_config));
+    EnclaveClient *client = GetClient(name);
+    if (!client) {
+      return absl::InternalError(
+          absl::StrCat("Enclave vanished after loading: ", name));
+    }
+    return client;
+  };
+  auto destroy = [this](EnclaveClient *client) {
+    Status status = DestroyEnclave(client, EnclaveFinal());
+    LOG_IF(ERROR, !status.ok())
+        << "Failed to finalize pooled enclave: " << status;
+  };
+  pool_by_name_.emplace(
+      pool_name, std::make_shared<EnclavePool>(pool_name, pool_config,
+                                               std::move(load),
+                                               std::move(destroy)));
+  return absl::OkStatus();
+}
+
+StatusOr<EnclaveClient *> EnclaveManager::AcquireEnclave(
+    absl::string_view pool_name) {
+  std::shared_ptr<EnclavePool> pool;
+  {
+    absl::MutexLock lock(&pool_table_lock_);
+    auto it = pool_by_name_.find(pool_name);
+    if (it == pool_by_name_.end()) {
+      return absl::NotFoundError(
+          absl::StrCat("No such enclave pool: ", pool_name));
+    }
+    pool = it->second;
+  }
+  return pool->Acquire();
+}
+
+StatusOr<EnclavePoolStats> EnclaveManager::GetEnclavePoolStats(
+    absl::string_view pool_name) const {
+  absl::MutexLock lock(&pool_table_lock_);
+  auto it = pool_by_name_.find(pool_name);
+  if (it == pool_by_name_.end()) {
+    return absl::NotFoundError(
+        absl::StrCat("No such enclave pool: ", pool_name));
+  }
+  return it->second->stats();
+}
+
+Status EnclaveManager::DestroyEnclavePool(absl::string_view pool_name) {
+  std::shared_ptr<EnclavePool> pool;
+  {
+    absl::MutexLock lock(&pool_table_lock_);
+    auto it = pool_by_name_.find(pool_name);
+    if (it == pool_by_name_.end()) {
+      return absl::NotFoundError(
+          absl::StrCat("No such enclave pool: ", pool_name));
+    }
+    pool = std::move(it->second);
+    pool_by_name_.erase(it);
+  }
+  // The pool loads and destroys enclaves through this manager, so it must not
+  // be destroyed while holding |pool_table_lock_|.
+  pool.reset();
+  return absl::OkStatus();
+}
+
 void EnclaveManager::RemoveEnclaveReference(absl::string_view name) {
   absl::WriterMutexLock lock(&client_table_lock_);
   EnclaveClient *client = client_by_name_[name].get();
@@ -22,6 +22,7 @@
 // Declares the enclave client API, providing types and methods for loading,
 // accessing, and finalizing enclaves.
 
+#include <memory>
 #include <string>
 #include <utility>
 
@@ -35,6 +36,7 @@
 #include "asylo/enclave.pb.h"  // IWYU pragma: export
 #include "asylo/platform/core/enclave_client.h"
 #include "asylo/platform/core/enclave_config_util.h"
+#include "asylo/platform/core/enclave_pool.h"
 #include "asylo/platform/core/shared_resource_manager.h"
 #include "asylo/platform/primitives/untrusted_primitives.h"
 #include "asylo/platform/primitives/util/message.h"
@@ -201,6 +203,54 @@ class EnclaveManager {
                         bool skip_finalize = false)
       ABSL_LOCKS_EXCLUDED(client_table_lock_);
 
+  /// Creates a pool of enclaves loaded ahead of time.
+  ///
+  /// Starts loading and initializing `pool_config.depth()` enclaves with
+  /// |load_config| in the background, `pool_config.warmup_concurrency()` at a
+  /// time. The pool is bound to the value of field `name` set in
+  /// |load_config|, and each of its enclaves is loaded under a distinct name
+  /// made of the pool name followed by `#` and a sequence number.
+  ///
+  /// It is an error to specify a name which is already bound to a pool, or a
+  /// |load_config| for a forked enclave.
+  ///
+  /// \param load_config Backend configuration options to load the enclaves.
+  /// \param pool_config Configuration of the pool.
+  Status CreateEnclavePool(const EnclaveLoadConfig &load_config,
+                           const EnclavePoolConfig &pool_config)
+      ABSL_LOCKS_EXCLUDED(pool_table_lock_);
+
+  /// Acquires an enclave from a pool.
+  ///
+  /// Returns an enclave initialized ahead of time if one is ready, and
+  /// otherwise loads one on the calling thread. Either way, the pool loads a
+  /// replacement in the background. The acquired enclave is no longer part of
+  /// the pool: it is accessed and destroyed like an enclave loaded with
+  /// LoadEnclave(), and GetName() returns the name it was loaded under.
+  ///
+  /// \param pool_name The name of the pool.
+  /// \return A client to the acquired enclave.
+  StatusOr<EnclaveClient *> AcquireEnclave(absl::string_view pool_name)
+      ABSL_LOCKS_EXCLUDED(pool_table_lock_);
+
+  /// Fetches the counters of an enclave pool.
+  ///
+  /// \param pool_name The name of the pool.
+  /// \return The number of enclaves ready in the pool, and the number of
+  ///         acquisitions that found or did not find an enclave ready.
+  StatusOr<EnclavePoolStats> GetEnclavePoolStats(
+      absl::string_view pool_name) const ABSL_LOCKS_EXCLUDED(pool_table_lock_);
+
+  /// Destroys an enclave pool.
+  ///
+  /// Waits for the enclaves being loaded by the pool, then finalizes and
+  /// destroys the enclaves which were not acquired. Enclaves acquired from the
+  /// pool are not affected.
+  ///
+  /// \param pool_name The name of the pool.
+  Status DestroyEnclavePool(absl::string_view pool_name)
+      ABSL_LOCKS_EXCLUDED(pool_table_lock_);
+
   /// Fetches the shared resource manager object.
   ///
   /// \return The SharedResourceManager instance.
@@ -262,6 +312,13 @@ class EnclaveManager {
   absl::flat_hash_map<const EnclaveClient *, EnclaveLoadConfig>
       load_config_by_client_ ABSL_GUARDED_BY(client_table_lock_);
 
+  // A mutex guarding the |pool_by_name_| table. Pools are shared so that an
+  // acquisition in progress keeps its pool alive without holding the lock.
+  mutable absl::Mutex pool_table_lock_;
+
+  absl::flat_hash_map<std::string, std::shared_ptr<EnclavePool>> pool_by_name_
+      ABSL_GUARDED_BY(pool_table_lock_);
+
   // Mutex guarding the static state of this class.
   static absl::Mutex mu_;
 
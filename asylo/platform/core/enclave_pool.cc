@@ -0,0 +1,136 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/platform/core/enclave_pool.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/statusor.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+namespace {
+
+// Bounds of the delay before a background thread retries after a failed load.
+// The delay doubles after every consecutive failure.
+constexpr absl::Duration kMinRetryDelay = absl::Milliseconds(100);
+constexpr absl::Duration kMaxRetryDelay = absl::Seconds(10);
+
+}  // namespace
+
+EnclavePool::EnclavePool(std::string name, const EnclavePoolConfig &config,
+                         LoadFunction load, DestroyFunction destroy)
+    : name_(std::move(name)),
+      depth_(config.depth()),
+      load_(std::move(load)),
+      destroy_(std::move(destroy)) {
+  const uint32_t thread_count =
+      std::min(std::max(config.warmup_concurrency(), 1u), depth_);
+  for (uint32_t i = 0; i < thread_count; ++i) {
+    threads_.push_back(absl::make_unique<Thread>([this] { WarmUpLoop(); }));
+  }
+}
+
+EnclavePool::~EnclavePool() {
+  {
+    absl::MutexLock lock(&mu_);
+    stopping_ = true;
+  }
+  for (auto &thread : threads_) {
+    thread->Join();
+  }
+  for (EnclaveClient *client : ready_) {
+    destroy_(client);
+  }
+}
+
+StatusOr<EnclaveClient *> EnclavePool::Acquire() {
+  std::string name;
+  {
+    absl::MutexLock lock(&mu_);
+    if (!ready_.empty()) {
+      EnclaveClient *client = ready_.front();
+      ready_.pop_front();
+      ++stats_.hits;
+      // Releasing the lock lets a background thread start the replacement.
+      return client;
+    }
+    ++stats_.misses;
+    name = NextEnclaveName();
+  }
+  return load_(name);
+}
+
+EnclavePoolStats EnclavePool::stats() const {
+  absl::MutexLock lock(&mu_);
+  EnclavePoolStats stats = stats_;
+  stats.ready = ready_.size();
+  return stats;
+}
+
+void EnclavePool::WarmUpLoop() {
+  absl::Duration retry_delay = kMinRetryDelay;
+  for (;;) {
+    std::string name;
+    {
+      absl::MutexLock lock(&mu_);
+      mu_.Await(absl::Condition(this, &EnclavePool::NeedsWork));
+      if (stopping_) {
+        return;
+      }
+      ++loading_;
+      name = NextEnclaveName();
+    }
+
+    StatusOr<EnclaveClient *> client_result = load_(name);
+
+    absl::MutexLock lock(&mu_);
+    --loading_;
+    if (client_result.ok()) {
+      ++stats_.loads;
+      ready_.push_back(client_result.value());
+      retry_delay = kMinRetryDelay;
+      continue;
+    }
+    ++stats_.load_failures;
+    LOG(ERROR) << "Failed to load enclave " << name << " for pool " << name_
+               << ": " << client_result.status();
+    // Do not spin on a load that keeps failing, but stop promptly.
+    mu_.AwaitWithTimeout(absl::Condition(&stopping_), retry_delay);
+    retry_delay = std::min(2 * retry_delay, kMaxRetryDelay);
+  }
+}
+
+bool EnclavePool::NeedsWork() const {
+  return stopping_ || ready_.size() + loading_ < depth_;
+}
+
+std::string EnclavePool::NextEnclaveName() {
+  return absl::StrCat(name_, "#", next_enclave_++);
+}
+
+}  // namespace asylo
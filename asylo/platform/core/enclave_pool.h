@@ -0,0 +1,118 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_PLATFORM_CORE_ENCLAVE_POOL_H_
+#define ASYLO_PLATFORM_CORE_ENCLAVE_POOL_H_
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/enclave.pb.h"
+#include "asylo/platform/core/enclave_client.h"
+#include "asylo/util/statusor.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+
+/// Counters describing the activity of an enclave pool.
+struct EnclavePoolStats {
+  /// Number of initialized enclaves waiting to be acquired.
+  uint64_t ready = 0;
+
+  /// Number of acquisitions served by a ready enclave.
+  uint64_t hits = 0;
+
+  /// Number of acquisitions which found the pool empty and loaded an enclave
+  /// on the calling thread.
+  uint64_t misses = 0;
+
+  /// Number of enclaves loaded in the background.
+  uint64_t loads = 0;
+
+  /// Number of background loads which failed.
+  uint64_t load_failures = 0;
+};
+
+// A set of enclaves loaded and initialized ahead of time by background threads
+// and handed out on demand. Every enclave handed out is replaced in the
+// background, so the pool keeps |depth| enclaves ready as long as they are
+// acquired no faster than they can be loaded.
+//
+// The pool does not load enclaves itself: it is given functions to load an
+// enclave under a name, and to destroy an enclave it never handed out. Each
+// enclave is loaded under a distinct name derived from the name of the pool.
+class EnclavePool {
+ public:
+  using LoadFunction =
+      std::function<StatusOr<EnclaveClient *>(absl::string_view name)>;
+  using DestroyFunction = std::function<void(EnclaveClient *client)>;
+
+  // Creates a pool called |name| and starts filling it in the background.
+  EnclavePool(std::string name, const EnclavePoolConfig &config,
+              LoadFunction load, DestroyFunction destroy);
+
+  EnclavePool(const EnclavePool &other) = delete;
+  EnclavePool &operator=(const EnclavePool &other) = delete;
+
+  // Stops the background loads, waiting for those in progress, and destroys
+  // the enclaves that were not acquired.
+  ~EnclavePool();
+
+  // Takes a ready enclave out of the pool, or loads one on the calling thread
+  // if none is ready.
+  StatusOr<EnclaveClient *> Acquire() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the current counters of the pool.
+  EnclavePoolStats stats() const ABSL_LOCKS_EXCLUDED(mu_);
+
+ private:
+  // Main loop of the background threads.
+  void WarmUpLoop() ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns true if a background thread should stop or load an enclave.
+  bool NeedsWork() const ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Returns a name for the next enclave of the pool.
+  std::string NextEnclaveName() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  const std::string name_;
+  const uint32_t depth_;
+  const LoadFunction load_;
+  const DestroyFunction destroy_;
+
+  mutable absl::Mutex mu_;
+  std::deque<EnclaveClient *> ready_ ABSL_GUARDED_BY(mu_);
+  uint32_t loading_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t next_enclave_ ABSL_GUARDED_BY(mu_) = 0;
+  EnclavePoolStats stats_ ABSL_GUARDED_BY(mu_);
+  bool stopping_ ABSL_GUARDED_BY(mu_) = false;
+
+  std::vector<std::unique_ptr<Thread>> threads_;
+};
+
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_CORE_ENCLAVE_POOL_H_
@@ -164,7 +164,26 @@ Status GenericEnclaveClient::EnterAndFinalize(const EnclaveFinal &final_input) {
   return StatusFromProto(status_proto);
 }
 
+Status GenericEnclaveClient::EnableSwitchlessExitCalls(
+    const SwitchlessConfig &config) {
+  ASYLO_ASSIGN_OR_RETURN(
+      switchless_pool_,
+      primitives::SwitchlessWorkerPool::Create(primitive_client_, config));
+  return absl::OkStatus();
+}
+
+Status GenericEnclaveClient::EnableSharedClock(
+    const SharedClockConfig &config) {
+  ASYLO_ASSIGN_OR_RETURN(
+      shared_clock_publisher_,
+      primitives::SharedClockPublisher::Create(primitive_client_, config));
+  return absl::OkStatus();
+}
+
 Status GenericEnclaveClient::DestroyEnclave() {
+  // Helper threads must stop calling into the enclave before it is destroyed.
+  switchless_pool_.reset();
+  shared_clock_publisher_.reset();
   return primitive_client_->Destroy();
 }
 
@@ -22,6 +22,8 @@
 #include "asylo/enclave.pb.h"  // IWYU pragma: export
 #include "asylo/platform/core/enclave_client.h"
 #include "asylo/platform/primitives/untrusted_primitives.h"
+#include "asylo/platform/primitives/util/shared_clock_publisher.h"
+#include "asylo/platform/primitives/util/switchless_worker_pool.h"
 #include "asylo/util/status.h"  // IWYU pragma: export
 
 namespace asylo {
@@ -39,6 +41,17 @@ class GenericEnclaveClient : public EnclaveClient {
     return primitive_client_;
   }
 
+  // Starts a pool of untrusted workers servicing host calls posted by the
+  // enclave without exiting it, as configured by |config|. Must be called after
+  // the enclave is initialized. The pool is stopped when the enclave is
+  // destroyed.
+  Status EnableSwitchlessExitCalls(const SwitchlessConfig &config);
+
+  // Starts publishing the host clocks to the enclave through shared memory, as
+  // configured by |config|. Must be called after the enclave is initialized.
+  // Publishing stops when the enclave is destroyed.
+  Status EnableSharedClock(const SharedClockConfig &config);
+
  protected:
   explicit GenericEnclaveClient(absl::string_view name)
       : EnclaveClient(name) {}
@@ -46,6 +59,12 @@ class GenericEnclaveClient : public EnclaveClient {
   // Primitive enclave client. Populated by the implementation of EnclaveLoader.
   std::shared_ptr<primitives::Client> primitive_client_;
 
+  // Workers servicing switchless exit calls, if enabled.
+  std::unique_ptr<primitives::SwitchlessWorkerPool> switchless_pool_;
+
+  // Publisher of the shared clock, if enabled.
+  std::unique_ptr<primitives::SharedClockPublisher> shared_clock_publisher_;
+
  private:
   Status EnterAndInitialize(const EnclaveConfig &config) override;
   Status EnterAndFinalize(const EnclaveFinal &final_input) override;
@@ -0,0 +1,264 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/platform/core/enclave_pool.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/match.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/enclave.pb.h"
+#include "asylo/platform/core/enclave_client.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::IsEmpty;
+using ::testing::UnorderedElementsAreArray;
+
+constexpr absl::Duration kWaitTimeout = absl::Seconds(10);
+
+class FakeEnclaveClient : public EnclaveClient {
+ public:
+  explicit FakeEnclaveClient(absl::string_view name) : EnclaveClient(name) {}
+
+  Status EnterAndRun(const EnclaveInput &input,
+                     EnclaveOutput *output) override {
+    return absl::OkStatus();
+  }
+
+ private:
+  Status EnterAndInitialize(const EnclaveConfig &config) override {
+    return absl::OkStatus();
+  }
+  Status EnterAndFinalize(const EnclaveFinal &final_input) override {
+    return absl::OkStatus();
+  }
+  Status DestroyEnclave() override { return absl::OkStatus(); }
+};
+
+// Stands in for the EnclaveManager: owns the enclaves loaded by a pool and
+// records what the pool does with them.
+class FakeEnclaveManager {
+ public:
+  EnclavePool::LoadFunction load_function() {
+    return [this](absl::string_view name) { return Load(name); };
+  }
+
+  EnclavePool::DestroyFunction destroy_function() {
+    return [this](EnclaveClient *client) {
+      absl::MutexLock lock(&mu_);
+      destroyed_.push_back(std::string(client->get_name()));
+    };
+  }
+
+  // Makes the next |count| loads fail.
+  void FailLoads(int count) {
+    absl::MutexLock lock(&mu_);
+    failures_left_ = count;
+  }
+
+  // Makes loads wait until |count| of them are in progress at once.
+  void GatherLoads(int count) {
+    absl::MutexLock lock(&mu_);
+    gather_count_ = count;
+  }
+
+  std::vector<std::string> loaded() const {
+    absl::MutexLock lock(&mu_);
+    return loaded_;
+  }
+
+  std::vector<std::string> destroyed() const {
+    absl::MutexLock lock(&mu_);
+    return destroyed_;
+  }
+
+  int max_concurrent_loads() const {
+    absl::MutexLock lock(&mu_);
+    return max_concurrent_loads_;
+  }
+
+ private:
+  StatusOr<EnclaveClient *> Load(absl::string_view name) {
+    absl::MutexLock lock(&mu_);
+    ++concurrent_loads_;
+    max_concurrent_loads_ = std::max(max_concurrent_loads_, concurrent_loads_);
+    auto gathered = [this]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+      return max_concurrent_loads_ >= gather_count_;
+    };
+    mu_.AwaitWithTimeout(absl::Condition(&gathered), kWaitTimeout);
+    --concurrent_loads_;
+    if (failures_left_ > 0) {
+      --failures_left_;
+      return absl::UnavailableError("Injected load failure");
+    }
+    clients_.push_back(absl::make_unique<FakeEnclaveClient>(name));
+    loaded_.push_back(std::string(name));
+    return clients_.back().get();
+  }
+
+  mutable absl::Mutex mu_;
+  std::vector<std::unique_ptr<FakeEnclaveClient>> clients_ ABSL_GUARDED_BY(mu_);
+  std::vector<std::string> loaded_ ABSL_GUARDED_BY(mu_);
+  std::vector<std::string> destroyed_ ABSL_GUARDED_BY(mu_);
+  int failures_left_ ABSL_GUARDED_BY(mu_) = 0;
+  int gather_count_ ABSL_GUARDED_BY(mu_) = 0;
+  int concurrent_loads_ ABSL_GUARDED_BY(mu_) = 0;
+  int max_concurrent_loads_ ABSL_GUARDED_BY(mu_) = 0;
+};
+
+class EnclavePoolTest : public ::testing::Test {
+ protected:
+  std::unique_ptr<EnclavePool> CreatePool(uint32_t depth,
+                                          uint32_t warmup_concurrency) {
+    EnclavePoolConfig config;
+    config.set_depth(depth);
+    config.set_warmup_concurrency(warmup_concurrency);
+    return absl::make_unique<EnclavePool>("pool", config,
+                                          manager_.load_function(),
+                                          manager_.destroy_function());
+  }
+
+  // Waits until |predicate| holds for the counters of |pool|.
+  bool WaitForStats(
+      EnclavePool *pool,
+      const std::function<bool(const EnclavePoolStats &)> &predicate) {
+    const absl::Time deadline = absl::Now() + kWaitTimeout;
+    while (!predicate(pool->stats())) {
+      if (absl::Now() > deadline) {
+        return false;
+      }
+      absl::SleepFor(absl::Milliseconds(1));
+    }
+    return true;
+  }
+
+  // Waits until |pool| holds |ready| enclaves.
+  bool WaitForReady(EnclavePool *pool, uint64_t ready) {
+    return WaitForStats(pool, [ready](const EnclavePoolStats &stats) {
+      return stats.ready == ready;
+    });
+  }
+
+  FakeEnclaveManager manager_;
+};
+
+TEST_F(EnclavePoolTest, FillsToDepth) {
+  auto pool = CreatePool(/*depth=*/3, /*warmup_concurrency=*/1);
+  ASSERT_TRUE(WaitForReady(pool.get(), 3));
+  // The pool does not load more enclaves than it keeps.
+  absl::SleepFor(absl::Milliseconds(50));
+  EnclavePoolStats stats = pool->stats();
+  EXPECT_THAT(stats.ready, Eq(3));
+  EXPECT_THAT(stats.loads, Eq(3));
+  EXPECT_THAT(stats.hits, Eq(0));
+  EXPECT_THAT(stats.misses, Eq(0));
+}
+
+TEST_F(EnclavePoolTest, AcquireHitsAndReplenishes) {
+  auto pool = CreatePool(/*depth=*/2, /*warmup_concurrency=*/1);
+  ASSERT_TRUE(WaitForReady(pool.get(), 2));
+
+  EnclaveClient *client;
+  ASYLO_ASSERT_OK_AND_ASSIGN(client, pool->Acquire());
+  EXPECT_TRUE(absl::StartsWith(client->get_name(), "pool#"));
+  ASSERT_TRUE(WaitForStats(pool.get(), [](const EnclavePoolStats &stats) {
+    return stats.ready == 2 && stats.loads == 3;
+  }));
+  EXPECT_THAT(pool->stats().hits, Eq(1));
+  EXPECT_THAT(pool->stats().misses, Eq(0));
+}
+
+TEST_F(EnclavePoolTest, AcquireLoadsOnMiss) {
+  auto pool = CreatePool(/*depth=*/0, /*warmup_concurrency=*/1);
+  EnclaveClient *client;
+  ASYLO_ASSERT_OK_AND_ASSIGN(client, pool->Acquire());
+  EXPECT_THAT(manager_.loaded(), Eq(std::vector<std::string>{
+                                     std::string(client->get_name())}));
+  EnclavePoolStats stats = pool->stats();
+  EXPECT_THAT(stats.misses, Eq(1));
+  EXPECT_THAT(stats.hits, Eq(0));
+  EXPECT_THAT(stats.loads, Eq(0));
+}
+
+TEST_F(EnclavePoolTest, LoadsInParallel) {
+  manager_.GatherLoads(3);
+  auto pool = CreatePool(/*depth=*/4, /*warmup_concurrency=*/3);
+  ASSERT_TRUE(WaitForReady(pool.get(), 4));
+  EXPECT_THAT(manager_.max_concurrent_loads(), Eq(3));
+}
+
+TEST_F(EnclavePoolTest, RetriesFailedLoads) {
+  manager_.FailLoads(2);
+  auto pool = CreatePool(/*depth=*/1, /*warmup_concurrency=*/1);
+  ASSERT_TRUE(WaitForReady(pool.get(), 1));
+  EXPECT_THAT(pool->stats().load_failures, Eq(2));
+}
+
+TEST_F(EnclavePoolTest, LoadsEnclavesUnderDistinctNames) {
+  auto pool = CreatePool(/*depth=*/3, /*warmup_concurrency=*/3);
+  for (int i = 0; i < 5; ++i) {
+    ASYLO_ASSERT_OK(pool->Acquire().status());
+  }
+  ASSERT_TRUE(WaitForReady(pool.get(), 3));
+  std::vector<std::string> loaded = manager_.loaded();
+  EXPECT_THAT(loaded.size(), Ge(8));
+  EXPECT_THAT(absl::flat_hash_set<std::string>(loaded.begin(), loaded.end())
+                  .size(),
+              Eq(loaded.size()));
+}
+
+TEST_F(EnclavePoolTest, DestroysOnlyReadyEnclaves) {
+  auto pool = CreatePool(/*depth=*/2, /*warmup_concurrency=*/1);
+  ASSERT_TRUE(WaitForReady(pool.get(), 2));
+  EnclaveClient *acquired;
+  ASYLO_ASSERT_OK_AND_ASSIGN(acquired, pool->Acquire());
+  ASSERT_TRUE(WaitForReady(pool.get(), 2));
+  EXPECT_THAT(manager_.destroyed(), IsEmpty());
+
+  pool.reset();
+  std::vector<std::string> expected_destroyed;
+  for (const std::string &name : manager_.loaded()) {
+    if (name != acquired->get_name()) {
+      expected_destroyed.push_back(name);
+    }
+  }
+  EXPECT_THAT(manager_.destroyed(),
+              UnorderedElementsAreArray(expected_destroyed));
+}
+
+}  // namespace
+}  // namespace asylo
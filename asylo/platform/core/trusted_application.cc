@@ -22,6 +22,7 @@
 #include <unistd.h>
 
 #include <cerrno>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <functional>
@@ -176,6 +177,9 @@ static absl::Mutex get_application_lock;
 // Initialize IO subsystem.
 static void InitializeIO(const EnclaveConfig &config);
 
+// Configure the reuse of threads created with pthread_create().
+static void InitializeThreadPool(const EnclaveConfig &config);
+
 TrustedApplication *GetApplicationInstance() {
   absl::MutexLock lock(&get_application_lock);
   if (!global_trusted_application) {
@@ -200,6 +204,7 @@ Status InitializeEnvironmentVariables(
 
 Status TrustedApplication::InitializeInternal(const EnclaveConfig &config) {
   InitializeIO(config);
+  InitializeThreadPool(config);
   Status status =
       InitializeEnvironmentVariables(config.environment_variables());
   const char *log_directory = config.logging_config().log_directory().c_str();
@@ -258,6 +263,17 @@ void InitializeIO(const EnclaveConfig &config) {
 
   // Set the current working directory so that relative paths can be handled.
   io_manager.SetCurrentWorkingDirectory(config.current_working_directory());
+
+  io_manager.SetEpollReadinessCacheEnabled(
+      config.enable_epoll_readiness_cache());
+}
+
+void InitializeThreadPool(const EnclaveConfig &config) {
+  ThreadManager::ThreadPoolOptions options;
+  options.max_idle_threads = config.thread_pool_size();
+  options.idle_timeout_us =
+      static_cast<uint64_t>(config.thread_pool_idle_timeout_ms()) * 1000;
+  ThreadManager::GetInstance()->SetThreadPoolOptions(options);
 }
 
 // Asylo enclave entry points.
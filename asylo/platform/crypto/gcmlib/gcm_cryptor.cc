@@ -18,6 +18,7 @@
 
 #include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
 
+#include <openssl/aead.h>
 #include <openssl/aes.h>
 #include <openssl/cmac.h>
 #include <openssl/err.h>
@@ -27,12 +28,14 @@
 #include <cstdlib>
 #include <cstring>
 #include <ctime>
+#include <vector>
 
 #include "absl/memory/memory.h"
 #include "absl/synchronization/mutex.h"
 #include "asylo/crypto/util/bssl_util.h"
 #include "asylo/crypto/util/byte_container_view.h"
 #include "asylo/crypto/util/bytes.h"
+#include "asylo/platform/primitives/util/trusted_drbg.h"
 #include "asylo/util/logging.h"
 
 namespace asylo {
@@ -54,6 +57,14 @@ constexpr uint8_t kCmacDerivationConstant[kKeyIdLength] = {
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
 
+// Fills |buf| with |count| random bytes from the calling thread's generator,
+// or from BoringSSL's generator if no hardware source of randomness is
+// available.
+bool RandomBytes(uint8_t *buf, size_t count) {
+  return primitives::TrustedDrbgRandomBytes(buf, count) ||
+         RAND_bytes(buf, count) == 1;
+}
+
 bool GenerateDerivedKey(const GcmCryptorKey &wrapping_key,
                         const uint8_t *key_id, GcmCryptorKey *dk) {
   static_assert(kKeyLength == 2 * AES_BLOCK_SIZE, "kKeyLength is invalid");
@@ -85,6 +96,17 @@ bool GenerateDerivedKey(const GcmCryptorKey &wrapping_key,
   return true;
 }
 
+// Returns an AES-GCM context set up with |key|, or nullptr on failure.
+bssl::UniquePtr<EVP_AEAD_CTX> NewAeadContext(const GcmCryptorKey &key) {
+  bssl::UniquePtr<EVP_AEAD_CTX> context(EVP_AEAD_CTX_new(
+      EVP_aead_aes_256_gcm(), reinterpret_cast<const uint8_t *>(key.data()),
+      kKeyLength, kTagLength));
+  if (!context) {
+    LOG(ERROR) << "EVP_AEAD_CTX_new failed: " << BsslLastErrorString();
+  }
+  return context;
+}
+
 }  // namespace
 
 GcmCryptor::GcmCryptor(size_t block_length, const GcmCryptorKey &gcm_key,
@@ -144,120 +166,157 @@ std::unique_ptr<GcmCryptor> GcmCryptor::Create(
 
 bool GcmCryptor::EncryptBlock(const uint8_t *plaintext_data, uint8_t *token,
                               uint8_t *ciphertext_data) {
-  if (plaintext_data == nullptr || token == nullptr ||
-      ciphertext_data == nullptr) {
-    LOG(ERROR) << "Invalid input to GcmCryptor::EncryptBlock.";
-    return false;
-  }
+  return EncryptBlocks(1, &plaintext_data, &token, &ciphertext_data);
+}
 
-  absl::MutexLock lock(&mu_);
+bool GcmCryptor::DecryptBlock(const uint8_t *ciphertext_data,
+                              const uint8_t *token, uint8_t *plaintext_data) {
+  return DecryptBlocks(1, &ciphertext_data, &token, &plaintext_data);
+}
 
-  if (1 != RAND_bytes(next_token_.nonce, kNonceLength)) {
-    LOG(ERROR)
-        << "Failed to generate random nonce for GcmCryptor::EncryptBlock: "
-        << BsslLastErrorString();
+bool GcmCryptor::EncryptBlocks(size_t count,
+                               const uint8_t *const plaintext_blocks[],
+                               uint8_t *const tokens[],
+                               uint8_t *const ciphertext_blocks[]) {
+  if (plaintext_blocks == nullptr || tokens == nullptr ||
+      ciphertext_blocks == nullptr) {
+    LOG(ERROR) << "Invalid input to GcmCryptor::EncryptBlocks.";
     return false;
   }
-
-  if (key_id_counter_ % kKeyIdCycle == 0) {
-    key_id_counter_ = 0;
-
-    if (1 != RAND_bytes(next_token_.key_id, kKeyIdLength)) {
-      LOG(ERROR)
-          << "Failed to generate random token for GcmCryptor::EncryptBlock: "
-          << BsslLastErrorString();
+  for (size_t i = 0; i < count; ++i) {
+    if (plaintext_blocks[i] == nullptr || tokens[i] == nullptr ||
+        ciphertext_blocks[i] == nullptr) {
+      LOG(ERROR) << "Invalid input to GcmCryptor::EncryptBlocks.";
       return false;
     }
+  }
 
-    if (!GenerateDerivedGcmKey(next_token_.key_id, &next_derived_key_)) {
-      LOG(ERROR) << "Failed to derive key for GcmCryptor::EncryptBlock: "
-                 << BsslLastErrorString();
-      return false;
+  // Reserve the key IDs of all blocks in a single critical section. The
+  // context of block i is contexts[context_indices[i]].
+  std::vector<std::shared_ptr<const EVP_AEAD_CTX>> contexts;
+  std::vector<size_t> context_indices(count);
+  {
+    absl::MutexLock lock(&mu_);
+    for (size_t i = 0; i < count; ++i) {
+      if (key_id_counter_ % kKeyIdCycle == 0) {
+        key_id_counter_ = 0;
+
+        if (!RandomBytes(next_token_.key_id, kKeyIdLength)) {
+          LOG(ERROR) << "Failed to generate random token for "
+                        "GcmCryptor::EncryptBlocks: "
+                     << BsslLastErrorString();
+          return false;
+        }
+
+        GcmCryptorKey derived_key;
+        if (!GenerateDerivedGcmKey(next_token_.key_id, &derived_key)) {
+          LOG(ERROR) << "Failed to derive key for GcmCryptor::EncryptBlocks: "
+                     << BsslLastErrorString();
+          return false;
+        }
+
+        next_context_ = NewAeadContext(derived_key);
+        if (!next_context_) {
+          return false;
+        }
+      }
+
+      // Increment the key reuse counter only if the key was successfully
+      // generated.
+      key_id_counter_++;
+
+      if (contexts.empty() || contexts.back() != next_context_) {
+        contexts.push_back(next_context_);
+      }
+      context_indices[i] = contexts.size() - 1;
+      memcpy(tokens[i] + kNonceLength, next_token_.key_id, kKeyIdLength);
     }
   }
 
-  // Increment the key reuse counter only if the key was successfully generated.
-  key_id_counter_++;
-
-  EVP_AEAD_CTX context;
-  if (!EVP_AEAD_CTX_init(
-          &context, EVP_aead_aes_256_gcm(),
-          reinterpret_cast<const uint8_t *>(next_derived_key_.data()),
-          kKeyLength, kTagLength, nullptr)) {
-    LOG(ERROR) << "EVP_AEAD_CTX_init failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
-    return false;
-  }
+  // Nonces are random, so they need not be generated under the lock.
+  for (size_t i = 0; i < count; ++i) {
+    if (!RandomBytes(tokens[i], kNonceLength)) {
+      LOG(ERROR) << "Failed to generate random nonce for "
+                    "GcmCryptor::EncryptBlocks: "
+                 << BsslLastErrorString();
+      return false;
+    }
 
-  size_t ciphertext_length;
-  size_t max_ciphertext_length = kBlockLength + kTagLength;
-  if (!EVP_AEAD_CTX_seal(&context, ciphertext_data, &ciphertext_length,
-                         max_ciphertext_length, next_token_.nonce, kNonceLength,
-                         plaintext_data, kBlockLength, nullptr, 0)) {
-    LOG(ERROR) << "EVP_AEAD_CTX_seal failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
-    return false;
-  }
+    size_t ciphertext_length;
+    size_t max_ciphertext_length = kBlockLength + kTagLength;
+    if (!EVP_AEAD_CTX_seal(contexts[context_indices[i]].get(),
+                           ciphertext_blocks[i], &ciphertext_length,
+                           max_ciphertext_length, tokens[i], kNonceLength,
+                           plaintext_blocks[i], kBlockLength, nullptr, 0)) {
+      LOG(ERROR) << "EVP_AEAD_CTX_seal failed: " << BsslLastErrorString();
+      return false;
+    }
 
-  if (ciphertext_length != max_ciphertext_length) {
-    LOG(ERROR) << "EVP_AEAD_CTX_seal failed to encrypt complete plaintext, "
-               << "expected ciphertext_length = " << max_ciphertext_length
-               << ", encountered ciphertext_length = " << ciphertext_length;
-    EVP_AEAD_CTX_cleanup(&context);
-    return false;
+    if (ciphertext_length != max_ciphertext_length) {
+      LOG(ERROR) << "EVP_AEAD_CTX_seal failed to encrypt complete plaintext, "
+                 << "expected ciphertext_length = " << max_ciphertext_length
+                 << ", encountered ciphertext_length = " << ciphertext_length;
+      return false;
+    }
   }
 
-  memcpy(token, next_token_.data(), kTokenLength);
-
-  EVP_AEAD_CTX_cleanup(&context);
   return true;
 }
 
-bool GcmCryptor::DecryptBlock(const uint8_t *ciphertext_data,
-                              const uint8_t *token, uint8_t *plaintext_data) {
-  if (ciphertext_data == nullptr || token == nullptr ||
-      plaintext_data == nullptr) {
-    LOG(ERROR) << "Invalid input to GcmCryptor::DecryptBlock.";
+bool GcmCryptor::DecryptBlocks(size_t count,
+                               const uint8_t *const ciphertext_blocks[],
+                               const uint8_t *const tokens[],
+                               uint8_t *const plaintext_blocks[]) {
+  if (ciphertext_blocks == nullptr || tokens == nullptr ||
+      plaintext_blocks == nullptr) {
+    LOG(ERROR) << "Invalid input to GcmCryptor::DecryptBlocks.";
     return false;
   }
 
-  const Token *tok = reinterpret_cast<const Token *>(token);
-
-  GcmCryptorKey derived_key;
-  if (!GenerateDerivedGcmKey(tok->key_id, &derived_key)) {
-    LOG(ERROR) << "Failed to derive key for GcmCryptor::DecryptBlock: "
-               << BsslLastErrorString();
-    return false;
-  }
+  // Context for the key ID of the previous block.
+  bssl::UniquePtr<EVP_AEAD_CTX> context;
+  const uint8_t *context_key_id = nullptr;
+  for (size_t i = 0; i < count; ++i) {
+    if (ciphertext_blocks[i] == nullptr || tokens[i] == nullptr ||
+        plaintext_blocks[i] == nullptr) {
+      LOG(ERROR) << "Invalid input to GcmCryptor::DecryptBlocks.";
+      return false;
+    }
 
-  EVP_AEAD_CTX context;
-  if (!EVP_AEAD_CTX_init(&context, EVP_aead_aes_256_gcm(),
-                         reinterpret_cast<const uint8_t *>(derived_key.data()),
-                         kKeyLength, kTagLength, nullptr)) {
-    LOG(ERROR) << "EVP_AEAD_CTX_init failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
-    return false;
-  }
+    const Token *tok = reinterpret_cast<const Token *>(tokens[i]);
+    if (!context ||
+        memcmp(context_key_id, tok->key_id, kKeyIdLength) != 0) {
+      GcmCryptorKey derived_key;
+      if (!GenerateDerivedGcmKey(tok->key_id, &derived_key)) {
+        LOG(ERROR) << "Failed to derive key for GcmCryptor::DecryptBlocks: "
+                   << BsslLastErrorString();
+        return false;
+      }
+
+      context = NewAeadContext(derived_key);
+      if (!context) {
+        return false;
+      }
+      context_key_id = tok->key_id;
+    }
 
-  size_t plaintext_length;
-  if (!EVP_AEAD_CTX_open(&context, plaintext_data, &plaintext_length,
-                         kBlockLength, tok->nonce, kNonceLength,
-                         ciphertext_data, kBlockLength + kTagLength, nullptr,
-                         0)) {
-    LOG(ERROR) << "EVP_AEAD_CTX_open failed: " << BsslLastErrorString();
-    EVP_AEAD_CTX_cleanup(&context);
-    return false;
-  }
+    size_t plaintext_length;
+    if (!EVP_AEAD_CTX_open(context.get(), plaintext_blocks[i],
+                           &plaintext_length, kBlockLength, tok->nonce,
+                           kNonceLength, ciphertext_blocks[i],
+                           kBlockLength + kTagLength, nullptr, 0)) {
+      LOG(ERROR) << "EVP_AEAD_CTX_open failed: " << BsslLastErrorString();
+      return false;
+    }
 
-  if (plaintext_length != kBlockLength) {
-    LOG(ERROR) << "EVP_AEAD_CTX_open failed to decrypt complete ciphertext, "
-               << "expected plaintext_length = " << kBlockLength
-               << ", encountered plaintext_length = " << plaintext_length;
-    EVP_AEAD_CTX_cleanup(&context);
-    return false;
+    if (plaintext_length != kBlockLength) {
+      LOG(ERROR) << "EVP_AEAD_CTX_open failed to decrypt complete ciphertext, "
+                 << "expected plaintext_length = " << kBlockLength
+                 << ", encountered plaintext_length = " << plaintext_length;
+      return false;
+    }
   }
 
-  EVP_AEAD_CTX_cleanup(&context);
   return true;
 }
 
@@ -287,13 +346,13 @@ GcmCryptor *GcmCryptorRegistry::GetGcmCryptor(size_t block_length,
                                               const GcmCryptorKey &key) {
   absl::MutexLock lock(&mu_);
 
-  auto it = cryptor_registry_.find(key);
-  if (it != cryptor_registry_.end()) {
+  auto &cryptors = cryptor_registry_[block_length];
+  auto it = cryptors.find(key);
+  if (it != cryptors.end()) {
     return it->second.get();
   }
 
-  auto result =
-      cryptor_registry_.emplace(key, GcmCryptor::Create(block_length, key));
+  auto result = cryptors.emplace(key, GcmCryptor::Create(block_length, key));
   return result.first->second.get();
 }
 
@@ -19,6 +19,7 @@
 #ifndef ASYLO_PLATFORM_CRYPTO_GCMLIB_GCM_CRYPTOR_H_
 #define ASYLO_PLATFORM_CRYPTO_GCMLIB_GCM_CRYPTOR_H_
 
+#include <openssl/aead.h>
 #include <openssl/evp.h>
 
 #include <memory>
@@ -68,6 +69,22 @@ class GcmCryptor {
   bool DecryptBlock(const uint8_t *ciphertext_data, const uint8_t *token,
                     uint8_t *plaintext_data);
 
+  // Encrypts |count| plaintext blocks as EncryptBlock does, with the tokens of
+  // all blocks reserved under a single lock acquisition, and the blocks sharing
+  // a derived key encrypted with a single AEAD context. Returns true on
+  // success, false if any of the blocks fails to encrypt.
+  bool EncryptBlocks(size_t count, const uint8_t *const plaintext_blocks[],
+                     uint8_t *const tokens[],
+                     uint8_t *const ciphertext_blocks[]);
+
+  // Decrypts |count| ciphertext blocks as DecryptBlock does, deriving the key
+  // and setting up the AEAD context once for each run of consecutive blocks
+  // encrypted with the same derived key. Returns true on success, false if any
+  // of the blocks fails to decrypt.
+  bool DecryptBlocks(size_t count, const uint8_t *const ciphertext_blocks[],
+                     const uint8_t *const tokens[],
+                     uint8_t *const plaintext_blocks[]);
+
   // Generates auth tag, in particular CMAC, for the specified data. Returns
   // true on success, false on failure.
   bool GetAuthTag(uint8_t out[16], const uint8_t *in, size_t in_len) const;
@@ -93,7 +110,9 @@ class GcmCryptor {
   const GcmCryptorKey kCmacKey;
   Token next_token_ ABSL_GUARDED_BY(mu_);
   uint64_t key_id_counter_;
-  GcmCryptorKey next_derived_key_ ABSL_GUARDED_BY(mu_);
+  // AEAD context set up with the key derived from next_token_.key_id. Shared
+  // with encryptions in progress, which use it outside of the lock.
+  std::shared_ptr<const EVP_AEAD_CTX> next_context_ ABSL_GUARDED_BY(mu_);
   absl::Mutex mu_;
 
   GcmCryptor(const GcmCryptor &) = delete;
@@ -109,7 +128,8 @@ class GcmCryptorRegistry {
     return *instance;
   }
 
-  // Accessor to the instance of GCM cryptor associated with a given key.
+  // Accessor to the instance of GCM cryptor associated with a given block
+  // length and key.
   GcmCryptor *GetGcmCryptor(size_t block_length, const GcmCryptorKey &key)
       ABSL_LOCKS_EXCLUDED(mu_);
 
@@ -140,8 +160,11 @@ class GcmCryptorRegistry {
   // primitives interface where system calls might not be available, so we use
   // std::unordered_map instead of absl::flat_hash_map to prevent unsafe system
   // calls made by absl based containers.
-  std::unordered_map<GcmCryptorKey, std::unique_ptr<GcmCryptor>,
-                     SafeBytesHasher>
+  // Cryptors are keyed on the block length first, since cryptors of different
+  // block lengths may share a key.
+  std::unordered_map<
+      size_t, std::unordered_map<GcmCryptorKey, std::unique_ptr<GcmCryptor>,
+                                 SafeBytesHasher>>
       cryptor_registry_ ABSL_GUARDED_BY(mu_);
   absl::Mutex mu_;
 };
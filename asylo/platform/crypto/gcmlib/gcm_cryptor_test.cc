@@ -20,6 +20,8 @@
 
 #include <openssl/rand.h>
 
+#include <vector>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "asylo/crypto/util/bytes.h"
@@ -195,6 +197,101 @@ TEST(GcmCryptorTest, DecryptWithAlteredCiphertextFails) {
       decryptor->DecryptBlock(encryptor_buffer, token, decryptor_buffer));
 }
 
+// Tests batch encryption and decryption across a key rotation, and that the
+// batches interoperate with the single block API.
+TEST(GcmCryptorTest, DecryptBlocksAfterEncryptBlocksReturnsOriginalTexts) {
+  constexpr size_t kNumBlocks = kKeyIdCycle + 10;
+  std::vector<uint8_t> plaintext(kNumBlocks * kBlockLength);
+  std::vector<uint8_t> ciphertext(kNumBlocks * (kBlockLength + kTagLength));
+  std::vector<uint8_t> decrypted(kNumBlocks * kBlockLength);
+  std::vector<uint8_t> tokens(kNumBlocks * kTokenLength);
+  std::vector<const uint8_t *> plaintext_blocks(kNumBlocks);
+  std::vector<uint8_t *> ciphertext_blocks(kNumBlocks);
+  std::vector<uint8_t *> decrypted_blocks(kNumBlocks);
+  std::vector<uint8_t *> token_ptrs(kNumBlocks);
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    plaintext_blocks[i] = &plaintext[i * kBlockLength];
+    ciphertext_blocks[i] = &ciphertext[i * (kBlockLength + kTagLength)];
+    decrypted_blocks[i] = &decrypted[i * kBlockLength];
+    token_ptrs[i] = &tokens[i * kTokenLength];
+  }
+  ASSERT_EQ(RAND_bytes(plaintext.data(), plaintext.size()), 1);
+  GcmCryptorKey key;
+  ASSERT_EQ(RAND_bytes(key.data(), key.size()), 1);
+  auto encryptor = GcmCryptor::Create(kBlockLength, key);
+  auto decryptor = GcmCryptor::Create(kBlockLength, key);
+
+  ASSERT_TRUE(encryptor->EncryptBlocks(kNumBlocks, plaintext_blocks.data(),
+                                       token_ptrs.data(),
+                                       ciphertext_blocks.data()));
+
+  // The key ID rotates exactly once every kKeyIdCycle blocks.
+  for (size_t i = 1; i < kNumBlocks; ++i) {
+    EXPECT_NE(memcmp(token_ptrs[i - 1], token_ptrs[i], kNonceLength), 0);
+    int key_id_cmp = memcmp(token_ptrs[i - 1] + kNonceLength,
+                            token_ptrs[i] + kNonceLength, kKeyIdLength);
+    if (i % kKeyIdCycle == 0) {
+      EXPECT_NE(key_id_cmp, 0);
+    } else {
+      EXPECT_EQ(key_id_cmp, 0);
+    }
+  }
+
+  std::vector<const uint8_t *> const_ciphertext_blocks(
+      ciphertext_blocks.begin(), ciphertext_blocks.end());
+  std::vector<const uint8_t *> const_token_ptrs(token_ptrs.begin(),
+                                                token_ptrs.end());
+  ASSERT_TRUE(decryptor->DecryptBlocks(
+      kNumBlocks, const_ciphertext_blocks.data(), const_token_ptrs.data(),
+      decrypted_blocks.data()));
+  EXPECT_EQ(plaintext, decrypted);
+
+  uint8_t decryptor_buffer[kBlockLength];
+  ASSERT_TRUE(decryptor->DecryptBlock(ciphertext_blocks[kNumBlocks - 1],
+                                      token_ptrs[kNumBlocks - 1],
+                                      decryptor_buffer));
+  EXPECT_EQ(memcmp(plaintext_blocks[kNumBlocks - 1], decryptor_buffer,
+                   kBlockLength),
+            0);
+}
+
+// Tests batch decryption fails if any of the blocks is altered.
+TEST(GcmCryptorTest, DecryptBlocksWithAlteredCiphertextFails) {
+  constexpr size_t kNumBlocks = 4;
+  uint8_t plaintext[kNumBlocks][kBlockLength];
+  uint8_t ciphertext[kNumBlocks][kBlockLength + kTagLength];
+  uint8_t decrypted[kNumBlocks][kBlockLength];
+  uint8_t tokens[kNumBlocks][kTokenLength];
+  const uint8_t *plaintext_blocks[kNumBlocks];
+  uint8_t *ciphertext_blocks[kNumBlocks];
+  uint8_t *decrypted_blocks[kNumBlocks];
+  uint8_t *token_ptrs[kNumBlocks];
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    ASSERT_EQ(RAND_bytes(plaintext[i], kBlockLength), 1);
+    plaintext_blocks[i] = plaintext[i];
+    ciphertext_blocks[i] = ciphertext[i];
+    decrypted_blocks[i] = decrypted[i];
+    token_ptrs[i] = tokens[i];
+  }
+  GcmCryptorKey key;
+  ASSERT_EQ(RAND_bytes(key.data(), key.size()), 1);
+  auto cryptor = GcmCryptor::Create(kBlockLength, key);
+  ASSERT_TRUE(cryptor->EncryptBlocks(kNumBlocks, plaintext_blocks, token_ptrs,
+                                     ciphertext_blocks));
+
+  // Alter the ciphertext of the last block.
+  ++ciphertext[kNumBlocks - 1][0];
+
+  const uint8_t *const_ciphertext_blocks[kNumBlocks];
+  const uint8_t *const_token_ptrs[kNumBlocks];
+  for (size_t i = 0; i < kNumBlocks; ++i) {
+    const_ciphertext_blocks[i] = ciphertext[i];
+    const_token_ptrs[i] = tokens[i];
+  }
+  ASSERT_FALSE(cryptor->DecryptBlocks(kNumBlocks, const_ciphertext_blocks,
+                                      const_token_ptrs, decrypted_blocks));
+}
+
 // Tests GCM cryptor registry returns consistent instance of GCM cryptor.
 TEST(GcmCryptorTest, GetGcmCryptorIsConsistent) {
   GcmCryptorKey key;
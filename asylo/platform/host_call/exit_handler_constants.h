@@ -139,12 +139,63 @@ static constexpr uint64_t kSysFutexWakeHandler =
 static constexpr uint64_t kLocalLifetimeAllocHandler =
     primitives::kSelectorHostCall + 30;
 
+// Exit handler constant for |SystemCallBatchHandler|.
+static constexpr uint64_t kSystemCallBatchHandler =
+    primitives::kSelectorHostCall + 31;
+
+// Exit handler constant for |WritevHandler|.
+static constexpr uint64_t kWritevHandler = primitives::kSelectorHostCall + 32;
+
+// Exit handler constant for |ReadvHandler|.
+static constexpr uint64_t kReadvHandler = primitives::kSelectorHostCall + 33;
+
+// Exit handler constant for |EpollPollerStartHandler|.
+static constexpr uint64_t kEpollPollerStartHandler =
+    primitives::kSelectorHostCall + 34;
+
+// Exit handler constant for |EpollPollerStopHandler|.
+static constexpr uint64_t kEpollPollerStopHandler =
+    primitives::kSelectorHostCall + 35;
+
+// Exit handler constant for |EpollPollerWaitHandler|.
+static constexpr uint64_t kEpollPollerWaitHandler =
+    primitives::kSelectorHostCall + 36;
+
 // Assert that the largest host call handler lies in
 // [kSelectorHostCall, kSelectorRemote).
-static_assert(kLocalLifetimeAllocHandler < primitives::kSelectorRemote,
+static_assert(kEpollPollerWaitHandler < primitives::kSelectorRemote,
               "Cannot have host call handler constant spill over into "
               "|kSelectorRemote|.");
 
+// Returns true if the host call handler registered for |selector| may be run by
+// a switchless worker thread rather than by the calling thread. Only handlers
+// which complete quickly, never block and do not depend on the identity of the
+// calling host thread are eligible. The generic system call handlers are not
+// listed, since their eligibility depends on the system calls they carry and is
+// decided by the host call dispatcher for each request.
+constexpr bool IsSwitchlessHostCall(uint64_t selector) {
+  switch (selector) {
+    case kIsAttyHandler:
+    case kSysconfHandler:
+    case kReallocHandler:
+    case kGetSocknameHandler:
+    case kGetPeernameHandler:
+    case kGetSockOptHandler:
+    case kInetPtonHandler:
+    case kInetNtopHandler:
+    case kIfNameToIndexHandler:
+    case kIfIndexToNameHandler:
+    case kGetCpuClockIdHandler:
+    case kHexDumpHandler:
+    case kClockGettimeHandler:
+    case kSysFutexWakeHandler:
+    case kLocalLifetimeAllocHandler:
+      return true;
+    default:
+      return false;
+  }
+}
+
 }  // namespace host_call
 }  // namespace asylo
 
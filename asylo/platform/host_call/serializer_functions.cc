@@ -20,6 +20,9 @@
 
 #include <ifaddrs.h>
 
+#include <algorithm>
+#include <cstring>
+
 #include "absl/status/status.h"
 #include "asylo/platform/primitives/primitive_status.h"
 #include "asylo/platform/system_call/type_conversions/types_functions.h"
@@ -106,6 +109,22 @@ PrimitiveStatus PushkLinuxSockAddrToWriter(
 
 }  // namespace
 
+bool FromkLinuxSockAddrExtent(Extent extent, struct sockaddr *output,
+                              socklen_t *output_len,
+                              void (*abort_handler)(const char *message)) {
+  union {
+    struct klinux_sockaddr sockaddr;
+    struct klinux_sockaddr_un sockaddr_un;
+    struct klinux_sockaddr_in sockaddr_in;
+    struct klinux_sockaddr_in6 sockaddr_in6;
+  } klinux_sock;
+  size_t klinux_sock_len = std::min(extent.size(), sizeof(klinux_sock));
+  memset(&klinux_sock, 0, sizeof(klinux_sock));
+  memcpy(&klinux_sock, extent.data(), klinux_sock_len);
+  return FromkLinuxSockAddr(&klinux_sock.sockaddr, klinux_sock_len, output,
+                            output_len, abort_handler);
+}
+
 bool IsIfAddrSupported(const struct ifaddrs *entry) {
   if (entry->ifa_addr && !IpCompliant(entry->ifa_addr)) return false;
   if (entry->ifa_netmask && !IpCompliant(entry->ifa_netmask)) return false;
@@ -163,13 +182,11 @@ bool DeserializeAddrinfo(primitives::MessageReader *in, struct addrinfo **out,
 
     // Optionally set ai_addr and ai_addrlen.
     if (!klinux_sockaddr_buf.empty()) {
-      const struct klinux_sockaddr *klinux_sock =
-          klinux_sockaddr_buf.As<struct klinux_sockaddr>();
       struct sockaddr_storage sock {};
       socklen_t socklen = sizeof(struct sockaddr_storage);
-      if (!FromkLinuxSockAddr(klinux_sock, klinux_sockaddr_buf.size(),
-                              reinterpret_cast<sockaddr *>(&sock), &socklen,
-                              abort_handler)) {
+      if (!FromkLinuxSockAddrExtent(klinux_sockaddr_buf,
+                                    reinterpret_cast<sockaddr *>(&sock),
+                                    &socklen, abort_handler)) {
         // Roll back info and linked list constructed until now.
         freeaddrinfo(info);
         freeaddrinfo(*out);
@@ -244,13 +261,11 @@ bool DeserializeIfAddrs(primitives::MessageReader *in, struct ifaddrs **out,
 
     // Optionally set addrs->ifa_addr.
     if (!klinux_ifa_addr_buf.empty()) {
-      const struct klinux_sockaddr *klinux_sock =
-          klinux_ifa_addr_buf.As<struct klinux_sockaddr>();
       struct sockaddr_storage sock {};
       socklen_t socklen = sizeof(struct sockaddr_storage);
-      if (!FromkLinuxSockAddr(klinux_sock, klinux_ifa_addr_buf.size(),
-                              reinterpret_cast<sockaddr *>(&sock), &socklen,
-                              abort_handler)) {
+      if (!FromkLinuxSockAddrExtent(klinux_ifa_addr_buf,
+                                    reinterpret_cast<sockaddr *>(&sock),
+                                    &socklen, abort_handler)) {
         // Roll back info and linked list constructed until now.
         freeifaddrs(addrs);
         freeifaddrs(*out);
@@ -263,13 +278,11 @@ bool DeserializeIfAddrs(primitives::MessageReader *in, struct ifaddrs **out,
 
     // Optionally set addrs->ifa_netmask.
     if (!klinux_ifa_netmask_buf.empty()) {
-      const struct klinux_sockaddr *klinux_sock =
-          klinux_ifa_netmask_buf.As<struct klinux_sockaddr>();
       struct sockaddr_storage sock {};
       socklen_t socklen = sizeof(struct sockaddr_storage);
-      if (!FromkLinuxSockAddr(klinux_sock, klinux_ifa_netmask_buf.size(),
-                              reinterpret_cast<sockaddr *>(&sock), &socklen,
-                              abort_handler)) {
+      if (!FromkLinuxSockAddrExtent(klinux_ifa_netmask_buf,
+                                    reinterpret_cast<sockaddr *>(&sock),
+                                    &socklen, abort_handler)) {
         // Roll back current ifaddrs node and linked list constructed until now.
         freeifaddrs(addrs);
         freeifaddrs(*out);
@@ -282,13 +295,11 @@ bool DeserializeIfAddrs(primitives::MessageReader *in, struct ifaddrs **out,
 
     // Optionally set addrs->ifa_ifu.ifu_dstaddr.
     if (!klinux_ifa_dstaddr_buf.empty()) {
-      const struct klinux_sockaddr *klinux_sock =
-          klinux_ifa_dstaddr_buf.As<struct klinux_sockaddr>();
       struct sockaddr_storage sock {};
       socklen_t socklen = sizeof(struct sockaddr_storage);
-      if (!FromkLinuxSockAddr(klinux_sock, klinux_ifa_dstaddr_buf.size(),
-                              reinterpret_cast<sockaddr *>(&sock), &socklen,
-                              abort_handler)) {
+      if (!FromkLinuxSockAddrExtent(klinux_ifa_dstaddr_buf,
+                                    reinterpret_cast<sockaddr *>(&sock),
+                                    &socklen, abort_handler)) {
         // Roll back current ifaddrs node and linked list constructed until now.
         freeifaddrs(addrs);
         freeifaddrs(*out);
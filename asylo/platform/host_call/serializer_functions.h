@@ -65,6 +65,14 @@ primitives::PrimitiveStatus SerializeIfAddrs(
     void (*abort_handler)(const char *message),
     bool explicit_klinux_conversion = false);
 
+// Converts the Linux based sockaddr held in |extent| to an enclave based
+// sockaddr, as FromkLinuxSockAddr() does. Extents read from a MessageReader are
+// not guaranteed to be aligned, so the sockaddr is copied to aligned storage
+// before it is read.
+bool FromkLinuxSockAddrExtent(primitives::Extent extent,
+                              struct sockaddr *output, socklen_t *output_len,
+                              void (*abort_handler)(const char *message));
+
 // Returns true if all sockaddr fields are compatible with IPv4 or IPv6, false
 // otherwise. The sockaddr fields in the ifaddrs struct may also be null.
 // IfAddrSupported is exposed here since it is used in tests.
@@ -33,6 +33,9 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
 #include <ostream>
 #include <string>
 #include <thread>
@@ -46,6 +49,7 @@
 #include "absl/strings/str_cat.h"
 #include "absl/time/clock.h"
 #include "absl/time/time.h"
+#include "asylo/enclave.pb.h"
 #include "asylo/enclave_manager.h"
 #include "asylo/platform/common/time_util.h"
 #include "asylo/platform/host_call/test/enclave_test_selectors.h"
@@ -54,6 +58,7 @@
 #include "asylo/platform/primitives/test/test_backend.h"
 #include "asylo/platform/primitives/untrusted_primitives.h"
 #include "asylo/platform/primitives/util/message.h"
+#include "asylo/platform/primitives/util/switchless_worker_pool.h"
 #include "asylo/platform/storage/utils/fd_closer.h"
 #include "asylo/test/util/status_matchers.h"
 #include "asylo/test/util/test_flags.h"
@@ -789,6 +794,53 @@ TEST_F(HostCallTest, TestRead) {
   EXPECT_THAT(out.next().As<char>(), StrEq(expected_content));
 }
 
+// Tests that enc_untrusted_read() is serviced by a switchless worker while a
+// worker pool is attached to the enclave, and that enc_untrusted_fsync(), which
+// is not eligible, still takes a regular exit.
+TEST_F(HostCallTest, TestSwitchlessRead) {
+  std::string test_file =
+      absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir), "/test_file.tmp");
+
+  int fd =
+      open(test_file.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  platform::storage::FdCloser fd_closer(fd);
+  ASSERT_GE(fd, 0);
+
+  std::string expected_content = "read without an exit";
+  ASSERT_THAT(
+      write(fd, expected_content.c_str(), expected_content.length() + 1),
+      Eq(expected_content.length() + 1));
+  ASSERT_THAT(lseek(fd, 0, SEEK_SET), Eq(0));
+
+  // Keep the worker spinning and the caller waiting for it, so that the read
+  // never falls back to a regular exit.
+  SwitchlessConfig config;
+  config.set_worker_count(1);
+  config.set_spin_iterations(std::numeric_limits<uint32_t>::max());
+  config.set_accept_spin_iterations(std::numeric_limits<uint32_t>::max());
+  std::unique_ptr<primitives::SwitchlessWorkerPool> pool;
+  ASYLO_ASSERT_OK_AND_ASSIGN(
+      pool, primitives::SwitchlessWorkerPool::Create(client_, config));
+
+  MessageWriter in;
+  in.Push<int>(/*value=fd=*/fd);
+  in.Push<size_t>(/*value=count=*/expected_content.length() + 1);
+  MessageReader out;
+  ASYLO_ASSERT_OK(client_->EnclaveCall(kTestRead, &in, &out));
+  ASSERT_THAT(out, SizeIs(2));  // Contains return value and buffer.
+  EXPECT_THAT(out.next<ssize_t>(), Eq(expected_content.length() + 1));
+  EXPECT_THAT(out.next().As<char>(), StrEq(expected_content));
+  EXPECT_THAT(pool->serviced_count(), Eq(1));
+
+  MessageWriter fsync_in;
+  fsync_in.Push<int>(fd);
+  MessageReader fsync_out;
+  ASYLO_ASSERT_OK(client_->EnclaveCall(kTestFsync, &fsync_in, &fsync_out));
+  ASSERT_THAT(fsync_out, SizeIs(1));  // Should only contain return value.
+  EXPECT_THAT(fsync_out.next<int>(), Eq(0));
+  EXPECT_THAT(pool->serviced_count(), Eq(1));
+}
+
 // Tests enc_untrusted_write() by making a host call from inside the enclave to
 // write to a file, and verifying that the content read from the file on the
 // host matches it.
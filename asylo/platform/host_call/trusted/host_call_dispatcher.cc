@@ -24,10 +24,79 @@
 #include "asylo/platform/primitives/primitive_status.h"
 #include "asylo/platform/primitives/trusted_primitives.h"
 #include "asylo/platform/primitives/util/message.h"
+#include "asylo/platform/primitives/util/trusted_switchless.h"
+#include "asylo/platform/system_call/message.h"
+#include "asylo/platform/system_call/sysno.h"
 #include "asylo/util/status_macros.h"
 
 namespace asylo {
 namespace host_call {
+namespace {
+
+// Returns true if system call |sysno| may be run by a switchless worker thread.
+// Only system calls which neither act on the calling thread nor wait for an
+// event of unbounded duration are eligible. Reads and writes may still block
+// on a pipe or a socket, which holds the worker for as long as the caller would
+// have waited in its own exit; callers which find no free worker fall back to a
+// regular exit.
+bool IsSwitchlessSystemCall(int sysno) {
+  switch (sysno) {
+    case system_call::kSYS_read:
+    case system_call::kSYS_write:
+    case system_call::kSYS_pread64:
+    case system_call::kSYS_pwrite64:
+    case system_call::kSYS_readv:
+    case system_call::kSYS_writev:
+    case system_call::kSYS_lseek:
+    case system_call::kSYS_fstat:
+    case system_call::kSYS_stat:
+    case system_call::kSYS_lstat:
+    case system_call::kSYS_access:
+    case system_call::kSYS_recvfrom:
+    case system_call::kSYS_sendto:
+    case system_call::kSYS_recvmsg:
+    case system_call::kSYS_sendmsg:
+    case system_call::kSYS_getsockname:
+    case system_call::kSYS_getpeername:
+    case system_call::kSYS_gettimeofday:
+    case system_call::kSYS_getpid:
+    case system_call::kSYS_getppid:
+    case system_call::kSYS_getuid:
+    case system_call::kSYS_geteuid:
+    case system_call::kSYS_getgid:
+    case system_call::kSYS_getegid:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns true if the serialized system call request |request| may be run by a
+// switchless worker thread. The request is owned by the enclave, so it may be
+// read without copying.
+bool IsSwitchlessSystemCallRequest(primitives::Extent request) {
+  if (request.size() < sizeof(system_call::MessageHeader)) {
+    return false;
+  }
+  return IsSwitchlessSystemCall(system_call::MessageReader(request).sysno());
+}
+
+// Performs an exit call to |exit_selector|, through the switchless request ring
+// if |switchless| is set and a worker accepts the call, and with a regular
+// enclave exit otherwise.
+primitives::PrimitiveStatus DispatchUntrustedCall(
+    uint64_t exit_selector, bool switchless, primitives::MessageWriter* input,
+    primitives::MessageReader* output) {
+  primitives::PrimitiveStatus status;
+  if (switchless && primitives::TrySwitchlessUntrustedCall(
+                        exit_selector, input, output, &status)) {
+    return status;
+  }
+  return primitives::TrustedPrimitives::UntrustedCall(exit_selector, input,
+                                                      output);
+}
+
+}  // namespace
 
 primitives::PrimitiveStatus SystemCallDispatcher(const uint8_t* request_buffer,
                                                  size_t request_size,
@@ -46,8 +115,11 @@ primitives::PrimitiveStatus SystemCallDispatcher(const uint8_t* request_buffer,
   primitives::MessageWriter input;
   input.PushByReference(primitives::Extent{request_buffer, request_size});
   primitives::MessageReader output;
-  ASYLO_RETURN_IF_ERROR(primitives::TrustedPrimitives::UntrustedCall(
-      kSystemCallHandler, &input, &output));
+  ASYLO_RETURN_IF_ERROR(DispatchUntrustedCall(
+      kSystemCallHandler,
+      IsSwitchlessSystemCallRequest(
+          primitives::Extent{request_buffer, request_size}),
+      &input, &output));
 
   // The output should only contain the serialized response.
   ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(output, 1);
@@ -69,6 +141,39 @@ primitives::PrimitiveStatus SystemCallDispatcher(const uint8_t* request_buffer,
   return primitives::PrimitiveStatus::OkStatus();
 }
 
+primitives::PrimitiveStatus SystemCallBatchDispatcher(
+    const primitives::Extent* requests, size_t request_count,
+    primitives::MessageReader* responses) {
+  if (request_count == 0 || requests == nullptr) {
+    return primitives::PrimitiveStatus{
+        primitives::AbslStatusCode::kFailedPrecondition,
+        "Empty batch provided. Need at least one valid request to dispatch the "
+        "host call."};
+  }
+
+  // The requests are owned by the caller; pass them by reference so that they
+  // are serialized directly into the untrusted parameter buffer.
+  // A batch is run by a switchless worker only if all of its system calls are
+  // eligible.
+  primitives::MessageWriter input;
+  bool switchless = true;
+  for (size_t i = 0; i < request_count; i++) {
+    if (requests[i].empty()) {
+      return primitives::PrimitiveStatus{
+          primitives::AbslStatusCode::kFailedPrecondition,
+          "Zero-sized request provided in system call batch."};
+    }
+    switchless = switchless && IsSwitchlessSystemCallRequest(requests[i]);
+    input.PushByReference(requests[i]);
+  }
+  ASYLO_RETURN_IF_ERROR(DispatchUntrustedCall(
+      kSystemCallBatchHandler, switchless, &input, responses));
+
+  // The output should contain exactly one serialized response per request.
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*responses, request_count);
+  return primitives::PrimitiveStatus::OkStatus();
+}
+
 primitives::PrimitiveStatus NonSystemCallDispatcher(
     uint64_t exit_selector, primitives::MessageWriter* input,
     primitives::MessageReader* output) {
@@ -79,8 +184,8 @@ primitives::PrimitiveStatus NonSystemCallDispatcher(
         "dispatch the host call"};
   }
 
-  ASYLO_RETURN_IF_ERROR(primitives::TrustedPrimitives::UntrustedCall(
-      exit_selector, input, output));
+  ASYLO_RETURN_IF_ERROR(DispatchUntrustedCall(
+      exit_selector, IsSwitchlessHostCall(exit_selector), input, output));
 
   // Output should at least contain the host call return value.
   if (output->empty()) {
@@ -26,8 +26,10 @@
 #include <sys/statfs.h>
 
 #include <algorithm>
+#include <limits>
 
 #include "absl/types/optional.h"
+#include "asylo/platform/common/epoll_readiness_ring.h"
 #include "asylo/platform/host_call/exit_handler_constants.h"
 #include "asylo/platform/host_call/serializer_functions.h"
 #include "asylo/platform/primitives/trusted_primitives.h"
@@ -140,6 +142,112 @@ bool PasswdHolderToPasswd(struct passwd_holder *passwd_in,
   return true;
 }
 
+// Maximum number of buffers accepted by the vectored I/O host calls, matching
+// UIO_MAXIOV on Linux.
+constexpr int kMaxIovecCount = 1024;
+
+// Offset passed to the vectored I/O handlers to use and update the file offset,
+// as readv() and writev() do, instead of reading or writing at a given offset.
+constexpr int64_t kCurrentFileOffset = -1;
+
+// Returns the total length of the buffers described by |iov|. Returns -1 and
+// sets errno to EINVAL if |iovcnt| is out of range or the total length does not
+// fit in an ssize_t.
+ssize_t TotalIovecLength(const struct iovec *iov, int iovcnt) {
+  if (iovcnt < 0 || iovcnt > kMaxIovecCount) {
+    errno = EINVAL;
+    return -1;
+  }
+  size_t total_length = 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    if (iov[i].iov_len > std::numeric_limits<ssize_t>::max() - total_length) {
+      errno = EINVAL;
+      return -1;
+    }
+    total_length += iov[i].iov_len;
+  }
+  return total_length;
+}
+
+// Writes the buffers described by |iov| to |fd| at |offset|, or at the file
+// offset if |offset| is kCurrentFileOffset. Each buffer is serialized directly
+// into the untrusted message, without being gathered in trusted memory first.
+ssize_t UntrustedWritev(int fd, const struct iovec *iov, int iovcnt,
+                        int64_t offset, const char *name) {
+  ssize_t total_length = TotalIovecLength(iov, iovcnt);
+  if (total_length == -1) {
+    return -1;
+  }
+
+  MessageWriter input;
+  input.Push(fd);
+  input.Push(offset);
+  for (int i = 0; i < iovcnt; ++i) {
+    input.PushByReference(Extent{iov[i].iov_base, iov[i].iov_len});
+  }
+  MessageReader output;
+  const auto status = NonSystemCallDispatcher(
+      ::asylo::host_call::kWritevHandler, &input, &output);
+  CheckStatusAndParamCount(status, output, name, 2);
+
+  ssize_t result = output.next<ssize_t>();
+  int klinux_errno = output.next<int>();
+  if (result == -1) {
+    errno = FromkLinuxErrno(klinux_errno);
+    return result;
+  }
+  if (result > total_length) {
+    std::string message = absl::StrCat(name, ": result exceeds requested");
+    TrustedPrimitives::BestEffortAbort(message.c_str());
+  }
+  return result;
+}
+
+// Reads from |fd| at |offset|, or at the file offset if |offset| is
+// kCurrentFileOffset, into the buffers described by |iov|. The data read is
+// scattered directly from the untrusted message into the buffers.
+ssize_t UntrustedReadv(int fd, const struct iovec *iov, int iovcnt,
+                       int64_t offset, const char *name) {
+  ssize_t total_length = TotalIovecLength(iov, iovcnt);
+  if (total_length == -1) {
+    return -1;
+  }
+
+  MessageWriter input;
+  input.Push(fd);
+  input.Push(offset);
+  for (int i = 0; i < iovcnt; ++i) {
+    input.Push<uint64_t>(iov[i].iov_len);
+  }
+  MessageReader output;
+  const auto status = NonSystemCallDispatcher(
+      ::asylo::host_call::kReadvHandler, &input, &output);
+  CheckStatusAndParamCount(status, output, name, 3);
+
+  ssize_t result = output.next<ssize_t>();
+  int klinux_errno = output.next<int>();
+  auto data_extent = output.next();
+  if (result == -1) {
+    errno = FromkLinuxErrno(klinux_errno);
+    return result;
+  }
+  if (result > total_length || data_extent.size() != result) {
+    std::string message =
+        absl::StrCat(name, ": result does not match the data returned");
+    TrustedPrimitives::BestEffortAbort(message.c_str());
+  }
+
+  const char *data = data_extent.As<char>();
+  size_t bytes_left = result;
+  for (int i = 0; i < iovcnt && bytes_left > 0; ++i) {
+    size_t bytes_to_copy = std::min(iov[i].iov_len, bytes_left);
+    memcpy(iov[i].iov_base, data, bytes_to_copy);
+    data += bytes_to_copy;
+    bytes_left -= bytes_to_copy;
+  }
+  return result;
+}
+
 }  // namespace
 
 extern "C" {
@@ -974,6 +1082,34 @@ ssize_t enc_untrusted_recvmsg(int sockfd, struct msghdr *msg, int flags) {
   return result;
 }
 
+ssize_t enc_untrusted_writev(int fd, const struct iovec *iov, int iovcnt) {
+  return UntrustedWritev(fd, iov, iovcnt, kCurrentFileOffset,
+                         "enc_untrusted_writev");
+}
+
+ssize_t enc_untrusted_readv(int fd, const struct iovec *iov, int iovcnt) {
+  return UntrustedReadv(fd, iov, iovcnt, kCurrentFileOffset,
+                        "enc_untrusted_readv");
+}
+
+ssize_t enc_untrusted_pwritev(int fd, const struct iovec *iov, int iovcnt,
+                              off_t offset) {
+  if (offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return UntrustedWritev(fd, iov, iovcnt, offset, "enc_untrusted_pwritev");
+}
+
+ssize_t enc_untrusted_preadv(int fd, const struct iovec *iov, int iovcnt,
+                             off_t offset) {
+  if (offset < 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  return UntrustedReadv(fd, iov, iovcnt, offset, "enc_untrusted_preadv");
+}
+
 int enc_untrusted_getsockname(int sockfd, struct sockaddr *addr,
                               socklen_t *addrlen) {
   if (!addr || !addrlen) {
@@ -1004,10 +1140,8 @@ int enc_untrusted_getsockname(int sockfd, struct sockaddr *addr,
   }
 
   auto klinux_sockaddr_buf = output.next();
-  const struct klinux_sockaddr *klinux_addr =
-      klinux_sockaddr_buf.As<struct klinux_sockaddr>();
-  if (!FromkLinuxSockAddr(klinux_addr, klinux_sockaddr_buf.size(), addr,
-                          addrlen, TrustedPrimitives::BestEffortAbort)) {
+  if (!FromkLinuxSockAddrExtent(klinux_sockaddr_buf, addr, addrlen,
+                                TrustedPrimitives::BestEffortAbort)) {
     errno = EFAULT;
     return -1;
   }
@@ -1034,10 +1168,8 @@ int enc_untrusted_accept(int sockfd, struct sockaddr *addr,
   }
 
   auto klinux_sockaddr_buf = output.next();
-  const struct klinux_sockaddr *klinux_addr =
-      klinux_sockaddr_buf.As<struct klinux_sockaddr>();
-  FromkLinuxSockAddr(klinux_addr, klinux_sockaddr_buf.size(), addr, addrlen,
-                     TrustedPrimitives::BestEffortAbort);
+  FromkLinuxSockAddrExtent(klinux_sockaddr_buf, addr, addrlen,
+                           TrustedPrimitives::BestEffortAbort);
   return result;
 }
 
@@ -1070,10 +1202,8 @@ int enc_untrusted_getpeername(int sockfd, struct sockaddr *addr,
   }
 
   auto klinux_sockaddr_buf = output.next();
-  const struct klinux_sockaddr *klinux_addr =
-      klinux_sockaddr_buf.As<struct klinux_sockaddr>();
-  FromkLinuxSockAddr(klinux_addr, klinux_sockaddr_buf.size(), addr, addrlen,
-                     TrustedPrimitives::BestEffortAbort);
+  FromkLinuxSockAddrExtent(klinux_sockaddr_buf, addr, addrlen,
+                           TrustedPrimitives::BestEffortAbort);
   return result;
 }
 
@@ -1116,10 +1246,8 @@ ssize_t enc_untrusted_recvfrom(int sockfd, void *buf, size_t len, int flags,
   // is filled in; in this case, |addrlen| is not used, and should also be NULL.
   if (src_addr != nullptr && addrlen != nullptr) {
     auto klinux_sockaddr_buf = output.next();
-    const struct klinux_sockaddr *klinux_addr =
-        klinux_sockaddr_buf.As<struct klinux_sockaddr>();
-    FromkLinuxSockAddr(klinux_addr, klinux_sockaddr_buf.size(), src_addr,
-                       addrlen, TrustedPrimitives::BestEffortAbort);
+    FromkLinuxSockAddrExtent(klinux_sockaddr_buf, src_addr, addrlen,
+                             TrustedPrimitives::BestEffortAbort);
   }
 
   return result;
@@ -1630,6 +1758,85 @@ int enc_untrusted_epoll_wait(int epfd, struct epoll_event *events,
   return result;
 }
 
+int enc_untrusted_epoll_poller_start(int epfd, uint64_t *poller,
+                                     asylo::EpollReadinessRing **ring) {
+  MessageWriter input;
+  input.Push(epfd);
+  MessageReader output;
+  const auto status = NonSystemCallDispatcher(
+      ::asylo::host_call::kEpollPollerStartHandler, &input, &output);
+  CheckStatusAndParamCount(status, output, "enc_untrusted_epoll_poller_start",
+                           3);
+
+  uint64_t poller_handle = output.next<uint64_t>();
+  auto *poller_ring =
+      reinterpret_cast<asylo::EpollReadinessRing *>(output.next<uint64_t>());
+  int klinux_errno = output.next<int>();
+  if (poller_handle == 0) {
+    errno = FromkLinuxErrno(klinux_errno);
+    return -1;
+  }
+  if (!TrustedPrimitives::IsOutsideEnclave(poller_ring,
+                                           sizeof(*poller_ring)) ||
+      poller_ring->InstanceVersion() !=
+          asylo::EpollReadinessRing::TypeVersion()) {
+    TrustedPrimitives::BestEffortAbort(
+        "enc_untrusted_epoll_poller_start: ring should be a compatible object "
+        "in untrusted memory.");
+  }
+  *poller = poller_handle;
+  *ring = poller_ring;
+  return 0;
+}
+
+void enc_untrusted_epoll_poller_stop(uint64_t poller) {
+  MessageWriter input;
+  input.Push(poller);
+  MessageReader output;
+  const auto status = NonSystemCallDispatcher(
+      ::asylo::host_call::kEpollPollerStopHandler, &input, &output);
+  CheckStatusAndParamCount(status, output, "enc_untrusted_epoll_poller_stop",
+                           0);
+}
+
+int enc_untrusted_epoll_poller_wait(uint64_t poller, int64_t timeout_microsec) {
+  MessageWriter input;
+  input.Push(poller);
+  input.Push(timeout_microsec);
+  MessageReader output;
+  const auto status = NonSystemCallDispatcher(
+      ::asylo::host_call::kEpollPollerWaitHandler, &input, &output);
+  CheckStatusAndParamCount(status, output, "enc_untrusted_epoll_poller_wait",
+                           2);
+
+  int result = output.next<int>();
+  int klinux_errno = output.next<int>();
+  if (result == -1) {
+    errno = FromkLinuxErrno(klinux_errno);
+  }
+  return result;
+}
+
+int enc_epoll_readiness_consume(asylo::EpollReadinessRing *ring,
+                                struct epoll_event *events, int maxevents) {
+  asylo::EpollReadinessRing::Event
+      ring_events[asylo::EpollReadinessRing::kCapacity];
+  int count = ring->Consume(
+      ring_events, std::min(maxevents, asylo::EpollReadinessRing::kCapacity));
+  // The events have been taken from the ring, so an event which cannot be
+  // converted is dropped rather than failing the whole batch.
+  int converted = 0;
+  for (int i = 0; i < count; ++i) {
+    struct klinux_epoll_event klinux_event;
+    klinux_event.events = ring_events[i].events;
+    klinux_event.data.u64 = ring_events[i].data;
+    if (FromkLinuxEpollEvent(&klinux_event, &events[converted])) {
+      ++converted;
+    }
+  }
+  return converted;
+}
+
 int enc_untrusted_getifaddrs(struct ifaddrs **ifap) {
   MessageWriter input;
   MessageReader output;
@@ -31,6 +31,7 @@
 #include <sched.h>
 #include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #include <cstdarg>
 #include <cstddef>
@@ -80,6 +81,11 @@ int64_t EnsureInitializedAndDispatchSyscall(
   if (!enc_is_syscall_dispatcher_set()) {
     enc_set_dispatch_syscall(asylo::host_call::SystemCallDispatcher);
   }
+  if (!enc_is_syscall_bulk_allocator_set()) {
+    enc_set_syscall_bulk_allocator(
+        asylo::primitives::TrustedPrimitives::UntrustedLocalAlloc,
+        asylo::primitives::TrustedPrimitives::UntrustedLocalFree);
+  }
   if (!enc_is_error_handler_set()) {
     enc_set_error_handler(
         asylo::primitives::TrustedPrimitives::BestEffortAbort);
@@ -87,6 +93,24 @@ int64_t EnsureInitializedAndDispatchSyscall(
   return enc_untrusted_syscall(sysno, args...);
 }
 
+// Ensures that the host call library is initialized, then submits the system
+// calls queued on |batch| to the host in a single exit.
+inline void EnsureInitializedAndSubmitSyscallBatch(
+    asylo::system_call::SystemCallBatch *batch) {
+  if (!enc_is_syscall_dispatcher_set()) {
+    enc_set_dispatch_syscall(asylo::host_call::SystemCallDispatcher);
+  }
+  if (!enc_is_syscall_batch_dispatcher_set()) {
+    enc_set_dispatch_syscall_batch(
+        asylo::host_call::SystemCallBatchDispatcher);
+  }
+  if (!enc_is_error_handler_set()) {
+    enc_set_error_handler(
+        asylo::primitives::TrustedPrimitives::BestEffortAbort);
+  }
+  batch->Submit();
+}
+
 // Verifies the return status of the host call and checks if the expected number
 // of parameters are received on the MessageReader.
 void CheckStatusAndParamCount(const asylo::primitives::PrimitiveStatus &status,
@@ -94,6 +118,12 @@ void CheckStatusAndParamCount(const asylo::primitives::PrimitiveStatus &status,
                               const char *name, int expected_params,
                               bool match_exact_params = true);
 
+namespace asylo {
+
+class EpollReadinessRing;
+
+}  // namespace asylo
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -201,6 +231,12 @@ void *enc_untrusted_realloc(void *ptr, size_t size);
 uint32_t enc_untrusted_sleep(uint32_t seconds);
 ssize_t enc_untrusted_sendmsg(int sockfd, const struct msghdr *msg, int flags);
 ssize_t enc_untrusted_recvmsg(int sockfd, struct msghdr *msg, int flags);
+ssize_t enc_untrusted_writev(int fd, const struct iovec *iov, int iovcnt);
+ssize_t enc_untrusted_readv(int fd, const struct iovec *iov, int iovcnt);
+ssize_t enc_untrusted_pwritev(int fd, const struct iovec *iov, int iovcnt,
+                              off_t offset);
+ssize_t enc_untrusted_preadv(int fd, const struct iovec *iov, int iovcnt,
+                             off_t offset);
 int enc_untrusted_getsockname(int sockfd, struct sockaddr *addr,
                               socklen_t *addrlen);
 int enc_untrusted_accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen);
@@ -240,11 +276,32 @@ int enc_untrusted_sys_futex_wait(int32_t *futex, int32_t expected,
                                  int64_t timeout_microsec);
 int enc_untrusted_sys_futex_wake(int32_t *futex, int32_t num);
 
+// Starts an untrusted thread polling the host epoll instance |epfd| and
+// publishing its ready events into an EpollReadinessRing in untrusted memory.
+// On success stores a handle to the poller in |*poller| and the ring in |*ring|
+// and returns 0. Returns -1 and sets errno otherwise.
+int enc_untrusted_epoll_poller_start(int epfd, uint64_t *poller,
+                                     asylo::EpollReadinessRing **ring);
+
+// Stops |poller| and frees its ring. |poller| must not be used afterwards.
+void enc_untrusted_epoll_poller_stop(uint64_t poller);
+
+// Blocks until the ring of |poller| holds ready events, the poller fails, or
+// |timeout_microsec| elapse. A negative timeout waits indefinitely. Returns 0
+// on a wakeup, or -1 with errno set to ETIMEDOUT on a timeout.
+int enc_untrusted_epoll_poller_wait(uint64_t poller, int64_t timeout_microsec);
+
 // Calls that are not delegated to the host or depend on other host calls are
 // defined below.
 void enc_freeaddrinfo(struct addrinfo *res);
 void enc_freeifaddrs(struct ifaddrs *ifa);
 
+// Takes up to |maxevents| ready events published in |ring| by an untrusted
+// epoll poller, without exiting the enclave. Returns the number of events
+// taken. Events the host reported with invalid flags are dropped.
+int enc_epoll_readiness_consume(asylo::EpollReadinessRing *ring,
+                                struct epoll_event *events, int maxevents);
+
 // Returns a new, empty wait queue. The queue will reside in untrusted memory.
 // The queue will have waiting disabled when it’s created.
 int32_t *enc_untrusted_create_wait_queue();
@@ -0,0 +1,191 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/platform/host_call/untrusted/epoll_poller.h"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "asylo/platform/common/futex.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/posix_errors.h"
+
+namespace asylo {
+namespace host_call {
+namespace {
+
+// Bounds of the interval at which a poller holding a published batch checks
+// whether the enclave has taken it, in microseconds. The interval doubles at
+// every check until the batch is taken.
+constexpr int64_t kMinBackoffMicroseconds = 10;
+constexpr int64_t kMaxBackoffMicroseconds = 1000;
+
+}  // namespace
+
+StatusOr<std::unique_ptr<EpollPoller>> EpollPoller::Create(int epfd) {
+  auto poller = absl::WrapUnique(new EpollPoller(epfd));
+  if (!poller->ring_) {
+    return absl::ResourceExhaustedError(
+        "Failed to allocate epoll readiness ring");
+  }
+
+  poller->stop_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (poller->stop_fd_ == -1) {
+    return LastPosixError("Failed to create the poller eventfd");
+  }
+  struct epoll_event event {};
+  event.events = EPOLLIN;
+  event.data.u64 = reinterpret_cast<uintptr_t>(poller.get());
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, poller->stop_fd_, &event) == -1) {
+    Status status = LastPosixError("Failed to register the poller eventfd");
+    close(poller->stop_fd_);
+    poller->stop_fd_ = -1;
+    return status;
+  }
+
+  EpollPoller *raw_poller = poller.get();
+  poller->poller_ = absl::make_unique<Thread>([raw_poller] {
+    raw_poller->PollLoop();
+  });
+  return std::move(poller);
+}
+
+EpollPoller::EpollPoller(int epfd)
+    : epfd_(epfd),
+      stop_fd_(-1),
+      ring_(nullptr),
+      poller_wake_sequence_(0),
+      stopping_(false) {
+  void *memory = mmap(/*addr=*/nullptr, sizeof(EpollReadinessRing),
+                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      /*fd=*/-1, /*offset=*/0);
+  if (memory == MAP_FAILED) {
+    return;
+  }
+  ring_ = new (memory) EpollReadinessRing();
+}
+
+EpollPoller::~EpollPoller() {
+  stopping_ = true;
+  if (stop_fd_ != -1) {
+    uint64_t value = 1;
+    if (write(stop_fd_, &value, sizeof(value)) != sizeof(value)) {
+      LOG(ERROR) << "Failed to interrupt epoll poller: " << strerror(errno);
+    }
+  }
+  WakePoller();
+  if (poller_) {
+    poller_->Join();
+  }
+  if (stop_fd_ != -1) {
+    // The epoll instance may already be closed, in which case the eventfd is
+    // deregistered by closing it.
+    epoll_ctl(epfd_, EPOLL_CTL_DEL, stop_fd_, /*event=*/nullptr);
+    close(stop_fd_);
+  }
+  if (ring_) {
+    ring_->Fail();
+    WakeWaiters();
+    ring_->~EpollReadinessRing();
+    munmap(ring_, sizeof(EpollReadinessRing));
+  }
+}
+
+int EpollPoller::Wait(int64_t timeout_microseconds) {
+  // The poller may be backing off on a batch which has been taken since.
+  WakePoller();
+  if (timeout_microseconds == 0 ||
+      ring_->state() != EpollReadinessRing::kArmed) {
+    return 0;
+  }
+  // sys_futex_wait() waits indefinitely on a zero timeout.
+  return sys_futex_wait(ring_->state_word(), EpollReadinessRing::kArmed,
+                        std::max<int64_t>(timeout_microseconds, 0));
+}
+
+void EpollPoller::PollLoop() {
+  const uint64_t stop_key = reinterpret_cast<uintptr_t>(this);
+  struct epoll_event events[EpollReadinessRing::kCapacity];
+  EpollReadinessRing::Event batch[EpollReadinessRing::kCapacity];
+  int64_t backoff_microseconds = kMinBackoffMicroseconds;
+  while (!stopping_.load(std::memory_order_relaxed)) {
+    int32_t state = ring_->state();
+    if (state == EpollReadinessRing::kPublished) {
+      int32_t sequence = poller_wake_sequence_.load();
+      if (ring_->state() == EpollReadinessRing::kPublished) {
+        sys_futex_wait(reinterpret_cast<int32_t *>(&poller_wake_sequence_),
+                       sequence, backoff_microseconds);
+      }
+      backoff_microseconds =
+          std::min(2 * backoff_microseconds, kMaxBackoffMicroseconds);
+      continue;
+    }
+    if (state != EpollReadinessRing::kArmed) {
+      return;
+    }
+    backoff_microseconds = kMinBackoffMicroseconds;
+
+    int count = epoll_wait(epfd_, events, EpollReadinessRing::kCapacity,
+                           /*timeout=*/-1);
+    if (count == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ring_->Fail();
+      WakeWaiters();
+      return;
+    }
+    int published = 0;
+    for (int i = 0; i < count; ++i) {
+      if (events[i].data.u64 == stop_key) {
+        continue;
+      }
+      batch[published].events = events[i].events;
+      batch[published].data = events[i].data.u64;
+      ++published;
+    }
+    if (ring_->Publish(batch, published)) {
+      WakeWaiters();
+    }
+  }
+}
+
+void EpollPoller::WakeWaiters() {
+  sys_futex_wake(ring_->state_word(), INT_MAX);
+}
+
+void EpollPoller::WakePoller() {
+  poller_wake_sequence_.fetch_add(1);
+  sys_futex_wake(reinterpret_cast<int32_t *>(&poller_wake_sequence_), 1);
+}
+
+}  // namespace host_call
+}  // namespace asylo
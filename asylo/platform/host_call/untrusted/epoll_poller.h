@@ -0,0 +1,97 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_PLATFORM_HOST_CALL_UNTRUSTED_EPOLL_POLLER_H_
+#define ASYLO_PLATFORM_HOST_CALL_UNTRUSTED_EPOLL_POLLER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "asylo/platform/common/epoll_readiness_ring.h"
+#include "asylo/util/statusor.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+namespace host_call {
+
+// An untrusted thread waiting for events on a host epoll instance and
+// publishing them into an EpollReadinessRing shared with an enclave, so that
+// the enclave can take ready events without an exit call.
+//
+// The poller only waits for new events while the ring is armed. Once it has
+// published a batch, it backs off until the enclave takes the last event of the
+// batch, or until an enclave thread calls Wait().
+class EpollPoller {
+ public:
+  // Allocates a ring and starts polling |epfd|. Registers an internal eventfd
+  // with |epfd|, used to stop the poller; its events are never published.
+  static StatusOr<std::unique_ptr<EpollPoller>> Create(int epfd);
+
+  EpollPoller(const EpollPoller &) = delete;
+  EpollPoller &operator=(const EpollPoller &) = delete;
+
+  // Stops the polling thread, deregisters the internal eventfd and frees the
+  // ring.
+  ~EpollPoller();
+
+  // Returns the ring the poller publishes into. Allocated with page alignment.
+  EpollReadinessRing *ring() const { return ring_; }
+
+  // Blocks until the ring holds a published batch, the poller fails, or
+  // |timeout_microseconds| elapse. A negative timeout waits indefinitely.
+  // Returns 0 on a wakeup and -1 with errno set otherwise, as
+  // sys_futex_wait() does.
+  int Wait(int64_t timeout_microseconds);
+
+ private:
+  explicit EpollPoller(int epfd);
+
+  // Main loop of the polling thread.
+  void PollLoop();
+
+  // Wakes every thread blocked on the state of the ring.
+  void WakeWaiters();
+
+  // Wakes the polling thread if it is backing off.
+  void WakePoller();
+
+  // The host epoll instance being polled.
+  const int epfd_;
+
+  // Eventfd registered with |epfd_| to interrupt a blocked epoll_wait().
+  int stop_fd_;
+
+  EpollReadinessRing *ring_;
+
+  // Futex word bumped to wake the polling thread while it backs off. Kept
+  // apart from the state of the ring so that waking the poller does not wake
+  // enclave threads blocked in Wait().
+  std::atomic<int32_t> poller_wake_sequence_;
+
+  // Set to request the polling thread to exit.
+  std::atomic<bool> stopping_;
+
+  std::unique_ptr<Thread> poller_;
+};
+
+}  // namespace host_call
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_HOST_CALL_UNTRUSTED_EPOLL_POLLER_H_
@@ -0,0 +1,121 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/platform/host_call/untrusted/epoll_poller.h"
+
+#include <errno.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <memory>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/platform/common/epoll_readiness_ring.h"
+#include "asylo/test/util/status_matchers.h"
+
+namespace asylo {
+namespace host_call {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ne;
+using ::testing::Not;
+
+constexpr int64_t kLongTimeoutMicroseconds = 10 * 1000 * 1000;
+
+class EpollPollerTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    ASSERT_THAT(epfd_, Ne(-1));
+    ASSERT_THAT(pipe(pipe_fds_), Eq(0));
+    struct epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.u64 = kPipeData;
+    ASSERT_THAT(epoll_ctl(epfd_, EPOLL_CTL_ADD, pipe_fds_[0], &event), Eq(0));
+  }
+
+  void TearDown() override {
+    close(pipe_fds_[0]);
+    close(pipe_fds_[1]);
+    close(epfd_);
+  }
+
+  // Waits until the poller publishes a batch and takes its first event.
+  EpollReadinessRing::Event TakeEvent(EpollPoller *poller) {
+    EpollReadinessRing::Event event{};
+    while (poller->ring()->Consume(&event, 1) == 0) {
+      EXPECT_THAT(poller->Wait(kLongTimeoutMicroseconds), Eq(0));
+    }
+    return event;
+  }
+
+  static constexpr uint64_t kPipeData = 42;
+  int epfd_;
+  int pipe_fds_[2];
+};
+
+TEST_F(EpollPollerTest, PublishesReadyEvents) {
+  auto poller_result = EpollPoller::Create(epfd_);
+  ASSERT_THAT(poller_result, IsOk());
+  std::unique_ptr<EpollPoller> poller = std::move(poller_result).value();
+  EXPECT_THAT(poller->ring()->InstanceVersion(),
+              Eq(EpollReadinessRing::TypeVersion()));
+
+  ASSERT_THAT(write(pipe_fds_[1], "a", 1), Eq(1));
+  EpollReadinessRing::Event event = TakeEvent(poller.get());
+  EXPECT_THAT(event.data, Eq(kPipeData));
+  EXPECT_THAT(event.events & EPOLLIN, Ne(0));
+
+  // The pipe is level-triggered, so it is reported again until it is drained.
+  event = TakeEvent(poller.get());
+  EXPECT_THAT(event.data, Eq(kPipeData));
+}
+
+TEST_F(EpollPollerTest, WaitTimesOutWithoutEvents) {
+  auto poller_result = EpollPoller::Create(epfd_);
+  ASSERT_THAT(poller_result, IsOk());
+  std::unique_ptr<EpollPoller> poller = std::move(poller_result).value();
+
+  EXPECT_THAT(poller->Wait(/*timeout_microseconds=*/1000), Eq(-1));
+  EXPECT_THAT(errno, Eq(ETIMEDOUT));
+  EXPECT_THAT(poller->ring()->state(), Eq(EpollReadinessRing::kArmed));
+}
+
+// Ensure a poller blocked in epoll_wait() with nothing ready can be destroyed.
+TEST_F(EpollPollerTest, DestroyInterruptsBlockedPoller) {
+  auto poller_result = EpollPoller::Create(epfd_);
+  ASSERT_THAT(poller_result, IsOk());
+  std::unique_ptr<EpollPoller> poller = std::move(poller_result).value();
+  usleep(1000);
+  poller.reset();
+
+  // The internal eventfd must have been deregistered.
+  struct epoll_event event;
+  EXPECT_THAT(epoll_wait(epfd_, &event, 1, /*timeout=*/0), Eq(0));
+}
+
+TEST_F(EpollPollerTest, FailsOnInvalidEpollFd) {
+  EXPECT_THAT(EpollPoller::Create(/*epfd=*/-1), Not(IsOk()));
+}
+
+}  // namespace
+}  // namespace host_call
+}  // namespace asylo
@@ -26,15 +26,20 @@
 #include <pwd.h>
 #include <signal.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <syslog.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <cstdint>
 #include <ctime>
+#include <memory>
+#include <vector>
 
 #include "absl/status/status.h"
 #include "asylo/platform/common/memory.h"
 #include "asylo/platform/host_call/serializer_functions.h"
+#include "asylo/platform/host_call/untrusted/epoll_poller.h"
 #include "asylo/platform/host_call/untrusted/host_call_handlers_util.h"
 #include "asylo/platform/primitives/util/message.h"
 #include "asylo/platform/primitives/util/status_conversions.h"
@@ -73,6 +78,26 @@ Status SystemCallHandler(const std::shared_ptr<primitives::Client> &client,
   return absl::OkStatus();
 }
 
+Status SystemCallBatchHandler(const std::shared_ptr<primitives::Client> &client,
+                              void *context, primitives::MessageReader *input,
+                              primitives::MessageWriter *output) {
+  ASYLO_RETURN_IF_TOO_FEW_READER_ARGUMENTS(*input, 1);
+  while (input->hasNext()) {
+    auto request = input->next();
+
+    Extent response;  // To be owned by untrusted call parameters.
+    primitives::PrimitiveStatus status =
+        system_call::UntrustedInvoke(request, &response);
+    if (!status.ok()) {
+      return primitives::MakeStatus(status);
+    }
+    output->PushByCopy(response);
+    free(response.data());
+  }
+
+  return absl::OkStatus();
+}
+
 Status IsAttyHandler(const std::shared_ptr<primitives::Client> &client,
                      void *context, primitives::MessageReader *input,
                      primitives::MessageWriter *output) {
@@ -217,6 +242,67 @@ Status RecvMsgHandler(const std::shared_ptr<primitives::Client> &client,
   return absl::OkStatus();
 }
 
+Status WritevHandler(const std::shared_ptr<primitives::Client> &client,
+                     void *context, primitives::MessageReader *input,
+                     primitives::MessageWriter *output) {
+  if (input->size() < 2) {
+    return absl::InvalidArgumentError(
+        "Expected at least 2 arguments on the MessageReader");
+  }
+  int fd = input->next<int>();
+  int64_t offset = input->next<int64_t>();
+
+  // Point the iovecs at the buffers in the message instead of copying them.
+  std::vector<struct iovec> iov(input->size() - 2);
+  for (auto &buffer : iov) {
+    auto extent = input->next();
+    buffer.iov_base = extent.As<char>();
+    buffer.iov_len = extent.size();
+  }
+
+  ssize_t result = offset == -1
+                       ? writev(fd, iov.data(), iov.size())
+                       : pwritev(fd, iov.data(), iov.size(), offset);
+  output->Push<int64_t>(result);  // Push return value.
+  output->Push<int>(errno);       // Push errno.
+  return absl::OkStatus();
+}
+
+Status ReadvHandler(const std::shared_ptr<primitives::Client> &client,
+                    void *context, primitives::MessageReader *input,
+                    primitives::MessageWriter *output) {
+  if (input->size() < 2) {
+    return absl::InvalidArgumentError(
+        "Expected at least 2 arguments on the MessageReader");
+  }
+  int fd = input->next<int>();
+  int64_t offset = input->next<int64_t>();
+
+  // Read into a single buffer split along the requested lengths, so that the
+  // data read can be returned as one extent.
+  std::vector<struct iovec> iov(input->size() - 2);
+  size_t total_length = 0;
+  for (auto &buffer : iov) {
+    buffer.iov_len = input->next<uint64_t>();
+    total_length += buffer.iov_len;
+  }
+  std::unique_ptr<char[]> data(new char[total_length]);
+  char *position = data.get();
+  for (auto &buffer : iov) {
+    buffer.iov_base = position;
+    position += buffer.iov_len;
+  }
+
+  ssize_t result = offset == -1
+                       ? readv(fd, iov.data(), iov.size())
+                       : preadv(fd, iov.data(), iov.size(), offset);
+  output->Push<int64_t>(result);  // Push return value.
+  output->Push<int>(errno);       // Push errno.
+  output->PushByCopy(
+      Extent{data.get(), static_cast<size_t>(std::max<ssize_t>(result, 0))});
+  return absl::OkStatus();
+}
+
 Status GetSocknameHandler(const std::shared_ptr<primitives::Client> &client,
                           void *context, primitives::MessageReader *input,
                           primitives::MessageWriter *output) {
@@ -579,6 +665,46 @@ Status SysFutexWakeHandler(const std::shared_ptr<primitives::Client> &client,
   return SysFutexWakeHelper(input, output);
 }
 
+Status EpollPollerStartHandler(
+    const std::shared_ptr<primitives::Client> &client, void *context,
+    primitives::MessageReader *input, primitives::MessageWriter *output) {
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*input, 1);
+  int epfd = input->next<int>();
+  auto poller_result = EpollPoller::Create(epfd);
+  if (!poller_result.ok()) {
+    output->Push<uint64_t>(0);
+    output->Push<uint64_t>(0);
+    output->Push<int>(errno);
+    return absl::OkStatus();
+  }
+  // The poller is owned by the enclave until it is passed back to
+  // EpollPollerStopHandler.
+  EpollPoller *poller = std::move(poller_result).value().release();
+  output->Push<uint64_t>(reinterpret_cast<uint64_t>(poller));
+  output->Push<uint64_t>(reinterpret_cast<uint64_t>(poller->ring()));
+  output->Push<int>(0);
+  return absl::OkStatus();
+}
+
+Status EpollPollerStopHandler(const std::shared_ptr<primitives::Client> &client,
+                              void *context, primitives::MessageReader *input,
+                              primitives::MessageWriter *output) {
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*input, 1);
+  delete reinterpret_cast<EpollPoller *>(input->next<uint64_t>());
+  return absl::OkStatus();
+}
+
+Status EpollPollerWaitHandler(const std::shared_ptr<primitives::Client> &client,
+                              void *context, primitives::MessageReader *input,
+                              primitives::MessageWriter *output) {
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*input, 2);
+  auto *poller = reinterpret_cast<EpollPoller *>(input->next<uint64_t>());
+  int64_t timeout_microsec = input->next<int64_t>();
+  output->Push<int>(poller->Wait(timeout_microsec));
+  output->Push<int>(errno);
+  return absl::OkStatus();
+}
+
 Status LocalLifetimeAllocHandler(
     const std::shared_ptr<primitives::Client> &client, void *context,
     primitives::MessageReader *input, primitives::MessageWriter *output) {
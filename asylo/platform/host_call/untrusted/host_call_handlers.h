@@ -37,6 +37,15 @@ Status SystemCallHandler(const std::shared_ptr<primitives::Client> &client,
                          void *context, primitives::MessageReader *input,
                          primitives::MessageWriter *output);
 
+// Host call handler servicing a batch of system calls in a single exit. It
+// receives a MessageReader containing one or more serialized system call
+// requests, executes them in order and writes back one serialized response per
+// request on the output MessageWriter. Returns ok status on success, otherwise
+// an error message if a serialization error has occurred for any request.
+Status SystemCallBatchHandler(const std::shared_ptr<primitives::Client> &client,
+                              void *context, primitives::MessageReader *input,
+                              primitives::MessageWriter *output);
+
 // isatty library call handler on the host; expects [int fd] and returns [int].
 Status IsAttyHandler(const std::shared_ptr<primitives::Client> &client,
                      void *context, primitives::MessageReader *input,
@@ -78,6 +87,22 @@ Status RecvMsgHandler(const std::shared_ptr<primitives::Client> &client,
                       void *context, primitives::MessageReader *input,
                       primitives::MessageWriter *output);
 
+// writev and pwritev syscall handler on the host; expects [int fd, int64_t
+// offset, Extent buffers...] and returns [ssize_t /*result*/, int /*errno*/] on
+// the MessageWriter. An |offset| of -1 writes at the file offset, as writev
+// does.
+Status WritevHandler(const std::shared_ptr<primitives::Client> &client,
+                     void *context, primitives::MessageReader *input,
+                     primitives::MessageWriter *output);
+
+// readv and preadv syscall handler on the host; expects [int fd, int64_t
+// offset, uint64_t buffer_lengths...] and returns [ssize_t /*result*/, int
+// /*errno*/, Extent /*data read*/] on the MessageWriter. An |offset| of -1
+// reads at the file offset, as readv does.
+Status ReadvHandler(const std::shared_ptr<primitives::Client> &client,
+                    void *context, primitives::MessageReader *input,
+                    primitives::MessageWriter *output);
+
 // getsockname syscall handler on the host; expects [int sockfd] and returns
 // [int /*result*/, int /*errno*/, sockaddr] on the MessageWriter.
 Status GetSocknameHandler(const std::shared_ptr<primitives::Client> &client,
@@ -229,6 +254,26 @@ Status SysFutexWakeHandler(const std::shared_ptr<primitives::Client> &client,
                            void *context, primitives::MessageReader *input,
                            primitives::MessageWriter *output);
 
+// Handler for host call enc_untrusted_epoll_poller_start(). Expects [int epfd]
+// and returns [uint64_t /*poller*/, uint64_t /*ring*/, int /*errno*/] on the
+// MessageWriter. |poller| and |ring| are zero on failure.
+Status EpollPollerStartHandler(
+    const std::shared_ptr<primitives::Client> &client, void *context,
+    primitives::MessageReader *input, primitives::MessageWriter *output);
+
+// Handler for host call enc_untrusted_epoll_poller_stop(). Expects [uint64_t
+// poller] and returns nothing on the MessageWriter.
+Status EpollPollerStopHandler(const std::shared_ptr<primitives::Client> &client,
+                              void *context, primitives::MessageReader *input,
+                              primitives::MessageWriter *output);
+
+// Handler for host call enc_untrusted_epoll_poller_wait(). Expects [uint64_t
+// poller, int64_t timeout_microsec] and returns [int result, int errno] on the
+// MessageWriter.
+Status EpollPollerWaitHandler(const std::shared_ptr<primitives::Client> &client,
+                              void *context, primitives::MessageReader *input,
+                              primitives::MessageWriter *output);
+
 // Handler for host call helper LocalLifetimeAlloc. Expects [size_t
 // bytes] and returns [uintptr_t result, int errno] on the
 // MessageWriter.
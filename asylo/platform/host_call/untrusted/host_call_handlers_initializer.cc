@@ -32,6 +32,10 @@ Status AddHostCallHandlersToExitCallProvider(
   ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
       kSystemCallHandler, primitives::ExitHandler{SystemCallHandler}));
 
+  ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
+      kSystemCallBatchHandler,
+      primitives::ExitHandler{SystemCallBatchHandler}));
+
   ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
       kIsAttyHandler, primitives::ExitHandler{IsAttyHandler}));
 
@@ -53,6 +57,12 @@ Status AddHostCallHandlersToExitCallProvider(
   ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
       kRecvMsgHandler, primitives::ExitHandler{RecvMsgHandler}));
 
+  ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
+      kWritevHandler, primitives::ExitHandler{WritevHandler}));
+
+  ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
+      kReadvHandler, primitives::ExitHandler{ReadvHandler}));
+
   ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
       kGetSocknameHandler, primitives::ExitHandler{GetSocknameHandler}));
 
@@ -116,6 +126,16 @@ Status AddHostCallHandlersToExitCallProvider(
   ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
       kSysFutexWakeHandler, primitives::ExitHandler{SysFutexWakeHandler}));
 
+  ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
+      kEpollPollerStartHandler,
+      primitives::ExitHandler{EpollPollerStartHandler}));
+
+  ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
+      kEpollPollerStopHandler, primitives::ExitHandler{EpollPollerStopHandler}));
+
+  ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
+      kEpollPollerWaitHandler, primitives::ExitHandler{EpollPollerWaitHandler}));
+
   ASYLO_RETURN_IF_ERROR(exit_call_provider->RegisterExitHandler(
       kLocalLifetimeAllocHandler,
       primitives::ExitHandler{LocalLifetimeAllocHandler}));
@@ -135,6 +135,36 @@ TEST(HostCallHandlersTest, SyscallHandlerInvalidRequestTest) {
   EXPECT_THAT(output, IsEmpty());
 }
 
+TEST(HostCallHandlersTest, SyscallBatchHandlerEmptyMessageTest) {
+  MessageReader empty_input;
+  MessageWriter empty_output;
+  EXPECT_THAT(
+      SystemCallBatchHandler(nullptr, nullptr, &empty_input, &empty_output),
+      StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+// Invokes a batch of host calls for valid serialized requests and verifies that
+// one response is produced per request.
+TEST(HostCallHandlersTest, SyscallBatchHandlerValidRequestsTest) {
+  std::array<uint64_t, system_call::kParameterMax> request_params;
+  MessageReader input;
+  FillInput(
+      [&request_params](MessageWriter *params) {
+        for (int i = 0; i < 3; i++) {
+          primitives::Extent request;  // To be allocated by Serialize.
+          ASYLO_ASSERT_OK(primitives::MakeStatus(system_call::SerializeRequest(
+              SYS_getpid, request_params, &request)));
+          params->PushByCopy(request);
+          free(request.data());
+        }
+      },
+      &input);
+  MessageWriter output;
+  ASSERT_THAT(SystemCallBatchHandler(nullptr, nullptr, &input, &output),
+              StatusIs(absl::StatusCode::kOk));
+  EXPECT_THAT(output, SizeIs(3));  // Contains one response per request.
+}
+
 // Invokes an IsAtty hostcall for an invalid request. It tests that the correct
 // error is returned for an empty input or for an input with more than one item.
 TEST(HostCallHandlersTest, IsAttyIncorrectSizeTest) {
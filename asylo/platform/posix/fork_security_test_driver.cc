@@ -422,5 +422,64 @@ TEST_F(ForkSecurityTest, RestoreWithModifyHeap) {
   }
 }
 
+// Tests that restoring the enclave from a snapshot missing a heap chunk returns
+// error.
+TEST_F(ForkSecurityTest, RestoreWithDroppedHeapChunk) {
+  Status status = LoadEnclaveAndTakeSnapshot("Restore with dropped heap chunk",
+                                             /*request_fork=*/true);
+  if (status.ok()) {
+    // SGX hardware mode. Drop the last chunk of the heap from the snapshot. Its
+    // memory is still released by |snapshot_deleter_|.
+    ASSERT_GT(snapshot_layout_.heap_size(), 0);
+    snapshot_layout_.mutable_heap()->RemoveLast();
+    // Restoring from a truncated heap should cause the enclave to return an
+    // error.
+    ASSERT_THAT(primitive_client_->EnterAndRestore(snapshot_layout_),
+                Not(IsOk()));
+    // If restore fails, no further entries should be allowed.
+    EnclaveInput input;
+    input.MutableExtension(fork_security_test_input)
+        ->set_thread_type(ForkSecurityTestInput::SETREQUEST);
+    input.MutableExtension(fork_security_test_input)->set_request_fork(false);
+    EXPECT_THAT(client_->EnterAndRun(input, /*output=*/nullptr), Not(IsOk()));
+    enclave_finalized_ = true;
+  } else {
+    // No need to do security test for non-hardware mode. Snapshotting/restoring
+    // are not supported.
+    EXPECT_THAT(status,
+                StatusIs(absl::StatusCode::kUnavailable,
+                         "Secure fork not supported in non SGX hardware mode"));
+  }
+}
+
+// Tests that restoring the enclave with the heap extent modified returns
+// error, since the heap extent is authenticated with every snapshot chunk.
+TEST_F(ForkSecurityTest, RestoreWithModifyHeapExtent) {
+  Status status = LoadEnclaveAndTakeSnapshot("Restore with modified extent",
+                                             /*request_fork=*/true);
+  if (status.ok()) {
+    // SGX hardware mode. Shrink the heap extent recorded in the snapshot.
+    ASSERT_GT(snapshot_layout_.heap_extent(), 0);
+    snapshot_layout_.set_heap_extent(snapshot_layout_.heap_extent() - 1);
+    // Restoring with a modified heap extent should cause the enclave to return
+    // an error.
+    ASSERT_THAT(primitive_client_->EnterAndRestore(snapshot_layout_),
+                Not(IsOk()));
+    // If restore fails, no further entries should be allowed.
+    EnclaveInput input;
+    input.MutableExtension(fork_security_test_input)
+        ->set_thread_type(ForkSecurityTestInput::SETREQUEST);
+    input.MutableExtension(fork_security_test_input)->set_request_fork(false);
+    EXPECT_THAT(client_->EnterAndRun(input, /*output=*/nullptr), Not(IsOk()));
+    enclave_finalized_ = true;
+  } else {
+    // No need to do security test for non-hardware mode. Snapshotting/restoring
+    // are not supported.
+    EXPECT_THAT(status,
+                StatusIs(absl::StatusCode::kUnavailable,
+                         "Secure fork not supported in non SGX hardware mode"));
+  }
+}
+
 }  // namespace
 }  // namespace asylo
@@ -21,54 +21,77 @@
 #include <openssl/rand.h>
 #include <stdint.h>
 
+#include <algorithm>
+#include <climits>
+
 #include "absl/memory/memory.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/primitives/trusted_runtime.h"
 
 namespace asylo {
 namespace io {
+namespace {
+
+// Number of times a thread finding the readiness ring empty checks it again
+// before exiting to block on the host.
+constexpr int kReadinessSpinCount = 64;
+
+}  // namespace
 
 int IOContextEpoll::EpollCtl(int op, int hostfd, struct epoll_event *event) {
   struct epoll_event event_copy = {};
   if (event) {
     event_copy.events = event->events;
   }
-  if (op == EPOLL_CTL_ADD) {
-    uint64_t key = 0;
-    do {
-      if (RAND_bytes(reinterpret_cast<uint8_t *>(&key),
-                     sizeof(uint64_t)) != 1) {
-        errno = EBADE;
+  {
+    absl::MutexLock lock(&mu_);
+    if (op == EPOLL_CTL_ADD) {
+      uint64_t key = 0;
+      do {
+        if (RAND_bytes(reinterpret_cast<uint8_t *>(&key),
+                       sizeof(uint64_t)) != 1) {
+          errno = EBADE;
+          return -1;
+        }
+      } while (key_to_data.find(key) != key_to_data.end());
+      key_to_data[key] = {event->data.u64, event->events};
+      fd_to_key[hostfd] = key;
+      event_copy.data.u64 = key;
+    } else if (op == EPOLL_CTL_MOD) {
+      if (fd_to_key.find(hostfd) == fd_to_key.end()) {
+        errno = ENOENT;
         return -1;
       }
-    } while (key_to_data.find(key) != key_to_data.end());
-    key_to_data[key] = event->data.u64;
-    fd_to_key[hostfd] = key;
-    event_copy.data.u64 = key;
-  } else if (op == EPOLL_CTL_MOD) {
-    if (fd_to_key.find(hostfd) == fd_to_key.end()) {
-      errno = ENOENT;
-      return -1;
-    }
-    uint64_t key = fd_to_key[hostfd];
-    key_to_data[key] = event->data.u64;
-    event_copy.data.u64 = key;
-  } else if (op == EPOLL_CTL_DEL) {
-    if (fd_to_key.find(hostfd) == fd_to_key.end()) {
-      errno = ENOENT;
+      uint64_t key = fd_to_key[hostfd];
+      key_to_data[key] = {event->data.u64, event->events};
+      event_copy.data.u64 = key;
+    } else if (op == EPOLL_CTL_DEL) {
+      if (fd_to_key.find(hostfd) == fd_to_key.end()) {
+        errno = ENOENT;
+        return -1;
+      }
+      uint64_t key = fd_to_key[hostfd];
+      event_copy.data.u64 = key;
+      fd_to_key.erase(hostfd);
+      key_to_data.erase(key);
+    } else {
       return -1;
     }
-    uint64_t key = fd_to_key[hostfd];
-    event_copy.data.u64 = key;
-    fd_to_key.erase(hostfd);
-    key_to_data.erase(key);
-  } else {
-    return -1;
   }
   return enc_untrusted_epoll_ctl(host_fd_, op, hostfd, &event_copy);
 }
 
 int IOContextEpoll::EpollWait(struct epoll_event *events, int maxevents,
                               int timeout) {
+  if (use_readiness_cache_ && maxevents > 0) {
+    int ret = WaitForReadyEvents(events, maxevents, timeout);
+    if (ret != kReadinessCacheUnavailable) {
+      return ret;
+    }
+  }
+
   int ret = enc_untrusted_epoll_wait(host_fd_, events, maxevents, timeout);
   if (ret == -1) {
     // errno is set in enc_untrusted_epoll_wait.
@@ -76,17 +99,128 @@ int IOContextEpoll::EpollWait(struct epoll_event *events, int maxevents,
   }
   // Convert the random bits in the data field back to the original data using
   // the key_to_data map.
+  absl::MutexLock lock(&mu_);
   for (int i = 0; i < ret; ++i) {
     uint64_t key = events[i].data.u64;
     if (key_to_data.find(key) == key_to_data.end()) {
       errno = EBADE;
       return -1;
     }
-    events[i].data.u64 = key_to_data[key];
+    events[i].data.u64 = key_to_data[key].data;
   }
   return ret;
 }
 
+int IOContextEpoll::WaitForReadyEvents(struct epoll_event *events,
+                                       int maxevents, int timeout) {
+  // Only read the clock if the call may block for a bounded time. Unless the
+  // shared clock is enabled, each read is an exit.
+  absl::Time deadline = absl::InfiniteFuture();
+  if (timeout > 0) {
+    deadline = absl::Now() + absl::Milliseconds(timeout);
+  }
+  while (true) {
+    uint64_t poller;
+    EpollReadinessRing *ring;
+    {
+      absl::MutexLock lock(&mu_);
+      if (readiness_cache_failed_) {
+        // The caller waits on the host epoll instance once this returns, so
+        // first wait for a concurrent StopPollerLocked() to stop the poller.
+        mu_.Await(absl::Condition(
+            +[](EpollReadinessRing **ring) { return *ring == nullptr; },
+            &ring_));
+        return kReadinessCacheUnavailable;
+      }
+      if (!ring_ &&
+          enc_untrusted_epoll_poller_start(host_fd_, &poller_, &ring_) == -1) {
+        // No poller waits on the host epoll instance, so the call may be made
+        // on the host.
+        readiness_cache_failed_ = true;
+        return kReadinessCacheUnavailable;
+      }
+      int ret = TakeReadyEvents(events, maxevents);
+      if (ret != 0) {
+        return ret;
+      }
+      if (ring_->state() == EpollReadinessRing::kFailed) {
+        // A failed ring holds no events. Stop the poller before the call is
+        // made on the host.
+        StopPollerLocked();
+        return kReadinessCacheUnavailable;
+      }
+      if (timeout == 0 || (timeout > 0 && absl::Now() >= deadline)) {
+        return 0;
+      }
+      poller = poller_;
+      ring = ring_;
+      ++active_waits_;
+    }
+
+    // The ring stays mapped while |active_waits_| is positive.
+    for (int i = 0; i < kReadinessSpinCount &&
+                    ring->state() == EpollReadinessRing::kArmed;
+         ++i) {
+      enc_pause();
+    }
+    if (ring->state() == EpollReadinessRing::kArmed) {
+      int64_t timeout_microsec =
+          timeout < 0 ? -1
+                      : std::max<int64_t>(
+                            absl::ToInt64Microseconds(deadline - absl::Now()),
+                            0);
+      // A timeout is detected against |deadline| on the next iteration.
+      enc_untrusted_epoll_poller_wait(poller, timeout_microsec);
+    }
+
+    absl::MutexLock lock(&mu_);
+    --active_waits_;
+  }
+}
+
+int IOContextEpoll::TakeReadyEvents(struct epoll_event *events,
+                                    int maxevents) {
+  int count = enc_epoll_readiness_consume(ring_, events, maxevents);
+  int kept = 0;
+  for (int i = 0; i < count; ++i) {
+    auto it = key_to_data.find(events[i].data.u64);
+    if (it == key_to_data.end()) {
+      // The file descriptor was deleted after the poller saw it ready.
+      continue;
+    }
+    uint32_t ready = events[i].events &
+                     (it->second.events | EPOLLERR | EPOLLHUP);
+    if (ready == 0) {
+      // The events of the file descriptor were modified since.
+      continue;
+    }
+    events[kept].events = ready;
+    events[kept].data.u64 = it->second.data;
+    ++kept;
+  }
+  return kept;
+}
+
+void IOContextEpoll::StopPoller() {
+  absl::MutexLock lock(&mu_);
+  StopPollerLocked();
+}
+
+void IOContextEpoll::StopPollerLocked() {
+  readiness_cache_failed_ = true;
+  if (!ring_) {
+    return;
+  }
+  // Release the threads blocked on the ring before freeing it.
+  ring_->Fail();
+  enc_untrusted_sys_futex_wake(ring_->state_word(), INT_MAX);
+  mu_.Await(absl::Condition(
+      +[](int *active_waits) { return *active_waits == 0; }, &active_waits_));
+  enc_untrusted_epoll_poller_stop(poller_);
+  poller_ = 0;
+  ring_ = nullptr;
+}
+
 int IOContextEpoll::GetHostFileDescriptor() { return host_fd_; }
 
 // Read and Write should never be called on an epoll fd.
@@ -100,7 +234,10 @@ ssize_t IOContextEpoll::Write(const void *buf, size_t count) {
   return -1;
 }
 
-int IOContextEpoll::Close() { return enc_untrusted_close(host_fd_); }
+int IOContextEpoll::Close() {
+  StopPoller();
+  return enc_untrusted_close(host_fd_);
+}
 
 }  // namespace io
 }  // namespace asylo
@@ -19,16 +19,32 @@
 #ifndef ASYLO_PLATFORM_POSIX_IO_IO_CONTEXT_EPOLL_H_
 #define ASYLO_PLATFORM_POSIX_IO_IO_CONTEXT_EPOLL_H_
 
+#include <cstdint>
 #include <unordered_map>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/synchronization/mutex.h"
+#include "asylo/platform/common/epoll_readiness_ring.h"
 #include "asylo/platform/posix/io/io_manager.h"
 
 namespace asylo {
 namespace io {
 // IOContext implementation wrapping an epoll file descriptor
+//
+// If |use_readiness_cache| is set, the first EpollWait() starts an untrusted
+// poller thread waiting on the host epoll instance, and later calls take the
+// events it has published from untrusted memory instead of exiting to the
+// host. EpollWait() only exits while no event is ready, to block until the
+// poller publishes some, so a zero timeout is always answered inside the
+// enclave. Level-triggered readiness may then be reported slightly after the
+// condition has cleared, which callers of epoll must already tolerate.
+//
+// EpollCtl() still exits once per call: the host kernel validates each
+// registration, and its errors must be reported synchronously.
 class IOContextEpoll : public IOManager::IOContext {
  public:
-  explicit IOContextEpoll(int host_fd) : host_fd_(host_fd) {}
+  explicit IOContextEpoll(int host_fd, bool use_readiness_cache = false)
+      : host_fd_(host_fd), use_readiness_cache_(use_readiness_cache) {}
   // It's important to note that adding dup'd file descriptors here won't work
   // the same as it would in POSIX.
   int EpollCtl(int op, int hostfd, struct epoll_event *event) override;
@@ -40,12 +56,54 @@ class IOContextEpoll : public IOManager::IOContext {
   int Close();
 
  private:
+  // The data and events registered by the enclave for a host file descriptor.
+  struct Registration {
+    uint64_t data;
+    uint32_t events;
+  };
+
+  // Serves EpollWait() from the readiness cache. Returns
+  // kReadinessCacheUnavailable if the call must be made on the host instead.
+  int WaitForReadyEvents(struct epoll_event *events, int maxevents,
+                         int timeout);
+
+  // Takes up to |maxevents| events from the readiness ring and translates them
+  // back to the registered data. Events for file descriptors no longer
+  // registered are dropped.
+  int TakeReadyEvents(struct epoll_event *events, int maxevents)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  // Fails the readiness ring, waits for the threads blocked on it to return and
+  // stops the poller. Once the poller is started, the host epoll instance is
+  // only waited on directly after it is stopped, since events taken by the
+  // poller would otherwise be lost.
+  void StopPoller() ABSL_LOCKS_EXCLUDED(mu_);
+  void StopPollerLocked() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mu_);
+
+  static constexpr int kReadinessCacheUnavailable = -2;
+
   // Host file descriptor implementing this stream.
   int host_fd_;
-  std::unordered_map<uint64_t, uint64_t> key_to_data;
+
+  // Whether EpollWait() may be served from a readiness cache.
+  const bool use_readiness_cache_;
+
+  absl::Mutex mu_;
+  std::unordered_map<uint64_t, Registration> key_to_data ABSL_GUARDED_BY(mu_);
   // Manages a mapping from the host file descriptor to a random key to enable
   // updates to the above map durring deletions/modifications.
-  std::unordered_map<int, uint64_t> fd_to_key;
+  std::unordered_map<int, uint64_t> fd_to_key ABSL_GUARDED_BY(mu_);
+
+  // Handle of the untrusted poller and the ring it publishes into, or 0 and
+  // nullptr if the poller is not running.
+  uint64_t poller_ ABSL_GUARDED_BY(mu_) = 0;
+  EpollReadinessRing *ring_ ABSL_GUARDED_BY(mu_) = nullptr;
+
+  // Set once the readiness cache can no longer be used.
+  bool readiness_cache_failed_ ABSL_GUARDED_BY(mu_) = false;
+
+  // Number of threads using |poller_| without holding |mu_|.
+  int active_waits_ ABSL_GUARDED_BY(mu_) = 0;
 };
 
 }  // namespace io
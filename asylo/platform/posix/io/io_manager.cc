@@ -21,6 +21,9 @@
 #include <fcntl.h>
 #include <poll.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cerrno>
 #include <cstdint>
 #include <memory>
@@ -35,33 +38,199 @@
 #include "asylo/platform/posix/io/io_context_inotify.h"
 #include "asylo/platform/posix/io/native_paths.h"
 #include "asylo/platform/posix/io/util.h"
+#include "asylo/platform/system_call/sysno.h"
+#include "asylo/platform/system_call/system_call.h"
 #include "asylo/util/posix_errors.h"
 #include "asylo/util/statusor.h"
 
 namespace asylo {
 namespace io {
 
+namespace {
+
+// The number of hazard pointers of a thread. The last one is used by lookups
+// which copy the context, and the others by nested ScopedContexts.
+constexpr int kHazardPointersPerThread = 4;
+
+// The hazard pointers through which a thread protects the file descriptor table
+// entries it is using from being freed. Each thread performing lookups holds
+// one record until it exits, after which the record is marked inactive and may
+// be taken over by a later thread. Records are never freed, so that they can be
+// scanned without locking; their number is bounded by the peak number of
+// concurrent threads, which for an enclave is the number of TCS.
+struct HazardRecord {
+  HazardRecord() {
+    for (auto &pointer : pointers) {
+      pointer.store(nullptr, std::memory_order_relaxed);
+    }
+  }
+
+  std::array<std::atomic<const void *>, kHazardPointersPerThread> pointers;
+  std::atomic<bool> active{true};
+  HazardRecord *next = nullptr;
+};
+
+// The list of all hazard records, shared by all file descriptor tables.
+std::atomic<HazardRecord *> hazard_records{nullptr};
+
+// Holds the hazard record of the calling thread, and releases it for reuse when
+// the thread exits.
+struct ThreadHazardRecord {
+  ~ThreadHazardRecord() {
+    if (record) {
+      for (auto &pointer : record->pointers) {
+        pointer.store(nullptr, std::memory_order_relaxed);
+      }
+      record->active.store(false, std::memory_order_release);
+    }
+  }
+
+  // The hazard record of the thread, or nullptr if it has not performed any
+  // lookup yet.
+  HazardRecord *record = nullptr;
+
+  // The number of hazard pointers held by the ScopedContexts of the thread.
+  int scoped_count = 0;
+};
+
+thread_local ThreadHazardRecord thread_hazard_record;
+
+// Returns an inactive hazard record after marking it active, or nullptr if all
+// records are in use.
+HazardRecord *AcquireInactiveHazardRecord() {
+  for (HazardRecord *record = hazard_records.load(std::memory_order_acquire);
+       record; record = record->next) {
+    bool active = false;
+    if (!record->active.load(std::memory_order_relaxed) &&
+        record->active.compare_exchange_strong(active, true,
+                                               std::memory_order_acquire)) {
+      return record;
+    }
+  }
+  return nullptr;
+}
+
+// Returns the hazard record of the calling thread, taking over the record of an
+// exited thread or allocating a new one on first use.
+HazardRecord *GetThreadHazardRecord() {
+  if (!thread_hazard_record.record) {
+    HazardRecord *record = AcquireInactiveHazardRecord();
+    if (!record) {
+      record = new HazardRecord;
+      HazardRecord *head = hazard_records.load(std::memory_order_relaxed);
+      do {
+        record->next = head;
+      } while (!hazard_records.compare_exchange_weak(
+          head, record, std::memory_order_release, std::memory_order_relaxed));
+    }
+    thread_hazard_record.record = record;
+  }
+  return thread_hazard_record.record;
+}
+
+// Returns the hazard pointer used by lookups which copy the context.
+std::atomic<const void *> *GetCopyHazardPointer() {
+  return &GetThreadHazardRecord()->pointers[kHazardPointersPerThread - 1];
+}
+
+// Returns an unused hazard pointer for a ScopedContext, or nullptr if all of
+// them are held by enclosing ScopedContexts.
+std::atomic<const void *> *AcquireScopedHazardPointer() {
+  HazardRecord *record = GetThreadHazardRecord();
+  if (thread_hazard_record.scoped_count == kHazardPointersPerThread - 1) {
+    return nullptr;
+  }
+  return &record->pointers[thread_hazard_record.scoped_count++];
+}
+
+// Releases the innermost hazard pointer of a ScopedContext.
+void ReleaseScopedHazardPointer(std::atomic<const void *> *hazard) {
+  hazard->store(nullptr, std::memory_order_release);
+  --thread_hazard_record.scoped_count;
+}
+
+// Returns true if any thread protects |pointer| with its hazard record.
+bool IsHazardous(const void *pointer) {
+  for (HazardRecord *record = hazard_records.load(std::memory_order_acquire);
+       record; record = record->next) {
+    for (const auto &hazard : record->pointers) {
+      if (hazard.load() == pointer) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
 IOManager::FileDescriptorTable::FileDescriptorTable()
-    : maximum_fd_soft_limit(kMaxOpenFiles),
-      maximum_fd_hard_limit(kMaxOpenFiles) {}
+    : lowest_unused_fd_hint_(0),
+      maximum_fd_soft_limit(kDefaultOpenFilesSoftLimit),
+      maximum_fd_hard_limit(kMaxOpenFiles) {
+  for (auto &chunk : chunks_) {
+    chunk.store(nullptr, std::memory_order_relaxed);
+  }
+}
+
+IOManager::FileDescriptorTable::~FileDescriptorTable() {
+  int highest_fd = GetHighestFileDescriptorUsed();
+  for (int fd = 0; fd <= highest_fd; ++fd) {
+    Delete(fd);
+  }
+  for (Entry *entry : retired_) {
+    delete entry;
+  }
+  for (auto &chunk : chunks_) {
+    delete chunk.load(std::memory_order_relaxed);
+  }
+}
+
+IOManager::FileDescriptorTable::ScopedContext::ScopedContext(
+    FileDescriptorTable *table, int fd) {
+  hazard_ = AcquireScopedHazardPointer();
+  if (!hazard_) {
+    owner_ = table->Get(fd);
+    context_ = owner_.get();
+    return;
+  }
+  Entry *entry = table->ProtectEntry(fd, hazard_);
+  if (entry) {
+    context_ = entry->context.get();
+  }
+}
+
+IOManager::FileDescriptorTable::ScopedContext::~ScopedContext() {
+  if (hazard_) {
+    ReleaseScopedHazardPointer(hazard_);
+  }
+}
 
 std::shared_ptr<IOManager::IOContext> IOManager::FileDescriptorTable::Get(
     int fd) {
-  if (!IsFileDescriptorValid(fd) || !fd_table_[fd]) return nullptr;
-  return fd_table_[fd]->Get();
+  std::atomic<const void *> *hazard = GetCopyHazardPointer();
+  Entry *entry = ProtectEntry(fd, hazard);
+  if (!entry) return nullptr;
+  std::shared_ptr<IOContext> context = entry->context;
+  hazard->store(nullptr, std::memory_order_release);
+  return context;
 }
 
 int IOManager::FileDescriptorTable::Delete(int fd) {
-  if (!IsFileDescriptorValid(fd)) return 0;
-  int close_result = 0;
-  fd_table_[fd]->WriteCloseResultTo(&close_result);
-  fd_table_[fd] = nullptr;
+  std::atomic<Entry *> *slot = Slot(fd);
+  if (!slot) return 0;
+  Entry *entry = slot->exchange(nullptr);
+  if (!entry) return 0;
+  lowest_unused_fd_hint_ = std::min(lowest_unused_fd_hint_, fd);
+  if (--entry->fd_count > 0) return 0;
+  int close_result = entry->context->Close() == -1 ? -1 : 0;
+  Retire(entry);
   return close_result;
 }
 
 bool IOManager::FileDescriptorTable::IsFileDescriptorUnused(int fd) {
   if (!IsFileDescriptorValid(fd)) return false;
-  return !fd_table_[fd];
+  return !LoadEntry(fd);
 }
 
 int IOManager::FileDescriptorTable::Insert(IOContext *context) {
@@ -69,26 +238,28 @@ int IOManager::FileDescriptorTable::Insert(IOContext *context) {
   if (fd < 0) {
     return -1;
   }
-  fd_table_[fd] = std::make_shared<AutoCloseIOContext>(context);
+  Publish(fd, new Entry(context));
   return fd;
 }
 
 int IOManager::FileDescriptorTable::CopyFileDescriptor(int oldfd, int startfd) {
   int newfd = GetNextFreeFileDescriptor(startfd);
-  if (!IsFileDescriptorValid(oldfd) || newfd == -1) {
+  Entry *entry = LoadEntry(oldfd);
+  if (!entry || newfd == -1) {
     return -1;
   }
-  fd_table_[newfd] = fd_table_[oldfd];
+  Publish(newfd, entry);
   return newfd;
 }
 
 int IOManager::FileDescriptorTable::CopyFileDescriptorToSpecifiedTarget(
     int oldfd, int newfd) {
-  if (!IsFileDescriptorValid(oldfd) || !IsFileDescriptorValid(newfd) ||
-      fd_table_[newfd]) {
+  Entry *entry = LoadEntry(oldfd);
+  if (!entry || newfd >= maximum_fd_soft_limit ||
+      !IsFileDescriptorUnused(newfd)) {
     return -1;
   }
-  fd_table_[newfd] = fd_table_[oldfd];
+  Publish(newfd, entry);
   return newfd;
 }
 
@@ -122,9 +293,79 @@ bool IOManager::FileDescriptorTable::IsFileDescriptorValid(int fd) {
   return fd >= 0 && fd < kMaxOpenFiles;
 }
 
+std::atomic<IOManager::FileDescriptorTable::Entry *>
+    *IOManager::FileDescriptorTable::Slot(int fd) {
+  if (!IsFileDescriptorValid(fd)) return nullptr;
+  Chunk *chunk = chunks_[fd / kChunkSize].load(std::memory_order_acquire);
+  return chunk ? &(*chunk)[fd % kChunkSize] : nullptr;
+}
+
+std::atomic<IOManager::FileDescriptorTable::Entry *>
+    *IOManager::FileDescriptorTable::MutableSlot(int fd) {
+  std::atomic<Chunk *> &chunk = chunks_[fd / kChunkSize];
+  if (!chunk.load(std::memory_order_relaxed)) {
+    auto *new_chunk = new Chunk;
+    for (auto &slot : *new_chunk) {
+      slot.store(nullptr, std::memory_order_relaxed);
+    }
+    chunk.store(new_chunk, std::memory_order_release);
+  }
+  return Slot(fd);
+}
+
+IOManager::FileDescriptorTable::Entry *
+IOManager::FileDescriptorTable::LoadEntry(int fd) {
+  std::atomic<Entry *> *slot = Slot(fd);
+  return slot ? slot->load(std::memory_order_relaxed) : nullptr;
+}
+
+IOManager::FileDescriptorTable::Entry *
+IOManager::FileDescriptorTable::ProtectEntry(
+    int fd, std::atomic<const void *> *hazard) {
+  std::atomic<Entry *> *slot = Slot(fd);
+  if (!slot) return nullptr;
+
+  // Check that the entry was still in the table once protected, so that it
+  // cannot have been retired before the hazard pointer was published.
+  Entry *entry = slot->load();
+  while (true) {
+    if (!entry) {
+      hazard->store(nullptr, std::memory_order_release);
+      return nullptr;
+    }
+    hazard->store(entry);
+    Entry *current = slot->load();
+    if (current == entry) return entry;
+    entry = current;
+  }
+}
+
+void IOManager::FileDescriptorTable::Publish(int fd, Entry *entry) {
+  ++entry->fd_count;
+  MutableSlot(fd)->store(entry, std::memory_order_release);
+  if (fd == lowest_unused_fd_hint_) {
+    ++lowest_unused_fd_hint_;
+  }
+}
+
+void IOManager::FileDescriptorTable::Retire(Entry *entry) {
+  retired_.push_back(entry);
+  auto protected_end =
+      std::partition(retired_.begin(), retired_.end(), IsHazardous);
+  for (auto it = protected_end; it != retired_.end(); ++it) {
+    delete *it;
+  }
+  retired_.erase(protected_end, retired_.end());
+}
+
 int IOManager::FileDescriptorTable::GetHighestFileDescriptorUsed() {
   for (int i = kMaxOpenFiles - 1; i >= 0; --i) {
-    if (fd_table_[i]) {
+    if (i % kChunkSize == kChunkSize - 1 && !Slot(i)) {
+      // Skip chunks which were never allocated.
+      i -= kChunkSize - 1;
+      continue;
+    }
+    if (!IsFileDescriptorUnused(i)) {
       return i;
     }
   }
@@ -136,8 +377,9 @@ int IOManager::FileDescriptorTable::GetNextFreeFileDescriptor(int startfd) {
     return -1;
   }
   int fd = -1;
-  for (int i = startfd; i < maximum_fd_soft_limit; ++i) {
-    if (!fd_table_[i]) {
+  for (int i = std::max(startfd, lowest_unused_fd_hint_);
+       i < maximum_fd_soft_limit; ++i) {
+    if (IsFileDescriptorUnused(i)) {
       fd = i;
       break;
     }
@@ -254,6 +496,10 @@ int IOManager::Dup2(int oldfd, int newfd) {
     if (oldfd == newfd) {
       return newfd;
     }
+    if (newfd < 0 || newfd >= fd_table_.get_maximum_fd_soft_limit()) {
+      errno = EBADF;
+      return -1;
+    }
     if (!fd_table_.IsFileDescriptorUnused(newfd) &&
         CloseFileDescriptor(newfd) == -1) {
       return -1;
@@ -269,11 +515,23 @@ int IOManager::Dup2(int oldfd, int newfd) {
 }
 
 int IOManager::Pipe(int pipefd[2], int flags) {
-  int res = enc_untrusted_pipe2(pipefd, flags);
+  int host_pipefd[2];
+  int res = enc_untrusted_pipe2(host_pipefd, flags);
   if (res != -1) {
-    pipefd[0] = RegisterHostFileDescriptor(pipefd[0]);
-    pipefd[1] = RegisterHostFileDescriptor(pipefd[1]);
+    pipefd[0] = RegisterHostFileDescriptor(host_pipefd[0]);
+    pipefd[1] = RegisterHostFileDescriptor(host_pipefd[1]);
     if (pipefd[0] < 0 || pipefd[1] < 0) {
+      // Release the end which was registered, if any, through its context and
+      // close the host file descriptors which were not in a single exit.
+      system_call::SystemCallBatch batch;
+      for (int i = 0; i < 2; ++i) {
+        if (pipefd[i] >= 0) {
+          Close(pipefd[i]);
+        } else {
+          batch.Add(system_call::kSYS_close, host_pipefd[i]);
+        }
+      }
+      EnsureInitializedAndSubmitSyscallBatch(&batch);
       errno = EMFILE;
       return -1;
     }
@@ -385,16 +643,13 @@ int IOManager::Select(int nfds, fd_set *readfds, fd_set *writefds,
 
 int IOManager::Poll(struct pollfd *fds, nfds_t nfds, int timeout) {
   std::vector<int> enclave_fd(nfds);
-  {
-    absl::ReaderMutexLock lock(&fd_table_lock_);
-    for (int i = 0; i < nfds; ++i) {
-      enclave_fd[i] = fds[i].fd;
-      std::shared_ptr<IOContext> context = fd_table_.Get(enclave_fd[i]);
-      if (context) {
-        fds[i].fd = context->GetHostFileDescriptor();
-      } else {
-        fds[i].fd = -1;
-      }
+  for (int i = 0; i < nfds; ++i) {
+    enclave_fd[i] = fds[i].fd;
+    std::shared_ptr<IOContext> context = fd_table_.Get(enclave_fd[i]);
+    if (context) {
+      fds[i].fd = context->GetHostFileDescriptor();
+    } else {
+      fds[i].fd = -1;
     }
   }
   int ret = enc_untrusted_poll(fds, nfds, timeout);
@@ -413,7 +668,8 @@ int IOManager::EpollCreate(int size) {
   if (hostfd == -1) {
     return -1;
   }
-  auto context = ::absl::make_unique<IOContextEpoll>(hostfd);
+  auto context = ::absl::make_unique<IOContextEpoll>(
+      hostfd, epoll_readiness_cache_enabled_);
   absl::WriterMutexLock lock(&fd_table_lock_);
   int fd = fd_table_.Insert(context.get());
   if (fd >= 0) {
@@ -425,26 +681,21 @@ int IOManager::EpollCreate(int size) {
 }
 
 int IOManager::EpollCtl(int epfd, int op, int fd, struct epoll_event *event) {
-  std::shared_ptr<IOContext> context;
-  {
-    absl::ReaderMutexLock lock(&fd_table_lock_);
-    context = fd_table_.Get(fd);
-  }
+  std::shared_ptr<IOContext> context = fd_table_.Get(fd);
   int hostfd = context ? context->GetHostFileDescriptor() : -1;
   if (hostfd == -1) {
     errno = EBADF;
     return -1;
   }
-  return CallWithContext(
-      epfd, [op, hostfd, event](std::shared_ptr<IOContext> epoll_context) {
-        return epoll_context->EpollCtl(op, hostfd, event);
-      });
+  return CallWithContext(epfd, [op, hostfd, event](IOContext *epoll_context) {
+    return epoll_context->EpollCtl(op, hostfd, event);
+  });
 }
 
 int IOManager::EpollWait(int epfd, struct epoll_event *events, int maxevents,
                          int timeout) {
   return CallWithContext(
-      epfd, [events, maxevents, timeout](std::shared_ptr<IOContext> context) {
+      epfd, [events, maxevents, timeout](IOContext *context) {
         return context->EpollWait(events, maxevents, timeout);
       });
 }
@@ -478,19 +729,21 @@ int IOManager::InotifyInit(bool non_block) {
 }
 
 int IOManager::InotifyAddWatch(int fd, const char *pathname, uint32_t mask) {
-  return CallWithContext(
-      fd, [this, pathname, mask](std::shared_ptr<IOContext> inotify_context) {
-        return CallWithHandler(
-            pathname, [inotify_context, mask](VirtualPathHandler *handler,
-                                              const char *canonical_path) {
-              return handler->InotifyAddWatch(inotify_context, canonical_path,
-                                              mask);
-            });
+  // Path handlers take a reference to the context.
+  std::shared_ptr<IOContext> inotify_context = fd_table_.Get(fd);
+  if (!inotify_context) {
+    errno = EBADF;
+    return -1;
+  }
+  return CallWithHandler(
+      pathname, [inotify_context, mask](VirtualPathHandler *handler,
+                                        const char *canonical_path) {
+        return handler->InotifyAddWatch(inotify_context, canonical_path, mask);
       });
 }
 
 int IOManager::InotifyRmWatch(int fd, int wd) {
-  return CallWithContext(fd, [wd](std::shared_ptr<IOContext> inotify_context) {
+  return CallWithContext(fd, [wd](IOContext *inotify_context) {
     return inotify_context->InotifyRmWatch(wd);
   });
 }
@@ -520,13 +773,9 @@ struct ErrorValue<Type,
 
 template <typename IOAction, typename ReturnType>
 ReturnType IOManager::CallWithContext(int fd, IOAction action) {
-  std::shared_ptr<IOContext> context;
-  {
-    absl::ReaderMutexLock lock(&fd_table_lock_);
-    context = fd_table_.Get(fd);
-  }
-  if (context) {
-    return action(context);
+  FileDescriptorTable::ScopedContext context(&fd_table_, fd);
+  if (context.get()) {
+    return action(context.get());
   }
   errno = EBADF;
   return ErrorValue<ReturnType>::value;
@@ -584,7 +833,7 @@ ReturnType IOManager::CallWithHandler(const char *path1, const char *path2,
 }
 
 int IOManager::Read(int fd, char *buf, size_t count) {
-  return CallWithContext(fd, [buf, count](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [buf, count](IOContext *context) {
     return context->Read(buf, count);
   });
 }
@@ -665,7 +914,7 @@ StatusOr<std::string> IOManager::CanonicalizePath(
 }
 
 int IOManager::Write(int fd, const char *buf, size_t count) {
-  return CallWithContext(fd, [buf, count](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [buf, count](IOContext *context) {
     return context->Write(buf, count);
   });
 }
@@ -732,7 +981,7 @@ int IOManager::Truncate(const char *path, off_t length) {
 }
 
 int IOManager::FTruncate(int fd, off_t length) {
-  return CallWithContext(fd, [length](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [length](IOContext *context) {
     return context->FTruncate(length);
   });
 }
@@ -814,23 +1063,21 @@ int IOManager::ChMod(const char *pathname, mode_t mode) {
 }
 
 int IOManager::FChOwn(int fd, uid_t owner, gid_t group) {
-  return CallWithContext(fd,
-                         [owner, group](std::shared_ptr<IOContext> context) {
-                           return context->FChOwn(owner, group);
-                         });
+  return CallWithContext(fd, [owner, group](IOContext *context) {
+    return context->FChOwn(owner, group);
+  });
 }
 
 int IOManager::FChMod(int fd, mode_t mode) {
-  return CallWithContext(fd, [mode](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [mode](IOContext *context) {
     return context->FChMod(mode);
   });
 }
 
 int IOManager::LSeek(int fd, off_t offset, int whence) {
-  return CallWithContext(fd,
-                         [offset, whence](std::shared_ptr<IOContext> context) {
-                           return context->LSeek(offset, whence);
-                         });
+  return CallWithContext(fd, [offset, whence](IOContext *context) {
+    return context->LSeek(offset, whence);
+  });
 }
 
 int IOManager::FCntl(int fd, int cmd, int64_t arg) {
@@ -846,73 +1093,69 @@ int IOManager::FCntl(int fd, int cmd, int64_t arg) {
     errno = EBADF;
     return -1;
   }
-  return CallWithContext(fd, [cmd, arg](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [cmd, arg](IOContext *context) {
     return context->FCntl(cmd, arg);
   });
 }
 
 int IOManager::FSync(int fd) {
   return CallWithContext(
-      fd, [](std::shared_ptr<IOContext> context) { return context->FSync(); });
+      fd, [](IOContext *context) { return context->FSync(); });
 }
 
 int IOManager::FDataSync(int fd) {
-  return CallWithContext(fd, [](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [](IOContext *context) {
     return context->FDataSync();
   });
 }
 
 int IOManager::FStat(int fd, struct stat *stat_buffer) {
-  return CallWithContext(fd, [stat_buffer](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [stat_buffer](IOContext *context) {
     return context->FStat(stat_buffer);
   });
 }
 
 ssize_t IOManager::FGetXattr(int fd, const char *name, void *value,
                              size_t size) {
-  return CallWithContext(
-      fd, [name, value, size](std::shared_ptr<IOContext> context) {
-        return context->FGetXattr(name, value, size);
-      });
+  return CallWithContext(fd, [name, value, size](IOContext *context) {
+    return context->FGetXattr(name, value, size);
+  });
 }
 
 int IOManager::FSetXattr(int fd, const char *name, const void *value,
                          size_t size, int flags) {
-  return CallWithContext(
-      fd, [name, value, size, flags](std::shared_ptr<IOContext> context) {
-        return context->FSetXattr(name, value, size, flags);
-      });
+  return CallWithContext(fd, [name, value, size, flags](IOContext *context) {
+    return context->FSetXattr(name, value, size, flags);
+  });
 }
 
 ssize_t IOManager::FListXattr(int fd, char *list, size_t size) {
-  return CallWithContext(fd, [list, size](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [list, size](IOContext *context) {
     return context->FListXattr(list, size);
   });
 }
 
 int IOManager::FStatFs(int fd, struct statfs *statfs_buffer) {
-  return CallWithContext(fd,
-                         [statfs_buffer](std::shared_ptr<IOContext> context) {
-                           return context->FStatFs(statfs_buffer);
-                         });
+  return CallWithContext(fd, [statfs_buffer](IOContext *context) {
+    return context->FStatFs(statfs_buffer);
+  });
 }
 
 int IOManager::Isatty(int fd) {
   return CallWithContext(
-      fd, [](std::shared_ptr<IOContext> context) { return context->Isatty(); });
+      fd, [](IOContext *context) { return context->Isatty(); });
 }
 
 int IOManager::FLock(int fd, int operation) {
-  return CallWithContext(fd, [operation](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [operation](IOContext *context) {
     return context->FLock(operation);
   });
 }
 
 int IOManager::Ioctl(int fd, int request, void *argp) {
-  return CallWithContext(fd,
-                         [request, argp](std::shared_ptr<IOContext> context) {
-                           return context->Ioctl(request, argp);
-                         });
+  return CallWithContext(fd, [request, argp](IOContext *context) {
+    return context->Ioctl(request, argp);
+  });
 }
 
 int IOManager::Mkdir(const char *path, mode_t mode) {
@@ -953,22 +1196,35 @@ int IOManager::Utimes(const char *filename, const struct timeval times[2]) {
 }
 
 ssize_t IOManager::Writev(int fd, const struct iovec *iov, int iovcnt) {
-  return CallWithContext(fd, [iov, iovcnt](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [iov, iovcnt](IOContext *context) {
     return context->Writev(iov, iovcnt);
   });
 }
 
 ssize_t IOManager::Readv(int fd, const struct iovec *iov, int iovcnt) {
-  return CallWithContext(fd, [iov, iovcnt](std::shared_ptr<IOContext> context) {
+  return CallWithContext(fd, [iov, iovcnt](IOContext *context) {
     return context->Readv(iov, iovcnt);
   });
 }
 
+ssize_t IOManager::PWritev(int fd, const struct iovec *iov, int iovcnt,
+                           off_t offset) {
+  return CallWithContext(fd, [iov, iovcnt, offset](IOContext *context) {
+    return context->PWritev(iov, iovcnt, offset);
+  });
+}
+
+ssize_t IOManager::PReadv(int fd, const struct iovec *iov, int iovcnt,
+                          off_t offset) {
+  return CallWithContext(fd, [iov, iovcnt, offset](IOContext *context) {
+    return context->PReadv(iov, iovcnt, offset);
+  });
+}
+
 ssize_t IOManager::PRead(int fd, void *buf, size_t count, off_t offset) {
-  return CallWithContext(
-      fd, [buf, count, offset](std::shared_ptr<IOContext> context) {
-        return context->PRead(buf, count, offset);
-      });
+  return CallWithContext(fd, [buf, count, offset](IOContext *context) {
+    return context->PRead(buf, count, offset);
+  });
 }
 
 mode_t IOManager::Umask(mode_t mask) { return enc_untrusted_umask(mask); }
@@ -1017,30 +1273,28 @@ int IOManager::SetRLimit(int resource, const struct rlimit *rlim) {
 int IOManager::SetSockOpt(int sockfd, int level, int option_name,
                           const void *option_value, socklen_t option_len) {
   return CallWithContext(sockfd, [level, option_name, option_value, option_len](
-                                     std::shared_ptr<IOContext> context) {
+                                     IOContext *context) {
     return context->SetSockOpt(level, option_name, option_value, option_len);
   });
 }
 
 int IOManager::Connect(int sockfd, const struct sockaddr *addr,
                        socklen_t addrlen) {
-  return CallWithContext(sockfd,
-                         [addr, addrlen](std::shared_ptr<IOContext> context) {
-                           return context->Connect(addr, addrlen);
-                         });
+  return CallWithContext(sockfd, [addr, addrlen](IOContext *context) {
+    return context->Connect(addr, addrlen);
+  });
 }
 
 int IOManager::Shutdown(int sockfd, int how) {
-  return CallWithContext(sockfd, [how](std::shared_ptr<IOContext> context) {
+  return CallWithContext(sockfd, [how](IOContext *context) {
     return context->Shutdown(how);
   });
 }
 
 ssize_t IOManager::Send(int sockfd, const void *buf, size_t len, int flags) {
-  return CallWithContext(sockfd,
-                         [buf, len, flags](std::shared_ptr<IOContext> context) {
-                           return context->Send(buf, len, flags);
-                         });
+  return CallWithContext(sockfd, [buf, len, flags](IOContext *context) {
+    return context->Send(buf, len, flags);
+  });
 }
 
 int IOManager::Socket(int domain, int type, int protocol) {
@@ -1059,16 +1313,15 @@ int IOManager::Socket(int domain, int type, int protocol) {
 int IOManager::GetSockOpt(int sockfd, int level, int optname, void *optval,
                           socklen_t *optlen) {
   return CallWithContext(sockfd, [level, optname, optval,
-                                  optlen](std::shared_ptr<IOContext> context) {
+                                  optlen](IOContext *context) {
     return context->GetSockOpt(level, optname, optval, optlen);
   });
 }
 
 int IOManager::Accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
-  int ret = CallWithContext(
-      sockfd, [addr, addrlen](std::shared_ptr<IOContext> context) {
-        return context->Accept(addr, addrlen);
-      });
+  int ret = CallWithContext(sockfd, [addr, addrlen](IOContext *context) {
+    return context->Accept(addr, addrlen);
+  });
   if (ret < 0) {
     return -1;
   }
@@ -1081,52 +1334,47 @@ int IOManager::Accept(int sockfd, struct sockaddr *addr, socklen_t *addrlen) {
 
 int IOManager::Bind(int sockfd, const struct sockaddr *addr,
                     socklen_t addrlen) {
-  return CallWithContext(sockfd,
-                         [addr, addrlen](std::shared_ptr<IOContext> context) {
-                           return context->Bind(addr, addrlen);
-                         });
+  return CallWithContext(sockfd, [addr, addrlen](IOContext *context) {
+    return context->Bind(addr, addrlen);
+  });
 }
 
 int IOManager::Listen(int sockfd, int backlog) {
-  return CallWithContext(sockfd, [backlog](std::shared_ptr<IOContext> context) {
+  return CallWithContext(sockfd, [backlog](IOContext *context) {
     return context->Listen(backlog);
   });
 }
 
 ssize_t IOManager::SendMsg(int sockfd, const struct msghdr *msg, int flags) {
-  return CallWithContext(sockfd,
-                         [msg, flags](std::shared_ptr<IOContext> context) {
-                           return context->SendMsg(msg, flags);
-                         });
+  return CallWithContext(sockfd, [msg, flags](IOContext *context) {
+    return context->SendMsg(msg, flags);
+  });
 }
 
 ssize_t IOManager::RecvMsg(int sockfd, struct msghdr *msg, int flags) {
-  return CallWithContext(sockfd,
-                         [msg, flags](std::shared_ptr<IOContext> context) {
-                           return context->RecvMsg(msg, flags);
-                         });
+  return CallWithContext(sockfd, [msg, flags](IOContext *context) {
+    return context->RecvMsg(msg, flags);
+  });
 }
 
 int IOManager::GetSockName(int sockfd, struct sockaddr *addr,
                            socklen_t *addrlen) {
-  return CallWithContext(sockfd,
-                         [addr, addrlen](std::shared_ptr<IOContext> context) {
-                           return context->GetSockName(addr, addrlen);
-                         });
+  return CallWithContext(sockfd, [addr, addrlen](IOContext *context) {
+    return context->GetSockName(addr, addrlen);
+  });
 }
 
 int IOManager::GetPeerName(int sockfd, struct sockaddr *addr,
                            socklen_t *addrlen) {
-  return CallWithContext(sockfd,
-                         [addr, addrlen](std::shared_ptr<IOContext> context) {
-                           return context->GetPeerName(addr, addrlen);
-                         });
+  return CallWithContext(sockfd, [addr, addrlen](IOContext *context) {
+    return context->GetPeerName(addr, addrlen);
+  });
 }
 
 ssize_t IOManager::RecvFrom(int sockfd, void *buf, size_t len, int flags,
                             struct sockaddr *src_addr, socklen_t *addrlen) {
   return CallWithContext(sockfd, [buf, len, flags, src_addr,
-                                  addrlen](std::shared_ptr<IOContext> context) {
+                                  addrlen](IOContext *context) {
     return context->RecvFrom(buf, len, flags, src_addr, addrlen);
   });
 }
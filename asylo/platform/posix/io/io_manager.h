@@ -29,6 +29,7 @@
 #include <sys/types.h>
 #include <utime.h>
 
+#include <array>
 #include <atomic>
 #include <cerrno>
 #include <cstdint>
@@ -38,6 +39,7 @@
 #include <memory>
 #include <queue>
 #include <type_traits>
+#include <vector>
 
 #include "absl/base/thread_annotations.h"
 #include "absl/memory/memory.h"
@@ -54,8 +56,12 @@ namespace io {
 class IOManager {
  public:
   // The maximum number of virtual file descriptors which may be open at any one
-  // time.
-  static const constexpr int kMaxOpenFiles = 1024;
+  // time, and the default hard limit on the number of open files.
+  static const constexpr int kMaxOpenFiles = 65536;
+
+  // The default soft limit on the number of open files, which may be raised up
+  // to the hard limit with setrlimit().
+  static const constexpr int kDefaultOpenFilesSoftLimit = 1024;
 
   // An IOContext object represents an abstract I/O stream. Different concrete
   // implementations might wrap a native file descriptor on the host, a virtual
@@ -134,6 +140,17 @@ class IOManager {
       return -1;
     }
 
+    virtual ssize_t PWritev(const struct iovec *iov, int iovcnt,
+                            off_t offset) {
+      errno = ENOSYS;
+      return -1;
+    }
+
+    virtual ssize_t PReadv(const struct iovec *iov, int iovcnt, off_t offset) {
+      errno = ENOSYS;
+      return -1;
+    }
+
     virtual int FTruncate(off_t length) {
       errno = ENOSYS;
       return -1;
@@ -393,18 +410,55 @@ class IOManager {
   };
 
   // A table of virtual file descriptors managed by the IOManager.
-  // This class is not thread safe. IOManager is responsible for locking the
-  // access to objects of this class.
+  //
+  // Lookups with Get() or ScopedContext take no lock and may run concurrently
+  // with each other and with a single call mutating the table. Calls mutating
+  // the table are not thread safe, and IOManager is responsible for
+  // serializing them.
+  //
+  // The table grows in chunks of kChunkSize descriptors which are allocated on
+  // first use and never moved, so a lookup is two atomic loads. Entries are
+  // published with atomic stores and, once removed, are only freed when no
+  // concurrent lookup protects them with a hazard pointer.
   class FileDescriptorTable {
    public:
     FileDescriptorTable();
+    ~FileDescriptorTable();
+
+    FileDescriptorTable(const FileDescriptorTable &) = delete;
+    FileDescriptorTable &operator=(const FileDescriptorTable &) = delete;
+
+    // Looks up the IOContext associated with a file descriptor and keeps it
+    // from being freed while the ScopedContext is alive, without taking a
+    // reference to it. A thread may nest a few ScopedContexts; deeper ones fall
+    // back to holding a reference as Get() does.
+    class ScopedContext {
+     public:
+      ScopedContext(FileDescriptorTable *table, int fd);
+      ~ScopedContext();
+
+      ScopedContext(const ScopedContext &) = delete;
+      ScopedContext &operator=(const ScopedContext &) = delete;
+
+      // Returns the IOContext, or nullptr if no such context exists.
+      IOContext *get() const { return context_; }
+
+     private:
+      IOContext *context_ = nullptr;
+
+      // The hazard pointer protecting the entry of |context_|, if any.
+      std::atomic<const void *> *hazard_ = nullptr;
+
+      // Owns |context_| when the thread had no hazard pointer left.
+      std::shared_ptr<IOContext> owner_;
+    };
 
     // Returns the IOContext associated with a file descriptor, or nullptr if
     // no such context exists.
     std::shared_ptr<IOContext> Get(int fd);
 
-    // Removes an entry from the table, destroying the associated IOContext if
-    // this is the last reference to the IOContext, and returns the file
+    // Removes an entry from the table, closing the associated IOContext if
+    // this is the last file descriptor referring to it, and returns the file
     // descriptor to the free list. If close() is called on the host and that
     // call fails, returns -1; otherwise, returns 0.
     int Delete(int fd);
@@ -429,8 +483,8 @@ class IOManager {
 
     // Creates a copy of |oldfd| using |newfd| for the new descriptor. The two
     // file descriptors will reference the same I/O context. Returns |newfd| on
-    // success, returns -1 if either |oldfd| or |newfd| is not valid, or |newfd|
-    // is already used.
+    // success, returns -1 if either |oldfd| or |newfd| is not valid, |newfd| is
+    // not below the soft limit, or |newfd| is already used.
     int CopyFileDescriptorToSpecifiedTarget(int oldfd, int newfd);
 
     bool SetFileDescriptorLimits(const struct rlimit *rlim);
@@ -440,49 +494,56 @@ class IOManager {
     int get_maximum_fd_hard_limit();
 
    private:
-    // A wrapper around IOContext that ensures that the IOContext is destroyed
-    // when there are no longer any references to it.
-    //
-    // A shared_ptr<AutoCloseIOContext> represents a file descriptor referring
-    // to a backing IOContext, whereas a shared_ptr<IOContext> keeps the
-    // IOContext alive, even if there are no file descriptors referencing it.
-    class AutoCloseIOContext {
-     public:
-      explicit AutoCloseIOContext(IOContext *context)
-          : close_result_(nullptr), context_(context) {}
-
-      ~AutoCloseIOContext() {
-        if (context_->Close() == -1) {
-          int *close_result = close_result_.load();
-          if (close_result) {
-            *close_result = -1;
-          }
-        }
-      }
-
-      std::shared_ptr<IOContext> Get() { return context_; }
-
-      // Indicates that if the Close() call in the destructor fails, then -1
-      // should be written to |close_result|. If called multiple times, only the
-      // most recent |close_result| pointer is used.
-      void WriteCloseResultTo(int *close_result) {
-        close_result_.store(close_result);
-      }
-
-     private:
-      // Where to write the result of the Close() call in the destructor if it
-      // fails. May be nullptr, in which case any Close() failures are silent.
-      std::atomic<int *> close_result_;
-
-      // The IOContext to wrap. A shared_ptr is used to ensure that calls using
-      // the context object don't end up with dangling pointers if the wrapping
-      // AutoCloseIOContext gets destroyed.
-      std::shared_ptr<IOContext> context_;
+    // Number of file descriptors in a chunk of the table.
+    static constexpr int kChunkSize = 1024;
+
+    static_assert(kMaxOpenFiles % kChunkSize == 0,
+                  "kMaxOpenFiles must be a multiple of kChunkSize");
+
+    // An entry of the table, shared by all file descriptors referring to the
+    // same IOContext.
+    struct Entry {
+      explicit Entry(IOContext *context) : context(context), fd_count(0) {}
+
+      // The IOContext to wrap. Lookups through ScopedContext use it while the
+      // entry is protected by a hazard pointer. A shared_ptr lets callers of
+      // Get() keep using it after the last file descriptor referring to it is
+      // closed.
+      const std::shared_ptr<IOContext> context;
+
+      // Number of file descriptors referring to this entry. The context is
+      // closed when it drops to zero.
+      int fd_count;
     };
 
+    using Chunk = std::array<std::atomic<Entry *>, kChunkSize>;
+
     // Returns whether |fd| is in expected range.
     bool IsFileDescriptorValid(int fd);
 
+    // Returns the slot holding the entry of |fd|, or nullptr if the chunk
+    // holding it has not been allocated.
+    std::atomic<Entry *> *Slot(int fd);
+
+    // Returns the slot holding the entry of |fd|, allocating its chunk if
+    // needed.
+    std::atomic<Entry *> *MutableSlot(int fd);
+
+    // Returns the entry of |fd|, or nullptr if |fd| is unused or invalid.
+    Entry *LoadEntry(int fd);
+
+    // Returns the entry of |fd| after protecting it with |hazard|, or nullptr
+    // if |fd| is unused or invalid.
+    Entry *ProtectEntry(int fd, std::atomic<const void *> *hazard);
+
+    // Stores |entry| as the entry of the unused file descriptor |fd|.
+    void Publish(int fd, Entry *entry);
+
+    // Frees |entry| once no lookup protects it, along with any previously
+    // retired entries which are no longer protected. The IOContext of an entry
+    // is freed with it, unless a reference returned by Get() is still held.
+    void Retire(Entry *entry);
+
     // Returns current highest file descriptor number. Returns -1 if no file
     // descriptors are used.
     int GetHighestFileDescriptorUsed();
@@ -491,7 +552,14 @@ class IOManager {
     // |startfd|. Returns -1 if there is no file descriptor available.
     int GetNextFreeFileDescriptor(int startfd);
 
-    std::array<std::shared_ptr<AutoCloseIOContext>, kMaxOpenFiles> fd_table_;
+    std::array<std::atomic<Chunk *>, kMaxOpenFiles / kChunkSize> chunks_;
+
+    // Entries removed from the table which were still protected by a lookup
+    // when they were retired.
+    std::vector<Entry *> retired_;
+
+    // A file descriptor number such that all lower file descriptors are used.
+    int lowest_unused_fd_hint_;
 
     // The maximum file descriptor number allowed.
     int maximum_fd_soft_limit;
@@ -648,6 +716,14 @@ class IOManager {
   // Implements readv(2).
   virtual ssize_t Readv(int fd, const struct iovec *iov, int iovcnt);
 
+  // Implements pwritev(2).
+  virtual ssize_t PWritev(int fd, const struct iovec *iov, int iovcnt,
+                          off_t offset);
+
+  // Implements preadv(2).
+  virtual ssize_t PReadv(int fd, const struct iovec *iov, int iovcnt,
+                         off_t offset);
+
   // Implements pread(2).
   virtual ssize_t PRead(int fd, void *buf, size_t count, off_t offset);
 
@@ -785,6 +861,12 @@ class IOManager {
   Status SetCurrentWorkingDirectory(absl::string_view path);
   std::string GetCurrentWorkingDirectory() const;
 
+  // Sets whether epoll instances created afterwards answer epoll_wait() from
+  // a readiness cache published by an untrusted poller thread.
+  void SetEpollReadinessCacheEnabled(bool enabled) {
+    epoll_readiness_cache_enabled_ = enabled;
+  }
+
  protected:
   IOManager() = default;
 
@@ -807,9 +889,11 @@ class IOManager {
   // nullptr if no entry is found.
   VirtualPathHandler *HandlerForPath(absl::string_view path) const;
 
-  // Locks the mutex corresponding to |fd| and performs thread safe action.
+  // Looks up the IOContext of |fd| without locking the file descriptor table,
+  // and performs an action on it. The context cannot be freed before the action
+  // returns, even if |fd| is closed concurrently.
   template <typename IOAction, typename ReturnType = typename std::result_of<
-                                   IOAction(std::shared_ptr<IOContext>)>::type>
+                                   IOAction(IOContext *)>::type>
   ReturnType CallWithContext(int fd, IOAction action)
       ABSL_LOCKS_EXCLUDED(fd_table_lock_);
 
@@ -836,10 +920,12 @@ class IOManager {
 
   FileDescriptorTable fd_table_;
 
-  // A mutex that locks the fd_table_.
+  // A mutex serializing the calls mutating |fd_table_|. Lookups do not take it.
   absl::Mutex fd_table_lock_;
 
   std::string current_working_directory_;
+
+  bool epoll_readiness_cache_enabled_ = false;
 };
 
 }  // namespace io
@@ -31,6 +31,7 @@
 #include "asylo/platform/host_call/trusted/host_calls.h"
 #include "asylo/platform/primitives/random_bytes.h"
 #include "asylo/platform/primitives/trusted_runtime.h"
+#include "asylo/platform/primitives/util/trusted_drbg.h"
 
 namespace asylo {
 namespace {
@@ -68,8 +69,13 @@ ssize_t RandomIOContext::Read(void *buf, size_t count) {
     // If RDRAND isn't supported, then fall back on the host's randomness.
     return enc_untrusted_read(fd_, buf, count);
   }
-  // Delegate to architecture-specific implementation to generate random numbers
-  return enc_hardware_random(reinterpret_cast<uint8_t *>(buf), count);
+  // Serve the request from the thread's generator, which is seeded from the
+  // architecture-specific hardware source.
+  if (!primitives::TrustedDrbgRandomBytes(buf, count)) {
+    errno = EIO;
+    return -1;
+  }
+  return count;
 }
 
 ssize_t RandomIOContext::Write(const void *buf, size_t count) {
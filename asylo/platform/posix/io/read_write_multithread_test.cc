@@ -19,8 +19,10 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <future>
 #include <sstream>
 #include <string>
@@ -46,6 +48,9 @@ namespace {
 // Controls the number of threads |LaunchThreads()| creates.
 constexpr int kNumThreads = 9;
 
+// Controls the number of times |OpenClose()| opens and closes a file.
+constexpr int kNumOpenCloseIterations = 200;
+
 // Generates a random alpha-numeric string.
 std::string GenerateRandomString() {
   constexpr int res_len = 10;
@@ -109,6 +114,37 @@ Status WriteRead(const char *path) {
   return absl::OkStatus();
 }
 
+// Repeatedly opens and closes a file, publishing each file descriptor in |fd|
+// while it is open, and sets |done| once finished.
+Status OpenClose(const char *path, std::atomic<int> *fd,
+                 std::atomic<bool> *done) {
+  Cleanup set_done([done] { done->store(true); });
+  for (int i = 0; i < kNumOpenCloseIterations; ++i) {
+    int new_fd = open(path, O_CREAT | O_RDWR, 0644);
+    if (new_fd < 0) {
+      return GenerateErrorStatusFromErrno("Failed to open file", path);
+    }
+    fd->store(new_fd);
+    if (close(new_fd) != 0) {
+      return GenerateErrorStatusFromErrno("Failed to close file", path);
+    }
+  }
+  return absl::OkStatus();
+}
+
+// Looks up the file descriptor published in |fd| until |done| is set. Each
+// lookup must either see an open file or fail with EBADF.
+Status StatUntilDone(const char *path, const std::atomic<int> *fd,
+                     const std::atomic<bool> *done) {
+  while (!done->load()) {
+    struct stat stat_buffer;
+    if (fstat(fd->load(), &stat_buffer) != 0 && errno != EBADF) {
+      return GenerateErrorStatusFromErrno("Failed to stat file", path);
+    }
+  }
+  return absl::OkStatus();
+}
+
 TEST(ReadWriteMultiThreadTest, MultiThreadTest) {
   // Assign random file name, to avoid potential conflict with other runs
   // on the same machine, current or prior.
@@ -130,5 +166,27 @@ TEST(ReadWriteMultiThreadTest, MultiThreadTest) {
   }
 }
 
+// Tests that file descriptor lookups racing with close either see the open file
+// or fail cleanly.
+TEST(ReadWriteMultiThreadTest, LookupRacesClose) {
+  MallocUniquePtr<char> test_file(
+      tempnam(absl::GetFlag(FLAGS_test_tmpdir).c_str(), "MRWT"));
+  Cleanup remove_file([&test_file] { remove(test_file.get()); });
+
+  std::atomic<int> fd(-1);
+  std::atomic<bool> done(false);
+  std::vector<std::future<Status>> futures;
+  for (int i = 0; i < kNumThreads - 1; ++i) {
+    futures.push_back(std::async(std::launch::async, &StatUntilDone,
+                                 test_file.get(), &fd, &done));
+  }
+  futures.push_back(std::async(std::launch::async, &OpenClose, test_file.get(),
+                               &fd, &done));
+
+  for (auto &result : futures) {
+    EXPECT_THAT(result.get(), IsOk());
+  }
+}
+
 }  // namespace
 }  // namespace asylo
@@ -65,6 +65,15 @@ int IOContextSecure::Ioctl(int request, void *argp) {
       return AeadHandler::GetInstance().SetMasterKey(
           host_fd_, ioctl_param->data, ioctl_param->length);
     }
+    case ENCLAVE_STORAGE_SET_BLOCK_LENGTH: {
+      uint32_t *block_length = reinterpret_cast<uint32_t *>(argp);
+      if (!block_length) {
+        errno = EINVAL;
+        return -1;
+      }
+      return AeadHandler::GetInstance().SetBlockLength(host_fd_,
+                                                       *block_length);
+    }
     default:
       if (argp != nullptr) {
         errno = ENOSYS;
@@ -21,6 +21,7 @@
 #include <signal.h>
 #include <sys/mman.h>
 
+#include <algorithm>
 #include <array>
 #include <bitset>
 #include <cerrno>
@@ -43,7 +44,8 @@
 
 namespace {
 
-constexpr size_t kNumSpinLockAttempts = 10000;
+using asylo::pthread_impl::QueueOperations;
+using asylo::pthread_impl::ThreadParker;
 
 static void (*tsd_destructors[PTHREAD_KEYS_MAX])(void *) = {0};
 static pthread_rwlock_t key_lock = PTHREAD_RWLOCK_INITIALIZER;
@@ -67,16 +69,6 @@ inline int pthread_spin_unlock(pthread_spinlock_t *lock) {
   return 0;
 }
 
-// Initializes an untrusted wait queue. Will do nothing if enclave is not yet
-// running, if called during enclave startup.
-inline void initialize_wait_queue(int32_t **wait_queue_ptr) {
-  if (wait_queue_ptr && !(*wait_queue_ptr) &&
-      asylo::GetState() == asylo::EnclaveState::kRunning) {
-    *wait_queue_ptr = enc_untrusted_create_wait_queue();
-    CHECK_NE(*wait_queue_ptr, nullptr);
-  }
-}
-
 // An RAII guard object managing exclusive access to a "lockable" object, where
 // a lockable object is an aggregate type with a field "lock_" of type
 // pthread_spinlock_t.
@@ -137,12 +129,16 @@ int pthread_mutex_lock_internal(pthread_mutex_t *mutex) {
   }
   mutex->_owner = self;
   mutex->_refcount++;
-  if (mutex->_untrusted_wait_queue) {
-    enc_untrusted_enable_waiting(mutex->_untrusted_wait_queue);
-  }
   return 0;
 }
 
+// Returns whether |mutex| looks unlocked, without locking |mutex|->_lock. Only
+// a hint for spinning.
+bool pthread_mutex_maybe_unlocked(const pthread_mutex_t *mutex) {
+  return *static_cast<const volatile pthread_t *>(&mutex->_owner) ==
+         PTHREAD_T_NULL;
+}
+
 // Read locks the given |rwlock| if possible and returns 0. On success,
 // |rwlock|._readers is incremented. Returns EBUSY if the |rwlock| is write
 // locked. |rwlock|._lock must be locked by the caller.
@@ -153,11 +149,6 @@ int pthread_rwlock_tryrdlock_internal(pthread_rwlock_t *rwlock) {
   }
 
   rwlock->_reader_count++;
-#ifdef _ASYLO_PTHREAD_RWLOCK_TRANSITIONAL_FLAG
-  if (rwlock->_untrusted_wait_queue) {
-    enc_untrusted_enable_waiting(rwlock->_untrusted_wait_queue);
-  }
-#endif
   return 0;
 }
 
@@ -183,11 +174,6 @@ int pthread_rwlock_trywrlock_internal(pthread_rwlock_t *rwlock) {
   }
 
   rwlock->_write_owner = self;
-#ifdef _ASYLO_PTHREAD_RWLOCK_TRANSITIONAL_FLAG
-  if (rwlock->_untrusted_wait_queue) {
-    enc_untrusted_enable_waiting(rwlock->_untrusted_wait_queue);
-  }
-#endif
   return 0;
 }
 
@@ -217,64 +203,70 @@ asylo::ThreadManager::ThreadOptions CreateOptions(
   return options;
 }
 
+// Wakes the threads whose parkers are queued in |list|, and frees |list|.
+void UnparkAll(__pthread_list_t *list) {
+  QueueOperations queue(list);
+  while (!queue.Empty()) {
+    ThreadParker::FromToken(queue.Front())->Unpark();
+    queue.Dequeue();
+  }
+}
+
 // Acquires |rwlock| with a read lock or a write lock if |TryLockFunc| is
 // set to pthread_rwlock_tryrdlock_internal() or
-// pthread_rwlock_trywrlock_internal() respectively.
-template <int(TryLockFunc)(pthread_rwlock_t *)>
+// pthread_rwlock_trywrlock_internal() respectively. If |rwlock| cannot be
+// acquired after spinning briefly, queues the calling thread, which is handed
+// the lock by the thread unlocking |rwlock|.
+template <int(TryLockFunc)(pthread_rwlock_t *), bool kExclusive>
 int pthread_rwlock_lock(pthread_rwlock_t *rwlock) {
   if (!asylo::primitives::IsValidEnclaveAddress<pthread_rwlock_t>(rwlock)) {
     return ConvertToErrno(EFAULT);
   }
 
-#ifdef _ASYLO_PTHREAD_RWLOCK_TRANSITIONAL_FLAG
-  if (!rwlock->_untrusted_wait_queue) {
+  int ret = 0;
+  {
     LockableGuard lock_guard(rwlock);
-    initialize_wait_queue(&rwlock->_untrusted_wait_queue);
+    ret = TryLockFunc(rwlock);
+  }
+  if (ret != EBUSY) {
+    return ret;
   }
-#endif
 
-  const pthread_t self = pthread_self();
-  asylo::pthread_impl::QueueOperations queue(rwlock);
-  int ret = 0;
+  if (ThreadParker::Spin([rwlock] {
+        LockableGuard lock_guard(rwlock);
+        return TryLockFunc(rwlock) == 0;
+      })) {
+    return 0;
+  }
+
+  ThreadParker *parker = ThreadParker::Self();
+  parker->Prepare(kExclusive);
   {
     LockableGuard lock_guard(rwlock);
     ret = TryLockFunc(rwlock);
-    if (ret == 0) {
-      return 0;
-    }
-    if (queue.Contains(self)) {
-      return EDEADLK;
+    if (ret != EBUSY) {
+      return ret;
     }
+    QueueOperations(rwlock).Enqueue(parker->Token());
   }
+  // The unlocking thread acquires |rwlock| on behalf of this thread before
+  // unparking it.
+  parker->Park(/*deadline=*/nullptr);
+  return 0;
+}
 
-  while (ret == EBUSY) {
-    for (int i = 0; i < kNumSpinLockAttempts; i++) {
-      {
-        LockableGuard lock_guard(rwlock);
-        ret = TryLockFunc(rwlock);
-        if (ret == 0) {
-          return 0;
-        }
-      }
-    }
-    {
-      LockableGuard lock_guard(rwlock);
-      queue.Enqueue(self);
-    }
-#ifdef _ASYLO_PTHREAD_RWLOCK_TRANSITIONAL_FLAG
-    if (rwlock->_untrusted_wait_queue) {
-      enc_untrusted_thread_wait(rwlock->_untrusted_wait_queue);
-    }
-#else
-    enc_pause();
-#endif
-    {
-      LockableGuard lock_guard(rwlock);
-      queue.Remove(self);
+// Removes |parker| from the queue of |cond| after its wait was abandoned.
+// Returns false if a signal dequeued the parker first, in which case the
+// signal has been consumed.
+bool pthread_cond_cancel_wait(pthread_cond_t *cond, ThreadParker *parker) {
+  {
+    LockableGuard lock_guard(cond);
+    if (QueueOperations(cond).Remove(parker->Token())) {
+      return true;
     }
   }
-
-  return ret;
+  parker->AwaitUnpark();
+  return false;
 }
 
 void pthread_tsd_run_destructors() {
@@ -411,6 +403,118 @@ bool QueueOperations::Empty() const {
   return current == nullptr;
 }
 
+__pthread_list_t QueueOperations::TakeFront(int count) {
+  __pthread_list_t taken = PTHREAD_LIST_INITIALIZER;
+  __pthread_list_node_t **tail = &taken._first;
+  for (; count > 0 && list_->_first; --count) {
+    __pthread_list_node_t *node = list_->_first;
+    list_->_first = node->_next;
+    node->_next = nullptr;
+    *tail = node;
+    tail = &node->_next;
+  }
+  return taken;
+}
+
+ThreadParker *ThreadParker::Self() {
+  // ThreadParker is trivially destructible, so the parker of a thread is
+  // released with its thread local storage.
+  static thread_local ThreadParker parker;
+  if (parker.thread_ == PTHREAD_T_NULL) {
+    parker.thread_ = pthread_self();
+  }
+  return &parker;
+}
+
+void ThreadParker::Prepare(bool exclusive) {
+  // Untrusted wait queues cannot be created during enclave startup, in which
+  // case the thread spins instead of sleeping.
+  if (!futex_word_ && GetState() == EnclaveState::kRunning) {
+    futex_word_ = enc_untrusted_create_wait_queue();
+  }
+  exclusive_ = exclusive;
+  state_.store(kWaiting, std::memory_order_relaxed);
+}
+
+bool ThreadParker::Park(const struct timespec *deadline) {
+  bool notified = SpinUntilNotified() || Sleep(deadline);
+  if (notified) {
+    state_.store(kIdle, std::memory_order_relaxed);
+  }
+  return notified;
+}
+
+void ThreadParker::AwaitUnpark() {
+  while (state_.load(std::memory_order_acquire) != kNotified) {
+    enc_pause();
+  }
+  state_.store(kIdle, std::memory_order_relaxed);
+}
+
+void ThreadParker::Unpark() {
+  // Read before notifying, since the parker may be released by its thread as
+  // soon as it is notified. The futex word itself is never freed.
+  int32_t *futex_word = futex_word_;
+  if (state_.exchange(kNotified, std::memory_order_seq_cst) == kSleeping &&
+      futex_word) {
+    __atomic_fetch_add(futex_word, 1, __ATOMIC_SEQ_CST);
+    enc_untrusted_sys_futex_wake(futex_word, 1);
+  }
+}
+
+void ThreadParker::AdjustSpinLimit(bool succeeded) {
+  spin_limit_ = succeeded ? std::min(2 * spin_limit_, kMaxSpinLimit)
+                          : std::max(spin_limit_ / 2, kMinSpinLimit);
+}
+
+bool ThreadParker::SpinUntilNotified() {
+  for (int i = 0; i < spin_limit_; ++i) {
+    if (state_.load(std::memory_order_acquire) == kNotified) {
+      return true;
+    }
+    enc_pause();
+  }
+  return false;
+}
+
+bool ThreadParker::Sleep(const struct timespec *deadline) {
+  int32_t expected = kWaiting;
+  if (!state_.compare_exchange_strong(expected, kSleeping,
+                                      std::memory_order_seq_cst)) {
+    return true;
+  }
+  while (true) {
+    // Read the futex word before the state, so that an Unpark() which is not
+    // observed below changes the word and interrupts the wait.
+    int32_t futex_value =
+        futex_word_ ? __atomic_load_n(futex_word_, __ATOMIC_SEQ_CST) : 0;
+    if (state_.load(std::memory_order_seq_cst) == kNotified) {
+      return true;
+    }
+
+    // A wait for 0 microseconds will actually wait indefinitely.
+    uint64_t time_left_micros = 0;
+    if (deadline) {
+      timespec curr_time;
+      timespec time_left;
+      // TimeSpecSubtract returns true if deadline < curr_time.
+      if (clock_gettime(CLOCK_REALTIME, &curr_time) != 0 ||
+          TimeSpecSubtract(*deadline, curr_time, &time_left) ||
+          (time_left_micros = TimeSpecToMicroseconds(&time_left)) == 0) {
+        expected = kSleeping;
+        return !state_.compare_exchange_strong(expected, kIdle,
+                                               std::memory_order_seq_cst);
+      }
+    }
+
+    if (futex_word_) {
+      enc_untrusted_sys_futex_wait(futex_word_, futex_value, time_left_micros);
+    } else {
+      enc_pause();
+    }
+  }
+}
+
 }  //  namespace pthread_impl
 }  //  namespace asylo
 
@@ -561,47 +665,43 @@ int pthread_mutex_destroy(pthread_mutex_t *mutex) {
   return 0;
 }
 
-// Locks |mutex|.
+// Locks |mutex|. If |mutex| is held after spinning briefly, queues the calling
+// thread, which is handed |mutex| by the thread unlocking it.
 int pthread_mutex_lock(pthread_mutex_t *mutex) {
   int ret = pthread_mutex_check_parameter(mutex);
   if (ret != 0) {
     return ret;
   }
 
-  const pthread_t self = pthread_self();
-  asylo::pthread_impl::QueueOperations list(mutex);
-
-  if (!mutex->_untrusted_wait_queue) {
+  {
     LockableGuard lock_guard(mutex);
-    // Ensure that the external wait queue is initialized
-    initialize_wait_queue(&mutex->_untrusted_wait_queue);
+    if (pthread_mutex_lock_internal(mutex) == 0) {
+      return 0;
+    }
   }
 
-  while (true) {
-    for (int i = 0; i < kNumSpinLockAttempts; i++) {
-      {
-        LockableGuard lock_guard(mutex);
-        ret = pthread_mutex_lock_internal(mutex);
-      }
-      if (ret == 0) {
-        return ret;
-      }
-    }
-    // Sleep on an untrusted wait queue until woken up. Waiting will
-    // be enabled if the lock is held, as the holder of the lock is
-    // responsible for enabling and disabling waiting.
-    if (mutex->_untrusted_wait_queue) {
-      {
-        LockableGuard lock_guard(mutex);
-        list.Enqueue(self);
-      }
-      enc_untrusted_thread_wait(mutex->_untrusted_wait_queue);
-      {
+  if (ThreadParker::Spin([mutex] {
+        if (!pthread_mutex_maybe_unlocked(mutex)) {
+          return false;
+        }
         LockableGuard lock_guard(mutex);
-        list.Remove(self);
-      }
+        return pthread_mutex_lock_internal(mutex) == 0;
+      })) {
+    return 0;
+  }
+
+  ThreadParker *parker = ThreadParker::Self();
+  parker->Prepare();
+  {
+    LockableGuard lock_guard(mutex);
+    if (pthread_mutex_lock_internal(mutex) == 0) {
+      return 0;
     }
+    QueueOperations(mutex).Enqueue(parker->Token());
   }
+  // The unlocking thread makes this thread the owner before unparking it.
+  parker->Park(/*deadline=*/nullptr);
+  return 0;
 }
 
 int pthread_mutex_trylock(pthread_mutex_t *mutex) {
@@ -622,30 +722,37 @@ int pthread_mutex_unlock(pthread_mutex_t *mutex) {
     return ret;
   }
 
-  asylo::pthread_impl::QueueOperations list(mutex);
-  LockableGuard lock_guard(mutex);
+  ThreadParker *next = nullptr;
+  {
+    QueueOperations list(mutex);
+    LockableGuard lock_guard(mutex);
 
-  if (mutex->_owner == PTHREAD_T_NULL) {
-    return EINVAL;
-  }
+    if (mutex->_owner == PTHREAD_T_NULL) {
+      return EINVAL;
+    }
 
-  if (mutex->_owner != pthread_self()) {
-    return EPERM;
-  }
+    if (mutex->_owner != pthread_self()) {
+      return EPERM;
+    }
 
-  mutex->_refcount--;
-  // If we change state from locked to unlocked
-  if (mutex->_refcount == 0) {
-    mutex->_owner = PTHREAD_T_NULL;
-    if (mutex->_untrusted_wait_queue) {
-      enc_untrusted_disable_waiting(mutex->_untrusted_wait_queue);
-      // Only notify if there is a thread to notify
-      if (!list.Empty()) {
-        enc_untrusted_notify(mutex->_untrusted_wait_queue);
-      }
+    mutex->_refcount--;
+    if (mutex->_refcount > 0) {
+      return 0;
     }
+
+    // An uncontended mutex is simply released. Otherwise, it is handed to the
+    // first waiter, so that waiters acquire it in FIFO order.
+    if (list.Empty()) {
+      mutex->_owner = PTHREAD_T_NULL;
+      return 0;
+    }
+    next = ThreadParker::FromToken(list.Front());
+    list.Dequeue();
+    mutex->_owner = next->Thread();
+    mutex->_refcount = 1;
   }
 
+  next->Unpark();
   return 0;
 }
 
@@ -700,129 +807,21 @@ int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
     return EFAULT;
   }
 
-  // Get the current thread ID to use as a wait queue value, truncated
-  // to 32 bits to fit in the wait queue state.
-  const pthread_t self = pthread_self();
-
-#ifdef _ASYLO_PTHREAD_COND_TRANSITIONAL_FLAG
-  // Use a global atomic counter to enumerate each thread. This generates a
-  // thread-specific 32 bit unique identifier for each thread, which is not the
-  // address of anything, and thus safer to expose outside the enclave (relative
-  // to some implementations of pthread_self()).
-  static std::atomic<int32_t> thread_counter(1);
-  thread_local int32_t self_32 =
-      thread_counter.fetch_add(1, std::memory_order_relaxed);
-
-  if (!cond->_untrusted_wait_queue) {
-    // initialize wait queue
-    LockableGuard lock_guard(cond);
-    initialize_wait_queue(&cond->_untrusted_wait_queue);
-  }
-#endif
-
-  asylo::pthread_impl::QueueOperations list(cond);
-  // Store a thread-specific unique ID to the wait queue. This allows wait to be
-  // atomic, as any other thread signalling a wakeup will overwrite this value
-  // with a different thread unique ID, disabling this thread from sleeping.
+  ThreadParker *parker = ThreadParker::Self();
+  parker->Prepare();
   {
     LockableGuard lock_guard(cond);
-#ifdef _ASYLO_PTHREAD_COND_TRANSITIONAL_FLAG
-    if (cond->_untrusted_wait_queue) {
-      enc_untrusted_wait_queue_set_value(cond->_untrusted_wait_queue, self_32);
-    }
-#endif
-    list.Enqueue(self);
+    QueueOperations(cond).Enqueue(parker->Token());
   }
 
   int ret = pthread_mutex_unlock(mutex);
   if (ret != 0) {
+    pthread_cond_cancel_wait(cond, parker);
     return ret;
   }
 
-#ifdef _ASYLO_PTHREAD_COND_TRANSITIONAL_FLAG
-  // A wait for 0 microseconds will actually wait indefinitely.
-  uint64_t time_left_micros = 0;
-  if (deadline) {
-    timespec curr_time;
-    ret = clock_gettime(CLOCK_REALTIME, &curr_time);
-    if (ret != 0) {
-      pthread_mutex_lock(mutex);
-      return ret;
-    }
-
-    // TimeSpecSubtract returns true if deadline < curr_time.
-    timespec time_left;
-    if (asylo::TimeSpecSubtract(*deadline, curr_time, &time_left)) {
-      pthread_mutex_lock(mutex);
-      return ETIMEDOUT;
-    }
-    time_left_micros = asylo::TimeSpecToMicroseconds(&time_left);
-
-    // Timeout if we're exactly at the deadline. Otherwise we'd sleep for 0
-    // microseconds, which is an indefinite sleep.
-    if (time_left_micros == 0) {
-      pthread_mutex_lock(mutex);
-      return ETIMEDOUT;
-    }
-  }
-  // Sleep on the wait queue until either the timeout occurs, or a wakeup
-  // occurs.
-  if (cond->_untrusted_wait_queue) {
-    enc_untrusted_thread_wait_value(cond->_untrusted_wait_queue, self_32,
-                                    time_left_micros);
-  }
-  {
-    LockableGuard lock_guard(cond);
-    list.Remove(self);
-  }
-
-  if (deadline) {
-    // Check if awoken up due to timeout.
-    timespec curr_time;
-    ret = clock_gettime(CLOCK_REALTIME, &curr_time);
-    if (ret != 0) {
-      pthread_mutex_lock(mutex);
-      return ret;
-    }
-
-    // TimeSpecSubtract returns true if deadline < curr_time.
-    timespec time_left;
-    if (asylo::TimeSpecSubtract(*deadline, curr_time, &time_left)) {
-      pthread_mutex_lock(mutex);
-      return ETIMEDOUT;
-    }
-  }
-
-  return pthread_mutex_lock(mutex);
-#else
-  while (true) {
-    enc_untrusted_sched_yield();
-
-    // If a deadline has been specified, check to see if it has passed.
-    if (deadline) {
-      timespec curr_time;
-      ret = clock_gettime(CLOCK_REALTIME, &curr_time);
-      if (ret != 0) {
-        break;
-      }
-
-      // TimeSpecSubtract returns true if deadline < curr_time.
-      timespec time_left;
-      if (asylo::TimeSpecSubtract(*deadline, curr_time, &time_left)) {
-        ret = ETIMEDOUT;
-        break;
-      }
-    }
-
-    LockableGuard lock_guard(cond);
-    if (!list.Contains(self)) {
-      break;
-    }
-  }
-
-  {
-    LockableGuard lock_guard(cond);
-    list.Remove(self);
+  if (!parker->Park(deadline) && pthread_cond_cancel_wait(cond, parker)) {
+    ret = ETIMEDOUT;
   }
 
   // Only set the retval to be the result of re-locking the mutex if there isn't
@@ -834,7 +833,6 @@ int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
     return ret;
   }
   return relock_ret;
-#endif
 }
 
 // Blocks until the given |cond| is signaled or broadcasted. |mutex| must  be
@@ -853,28 +851,12 @@ int pthread_cond_notify_internal(pthread_cond_t *cond, int num_threads) {
     return EFAULT;
   }
 
-#ifdef _ASYLO_PTHREAD_COND_TRANSITIONAL_FLAG
-  // If there is no queue, there is no way for other threads to be asleep on
-  // that queue, and thus there is nothing to do.
-  if (cond->_untrusted_wait_queue != nullptr) {
-    asylo::pthread_impl::QueueOperations list(cond);
-    const int32_t self = static_cast<int32_t>(pthread_self());
+  __pthread_list_t woken;
+  {
     LockableGuard lock_guard(cond);
-    enc_untrusted_wait_queue_set_value(cond->_untrusted_wait_queue, self);
-    if (!list.Empty()) {
-      enc_untrusted_notify(cond->_untrusted_wait_queue, num_threads);
-    }
+    woken = QueueOperations(cond).TakeFront(num_threads);
   }
-#else
-  LockableGuard lock_guard(cond);
-  asylo::pthread_impl::QueueOperations list(cond);
-  if (num_threads == 1 && !list.Empty()) {
-    list.Dequeue();
-  } else {
-    // only called with 1 and INT_MAX
-    list.Clear();
-  }
-#endif
+  UnparkAll(&woken);
   return 0;
 }
 
@@ -979,13 +961,16 @@ int sem_timedwait(sem_t *sem, const timespec *abs_timeout) {
 int sem_wait(sem_t *sem) { return sem_timedwait(sem, nullptr); }
 
 int sem_trywait(sem_t *sem) {
-  struct timespec deadline = {0, 0};
-  int ret = sem_timedwait(sem, &deadline);
-  if (ret != 0 && errno == ETIMEDOUT) {
-    errno = EAGAIN;
+  if (!asylo::primitives::IsValidEnclaveAddress<sem_t>(sem)) {
+    return ConvertToErrno(EFAULT);
   }
 
-  return ret;
+  asylo::pthread_impl::PthreadMutexLock lock(&sem->mu_);
+  if (sem->count_ == 0) {
+    return ConvertToErrno(EAGAIN);
+  }
+  sem->count_--;
+  return 0;
 }
 
 int sem_destroy(sem_t *sem) {
@@ -1036,11 +1021,13 @@ int pthread_rwlock_trywrlock(pthread_rwlock_t *rwlock) {
 }
 
 int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock) {
-  return pthread_rwlock_lock<pthread_rwlock_tryrdlock_internal>(rwlock);
+  return pthread_rwlock_lock<pthread_rwlock_tryrdlock_internal,
+                             /*kExclusive=*/false>(rwlock);
 }
 
 int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock) {
-  return pthread_rwlock_lock<pthread_rwlock_trywrlock_internal>(rwlock);
+  return pthread_rwlock_lock<pthread_rwlock_trywrlock_internal,
+                             /*kExclusive=*/true>(rwlock);
 }
 
 int pthread_rwlock_unlock(pthread_rwlock_t *rwlock) {
@@ -1048,32 +1035,39 @@ int pthread_rwlock_unlock(pthread_rwlock_t *rwlock) {
     return ConvertToErrno(EFAULT);
   }
 
-  asylo::pthread_impl::QueueOperations list(rwlock);
-  LockableGuard lock_guard(rwlock);
+  __pthread_list_t granted = PTHREAD_LIST_INITIALIZER;
+  {
+    QueueOperations queue(rwlock);
+    LockableGuard lock_guard(rwlock);
 
-  const pthread_t self = pthread_self();
-  if (rwlock->_write_owner == self) {
-    rwlock->_write_owner = PTHREAD_T_NULL;
-#ifdef _ASYLO_PTHREAD_RWLOCK_TRANSITIONAL_FLAG
-    if (rwlock->_untrusted_wait_queue) {
-      enc_untrusted_disable_waiting(rwlock->_untrusted_wait_queue);
-      if (!list.Empty()) {
-        enc_untrusted_notify(rwlock->_untrusted_wait_queue);
-      }
+    if (rwlock->_write_owner == pthread_self()) {
+      rwlock->_write_owner = PTHREAD_T_NULL;
+    } else {
+      rwlock->_reader_count--;
     }
-#endif
-    return 0;
-  }
 
-  rwlock->_reader_count--;
-#ifdef _ASYLO_PTHREAD_RWLOCK_TRANSITIONAL_FLAG
-  if (rwlock->_reader_count == 0 && rwlock->_untrusted_wait_queue) {
-    enc_untrusted_disable_waiting(rwlock->_untrusted_wait_queue);
-    if (!list.Empty()) {
-      enc_untrusted_notify(rwlock->_untrusted_wait_queue);
+    // Once |rwlock| is released, hand it to the first waiter if it is a
+    // writer, or else to every reader queued before the next writer.
+    if (rwlock->_write_owner == PTHREAD_T_NULL &&
+        rwlock->_reader_count == 0 && !queue.Empty()) {
+      ThreadParker *front = ThreadParker::FromToken(queue.Front());
+      if (front->exclusive()) {
+        rwlock->_write_owner = front->Thread();
+        granted = queue.TakeFront(1);
+      } else {
+        int readers = 0;
+        for (__pthread_list_node_t *node = rwlock->_queue._first;
+             node && !ThreadParker::FromToken(node->_thread_id)->exclusive();
+             node = node->_next) {
+          readers++;
+        }
+        rwlock->_reader_count += readers;
+        granted = queue.TakeFront(readers);
+      }
     }
   }
-#endif
+
+  UnparkAll(&granted);
   return 0;
 }
 
@@ -20,8 +20,13 @@
 #define ASYLO_PLATFORM_POSIX_PTHREAD_IMPL_H_
 
 #include <pthread.h>
+#include <time.h>
+
+#include <atomic>
+#include <cstdint>
 #include <functional>
 
+#include "asylo/platform/primitives/trusted_runtime.h"
 #include "asylo/util/logging.h"
 
 namespace asylo {
@@ -51,6 +56,10 @@ class QueueOperations {
   // Removes all ids from the list.
   void Clear();
 
+  // Removes up to |count| ids from the front of the list and returns them, in
+  // order, as a list owned by the caller.
+  __pthread_list_t TakeFront(int count);
+
   // Returns true of the |id| is in the list.
   bool Contains(const pthread_t id) const;
 
@@ -64,6 +73,112 @@ class QueueOperations {
   __pthread_list_t *const list_;
 };
 
+// Blocks and wakes threads on behalf of the pthread synchronization primitives.
+// Each thread owns one parker. A thread waiting on a primitive queues its
+// parker on the primitive, and the thread releasing the primitive hands it
+// directly to the first queued thread, in FIFO order, by unparking it.
+//
+// Parking spins for a bounded, adaptive time before sleeping on a futex word in
+// untrusted memory. Whether a parker is notified is only ever decided by the
+// trusted state of the parker, so the host can delay a parked thread but cannot
+// wake it early. Unpark() only exits the enclave if the thread is sleeping.
+class ThreadParker {
+ public:
+  // Returns the parker of the calling thread.
+  static ThreadParker *Self();
+
+  // Returns the parker |token| was obtained from.
+  static ThreadParker *FromToken(pthread_t token) {
+    return reinterpret_cast<ThreadParker *>(token);
+  }
+
+  // Returns an identifier of the parker suitable for queueing on a primitive.
+  pthread_t Token() { return reinterpret_cast<pthread_t>(this); }
+
+  // Returns the thread owning the parker.
+  pthread_t Thread() const { return thread_; }
+
+  // Prepares the calling thread to park. Must be called by the owning thread
+  // before the parker is queued on a primitive, and without holding the lock
+  // of a primitive, since it may exit the enclave on first use. |exclusive|
+  // records whether the thread waits for exclusive ownership, for primitives
+  // which may grant shared ownership to several waiters at once.
+  void Prepare(bool exclusive = true);
+
+  // Returns whether the thread waits for exclusive ownership.
+  bool exclusive() const { return exclusive_; }
+
+  // Blocks the calling thread until the parker is unparked or, if |deadline|
+  // is not null, the CLOCK_REALTIME time |deadline| passes. Returns true if the
+  // parker was unparked. A caller which times out must dequeue the parker
+  // itself, and call AwaitUnpark() if it was dequeued by another thread first.
+  bool Park(const struct timespec *deadline);
+
+  // Waits for an Unpark() racing with a timed out Park() to complete.
+  void AwaitUnpark();
+
+  // Wakes the thread parked on the parker. The parker must have been dequeued
+  // by the caller. Must not be called on the parker again until it has been
+  // queued again.
+  void Unpark();
+
+  // Spins for up to the adaptive spin budget of the calling thread until
+  // |done| returns true. Returns the final result of |done|.
+  template <typename Predicate>
+  static bool Spin(Predicate done) {
+    ThreadParker *self = Self();
+    for (int i = 0; i < self->spin_limit_; ++i) {
+      if (done()) {
+        self->AdjustSpinLimit(/*succeeded=*/true);
+        return true;
+      }
+      enc_pause();
+    }
+    bool result = done();
+    self->AdjustSpinLimit(result);
+    return result;
+  }
+
+ private:
+  // States of a parker.
+  static constexpr int32_t kIdle = 0;
+  static constexpr int32_t kWaiting = 1;
+  static constexpr int32_t kSleeping = 2;
+  static constexpr int32_t kNotified = 3;
+
+  // Bounds and initial value of the spin budget, in pause instructions.
+  static constexpr int kMinSpinLimit = 8;
+  static constexpr int kMaxSpinLimit = 512;
+  static constexpr int kInitialSpinLimit = 64;
+
+  // Doubles the spin budget of the thread after spinning succeeded, and halves
+  // it after spinning failed.
+  void AdjustSpinLimit(bool succeeded);
+
+  // Spins for up to the spin budget of the thread until the parker is
+  // notified. Returns true if it was.
+  bool SpinUntilNotified();
+
+  // Sleeps on |futex_word_| until the parker is notified or |deadline|
+  // passes. Returns true if the parker was notified.
+  bool Sleep(const struct timespec *deadline);
+
+  std::atomic<int32_t> state_{kIdle};
+
+  // The thread owning the parker.
+  pthread_t thread_ = PTHREAD_T_NULL;
+
+  // Futex word in untrusted memory the thread sleeps on, allocated on first
+  // use. Unpark() increments it before waking the thread.
+  int32_t *futex_word_ = nullptr;
+
+  // Number of pause instructions to spin for before sleeping. Only accessed
+  // by the owning thread.
+  int spin_limit_ = kInitialSpinLimit;
+
+  bool exclusive_ = true;
+};
+
 // Provides an RAII wrapper around pthread_mutex_t. Aborts on errors, so should
 // only be used for locks that are internal to pthread.cc, where errors indicate
 // internal implementation errors. Should not be used for user-provided mutexes
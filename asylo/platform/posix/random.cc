@@ -0,0 +1,41 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include <errno.h>
+#include <sys/random.h>
+
+#include "asylo/platform/primitives/util/trusted_drbg.h"
+
+extern "C" {
+
+// Fills |buf| from the calling thread's in-enclave generator, without an exit
+// to the host.
+ssize_t getrandom(void *buf, size_t buflen, unsigned int flags) {
+  if (flags & ~(GRND_NONBLOCK | GRND_RANDOM)) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (!asylo::primitives::TrustedDrbgRandomBytes(buf, buflen)) {
+    errno = ENOSYS;
+    return -1;
+  }
+  return buflen;
+}
+
+}  // extern "C"
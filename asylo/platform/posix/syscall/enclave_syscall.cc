@@ -18,6 +18,8 @@
 
 #include "asylo/platform/posix/syscall/enclave_syscall.h"
 
+#include <sys/random.h>
+
 #include <cerrno>
 
 #include "asylo/platform/host_call/trusted/host_calls.h"
@@ -295,6 +297,8 @@ int64_t EnclaveSyscallWithDeps(int sysno, uint64_t* args, size_t nargs,
       return asylo::RtSigprocmask(
           args[0], reinterpret_cast<const sigset_t *>(args[1]),
           reinterpret_cast<sigset_t *>(args[2]), args[3]);
+    case asylo::system_call::kSYS_getrandom:
+      return getrandom(reinterpret_cast<void *>(args[0]), args[1], args[2]);
     case asylo::system_call::kSYS_kill:
           return enc_untrusted_kill(args[0], static_cast<int>(args[1]));
     case asylo::system_call::kSYS_exit:
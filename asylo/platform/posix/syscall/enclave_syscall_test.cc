@@ -18,6 +18,11 @@
 
 #include "asylo/platform/posix/syscall/enclave_syscall.h"
 
+#include <errno.h>
+#include <sys/random.h>
+
+#include <cstring>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "asylo/platform/posix/syscall/enclave_syscall_helper.h"
@@ -1116,6 +1121,32 @@ TEST_F(EnclaveSyscallTest, EnclaveSyscallRecvFrom) {
                                        6, helper, io_manager));
 }
 
+// Tests that getrandom is served inside the enclave, without a host call.
+TEST_F(EnclaveSyscallTest, EnclaveSyscallGetrandom) {
+  uint8_t buf[64] = {};
+  uint8_t zeros[sizeof(buf)] = {};
+
+  uint64_t args[] = {reinterpret_cast<uint64_t>(buf), sizeof(buf),
+                     GRND_NONBLOCK};
+
+  EXPECT_CALL(*helper, DispatchSyscall).Times(Exactly(0));
+
+  EXPECT_EQ(static_cast<int64_t>(sizeof(buf)),
+            EnclaveSyscallWithDeps(asylo::system_call::kSYS_getrandom, args, 3,
+                                   helper, io_manager));
+  EXPECT_NE(0, memcmp(buf, zeros, sizeof(buf)));
+}
+
+TEST_F(EnclaveSyscallTest, EnclaveSyscallGetrandomRejectsUnknownFlags) {
+  uint8_t buf[16];
+
+  uint64_t args[] = {reinterpret_cast<uint64_t>(buf), sizeof(buf), 0x80};
+
+  EXPECT_EQ(-1, EnclaveSyscallWithDeps(asylo::system_call::kSYS_getrandom,
+                                       args, 3, helper, io_manager));
+  EXPECT_EQ(EINVAL, errno);
+}
+
 }  // namespace
 }  // namespace system_call
 }  // namespace asylo
@@ -608,6 +608,24 @@ TEST_F(SyscallsTest, RlimitInvalidNoFile) {
               IsOk());
 }
 
+// Tests setrlimit() with RLIMIT_NOFILE by raising the soft limit past the
+// default, and checking that file descriptors above it can be used.
+TEST_F(SyscallsTest, RlimitHighNoFile) {
+  EXPECT_THAT(RunSyscallInsideEnclave(
+                  "rlimit high nofile",
+                  absl::GetFlag(FLAGS_test_tmpdir) + "/rlimit", nullptr),
+              IsOk());
+}
+
+// Tests that dup2() rejects a target file descriptor which is not below the
+// RLIMIT_NOFILE soft limit.
+TEST_F(SyscallsTest, Dup2BeyondRlimit) {
+  EXPECT_THAT(RunSyscallInsideEnclave(
+                  "dup2 beyond rlimit",
+                  absl::GetFlag(FLAGS_test_tmpdir) + "/dup2", nullptr),
+              IsOk());
+}
+
 //////////////////////////////////////
 //          sys/socket.h            //
 //////////////////////////////////////
@@ -972,6 +990,17 @@ TEST_F(SyscallsTest, Writev) {
       IsOk());
 }
 
+// Tests pwritev() and preadv() by writing a scattered array at an offset in a
+// file inside the enclave, and then reading it back at the same offset into
+// differently split buffers.
+TEST_F(SyscallsTest, PreadvPwritev) {
+  EXPECT_THAT(RunSyscallInsideEnclave(
+                  "preadv_pwritev",
+                  absl::GetFlag(FLAGS_test_tmpdir) + "/preadv_pwritev",
+                  nullptr),
+              IsOk());
+}
+
 //////////////////////////////////////
 //          sys/utsname.h           //
 //////////////////////////////////////
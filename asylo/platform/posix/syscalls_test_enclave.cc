@@ -96,6 +96,10 @@ class SyscallsEnclave : public EnclaveTestCase {
       return RunRlimitLowNoFileTest(test_input.path_name());
     } else if (test_input.test_target() == "rlimit invalid nofile") {
       return RunRlimitInvalidNoFileTest(test_input.path_name());
+    } else if (test_input.test_target() == "rlimit high nofile") {
+      return RunRlimitHighNoFileTest(test_input.path_name());
+    } else if (test_input.test_target() == "dup2 beyond rlimit") {
+      return RunDup2BeyondRlimitTest(test_input.path_name());
     } else if (test_input.test_target() == "getpeername_ebadf") {
       return RunGetPeernameFailureTest_EBADF();
     } else if (test_input.test_target() == "getpeername_efault") {
@@ -136,6 +140,8 @@ class SyscallsEnclave : public EnclaveTestCase {
       return RunReadvTest(test_input.path_name());
     } else if (test_input.test_target() == "writev") {
       return RunWritevTest(test_input.path_name());
+    } else if (test_input.test_target() == "preadv_pwritev") {
+      return RunPreadvPwritevTest(test_input.path_name());
     } else if (test_input.test_target() == "uname") {
       return RunUnameTest(output);
     } else if (test_input.test_target() == "dup") {
@@ -820,8 +826,8 @@ class SyscallsEnclave : public EnclaveTestCase {
 
     // setrlimit should fail if the limit is set to be greater than the maximum
     // allowed file descriptor number inside the enclave.
-    set_limit.rlim_cur = 2000;
-    set_limit.rlim_max = 2000;
+    set_limit.rlim_cur = 100000;
+    set_limit.rlim_max = 100000;
     if (setrlimit(RLIMIT_NOFILE, &set_limit) != -1) {
       return Status(absl::StatusCode::kInternal,
                     "setrlimit with limit higher than the maximum allowed "
@@ -857,6 +863,70 @@ class SyscallsEnclave : public EnclaveTestCase {
     return absl::OkStatus();
   }
 
+  Status RunRlimitHighNoFileTest(const std::string &path) {
+    constexpr int soft_limit = 4096;
+    struct rlimit set_limit;
+    if (getrlimit(RLIMIT_NOFILE, &set_limit) != 0) {
+      return LastPosixError("getrlimit failed");
+    }
+    set_limit.rlim_cur = soft_limit;
+    if (setrlimit(RLIMIT_NOFILE, &set_limit) != 0) {
+      return LastPosixError("setrlimit failed");
+    }
+
+    const std::string message = path;
+    int fd;
+    ASYLO_ASSIGN_OR_RETURN(fd, OpenFile(path, O_CREAT | O_RDWR, 0644));
+    platform::storage::FdCloser fd_closer(fd);
+    ssize_t rc = write(fd, message.c_str(), message.size());
+    if (rc != message.size()) {
+      return LastPosixError(absl::StrCat("Write to file:", path, " failed"));
+    }
+
+    // File descriptors past the first 1024 should be usable once the soft
+    // limit allows them.
+    int dup_fd = fcntl(fd, F_DUPFD, 1500);
+    if (dup_fd < 1500 || dup_fd >= soft_limit) {
+      return LastPosixError(
+          absl::StrCat("fcntl F_DUPFD fd:", fd, " returned fd:", dup_fd));
+    }
+    platform::storage::FdCloser dup_fd_closer(dup_fd);
+    ASYLO_RETURN_IF_ERROR(CompareFiles(fd, dup_fd, message.size()));
+
+    int newfd = soft_limit - 1;
+    int dup2_fd = dup2(fd, newfd);
+    if (dup2_fd != newfd) {
+      return LastPosixError(
+          absl::StrCat("dup2 fd:", fd, " to fd:", newfd, " failed"));
+    }
+    platform::storage::FdCloser dup2_fd_closer(dup2_fd);
+    ASYLO_RETURN_IF_ERROR(CompareFiles(fd, dup2_fd, message.size()));
+    return absl::OkStatus();
+  }
+
+  Status RunDup2BeyondRlimitTest(const std::string &path) {
+    int fd;
+    ASYLO_ASSIGN_OR_RETURN(fd, OpenFile(path, O_CREAT | O_RDWR, 0644));
+    platform::storage::FdCloser fd_closer(fd);
+    struct rlimit get_limit;
+    if (getrlimit(RLIMIT_NOFILE, &get_limit) != 0) {
+      return LastPosixError("getrlimit failed");
+    }
+
+    // dup2 should fail with EBADF if |newfd| is not below the soft limit, even
+    // though the table could hold it.
+    for (int newfd : {static_cast<int>(get_limit.rlim_cur), -1}) {
+      errno = 0;
+      if (dup2(fd, newfd) != -1 || errno != EBADF) {
+        return Status(absl::StatusCode::kInternal,
+                      absl::StrCat("dup2 fd:", fd, " to fd:", newfd,
+                                   " beyond the soft limit did not fail with "
+                                   "EBADF"));
+      }
+    }
+    return absl::OkStatus();
+  }
+
   //////////////////////////////////////
   //          sys/socket.h            //
   //////////////////////////////////////
@@ -1243,6 +1313,55 @@ class SyscallsEnclave : public EnclaveTestCase {
     return absl::OkStatus();
   }
 
+  Status RunPreadvPwritevTest(const std::string &path) {
+    int fd;
+    ASYLO_ASSIGN_OR_RETURN(fd, OpenFile(path, O_CREAT | O_RDWR, 0644));
+    platform::storage::FdCloser fd_closer(fd);
+    constexpr off_t offset = 5;
+    const std::string message1 = "First pwritev message";
+    const std::string message2 = "Second pwritev message";
+    const std::string message = message1 + message2;
+    struct iovec write_iov[2];
+    write_iov[0].iov_base = const_cast<char *>(message1.c_str());
+    write_iov[0].iov_len = message1.size();
+    write_iov[1].iov_base = const_cast<char *>(message2.c_str());
+    write_iov[1].iov_len = message2.size();
+    ssize_t rc = pwritev(fd, write_iov, 2, offset);
+    if (rc != message.size()) {
+      return LastPosixError(absl::StrCat(
+          "pwritev return:", rc, " does not match message size:",
+          message.size()));
+    }
+
+    // Read the message back split at a different point than it was written.
+    std::vector<char> buf1(message.size() / 3);
+    std::vector<char> buf2(message.size() - buf1.size());
+    struct iovec read_iov[2];
+    read_iov[0].iov_base = buf1.data();
+    read_iov[0].iov_len = buf1.size();
+    read_iov[1].iov_base = buf2.data();
+    read_iov[1].iov_len = buf2.size();
+    rc = preadv(fd, read_iov, 2, offset);
+    if (rc != message.size()) {
+      return LastPosixError(absl::StrCat(
+          "preadv return:", rc, " does not match message size:",
+          message.size()));
+    }
+    if (std::string(buf1.begin(), buf1.end()) +
+            std::string(buf2.begin(), buf2.end()) !=
+        message) {
+      return Status(absl::StatusCode::kInternal,
+                    "Messages from preadv do not match the expected message.");
+    }
+
+    // Neither call should have moved the file offset.
+    if (lseek(fd, 0, SEEK_CUR) != 0) {
+      return Status(absl::StatusCode::kInternal,
+                    "pwritev or preadv changed the file offset");
+    }
+    return absl::OkStatus();
+  }
+
   //////////////////////////////////////
   //          sys/utsname.h           //
   //////////////////////////////////////
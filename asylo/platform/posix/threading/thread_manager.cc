@@ -20,6 +20,7 @@
 
 #include <pthread.h>
 #include <sys/mman.h>
+#include <time.h>
 
 #include <algorithm>
 #include <atomic>
@@ -33,6 +34,9 @@
 namespace asylo {
 namespace {
 
+constexpr uint64_t kMicrosecondsPerSecond = 1000000;
+constexpr uint64_t kNanosecondsPerMicrosecond = 1000;
+
 // Returns when |predicate| returns true. |mutex| must be locked.
 void WaitFor(const std::function<bool()> &predicate, pthread_cond_t *cond,
              pthread_mutex_t *mutex) {
@@ -166,9 +170,14 @@ ThreadManager *ThreadManager::GetInstance() {
   return instance;
 }
 
+void ThreadManager::SetThreadPoolOptions(const ThreadPoolOptions &options) {
+  PthreadMutexLock lock(&threads_lock_);
+  pool_options_ = options;
+}
+
 std::shared_ptr<ThreadManager::Thread> ThreadManager::EnqueueThread(
     const ThreadOptions &options, const std::function<int()> &start_routine,
-    void *tls) {
+    void *tls, bool *claimed_idle_thread) {
   PthreadMutexLock lock(&threads_lock_);
 
   queued_threads_.emplace(
@@ -178,6 +187,13 @@ std::shared_ptr<ThreadManager::Thread> ThreadManager::EnqueueThread(
   // If a Thread object cannot be allocated, abort.
   CHECK(thread != nullptr);
 
+  *claimed_idle_thread = idle_threads_ > 0;
+  if (*claimed_idle_thread) {
+    --idle_threads_;
+    ++claimed_idle_threads_;
+    pthread_cond_signal(&idle_threads_cond_);
+  }
+
   pthread_cond_broadcast(&threads_cond_);
   return thread;
 }
@@ -214,10 +230,14 @@ int ThreadManager::CreateThread(const std::function<int()> &start_routine,
   if (attr && attr->detach_state == PTHREAD_CREATE_DETACHED) {
     options.detached = true;
   }
-  std::shared_ptr<Thread> thread = EnqueueThread(options, start_routine, tls);
-
-  // Exit and create a thread to enter with EnclaveCall DonateThread.
-  if (asylo::primitives::TrustedPrimitives::CreateThread()) {
+  bool claimed_idle_thread = false;
+  std::shared_ptr<Thread> thread =
+      EnqueueThread(options, start_routine, tls, &claimed_idle_thread);
+
+  // Unless an idle thread will run the job, exit and create a thread to enter
+  // with EnclaveCall DonateThread.
+  if (!claimed_idle_thread &&
+      asylo::primitives::TrustedPrimitives::CreateThread()) {
     return ECHILD;
   }
 
@@ -234,8 +254,16 @@ int ThreadManager::CreateThread(const std::function<int()> &start_routine,
 // StartThread is called from trusted_application.cc as the start routine when
 // a new thread is donated to the Enclave.
 int ThreadManager::StartThread(pid_t tid) {
+  donated_threads_.fetch_add(1);
   std::shared_ptr<Thread> thread = DequeueThread(tid);
+  while (thread) {
+    RunThread(thread);
+    thread = WaitForQueuedThread(tid);
+  }
+  return 0;
+}
 
+void ThreadManager::RunThread(const std::shared_ptr<Thread> &thread) {
   // Update the thread info in pthread_self.
   enc_update_pthread_info(thread->GetThreadTls());
 
@@ -243,7 +271,8 @@ int ThreadManager::StartThread(pid_t tid) {
   thread->Run();
 
   // Wait for the caller to join before releasing the thread if the thread is
-  // joinable.
+  // joinable. This also keeps the thread ID from being reused by a pooled
+  // thread while the previous Thread bound to it may still be joined.
   bool skipped_join = false;
   thread->WaitForThreadToEnterState(
       Thread::ThreadState::JOINED, [&thread, this, &skipped_join]() {
@@ -276,7 +305,60 @@ int ThreadManager::StartThread(pid_t tid) {
   // Thread finished execution, reset the thread ID and release the TLS memory.
   munmap(reinterpret_cast<struct __pthread_info *>(pthread_self())->self,
          reinterpret_cast<struct __pthread_info *>(pthread_self())->tls_size);
-  return 0;
+}
+
+std::shared_ptr<ThreadManager::Thread> ThreadManager::WaitForQueuedThread(
+    pid_t tid) {
+  uint64_t idle_timeout_us;
+  {
+    PthreadMutexLock lock(&threads_lock_);
+    if (finalizing_.load() ||
+        idle_threads_ + claimed_idle_threads_ >=
+            pool_options_.max_idle_threads) {
+      return nullptr;
+    }
+    idle_timeout_us = pool_options_.idle_timeout_us;
+  }
+
+  // Read the clock before parking, since doing so may exit the enclave.
+  struct timespec deadline;
+  if (clock_gettime(CLOCK_REALTIME, &deadline) != 0) {
+    return nullptr;
+  }
+  deadline.tv_sec += idle_timeout_us / kMicrosecondsPerSecond;
+  deadline.tv_nsec +=
+      (idle_timeout_us % kMicrosecondsPerSecond) * kNanosecondsPerMicrosecond;
+  if (deadline.tv_nsec >= kMicrosecondsPerSecond * kNanosecondsPerMicrosecond) {
+    deadline.tv_sec += 1;
+    deadline.tv_nsec -= kMicrosecondsPerSecond * kNanosecondsPerMicrosecond;
+  }
+
+  {
+    PthreadMutexLock lock(&threads_lock_);
+    if (finalizing_.load() ||
+        idle_threads_ + claimed_idle_threads_ >=
+            pool_options_.max_idle_threads) {
+      return nullptr;
+    }
+    ++idle_threads_;
+    int ret = 0;
+    while (claimed_idle_threads_ == 0 && !finalizing_.load() && ret == 0) {
+      ret = pthread_cond_timedwait(&idle_threads_cond_, &threads_lock_,
+                                   &deadline);
+    }
+
+    // A claim may be taken by any idle thread, including one whose wait has
+    // just expired, since all of them are counted alike.
+    if (claimed_idle_threads_ == 0) {
+      --idle_threads_;
+      pthread_cond_broadcast(&threads_cond_);
+      return nullptr;
+    }
+    --claimed_idle_threads_;
+  }
+
+  // The claim reserves an entry of queued_threads_ for this thread.
+  return DequeueThread(tid);
 }
 
 void ThreadManager::UpdateThreadResult(const pthread_t thread_id, void *ret) {
@@ -375,10 +457,30 @@ void ThreadManager::Finalize() {
     thread.second->SignalStateWaiters();
   }
 
-  // Wait for any expected threads to be donated and all threads to return from
-  // start_routine.
-  WaitFor([this]() { return queued_threads_.empty() && threads_.empty(); },
-          &threads_cond_, &threads_lock_);
+  // Release the idle threads so that they leave the enclave.
+  pthread_cond_broadcast(&idle_threads_cond_);
+
+  // Wait for any expected threads to be donated, all threads to return from
+  // start_routine, and all idle threads to leave.
+  WaitFor(
+      [this]() {
+        return queued_threads_.empty() && threads_.empty() &&
+               idle_threads_ == 0 && claimed_idle_threads_ == 0;
+      },
+      &threads_cond_, &threads_lock_);
+}
+
+void ThreadManager::ForgetIdleThreads() {
+  PthreadMutexLock lock(&threads_lock_);
+  // The waiters queued on the condition variable belong to the parent enclave.
+  int ret = pthread_cond_init(&idle_threads_cond_, /*attr=*/nullptr);
+  CHECK_EQ(ret, 0);
+  idle_threads_ = 0;
+  claimed_idle_threads_ = 0;
+}
+
+size_t ThreadManager::DonatedThreadCount() const {
+  return donated_threads_.load();
 }
 
 }  // namespace asylo
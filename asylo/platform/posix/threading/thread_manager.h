@@ -22,6 +22,8 @@
 #include <pthread.h>
 
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <functional>
 #include <memory>
 #include <queue>
@@ -36,6 +38,9 @@ bool ReturnFalse();
 
 // ThreadManager class is a singleton responsible for:
 // - Maintaining a queue of thread start_routine functions.
+// - Keeping threads donated to the enclave parked inside it once their
+//   start_routine completes, so that later start_routines can run on them
+//   without exiting the enclave to create a new thread.
 class ThreadManager {
  public:
   static ThreadManager *GetInstance();
@@ -46,6 +51,22 @@ class ThreadManager {
     bool detached = false;
   };
 
+  // ThreadPoolOptions configures the reuse of donated threads.
+  struct ThreadPoolOptions {
+    // Maximum number of threads kept idle inside the enclave, waiting for a
+    // new start_routine. Each idle thread occupies an enclave thread slot. Zero
+    // disables reuse, so every start_routine runs on a newly donated thread.
+    size_t max_idle_threads = 0;
+
+    // Time in microseconds an idle thread waits for a new start_routine before
+    // leaving the enclave.
+    uint64_t idle_timeout_us = 0;
+  };
+
+  // Sets the options used for threads which complete a start_routine from now
+  // on. Threads which are already idle keep their current deadline.
+  void SetThreadPoolOptions(const ThreadPoolOptions &options);
+
   // Adds the given |function| to a start_routine queue of functions waiting to
   // be run by the pthreads implementation. |tid| updates the system thread ID
   // of the new thread. |tls| specifies the pthread TLS address for the new
@@ -55,7 +76,9 @@ class ThreadManager {
 
   // Removes a function from the start_routine queue and runs it. If no
   // start_routine is present this function will abort(). |tid| is the system
-  // thread ID from the host.
+  // thread ID from the host. Once the start_routine is done, the calling thread
+  // stays in the enclave to run further start_routines while the thread pool
+  // has room for it, and returns after waiting idle for the configured timeout.
   int StartThread(pid_t tid);
 
   // Updates the result of start function in the ThreadManager.
@@ -81,6 +104,15 @@ class ThreadManager {
   // created threads have returned from |start_routine|.
   void Finalize();
 
+  // Forgets all idle threads without waking them. This is called in an enclave
+  // restored from a fork snapshot, where the idle threads of the parent enclave
+  // do not exist.
+  void ForgetIdleThreads();
+
+  // Returns the number of threads donated to the enclave to run start_routines.
+  // A start_routine run by an idle thread does not add to the count.
+  size_t DonatedThreadCount() const;
+
  private:
   ThreadManager() = default;
   ThreadManager(ThreadManager const &) = delete;
@@ -181,24 +213,49 @@ class ThreadManager {
   };
 
   // Adds a Thread object with the given |options| and |start_routine| to
-  // queued_threads_. Guaranteed to return a valid std::shared_ptr or this
-  // function will abort.
+  // queued_threads_. If an idle thread is available, claims it to run the
+  // Thread and sets |*claimed_idle_thread| to true. Guaranteed to return a
+  // valid std::shared_ptr or this function will abort.
   std::shared_ptr<Thread> EnqueueThread(
       const ThreadOptions &options, const std::function<int()> &start_routine,
-      void *tls);
+      void *tls, bool *claimed_idle_thread);
 
   // Removes a Thread object from queued_threads_ and setups up the Thread with
   // pthread_self() as the thread id and adding it to the threads_ map.
   // Guaranteed to return a valid std::shared_ptr or this function will abort.
   std::shared_ptr<Thread> DequeueThread(pid_t tid);
 
+  // Runs |thread| on the calling thread, and waits until it is joined or
+  // detached.
+  void RunThread(const std::shared_ptr<Thread> &thread);
+
+  // Parks the calling thread as an idle thread until it is claimed by
+  // CreateThread(), then dequeues the Thread it was claimed for. Returns
+  // nullptr without waiting if the thread pool is full, or if no Thread claims
+  // the calling thread before the idle timeout expires or the ThreadManager is
+  // finalized.
+  std::shared_ptr<Thread> WaitForQueuedThread(pid_t tid);
+
   // Returns a Thread pointer for a given |thread_id|.
   std::shared_ptr<Thread> GetThread(pthread_t thread_id);
 
-  // Guards queued_threads_ and threads_.
+  // Guards queued_threads_, threads_, and the thread pool state.
   pthread_mutex_t threads_lock_ = PTHREAD_MUTEX_INITIALIZER;
   pthread_cond_t threads_cond_ = PTHREAD_COND_INITIALIZER;
 
+  // Signaled when an idle thread is claimed or the ThreadManager is finalized.
+  pthread_cond_t idle_threads_cond_ = PTHREAD_COND_INITIALIZER;
+
+  ThreadPoolOptions pool_options_;
+
+  // Number of idle threads waiting to be claimed.
+  size_t idle_threads_ = 0;
+
+  // Number of idle threads claimed by CreateThread() which have not yet
+  // dequeued their Thread. Each claim corresponds to an entry of
+  // queued_threads_ for which no thread was donated.
+  size_t claimed_idle_threads_ = 0;
+
   // Queue of start_routines waiting to be run.
   // std::shared_ptr is documented to use atomic increments/decrements to manage
   // a refcount instead of using a mutex.
@@ -219,6 +276,9 @@ class ThreadManager {
   // that don't join all their threads. While finalizing, join becomes a noop
   // and threads are treated as detached as they complete.
   std::atomic<bool> finalizing_{false};
+
+  // Number of threads which have entered StartThread().
+  std::atomic<size_t> donated_threads_{0};
 };
 
 }  // namespace asylo
@@ -24,10 +24,14 @@
 
 #include "asylo/platform/common/time_util.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/primitives/util/trusted_shared_clock.h"
 
 using asylo::NanosecondsToTimeSpec;
 using asylo::NanosecondsToTimeVal;
 using asylo::TimeSpecToNanoseconds;
+using asylo::primitives::ObserveMonotonicClock;
+using asylo::primitives::ReadSharedClock;
+using asylo::primitives::SharedClockId;
 
 namespace {
 
@@ -51,6 +55,12 @@ int enclave_gettimeofday(struct timeval *__restrict time, void *timezone) {
     return -1;
   }
 
+  int64_t realtime;
+  if (ReadSharedClock(SharedClockId::kRealtime, &realtime)) {
+    NanosecondsToTimeVal(time, realtime);
+    return 0;
+  }
+
   struct timeval tval {};
   int result = enc_untrusted_gettimeofday(&tval, nullptr);
   time->tv_sec = tval.tv_sec;
@@ -61,7 +71,22 @@ int enclave_gettimeofday(struct timeval *__restrict time, void *timezone) {
 int enclave_times(struct tms *buf) { return enc_untrusted_times(buf); }
 
 int clock_gettime(clockid_t clock_id, struct timespec *time) {
-  int result = enc_untrusted_clock_gettime(clock_id, time);
+  // Read the monotonic and realtime clocks from the shared clock if it is
+  // available, and from the host otherwise.
+  int result;
+  int64_t nanoseconds;
+  if ((clock_id == CLOCK_MONOTONIC &&
+       ReadSharedClock(SharedClockId::kMonotonic, &nanoseconds)) ||
+      (clock_id == CLOCK_REALTIME &&
+       ReadSharedClock(SharedClockId::kRealtime, &nanoseconds))) {
+    NanosecondsToTimeSpec(time, nanoseconds);
+    result = 0;
+  } else {
+    result = enc_untrusted_clock_gettime(clock_id, time);
+    if (result == 0 && clock_id == CLOCK_MONOTONIC) {
+      ObserveMonotonicClock(TimeSpecToNanoseconds(time));
+    }
+  }
   if (clock_id == CLOCK_MONOTONIC) {
     int64_t clock_monotonic = TimeSpecToNanoseconds(time);
     thread_local static int64_t last_tick = clock_monotonic;
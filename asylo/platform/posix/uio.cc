@@ -32,4 +32,12 @@ ssize_t readv(int fd, const struct iovec *iov, int iovcnt) {
   return IOManager::GetInstance().Readv(fd, iov, iovcnt);
 }
 
+ssize_t preadv(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+  return IOManager::GetInstance().PReadv(fd, iov, iovcnt, offset);
+}
+
+ssize_t pwritev(int fd, const struct iovec *iov, int iovcnt, off_t offset) {
+  return IOManager::GetInstance().PWritev(fd, iov, iovcnt, offset);
+}
+
 }  // extern "C"
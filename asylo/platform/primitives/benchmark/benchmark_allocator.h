@@ -0,0 +1,41 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_BENCHMARK_BENCHMARK_ALLOCATOR_H_
+#define ASYLO_PLATFORM_PRIMITIVES_BENCHMARK_BENCHMARK_ALLOCATOR_H_
+
+#include <cstddef>
+
+// This file declares the untrusted memory allocator measured by the benchmark
+// enclave. Each backend links its own implementation: the SGX backend measures
+// UntrustedCacheMalloc, which backs the parameters of every exit call, and
+// other backends measure TrustedPrimitives::UntrustedLocalAlloc.
+
+namespace asylo {
+namespace primitives {
+
+// Allocates |size| bytes of untrusted memory. Returns nullptr on failure.
+void *BenchmarkUntrustedAlloc(size_t size);
+
+// Frees memory allocated by BenchmarkUntrustedAlloc().
+void BenchmarkUntrustedFree(void *ptr);
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_BENCHMARK_BENCHMARK_ALLOCATOR_H_
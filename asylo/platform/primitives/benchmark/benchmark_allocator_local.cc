@@ -0,0 +1,36 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <cstddef>
+
+#include "asylo/platform/primitives/benchmark/benchmark_allocator.h"
+#include "asylo/platform/primitives/trusted_primitives.h"
+
+namespace asylo {
+namespace primitives {
+
+void *BenchmarkUntrustedAlloc(size_t size) {
+  return TrustedPrimitives::UntrustedLocalAlloc(size);
+}
+
+void BenchmarkUntrustedFree(void *ptr) {
+  TrustedPrimitives::UntrustedLocalFree(ptr);
+}
+
+}  // namespace primitives
+}  // namespace asylo
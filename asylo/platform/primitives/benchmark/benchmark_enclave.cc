@@ -0,0 +1,156 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <sys/epoll.h>
+#include <time.h>
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+#include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/primitives/benchmark/benchmark_allocator.h"
+#include "asylo/platform/primitives/benchmark/benchmark_selectors.h"
+#include "asylo/platform/primitives/extent.h"
+#include "asylo/platform/primitives/primitive_status.h"
+#include "asylo/platform/primitives/trusted_primitives.h"
+#include "asylo/platform/primitives/trusted_runtime.h"
+#include "asylo/platform/primitives/util/message.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace primitives {
+namespace {
+
+// Size of the buffers read and written by BenchmarkSyscall::kRead and
+// BenchmarkSyscall::kWrite.
+constexpr size_t kSyscallBufferSize = 64;
+
+PrimitiveStatus Empty(void *context, MessageReader *in, MessageWriter *out) {
+  ASYLO_RETURN_IF_READER_NOT_EMPTY(*in);
+  return PrimitiveStatus::OkStatus();
+}
+
+PrimitiveStatus Echo(void *context, MessageReader *in, MessageWriter *out) {
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*in, 1);
+  out->PushByCopy(in->next());
+  return PrimitiveStatus::OkStatus();
+}
+
+PrimitiveStatus UntrustedCalls(void *context, MessageReader *in,
+                               MessageWriter *out) {
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*in, 2);
+  const auto count = in->next<uint64_t>();
+  const auto payload_size = in->next<uint64_t>();
+  std::unique_ptr<char[]> payload(new char[payload_size]);
+  memset(payload.get(), 0, payload_size);
+  for (uint64_t i = 0; i < count; ++i) {
+    MessageWriter input;
+    if (payload_size > 0) {
+      input.PushByReference(Extent{payload.get(), payload_size});
+    }
+    MessageReader output;
+    ASYLO_RETURN_IF_ERROR(TrustedPrimitives::UntrustedCall(
+        kBenchmarkUntrustedEcho, &input, &output));
+  }
+  return PrimitiveStatus::OkStatus();
+}
+
+PrimitiveStatus Syscalls(void *context, MessageReader *in, MessageWriter *out) {
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*in, 3);
+  const auto syscall = in->next<BenchmarkSyscall>();
+  const auto count = in->next<uint64_t>();
+  const auto fd = in->next<int>();
+  char buffer[kSyscallBufferSize] = {};
+  for (uint64_t i = 0; i < count; ++i) {
+    int64_t result = -1;
+    switch (syscall) {
+      case BenchmarkSyscall::kRead:
+        result = enc_untrusted_read(fd, buffer, sizeof(buffer));
+        break;
+      case BenchmarkSyscall::kWrite:
+        result = enc_untrusted_write(fd, buffer, sizeof(buffer));
+        break;
+      case BenchmarkSyscall::kClockGettime: {
+        struct timespec ts;
+        result = enc_untrusted_clock_gettime(CLOCK_MONOTONIC, &ts);
+        break;
+      }
+      case BenchmarkSyscall::kEpollWait: {
+        struct epoll_event event;
+        result = enc_untrusted_epoll_wait(fd, &event, 1, /*timeout=*/0);
+        break;
+      }
+      default:
+        return {AbslStatusCode::kInvalidArgument, "Unknown system call"};
+    }
+    if (result < 0) {
+      return {AbslStatusCode::kInternal, "Benchmarked system call failed"};
+    }
+  }
+  return PrimitiveStatus::OkStatus();
+}
+
+PrimitiveStatus UntrustedAllocs(void *context, MessageReader *in,
+                                MessageWriter *out) {
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*in, 2);
+  const auto count = in->next<uint64_t>();
+  const auto size = in->next<uint64_t>();
+  for (uint64_t i = 0; i < count; ++i) {
+    void *buffer = BenchmarkUntrustedAlloc(size);
+    if (!buffer) {
+      return {AbslStatusCode::kResourceExhausted,
+              "Failed to allocate untrusted memory"};
+    }
+    BenchmarkUntrustedFree(buffer);
+  }
+  return PrimitiveStatus::OkStatus();
+}
+
+}  // namespace
+}  // namespace primitives
+}  // namespace asylo
+
+using ::asylo::primitives::EntryHandler;
+using ::asylo::primitives::PrimitiveStatus;
+using ::asylo::primitives::TrustedPrimitives;
+
+// Implements the required enclave initialization function.
+extern "C" PrimitiveStatus asylo_enclave_init() {
+  ASYLO_RETURN_IF_ERROR(TrustedPrimitives::RegisterEntryHandler(
+      asylo::primitives::kBenchmarkEmptySelector,
+      EntryHandler{asylo::primitives::Empty}));
+  ASYLO_RETURN_IF_ERROR(TrustedPrimitives::RegisterEntryHandler(
+      asylo::primitives::kBenchmarkEchoSelector,
+      EntryHandler{asylo::primitives::Echo}));
+  ASYLO_RETURN_IF_ERROR(TrustedPrimitives::RegisterEntryHandler(
+      asylo::primitives::kBenchmarkUntrustedCallSelector,
+      EntryHandler{asylo::primitives::UntrustedCalls}));
+  ASYLO_RETURN_IF_ERROR(TrustedPrimitives::RegisterEntryHandler(
+      asylo::primitives::kBenchmarkSyscallSelector,
+      EntryHandler{asylo::primitives::Syscalls}));
+  ASYLO_RETURN_IF_ERROR(TrustedPrimitives::RegisterEntryHandler(
+      asylo::primitives::kBenchmarkUntrustedAllocSelector,
+      EntryHandler{asylo::primitives::UntrustedAllocs}));
+  return PrimitiveStatus::OkStatus();
+}
+
+// Implements the required enclave finalization function.
+extern "C" PrimitiveStatus asylo_enclave_fini() {
+  return PrimitiveStatus::OkStatus();
+}
@@ -0,0 +1,67 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_BENCHMARK_BENCHMARK_SELECTORS_H_
+#define ASYLO_PLATFORM_PRIMITIVES_BENCHMARK_BENCHMARK_SELECTORS_H_
+
+#include <cstdint>
+
+#include "asylo/platform/primitives/primitives.h"
+
+namespace asylo {
+namespace primitives {
+
+// Entry points registered by the benchmark enclave.
+
+// Returns immediately. Expects an empty input.
+constexpr uint64_t kBenchmarkEmptySelector = kSelectorUser + 1;
+
+// Returns a copy of its input. Expects [payload].
+constexpr uint64_t kBenchmarkEchoSelector = kSelectorUser + 2;
+
+// Performs |count| exit calls to kBenchmarkUntrustedEcho, each carrying
+// |payload_size| bytes. Expects [uint64_t count, uint64_t payload_size].
+constexpr uint64_t kBenchmarkUntrustedCallSelector = kSelectorUser + 3;
+
+// Performs |count| calls of a BenchmarkSyscall through the host call library.
+// Expects [BenchmarkSyscall syscall, uint64_t count, int fd], where |fd| is the
+// host file descriptor the system call operates on, if any.
+constexpr uint64_t kBenchmarkSyscallSelector = kSelectorUser + 4;
+
+// Allocates and frees |count| buffers of |size| bytes of untrusted memory with
+// the allocator the backend uses for exit call parameters. Expects
+// [uint64_t count, uint64_t size].
+constexpr uint64_t kBenchmarkUntrustedAllocSelector = kSelectorUser + 5;
+
+// Exit points registered by the benchmark driver.
+
+// Returns a copy of its input.
+constexpr uint64_t kBenchmarkUntrustedEcho = kSelectorUser + 1;
+
+// System calls exercised by kBenchmarkSyscallSelector.
+enum class BenchmarkSyscall : int32_t {
+  kRead = 0,          // Reads 64 bytes from |fd|.
+  kWrite = 1,         // Writes 64 bytes to |fd|.
+  kClockGettime = 2,  // Reads CLOCK_MONOTONIC.
+  kEpollWait = 3,     // Polls the epoll instance |fd| without blocking.
+};
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_BENCHMARK_BENCHMARK_SELECTORS_H_
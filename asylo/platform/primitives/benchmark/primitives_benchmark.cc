@@ -0,0 +1,265 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+// Microbenchmarks of the cost of crossing the enclave boundary: entry and exit
+// calls across payload sizes, MessageWriter and MessageReader serialization,
+// representative system calls made through the host call library, and the
+// untrusted memory allocator backing exit call parameters.
+//
+// The backend the enclave is loaded with is selected by the TestBackend linked
+// into the binary.
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include "absl/flags/parse.h"
+#include "absl/status/status.h"
+#include "asylo/platform/host_call/untrusted/host_call_handlers_initializer.h"
+#include "asylo/platform/primitives/benchmark/benchmark_selectors.h"
+#include "asylo/platform/primitives/extent.h"
+#include "asylo/platform/primitives/test/test_backend.h"
+#include "asylo/platform/primitives/untrusted_primitives.h"
+#include "asylo/platform/primitives/util/message.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/status.h"
+
+namespace asylo {
+namespace primitives {
+namespace {
+
+// Number of enclave crossings or allocations performed inside the enclave per
+// benchmark iteration, to amortize the entry call which drives them.
+constexpr uint64_t kOperationsPerIteration = 64;
+
+// The benchmark enclave, or nullptr if it has not been loaded.
+std::shared_ptr<Client> *loaded_client = nullptr;
+
+// Returns the benchmark enclave, loading it on first use.
+std::shared_ptr<Client> GetClient() {
+  if (!loaded_client) {
+    loaded_client = new std::shared_ptr<Client>(
+        test::TestBackend::Get()->LoadTestEnclaveOrDie(
+            /*enclave_name=*/"primitives_benchmark"));
+    Client::ExitCallProvider *provider = (*loaded_client)->exit_call_provider();
+    CHECK(host_call::AddHostCallHandlersToExitCallProvider(provider).ok());
+    ExitHandler::Callback echo = [](std::shared_ptr<Client> client,
+                                    void *context, MessageReader *in,
+                                    MessageWriter *out) -> Status {
+      if (in->hasNext()) {
+        out->PushByCopy(in->next());
+      }
+      return absl::OkStatus();
+    };
+    CHECK(provider->RegisterExitHandler(kBenchmarkUntrustedEcho,
+                                        ExitHandler{echo})
+              .ok());
+  }
+  return *loaded_client;
+}
+
+// Destroys the benchmark enclave if it was loaded.
+void DestroyClient() {
+  if (loaded_client) {
+    (*loaded_client)->Destroy();
+    delete loaded_client;
+    loaded_client = nullptr;
+  }
+}
+
+// Makes an entry call to |selector| with |input|, reporting a failure as an
+// error of the running benchmark.
+void RunEnclaveCall(uint64_t selector, MessageWriter *input,
+                      benchmark::State *state) {
+  MessageReader output;
+  Status status = GetClient()->EnclaveCall(selector, input, &output);
+  if (!status.ok()) {
+    state->SkipWithError(status.ToString().c_str());
+  }
+}
+
+// Entry call with no parameters.
+void BM_EnclaveCallEmpty(benchmark::State &state) {
+  auto client = GetClient();
+  for (auto _ : state) {
+    MessageReader output;
+    benchmark::DoNotOptimize(
+        client->EnclaveCall(kBenchmarkEmptySelector, nullptr, &output));
+  }
+}
+BENCHMARK(BM_EnclaveCallEmpty);
+
+// Entry call round trip, copying state.range(0) bytes in and out.
+void BM_EnclaveCallEcho(benchmark::State &state) {
+  std::vector<char> payload(state.range(0), 'a');
+  for (auto _ : state) {
+    MessageWriter input;
+    input.PushByReference(Extent{payload.data(), payload.size()});
+    RunEnclaveCall(kBenchmarkEchoSelector, &input, &state);
+  }
+  state.SetBytesProcessed(state.iterations() * payload.size() * 2);
+}
+BENCHMARK(BM_EnclaveCallEcho)
+    ->Arg(0)
+    ->Arg(64)
+    ->Arg(1 << 10)
+    ->Arg(16 << 10)
+    ->Arg(256 << 10);
+
+// Exit call round trip made from inside the enclave, copying state.range(0)
+// bytes out and in.
+void BM_UntrustedCallEcho(benchmark::State &state) {
+  const uint64_t payload_size = state.range(0);
+  for (auto _ : state) {
+    MessageWriter input;
+    input.Push(kOperationsPerIteration);
+    input.Push(payload_size);
+    RunEnclaveCall(kBenchmarkUntrustedCallSelector, &input, &state);
+  }
+  state.SetItemsProcessed(state.iterations() * kOperationsPerIteration);
+  state.SetBytesProcessed(state.iterations() * kOperationsPerIteration *
+                          payload_size * 2);
+}
+BENCHMARK(BM_UntrustedCallEcho)
+    ->Arg(0)
+    ->Arg(64)
+    ->Arg(1 << 10)
+    ->Arg(16 << 10)
+    ->Arg(256 << 10);
+
+// Serialization of state.range(0) extents of state.range(1) bytes each.
+void BM_MessageWriterSerialize(benchmark::State &state) {
+  const size_t extent_count = state.range(0);
+  const size_t extent_size = state.range(1);
+  std::vector<char> payload(extent_size, 'a');
+  std::vector<char> buffer;
+  for (auto _ : state) {
+    MessageWriter writer;
+    for (size_t i = 0; i < extent_count; ++i) {
+      writer.PushByReference(Extent{payload.data(), payload.size()});
+    }
+    buffer.resize(writer.MessageSize());
+    writer.Serialize(buffer.data());
+    benchmark::DoNotOptimize(buffer.data());
+  }
+  state.SetBytesProcessed(state.iterations() * extent_count * extent_size);
+}
+BENCHMARK(BM_MessageWriterSerialize)
+    ->ArgPair(1, 8)
+    ->ArgPair(4, 8)
+    ->ArgPair(16, 8)
+    ->ArgPair(1, 4 << 10)
+    ->ArgPair(4, 4 << 10);
+
+// Deserialization of state.range(0) extents of state.range(1) bytes each.
+void BM_MessageReaderDeserialize(benchmark::State &state) {
+  const size_t extent_count = state.range(0);
+  const size_t extent_size = state.range(1);
+  std::vector<char> payload(extent_size, 'a');
+  MessageWriter writer;
+  for (size_t i = 0; i < extent_count; ++i) {
+    writer.PushByReference(Extent{payload.data(), payload.size()});
+  }
+  std::vector<char> buffer(writer.MessageSize());
+  writer.Serialize(buffer.data());
+  for (auto _ : state) {
+    MessageReader reader;
+    reader.Deserialize(buffer.data(), buffer.size());
+    benchmark::DoNotOptimize(reader.next());
+  }
+  state.SetBytesProcessed(state.iterations() * extent_count * extent_size);
+}
+BENCHMARK(BM_MessageReaderDeserialize)
+    ->ArgPair(1, 8)
+    ->ArgPair(4, 8)
+    ->ArgPair(16, 8)
+    ->ArgPair(1, 4 << 10)
+    ->ArgPair(4, 4 << 10);
+
+// Runs kOperationsPerIteration calls of |syscall| on |fd| inside the enclave
+// per iteration.
+void RunSyscallBenchmark(BenchmarkSyscall syscall, int fd,
+                         benchmark::State *state) {
+  for (auto _ : *state) {
+    MessageWriter input;
+    input.Push(syscall);
+    input.Push(kOperationsPerIteration);
+    input.Push(fd);
+    RunEnclaveCall(kBenchmarkSyscallSelector, &input, state);
+  }
+  state->SetItemsProcessed(state->iterations() * kOperationsPerIteration);
+}
+
+void BM_SyscallRead(benchmark::State &state) {
+  int fd = open("/dev/zero", O_RDONLY);
+  RunSyscallBenchmark(BenchmarkSyscall::kRead, fd, &state);
+  close(fd);
+}
+BENCHMARK(BM_SyscallRead);
+
+void BM_SyscallWrite(benchmark::State &state) {
+  int fd = open("/dev/null", O_WRONLY);
+  RunSyscallBenchmark(BenchmarkSyscall::kWrite, fd, &state);
+  close(fd);
+}
+BENCHMARK(BM_SyscallWrite);
+
+void BM_SyscallClockGettime(benchmark::State &state) {
+  RunSyscallBenchmark(BenchmarkSyscall::kClockGettime, /*fd=*/-1, &state);
+}
+BENCHMARK(BM_SyscallClockGettime);
+
+void BM_SyscallEpollWait(benchmark::State &state) {
+  int fd = epoll_create1(0);
+  RunSyscallBenchmark(BenchmarkSyscall::kEpollWait, fd, &state);
+  close(fd);
+}
+BENCHMARK(BM_SyscallEpollWait);
+
+// Allocation and release of untrusted buffers of state.range(0) bytes from
+// inside the enclave.
+void BM_UntrustedAlloc(benchmark::State &state) {
+  const uint64_t size = state.range(0);
+  for (auto _ : state) {
+    MessageWriter input;
+    input.Push(kOperationsPerIteration);
+    input.Push(size);
+    RunEnclaveCall(kBenchmarkUntrustedAllocSelector, &input, &state);
+  }
+  state.SetItemsProcessed(state.iterations() * kOperationsPerIteration);
+}
+BENCHMARK(BM_UntrustedAlloc)->Arg(16)->Arg(128)->Arg(1 << 10)->Arg(16 << 10);
+
+}  // namespace
+}  // namespace primitives
+}  // namespace asylo
+
+int main(int argc, char **argv) {
+  benchmark::Initialize(&argc, argv);
+  absl::ParseCommandLine(argc, argv);
+  benchmark::RunSpecifiedBenchmarks();
+  asylo::primitives::DestroyClient();
+  return 0;
+}
@@ -20,6 +20,7 @@
 
 #include <cstdio>
 #include <cstring>
+#include <utility>
 
 #include "absl/status/status.h"
 #include "asylo/platform/primitives/dlopen/shared_dlopen.h"
@@ -29,6 +30,8 @@
 #include "asylo/platform/primitives/trusted_runtime.h"
 #include "asylo/platform/primitives/util/message.h"
 #include "asylo/platform/primitives/util/trusted_runtime_helper.h"
+#include "asylo/platform/primitives/util/trusted_shared_clock.h"
+#include "asylo/platform/primitives/util/trusted_switchless.h"
 
 namespace asylo {
 namespace primitives {
@@ -78,6 +81,12 @@ void RegisterInternalHandlers() {
            .ok()) {
     TrustedPrimitives::BestEffortAbort("Could not register entry handler");
   }
+
+  // Register the switchless exit call configuration entry handler.
+  RegisterSwitchlessEntryHandler();
+
+  // Register the shared clock configuration entry handler.
+  RegisterSharedClockEntryHandler();
 }
 
 void TrustedPrimitives::BestEffortAbort(const char *message) {
@@ -121,7 +130,7 @@ extern "C" PrimitiveStatus asylo_enclave_call(uint64_t selector,
   // TOC/TOU attacks.
   auto trusted_input = CopyFromUntrusted(input, input_len);
   if (trusted_input) {
-    in.Deserialize(trusted_input.get(), input_len);
+    in.Deserialize(std::move(trusted_input), input_len);
   }
 
   PrimitiveStatus status = InvokeEntryHandler(selector, &in, &out);
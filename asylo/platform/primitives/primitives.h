@@ -41,10 +41,25 @@ static constexpr uint64_t kSelectorAsyloDonateThread = 2;
 /// Enclave finalization entry point selector.
 static constexpr uint64_t kSelectorAsyloFini = 3;
 
+/// Switchless exit call configuration entry point selector.
+static constexpr uint64_t kSelectorAsyloSwitchless = 4;
+
+/// Shared clock configuration entry point selector.
+static constexpr uint64_t kSelectorAsyloSharedClock = 5;
+
+/// Entry point selectors in (`kSelectorAsyloReservedBase`, `kSelectorUser`) are
+/// reserved for future use by the runtime.
+static constexpr uint64_t kSelectorAsyloReservedBase =
+    kSelectorAsyloSharedClock;
+
 //////////////////////////////////////
 //      Exit handler selectors      //
 //////////////////////////////////////
 
+/// Selector for the handler yielding the host thread of a trusted caller
+/// waiting for a switchless exit call to complete.
+static constexpr uint64_t kSelectorSwitchlessYield = 86;
+
 /// Selector for thread creation handler.
 static constexpr uint64_t kSelectorCreateThread = 87;
 
@@ -55,7 +70,7 @@ static constexpr uint64_t kSelectorHostCall = 88;
 
 /// Selector values in [`kSelectorRemote`, `kSelectorUser`) range are reserved
 /// for remote backend needs and cannot be used by any other component.
-static constexpr uint64_t kSelectorRemote = 120;
+static constexpr uint64_t kSelectorRemote = 126;
 
 /// Selector values less than `kSelectorUser` are reserved by the runtime and
 /// may not be registered by the applications.
@@ -40,6 +40,23 @@ static void rdrand64(void *out) {
   abort();
 }
 
+// Writes a 64-bit value from the RDSEED instruction to |out|, or falls back to
+// RDRAND if the entropy source is exhausted.
+static void rdseed64(void *out) {
+  // RDSEED fails whenever the entropy conditioner has not yet accumulated
+  // enough entropy, so unlike RDRAND it is expected to fail under load. Spec
+  // recommends pausing between retries.
+  constexpr int kSeedRetries = 100;
+  for (int i = 0; i < kSeedRetries; ++i) {
+    if (_rdseed64_step(static_cast<unsigned long long *>(out))) {
+      return;
+    }
+    _mm_pause();
+  }
+
+  rdrand64(out);
+}
+
 static uint64_t rdrand64() {
   uint64_t temp;
   rdrand64(&temp);
@@ -65,6 +82,15 @@ static bool cpuid_rdrand() {
   return !!(ecx & (1 << 30));
 }
 
+static bool cpuid_rdseed() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return false;
+  }
+  // Bit 18 of EBX is set => machine supports RDSEED.
+  return !!(ebx & (1 << 18));
+}
+
 }  // namespace
 
 namespace asylo {
@@ -74,6 +100,11 @@ bool rdrand_supported() {
   return supported;
 }
 
+bool rdseed_supported() {
+  static bool supported = cpuid_rdseed();
+  return supported;
+}
+
 }  // namespace asylo
 
 extern "C" int enc_hardware_random_entropy() {
@@ -117,3 +148,18 @@ extern "C" ssize_t enc_hardware_random(uint8_t *buf, size_t count) {
 
   return count;
 }
+
+extern "C" ssize_t enc_hardware_seed(uint8_t *buf, size_t count) {
+  if (!asylo::rdrand_supported()) {
+    return -1;
+  }
+  if (!asylo::rdseed_supported()) {
+    return enc_hardware_random(buf, count);
+  }
+  for (size_t offset = 0; offset < count; offset += sizeof(uint64_t)) {
+    uint64_t temp;
+    rdseed64(&temp);
+    memcpy(&buf[offset], &temp, std::min(sizeof(temp), count - offset));
+  }
+  return count;
+}
@@ -33,6 +33,9 @@ namespace asylo {
 // Returns whether the CPU supports the RDRAND instruction.
 bool rdrand_supported();
 
+// Returns whether the CPU supports the RDSEED instruction.
+bool rdseed_supported();
+
 }  // namespace asylo
 
 #endif  // ASYLO_PLATFORM_PRIMITIVES_RANDOM_BYTES_H_
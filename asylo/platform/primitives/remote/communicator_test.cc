@@ -130,6 +130,14 @@ class CommunicatorTestFixture : public ::testing::Test {
     CHECK_EQ(res, 0) << strerror(errno);
   }
 
+  // Number of communication streams used by both host and target, defaults to
+  // unary RPCs unless overridden.
+  virtual int communication_streams() const { return 0; }
+
+  // Whether host and target pass messages through shared memory rings,
+  // defaults to gRPC unless overridden.
+  virtual bool shared_memory_transport() const { return false; }
+
  private:
   // Sets up host-side handler expectations, defaults to not being called
   // unless overridden.
@@ -196,6 +204,8 @@ class CommunicatorTestFixture : public ::testing::Test {
                                      RemoteProvision::Instantiate()));
       proxy_config->EnableOpenCensusMetricsCollection(absl::Seconds(1),
                                                       "test_name");
+      proxy_config->set_communication_streams(communication_streams());
+      proxy_config->set_shared_memory_transport(shared_memory_transport());
 
       // Establish connection to the target server.
       ASYLO_ASSERT_OK(communicator->Connect(*proxy_config, end_point));
@@ -207,6 +217,8 @@ class CommunicatorTestFixture : public ::testing::Test {
           << strerror(errno);
 
       RemoteProxyConfig proxy_config(std::move(connection_config));
+      proxy_config.set_communication_streams(communication_streams());
+      proxy_config.set_shared_memory_transport(shared_memory_transport());
 
       // Establish connection to the host server.
       ASYLO_ASSERT_OK(communicator->Connect(
@@ -760,6 +772,46 @@ class OpenCensusClientTest : public CommunicatorTestFixture {
   }
 };
 
+// The following tests repeat some of the tests above with messages sent over
+// communication streams rather than unary RPCs.
+
+class StreamedSingleInvokeTest : public SingleInvokeTest {
+ private:
+  int communication_streams() const override { return 1; }
+};
+
+class StreamedMultithreadedWithThreadLocalStorageTest
+    : public MultithreadedWithThreadLocalStorageTest {
+ private:
+  int communication_streams() const override { return 2; }
+};
+
+class StreamedDuplexNestedMultithreadedInvokesTest
+    : public DuplexNestedMultithreadedInvokesTest {
+ private:
+  int communication_streams() const override { return 2; }
+};
+
+// The following tests repeat some of the tests above with messages passed
+// through shared memory rings, since host and target run on the same machine.
+
+class SharedMemorySingleInvokeTest : public SingleInvokeTest {
+ private:
+  bool shared_memory_transport() const override { return true; }
+};
+
+class SharedMemoryMultithreadedWithThreadLocalStorageTest
+    : public MultithreadedWithThreadLocalStorageTest {
+ private:
+  bool shared_memory_transport() const override { return true; }
+};
+
+class SharedMemoryDuplexNestedMultithreadedInvokesTest
+    : public DuplexNestedMultithreadedInvokesTest {
+ private:
+  bool shared_memory_transport() const override { return true; }
+};
+
 void RegisterAllTests() {
   // Prepare all the tests (before forking the process - so that both host and
   // target processes see them), do not store pointers - they are handed over
@@ -772,6 +824,16 @@ void RegisterAllTests() {
   CommunicatorTestFixture::Register<DuplexNestedMultithreadedInvokesTest>();
   CommunicatorTestFixture::Register<UnknownSelectorTest>();
   CommunicatorTestFixture::Register<OpenCensusClientTest>();
+  CommunicatorTestFixture::Register<StreamedSingleInvokeTest>();
+  CommunicatorTestFixture::Register<
+      StreamedMultithreadedWithThreadLocalStorageTest>();
+  CommunicatorTestFixture::Register<
+      StreamedDuplexNestedMultithreadedInvokesTest>();
+  CommunicatorTestFixture::Register<SharedMemorySingleInvokeTest>();
+  CommunicatorTestFixture::Register<
+      SharedMemoryMultithreadedWithThreadLocalStorageTest>();
+  CommunicatorTestFixture::Register<
+      SharedMemoryDuplexNestedMultithreadedInvokesTest>();
 }
 
 }  // namespace test
@@ -18,20 +18,31 @@
 
 #include "asylo/platform/primitives/remote/grpc_client_impl.h"
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <cstdint>
+#include <deque>
 #include <iterator>
 #include <string>
 #include <utility>
 
+#include "absl/base/call_once.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/primitives/extent.h"
 #include "asylo/platform/primitives/remote/communicator.h"
 #include "asylo/platform/primitives/remote/grpc_service.grpc.pb.h"
 #include "asylo/platform/primitives/remote/grpc_service.pb.h"
 #include "asylo/platform/primitives/remote/metrics/clients/opencensus_client.h"
+#include "asylo/platform/primitives/remote/shared_memory_ring.h"
 #include "asylo/platform/primitives/util/message.h"
 #include "asylo/util/remote/remote_proxy_config.h"
 #include "asylo/util/status.h"
@@ -42,6 +53,7 @@
 #include "include/grpc/support/time.h"
 #include "include/grpcpp/support/status.h"
 #include "include/grpcpp/create_channel.h"
+#include "include/grpcpp/impl/codegen/sync_stream.h"
 #include "include/grpcpp/security/credentials.h"
 #include "include/grpcpp/support/channel_arguments.h"
 
@@ -50,6 +62,22 @@ namespace primitives {
 
 namespace {
 
+// Upper bound on the serialized size of the messages in one batch. A message
+// larger than this is sent in a batch of its own.
+constexpr size_t kMaxBatchBytes = 256 * 1024;
+
+// Upper bound on the serialized size of the messages queued on a stream but not
+// yet written. Senders block while it is exceeded.
+constexpr size_t kMaxQueuedBytes = 4 * 1024 * 1024;
+
+// Maximum number of batches written on a stream but not yet acknowledged by
+// the counterpart. Bounds the amount of work queued on the counterpart.
+constexpr uint64_t kMaxUnacknowledgedBatches = 16;
+
+// Capacity of the shared memory ring. Larger messages are split into
+// fragments by the ring.
+constexpr size_t kSharedMemoryRingCapacity = 1024 * 1024;
+
 void SerializeIntoRequest(CommunicationMessage *request,
                           Communicator::Invocation *invocation) {
   *request->mutable_status() =
@@ -82,6 +110,178 @@ void DeserializeFromReply(const CommunicationMessage &reply,
 
 }  // namespace
 
+// Persistent CommunicateStream RPC. Senders append messages to a queue and
+// block until they have been written. A writer thread drains the queue into
+// batches, so messages sent by threads while the previous batch is being
+// written are coalesced into the next one, and a reader thread consumes the
+// counterpart's acknowledgements, which limit the number of batches in flight.
+class Communicator::ClientImpl::CommunicationStream {
+ public:
+  CommunicationStream(CommunicatorService::Stub *stub,
+                      Communicator *communicator)
+      : communicator_(communicator),
+        stream_(stub->CommunicateStream(&context_)) {
+    writer_thread_ = absl::make_unique<Thread>([this] { WriterLoop(); });
+    reader_thread_ = absl::make_unique<Thread>([this] { ReaderLoop(); });
+  }
+
+  ~CommunicationStream() { Close(); }
+
+  CommunicationStream(const CommunicationStream &other) = delete;
+  CommunicationStream &operator=(const CommunicationStream &other) = delete;
+
+  // Queues |message| and waits until the batch containing it has been
+  // written to the stream.
+  Status Send(const CommunicationMessage &message) {
+    const size_t message_bytes = message.ByteSizeLong();
+    absl::MutexLock lock(&mu_);
+    while (status_.ok() && !closing_ && queued_bytes_ >= kMaxQueuedBytes) {
+      changed_.Wait(&mu_);
+    }
+    if (!status_.ok()) {
+      return status_;
+    }
+    if (closing_) {
+      return Status{absl::StatusCode::kCancelled, "Stream closed"};
+    }
+    queue_.push_back(message);
+    queued_bytes_ += message_bytes;
+    const uint64_t ticket = ++queued_messages_;
+    changed_.SignalAll();
+    while (status_.ok() && written_messages_ < ticket) {
+      changed_.Wait(&mu_);
+    }
+    return written_messages_ >= ticket ? absl::OkStatus() : status_;
+  }
+
+  // Writes all queued messages, half-closes the stream and waits for the
+  // counterpart to finish it. Repeated calls have no effect.
+  void Close() {
+    absl::call_once(close_once_, [this] {
+      {
+        absl::MutexLock lock(&mu_);
+        closing_ = true;
+        changed_.SignalAll();
+      }
+      writer_thread_->Join();
+      bool failed;
+      {
+        absl::MutexLock lock(&mu_);
+        failed = !status_.ok();
+      }
+      if (failed || !stream_->WritesDone()) {
+        // Do not wait for a counterpart that may never finish the stream.
+        context_.TryCancel();
+      }
+      reader_thread_->Join();
+      const ::grpc::Status grpc_status = stream_->Finish();
+      if (!grpc_status.ok() &&
+          grpc_status.error_code() != ::grpc::StatusCode::CANCELLED) {
+        LOG(ERROR) << "Communication stream error="
+                   << ConvertStatus<absl::Status>(grpc_status);
+      }
+    });
+  }
+
+ private:
+  // Writes batches of queued messages until the stream is closed or fails.
+  void WriterLoop() {
+    for (;;) {
+      CommunicationBatch batch;
+      size_t batch_bytes = 0;
+      {
+        absl::MutexLock lock(&mu_);
+        while (status_.ok() && !(closing_ && queue_.empty()) &&
+               (queue_.empty() || written_batches_ - acknowledged_batches_ >=
+                                      kMaxUnacknowledgedBatches)) {
+          changed_.Wait(&mu_);
+        }
+        if (!status_.ok() || queue_.empty()) {
+          return;
+        }
+        while (!queue_.empty()) {
+          const size_t message_bytes = queue_.front().ByteSizeLong();
+          if (batch.messages_size() > 0 &&
+              batch_bytes + message_bytes > kMaxBatchBytes) {
+            break;
+          }
+          *batch.add_messages() = std::move(queue_.front());
+          queue_.pop_front();
+          batch_bytes += message_bytes;
+        }
+      }
+      if (communicator_->is_host()) {
+        batch.set_host_time_nanos(absl::GetCurrentTimeNanos());
+      }
+      const bool written = stream_->Write(batch);
+      absl::MutexLock lock(&mu_);
+      queued_bytes_ -= batch_bytes;
+      if (written) {
+        written_messages_ += batch.messages_size();
+        ++written_batches_;
+      } else if (status_.ok()) {
+        status_ = Status{absl::StatusCode::kInternal,
+                         "Failed to write to communication stream"};
+      }
+      changed_.SignalAll();
+    }
+  }
+
+  // Processes acknowledgements until the counterpart finishes the stream.
+  void ReaderLoop() {
+    CommunicationConfirmation confirmation;
+    while (stream_->Read(&confirmation)) {
+      // If host responded with time stamp, process it.
+      if (!communicator_->is_host() && confirmation.has_host_time_nanos()) {
+        communicator_->set_host_time_nanos(confirmation.host_time_nanos());
+      }
+      absl::MutexLock lock(&mu_);
+      acknowledged_batches_ =
+          std::max(acknowledged_batches_, confirmation.received_batches());
+      changed_.SignalAll();
+    }
+    absl::MutexLock lock(&mu_);
+    if (status_.ok()) {
+      status_ = Status{absl::StatusCode::kCancelled,
+                       "Communication stream closed by counterpart"};
+    }
+    changed_.SignalAll();
+  }
+
+  Communicator *const communicator_;
+
+  ::grpc::ClientContext context_;
+  const std::unique_ptr<::grpc::ClientReaderWriter<CommunicationBatch,
+                                                   CommunicationConfirmation>>
+      stream_;
+
+  absl::Mutex mu_;
+
+  // Signaled whenever any of the fields guarded by |mu_| changes.
+  absl::CondVar changed_;
+
+  // Messages not yet handed to the writer thread, and their total size.
+  std::deque<CommunicationMessage> queue_ ABSL_GUARDED_BY(mu_);
+  size_t queued_bytes_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Running totals, used by senders and the writer thread to wait for each
+  // other.
+  uint64_t queued_messages_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t written_messages_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t written_batches_ ABSL_GUARDED_BY(mu_) = 0;
+  uint64_t acknowledged_batches_ ABSL_GUARDED_BY(mu_) = 0;
+
+  // Set by Close(). Queued messages are still written.
+  bool closing_ ABSL_GUARDED_BY(mu_) = false;
+
+  // First error encountered. Once set, the stream accepts no more messages.
+  Status status_ ABSL_GUARDED_BY(mu_);
+
+  absl::once_flag close_once_;
+  std::unique_ptr<Thread> writer_thread_;
+  std::unique_ptr<Thread> reader_thread_;
+};
+
 Status Communicator::ClientImpl::RunInvocation(
     Communicator::Invocation *invocation) {
   if (!communicator_->is_client_ready_.load()) {
@@ -119,7 +319,8 @@ Status Communicator::ClientImpl::RunInvocation(
   return invocation->status;
 }
 
-Communicator::ClientImpl::~ClientImpl() = default;
+Communicator::ClientImpl::~ClientImpl() { CloseTransports(); }
+
 Communicator::ClientImpl::ClientImpl(Communicator *communicator)
     : sequence_number_(0), communicator_(CHECK_NOTNULL(communicator)) {}
 
@@ -138,6 +339,13 @@ Communicator::ClientImpl::Create(const RemoteProxyConfig &config,
   }
   client->grpc_stub_ =
       CommunicatorService::NewStub(client->grpc_channel_);
+  for (int i = 0; i < config.communication_streams(); ++i) {
+    client->streams_.push_back(absl::make_unique<CommunicationStream>(
+        client->grpc_stub_.get(), communicator));
+  }
+  if (config.shared_memory_transport()) {
+    client->AttachSharedMemoryRing();
+  }
 
   if (communicator->is_host()) {
     const RemoteProxyClientConfig &client_config =
@@ -156,6 +364,19 @@ Communicator::ClientImpl::Create(const RemoteProxyConfig &config,
 Status Communicator::ClientImpl::SendCommunication(
     const CommunicationMessage &message) {
   ASYLO_RETURN_IF_ERROR(IsMessageValid(message));
+  if (ring_) {
+    return SendRingCommunication(message);
+  }
+  if (streams_.empty()) {
+    return SendUnaryCommunication(message);
+  }
+  // Messages of a thread always take the same stream, preserving their order.
+  return streams_[message.invocation_thread_id() % streams_.size()]->Send(
+      message);
+}
+
+Status Communicator::ClientImpl::SendUnaryCommunication(
+    const CommunicationMessage &message) {
   CommunicationConfirmation confirmation;
   if (communicator_->is_host()) {
     confirmation.set_host_time_nanos(absl::GetCurrentTimeNanos());
@@ -178,7 +399,83 @@ Status Communicator::ClientImpl::SendCommunication(
   return absl::OkStatus();
 }
 
+Status Communicator::ClientImpl::SendRingCommunication(
+    const CommunicationMessage &message) {
+  std::string record;
+  if (!message.SerializeToString(&record)) {
+    return Status{absl::StatusCode::kInternal,
+                  "Failed to serialize communication message"};
+  }
+  if (communicator_->is_host()) {
+    // Messages written to the ring are not confirmed, so the host time stamp
+    // travels with the message instead. Concatenated serialized messages parse
+    // as their merge, which avoids copying the message to set the field.
+    CommunicationMessage time_stamp;
+    time_stamp.set_host_time_nanos(absl::GetCurrentTimeNanos());
+    time_stamp.AppendToString(&record);
+  }
+  absl::MutexLock lock(&ring_mu_);
+  if (!ring_status_.ok()) {
+    return ring_status_;
+  }
+  Status status = ring_->Write(record, absl::Seconds(5));
+  if (status.ok()) {
+    return status;
+  }
+  // Later messages are not sent over gRPC instead, since they could overtake
+  // messages of the same thread still in the ring, and |message| is lost.
+  if (status.code() == absl::StatusCode::kDeadlineExceeded) {
+    // The counterpart stopped consuming the ring. Close it, so that it does
+    // not wait on it any longer.
+    LOG(ERROR) << "Shared memory ring stalled, status=" << status;
+    ring_->Close();
+  }
+  ring_status_ = Status{absl::StatusCode::kUnavailable,
+                        absl::StrCat("Shared memory ring failed: ",
+                                     status.message())};
+  return ring_status_;
+}
+
+void Communicator::ClientImpl::AttachSharedMemoryRing() {
+  auto ring_result = SharedMemoryRing::Create(kSharedMemoryRingCapacity);
+  if (!ring_result.ok()) {
+    LOG(WARNING) << "Failed to create shared memory ring, status="
+                 << ring_result.status();
+    return;
+  }
+  std::unique_ptr<SharedMemoryRing> ring = std::move(ring_result).value();
+  SharedMemoryRingRequest request;
+  request.set_pid(getpid());
+  request.set_fd(ring->fd());
+  request.set_token(ring->token());
+  SharedMemoryRingReply reply;
+  ::grpc::ClientContext context;
+  gpr_timespec absolute_deadline = gpr_time_add(
+      gpr_now(GPR_CLOCK_REALTIME), gpr_time_from_seconds(5, GPR_TIMESPAN));
+  context.set_deadline(absolute_deadline);
+  const auto grpc_status =
+      grpc_stub_->AttachSharedMemoryRing(&context, request, &reply);
+  if (!grpc_status.ok()) {
+    // Expected when the counterpart runs on another machine.
+    LOG(INFO) << "Shared memory ring not attached, using gRPC, status="
+              << ConvertStatus<absl::Status>(grpc_status);
+    return;
+  }
+  ring_ = std::move(ring);
+}
+
+void Communicator::ClientImpl::CloseTransports() {
+  if (ring_) {
+    ring_->Close();
+  }
+  for (auto &stream : streams_) {
+    stream->Close();
+  }
+}
+
 void Communicator::ClientImpl::SendDisconnect() {
+  // Deliver all queued messages before the counterpart shuts down.
+  CloseTransports();
   DisconnectRequest request;
   DisconnectReply reply;
   ::grpc::ClientContext context;
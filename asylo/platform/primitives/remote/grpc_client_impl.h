@@ -22,12 +22,16 @@
 #include <atomic>
 #include <cstdint>
 #include <memory>
+#include <vector>
 
+#include "absl/base/thread_annotations.h"
 #include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
 #include "asylo/platform/primitives/remote/communicator.h"
 #include "asylo/platform/primitives/remote/grpc_service.grpc.pb.h"
 #include "asylo/platform/primitives/remote/grpc_service.pb.h"
 #include "asylo/platform/primitives/remote/metrics/clients/opencensus_client.h"
+#include "asylo/platform/primitives/remote/shared_memory_ring.h"
 #include "asylo/util/asylo_macros.h"
 #include "asylo/util/remote/remote_loader.pb.h"
 #include "asylo/util/status.h"
@@ -54,11 +58,18 @@ class Communicator::ClientImpl {
       Communicator *const communicator);
 
   // Sends CommuncationMessage (request or response) to the counterpart
-  // Communicator.
+  // Communicator. If the counterpart has attached to the shared memory ring,
+  // the message is written to the ring. Once the ring stalls or is closed, this
+  // and all later messages fail rather than being sent over gRPC, which would
+  // not preserve their order. Otherwise, if communication streams are
+  // configured, the message is queued on the stream selected by its
+  // invocation_thread_id, and the call returns once the batch containing it has
+  // been written to the stream.
   Status SendCommunication(const CommunicationMessage &message);
 
-  // Sends disconnect request to the Communicator counterpart, triggering it to
-  // shut down.
+  // Closes the shared memory ring and flushes and closes communication
+  // streams, if any, then sends disconnect request to the Communicator
+  // counterpart, triggering it to shut down.
   void SendDisconnect();
 
   // Sends end point address to the counterpart. Not mandatory, expected to be
@@ -75,9 +86,28 @@ class Communicator::ClientImpl {
   Status RunInvocation(Communicator::Invocation *invocation);
 
  private:
+  // Persistent CommunicateStream RPC that batches messages queued by any
+  // number of threads.
+  class CommunicationStream;
+
   // Constructor, used by factory method only.
   explicit ClientImpl(Communicator *communicator);
 
+  // Creates a shared memory ring and asks the counterpart to attach to it.
+  // Leaves |ring_| empty if the counterpart is not on the same machine.
+  void AttachSharedMemoryRing();
+
+  // Sends |message| with a unary Communicate RPC.
+  Status SendUnaryCommunication(const CommunicationMessage &message);
+
+  // Writes |message| to the shared memory ring. Closes the ring if it stalls,
+  // and fails all later calls once a write has failed.
+  Status SendRingCommunication(const CommunicationMessage &message);
+
+  // Closes the shared memory ring, and flushes and closes all communication
+  // streams. The counterpart still consumes messages already in the ring.
+  void CloseTransports();
+
   // Generates atomically increasing monotonic sequence number
   // for request-response match verification.
   uint64_t GenerateSequenceNumber();
@@ -86,6 +116,20 @@ class Communicator::ClientImpl {
   std::shared_ptr<::grpc::Channel> grpc_channel_;
   std::unique_ptr<CommunicatorService::Stub> grpc_stub_;
 
+  // Communication streams, empty if messages are sent with unary RPCs. The
+  // vector is populated by Create() and not resized afterwards.
+  std::vector<std::unique_ptr<CommunicationStream>> streams_;
+
+  // Shared memory ring consumed by a co-located counterpart, or null if
+  // messages are sent over gRPC. Set by Create() and not changed afterwards.
+  std::unique_ptr<SharedMemoryRing> ring_;
+
+  // Serializes writers of |ring_|, which supports a single writer at a time.
+  absl::Mutex ring_mu_;
+
+  // The error returned by all writes to |ring_| after one has failed.
+  Status ring_status_ ABSL_GUARDED_BY(ring_mu_);
+
   // SequenceNumber generation.
   std::atomic<uint64_t> sequence_number_;
 
@@ -23,6 +23,7 @@
 #include <ctime>
 #include <iterator>
 #include <string>
+#include <utility>
 
 #include "absl/flags/flag.h"
 #include "absl/status/status.h"
@@ -35,6 +36,7 @@
 #include "asylo/platform/primitives/remote/grpc_service.grpc.pb.h"
 #include "asylo/platform/primitives/remote/grpc_service.pb.h"
 #include "asylo/platform/primitives/remote/metrics/proc_system_service.h"
+#include "asylo/platform/primitives/remote/shared_memory_ring.h"
 #include "asylo/util/status.h"
 #include "asylo/util/status_helpers.h"
 #include "asylo/util/status_macros.h"
@@ -45,6 +47,7 @@
 #include "include/grpcpp/impl/codegen/completion_queue.h"
 #include "include/grpcpp/support/status.h"
 #include "include/grpcpp/create_channel.h"
+#include "include/grpcpp/impl/codegen/async_stream.h"
 #include "include/grpcpp/impl/codegen/async_unary_call.h"
 #include "include/grpcpp/impl/codegen/server_context.h"
 #include "include/grpcpp/security/server_credentials.h"
@@ -141,13 +144,23 @@ void Communicator::ServiceImpl::StartInvocation(
   handler_(std::move(invocation));
 }
 
+// Base of all completion queue tags: ServerRpcLoop calls Proceed() with the
+// result of the operation the tag was registered with.
+class Communicator::ServiceImpl::Tag {
+ public:
+  virtual ~Tag() = default;
+
+  virtual void Proceed(bool ok) = 0;
+};
+
 // Server-side instance base that asynchronously processes one RPC call through
 // its stages.
-class Communicator::ServiceImpl::RpcInstance {
+class Communicator::ServiceImpl::RpcInstance
+    : public Communicator::ServiceImpl::Tag {
  public:
   explicit RpcInstance(Communicator::ServiceImpl *service)
       : service_(CHECK_NOTNULL(service)), completed_(false) {}
-  virtual ~RpcInstance() = default;
+  ~RpcInstance() override = default;
 
   RpcInstance(const RpcInstance &other) = delete;
   RpcInstance &operator=(const RpcInstance &other) = delete;
@@ -175,6 +188,8 @@ class Communicator::ServiceImpl::RpcInstance {
   ::grpc::ServerContext *context() { return &context_; }
 
  private:
+  void Proceed(bool ok) override { ProcessRpc(ok); }
+
   // Executes specific RPC.
   virtual void ExecuteRpc() = 0;
 
@@ -250,6 +265,206 @@ class Communicator::ServiceImpl::CommunicationRpcInstance
   ::grpc::ServerAsyncResponseWriter<CommunicationConfirmation> responder_;
 };
 
+// Server-side instance of a CommunicateStream call. Unlike the unary RPCs, the
+// stream has several operations in progress at once (a read and an
+// acknowledgement write), so each kind of operation has its own tag. All tags
+// are processed on the ServerRpcLoop thread, so the state needs no locking.
+class Communicator::ServiceImpl::CommunicationStreamRpcInstance {
+ public:
+  explicit CommunicationStreamRpcInstance(Communicator::ServiceImpl *service)
+      : service_(CHECK_NOTNULL(service)),
+        connected_tag_(this, &CommunicationStreamRpcInstance::OnConnected),
+        read_tag_(this, &CommunicationStreamRpcInstance::OnRead),
+        written_tag_(this, &CommunicationStreamRpcInstance::OnWritten),
+        finished_tag_(this, &CommunicationStreamRpcInstance::OnFinished),
+        stream_(&context_) {
+    service->RequestCommunicateStream(&context_, &stream_,
+                                      service->completion_queue_.get(),
+                                      service->completion_queue_.get(),
+                                      static_cast<Tag *>(&connected_tag_));
+  }
+
+  ~CommunicationStreamRpcInstance() {
+    if (registered_) {
+      service_->active_streams_.Lock()->erase(&context_);
+    }
+  }
+
+  CommunicationStreamRpcInstance(const CommunicationStreamRpcInstance &other) =
+      delete;
+  CommunicationStreamRpcInstance &operator=(
+      const CommunicationStreamRpcInstance &other) = delete;
+
+ private:
+  // Tag that forwards completion of an operation to a member function.
+  class OperationTag : public Communicator::ServiceImpl::Tag {
+   public:
+    using Handler = void (CommunicationStreamRpcInstance::*)(bool ok);
+
+    OperationTag(CommunicationStreamRpcInstance *instance, Handler handler)
+        : instance_(instance), handler_(handler) {}
+
+    void Proceed(bool ok) override { (instance_->*handler_)(ok); }
+
+   private:
+    CommunicationStreamRpcInstance *const instance_;
+    const Handler handler_;
+  };
+
+  void OnConnected(bool ok) {
+    if (!ok) {
+      // The server is shutting down.
+      delete this;
+      return;
+    }
+    // Spawn a new CommunicationStreamRpcInstance to serve new clients while
+    // this one serves its stream.
+    new CommunicationStreamRpcInstance(service_);
+    service_->active_streams_.Lock()->insert(&context_);
+    registered_ = true;
+    stream_.Read(&batch_, static_cast<Tag *>(&read_tag_));
+  }
+
+  void OnRead(bool ok) {
+    if (!ok) {
+      // The client has closed its side of the stream, or the stream failed.
+      read_done_ = true;
+      MaybeFinish();
+      return;
+    }
+
+    Communicator *const communicator = service_->communicator_;
+    // If received time stamp from host with batch, store it.
+    if (!communicator->is_host() && batch_.has_host_time_nanos()) {
+      communicator->set_host_time_nanos(batch_.host_time_nanos());
+    }
+    for (CommunicationMessage &message : *batch_.mutable_messages()) {
+      // Each message is owned by its wrapper, since it may outlive the batch.
+      auto *owned_message = new CommunicationMessage(std::move(message));
+      communicator->QueueMessageForThread(CommunicationMessagePtr(
+          owned_message,
+          WrappedMessageDeleter([owned_message] { delete owned_message; })));
+    }
+    batch_.Clear();
+    ++received_batches_;
+    MaybeWriteAcknowledgement();
+    stream_.Read(&batch_, static_cast<Tag *>(&read_tag_));
+  }
+
+  void OnWritten(bool ok) {
+    writing_ = false;
+    if (ok) {
+      MaybeWriteAcknowledgement();
+    }
+    MaybeFinish();
+  }
+
+  void OnFinished(bool ok) { delete this; }
+
+  // Acknowledges the batches received so far, unless a previous
+  // acknowledgement is still being written (in which case OnWritten sends the
+  // latest count).
+  void MaybeWriteAcknowledgement() {
+    if (writing_ || finishing_ || acknowledged_batches_ == received_batches_) {
+      return;
+    }
+    confirmation_.Clear();
+    // If host responds to the target, add time stamp.
+    if (service_->communicator_->is_host()) {
+      confirmation_.set_host_time_nanos(absl::GetCurrentTimeNanos());
+    }
+    confirmation_.set_received_batches(received_batches_);
+    acknowledged_batches_ = received_batches_;
+    writing_ = true;
+    stream_.Write(confirmation_, static_cast<Tag *>(&written_tag_));
+  }
+
+  // Finishes the stream once reading is done and no write is in progress.
+  void MaybeFinish() {
+    if (!read_done_ || writing_ || finishing_) {
+      return;
+    }
+    finishing_ = true;
+    stream_.Finish(::grpc::Status::OK, static_cast<Tag *>(&finished_tag_));
+  }
+
+  Communicator::ServiceImpl *const service_;
+
+  OperationTag connected_tag_;
+  OperationTag read_tag_;
+  OperationTag written_tag_;
+  OperationTag finished_tag_;
+
+  bool registered_ = false;
+  bool read_done_ = false;
+  bool writing_ = false;
+  bool finishing_ = false;
+  uint64_t received_batches_ = 0;
+  uint64_t acknowledged_batches_ = 0;
+
+  // What we get from the client.
+  CommunicationBatch batch_;
+
+  // What we send back to the client.
+  CommunicationConfirmation confirmation_;
+
+  // Context and the means to get back to the client (must always be the last:
+  // destruct them before batch_ and confirmation_).
+  ::grpc::ServerContext context_;
+  ::grpc::ServerAsyncReaderWriter<CommunicationConfirmation, CommunicationBatch>
+      stream_;
+};
+
+class Communicator::ServiceImpl::AttachSharedMemoryRingRpcInstance
+    : public Communicator::ServiceImpl::RpcInstance {
+ public:
+  // Take in the "service" instance (in this case representing an asynchronous
+  // server) and the "completion_queue" used for asynchronous communication
+  // with the gRPC runtime.
+  explicit AttachSharedMemoryRingRpcInstance(Communicator::ServiceImpl *service)
+      : Communicator::ServiceImpl::RpcInstance(service), responder_(context()) {
+    // Request* that the system start processing Send requests. In this request,
+    // "this" acts as the tag uniquely identifying the request (so that
+    // different AttachSharedMemoryRingRpcInstance instances can serve
+    // different requests concurrently), in this case the memory address of
+    // this AttachSharedMemoryRingRpcInstance.
+    service->RequestAttachSharedMemoryRing(context(), &request_, &responder_,
+                                           completion_queue(),
+                                           completion_queue(), this);
+  }
+
+ private:
+  void RespondRpc() override {
+    // And we are done! Let the gRPC runtime know we've finished, using the
+    // memory address of this instance as the uniquely identifying tag for
+    // the event.
+    responder_.Finish(confirmation_, ConvertStatus<::grpc::Status>(status_),
+                      this);
+  }
+
+  void ExecuteRpc() override {
+    // Spawn a new AttachSharedMemoryRingRpcInstance instance to serve new
+    // clients while we process the one for this
+    // AttachSharedMemoryRingRpcInstance. The instance will deallocate itself
+    // once completed.
+    new AttachSharedMemoryRingRpcInstance(service());
+
+    status_ = service()->AttachSharedMemoryRing(request_);
+    Complete();
+  }
+
+  // What we get from the client.
+  SharedMemoryRingRequest request_;
+
+  // What we send back to the client.
+  SharedMemoryRingReply confirmation_;
+  Status status_;
+
+  // The means to get back to the client (must always be the last: destruct
+  // it before request_ and confirmation_).
+  ::grpc::ServerAsyncResponseWriter<SharedMemoryRingReply> responder_;
+};
+
 class Communicator::ServiceImpl::DisconnectRpcInstance
     : public Communicator::ServiceImpl::RpcInstance {
  public:
@@ -430,6 +645,8 @@ Communicator::ServiceImpl::Create(
 void Communicator::ServiceImpl::ServerRpcLoop() {
   // Spawn new RpcInstances for all possible RPCs to serve new clients.
   new CommunicationRpcInstance(this);
+  new CommunicationStreamRpcInstance(this);
+  new AttachSharedMemoryRingRpcInstance(this);
   new DisconnectRpcInstance(this);
   new DisposeOfThreadRpcInstance(this);
   new EndPointAddressRpcInstance(this);
@@ -441,6 +658,8 @@ void Communicator::ServiceImpl::ServerRpcLoop() {
   // memory address of an RpcInstance.
   // The return value of Next should always be checked. This return value
   // tells us whether there is any kind of event or cq_ is shutting down.
+  // Every tag is a Tag: either an RpcInstance, or an operation of a
+  // CommunicationStreamRpcInstance.
   for (;;) {
     gpr_timespec next_deadline = gpr_time_add(
         gpr_now(GPR_CLOCK_REALTIME),
@@ -456,7 +675,7 @@ void Communicator::ServiceImpl::ServerRpcLoop() {
       continue;
     }
     CHECK_EQ(next_status, grpc::CompletionQueue::GOT_EVENT);
-    static_cast<RpcInstance *>(tag)->ProcessRpc(ok);
+    static_cast<Tag *>(tag)->Proceed(ok);
   }
 }
 
@@ -465,6 +684,9 @@ Communicator::ServiceImpl::~ServiceImpl() {
   if (rpc_thread_) {
     rpc_thread_->Join();
   }
+  // The RPC thread may have attached a ring while the server was shutting
+  // down.
+  DetachSharedMemoryRings();
 }
 
 std::string Communicator::ServiceImpl::WaitForEndPointAddress() {
@@ -497,6 +719,12 @@ std::string Communicator::ServiceImpl::WaitForEndPointAddress() {
 }
 
 void Communicator::ServiceImpl::WaitForDisconnect() {
+  // Communication streams stay open until the counterpart closes them; cancel
+  // them so that the server shutdown does not wait for the counterpart.
+  for (::grpc::ServerContext *context : *active_streams_.ReaderLock()) {
+    context->TryCancel();
+  }
+  DetachSharedMemoryRings();
   if (server_) {
     server_->Shutdown();
   }
@@ -506,6 +734,57 @@ void Communicator::ServiceImpl::WaitForDisconnect() {
   }
 }
 
+Status Communicator::ServiceImpl::AttachSharedMemoryRing(
+    const SharedMemoryRingRequest &request) {
+  AttachedRing attached_ring;
+  ASYLO_ASSIGN_OR_RETURN(
+      attached_ring.ring,
+      SharedMemoryRing::Attach(request.pid(), request.fd(), request.token()));
+  SharedMemoryRing *const ring = attached_ring.ring.get();
+  attached_ring.consumer = absl::make_unique<Thread>(
+      [this, ring] { ConsumeSharedMemoryRing(ring); });
+  attached_rings_.Lock()->push_back(std::move(attached_ring));
+  return absl::OkStatus();
+}
+
+void Communicator::ServiceImpl::ConsumeSharedMemoryRing(
+    SharedMemoryRing *ring) {
+  std::string record;
+  for (;;) {
+    const Status status = ring->Read(&record);
+    if (!status.ok()) {
+      if (status.code() != absl::StatusCode::kCancelled) {
+        LOG(ERROR) << "Shared memory ring error=" << status;
+        // Do not leave the counterpart waiting for room in the ring.
+        ring->Close();
+      }
+      return;
+    }
+    auto *message = new CommunicationMessage;
+    if (!message->ParseFromString(record)) {
+      LOG(ERROR) << "Malformed message in shared memory ring";
+      delete message;
+      continue;
+    }
+    // If received time stamp from host with message, store it.
+    if (!communicator_->is_host() && message->has_host_time_nanos()) {
+      communicator_->set_host_time_nanos(message->host_time_nanos());
+    }
+    communicator_->QueueMessageForThread(CommunicationMessagePtr(
+        message, WrappedMessageDeleter([message] { delete message; })));
+  }
+}
+
+void Communicator::ServiceImpl::DetachSharedMemoryRings() {
+  std::vector<AttachedRing> attached_rings;
+  attached_rings.swap(*attached_rings_.Lock());
+  for (AttachedRing &attached_ring : attached_rings) {
+    // Records written before the ring is closed are still consumed.
+    attached_ring.ring->Close();
+    attached_ring.consumer->Join();
+  }
+}
+
 void Communicator::ServiceImpl::RecordEndPointAddress(
     absl::string_view address) {
   auto end_point_address_callback_lock =
@@ -24,13 +24,17 @@
 #include <memory>
 #include <string>
 #include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_set.h"
 #include "absl/strings/string_view.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/primitives/remote/communicator.h"
 #include "asylo/platform/primitives/remote/grpc_service.grpc.pb.h"
 #include "asylo/platform/primitives/remote/metrics/proc_system_service.h"
+#include "asylo/platform/primitives/remote/shared_memory_ring.h"
 #include "asylo/util/asylo_macros.h"
+#include "asylo/util/mutex_guarded.h"
 #include "asylo/util/status.h"
 #include "asylo/util/statusor.h"
 #include "asylo/util/thread.h"
@@ -59,9 +63,10 @@ class Communicator::ServiceImpl
   // processes an RPC with a disconnect request.
   void ServerRpcLoop();
 
-  // Shuts down server and completion queue, joins ServerRpcLoop thread (thus
-  // waiting for ServerRpcLoop to terminate). When WaitForDisconnect returns,
-  // it is safe to destruct ServiceImpl instance.
+  // Cancels open communication streams, consumes the messages left in attached
+  // shared memory rings, shuts down server and completion queue, joins
+  // ServerRpcLoop thread (thus waiting for ServerRpcLoop to terminate). When
+  // WaitForDisconnect returns, it is safe to destruct ServiceImpl instance.
   void WaitForDisconnect();
 
   // Waits for end point address to be received from the counterpart calling
@@ -81,23 +86,54 @@ class Communicator::ServiceImpl
   ServiceImpl &operator=(const ServiceImpl &other) = delete;
 
  private:
+  // Completion queue tag, notified when an asynchronous operation completes.
+  class Tag;
+
   // Server-side instance base of an RPC call.
   class RpcInstance;
 
   // Classes for all supported RPC calls.
   class CommunicationRpcInstance;
+  class CommunicationStreamRpcInstance;
+  class AttachSharedMemoryRingRpcInstance;
   class DisconnectRpcInstance;
   class DisposeOfThreadRpcInstance;
   class EndPointAddressRpcInstance;
 
   // Constructor is called by Create() factory only.
   explicit ServiceImpl(Communicator *communicator)
-      : end_point_address_callback_(absl::optional<address_callback>()),
+      : active_streams_(absl::flat_hash_set<::grpc::ServerContext *>()),
+        attached_rings_(std::vector<AttachedRing>()),
+        end_point_address_callback_(absl::optional<address_callback>()),
         communicator_(CHECK_NOTNULL(communicator)),
         address_state_(absl::optional<std::string>()) {}
 
   void RecordEndPointAddress(absl::string_view address);
 
+  // Maps the shared memory ring described by |request| and starts a thread
+  // queueing the messages read from it.
+  Status AttachSharedMemoryRing(const SharedMemoryRingRequest &request);
+
+  // Queues messages read from |ring| until it is closed.
+  void ConsumeSharedMemoryRing(SharedMemoryRing *ring);
+
+  // Closes attached shared memory rings and joins their consumer threads, once
+  // the messages left in the rings have been queued.
+  void DetachSharedMemoryRings();
+
+  // Contexts of the CommunicateStream RPCs currently open, cancelled by
+  // WaitForDisconnect since streams stay open until the counterpart closes
+  // them.
+  MutexGuarded<absl::flat_hash_set<::grpc::ServerContext *>> active_streams_;
+
+  // Shared memory ring attached at the request of the counterpart, and the
+  // thread consuming it.
+  struct AttachedRing {
+    std::unique_ptr<SharedMemoryRing> ring;
+    std::unique_ptr<Thread> consumer;
+  };
+  MutexGuarded<std::vector<AttachedRing>> attached_rings_;
+
   // Request handler provided by the caller.
   std::function<void(std::unique_ptr<Invocation> invocation)> handler_;
 
@@ -0,0 +1,425 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/platform/primitives/remote/shared_memory_ring.h"
+
+#include <fcntl.h>
+#include <openssl/rand.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/platform/common/futex.h"
+#include "asylo/util/posix_errors.h"
+#include "asylo/util/status.h"
+#include "asylo/util/status_macros.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+namespace primitives {
+namespace {
+
+// Identifies a mapping as a SharedMemoryRing of this layout ("ASYLORNG").
+constexpr uint64_t kRingMagic = 0x474e524f4c595341;
+
+constexpr size_t kTokenSize = 16;
+
+constexpr size_t kCacheLineSize = 64;
+
+// Fragments are aligned so that their length prefix never wraps around the
+// end of the ring.
+constexpr size_t kFragmentAlignment = 8;
+
+// Set in the length prefix of every fragment but the last of a record.
+constexpr uint32_t kMoreFragments = 0x80000000;
+
+constexpr size_t kMinCapacity = 16 * kFragmentAlignment;
+
+// Default time Write() and Read() wait for each fragment of a record after its
+// first one.
+constexpr absl::Duration kDefaultFragmentTimeout = absl::Seconds(5);
+
+// Number of times a blocked reader or writer polls the ring before sleeping on
+// the futex. A counterpart that keeps up is noticed without a system call.
+constexpr int kSpinIterations = 2000;
+
+// Returns the number of times to poll the ring before sleeping. Spinning only
+// delays the counterpart when both share a single CPU.
+int SpinIterations() {
+  static const int spin_iterations =
+      std::thread::hardware_concurrency() > 1 ? kSpinIterations : 0;
+  return spin_iterations;
+}
+
+size_t RoundUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+size_t FragmentSize(size_t payload_size) {
+  return RoundUp(sizeof(uint32_t) + payload_size, kFragmentAlignment);
+}
+
+void Pause() {
+#if defined(__x86_64__)
+  __builtin_ia32_pause();
+#endif
+}
+
+}  // namespace
+
+// Layout of the start of the shared mapping. The positions are running byte
+// counts, reduced modulo the capacity when indexing the record area. Fields
+// written by the consumer and by the producer are kept on separate cache lines.
+struct SharedMemoryRing::Header {
+  uint64_t magic;
+  uint64_t capacity;
+  char token[kTokenSize];
+
+  // Written by the consumer.
+  alignas(kCacheLineSize) std::atomic<uint64_t> head;
+  std::atomic<int32_t> space_sequence;
+  std::atomic<int32_t> consumer_waiting;
+
+  // Written by the producer.
+  alignas(kCacheLineSize) std::atomic<uint64_t> tail;
+  std::atomic<int32_t> data_sequence;
+  std::atomic<int32_t> producer_waiting;
+
+  alignas(kCacheLineSize) std::atomic<int32_t> closed;
+};
+
+// The header is shared between processes, so its atomics must be plain words.
+static_assert(sizeof(std::atomic<uint64_t>) == sizeof(uint64_t),
+              "std::atomic<uint64_t> is not lock free.");
+static_assert(sizeof(std::atomic<int32_t>) == sizeof(int32_t),
+              "std::atomic<int32_t> is not lock free.");
+
+StatusOr<std::unique_ptr<SharedMemoryRing>> SharedMemoryRing::Create(
+    size_t capacity) {
+  capacity = RoundUp(std::max(capacity, kMinCapacity), kFragmentAlignment);
+  std::string token(kTokenSize, '\0');
+  if (RAND_bytes(reinterpret_cast<uint8_t *>(&token[0]), token.size()) != 1) {
+    return absl::InternalError("Failed to generate shared memory ring token");
+  }
+
+  int fd = memfd_create("asylo_communicator_ring", MFD_CLOEXEC);
+  if (fd == -1) {
+    return LastPosixError("Failed to create shared memory ring");
+  }
+  const size_t mapping_size = sizeof(Header) + capacity;
+  if (ftruncate(fd, mapping_size) == -1) {
+    Status status = LastPosixError("Failed to size shared memory ring");
+    close(fd);
+    return status;
+  }
+  void *mapping = mmap(/*addr=*/nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, fd, /*offset=*/0);
+  if (mapping == MAP_FAILED) {
+    Status status = LastPosixError("Failed to map shared memory ring");
+    close(fd);
+    return status;
+  }
+
+  // The memfd is zero-filled, which leaves the ring empty and open.
+  Header *header = new (mapping) Header();
+  header->capacity = capacity;
+  memcpy(header->token, token.data(), kTokenSize);
+  std::atomic_thread_fence(std::memory_order_release);
+  header->magic = kRingMagic;
+  return absl::WrapUnique(
+      new SharedMemoryRing(fd, std::move(token), mapping, mapping_size));
+}
+
+StatusOr<std::unique_ptr<SharedMemoryRing>> SharedMemoryRing::Attach(
+    pid_t pid, int fd, absl::string_view token) {
+  if (token.size() != kTokenSize) {
+    return absl::InvalidArgumentError("Malformed shared memory ring token");
+  }
+  const std::string path = absl::StrCat("/proc/", pid, "/fd/", fd);
+  // Opening a device or a FIFO may block or have side effects, so the file type
+  // is checked before the file is opened. The descriptor is opened without
+  // blocking and without acquiring a controlling terminal in case the file is
+  // replaced in between, which is detected below.
+  struct stat path_stat;
+  if (stat(path.c_str(), &path_stat) == -1) {
+    return LastPosixError(absl::StrCat("Failed to stat ", path));
+  }
+  if (!S_ISREG(path_stat.st_mode)) {
+    return absl::FailedPreconditionError(
+        absl::StrCat(path, " is not a shared memory ring"));
+  }
+  int local_fd =
+      open(path.c_str(), O_RDWR | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+  if (local_fd == -1) {
+    return LastPosixError(absl::StrCat("Failed to open ", path));
+  }
+  struct stat stat_buffer;
+  if (fstat(local_fd, &stat_buffer) == -1) {
+    Status status = LastPosixError("Failed to stat shared memory ring");
+    close(local_fd);
+    return status;
+  }
+  const size_t mapping_size = stat_buffer.st_size;
+  if (!S_ISREG(stat_buffer.st_mode) ||
+      stat_buffer.st_dev != path_stat.st_dev ||
+      stat_buffer.st_ino != path_stat.st_ino ||
+      mapping_size < sizeof(Header) + kMinCapacity) {
+    close(local_fd);
+    return absl::FailedPreconditionError(
+        absl::StrCat(path, " is not a shared memory ring"));
+  }
+  void *mapping = mmap(/*addr=*/nullptr, mapping_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED, local_fd, /*offset=*/0);
+  if (mapping == MAP_FAILED) {
+    Status status = LastPosixError("Failed to map shared memory ring");
+    close(local_fd);
+    return status;
+  }
+  // Constructed before validating the header, so that the mapping and the
+  // descriptor are released on failure.
+  auto ring = absl::WrapUnique(new SharedMemoryRing(
+      local_fd, std::string(token), mapping, mapping_size));
+
+  const Header *header = ring->header_;
+  if (header->magic != kRingMagic ||
+      header->capacity != mapping_size - sizeof(Header) ||
+      memcmp(header->token, token.data(), kTokenSize) != 0) {
+    return absl::FailedPreconditionError(
+        absl::StrCat(path, " is not the requested shared memory ring"));
+  }
+  return std::move(ring);
+}
+
+SharedMemoryRing::SharedMemoryRing(int fd, std::string token, void *mapping,
+                                   size_t mapping_size)
+    : fd_(fd),
+      token_(std::move(token)),
+      mapping_(mapping),
+      mapping_size_(mapping_size),
+      header_(static_cast<Header *>(mapping)),
+      data_(static_cast<char *>(mapping) + sizeof(Header)),
+      capacity_(mapping_size - sizeof(Header)),
+      fragment_timeout_(kDefaultFragmentTimeout) {}
+
+SharedMemoryRing::~SharedMemoryRing() {
+  munmap(mapping_, mapping_size_);
+  close(fd_);
+}
+
+size_t SharedMemoryRing::max_fragment_size() const {
+  // Leaves room for several fragments in flight, so that the producer rarely
+  // waits for the consumer to catch up with a single large fragment.
+  return capacity_ / 4 - sizeof(uint32_t);
+}
+
+Status SharedMemoryRing::Write(absl::string_view record,
+                               absl::Duration timeout) {
+  absl::Time deadline = absl::Now() + timeout;
+  bool started = false;
+  bool more;
+  do {
+    const size_t size = std::min(record.size(), max_fragment_size());
+    more = size < record.size();
+    Status status = WriteFragment(record.substr(0, size), more, deadline);
+    if (!status.ok()) {
+      if (started) {
+        // The reader is already assembling the record, which cannot be
+        // withdrawn.
+        Close();
+      }
+      return status;
+    }
+    started = true;
+    record.remove_prefix(size);
+    deadline = absl::Now() + fragment_timeout_;
+  } while (more);
+  return absl::OkStatus();
+}
+
+Status SharedMemoryRing::Read(std::string *record, absl::Duration timeout) {
+  record->clear();
+  absl::Time deadline = absl::Now() + timeout;
+  bool started = false;
+  bool more;
+  do {
+    Status status = ReadFragment(record, &more, deadline);
+    if (!status.ok()) {
+      if (started) {
+        // The rest of the record can no longer be told apart from the next
+        // record.
+        Close();
+      }
+      return status;
+    }
+    started = true;
+    deadline = absl::Now() + fragment_timeout_;
+  } while (more);
+  return absl::OkStatus();
+}
+
+Status SharedMemoryRing::WriteFragment(absl::string_view fragment, bool more,
+                                       absl::Time deadline) {
+  const size_t fragment_size = FragmentSize(fragment.size());
+  const uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+  bool corrupted = false;
+  auto no_space = [this, tail, fragment_size, &corrupted] {
+    const uint64_t used = tail - header_->head.load();
+    corrupted = used > capacity_;
+    return !corrupted && capacity_ - used < fragment_size;
+  };
+  ASYLO_RETURN_IF_ERROR(WaitWhile(&header_->space_sequence,
+                                  &header_->producer_waiting, deadline,
+                                  no_space));
+  if (closed()) {
+    return absl::CancelledError("Shared memory ring closed");
+  }
+  if (corrupted) {
+    return absl::DataLossError("Shared memory ring corrupted");
+  }
+
+  const uint32_t prefix = fragment.size() | (more ? kMoreFragments : 0);
+  CopyIn(tail, &prefix, sizeof(prefix));
+  CopyIn(tail + sizeof(prefix), fragment.data(), fragment.size());
+  header_->tail.store(tail + fragment_size);
+  if (header_->consumer_waiting.load()) {
+    header_->data_sequence.fetch_add(1);
+    sys_futex_wake(reinterpret_cast<int32_t *>(&header_->data_sequence), 1);
+  }
+  return absl::OkStatus();
+}
+
+Status SharedMemoryRing::ReadFragment(std::string *record, bool *more,
+                                      absl::Time deadline) {
+  const uint64_t head = header_->head.load(std::memory_order_relaxed);
+  auto empty = [this, head] { return header_->tail.load() == head; };
+  ASYLO_RETURN_IF_ERROR(WaitWhile(&header_->data_sequence,
+                                  &header_->consumer_waiting, deadline,
+                                  empty));
+  const uint64_t used = header_->tail.load(std::memory_order_acquire) - head;
+  if (used == 0) {
+    return absl::CancelledError("Shared memory ring closed");
+  }
+
+  // Validate the fragment against what the producer has published before
+  // trusting its length.
+  uint32_t prefix = 0;
+  if (used >= sizeof(prefix) && used <= capacity_) {
+    CopyOut(head, &prefix, sizeof(prefix));
+  }
+  const size_t length = prefix & ~kMoreFragments;
+  if (used < sizeof(prefix) || used > capacity_ ||
+      length > max_fragment_size() || FragmentSize(length) > used) {
+    return absl::DataLossError("Shared memory ring corrupted");
+  }
+  const size_t offset = record->size();
+  record->resize(offset + length);
+  CopyOut(head + sizeof(prefix), &(*record)[offset], length);
+  *more = (prefix & kMoreFragments) != 0;
+
+  header_->head.store(head + FragmentSize(length));
+  if (header_->producer_waiting.load()) {
+    header_->space_sequence.fetch_add(1);
+    sys_futex_wake(reinterpret_cast<int32_t *>(&header_->space_sequence), 1);
+  }
+  return absl::OkStatus();
+}
+
+void SharedMemoryRing::Close() {
+  header_->closed.store(1);
+  header_->data_sequence.fetch_add(1);
+  header_->space_sequence.fetch_add(1);
+  sys_futex_wake(reinterpret_cast<int32_t *>(&header_->data_sequence),
+                 INT_MAX);
+  sys_futex_wake(reinterpret_cast<int32_t *>(&header_->space_sequence),
+                 INT_MAX);
+}
+
+bool SharedMemoryRing::closed() const { return header_->closed.load() != 0; }
+
+template <typename Predicate>
+Status SharedMemoryRing::WaitWhile(std::atomic<int32_t> *futex,
+                                   std::atomic<int32_t> *waiting,
+                                   absl::Time deadline, Predicate predicate) {
+  for (int i = 0; i < SpinIterations(); ++i) {
+    if (!predicate() || closed()) {
+      return absl::OkStatus();
+    }
+    Pause();
+  }
+  for (;;) {
+    const int32_t sequence = futex->load();
+    // Announce the wait before checking the ring again: the counterpart either
+    // sees the announcement after updating the ring and wakes this process, or
+    // updated the ring before the check below.
+    waiting->store(1);
+    if (!predicate() || closed()) {
+      waiting->store(0);
+      return absl::OkStatus();
+    }
+    int64_t timeout_microseconds = 0;  // Waits indefinitely.
+    if (deadline != absl::InfiniteFuture()) {
+      const absl::Duration remaining = deadline - absl::Now();
+      if (remaining <= absl::ZeroDuration()) {
+        waiting->store(0);
+        return absl::DeadlineExceededError(
+            "Timed out waiting for shared memory ring");
+      }
+      timeout_microseconds =
+          std::max<int64_t>(absl::ToInt64Microseconds(remaining), 1);
+    }
+    sys_futex_wait(reinterpret_cast<int32_t *>(futex), sequence,
+                   timeout_microseconds);
+    waiting->store(0);
+  }
+}
+
+void SharedMemoryRing::CopyIn(uint64_t position, const void *source,
+                              size_t size) {
+  const size_t offset = position % capacity_;
+  const size_t first = std::min(size, capacity_ - offset);
+  memcpy(data_ + offset, source, first);
+  memcpy(data_, static_cast<const char *>(source) + first, size - first);
+}
+
+void SharedMemoryRing::CopyOut(uint64_t position, void *destination,
+                               size_t size) const {
+  const size_t offset = position % capacity_;
+  const size_t first = std::min(size, capacity_ - offset);
+  memcpy(destination, data_ + offset, first);
+  memcpy(static_cast<char *>(destination) + first, data_, size - first);
+}
+
+}  // namespace primitives
+}  // namespace asylo
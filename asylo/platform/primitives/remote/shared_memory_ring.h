@@ -0,0 +1,159 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_REMOTE_SHARED_MEMORY_RING_H_
+#define ASYLO_PLATFORM_PRIMITIVES_REMOTE_SHARED_MEMORY_RING_H_
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+
+namespace asylo {
+namespace primitives {
+
+// A queue of variable-size records in a memfd mapping shared by two processes
+// on the same machine, with exactly one producing and one consuming process.
+// Used by Communicator to pass messages to a co-located counterpart without a
+// gRPC round trip.
+//
+// The process creating the ring hands its pid, the memfd descriptor and the
+// ring token to the counterpart (over gRPC), which maps the same memfd through
+// /proc/<pid>/fd/<fd>. Attach fails unless the token matches, so a
+// counterpart on another machine or in another pid namespace cannot mistake
+// an unrelated file for the ring.
+//
+// Either process may be the producer. Write() and Read() each support a single
+// thread at a time; concurrent writers must be serialized by the caller.
+// Records larger than a quarter of the ring are split into fragments, so the
+// size of a record is not bounded by the capacity of the ring. A
+// blocked reader or writer sleeps on a futex in the shared mapping, and is only
+// woken by the counterpart if it announced that it is about to sleep, so that
+// neither side makes a system call while the other keeps up.
+//
+// The contents of the ring are written by the counterpart process and are not
+// trusted: every fragment is validated against the bounds of the ring before
+// it is copied out.
+class SharedMemoryRing {
+ public:
+  // Creates a ring holding up to |capacity| bytes of records, rounded up to a
+  // multiple of 8 bytes.
+  static StatusOr<std::unique_ptr<SharedMemoryRing>> Create(size_t capacity);
+
+  // Maps the ring created by process |pid| with descriptor |fd|. Fails if the
+  // file is not accessible or is not a ring with token |token|.
+  static StatusOr<std::unique_ptr<SharedMemoryRing>> Attach(
+      pid_t pid, int fd, absl::string_view token);
+
+  SharedMemoryRing(const SharedMemoryRing &other) = delete;
+  SharedMemoryRing &operator=(const SharedMemoryRing &other) = delete;
+
+  // Unmaps the ring and closes its descriptor. Does not close the ring for the
+  // counterpart.
+  ~SharedMemoryRing();
+
+  // Descriptor of the memfd backing the ring.
+  int fd() const { return fd_; }
+
+  // Random token identifying the ring, checked by Attach().
+  const std::string &token() const { return token_; }
+
+  // Size of the record area in bytes.
+  size_t capacity() const { return capacity_; }
+
+  // Appends |record| to the ring, waiting for up to |timeout| for space for
+  // its first fragment, then for up to the fragment timeout for space for each
+  // further fragment. A partially written record cannot be withdrawn, so the
+  // ring is closed if a further fragment cannot be written. Returns Cancelled
+  // if the ring is closed and DeadlineExceeded on timeout.
+  Status Write(absl::string_view record,
+               absl::Duration timeout = absl::InfiniteDuration());
+
+  // Removes the oldest record from the ring into |record|, waiting for up to
+  // |timeout| for its first fragment to be written, then for up to the fragment
+  // timeout for each further fragment. Closes the ring if a further fragment
+  // cannot be read. Returns Cancelled once the ring is closed and all records
+  // written before it was closed have been read, DeadlineExceeded on timeout
+  // and DataLoss if the ring is corrupted.
+  Status Read(std::string *record,
+              absl::Duration timeout = absl::InfiniteDuration());
+
+  // Sets how long Write() and Read() wait for each fragment of a record after
+  // its first one. Defaults to 5 seconds.
+  void set_fragment_timeout(absl::Duration timeout) {
+    fragment_timeout_ = timeout;
+  }
+
+  // Closes the ring for both processes, waking any blocked reader or writer.
+  // Records already written can still be read.
+  void Close();
+
+  // Returns true once either process has closed the ring.
+  bool closed() const;
+
+ private:
+  struct Header;
+
+  SharedMemoryRing(int fd, std::string token, void *mapping,
+                   size_t mapping_size);
+
+  // Size of the largest fragment of a record.
+  size_t max_fragment_size() const;
+
+  // Appends one fragment of a record, followed by more fragments if |more|.
+  Status WriteFragment(absl::string_view fragment, bool more,
+                       absl::Time deadline);
+
+  // Appends the next fragment of a record to |record|, and sets |more| if the
+  // record has more fragments.
+  Status ReadFragment(std::string *record, bool *more, absl::Time deadline);
+
+  // Waits on |futex| while |predicate| holds, until |deadline|. Announces the
+  // wait in |waiting| so that the counterpart wakes this process.
+  template <typename Predicate>
+  Status WaitWhile(std::atomic<int32_t> *futex, std::atomic<int32_t> *waiting,
+                   absl::Time deadline, Predicate predicate);
+
+  // Copy |size| bytes to or from the record area at running byte count
+  // |position|, wrapping around its end.
+  void CopyIn(uint64_t position, const void *source, size_t size);
+  void CopyOut(uint64_t position, void *destination, size_t size) const;
+
+  const int fd_;
+  const std::string token_;
+  void *const mapping_;
+  const size_t mapping_size_;
+  Header *const header_;
+  char *const data_;
+  const size_t capacity_;
+  absl::Duration fragment_timeout_;
+};
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_REMOTE_SHARED_MEMORY_RING_H_
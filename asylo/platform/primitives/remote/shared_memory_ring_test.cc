@@ -0,0 +1,194 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/platform/primitives/remote/shared_memory_ring.h"
+
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "asylo/test/util/status_matchers.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+namespace primitives {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::Not;
+
+constexpr size_t kCapacity = 4096;
+
+class SharedMemoryRingTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    auto ring_result = SharedMemoryRing::Create(kCapacity);
+    ASSERT_THAT(ring_result, IsOk());
+    producer_ = std::move(ring_result).value();
+    // The consumer maps the ring the same way a counterpart process does.
+    auto attach_result =
+        SharedMemoryRing::Attach(getpid(), producer_->fd(), producer_->token());
+    ASSERT_THAT(attach_result, IsOk());
+    consumer_ = std::move(attach_result).value();
+  }
+
+  std::unique_ptr<SharedMemoryRing> producer_;
+  std::unique_ptr<SharedMemoryRing> consumer_;
+};
+
+TEST_F(SharedMemoryRingTest, AttachSharesRing) {
+  EXPECT_THAT(consumer_->capacity(), Eq(producer_->capacity()));
+  EXPECT_THAT(consumer_->capacity(), Ge(kCapacity));
+  ASSERT_THAT(producer_->Write("first"), IsOk());
+  ASSERT_THAT(producer_->Write(""), IsOk());
+  ASSERT_THAT(producer_->Write("third"), IsOk());
+  std::string record;
+  ASSERT_THAT(consumer_->Read(&record), IsOk());
+  EXPECT_THAT(record, Eq("first"));
+  ASSERT_THAT(consumer_->Read(&record), IsOk());
+  EXPECT_THAT(record, Eq(""));
+  ASSERT_THAT(consumer_->Read(&record), IsOk());
+  EXPECT_THAT(record, Eq("third"));
+}
+
+TEST_F(SharedMemoryRingTest, AttachRejectsWrongToken) {
+  std::string token = producer_->token();
+  token[0] ^= 1;
+  EXPECT_THAT(SharedMemoryRing::Attach(getpid(), producer_->fd(), token),
+              Not(IsOk()));
+  EXPECT_THAT(SharedMemoryRing::Attach(getpid(), producer_->fd(), "short"),
+              Not(IsOk()));
+}
+
+TEST_F(SharedMemoryRingTest, AttachRejectsOtherFiles) {
+  EXPECT_THAT(
+      SharedMemoryRing::Attach(getpid(), STDIN_FILENO, producer_->token()),
+      Not(IsOk()));
+
+  int pipe_fds[2];
+  ASSERT_THAT(pipe(pipe_fds), Eq(0));
+  EXPECT_THAT(SharedMemoryRing::Attach(getpid(), pipe_fds[0],
+                                       producer_->token()),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+  close(pipe_fds[0]);
+  close(pipe_fds[1]);
+}
+
+TEST_F(SharedMemoryRingTest, FragmentsLargeRecords) {
+  const std::string large_record(10 * producer_->capacity(), 'x');
+  Thread producer_thread([this, &large_record] {
+    ASSERT_THAT(producer_->Write(large_record), IsOk());
+    ASSERT_THAT(producer_->Write("small"), IsOk());
+  });
+  std::string record;
+  ASSERT_THAT(consumer_->Read(&record), IsOk());
+  EXPECT_THAT(record, Eq(large_record));
+  ASSERT_THAT(consumer_->Read(&record), IsOk());
+  EXPECT_THAT(record, Eq("small"));
+  producer_thread.Join();
+}
+
+TEST_F(SharedMemoryRingTest, ReadTimesOut) {
+  std::string record;
+  EXPECT_THAT(consumer_->Read(&record, absl::Milliseconds(10)),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+}
+
+TEST_F(SharedMemoryRingTest, WriteTimesOutWhenFull) {
+  const std::string record(producer_->capacity() / 8, 'x');
+  Status status;
+  while ((status = producer_->Write(record, absl::Milliseconds(10))).ok()) {
+  }
+  EXPECT_THAT(status, StatusIs(absl::StatusCode::kDeadlineExceeded));
+}
+
+TEST_F(SharedMemoryRingTest, StalledRecordClosesRing) {
+  producer_->set_fragment_timeout(absl::Milliseconds(10));
+  const std::string large_record(2 * producer_->capacity(), 'x');
+  EXPECT_THAT(producer_->Write(large_record),
+              StatusIs(absl::StatusCode::kDeadlineExceeded));
+  EXPECT_TRUE(producer_->closed());
+
+  // The reader does not wait for the rest of the record once the ring is
+  // closed.
+  std::string record;
+  EXPECT_THAT(consumer_->Read(&record),
+              StatusIs(absl::StatusCode::kCancelled));
+}
+
+// Streams records of varying sizes through the ring from another thread, so
+// that records wrap around its end, some are fragmented, and both sides block
+// on each other.
+TEST_F(SharedMemoryRingTest, PreservesOrderAcrossWrapAround) {
+  constexpr int kRecords = 5000;
+  auto make_record = [this](int i) {
+    return std::string(i * 7 % (2 * producer_->capacity()), 'a' + i % 26) +
+           absl::StrCat(i);
+  };
+  Thread producer_thread([this, &make_record] {
+    for (int i = 0; i < kRecords; ++i) {
+      ASSERT_THAT(producer_->Write(make_record(i)), IsOk());
+    }
+    producer_->Close();
+  });
+  std::string record;
+  for (int i = 0; i < kRecords; ++i) {
+    ASSERT_THAT(consumer_->Read(&record), IsOk());
+    ASSERT_THAT(record, Eq(make_record(i)));
+  }
+  EXPECT_THAT(consumer_->Read(&record),
+              StatusIs(absl::StatusCode::kCancelled));
+  producer_thread.Join();
+}
+
+TEST_F(SharedMemoryRingTest, CloseWakesBlockedReader) {
+  Thread consumer_thread([this] {
+    std::string record;
+    EXPECT_THAT(consumer_->Read(&record),
+                StatusIs(absl::StatusCode::kCancelled));
+  });
+  absl::SleepFor(absl::Milliseconds(50));
+  producer_->Close();
+  consumer_thread.Join();
+}
+
+TEST_F(SharedMemoryRingTest, CloseDrainsWrittenRecords) {
+  ASSERT_THAT(producer_->Write("record"), IsOk());
+  consumer_->Close();
+  EXPECT_TRUE(producer_->closed());
+  EXPECT_THAT(producer_->Write("late"),
+              StatusIs(absl::StatusCode::kCancelled));
+  std::string record;
+  ASSERT_THAT(consumer_->Read(&record), IsOk());
+  EXPECT_THAT(record, Eq("record"));
+  EXPECT_THAT(consumer_->Read(&record),
+              StatusIs(absl::StatusCode::kCancelled));
+}
+
+}  // namespace
+}  // namespace primitives
+}  // namespace asylo
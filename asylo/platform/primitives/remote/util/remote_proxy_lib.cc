@@ -18,6 +18,7 @@
 
 #include "asylo/platform/primitives/remote/util/remote_proxy_lib.h"
 
+#include <cstdint>
 #include <string>
 #include <utility>
 
@@ -42,6 +43,14 @@
 ABSL_FLAG(std::string, host_address, "[::]:8888",
           "Address that remote enclave calls back to the host");
 
+ABSL_FLAG(int32_t, communication_streams, 0,
+          "Number of persistent streams used to send messages to the host, or "
+          "0 to send each message with its own RPC");
+
+ABSL_FLAG(bool, shared_memory_transport, false,
+          "Pass messages to the host through shared memory when it runs on "
+          "the same machine");
+
 using ::asylo::EnclaveLoadConfig;
 using ::asylo::ProcessMainWrapper;
 using ::asylo::RemoteProxyServerConfig;
@@ -86,6 +95,10 @@ int main(int argc, char **argv) {
     LOG(ERROR) << config_or_request.status();
     return -1;
   }
+  config_or_request.value()->set_communication_streams(
+      absl::GetFlag(FLAGS_communication_streams));
+  config_or_request.value()->set_shared_memory_transport(
+      absl::GetFlag(FLAGS_shared_memory_transport));
 
   const auto run_status =
       ProcessMainWrapper<RemoteEnclaveProxyServer>::RunUntilTerminated(
@@ -26,6 +26,7 @@
 #include "asylo/platform/primitives/sgx/untrusted_cache_malloc.h"
 #include "asylo/platform/primitives/trusted_primitives.h"
 #include "asylo/platform/primitives/trusted_runtime.h"
+#include "asylo/platform/primitives/util/trusted_drbg.h"
 #include "asylo/platform/primitives/util/status_serializer.h"
 #include "asylo/util/status.h"
 
@@ -105,8 +106,15 @@ int Restore(const char *snapshot_layout, size_t snapshot_layout_len,
   // deallocators using the same heap. Consequently, we wait to deserialize this
   // message until after switching heaps in RestoreForFork().
   status = RestoreForFork(snapshot_layout, snapshot_layout_len);
+  if (status.ok()) {
+    // The child inherited the random number generator state of its parent.
+    primitives::TrustedDrbgForkReseed();
+  }
   int ret = status_serializer.Serialize(status);
 
+  // Threads left idle in the parent enclave were not forked.
+  ThreadManager::GetInstance()->ForgetIdleThreads();
+
   if (!status.ok()) {
     // Delete instance of the global memory pool singleton freeing all memory
     // held by the pool.
@@ -19,8 +19,11 @@
 #include <openssl/rand.h>
 #include <sys/socket.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
@@ -50,6 +53,10 @@
 #include "asylo/util/posix_errors.h"
 #include "asylo/util/status.h"
 
+// Largest size the enclave heap has grown to through enclave_sbrk(), defined
+// by the SGX trusted runtime.
+extern "C" size_t g_peak_heap_used;
+
 namespace asylo {
 namespace {
 
@@ -57,6 +64,22 @@ namespace {
 // use an AES256-GCM-SIV key to encrypt the snapshot.
 constexpr size_t kSnapshotKeySize = 32;
 
+// Size of the independently sealed chunks a snapshot region is split into. It
+// is small enough that untouched pages within the heap form all-zero chunks,
+// which are sealed without their contents.
+constexpr size_t kSnapshotChunkSize = 64 * 1024;
+
+// Associated data sealed with every snapshot chunk. It binds the chunk to the
+// enclave address it is restored to and to its size, so that chunks can not be
+// moved or resized. It also binds the heap extent recorded in the snapshot, so
+// that the untrusted side can not shrink the restored heap by rewriting
+// SnapshotLayout.heap_extent and dropping heap chunks.
+struct SnapshotChunkAssociatedData {
+  uint64_t address;
+  uint64_t size;
+  uint64_t heap_extent;
+};
+
 // Indicates whether a fork request has been made from inside the enclave. A
 // snapshot ecall is only allowed to enter the enclave if it's set.
 std::atomic<bool> fork_requested(false);
@@ -165,157 +188,202 @@ Status BlockAndWaitOnEntries(int calling_thread_entry_count, int timeout) {
   return absl::OkStatus();
 }
 
-// Encrypts the enclave memory from |source_base| with |source_size| with
-// |cryptor|, and saves the encrypted data in untrusted memory |snapshot_entry|,
-// which includes both the ciphertext and nonce. |snapshot_entry| is a protobuf
-// that's passed across enclave boundary. It contains 64-bit integer
-// representations of the pointers to untrusted memory that contains the
-// encrypted data.
-Status EncryptToUntrustedMemory(AeadCryptor *cryptor, const void *source_base,
-                                const size_t source_size,
-                                SnapshotLayoutEntry *snapshot_entry) {
-  ByteContainerView plaintext(source_base, source_size);
-  int maximum_ciphertext_size = source_size + cryptor->MaxSealOverhead();
-  void *destination_base = primitives::TrustedPrimitives::UntrustedLocalAlloc(
-      maximum_ciphertext_size);
-  size_t destination_size;
-  if (!destination_base) {
-    return Status(absl::StatusCode::kInternal,
-                  "Failed to allocate untrusted memory for snapshot");
-  }
-  size_t nonce_size = cryptor->NonceSize();
-  void *nonce_base =
-      primitives::TrustedPrimitives::UntrustedLocalAlloc(nonce_size);
-  if (!nonce_base) {
-    return Status(absl::StatusCode::kInternal,
-                  "Failed to allocate untrusted memory for snapshot nonce");
-  }
-
-  // Use the enclave address being encrypted as the associated data to make sure
-  // that it's restored to exactly the same address space in the child enclave.
-  ASYLO_RETURN_IF_ERROR(cryptor->Seal(
-      plaintext, ConvertTrivialObjectToBinaryString(source_base),
-      absl::MakeSpan(reinterpret_cast<uint8_t *>(nonce_base), nonce_size),
-      absl::MakeSpan(reinterpret_cast<uint8_t *>(destination_base),
-                     maximum_ciphertext_size),
-      &destination_size));
-
-  snapshot_entry->set_ciphertext_base(
-      reinterpret_cast<uint64_t>(destination_base));
-  snapshot_entry->set_ciphertext_size(static_cast<uint64_t>(destination_size));
-  snapshot_entry->set_nonce_base(reinterpret_cast<uint64_t>(nonce_base));
-  snapshot_entry->set_nonce_size(static_cast<uint64_t>(nonce_size));
-  return absl::OkStatus();
+// Returns the size of the chunks a snapshot region is split into. Each chunk is
+// sealed independently, so the chunk size must not exceed the maximum message
+// size supported by |cryptor|.
+size_t SnapshotChunkSize(const AeadCryptor &cryptor) {
+  return std::min(kSnapshotChunkSize, cryptor.MaxMessageSize());
 }
 
-// Decrypts the untrusted source from |snapshot_entry| with |cryptor| to the
-// enclave memory location at |destination_base| with |destination_size|.
-// |snapshot_entry| is a protobuf that is passed from untrusted side, it
-// contains both the ciphertext and nonce of the data, stored in 64-bit
-// integers. The size of the decrypted memory is returned in
-// |actual_plaintext_size|.
-Status DecryptFromUntrustedMemory(AeadCryptor *cryptor,
-                                  SnapshotLayoutEntry snapshot_entry,
-                                  void *destination_base,
-                                  size_t destination_size,
-                                  size_t *actual_plaintext_size) {
-  // The address stored in snapshot are 64-bit integers, they need to be casted
-  // to pointer type before decryption.
-  void *source_base =
-      reinterpret_cast<void *>(snapshot_entry.ciphertext_base());
-  size_t source_size = static_cast<size_t>(snapshot_entry.ciphertext_size());
-  if (!primitives::TrustedPrimitives::IsOutsideEnclave(source_base,
-                                                       source_size)) {
-    return Status(absl::StatusCode::kInternal,
-                  "snapshot is not outside the enclave");
-  }
-  void *nonce_base = reinterpret_cast<void *>(snapshot_entry.nonce_base());
-  size_t nonce_size = static_cast<size_t>(snapshot_entry.nonce_size());
-  if (!primitives::TrustedPrimitives::IsOutsideEnclave(nonce_base,
-                                                       nonce_size)) {
-    return Status(absl::StatusCode::kInternal,
-                  "snapshot nonce is not outside the enclave");
-  }
-  ByteContainerView ciphertext(source_base, source_size);
-  std::vector<uint8_t> nonce(
-      reinterpret_cast<uint8_t *>(nonce_base),
-      reinterpret_cast<uint8_t *>(nonce_base) + nonce_size);
-
-  // Use the enclave address being restored as the associated data to make sure
-  // that it's restoring from the same address space in the parent enclave.
-  return cryptor->Open(
-      ciphertext, ConvertTrivialObjectToBinaryString(destination_base), nonce,
-      absl::MakeSpan(reinterpret_cast<uint8_t *>(destination_base),
-                     destination_size),
-      actual_plaintext_size);
+// Returns whether the |size| bytes at |base| are all zero.
+bool IsZeroMemory(const uint8_t *base, size_t size) {
+  return size == 0 || (base[0] == 0 && memcmp(base, base + 1, size - 1) == 0);
 }
 
-void CopyNonOkStatus(const Status &non_ok_status, absl::StatusCode *error_code,
-                     char *error_message, size_t message_buffer_size) {
-  *error_code = non_ok_status.code();
-  strncpy(error_message, non_ok_status.message().data(),
-          std::min(message_buffer_size, non_ok_status.message().size()));
+// Returns the number of bytes at the start of the enclave heap described by
+// |enclave_layout| that have ever been handed out by enclave_sbrk(). Memory
+// beyond this high-water mark has never been allocated, so it does not need to
+// be part of a snapshot.
+size_t GetHeapExtent(const EnclaveMemoryLayout &enclave_layout) {
+  uintptr_t heap_base = reinterpret_cast<uintptr_t>(enclave_layout.heap_base);
+  uintptr_t heap_break = reinterpret_cast<uintptr_t>(enclave_sbrk(0));
+  if (heap_break < heap_base ||
+      heap_break - heap_base > enclave_layout.heap_size) {
+    // The program break is not inside the heap, so the high-water mark can not
+    // be trusted. Take the whole heap instead.
+    return enclave_layout.heap_size;
+  }
+  return std::min(std::max<size_t>(g_peak_heap_used, heap_break - heap_base),
+                  enclave_layout.heap_size);
 }
 
-// Encrypts a whole memory region of size |source_size| at |source_base| in the
-// enclave with |cryptor|. The memory could be data, bss, heap, thread or data.
-// The encryption may result in multiple snapshot entries if the memory size is
-// greater than the maximum message size supported by |cryptor|. The result is
-// written to |entry|.
+// Seals the enclave memory from |source_base| with |source_size| with |cryptor|
+// into a series of independently sealed chunks, and saves them in untrusted
+// memory described by |entry|, one snapshot entry per chunk. |entry| is a
+// protobuf that's passed across enclave boundary. It contains 64-bit integer
+// representations of the pointers to untrusted memory that contains the
+// encrypted data. If |elide_zero_chunks| is true, chunks that are all zero are
+// sealed with an empty plaintext. The size of their ciphertext then tells the
+// host which chunks are all zero, so this is only done for the heap, where
+// untouched pages below the high-water mark make it worthwhile. |heap_extent|
+// is bound to every chunk, see SnapshotChunkAssociatedData.
 Status EncryptToSnapshot(AeadCryptor *cryptor, void *source_base,
-                         size_t source_size,
+                         size_t source_size, size_t heap_extent,
+                         bool elide_zero_chunks,
                          google::protobuf::RepeatedPtrField<SnapshotLayoutEntry> *entry) {
-  size_t bytes_left = source_size;
-  uint8_t *current_position = reinterpret_cast<uint8_t *>(source_base);
+  size_t chunk_size = SnapshotChunkSize(*cryptor);
+  size_t chunk_count = (source_size + chunk_size - 1) / chunk_size;
+  if (chunk_count == 0) {
+    return absl::OkStatus();
+  }
+
+  // Allocate the untrusted buffers for all chunks with one exit each for the
+  // ciphertexts and the nonces. Every buffer is a separate allocation, so the
+  // host releases them per snapshot entry as before.
+  size_t ciphertext_buffer_size = chunk_size + cryptor->MaxSealOverhead();
+  size_t nonce_size = cryptor->NonceSize();
+  void **ciphertext_buffers = primitives::AllocateUntrustedBuffers(
+      chunk_count, ciphertext_buffer_size);
+  void **nonce_buffers =
+      primitives::AllocateUntrustedBuffers(chunk_count, nonce_size);
+  Cleanup free_buffer_lists([ciphertext_buffers, nonce_buffers] {
+    primitives::TrustedPrimitives::UntrustedLocalFree(ciphertext_buffers);
+    primitives::TrustedPrimitives::UntrustedLocalFree(nonce_buffers);
+  });
+
+  Status status;
+  uint8_t *chunk_base = reinterpret_cast<uint8_t *>(source_base);
+  for (size_t i = 0; i < chunk_count; ++i) {
+    size_t plaintext_size = std::min(chunk_size, source_size - i * chunk_size);
+    void *ciphertext_base = ciphertext_buffers[i];
+    void *nonce_base = nonce_buffers[i];
+    if (!ciphertext_base ||
+        !primitives::TrustedPrimitives::IsOutsideEnclave(
+            ciphertext_base, ciphertext_buffer_size) ||
+        !nonce_base || !primitives::TrustedPrimitives::IsOutsideEnclave(
+                           nonce_base, nonce_size)) {
+      status = Status(absl::StatusCode::kInternal,
+                      "Failed to allocate untrusted memory for snapshot");
+      break;
+    }
+
+    SnapshotChunkAssociatedData associated_data = {
+        reinterpret_cast<uint64_t>(chunk_base), plaintext_size, heap_extent};
+    bool elide_chunk =
+        elide_zero_chunks && IsZeroMemory(chunk_base, plaintext_size);
+    ByteContainerView plaintext(chunk_base, elide_chunk ? 0 : plaintext_size);
+    size_t ciphertext_size;
+    status = cryptor->Seal(
+        plaintext, ConvertTrivialObjectToBinaryString(associated_data),
+        absl::MakeSpan(reinterpret_cast<uint8_t *>(nonce_base), nonce_size),
+        absl::MakeSpan(reinterpret_cast<uint8_t *>(ciphertext_base),
+                       ciphertext_buffer_size),
+        &ciphertext_size);
+    if (!status.ok()) {
+      break;
+    }
 
-  while (bytes_left > 0) {
-    size_t plaintext_size = std::min(cryptor->MaxMessageSize(), bytes_left);
-    ASYLO_RETURN_IF_ERROR(EncryptToUntrustedMemory(
-        cryptor, current_position, plaintext_size, entry->Add()));
+    SnapshotLayoutEntry *chunk_entry = entry->Add();
+    chunk_entry->set_ciphertext_base(
+        reinterpret_cast<uint64_t>(ciphertext_base));
+    chunk_entry->set_ciphertext_size(static_cast<uint64_t>(ciphertext_size));
+    chunk_entry->set_nonce_base(reinterpret_cast<uint64_t>(nonce_base));
+    chunk_entry->set_nonce_size(static_cast<uint64_t>(nonce_size));
+    chunk_base += plaintext_size;
+  }
 
-    bytes_left -= plaintext_size;
-    current_position += plaintext_size;
+  if (!status.ok()) {
+    // None of the buffers are handed to the host, so release all of them.
+    primitives::DeAllocateUntrustedBuffers(ciphertext_buffers, chunk_count);
+    primitives::DeAllocateUntrustedBuffers(nonce_buffers, chunk_count);
+    entry->Clear();
   }
-  return absl::OkStatus();
+  return status;
 }
 
-// Decrypts a whole memory region with |cryptor| from |entry|. The memory region
-// can be data, bss, heap, thread or stack. The snapshot may contain one or more
-// entries, and is decrypted in a loop. The decrypted result is saved in
-// |destination_base| with |destination_size|.
+// Opens the chunks in |entry| with |cryptor| into the enclave memory at
+// |destination_base| with |destination_size|. The memory region can be data,
+// bss, heap, thread or stack. |entry| must hold exactly one snapshot entry per
+// chunk of the region, and every chunk must authenticate against its
+// destination address, its size and |heap_extent|. If |zero_chunks_elided| is
+// true, a chunk with an empty plaintext is restored as zeros, see
+// EncryptToSnapshot(). If a chunk fails to open, the whole region is cleared.
 Status DecryptFromSnapshot(
     AeadCryptor *cryptor, void *destination_base, size_t destination_size,
+    size_t heap_extent, bool zero_chunks_elided,
     const google::protobuf::RepeatedPtrField<SnapshotLayoutEntry> &entry) {
-  uint8_t *current_position = reinterpret_cast<uint8_t *>(destination_base);
-  size_t bytes_left = destination_size;
+  size_t chunk_size = SnapshotChunkSize(*cryptor);
+  size_t chunk_count = (destination_size + chunk_size - 1) / chunk_size;
+  if (static_cast<size_t>(entry.size()) != chunk_count) {
+    return Status(absl::StatusCode::kInternal,
+                  "The snapshot size does not match expectation");
+  }
+  // We should not decrypt to any untrusted memory.
+  if (destination_size > 0 &&
+      (!destination_base || !primitives::TrustedPrimitives::IsInsideEnclave(
+                                destination_base, destination_size))) {
+    return Status(absl::StatusCode::kInternal,
+                  "enclave memory is not found or unexpected");
+  }
 
-  for (int i = 0; i < entry.size() && bytes_left > 0; ++i) {
-    // The expected plaintext size in the current snapshot part. It should be
-    // either the max message size of the cryptor, or the bytes left in the
-    // destination.
+  uint8_t *chunk_base = reinterpret_cast<uint8_t *>(destination_base);
+  for (int i = 0; i < entry.size(); ++i) {
     size_t expected_plaintext_size =
-        std::min(cryptor->MaxMessageSize(), bytes_left);
-    // We should not decrypt to any untrusted memory.
-    if (!current_position || !primitives::TrustedPrimitives::IsInsideEnclave(
-                                 current_position, expected_plaintext_size)) {
+        std::min(chunk_size, destination_size - i * chunk_size);
+
+    // The address stored in snapshot are 64-bit integers, they need to be
+    // casted to pointer type before decryption.
+    void *ciphertext_base =
+        reinterpret_cast<void *>(entry[i].ciphertext_base());
+    size_t ciphertext_size = static_cast<size_t>(entry[i].ciphertext_size());
+    if (!primitives::TrustedPrimitives::IsOutsideEnclave(ciphertext_base,
+                                                         ciphertext_size)) {
       return Status(absl::StatusCode::kInternal,
-                    "enclave memory is not found or unexpected");
+                    "snapshot is not outside the enclave");
     }
+    void *nonce_base = reinterpret_cast<void *>(entry[i].nonce_base());
+    size_t nonce_size = static_cast<size_t>(entry[i].nonce_size());
+    if (!primitives::TrustedPrimitives::IsOutsideEnclave(nonce_base,
+                                                         nonce_size)) {
+      return Status(absl::StatusCode::kInternal,
+                    "snapshot nonce is not outside the enclave");
+    }
+    std::vector<uint8_t> nonce(
+        reinterpret_cast<uint8_t *>(nonce_base),
+        reinterpret_cast<uint8_t *>(nonce_base) + nonce_size);
 
+    SnapshotChunkAssociatedData associated_data = {
+        reinterpret_cast<uint64_t>(chunk_base), expected_plaintext_size,
+        heap_extent};
     size_t actual_plaintext_size;
-    ASYLO_RETURN_IF_ERROR(DecryptFromUntrustedMemory(
-        cryptor, entry[i], current_position, expected_plaintext_size,
-        &actual_plaintext_size));
-    if (actual_plaintext_size != expected_plaintext_size) {
+    Status status = cryptor->Open(
+        ByteContainerView(ciphertext_base, ciphertext_size),
+        ConvertTrivialObjectToBinaryString(associated_data), nonce,
+        absl::MakeSpan(chunk_base, expected_plaintext_size),
+        &actual_plaintext_size);
+    if (!status.ok()) {
+      // Clear the region, rather than leave it partially restored.
+      memset(destination_base, 0, destination_size);
+      return status;
+    }
+    if (actual_plaintext_size == 0 && zero_chunks_elided) {
+      memset(chunk_base, 0, expected_plaintext_size);
+    } else if (actual_plaintext_size != expected_plaintext_size) {
       return Status(absl::StatusCode::kInternal,
                     "The snapshot size does not match expectation");
     }
-    bytes_left -= actual_plaintext_size;
-    current_position += actual_plaintext_size;
+    chunk_base += expected_plaintext_size;
   }
   return absl::OkStatus();
 }
 
+void CopyNonOkStatus(const Status &non_ok_status, absl::StatusCode *error_code,
+                     char *error_message, size_t message_buffer_size) {
+  *error_code = non_ok_status.code();
+  strncpy(error_message, non_ok_status.message().data(),
+          std::min(message_buffer_size, non_ok_status.message().size()));
+}
+
 }  // namespace
 
 bool IsSecureForkSupported() { return true; }
@@ -336,7 +404,9 @@ void SaveThreadLayoutForSnapshot() {
 void SetForkRequested() { fork_requested = true; }
 
 // Takes a snapshot of the enclave data/bss/heap and stack for the calling
-// thread by copying to untrusted memory.
+// thread by copying to untrusted memory. Each region is split into
+// independently sealed chunks, and only the allocated part of the heap is
+// included.
 Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
   // A snapshot is not allowed unless fork is requested from inside an enclave.
   if (!ClearForkRequested()) {
@@ -417,6 +487,10 @@ Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
   memcpy(enclave_layout.reserved_bss_base, enclave_layout.bss_base,
          enclave_layout.bss_size);
 
+  // Only the part of the heap below its high-water mark has ever been
+  // allocated. The rest is still zero, and is left out of the snapshot.
+  size_t heap_extent = GetHeapExtent(enclave_layout);
+
   // Stack-allocated error code and error message. A Status object is later
   // created from these components after the heap has been switched back.
   absl::StatusCode error_code = absl::StatusCode::kOk;
@@ -437,6 +511,7 @@ Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
   do {
     // Create a temporary snapshot object on the switched heap.
     SnapshotLayout tmp_snapshot_layout;
+    tmp_snapshot_layout.set_heap_extent(heap_extent);
 
     // Create a cryptor based on the AES256-GCM-SIV snapshot key to encrypt
     // the whole enclave memory.
@@ -450,7 +525,8 @@ Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
 
     // Allocate and encrypt reserved data section to an untrusted snapshot.
     status = EncryptToSnapshot(cryptor.get(), enclave_layout.reserved_data_base,
-                               enclave_layout.data_size,
+                               enclave_layout.data_size, heap_extent,
+                               /*elide_zero_chunks=*/false,
                                tmp_snapshot_layout.mutable_data());
 
     if (!status.ok()) {
@@ -461,7 +537,8 @@ Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
 
     // Allocate and encrypt reserved bss section to an untrusted snapshot.
     status = EncryptToSnapshot(cryptor.get(), enclave_layout.reserved_bss_base,
-                               enclave_layout.bss_size,
+                               enclave_layout.bss_size, heap_extent,
+                               /*elide_zero_chunks=*/false,
                                tmp_snapshot_layout.mutable_bss());
 
     if (!status.ok()) {
@@ -472,7 +549,8 @@ Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
 
     // Allocate and encrypt thread data for the calling thread.
     status = EncryptToSnapshot(cryptor.get(), thread_layout.thread_base,
-                               thread_layout.thread_size,
+                               thread_layout.thread_size, heap_extent,
+                               /*elide_zero_chunks=*/false,
                                tmp_snapshot_layout.mutable_thread());
 
     if (!status.ok()) {
@@ -481,9 +559,11 @@ Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
       break;
     }
 
-    // Allocate and encrypt heap to an untrusted snapshot.
+    // Allocate and encrypt the allocated part of the heap to an untrusted
+    // snapshot.
     status = EncryptToSnapshot(cryptor.get(), enclave_layout.heap_base,
-                               enclave_layout.heap_size,
+                               heap_extent, heap_extent,
+                               /*elide_zero_chunks=*/true,
                                tmp_snapshot_layout.mutable_heap());
 
     if (!status.ok()) {
@@ -497,7 +577,9 @@ Status TakeSnapshotForFork(SnapshotLayout *snapshot_layout) {
                         reinterpret_cast<size_t>(thread_layout.stack_limit);
 
     status = EncryptToSnapshot(cryptor.get(), thread_layout.stack_limit,
-                               stack_size, tmp_snapshot_layout.mutable_stack());
+                               stack_size, heap_extent,
+                               /*elide_zero_chunks=*/false,
+                               tmp_snapshot_layout.mutable_stack());
 
     if (!status.ok()) {
       CopyNonOkStatus(status, &error_code, error_message,
@@ -546,23 +628,43 @@ Status DecryptAndRestoreEnclaveDataBssHeap(
   ASYLO_ASSIGN_OR_RETURN(cryptor,
                          AeadCryptor::CreateAesGcmSivCryptor(snapshot_key));
 
+  // The heap extent is authenticated along with every chunk below.
+  size_t heap_extent = snapshot_layout.heap_extent();
+  if (heap_extent > enclave_layout.heap_size) {
+    return Status(absl::StatusCode::kInternal,
+                  "The snapshot heap does not fit in the enclave heap");
+  }
+
   // Decrypt the data section to reserved data, to avoid overwriting data used
   // by the cryptor.
-  ASYLO_RETURN_IF_ERROR(
-      DecryptFromSnapshot(cryptor.get(), enclave_layout.reserved_data_base,
-                          enclave_layout.data_size, snapshot_layout.data()));
+  ASYLO_RETURN_IF_ERROR(DecryptFromSnapshot(
+      cryptor.get(), enclave_layout.reserved_data_base,
+      enclave_layout.data_size, heap_extent, /*zero_chunks_elided=*/false,
+      snapshot_layout.data()));
 
   // Decrypt the bss section to reserved bss, to avoid overwriting bss used
   // by the cryptor.
-  ASYLO_RETURN_IF_ERROR(
-      DecryptFromSnapshot(cryptor.get(), enclave_layout.reserved_bss_base,
-                          enclave_layout.bss_size, snapshot_layout.bss()));
+  ASYLO_RETURN_IF_ERROR(DecryptFromSnapshot(
+      cryptor.get(), enclave_layout.reserved_bss_base, enclave_layout.bss_size,
+      heap_extent, /*zero_chunks_elided=*/false, snapshot_layout.bss()));
+
+  // The part of the heap this enclave has used so far, read before the
+  // restored data and bss overwrite its high-water mark.
+  size_t used_heap_size = GetHeapExtent(enclave_layout);
 
   // Decrypt and restore the heap. It is safe to overwrite the heap here because
   // the heap used by the cryptor is allocated on the switched heap.
-  ASYLO_RETURN_IF_ERROR(
-      DecryptFromSnapshot(cryptor.get(), enclave_layout.heap_base,
-                          enclave_layout.heap_size, snapshot_layout.heap()));
+  ASYLO_RETURN_IF_ERROR(DecryptFromSnapshot(
+      cryptor.get(), enclave_layout.heap_base, heap_extent, heap_extent,
+      /*zero_chunks_elided=*/true, snapshot_layout.heap()));
+
+  // The snapshot leaves out the heap above the parent's high-water mark, which
+  // the parent never allocated. Clear whatever this enclave allocated there
+  // before the restore, since the allocator expects new memory to be zero.
+  if (used_heap_size > heap_extent) {
+    memset(reinterpret_cast<uint8_t *>(enclave_layout.heap_base) + heap_extent,
+           0, used_heap_size - heap_extent);
+  }
 
   void *switched_heap_next = GetSwitchedHeapNext();
   size_t switched_heap_remaining = GetSwitchedHeapRemaining();
@@ -597,16 +699,18 @@ Status DecryptAndRestoreThreadStack(
   // Decrypt and restore the thread information. Restore happens in a different
   // TCS (enclave thread) from the thread that requests fork(). Therefore it is
   // OK to overwrite the stack since we are using different stack now.
-  ASYLO_RETURN_IF_ERROR(
-      DecryptFromSnapshot(cryptor.get(), thread_layout.thread_base,
-                          thread_layout.thread_size, snapshot_layout.thread()));
+  ASYLO_RETURN_IF_ERROR(DecryptFromSnapshot(
+      cryptor.get(), thread_layout.thread_base, thread_layout.thread_size,
+      snapshot_layout.heap_extent(), /*zero_chunks_elided=*/false,
+      snapshot_layout.thread()));
 
   // are decrypting it in a different TCS from the thread that requests fork().
   size_t stack_size = reinterpret_cast<size_t>(thread_layout.stack_base) -
                       reinterpret_cast<size_t>(thread_layout.stack_limit);
-  ASYLO_RETURN_IF_ERROR(
-      DecryptFromSnapshot(cryptor.get(), thread_layout.stack_limit, stack_size,
-                          snapshot_layout.stack()));
+  ASYLO_RETURN_IF_ERROR(DecryptFromSnapshot(
+      cryptor.get(), thread_layout.stack_limit, stack_size,
+      snapshot_layout.heap_extent(), /*zero_chunks_elided=*/false,
+      snapshot_layout.stack()));
 
   return absl::OkStatus();
 }
@@ -22,6 +22,7 @@
 #include "asylo/platform/primitives/sgx/fork_internal.h"
 #include "asylo/platform/primitives/sgx/trusted_sgx.h"
 #include "asylo/platform/primitives/trusted_runtime.h"
+#include "asylo/platform/primitives/util/trusted_drbg.h"
 #include "asylo/util/status.h"
 
 namespace asylo {
@@ -82,6 +83,10 @@ pid_t enc_fork(const char *enclave_name) {
   }
   pid_t pid =
       asylo::primitives::InvokeFork(enclave_name, /*restore_snapshot=*/false);
+  if (pid == 0) {
+    // The child inherited the random number generator state of its parent.
+    primitives::TrustedDrbgForkReseed();
+  }
   enc_unblock_entries();
   return pid;
 }
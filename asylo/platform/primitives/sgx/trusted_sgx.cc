@@ -22,6 +22,7 @@
 #include <signal.h>
 #include <sys/types.h>
 
+#include <utility>
 #include <vector>
 
 #include "absl/status/status.h"
@@ -43,6 +44,8 @@
 #include "asylo/platform/primitives/util/message.h"
 #include "asylo/platform/primitives/util/trusted_memory.h"
 #include "asylo/platform/primitives/util/trusted_runtime_helper.h"
+#include "asylo/platform/primitives/util/trusted_shared_clock.h"
+#include "asylo/platform/primitives/util/trusted_switchless.h"
 #include "asylo/platform/system_call/type_conversions/types_functions.h"
 #include "asylo/util/cleanup.h"
 #include "asylo/util/status.h"
@@ -168,6 +171,12 @@ void RegisterInternalHandlers() {
     TrustedPrimitives::BestEffortAbort(
         "Could not register entry handler: FinalizeEnclave");
   }
+
+  // Register the switchless exit call configuration entry handler.
+  RegisterSwitchlessEntryHandler();
+
+  // Register the shared clock configuration entry handler.
+  RegisterSharedClockEntryHandler();
 }
 
 void TrustedPrimitives::BestEffortAbort(const char *message) {
@@ -201,7 +210,7 @@ int asylo_enclave_call(uint64_t selector, void *buffer) {
   // TOC/TOU attacks.
   auto trusted_input = CopyFromUntrusted(input, input_size);
   if (trusted_input) {
-    in.Deserialize(trusted_input.get(), input_size);
+    in.Deserialize(std::move(trusted_input), input_size);
   }
 
   PrimitiveStatus status = InvokeEntryHandler(selector, &in, &out);
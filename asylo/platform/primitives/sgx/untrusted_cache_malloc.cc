@@ -17,6 +17,8 @@
  */
 #include "asylo/platform/primitives/sgx/untrusted_cache_malloc.h"
 
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <memory>
 
@@ -49,7 +51,57 @@ namespace asylo {
 
 using primitives::TrustedPrimitives;
 
+namespace {
+
+// Number of low bits of a magazine entry holding the index of a buffer in its
+// slab. The remaining bits hold the id of the slab.
+constexpr int kEntryIndexBits = 16;
+
+uint32_t MakeEntry(int slab_id, int index) {
+  return (static_cast<uint32_t>(slab_id) << kEntryIndexBits) |
+         static_cast<uint32_t>(index);
+}
+
+int EntrySlabId(uint32_t entry) { return entry >> kEntryIndexBits; }
+
+int EntryIndex(uint32_t entry) {
+  return entry & ((uint32_t{1} << kEntryIndexBits) - 1);
+}
+
+// Returns the bit tracking the buffer at |index| in its bitmap word.
+uint64_t BufferBit(int index) { return uint64_t{1} << (index % 64); }
+
+}  // namespace
+
 bool UntrustedCacheMalloc::is_destroyed_ = false;
+std::atomic<UntrustedCacheMalloc::Slab *>
+    UntrustedCacheMalloc::slabs_[kMaxSlabs];
+std::atomic<int> UntrustedCacheMalloc::slab_count_{0};
+std::atomic<UntrustedCacheMalloc::Slab *>
+    UntrustedCacheMalloc::slab_table_[kSlabTableSize];
+TrustedSpinLock UntrustedCacheMalloc::slab_table_lock_(/*is_recursive=*/false);
+thread_local UntrustedCacheMalloc::ThreadCache
+    UntrustedCacheMalloc::thread_cache_;
+
+UntrustedCacheMalloc::ThreadCache::~ThreadCache() {
+  if (is_destroyed_) {
+    return;
+  }
+  for (size_t size_class = 0; size_class < kNumSizeClasses; size_class++) {
+    Magazine *magazine = &magazines[size_class];
+    if (magazine->count > 0) {
+      Instance()->Flush(size_class, magazine, magazine->count);
+    }
+  }
+}
+
+int UntrustedCacheMalloc::Slab::BufferIndex(uintptr_t address) const {
+  if (address < base || address - base >= buffer_count * buffer_size ||
+      (address - base) % buffer_size != 0) {
+    return -1;
+  }
+  return (address - base) / buffer_size;
+}
 
 UntrustedCacheMalloc *UntrustedCacheMalloc::Instance() {
   static TrustedSpinLock lock(/*is_recursive=*/false);
@@ -77,9 +129,25 @@ UntrustedCacheMalloc::UntrustedCacheMalloc() : lock_(/*is_recursive=*/true) {
 }
 
 UntrustedCacheMalloc::~UntrustedCacheMalloc() {
-  while (!buffer_pool_.empty()) {
-    PushToFreeList(buffer_pool_.top());
-    buffer_pool_.pop();
+  // Release every slab with no buffers in use. Slabs holding buffers in use are
+  // kept, so those buffers are still recognized when they are freed.
+  int slab_count = slab_count_.load(std::memory_order_acquire);
+  for (int id = 0; id < slab_count; id++) {
+    Slab *slab = slabs_[id].load(std::memory_order_acquire);
+    if (slab->released.load(std::memory_order_acquire)) {
+      continue;
+    }
+    bool in_use = false;
+    for (const auto &word : slab->busy) {
+      if (word.load(std::memory_order_acquire) != 0) {
+        in_use = true;
+        break;
+      }
+    }
+    if (!in_use) {
+      slab->released.store(true, std::memory_order_release);
+      PushToFreeList(reinterpret_cast<void *>(slab->base));
+    }
   }
 
   // Free remaining elements in the free_list_.
@@ -92,47 +160,168 @@ UntrustedCacheMalloc::~UntrustedCacheMalloc() {
   is_destroyed_ = true;
 }
 
-void *UntrustedCacheMalloc::GetBuffer() {
-  void **buffers = nullptr;
-  void *buffer;
-  bool is_pool_empty;
+int UntrustedCacheMalloc::SizeClassOf(size_t size) {
+  if (size <= kMinBufferSize) {
+    return 0;
+  }
+  // Index of the smallest power of two not less than |size|, relative to
+  // kMinBufferSize.
+  return (64 - __builtin_clzll(size - 1)) - __builtin_ctzll(kMinBufferSize);
+}
 
-  {
-    LockGuard spin_lock(&lock_);
-    is_pool_empty = buffer_pool_.empty();
-    if (is_pool_empty) {
-      buffers =
-          primitives::AllocateUntrustedBuffers(kPoolIncrement, kPoolEntrySize);
-      for (int i = 0; i < kPoolIncrement; i++) {
-        void *buf = buffers[i];
-        if (!buf || !TrustedPrimitives::IsOutsideEnclave(buf, kPoolEntrySize)) {
-          TrustedPrimitives::BestEffortAbort(
-              "Cached buffer is not outside the enclave");
-        }
-        buffer_pool_.push(buf);
+UntrustedCacheMalloc::Slab *UntrustedCacheMalloc::FindSlab(void *buffer,
+                                                           int *index) {
+  uintptr_t address = reinterpret_cast<uintptr_t>(buffer);
+  size_t slot = (address / kSlabSize) % kSlabTableSize;
+  for (size_t probe = 0; probe < kSlabTableSize; probe++) {
+    Slab *slab = slab_table_[slot].load(std::memory_order_acquire);
+    if (!slab) {
+      return nullptr;
+    }
+    if (!slab->released.load(std::memory_order_acquire)) {
+      int buffer_index = slab->BufferIndex(address);
+      if (buffer_index >= 0) {
+        *index = buffer_index;
+        return slab;
       }
     }
-    buffer = buffer_pool_.top();
-    buffer_pool_.pop();
-    busy_buffers_.insert(buffer);
+    slot = (slot + 1) % kSlabTableSize;
+  }
+  return nullptr;
+}
+
+UntrustedCacheMalloc::Slab *UntrustedCacheMalloc::AddSlab(int size_class) {
+  LockGuard table_lock(&slab_table_lock_);
+  int id = slab_count_.load(std::memory_order_relaxed);
+  if (static_cast<size_t>(id) >= kMaxSlabs) {
+    return nullptr;
+  }
+  void *memory = TrustedPrimitives::UntrustedLocalAlloc(kSlabSize);
+  if (!memory || !TrustedPrimitives::IsOutsideEnclave(memory, kSlabSize)) {
+    TrustedPrimitives::BestEffortAbort(
+        "Cached buffer is not outside the enclave");
+  }
+
+  Slab *slab = new Slab();
+  slab->base = reinterpret_cast<uintptr_t>(memory);
+  slab->buffer_size = kMinBufferSize << size_class;
+  slab->buffer_count = kSlabSize / slab->buffer_size;
+  slab->id = id;
+  SizeClass *depot = &size_classes_[size_class];
+  slab->next = depot->slabs;
+  depot->slabs = slab;
+
+  slabs_[id].store(slab, std::memory_order_release);
+  slab_count_.store(id + 1, std::memory_order_release);
+
+  // Enter the slab in the slot of each kSlabSize-aligned window it overlaps.
+  uintptr_t first_window = slab->base / kSlabSize;
+  uintptr_t last_window = (slab->base + kSlabSize - 1) / kSlabSize;
+  for (uintptr_t window = first_window; window <= last_window; window++) {
+    size_t slot = window % kSlabTableSize;
+    while (slab_table_[slot].load(std::memory_order_relaxed)) {
+      slot = (slot + 1) % kSlabTableSize;
+    }
+    slab_table_[slot].store(slab, std::memory_order_release);
+  }
+  return slab;
+}
+
+void UntrustedCacheMalloc::ClaimBuffers(Slab *slab, int count,
+                                        Magazine *magazine) {
+  for (int word = 0; word * 64 < slab->buffer_count; word++) {
+    uint64_t free_bits = ~slab->owned[word];
+    if (slab->buffer_count - word * 64 < 64) {
+      free_bits &= BufferBit(slab->buffer_count) - 1;
+    }
+    while (free_bits && count > 0) {
+      int index = word * 64 + __builtin_ctzll(free_bits);
+      free_bits &= free_bits - 1;
+      slab->owned[word] |= BufferBit(index);
+      magazine->entries[magazine->count++] = MakeEntry(slab->id, index);
+      count--;
+    }
+    if (count == 0) {
+      return;
+    }
+  }
+}
+
+bool UntrustedCacheMalloc::Refill(int size_class, Magazine *magazine) {
+  SizeClass *depot = &size_classes_[size_class];
+  LockGuard depot_lock(&depot->lock);
+  const int wanted = kMagazineSize / 2;
+
+  // Scan the slabs of the size class once, starting where the last refill
+  // left off.
+  Slab *start = depot->cursor ? depot->cursor : depot->slabs;
+  Slab *slab = start;
+  while (slab) {
+    ClaimBuffers(slab, wanted - magazine->count, magazine);
+    if (magazine->count == wanted) {
+      break;
+    }
+    slab = slab->next ? slab->next : depot->slabs;
+    if (slab == start) {
+      break;
+    }
+  }
+  depot->cursor = slab;
+
+  if (magazine->count == 0) {
+    slab = AddSlab(size_class);
+    if (!slab) {
+      return false;
+    }
+    ClaimBuffers(slab, wanted, magazine);
+    depot->cursor = slab;
   }
+  return true;
+}
+
+void UntrustedCacheMalloc::Flush(int size_class, Magazine *magazine,
+                                 int count) {
+  LockGuard depot_lock(&size_classes_[size_class].lock);
 
-  if (is_pool_empty) {
-    // Free memory held by the array of buffer pointers returned by
-    // AllocateUntrustedBuffers.
-    Free(buffers);
+  // Return the least recently freed buffers of the magazine, keeping the
+  // buffers most likely to still be in the cache.
+  const int flushed = count;
+  for (int i = 0; i < flushed; i++) {
+    uint32_t entry = magazine->entries[i];
+    Slab *slab = slabs_[EntrySlabId(entry)].load(std::memory_order_acquire);
+    int index = EntryIndex(entry);
+    slab->owned[index / 64] &= ~BufferBit(index);
+  }
+  for (int i = flushed; i < magazine->count; i++) {
+    magazine->entries[i - flushed] = magazine->entries[i];
   }
-  return buffer;
+  magazine->count -= flushed;
 }
 
 void *UntrustedCacheMalloc::Malloc(size_t size) {
   // Don't access UnturstedCacheMalloc if not running on normal heap, otherwise
   // it will cause error when UntrustedCacheMalloc tries to free the memory on
   // the normal heap.
-  if (is_destroyed_ || (size > kPoolEntrySize) || GetSwitchedHeapNext()) {
+  if (is_destroyed_ || (size > kMaxBufferSize) || GetSwitchedHeapNext()) {
     return primitives::TrustedPrimitives::UntrustedLocalAlloc(size);
   }
-  return GetBuffer();
+
+  int size_class = SizeClassOf(size);
+  Magazine *magazine = &thread_cache_.magazines[size_class];
+  if (magazine->count == 0 && !Refill(size_class, magazine)) {
+    // The pool has reached its maximum size.
+    return primitives::TrustedPrimitives::UntrustedLocalAlloc(size);
+  }
+
+  uint32_t entry = magazine->entries[--magazine->count];
+  Slab *slab = slabs_[EntrySlabId(entry)].load(std::memory_order_acquire);
+  int index = EntryIndex(entry);
+  if (slab->busy[index / 64].fetch_or(BufferBit(index),
+                                      std::memory_order_acq_rel) &
+      BufferBit(index)) {
+    TrustedPrimitives::BestEffortAbort("Cached buffer is already in use");
+  }
+  return slab->Buffer(index);
 }
 
 void UntrustedCacheMalloc::PushToFreeList(void *buffer) {
@@ -147,21 +336,42 @@ void UntrustedCacheMalloc::PushToFreeList(void *buffer) {
 }
 
 void UntrustedCacheMalloc::Free(void *buffer) {
-  if (is_destroyed_ || GetSwitchedHeapNext()) {
-    primitives::TrustedPrimitives::UntrustedLocalFree(buffer);
+  if (!buffer) {
     return;
   }
-  LockGuard spin_lock(&lock_);
 
   // Add the buffer to the free list if it was not allocated from the buffer
-  // pool and was allocated via UntrustedLocalAlloc. If the
-  // buffer was allocated from the buffer pool push it back to the pool.
-  if (busy_buffers_.find(buffer) == busy_buffers_.end()) {
+  // pool and was allocated via UntrustedLocalAlloc.
+  int index;
+  Slab *slab = FindSlab(buffer, &index);
+  if (!slab) {
+    if (is_destroyed_ || GetSwitchedHeapNext()) {
+      primitives::TrustedPrimitives::UntrustedLocalFree(buffer);
+      return;
+    }
+    LockGuard spin_lock(&lock_);
     PushToFreeList(buffer);
     return;
   }
-  busy_buffers_.erase(buffer);
-  buffer_pool_.push(buffer);
+
+  if (!(slab->busy[index / 64].fetch_and(~BufferBit(index),
+                                         std::memory_order_acq_rel) &
+        BufferBit(index))) {
+    TrustedPrimitives::BestEffortAbort("Cached buffer is not in use");
+  }
+  if (is_destroyed_) {
+    return;
+  }
+
+  // Push the buffer back to the magazine of the calling thread. Returning a
+  // buffer to the pool never allocates trusted memory, so this is also safe
+  // while running on a switched heap.
+  int size_class = SizeClassOf(slab->buffer_size);
+  Magazine *magazine = &thread_cache_.magazines[size_class];
+  if (magazine->count == kMagazineSize) {
+    Flush(size_class, magazine, magazine->count / 2);
+  }
+  magazine->entries[magazine->count++] = MakeEntry(slab->id, index);
 }
 
 }  // namespace asylo
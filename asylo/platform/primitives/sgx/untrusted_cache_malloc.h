@@ -19,9 +19,10 @@
 #ifndef ASYLO_PLATFORM_PRIMITIVES_SGX_UNTRUSTED_CACHE_MALLOC_H_
 #define ASYLO_PLATFORM_PRIMITIVES_SGX_UNTRUSTED_CACHE_MALLOC_H_
 
+#include <atomic>
 #include <cstddef>
-#include <stack>
-#include <unordered_set>
+#include <cstdint>
+#include <memory>
 
 #include "asylo/platform/core/trusted_spin_lock.h"
 #include "asylo/platform/primitives/sgx/trusted_sgx.h"
@@ -33,20 +34,28 @@ namespace asylo {
 // class optimizes the common case of small allocations on backends where the
 // trusted and untrusted application partitions share an address space.
 //
-// For smaller allocations, the implementation allocates memory from a buffer
-// pool maintained by the class. The buffer pool is implemented as a stack
-// of untrusted buffers.
+// Allocations of up to kMaxBufferSize bytes are served from a buffer pool
+// maintained by the class. The pool is divided into power-of-two size classes
+// between kMinBufferSize and kMaxBufferSize bytes. The buffers of a size class
+// are carved out of slabs of kSlabSize bytes of untrusted memory, each of which
+// is described by a Slab object kept in trusted memory.
 //
-// This class is initialized in the trusted space and manages the buffers
-// in untrusted memory 1) assigning buffers to threads requesting memory and
-// 2) pushing back buffers to the pool (for reuse) when they are requested to
-// be freed.
+// Every thread keeps a small magazine of free buffers per size class in
+// thread-local storage, so the common Malloc and Free paths take no locks. A
+// thread only takes the lock of a size class to refill an empty magazine from,
+// or flush half of a full magazine back to, the depot of free buffers held in
+// the slabs of that class.
+//
+// Buffers handed out by the pool are tracked in a per-slab atomic bitmap. Free
+// finds the slab of a buffer through a lock-free table keyed by address, so
+// buffers allocated through UntrustedLocalAlloc are told apart from pooled
+// buffers without consulting any state in untrusted memory.
 class UntrustedCacheMalloc {
  public:
   UntrustedCacheMalloc(UntrustedCacheMalloc const &) = delete;
   UntrustedCacheMalloc &operator=(UntrustedCacheMalloc const &) = delete;
 
-  // The destructor frees all buffers in the buffer pool and the free list.
+  // The destructor frees all slabs with no buffers in use and the free list.
   ~UntrustedCacheMalloc();
 
   // Returns the UntrustedCacheMalloc singleton instance.
@@ -62,35 +71,164 @@ class UntrustedCacheMalloc {
   // Releases memory on the untrusted heap.
   void Free(void *buffer);
 
+  // Size of the smallest buffer pool size class in bytes.
+  static constexpr size_t kMinBufferSize = 256;
+
+  // Size of the largest buffer pool size class in bytes. Larger allocations are
+  // made directly on the untrusted heap.
+  static constexpr size_t kMaxBufferSize = 64 * 1024;
+
  private:
   struct FreeList {
     primitives::UntrustedUniquePtr<void *> buffers;
     int count;
   };
 
-  TrustedSpinLock lock_;
+  // Size of the untrusted memory region buffers of a size class are carved out
+  // of, in bytes.
+  static constexpr size_t kSlabSize = 256 * 1024;
+
+  // Number of 64-bit words in the bitmaps tracking the buffers of a slab.
+  static constexpr size_t kSlabBitmapWords = kSlabSize / kMinBufferSize / 64;
 
-  // Number of entries added to the buffer pool when it's depleted.
-  static constexpr size_t kPoolIncrement = 1024;
+  // Number of buffer pool size classes.
+  static constexpr size_t kNumSizeClasses = 9;
 
-  // Size of a buffer pool entry in bytes.
-  static constexpr size_t kPoolEntrySize = 4096;
+  // Maximum number of slabs in the buffer pool. When this limit is reached,
+  // allocations which would need a new slab are made directly on the untrusted
+  // heap.
+  static constexpr size_t kMaxSlabs = 512;
+
+  // Number of entries in the table mapping addresses to slabs. Each slab is
+  // entered once for each kSlabSize-aligned window it overlaps, which is at
+  // most twice, so the table is never more than half full.
+  static constexpr size_t kSlabTableSize = 4 * kMaxSlabs;
+
+  // Number of free buffers a thread caches per size class.
+  static constexpr int kMagazineSize = 32;
 
   // Maximum entries in the free list. When this limit is reached, all memory
   // held by the pointers in the free list is freed.
   static constexpr size_t kFreeListCapacity = 1024;
 
+  // A kSlabSize region of untrusted memory divided into buffers of a single
+  // size class.
+  struct Slab {
+    // Returns the index of the buffer starting at |address|, or -1 if
+    // |address| is not the start of a buffer in this slab.
+    int BufferIndex(uintptr_t address) const;
+
+    // Returns the start of the buffer at |index|.
+    void *Buffer(int index) const {
+      return reinterpret_cast<void *>(base + index * buffer_size);
+    }
+
+    // Address of the first buffer of the slab.
+    uintptr_t base;
+
+    // Size of each buffer of the slab in bytes.
+    size_t buffer_size;
+
+    // Number of buffers in the slab.
+    int buffer_count;
+
+    // Index of the slab in |slabs_|.
+    int id;
+
+    // Next slab of the same size class.
+    Slab *next;
+
+    // Set when the untrusted memory of the slab has been released.
+    std::atomic<bool> released;
+
+    // Buffers held either by a magazine or by a pool client. Guarded by the
+    // lock of the size class of the slab.
+    uint64_t owned[kSlabBitmapWords];
+
+    // Buffers held by a pool client.
+    std::atomic<uint64_t> busy[kSlabBitmapWords];
+  };
+
+  // Depot of free buffers of one size class.
+  struct SizeClass {
+    TrustedSpinLock lock{/*is_recursive=*/false};
+
+    // Slabs of this size class. Guarded by |lock|.
+    Slab *slabs = nullptr;
+
+    // Slab to resume looking for free buffers in. Guarded by |lock|.
+    Slab *cursor = nullptr;
+  };
+
+  // Per-thread cache of free buffers of one size class. Each entry encodes the
+  // id of a slab and the index of a buffer in that slab.
+  struct Magazine {
+    uint32_t entries[kMagazineSize];
+    int count;
+  };
+
+  // Guards the free list.
+  TrustedSpinLock lock_;
+
   // Defaults to false. Set to true when the singleton class object is
   // destructed. The class will internally route all subsequent calls for memory
   // (de)allocation to the native malloc/free implementation.
   static bool is_destroyed_;
 
+  // Slabs of the buffer pool, indexed by slab id. Slabs are never deleted, so
+  // buffers in use when the singleton is destroyed can still be identified when
+  // they are freed.
+  static std::atomic<Slab *> slabs_[kMaxSlabs];
+
+  // Number of slabs in |slabs_|.
+  static std::atomic<int> slab_count_;
+
+  // Open-addressed table of slabs, hashed by the kSlabSize-aligned windows each
+  // slab overlaps. Entries are only ever added, by threads holding
+  // |slab_table_lock_|, and are read without locking.
+  static std::atomic<Slab *> slab_table_[kSlabTableSize];
+  static TrustedSpinLock slab_table_lock_;
+
+  // Magazines of a thread, one per size class. Buffers left in the magazines
+  // when the thread exits are returned to the depots, so that they are not lost
+  // to the pool.
+  struct ThreadCache {
+    ~ThreadCache();
+
+    Magazine magazines[kNumSizeClasses];
+  };
+
+  // Magazines of the calling thread.
+  static thread_local ThreadCache thread_cache_;
+
   UntrustedCacheMalloc();
 
-  // Returns a buffer from the pool. If no buffers are available in the pool,
-  // this function is responsible for adding new buffers to the pool before
-  // returning the buffer.
-  void *GetBuffer();
+  // Returns the size class of allocations of |size| bytes. |size| must not be
+  // greater than kMaxBufferSize.
+  static int SizeClassOf(size_t size);
+
+  // Returns the pool slab |buffer| is the start of a buffer in, storing the
+  // index of the buffer in |index|, or nullptr if |buffer| was not allocated
+  // from the buffer pool.
+  static Slab *FindSlab(void *buffer, int *index);
+
+  // Allocates a slab for size class |size_class| and makes it visible to
+  // FindSlab. Returns nullptr if the slab limit was reached or the allocation
+  // failed. Must be called with the lock of |size_class| held.
+  Slab *AddSlab(int size_class);
+
+  // Moves up to |count| free buffers of |slab| to |magazine|. Must be called
+  // with the lock of the size class of |slab| held.
+  static void ClaimBuffers(Slab *slab, int count, Magazine *magazine);
+
+  // Moves up to half a magazine of free buffers of |size_class| from the depot
+  // to |magazine|, adding a slab if the depot is empty. Returns false if no
+  // buffers could be made available.
+  bool Refill(int size_class, Magazine *magazine);
+
+  // Moves the |count| least recently freed buffers in |magazine| back to the
+  // depot of |size_class|.
+  void Flush(int size_class, Magazine *magazine, int count);
 
   // Pushes |buffer| to the free list. If the free list capacity is reached,
   // this function is also responsible for first emptying the free list by
@@ -101,14 +239,8 @@ class UntrustedCacheMalloc {
   // List of pointers to untrusted buffers which need to be freed.
   std::unique_ptr<FreeList> free_list_;
 
-  // Pool of pointers to free buffers allocated on the untrusted heap. The
-  // buffer pool is implemented as a stack. This allows for a warmer cache as a
-  // recently returned buffer which is hot in the cache is the first to get
-  // reassigned to a thread requesting a buffer.
-  std::stack<void *> buffer_pool_;
-
-  // Set of buffers returned to and owned by buffer pool clients.
-  std::unordered_set<void *> busy_buffers_;
+  // Depots of the buffer pool, one per size class.
+  SizeClass size_classes_[kNumSizeClasses];
 };
 
 }  // namespace asylo
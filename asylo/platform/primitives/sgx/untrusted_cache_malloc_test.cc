@@ -19,8 +19,11 @@
 #include "asylo/platform/primitives/sgx/untrusted_cache_malloc.h"
 
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <random>
+#include <set>
 #include <thread>
 #include <vector>
 
@@ -67,5 +70,113 @@ TEST_F(UntrustedCacheMallocTest, StressTest) {
   }
 }
 
+TEST_F(UntrustedCacheMallocTest, AllocatesEverySize) {
+  for (size_t size : {size_t{1}, UntrustedCacheMalloc::kMinBufferSize,
+                      UntrustedCacheMalloc::kMinBufferSize + 1, size_t{4096},
+                      UntrustedCacheMalloc::kMaxBufferSize,
+                      UntrustedCacheMalloc::kMaxBufferSize + 1,
+                      size_t{1024 * 1024}}) {
+    void *buffer = untrusted_cache_malloc_->Malloc(size);
+    ASSERT_NE(buffer, nullptr);
+    memset(buffer, 'a', size);
+    untrusted_cache_malloc_->Free(buffer);
+  }
+}
+
+TEST_F(UntrustedCacheMallocTest, ReusesFreedBuffers) {
+  void *buffer = untrusted_cache_malloc_->Malloc(100);
+  untrusted_cache_malloc_->Free(buffer);
+  EXPECT_EQ(untrusted_cache_malloc_->Malloc(200), buffer);
+  untrusted_cache_malloc_->Free(buffer);
+}
+
+TEST_F(UntrustedCacheMallocTest, BuffersDoNotOverlap) {
+  constexpr int kBuffers = 2000;
+  constexpr size_t kSize = 512;
+  std::vector<uint8_t *> buffers;
+  for (int i = 0; i < kBuffers; i++) {
+    auto buffer =
+        static_cast<uint8_t *>(untrusted_cache_malloc_->Malloc(kSize));
+    memset(buffer, i % 256, kSize);
+    buffers.push_back(buffer);
+  }
+  EXPECT_EQ(std::set<uint8_t *>(buffers.begin(), buffers.end()).size(),
+            buffers.size());
+  for (int i = 0; i < kBuffers; i++) {
+    for (size_t j = 0; j < kSize; j++) {
+      ASSERT_EQ(buffers[i][j], i % 256);
+    }
+    untrusted_cache_malloc_->Free(buffers[i]);
+  }
+}
+
+TEST_F(UntrustedCacheMallocTest, FreesBuffersAcrossThreads) {
+  constexpr int kNumThreads = 8;
+  constexpr int kAllocations = 200;
+
+  // Each thread allocates buffers of every size class, and frees the buffers
+  // allocated by the previous thread, so that buffers move between the
+  // magazines of different threads.
+  std::vector<std::vector<void *>> buffers(kNumThreads);
+  auto allocate = [this, &buffers](int thread) {
+    std::mt19937 rand_engine(thread);
+    std::uniform_int_distribution<size_t> rand_gen(
+        1, UntrustedCacheMalloc::kMaxBufferSize);
+    for (int i = 0; i < kAllocations; i++) {
+      size_t size = rand_gen(rand_engine);
+      void *buffer = untrusted_cache_malloc_->Malloc(size);
+      memset(buffer, 'a', size);
+      buffers[thread].push_back(buffer);
+    }
+  };
+  auto free = [this, &buffers](int thread) {
+    for (void *buffer : buffers[(thread + 1) % kNumThreads]) {
+      untrusted_cache_malloc_->Free(buffer);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back(allocate, i);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+  for (int i = 0; i < kNumThreads; i++) {
+    threads.emplace_back(free, i);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+TEST_F(UntrustedCacheMallocTest, ThreadExitReturnsBuffersToPool) {
+  // Each thread holds a whole slab of the largest size class in its magazine.
+  // Unless exiting threads return their buffers to the pool, the pool runs out
+  // of slabs well before the last thread.
+  constexpr int kNumThreads = 1024;
+  std::set<void *> buffers;
+  for (int i = 0; i < kNumThreads; i++) {
+    std::thread thread([this, &buffers] {
+      void *buffer =
+          untrusted_cache_malloc_->Malloc(UntrustedCacheMalloc::kMaxBufferSize);
+      buffers.insert(buffer);
+      untrusted_cache_malloc_->Free(buffer);
+    });
+    thread.join();
+  }
+  EXPECT_LT(buffers.size(), size_t{kNumThreads / 2});
+
+  // Allocations are still served from the pool.
+  void *buffer =
+      untrusted_cache_malloc_->Malloc(UntrustedCacheMalloc::kMaxBufferSize);
+  untrusted_cache_malloc_->Free(buffer);
+  EXPECT_EQ(
+      untrusted_cache_malloc_->Malloc(UntrustedCacheMalloc::kMaxBufferSize),
+      buffer);
+  untrusted_cache_malloc_->Free(buffer);
+}
+
 }  // namespace
 }  // namespace asylo
@@ -50,6 +50,12 @@ ssize_t enc_hardware_random(uint8_t *buf, size_t count);
 // enc_hardware_random.
 int enc_hardware_random_entropy();
 
+// Writes `count`-many bytes from a hardware entropy source into `buf`, suitable
+// for seeding a deterministic random bit generator. Uses RDSEED where it is
+// supported and RDRAND otherwise. Returns -1 if no hardware source of
+// randomness is available.
+ssize_t enc_hardware_seed(uint8_t *buf, size_t count);
+
 // Registers a signal handler on the host.
 int enc_register_signal(int signum, const sigset_t mask, int flags);
 
@@ -24,12 +24,15 @@
 #include <sys/un.h>
 
 #include <algorithm>
+#include <cstdint>
 #include <cstring>
 #include <functional>
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
+#include "absl/container/inlined_vector.h"
 #include "absl/memory/memory.h"
 #include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
@@ -51,8 +54,18 @@ namespace primitives {
 // from the writer is disallowed. The message writer does not perform memory
 // allocation for the serialized message. Extents can be pushed by reference or
 // by copy, in which case they are owned by the MessageWriter.
+//
+// Data pushed by copy is packed into a single contiguous arena owned by the
+// writer. Small messages fit entirely into inline storage, so pushing values
+// does not allocate memory until the arena or the extent list outgrows it.
 class MessageWriter {
  public:
+  // Number of extents the writer holds without allocating memory.
+  static constexpr size_t kInlineExtents = 8;
+
+  // Number of bytes of copied data the writer holds without allocating memory.
+  static constexpr size_t kInlineArenaSize = 256;
+
   MessageWriter() = default;
 
   // Disallow copying.
@@ -64,16 +77,16 @@ class MessageWriter {
   MessageWriter &operator=(MessageWriter &&other) = default;
 
   // Returns true if no output has been written to the MessageWriter.
-  bool empty() const { return extents_.empty(); }
+  bool empty() const { return entries_.empty(); }
 
   // Returns the number of extents pushed on the writer.
-  size_t size() const { return extents_.size(); }
+  size_t size() const { return entries_.size(); }
 
   // Returns the size of serialized message generated by Serialize().
   size_t MessageSize() const {
-    size_t result = sizeof(uint64_t) * extents_.size();
-    for (const auto &extent : extents_) {
-      result += extent.size();
+    size_t result = sizeof(uint64_t) * entries_.size();
+    for (const auto &entry : entries_) {
+      result += entry.size;
     }
     return result;
   }
@@ -81,36 +94,44 @@ class MessageWriter {
   // Generates and writes a serialized message into |buffer| owned by
   // the caller, which must accommodate at least MessageSize() bytes.
   void Serialize(void *buffer) const {
-    if (extents_.empty()) {
+    if (entries_.empty()) {
       return;
     }
     auto ptr = reinterpret_cast<char *>(buffer);
-    for (const auto &extent : extents_) {
-      uint64_t size = extent.size();
+    for (const auto &entry : entries_) {
+      uint64_t size = entry.size;
       memcpy(ptr, &size, sizeof(uint64_t));  // Copy data size.
       ptr += sizeof(uint64_t);
-      memcpy(ptr, extent.data(), size);  // Copy data.
+      if (size > 0) {
+        memcpy(ptr, Resolve(entry).data(), size);  // Copy data.
+      }
       ptr += size;
     }
   }
 
   // Serializes data using a given serializer.
   void Serialize(const std::function<void(Extent)> &serializer) const {
-    for (const auto &extent : extents_) {
-      serializer(extent);
+    for (const auto &entry : entries_) {
+      serializer(Resolve(entry));
     }
   }
 
   // Pushes an extent to the MessageWriter by reference.
-  void PushByReference(Extent extent) { extents_.emplace_back(extent); }
+  void PushByReference(Extent extent) {
+    entries_.push_back(Entry{extent.data(), /*offset=*/0, extent.size(),
+                             /*copied=*/false});
+  }
 
-  // Pushes an extent to the MessageWriter by copy. Data is copied and owned by
-  // the MessageWriter.
+  // Pushes an extent to the MessageWriter by copy. Data is copied into the
+  // arena owned by the MessageWriter.
   void PushByCopy(Extent extent) {
-    char *extent_data = new char[extent.size()];
-    copied_data_owner_.emplace_back(extent_data);
-    memcpy(extent_data, extent.data(), extent.size());
-    PushByReference(Extent{extent_data, extent.size()});
+    size_t offset = arena_.size();
+    if (extent.size() > 0) {
+      const char *data = extent.As<char>();
+      arena_.insert(arena_.end(), data, data + extent.size());
+    }
+    entries_.push_back(
+        Entry{/*data=*/nullptr, offset, extent.size(), /*copied=*/true});
   }
 
   // Pushes non-pointer data types (eg. ints, structs) by value. Internally
@@ -167,21 +188,48 @@ class MessageWriter {
 
   // Copies the extents of |other| to this MessageWriter.
   void Extend(const MessageWriter &other) {
-    for (const auto extent : other.extents_) {
-      PushByCopy(extent);
+    for (const auto &entry : other.entries_) {
+      PushByCopy(other.Resolve(entry));
     }
   }
 
  private:
-  std::vector<Extent> extents_;
-  std::vector<std::unique_ptr<char[]>> copied_data_owner_;
+  // An extent pushed on the writer. Extents pushed by copy record their offset
+  // into |arena_| rather than an address, since the arena may be relocated as
+  // it grows or when the writer is moved.
+  struct Entry {
+    void *data;     // Address of data pushed by reference.
+    size_t offset;  // Offset into |arena_| of data pushed by copy.
+    size_t size;    // Size of the data in bytes.
+    bool copied;    // Whether the data is stored in |arena_|.
+  };
+
+  // Returns the extent described by |entry|.
+  Extent Resolve(const Entry &entry) const {
+    if (!entry.copied) {
+      return Extent{entry.data, entry.size};
+    }
+    return Extent{arena_.data() + entry.offset, entry.size};
+  }
+
+  absl::InlinedVector<Entry, kInlineExtents> entries_;
+  absl::InlinedVector<char, kInlineArenaSize> arena_;
 };
 
 // A message reader that consumes a serialized message and generates extents.
 // The extent memory is owned by the class and freed with the destructor.
 // Extents can be read from the MessageReader only once, and never written.
+//
+// A serialized message is copied into a single buffer owned by the reader and
+// its extents are viewed in place, so deserializing a message performs one
+// allocation regardless of the number of extents it holds. Extents are not
+// guaranteed to be aligned beyond a byte boundary, so values are copied out of
+// them by next<T>() and peek<T>() rather than read in place.
 class MessageReader {
  public:
+  // Number of extents the reader tracks without allocating memory.
+  static constexpr size_t kInlineExtents = 8;
+
   MessageReader() = default;
 
   // Disallow copying.
@@ -197,40 +245,70 @@ class MessageReader {
   // by the user/runtime. |buffer| consists of |size| bytes. |buffer| could be
   // located in untrusted memory, and therefore, transferring its ownership to
   // trusted memory is non-trivial, since trusted memory would then need to
-  // remotely manage untrusted memory. This necessitates deserializing and
-  // copying |buffer| into new owned extents, since MessageReader is expected
-  // to own its memory.
+  // remotely manage untrusted memory. This necessitates copying |buffer| into
+  // memory owned by the reader before parsing it, which also guarantees that
+  // the parsed message cannot be modified concurrently by its producer.
   void Deserialize(const void *buffer, size_t size) {
-    const char *ptr = reinterpret_cast<const char *>(buffer);
+    if (size == 0) {
+      return;
+    }
+    std::unique_ptr<char[]> owned_buffer(new char[size]);
+    memcpy(owned_buffer.get(), buffer, size);
+    Deserialize(std::move(owned_buffer), size);
+  }
+
+  // Deserializes a data buffer of provided size which is already owned by the
+  // caller, taking ownership of it rather than copying it. |buffer| must not be
+  // accessible to untrusted code.
+  void Deserialize(std::unique_ptr<char[]> buffer, size_t size) {
+    if (!buffer || size == 0) {
+      return;
+    }
+    const char *ptr = buffer.get();
     const char *end_ptr = ptr + size;
     while (ptr < end_ptr) {
       uint64_t extent_len;
+      if (static_cast<size_t>(end_ptr - ptr) < sizeof(uint64_t)) {
+        // Truncated extent header. This indicates an invalid/modified buffer.
+        abort();
+      }
       memcpy(&extent_len, ptr, sizeof(uint64_t));
       ptr += sizeof(uint64_t);
-      if (ptr + extent_len > end_ptr) {
+      if (extent_len > static_cast<uint64_t>(end_ptr - ptr)) {
         // |extent_len| overflows size. This indicates an invalid/modified
         // buffer.
         abort();
       }
-      char *extent_data = new char[extent_len];
-      extents_.emplace_back(std::unique_ptr<char[]>(extent_data), extent_len);
-      memcpy(extent_data, ptr, extent_len);
+      extents_.emplace_back(ptr, extent_len);
       ptr += extent_len;
     }
+    buffers_.push_back(std::move(buffer));
   }
 
   // Deserializes data using a given deserializer.
   void Deserialize(const size_t size,
                    const std::function<Extent(size_t i)> &deserializer) {
-    extents_.reserve(size);
+    if (size == 0) {
+      return;
+    }
+    absl::InlinedVector<Extent, kInlineExtents> extents;
+    extents.reserve(size);
+    size_t total_size = 0;
     for (size_t i = 0; i < size; ++i) {
-      auto extent = deserializer(i);
-      extents_.emplace_back(absl::make_unique<char[]>(extent.size()),
-                            extent.size());
+      extents.push_back(deserializer(i));
+      total_size += extents.back().size();
+    }
+    std::unique_ptr<char[]> buffer(new char[total_size]);
+    char *ptr = buffer.get();
+    extents_.reserve(extents_.size() + size);
+    for (const auto &extent : extents) {
       if (extent.size() > 0) {
-        memcpy(extents_.back().first.get(), extent.data(), extent.size());
+        memcpy(ptr, extent.data(), extent.size());
       }
+      extents_.emplace_back(ptr, extent.size());
+      ptr += extent.size();
     }
+    buffers_.push_back(std::move(buffer));
   }
 
   // Returns the number of extents read.
@@ -245,27 +323,26 @@ class MessageReader {
     return result;
   }
 
-  // Interprets the next item in the MessageReader as a pointer to a value of
-  // type T, consumes it, and returns its value by copy.
+  // Interprets the next item in the MessageReader as a value of type T,
+  // consumes it, and returns its value by copy.
   template <typename T>
   T next() {
-    Extent result = next();
-    return *(result.As<T>());
+    return CopyValue<T>(next());
   }
 
   // Peeks at the next extent in the MessageReader; the ensuing next() call will
   // return the same extent. The extent remains owned by the MessageReader and
   // its lifetime is the lifetime of the MessageReader.
   Extent peek() {
-    return Extent{extents_[pos_].first.get(), extents_[pos_].second};
+    return Extent{const_cast<char *>(extents_[pos_].first),
+                  extents_[pos_].second};
   }
 
-  // Interprets the peek item in the MessageReader as a pointer to a value of
-  // type T, consumes it, and returns its value by const reference.
+  // Interprets the peek item in the MessageReader as a value of type T and
+  // returns its value by copy, without consuming it.
   template <typename T>
-  const T &peek() {
-    Extent result = peek();
-    return *(result.As<T>());
+  T peek() {
+    return CopyValue<T>(peek());
   }
 
   // Returns if the reader is empty, i.e. contains no extents.
@@ -309,7 +386,21 @@ class MessageReader {
   } while (false)
 
  private:
-  std::vector<std::pair<std::unique_ptr<char[]>, size_t>> extents_;
+  // Copies a value of type T out of |extent|. Extents are packed at arbitrary
+  // offsets, so the value may not be suitably aligned to be read in place.
+  template <typename T>
+  static T CopyValue(Extent extent) {
+    T value;
+    memcpy(&value, extent.data(), sizeof(T));
+    return value;
+  }
+
+  // Buffers holding the deserialized messages. Usually there is just one.
+  absl::InlinedVector<std::unique_ptr<char[]>, 1> buffers_;
+
+  // The deserialized extents, viewing memory in |buffers_|.
+  absl::InlinedVector<std::pair<const char *, size_t>, kInlineExtents>
+      extents_;
   size_t pos_ = 0;
 };
 
@@ -19,7 +19,12 @@
 #include "asylo/platform/primitives/util/message.h"
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
@@ -190,6 +195,126 @@ TEST(MessageTest, PushPopStrings) {
   EXPECT_THAT(reader.next().As<char>(), StrEq("moon"));
 }
 
+// Ensure that messages outgrowing the inline storage of the writer and the
+// reader are serialized correctly.
+TEST(MessageTest, PushPopBeyondInlineStorage) {
+  const std::string long_string(2 * MessageWriter::kInlineArenaSize, 'x');
+  const int num_values = 4 * MessageWriter::kInlineExtents;
+  MessageWriter writer;
+  for (int i = 0; i < num_values; ++i) {
+    writer.Push(i);
+    writer.PushString(long_string);
+  }
+  EXPECT_THAT(writer, SizeIs(2 * num_values));
+
+  MessageReader reader = BuildMessageReader(writer);
+  ASSERT_THAT(reader, SizeIs(2 * num_values));
+  for (int i = 0; i < num_values; ++i) {
+    EXPECT_THAT(reader.next<int>(), Eq(i));
+    EXPECT_THAT(reader.next().As<char>(), StrEq(long_string));
+  }
+  EXPECT_THAT(reader.hasNext(), Eq(false));
+}
+
+// Ensure that data pushed by copy remains valid after the writer is moved.
+TEST(MessageTest, MoveWriterWithCopiedData) {
+  const char *world = "world";
+  MessageWriter writer;
+  writer.PushString("hello");
+  writer.PushByReference(Extent{world, strlen(world) + 1});
+  writer.Push(42);
+
+  MessageWriter moved(std::move(writer));
+  MessageReader reader = BuildMessageReader(moved);
+  ASSERT_THAT(reader, SizeIs(3));
+  EXPECT_THAT(reader.next().As<char>(), StrEq("hello"));
+  EXPECT_THAT(reader.next().As<char>(), StrEq(world));
+  EXPECT_THAT(reader.next<int>(), Eq(42));
+}
+
+TEST(MessageTest, PushPopEmptyExtents) {
+  MessageWriter writer;
+  writer.PushString(nullptr);
+  writer.PushByCopy(Extent{nullptr, 0});
+  writer.Push(7);
+  EXPECT_THAT(writer.MessageSize(), Eq(3 * sizeof(uint64_t) + sizeof(int)));
+
+  MessageReader reader = BuildMessageReader(writer);
+  ASSERT_THAT(reader, SizeIs(3));
+  EXPECT_THAT(reader.next().size(), Eq(0));
+  EXPECT_THAT(reader.next().size(), Eq(0));
+  EXPECT_THAT(reader.next<int>(), Eq(7));
+}
+
+// Tests that values packed at unaligned offsets are read back intact.
+TEST(MessageTest, PushPopUnalignedValues) {
+  MessageWriter writer;
+  writer.Push<char>('a');
+  writer.Push<int64_t>(-2);
+  writer.Push<char>('b');
+  writer.Push<double>(0.5);
+
+  MessageReader reader = BuildMessageReader(writer);
+  EXPECT_THAT(reader.next<char>(), Eq('a'));
+  EXPECT_THAT(reader.peek<int64_t>(), Eq(-2));
+  EXPECT_THAT(reader.next<int64_t>(), Eq(-2));
+  EXPECT_THAT(reader.next<char>(), Eq('b'));
+  EXPECT_THAT(reader.next<double>(), Eq(0.5));
+}
+
+// Ensure that a reader can take ownership of a serialized buffer.
+TEST(MessageTest, DeserializeOwnedBuffer) {
+  MessageWriter writer;
+  writer.PushString("hello");
+  writer.Push(1);
+
+  const size_t size = writer.MessageSize();
+  auto buffer = absl::make_unique<char[]>(size);
+  writer.Serialize(buffer.get());
+  const char *data = buffer.get();
+
+  MessageReader reader;
+  reader.Deserialize(std::move(buffer), size);
+  ASSERT_THAT(reader, SizeIs(2));
+  EXPECT_THAT(reader.peek().data(), Eq(data + sizeof(uint64_t)));
+  EXPECT_THAT(reader.next().As<char>(), StrEq("hello"));
+  EXPECT_THAT(reader.next<int>(), Eq(1));
+}
+
+TEST(MessageTest, SerializeDeserializeWithCallbacks) {
+  MessageWriter writer;
+  writer.PushString("hello");
+  writer.Push(3);
+  writer.PushString("world");
+
+  std::vector<std::string> items;
+  writer.Serialize([&items](Extent extent) {
+    items.emplace_back(extent.As<char>(), extent.size());
+  });
+  ASSERT_THAT(items, SizeIs(3));
+
+  MessageReader reader;
+  reader.Deserialize(items.size(), [&items](size_t i) {
+    return Extent{items[i].data(), items[i].size()};
+  });
+  ASSERT_THAT(reader, SizeIs(3));
+  EXPECT_THAT(reader.next().As<char>(), StrEq("hello"));
+  EXPECT_THAT(reader.next<int>(), Eq(3));
+  EXPECT_THAT(reader.next().As<char>(), StrEq("world"));
+}
+
+TEST(MessageDeathTest, TruncatedMessage) {
+  MessageWriter writer;
+  writer.PushString("hello");
+  const size_t size = writer.MessageSize();
+  const auto buffer = absl::make_unique<char[]>(size);
+  writer.Serialize(buffer.get());
+
+  MessageReader reader;
+  EXPECT_DEATH(reader.Deserialize(buffer.get(), size - 1), "");
+  EXPECT_DEATH(reader.Deserialize(buffer.get(), sizeof(uint64_t) - 1), "");
+}
+
 }  // namespace
 }  // namespace primitives
 }  // namespace asylo
@@ -0,0 +1,126 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/primitives/util/shared_clock_publisher.h"
+
+#include <sys/mman.h>
+#include <time.h>
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "asylo/platform/common/time_util.h"
+#include "asylo/platform/primitives/primitives.h"
+#include "asylo/platform/primitives/util/message.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace primitives {
+
+StatusOr<std::unique_ptr<SharedClockPublisher>> SharedClockPublisher::Create(
+    std::shared_ptr<Client> client, const SharedClockConfig &config) {
+  if (config.update_interval_microseconds() == 0) {
+    return absl::InvalidArgumentError(
+        "Shared clock requires a non-zero update interval");
+  }
+  auto publisher =
+      absl::WrapUnique(new SharedClockPublisher(std::move(client), config));
+  if (!publisher->clock_) {
+    return absl::ResourceExhaustedError("Failed to allocate shared clock");
+  }
+
+  MessageWriter in;
+  in.Push(reinterpret_cast<uint64_t>(publisher->clock_));
+  MessageReader out;
+  ASYLO_RETURN_IF_ERROR(
+      publisher->client_->EnclaveCall(kSelectorAsyloSharedClock, &in, &out));
+  return std::move(publisher);
+}
+
+SharedClockPublisher::SharedClockPublisher(std::shared_ptr<Client> client,
+                                           const SharedClockConfig &config)
+    : client_(std::move(client)),
+      config_(config),
+      clock_(nullptr),
+      stopping_(false) {
+  void *memory = mmap(/*addr=*/nullptr, sizeof(SharedClock),
+                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      /*fd=*/-1, /*offset=*/0);
+  if (memory == MAP_FAILED) {
+    return;
+  }
+  clock_ = new (memory) SharedClock();
+
+  // Publish a valid sample before the clock can be attached.
+  Publish();
+  clock_->set_active(true);
+  publisher_ = absl::make_unique<Thread>([this] { PublishLoop(); });
+}
+
+SharedClockPublisher::~SharedClockPublisher() {
+  if (clock_) {
+    clock_->set_active(false);
+    if (!client_->IsClosed()) {
+      MessageReader out;
+      Status status = client_->EnclaveCall(kSelectorAsyloSharedClock,
+                                           /*input=*/nullptr, &out);
+      LOG_IF(ERROR, !status.ok())
+          << "Failed to detach shared clock: " << status;
+    }
+  }
+  stopping_ = true;
+  if (publisher_) {
+    publisher_->Join();
+  }
+  if (clock_) {
+    clock_->~SharedClock();
+    munmap(clock_, sizeof(SharedClock));
+  }
+}
+
+void SharedClockPublisher::Publish() {
+  struct timespec monotonic;
+  struct timespec realtime;
+  if (clock_gettime(CLOCK_MONOTONIC, &monotonic) != 0 ||
+      clock_gettime(CLOCK_REALTIME, &realtime) != 0) {
+    // Leave the previous sample in place. Readers fall back to host calls once
+    // it goes stale.
+    return;
+  }
+  clock_->Publish(TimeSpecToNanoseconds(&monotonic),
+                  TimeSpecToNanoseconds(&realtime));
+}
+
+void SharedClockPublisher::PublishLoop() {
+  struct timespec interval;
+  NanosecondsToTimeSpec(
+      &interval,
+      static_cast<int64_t>(config_.update_interval_microseconds()) * 1000);
+  while (!stopping_.load(std::memory_order_relaxed)) {
+    nanosleep(&interval, /*rem=*/nullptr);
+    Publish();
+  }
+}
+
+}  // namespace primitives
+}  // namespace asylo
@@ -0,0 +1,82 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_UTIL_SHARED_CLOCK_PUBLISHER_H_
+#define ASYLO_PLATFORM_PRIMITIVES_UTIL_SHARED_CLOCK_PUBLISHER_H_
+
+#include <atomic>
+#include <memory>
+
+#include "asylo/enclave.pb.h"
+#include "asylo/platform/common/shared_clock.h"
+#include "asylo/platform/primitives/untrusted_primitives.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+namespace primitives {
+
+// An untrusted thread periodically publishing the host's CLOCK_MONOTONIC and
+// CLOCK_REALTIME into a SharedClock attached to an enclave, so that the enclave
+// can read the time without an exit call. The resolution of the clocks read by
+// the enclave is the publication interval,
+// `SharedClockConfig.update_interval_microseconds`.
+class SharedClockPublisher {
+ public:
+  // Allocates a SharedClock, starts the publishing thread and attaches the
+  // clock to the enclave behind |client|. Returns an error if
+  // `config.update_interval_microseconds()` is zero or the enclave rejects the
+  // clock.
+  static StatusOr<std::unique_ptr<SharedClockPublisher>> Create(
+      std::shared_ptr<Client> client, const SharedClockConfig &config);
+
+  SharedClockPublisher(const SharedClockPublisher &) = delete;
+  SharedClockPublisher &operator=(const SharedClockPublisher &) = delete;
+
+  // Detaches the clock from the enclave if it is still open, then stops the
+  // publishing thread.
+  ~SharedClockPublisher();
+
+ private:
+  SharedClockPublisher(std::shared_ptr<Client> client,
+                       const SharedClockConfig &config);
+
+  // Publishes the current time into |clock_|.
+  void Publish();
+
+  // Main loop of the publishing thread.
+  void PublishLoop();
+
+  const std::shared_ptr<Client> client_;
+  const SharedClockConfig config_;
+
+  // The clock shared with the enclave. Allocated with page alignment in
+  // untrusted memory.
+  SharedClock *clock_;
+
+  // Set to request the publishing thread to exit.
+  std::atomic<bool> stopping_;
+
+  std::unique_ptr<Thread> publisher_;
+};
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_UTIL_SHARED_CLOCK_PUBLISHER_H_
@@ -0,0 +1,333 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_UTIL_SWITCHLESS_RING_H_
+#define ASYLO_PLATFORM_PRIMITIVES_UTIL_SWITCHLESS_RING_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+#include "asylo/platform/primitives/primitive_status.h"
+#include "asylo/platform/primitives/util/message.h"
+
+namespace asylo {
+namespace primitives {
+
+// A table of request slots shared between trusted threads and a pool of
+// untrusted worker threads, used to service exit calls without leaving the
+// enclave ("switchless" exit calls).
+//
+// The ring is allocated in untrusted memory by the untrusted runtime. A trusted
+// thread claims a free slot, serializes its request into the slot buffer and
+// marks it posted. An untrusted worker picks up the posted request, invokes the
+// exit handler, writes the serialized response back into the slot (or into a
+// worker-owned heap buffer if it does not fit) and marks the slot done. The
+// trusted thread copies the response into trusted memory and releases the slot.
+// Responses that spilled onto the untrusted heap are freed by the workers, so
+// that a switchless call never requires an enclave exit on the trusted side.
+//
+// A slot moves through the following states:
+//
+//   kFree --(trusted)--> kClaimed --(trusted)--> kPosted --(worker)--> kRunning
+//   kRunning --(worker)--> kDone --(trusted)--> kFree or kReleased
+//   kReleased --(worker)--> kFree
+//
+// A posted request which is not picked up by a worker in time may be withdrawn
+// by the trusted thread (kPosted --> kFree), which then falls back to a regular
+// exit call.
+//
+// NOTE: All memory in the ring is writable by untrusted code. Trusted code must
+// treat every field it reads from a slot as attacker-controlled and validate it
+// before use. Slot indices are always taken modulo kSlotCount, so corruption of
+// the ring cannot cause accesses outside of the object itself.
+class SwitchlessRing {
+ public:
+  // Number of request slots in the ring.
+  static constexpr size_t kSlotCount = 64;
+
+  // Capacity in bytes of the request/response buffer of a slot. Chosen such
+  // that each slot occupies exactly one page.
+  static constexpr size_t kSlotBufferSize = 4096 - 64;
+
+  enum SlotState : uint32_t {
+    kFree = 0,
+    kClaimed = 1,
+    kPosted = 2,
+    kRunning = 3,
+    kDone = 4,
+    kReleased = 5,
+  };
+
+  struct alignas(64) Slot {
+    // Current SlotState of the slot.
+    std::atomic<uint32_t> state;
+
+    // Error code of the PrimitiveStatus returned by the exit handler.
+    int32_t status;
+
+    // Exit handler selector of the posted request.
+    uint64_t selector;
+
+    // Size of the serialized request in |buffer|.
+    uint64_t input_size;
+
+    // Size of the serialized response pointed to by |output|.
+    uint64_t output_size;
+
+    // Location of the serialized response. Either points to |buffer| or to a
+    // heap allocation owned by the untrusted workers.
+    void *output;
+
+    // Inline storage for the serialized request and response.
+    uint8_t buffer[kSlotBufferSize];
+  };
+
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                "std::atomic<uint32_t> is not lock free.");
+  static_assert(sizeof(Slot) == 4096,
+                "Unexpected size for SwitchlessRing::Slot");
+
+  // The callback signature of the exit handler dispatch used by workers.
+  using Handler = std::function<PrimitiveStatus(
+      uint64_t selector, MessageReader *input, MessageWriter *output)>;
+
+  // Initializes an inactive ring. |accept_spins| is the number of polls a
+  // trusted caller makes waiting for a worker to pick up its request before
+  // withdrawing it.
+  explicit SwitchlessRing(uint32_t accept_spins)
+      : instance_version_(TypeVersion()),
+        active_(0),
+        accept_spins_(accept_spins),
+        next_slot_(0) {
+    for (auto &slot : slots_) {
+      slot.state = kFree;
+      slot.output = nullptr;
+    }
+  }
+
+  SwitchlessRing(const SwitchlessRing &) = delete;
+  SwitchlessRing &operator=(const SwitchlessRing &) = delete;
+
+  // Returns a signature reflecting the layout of this concrete instance.
+  uint64_t InstanceVersion() const { return instance_version_; }
+
+  // Returns a signature reflecting the layout of this abstract type.
+  static constexpr uint64_t TypeVersion() {
+    return offsetof(SwitchlessRing, active_) << 0 |
+           offsetof(SwitchlessRing, accept_spins_) << 8 |
+           offsetof(SwitchlessRing, slots_) << 16 |
+           sizeof(SwitchlessRing) << 32;
+  }
+
+  // Opens or closes the ring for new requests.
+  void set_active(bool active) { active_ = active ? 1 : 0; }
+
+  // Returns true if the ring accepts new requests.
+  bool is_active() const { return active_ != 0; }
+
+  // Returns the number of polls trusted callers wait for a worker.
+  uint32_t accept_spins() const { return accept_spins_; }
+
+  //////////////////////////////////////
+  //        Trusted caller side       //
+  //////////////////////////////////////
+
+  // Claims a free slot and posts a request for |selector| with the serialized
+  // contents of |input|, which may be null. Returns the index of the posted
+  // slot, or -1 if the ring is inactive, has no free slot, or the request does
+  // not fit into a slot buffer.
+  int Post(uint64_t selector, const MessageWriter *input) {
+    size_t input_size = input ? input->MessageSize() : 0;
+    if (!is_active() || input_size > kSlotBufferSize) {
+      return -1;
+    }
+    size_t start = next_slot_.fetch_add(1, std::memory_order_relaxed);
+    for (size_t i = 0; i < kSlotCount; ++i) {
+      size_t index = (start + i) % kSlotCount;
+      Slot &slot = slots_[index];
+      uint32_t expected = kFree;
+      if (!slot.state.compare_exchange_strong(expected, kClaimed,
+                                              std::memory_order_acquire)) {
+        continue;
+      }
+      slot.selector = selector;
+      slot.input_size = input_size;
+      if (input_size > 0) {
+        input->Serialize(slot.buffer);
+      }
+      slot.state.store(kPosted, std::memory_order_release);
+      return static_cast<int>(index);
+    }
+    return -1;
+  }
+
+  // Waits for a worker to pick up the request posted in slot |index|. If no
+  // worker does so within |spins| polls, attempts to withdraw the
+  // request. Returns true if the request was accepted by a worker, or false if
+  // it was withdrawn and the slot was returned to the free state.
+  bool AwaitAccept(int index, uint32_t spins) {
+    Slot &slot = slots_[index % kSlotCount];
+    for (uint32_t i = 0; i < spins; ++i) {
+      if (slot.state.load(std::memory_order_acquire) != kPosted) {
+        return true;
+      }
+      Pause();
+    }
+    uint32_t expected = kPosted;
+    return !slot.state.compare_exchange_strong(expected, kFree,
+                                               std::memory_order_acq_rel);
+  }
+
+  // Waits for up to |spins| polls for the worker servicing slot |index| to
+  // publish a response. Returns true if the response is available. An accepted
+  // request cannot be withdrawn, so a caller which runs out of polls must keep
+  // waiting, but should give the worker a chance to run first.
+  bool AwaitCompletion(int index, uint32_t spins) {
+    Slot &slot = slots_[index % kSlotCount];
+    for (uint32_t i = 0; i < spins; ++i) {
+      if (slot.state.load(std::memory_order_acquire) == kDone) {
+        return true;
+      }
+      Pause();
+    }
+    return slot.state.load(std::memory_order_acquire) == kDone;
+  }
+
+  // Returns the slot at |index|. Its contents are untrusted.
+  Slot &slot(int index) { return slots_[index % kSlotCount]; }
+
+  // Returns true if |output| is the inline buffer of slot |index|.
+  bool IsInlineOutput(int index, const void *output) const {
+    return output == slots_[index % kSlotCount].buffer;
+  }
+
+  // Releases slot |index| after its response was consumed. If the response was
+  // stored outside the slot buffer, hands the slot back to the workers so they
+  // can free it.
+  void Release(int index, bool inline_output) {
+    slots_[index % kSlotCount].state.store(inline_output ? kFree : kReleased,
+                                           std::memory_order_release);
+  }
+
+  //////////////////////////////////////
+  //        Untrusted worker side     //
+  //////////////////////////////////////
+
+  // Services at most one posted request with |handler|, scanning the ring from
+  // |start|. Slots released with a spilled response are reclaimed along the
+  // way. Returns true if a request was serviced.
+  bool ServiceOne(size_t start, const Handler &handler) {
+    for (size_t i = 0; i < kSlotCount; ++i) {
+      Slot &slot = slots_[(start + i) % kSlotCount];
+      uint32_t expected = slot.state.load(std::memory_order_acquire);
+      if (expected == kReleased) {
+        if (slot.state.compare_exchange_strong(expected, kClaimed,
+                                               std::memory_order_acquire)) {
+          FreeSpilledOutput(&slot);
+          slot.state.store(kFree, std::memory_order_release);
+        }
+        continue;
+      }
+      if (expected != kPosted ||
+          !slot.state.compare_exchange_strong(expected, kRunning,
+                                              std::memory_order_acquire)) {
+        continue;
+      }
+      Run(&slot, handler);
+      return true;
+    }
+    return false;
+  }
+
+  // Returns true if no slot is in use by either side.
+  bool Idle() const {
+    for (const auto &slot : slots_) {
+      if (slot.state.load(std::memory_order_acquire) != kFree) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Frees all spilled responses still held by released slots. Must only be
+  // called once no trusted caller or worker can access the ring anymore.
+  void UnsynchronizedReclaim() {
+    for (auto &slot : slots_) {
+      FreeSpilledOutput(&slot);
+      slot.state = kFree;
+    }
+  }
+
+ private:
+  static void Pause() {
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+  }
+
+  // Invokes |handler| on the request held by |slot| and publishes the result.
+  static void Run(Slot *slot, const Handler &handler) {
+    MessageReader in;
+    if (slot->input_size <= kSlotBufferSize) {
+      in.Deserialize(slot->buffer, slot->input_size);
+    }
+    MessageWriter out;
+    PrimitiveStatus status = handler(slot->selector, &in, &out);
+    slot->status = status.error_code();
+    size_t output_size = status.ok() ? out.MessageSize() : 0;
+    slot->output_size = output_size;
+    if (output_size == 0) {
+      slot->output = slot->buffer;
+    } else if (output_size <= kSlotBufferSize) {
+      slot->output = slot->buffer;
+      out.Serialize(slot->buffer);
+    } else {
+      slot->output = malloc(output_size);
+      if (slot->output) {
+        out.Serialize(slot->output);
+      } else {
+        slot->status = AbslStatusCode::kResourceExhausted;
+        slot->output = slot->buffer;
+        slot->output_size = 0;
+      }
+    }
+    slot->state.store(kDone, std::memory_order_release);
+  }
+
+  static void FreeSpilledOutput(Slot *slot) {
+    if (slot->output && slot->output != slot->buffer) {
+      free(slot->output);
+    }
+    slot->output = nullptr;
+  }
+
+  const uint64_t instance_version_;   // Layout of the ring.
+  std::atomic<uint32_t> active_;      // Ring accepts new requests.
+  const uint32_t accept_spins_;       // Polls before withdrawing a request.
+  std::atomic<size_t> next_slot_;     // Hint for the next slot to claim.
+  Slot slots_[kSlotCount];
+} __attribute__((aligned(64)));
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_UTIL_SWITCHLESS_RING_H_
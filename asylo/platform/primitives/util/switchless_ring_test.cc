@@ -0,0 +1,257 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/primitives/util/switchless_ring.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include "asylo/platform/primitives/primitive_status.h"
+#include "asylo/platform/primitives/util/message.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+namespace primitives {
+namespace {
+
+using ::testing::Eq;
+using ::testing::Ge;
+using ::testing::SizeIs;
+using ::testing::StrEq;
+
+constexpr uint64_t kEchoSelector = 7;
+constexpr uint64_t kFailSelector = 8;
+constexpr uint32_t kAcceptSpins = 1000;
+
+// Echoes its input back, or fails for kFailSelector.
+PrimitiveStatus EchoHandler(uint64_t selector, MessageReader *input,
+                            MessageWriter *output) {
+  if (selector == kFailSelector) {
+    return PrimitiveStatus{AbslStatusCode::kInternal, "failed"};
+  }
+  while (input->hasNext()) {
+    output->PushByCopy(input->next());
+  }
+  return PrimitiveStatus::OkStatus();
+}
+
+class SwitchlessRingTest : public ::testing::Test {
+ protected:
+  SwitchlessRingTest() : ring_(new SwitchlessRing(kAcceptSpins)) {
+    ring_->set_active(true);
+  }
+
+  // Consumes the response of the completed request in slot |index|.
+  PrimitiveStatus Consume(int index, MessageReader *output) {
+    SwitchlessRing::Slot &slot = ring_->slot(index);
+    bool inline_output = ring_->IsInlineOutput(index, slot.output);
+    if (slot.status == AbslStatusCode::kOk && slot.output_size > 0) {
+      output->Deserialize(slot.output, slot.output_size);
+    }
+    int32_t status = slot.status;
+    ring_->Release(index, inline_output);
+    return PrimitiveStatus(status);
+  }
+
+  std::unique_ptr<SwitchlessRing> ring_;
+};
+
+TEST_F(SwitchlessRingTest, LayoutVersionMatches) {
+  EXPECT_THAT(ring_->InstanceVersion(), Eq(SwitchlessRing::TypeVersion()));
+}
+
+TEST_F(SwitchlessRingTest, InactiveRingRejectsRequests) {
+  ring_->set_active(false);
+  MessageWriter input;
+  input.Push(1);
+  EXPECT_THAT(ring_->Post(kEchoSelector, &input), Eq(-1));
+}
+
+TEST_F(SwitchlessRingTest, OversizedRequestIsRejected) {
+  MessageWriter input;
+  input.PushString(std::string(SwitchlessRing::kSlotBufferSize, 'a'));
+  EXPECT_THAT(ring_->Post(kEchoSelector, &input), Eq(-1));
+}
+
+TEST_F(SwitchlessRingTest, RoundTripInline) {
+  MessageWriter input;
+  input.Push(42);
+  input.PushString("hello");
+  int index = ring_->Post(kEchoSelector, &input);
+  ASSERT_THAT(index, Ge(0));
+
+  EXPECT_TRUE(ring_->ServiceOne(/*start=*/0, EchoHandler));
+  EXPECT_TRUE(ring_->AwaitCompletion(index, kAcceptSpins));
+
+  MessageReader output;
+  EXPECT_TRUE(Consume(index, &output).ok());
+  ASSERT_THAT(output, SizeIs(2));
+  EXPECT_THAT(output.next<int>(), Eq(42));
+  EXPECT_THAT(output.next().As<char>(), StrEq("hello"));
+  EXPECT_TRUE(ring_->Idle());
+}
+
+TEST_F(SwitchlessRingTest, SpilledResponseIsFreedByWorker) {
+  MessageWriter input;
+  input.Push(1);
+  int index = ring_->Post(kEchoSelector, &input);
+  ASSERT_THAT(index, Ge(0));
+
+  auto big_handler = [](uint64_t selector, MessageReader *in,
+                        MessageWriter *out) {
+    out->PushString(std::string(2 * SwitchlessRing::kSlotBufferSize, 'd'));
+    return PrimitiveStatus::OkStatus();
+  };
+  EXPECT_TRUE(ring_->ServiceOne(/*start=*/0, big_handler));
+  EXPECT_TRUE(ring_->AwaitCompletion(index, kAcceptSpins));
+  EXPECT_FALSE(ring_->IsInlineOutput(index, ring_->slot(index).output));
+
+  MessageReader output;
+  EXPECT_TRUE(Consume(index, &output).ok());
+  ASSERT_THAT(output, SizeIs(1));
+  EXPECT_THAT(output.next().size(),
+              Eq(2 * SwitchlessRing::kSlotBufferSize + 1));
+
+  // The released slot is reclaimed by the next worker scan.
+  EXPECT_FALSE(ring_->Idle());
+  EXPECT_FALSE(ring_->ServiceOne(/*start=*/0, EchoHandler));
+  EXPECT_TRUE(ring_->Idle());
+}
+
+TEST_F(SwitchlessRingTest, HandlerErrorIsPropagated) {
+  int index = ring_->Post(kFailSelector, /*input=*/nullptr);
+  ASSERT_THAT(index, Ge(0));
+  EXPECT_TRUE(ring_->ServiceOne(/*start=*/0, EchoHandler));
+  EXPECT_TRUE(ring_->AwaitCompletion(index, kAcceptSpins));
+
+  MessageReader output;
+  EXPECT_THAT(Consume(index, &output).error_code(),
+              Eq(AbslStatusCode::kInternal));
+  EXPECT_THAT(output, SizeIs(0));
+}
+
+TEST_F(SwitchlessRingTest, UnacceptedRequestIsWithdrawn) {
+  MessageWriter input;
+  input.Push(1);
+  int index = ring_->Post(kEchoSelector, &input);
+  ASSERT_THAT(index, Ge(0));
+  EXPECT_FALSE(ring_->AwaitAccept(index, kAcceptSpins));
+  EXPECT_TRUE(ring_->Idle());
+  EXPECT_FALSE(ring_->ServiceOne(/*start=*/0, EchoHandler));
+}
+
+TEST_F(SwitchlessRingTest, AwaitCompletionIsBounded) {
+  MessageWriter input;
+  input.Push(1);
+  int index = ring_->Post(kEchoSelector, &input);
+  ASSERT_THAT(index, Ge(0));
+  EXPECT_FALSE(ring_->AwaitCompletion(index, kAcceptSpins));
+
+  EXPECT_TRUE(ring_->ServiceOne(/*start=*/0, EchoHandler));
+  EXPECT_TRUE(ring_->AwaitCompletion(index, kAcceptSpins));
+  MessageReader output;
+  EXPECT_TRUE(Consume(index, &output).ok());
+  EXPECT_TRUE(ring_->Idle());
+}
+
+TEST_F(SwitchlessRingTest, FullRingRejectsRequests) {
+  MessageWriter input;
+  input.Push(1);
+  for (size_t i = 0; i < SwitchlessRing::kSlotCount; ++i) {
+    EXPECT_THAT(ring_->Post(kEchoSelector, &input), Ge(0));
+  }
+  EXPECT_THAT(ring_->Post(kEchoSelector, &input), Eq(-1));
+  for (size_t i = 0; i < SwitchlessRing::kSlotCount; ++i) {
+    EXPECT_TRUE(ring_->ServiceOne(/*start=*/0, EchoHandler));
+  }
+}
+
+TEST_F(SwitchlessRingTest, ConcurrentCallersAndWorkers) {
+  constexpr int kCallers = 4;
+  constexpr int kWorkers = 2;
+  constexpr int kCallsPerCaller = 200;
+
+  std::atomic<bool> stop(false);
+  std::vector<Thread> workers;
+  for (int i = 0; i < kWorkers; ++i) {
+    workers.emplace_back([this, &stop, i] {
+      while (!stop) {
+        if (!ring_->ServiceOne(i * SwitchlessRing::kSlotCount / kWorkers,
+                               EchoHandler)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::atomic<int> failures(0);
+  std::vector<Thread> callers;
+  for (int i = 0; i < kCallers; ++i) {
+    callers.emplace_back([this, &failures, i] {
+      for (int j = 0; j < kCallsPerCaller; ++j) {
+        MessageWriter input;
+        input.Push(i * kCallsPerCaller + j);
+        // Yield rather than spin while waiting so that workers make progress
+        // on machines with few cores.
+        int index;
+        do {
+          index = ring_->Post(kEchoSelector, &input);
+          if (index < 0) {
+            std::this_thread::yield();
+            continue;
+          }
+          for (int k = 0; k < 100 && ring_->slot(index).state.load() ==
+                                         SwitchlessRing::kPosted;
+               ++k) {
+            std::this_thread::yield();
+          }
+          if (!ring_->AwaitAccept(index, /*spins=*/0)) {
+            index = -1;
+          }
+        } while (index < 0);
+        while (ring_->slot(index).state.load() != SwitchlessRing::kDone) {
+          std::this_thread::yield();
+        }
+        MessageReader output;
+        if (!Consume(index, &output).ok() || output.size() != 1 ||
+            output.next<int>() != i * kCallsPerCaller + j) {
+          ++failures;
+        }
+      }
+    });
+  }
+  for (auto &caller : callers) {
+    caller.Join();
+  }
+  stop = true;
+  for (auto &worker : workers) {
+    worker.Join();
+  }
+  EXPECT_THAT(failures.load(), Eq(0));
+  EXPECT_TRUE(ring_->Idle());
+}
+
+}  // namespace
+}  // namespace primitives
+}  // namespace asylo
@@ -0,0 +1,167 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/primitives/util/switchless_worker_pool.h"
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+
+#include "absl/memory/memory.h"
+#include "absl/status/status.h"
+#include "asylo/platform/primitives/primitives.h"
+#include "asylo/platform/primitives/util/message.h"
+#include "asylo/util/logging.h"
+#include "asylo/util/status_macros.h"
+
+namespace asylo {
+namespace primitives {
+namespace {
+
+// Yields the calling host thread so that a switchless worker waiting for a CPU
+// may complete the request the trusted caller is waiting for.
+Status SwitchlessYieldHandler(const std::shared_ptr<Client> &client,
+                              void *context, MessageReader *input,
+                              MessageWriter *output) {
+  sched_yield();
+  return absl::OkStatus();
+}
+
+}  // namespace
+
+StatusOr<std::unique_ptr<SwitchlessWorkerPool>> SwitchlessWorkerPool::Create(
+    std::shared_ptr<Client> client, const SwitchlessConfig &config) {
+  if (config.worker_count() == 0) {
+    return absl::InvalidArgumentError(
+        "Switchless worker pool requires at least one worker");
+  }
+  auto pool =
+      absl::WrapUnique(new SwitchlessWorkerPool(std::move(client), config));
+  if (!pool->ring_) {
+    return absl::ResourceExhaustedError(
+        "Failed to allocate switchless request ring");
+  }
+
+  // The handler outlives the pool, so it may already be registered if
+  // switchless exit calls were enabled before.
+  Status status = pool->client_->exit_call_provider()->RegisterExitHandler(
+      kSelectorSwitchlessYield, ExitHandler{SwitchlessYieldHandler});
+  if (!status.ok() && !absl::IsAlreadyExists(status)) {
+    return status;
+  }
+
+  MessageWriter in;
+  in.Push(reinterpret_cast<uint64_t>(pool->ring_));
+  MessageReader out;
+  ASYLO_RETURN_IF_ERROR(
+      pool->client_->EnclaveCall(kSelectorAsyloSwitchless, &in, &out));
+  pool->ring_->set_active(true);
+  return std::move(pool);
+}
+
+SwitchlessWorkerPool::SwitchlessWorkerPool(std::shared_ptr<Client> client,
+                                           const SwitchlessConfig &config)
+    : client_(std::move(client)),
+      config_(config),
+      ring_(nullptr),
+      stopping_(false),
+      serviced_count_(0) {
+  void *memory = mmap(/*addr=*/nullptr, sizeof(SwitchlessRing),
+                      PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                      /*fd=*/-1, /*offset=*/0);
+  if (memory == MAP_FAILED) {
+    return;
+  }
+  ring_ = new (memory) SwitchlessRing(config_.accept_spin_iterations());
+  workers_.reserve(config_.worker_count());
+  for (size_t i = 0; i < config_.worker_count(); ++i) {
+    workers_.emplace_back([this, i] { WorkerLoop(i); });
+  }
+}
+
+SwitchlessWorkerPool::~SwitchlessWorkerPool() {
+  if (ring_) {
+    // Stop accepting new requests and detach the ring while the workers are
+    // still servicing in-flight requests, since detaching waits for them.
+    ring_->set_active(false);
+    if (!client_->IsClosed()) {
+      MessageReader out;
+      Status status = client_->EnclaveCall(kSelectorAsyloSwitchless,
+                                           /*input=*/nullptr, &out);
+      LOG_IF(ERROR, !status.ok())
+          << "Failed to detach switchless ring: " << status;
+    }
+  }
+  stopping_ = true;
+  for (auto &worker : workers_) {
+    worker.Join();
+  }
+  if (ring_) {
+    ring_->UnsynchronizedReclaim();
+    ring_->~SwitchlessRing();
+    munmap(ring_, sizeof(SwitchlessRing));
+  }
+}
+
+PrimitiveStatus SwitchlessWorkerPool::Dispatch(uint64_t selector,
+                                               MessageReader *input,
+                                               MessageWriter *output) {
+  serviced_count_.fetch_add(1, std::memory_order_relaxed);
+  return Client::ExitCallback(selector, input, output);
+}
+
+void SwitchlessWorkerPool::WorkerLoop(size_t worker) {
+  // Exit handlers locate their enclave through the thread-local current client.
+  Client::ScopedCurrentClient scoped_client(client_.get());
+  SwitchlessRing::Handler handler = [this](uint64_t selector,
+                                           MessageReader *input,
+                                           MessageWriter *output) {
+    return Dispatch(selector, input, output);
+  };
+
+  // Spread the workers' starting points over the ring to reduce contention on
+  // the slot states.
+  const size_t start =
+      worker * SwitchlessRing::kSlotCount / config_.worker_count();
+  uint32_t idle_polls = 0;
+  while (!stopping_.load(std::memory_order_relaxed)) {
+    if (ring_->ServiceOne(start, handler)) {
+      idle_polls = 0;
+      continue;
+    }
+    if (idle_polls < config_.spin_iterations()) {
+      ++idle_polls;
+#if defined(__x86_64__)
+      __builtin_ia32_pause();
+#endif
+      continue;
+    }
+    struct timespec duration;
+    duration.tv_sec = config_.sleep_microseconds() / 1000000;
+    duration.tv_nsec = (config_.sleep_microseconds() % 1000000) * 1000;
+    nanosleep(&duration, /*rem=*/nullptr);
+  }
+}
+
+}  // namespace primitives
+}  // namespace asylo
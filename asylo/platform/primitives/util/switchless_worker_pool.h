@@ -0,0 +1,98 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_UTIL_SWITCHLESS_WORKER_POOL_H_
+#define ASYLO_PLATFORM_PRIMITIVES_UTIL_SWITCHLESS_WORKER_POOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "asylo/enclave.pb.h"
+#include "asylo/platform/primitives/untrusted_primitives.h"
+#include "asylo/platform/primitives/util/switchless_ring.h"
+#include "asylo/util/status.h"
+#include "asylo/util/statusor.h"
+#include "asylo/util/thread.h"
+
+namespace asylo {
+namespace primitives {
+
+// A pool of untrusted threads servicing switchless exit calls posted by an
+// enclave into a SwitchlessRing.
+//
+// Each worker polls the ring for posted requests and dispatches them to the
+// exit call provider of the enclave client, exactly as a regular exit call
+// would be dispatched. A worker that finds no work for
+// `SwitchlessConfig.spin_iterations` consecutive polls goes to sleep for
+// `SwitchlessConfig.sleep_microseconds` between polls until work arrives again.
+// Trusted callers that find no awake worker fall back to a regular exit call,
+// so a sleeping pool only costs latency, never progress.
+class SwitchlessWorkerPool {
+ public:
+  // Allocates a SwitchlessRing, starts `config.worker_count()` workers and
+  // attaches the ring to the enclave behind |client|. Returns an error if
+  // `config.worker_count()` is zero or the enclave rejects the ring.
+  static StatusOr<std::unique_ptr<SwitchlessWorkerPool>> Create(
+      std::shared_ptr<Client> client, const SwitchlessConfig &config);
+
+  SwitchlessWorkerPool(const SwitchlessWorkerPool &) = delete;
+  SwitchlessWorkerPool &operator=(const SwitchlessWorkerPool &) = delete;
+
+  // Detaches the ring from the enclave if it is still open, then stops and
+  // joins all workers.
+  ~SwitchlessWorkerPool();
+
+  // Returns the number of worker threads.
+  size_t worker_count() const { return workers_.size(); }
+
+  // Returns the number of exit calls serviced by the workers.
+  uint64_t serviced_count() const { return serviced_count_.load(); }
+
+ private:
+  SwitchlessWorkerPool(std::shared_ptr<Client> client,
+                       const SwitchlessConfig &config);
+
+  // Main loop of the worker with index |worker|.
+  void WorkerLoop(size_t worker);
+
+  // Dispatches a request to the exit call provider of |client_|.
+  PrimitiveStatus Dispatch(uint64_t selector, MessageReader *input,
+                           MessageWriter *output);
+
+  const std::shared_ptr<Client> client_;
+  const SwitchlessConfig config_;
+
+  // The ring shared with the enclave. Allocated with page alignment in
+  // untrusted memory.
+  SwitchlessRing *ring_;
+
+  // Set to request all workers to exit.
+  std::atomic<bool> stopping_;
+
+  // Number of exit calls dispatched by the workers.
+  std::atomic<uint64_t> serviced_count_;
+
+  std::vector<Thread> workers_;
+};
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_UTIL_SWITCHLESS_WORKER_POOL_H_
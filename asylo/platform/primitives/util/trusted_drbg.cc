@@ -0,0 +1,97 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#include "asylo/platform/primitives/util/trusted_drbg.h"
+
+#include <openssl/mem.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "absl/base/attributes.h"
+#include "absl/types/span.h"
+#include "asylo/crypto/ctr_drbg.h"
+#include "asylo/crypto/util/byte_container_view.h"
+#include "asylo/platform/primitives/trusted_runtime.h"
+
+namespace asylo {
+namespace primitives {
+
+namespace {
+
+// Number of generate requests served by a thread's generator before it is
+// reseeded. This is far below the limit of 2^48 requests of SP 800-90A, and
+// bounds the output exposed by a compromise of the generator state.
+constexpr uint64_t kMaxRequestsPerSeed = 4096;
+
+// Seed generation of the enclave. A thread whose generator was seeded in an
+// earlier generation reseeds it before its next request.
+std::atomic<uint64_t> seed_generation{1};
+
+// Per-thread generator state. It is constant-initialized and trivially
+// destructible, so it needs no initialization or cleanup when an enclave
+// thread is created or destroyed.
+struct ThreadDrbg {
+  CtrDrbg drbg;
+  uint64_t generation = 0;
+};
+
+ABSL_CONST_INIT thread_local ThreadDrbg thread_drbg;
+
+// Seeds or reseeds |state| from the hardware entropy source. Returns false if
+// no entropy is available.
+bool SeedThreadDrbg(ThreadDrbg *state, uint64_t generation) {
+  uint8_t entropy[CtrDrbg::kSeedSize];
+  if (enc_hardware_seed(entropy, sizeof(entropy)) !=
+      static_cast<ssize_t>(sizeof(entropy))) {
+    return false;
+  }
+  ByteContainerView entropy_view(entropy, sizeof(entropy));
+  bool seeded = state->drbg.instantiated()
+                    ? state->drbg.Reseed(entropy_view).ok()
+                    : state->drbg.Instantiate(entropy_view).ok();
+  OPENSSL_cleanse(entropy, sizeof(entropy));
+  if (seeded) {
+    state->generation = generation;
+  }
+  return seeded;
+}
+
+}  // namespace
+
+bool TrustedDrbgRandomBytes(void *buf, size_t count) {
+  ThreadDrbg *state = &thread_drbg;
+  uint64_t generation = seed_generation.load(std::memory_order_acquire);
+  if (state->generation != generation ||
+      state->drbg.reseed_counter() > kMaxRequestsPerSeed) {
+    if (!SeedThreadDrbg(state, generation)) {
+      return false;
+    }
+  }
+  return state->drbg
+      .Generate(absl::MakeSpan(static_cast<uint8_t *>(buf), count))
+      .ok();
+}
+
+void TrustedDrbgForkReseed() {
+  seed_generation.fetch_add(1, std::memory_order_acq_rel);
+}
+
+}  // namespace primitives
+}  // namespace asylo
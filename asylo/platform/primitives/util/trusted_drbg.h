@@ -0,0 +1,50 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_UTIL_TRUSTED_DRBG_H_
+#define ASYLO_PLATFORM_PRIMITIVES_UTIL_TRUSTED_DRBG_H_
+
+#include <cstddef>
+
+// This file declares the trusted random number generator backing /dev/urandom,
+// getrandom() and the crypto nonce generators inside an enclave. Each trusted
+// thread owns a CtrDrbg seeded from the hardware entropy source, so that
+// requests are served with AES instead of one RDRAND instruction per eight
+// bytes. It depends only on the hardware randomness primitives and is shared
+// by all local backends.
+
+namespace asylo {
+namespace primitives {
+
+// Fills |buf| with |count| random bytes from the calling thread's generator,
+// which is seeded on first use and reseeded from enc_hardware_seed()
+// periodically and after a fork. Returns false if no hardware source of
+// randomness is available; the caller is expected to fall back to another
+// source of randomness in that case.
+bool TrustedDrbgRandomBytes(void *buf, size_t count);
+
+// Makes every thread reseed its generator before serving its next request.
+// Called in a child enclave after fork so that the child does not repeat the
+// output of the generators it inherited from its parent.
+void TrustedDrbgForkReseed();
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_UTIL_TRUSTED_DRBG_H_
@@ -0,0 +1,164 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/primitives/util/trusted_shared_clock.h"
+
+#include <atomic>
+#include <cstdint>
+
+#include "absl/status/status.h"
+#include "asylo/platform/common/shared_clock.h"
+#include "asylo/platform/primitives/primitive_status.h"
+#include "asylo/platform/primitives/primitives.h"
+#include "asylo/platform/primitives/trusted_primitives.h"
+#include "asylo/platform/primitives/util/message.h"
+
+namespace asylo {
+namespace primitives {
+
+namespace {
+
+// Number of consecutive reads of the same sample by a thread after which the
+// sample is considered stale, for instance because the publishing thread on
+// the host stopped making progress.
+constexpr uint32_t kMaxReadsPerSample = 4096;
+
+// The clock currently attached to the enclave, or nullptr.
+std::atomic<const SharedClock *> attached_clock{nullptr};
+
+// Number of trusted threads currently reading |attached_clock|. The clock may
+// not be detached while this is non-zero.
+std::atomic<uint32_t> active_readers{0};
+
+// Latest CLOCK_MONOTONIC value returned to the enclave, in nanoseconds.
+std::atomic<int64_t> monotonic_floor{0};
+
+// Sequence number of the last sample read by this thread, and the number of
+// consecutive times it was read.
+thread_local uint64_t last_sequence = 0;
+thread_local uint32_t last_sequence_reads = 0;
+
+// RAII helper tracking a reader in |active_readers|.
+class ScopedSharedClockReader {
+ public:
+  ScopedSharedClockReader() { active_readers.fetch_add(1); }
+  ~ScopedSharedClockReader() { active_readers.fetch_sub(1); }
+
+  ScopedSharedClockReader(const ScopedSharedClockReader &) = delete;
+  ScopedSharedClockReader &operator=(const ScopedSharedClockReader &) = delete;
+};
+
+// Detaches the current clock, waiting for all in-progress reads to complete.
+void DetachClock() {
+  attached_clock.store(nullptr);
+  while (active_readers.load() != 0) {
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+  }
+}
+
+// Entry handler installed by the runtime to attach or detach a SharedClock.
+PrimitiveStatus ConfigureSharedClock(void *context, MessageReader *in,
+                                     MessageWriter *out) {
+  DetachClock();
+  if (!in || in->size() == 0) {
+    return PrimitiveStatus::OkStatus();
+  }
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*in, 1);
+  auto *clock = reinterpret_cast<const SharedClock *>(in->next<uint64_t>());
+  if (!clock ||
+      !TrustedPrimitives::IsOutsideEnclave(clock, sizeof(SharedClock))) {
+    return {AbslStatusCode::kInvalidArgument,
+            "Shared clock must lie in untrusted memory."};
+  }
+  if (clock->InstanceVersion() != SharedClock::TypeVersion()) {
+    return {AbslStatusCode::kFailedPrecondition,
+            "Shared clock layout does not match the enclave."};
+  }
+  attached_clock.store(clock);
+  return PrimitiveStatus::OkStatus();
+}
+
+// Returns true if |sample| has not been read too often by this thread.
+bool CheckReadCount(const SharedClock::Sample &sample) {
+  if (sample.sequence != last_sequence) {
+    last_sequence = sample.sequence;
+    last_sequence_reads = 0;
+  }
+  if (last_sequence_reads >= kMaxReadsPerSample) {
+    return false;
+  }
+  ++last_sequence_reads;
+  return true;
+}
+
+}  // namespace
+
+void RegisterSharedClockEntryHandler() {
+  EntryHandler handler{ConfigureSharedClock};
+  if (!TrustedPrimitives::RegisterEntryHandler(kSelectorAsyloSharedClock,
+                                               handler)
+           .ok()) {
+    TrustedPrimitives::BestEffortAbort(
+        "Could not register entry handler: ConfigureSharedClock.");
+  }
+}
+
+bool ReadSharedClock(SharedClockId id, int64_t *nanoseconds) {
+  if (!attached_clock.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  SharedClock::Sample sample;
+  {
+    ScopedSharedClockReader reader;
+    const SharedClock *clock = attached_clock.load();
+    if (!clock || !clock->Read(&sample)) {
+      return false;
+    }
+  }
+
+  // Never let CLOCK_MONOTONIC go backwards: a sample older than a time already
+  // handed out is stale, whether that time came from this clock or the host.
+  int64_t floor = monotonic_floor.load(std::memory_order_relaxed);
+  do {
+    if (sample.monotonic_ns < floor) {
+      return false;
+    }
+  } while (sample.monotonic_ns > floor &&
+           !monotonic_floor.compare_exchange_weak(floor, sample.monotonic_ns,
+                                                  std::memory_order_relaxed));
+  if (!CheckReadCount(sample)) {
+    return false;
+  }
+
+  *nanoseconds = id == SharedClockId::kMonotonic ? sample.monotonic_ns
+                                                 : sample.realtime_ns;
+  return true;
+}
+
+void ObserveMonotonicClock(int64_t nanoseconds) {
+  int64_t floor = monotonic_floor.load(std::memory_order_relaxed);
+  while (nanoseconds > floor &&
+         !monotonic_floor.compare_exchange_weak(floor, nanoseconds,
+                                                std::memory_order_relaxed)) {
+  }
+}
+
+}  // namespace primitives
+}  // namespace asylo
@@ -0,0 +1,60 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_UTIL_TRUSTED_SHARED_CLOCK_H_
+#define ASYLO_PLATFORM_PRIMITIVES_UTIL_TRUSTED_SHARED_CLOCK_H_
+
+#include <cstdint>
+
+// This file declares the trusted side of the shared clock, a SharedClock
+// published periodically by the untrusted runtime which lets the enclave read
+// the time without an exit call. It depends only on the TrustedPrimitives API
+// and is shared by all local backends.
+
+namespace asylo {
+namespace primitives {
+
+// Clocks readable from the shared clock.
+enum class SharedClockId { kMonotonic, kRealtime };
+
+// Registers the kSelectorAsyloSharedClock entry handler, through which the
+// untrusted runtime attaches a SharedClock to the enclave (input: the clock
+// address) or detaches it (input: empty). Implemented for backends to call from
+// RegisterInternalHandlers().
+void RegisterSharedClockEntryHandler();
+
+// Reads the clock |id| from the attached SharedClock into |nanoseconds|.
+// Returns false if no clock is attached, no consistent sample could be read, or
+// the published sample is stale; the caller is expected to fall back to a host
+// call in that case.
+//
+// A sample is considered stale if its monotonic time is older than the latest
+// monotonic time returned to the enclave, including times passed to
+// ObserveMonotonicClock(), or if the calling thread has read the same sample
+// too many times in a row. Reads of CLOCK_MONOTONIC are therefore never
+// observed to go backwards, even when interleaved with host calls.
+bool ReadSharedClock(SharedClockId id, int64_t *nanoseconds);
+
+// Records a CLOCK_MONOTONIC value obtained from the host, in nanoseconds, so
+// that later reads of the shared clock do not return an earlier time.
+void ObserveMonotonicClock(int64_t nanoseconds);
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_UTIL_TRUSTED_SHARED_CLOCK_H_
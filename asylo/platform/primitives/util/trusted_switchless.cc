@@ -0,0 +1,166 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/primitives/util/trusted_switchless.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "asylo/platform/primitives/primitive_status.h"
+#include "asylo/platform/primitives/primitives.h"
+#include "asylo/platform/primitives/trusted_primitives.h"
+#include "asylo/platform/primitives/trusted_runtime.h"
+#include "asylo/platform/primitives/util/message.h"
+#include "asylo/platform/primitives/util/switchless_ring.h"
+
+namespace asylo {
+namespace primitives {
+
+namespace {
+
+// Number of polls a trusted caller makes waiting for an accepted request to
+// complete before yielding its host thread through a regular exit call.
+constexpr uint32_t kCompletionSpins = 1 << 16;
+
+// The ring currently attached to the enclave, or nullptr.
+std::atomic<SwitchlessRing *> attached_ring{nullptr};
+
+// Number of trusted threads currently between loading |attached_ring| and
+// releasing their slot. The ring may not be detached while this is non-zero.
+std::atomic<uint32_t> active_callers{0};
+
+// RAII helper tracking a caller in |active_callers|.
+class ScopedSwitchlessCaller {
+ public:
+  ScopedSwitchlessCaller() { active_callers.fetch_add(1); }
+  ~ScopedSwitchlessCaller() { active_callers.fetch_sub(1); }
+
+  ScopedSwitchlessCaller(const ScopedSwitchlessCaller &) = delete;
+  ScopedSwitchlessCaller &operator=(const ScopedSwitchlessCaller &) = delete;
+};
+
+// Detaches the current ring, waiting for all in-progress switchless calls to
+// complete. Workers must keep servicing the ring until this returns.
+void DetachRing() {
+  attached_ring.store(nullptr);
+  while (active_callers.load() != 0) {
+    enc_pause();
+  }
+}
+
+// Entry handler installed by the runtime to attach or detach a SwitchlessRing.
+PrimitiveStatus ConfigureSwitchless(void *context, MessageReader *in,
+                                    MessageWriter *out) {
+  DetachRing();
+  if (!in || in->size() == 0) {
+    return PrimitiveStatus::OkStatus();
+  }
+  ASYLO_RETURN_IF_INCORRECT_READER_ARGUMENTS(*in, 1);
+  auto *ring = reinterpret_cast<SwitchlessRing *>(in->next<uint64_t>());
+  if (!ring ||
+      !TrustedPrimitives::IsOutsideEnclave(ring, sizeof(SwitchlessRing))) {
+    return {AbslStatusCode::kInvalidArgument,
+            "Switchless ring must lie in untrusted memory."};
+  }
+  if (ring->InstanceVersion() != SwitchlessRing::TypeVersion()) {
+    return {AbslStatusCode::kFailedPrecondition,
+            "Switchless ring layout does not match the enclave."};
+  }
+  attached_ring.store(ring);
+  return PrimitiveStatus::OkStatus();
+}
+
+}  // namespace
+
+void RegisterSwitchlessEntryHandler() {
+  EntryHandler handler{ConfigureSwitchless};
+  if (!TrustedPrimitives::RegisterEntryHandler(kSelectorAsyloSwitchless,
+                                               handler)
+           .ok()) {
+    TrustedPrimitives::BestEffortAbort(
+        "Could not register entry handler: ConfigureSwitchless.");
+  }
+}
+
+bool SwitchlessEnabled() { return attached_ring.load() != nullptr; }
+
+bool TrySwitchlessUntrustedCall(uint64_t untrusted_selector,
+                                MessageWriter *input, MessageReader *output,
+                                PrimitiveStatus *status) {
+  if (!attached_ring.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  ScopedSwitchlessCaller caller;
+  SwitchlessRing *ring = attached_ring.load();
+  if (!ring) {
+    return false;
+  }
+
+  int index = ring->Post(untrusted_selector, input);
+  if (index < 0) {
+    return false;
+  }
+  if (!ring->AwaitAccept(index, ring->accept_spins())) {
+    return false;
+  }
+  // An accepted request cannot be withdrawn. If it takes long to complete, the
+  // worker may be waiting for a host CPU, so stop spinning and let the host
+  // scheduler run between polls.
+  while (!ring->AwaitCompletion(index, kCompletionSpins)) {
+    // A failed yield only costs CPU time, so keep waiting regardless.
+    MessageReader yield_output;
+    PrimitiveStatus yield_status = TrustedPrimitives::UntrustedCall(
+        kSelectorSwitchlessYield, /*input=*/nullptr, &yield_output);
+    static_cast<void>(yield_status);
+  }
+
+  // Read each field of the response exactly once, since untrusted code may
+  // modify the slot concurrently.
+  SwitchlessRing::Slot &slot = ring->slot(index);
+  int32_t error_code = slot.status;
+  const void *response = slot.output;
+  uint64_t response_size = slot.output_size;
+  bool inline_response = ring->IsInlineOutput(index, response);
+  if (inline_response
+          ? response_size > SwitchlessRing::kSlotBufferSize
+          : !TrustedPrimitives::IsOutsideEnclave(response, response_size)) {
+    TrustedPrimitives::BestEffortAbort(
+        "Switchless exit call response should be in untrusted memory.");
+  }
+
+  // Copy the response to a trusted buffer before deserializing to prevent
+  // TOC/TOU attacks.
+  if (error_code == AbslStatusCode::kOk && response_size > 0 && output) {
+    std::unique_ptr<char[]> trusted_response(new char[response_size]);
+    memcpy(trusted_response.get(), response, response_size);
+    output->Deserialize(std::move(trusted_response), response_size);
+  }
+  ring->Release(index, inline_response);
+
+  *status = error_code == AbslStatusCode::kOk
+                ? PrimitiveStatus::OkStatus()
+                : PrimitiveStatus{error_code, "Switchless exit call failed."};
+  return true;
+}
+
+}  // namespace primitives
+}  // namespace asylo
@@ -0,0 +1,58 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_PRIMITIVES_UTIL_TRUSTED_SWITCHLESS_H_
+#define ASYLO_PLATFORM_PRIMITIVES_UTIL_TRUSTED_SWITCHLESS_H_
+
+#include <cstdint>
+
+#include "asylo/platform/primitives/primitive_status.h"
+#include "asylo/platform/primitives/util/message.h"
+
+// This file declares the trusted side of switchless exit calls, which are
+// serviced by untrusted worker threads through a SwitchlessRing shared with
+// the enclave instead of by an enclave exit of the calling thread. It depends
+// only on the TrustedPrimitives API and is shared by all local backends.
+
+namespace asylo {
+namespace primitives {
+
+// Registers the kSelectorAsyloSwitchless entry handler, through which the
+// untrusted runtime attaches a SwitchlessRing to the enclave (input: the ring
+// address) or detaches it (input: empty). Implemented for backends to call from
+// RegisterInternalHandlers().
+void RegisterSwitchlessEntryHandler();
+
+// Returns true if a SwitchlessRing is attached to the enclave.
+bool SwitchlessEnabled();
+
+// Attempts to perform an exit call to |untrusted_selector| through the attached
+// SwitchlessRing. Returns true if the call was serviced by an untrusted worker,
+// in which case the outcome of the call is stored in |status| and the results
+// are deserialized into |output|. Returns false without side effects if
+// switchless mode is disabled, the ring is full, the request is too large for a
+// ring slot, or no worker picked up the request in time; the caller is expected
+// to fall back to TrustedPrimitives::UntrustedCall.
+bool TrySwitchlessUntrustedCall(uint64_t untrusted_selector,
+                                MessageWriter *input, MessageReader *output,
+                                PrimitiveStatus *status);
+
+}  // namespace primitives
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_PRIMITIVES_UTIL_TRUSTED_SWITCHLESS_H_
@@ -22,9 +22,14 @@
 
 // IO syscall interface constants.
 #include <fcntl.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <iomanip>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "absl/strings/escaping.h"
 #include "absl/synchronization/mutex.h"
@@ -32,6 +37,8 @@
 #include "asylo/crypto/util/bytes.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
 #include "asylo/platform/storage/utils/fd_closer.h"
+#include "asylo/platform/system_call/sysno.h"
+#include "asylo/platform/system_call/system_call.h"
 
 namespace asylo {
 namespace platform {
@@ -42,11 +49,31 @@ using crypto::gcmlib::GcmCryptorRegistry;
 
 namespace {
 
+// Number of block auth tags read from the host in a single exit when
+// collecting integrity metadata of an existing file.
+constexpr int64_t kTagReadBatchSize = 64;
+
 // Perform a weak validation that the path is canonical.
 bool IsPathNameValid(const char *path_name) {
   return path_name && strlen(path_name) && path_name[0] == '/';
 }
 
+// Returns true if |block_length| is a supported length of file blocks.
+bool IsBlockLengthValid(size_t block_length) {
+  return block_length >= kMinBlockLength && block_length <= kMaxBlockLength &&
+         (block_length & (block_length - 1)) == 0;
+}
+
+// Returns the index of a supported |block_length| among the supported block
+// lengths, in increasing order.
+size_t BlockLengthIndex(size_t block_length) {
+  size_t index = 0;
+  for (size_t length = kMinBlockLength; length < block_length; length *= 2) {
+    index++;
+  }
+  return index;
+}
+
 bool is_transient_error(int err) { return (err == EAGAIN) || (err == EINTR); }
 
 // Returns -1 on failure, or min(|len|, bytes to EOF) on success.
@@ -74,16 +101,45 @@ ssize_t read_all(int fd, void *buf, size_t len) {
   return offset;
 }
 
-// Returns -1 on failure, or |len| on success.
-ssize_t write_all(int fd, const void *buf, size_t len) {
+// Reads |len| bytes at the file offset |file_offset| without moving the cursor
+// of |fd|. Returns -1 on failure, or min(|len|, bytes to EOF) on success.
+ssize_t pread_all(int fd, void *buf, size_t len, off_t file_offset) {
+  size_t bytes_to_read = len;
+  size_t offset = 0;
+
+  while (bytes_to_read > 0) {
+    ssize_t bytes_read;
+    do {
+      bytes_read = enc_untrusted_pread64(
+          fd, static_cast<uint8_t *>(buf) + offset, bytes_to_read,
+          file_offset + offset);
+    } while ((bytes_read == -1) && is_transient_error(errno));
+    if (bytes_read == -1) {
+      return -1;
+    }
+    if (bytes_read == 0) {
+      return offset;
+    }
+
+    bytes_to_read -= bytes_read;
+    offset += bytes_read;
+  }
+
+  return offset;
+}
+
+// Writes |len| bytes at the file offset |file_offset| without moving the
+// cursor of |fd|. Returns -1 on failure, or |len| on success.
+ssize_t pwrite_all(int fd, const void *buf, size_t len, off_t file_offset) {
   size_t bytes_to_write = len;
   size_t offset = 0;
 
   while (bytes_to_write > 0) {
     ssize_t bytes_written;
     do {
-      bytes_written = enc_untrusted_write(
-          fd, static_cast<const uint8_t *>(buf) + offset, bytes_to_write);
+      bytes_written = enc_untrusted_pwrite64(
+          fd, static_cast<const uint8_t *>(buf) + offset, bytes_to_write,
+          file_offset + offset);
     } while ((bytes_written == -1) && is_transient_error(errno));
     if (bytes_written == -1) {
       return -1;
@@ -101,49 +157,198 @@ ssize_t write_all(int fd, const void *buf, size_t len) {
   return offset;
 }
 
+// Completes the pwrite64 of |len| bytes at |file_offset| submitted as |call| in
+// |batch|, writing the bytes left by a short or interrupted write. Returns -1
+// on failure, or |len| on success.
+ssize_t complete_batched_pwrite(const system_call::SystemCallBatch &batch,
+                                size_t call, int fd, const void *buf,
+                                size_t len, off_t file_offset) {
+  int64_t bytes_written = batch.result(call);
+  if (bytes_written == -1) {
+    if (!is_transient_error(batch.error_number(call))) {
+      errno = batch.error_number(call);
+      return -1;
+    }
+    bytes_written = 0;
+  }
+  if (bytes_written < 0 || bytes_written > static_cast<int64_t>(len)) {
+    errno = EIO;
+    return -1;
+  }
+  if (bytes_written == static_cast<int64_t>(len)) {
+    return len;
+  }
+
+  if (pwrite_all(fd, static_cast<const uint8_t *>(buf) + bytes_written,
+                 len - bytes_written, file_offset + bytes_written) == -1) {
+    return -1;
+  }
+  return len;
+}
+
 // Returns offset to the plaintext buffer associated with the |block_index| of
 // a full block.
 const uint8_t *GetPlaintextBuffer(size_t first_partial_block_bytes_count,
-                                  int64_t block_index, const void *buf) {
+                                  int64_t block_index, size_t block_length,
+                                  const void *buf) {
   const uint8_t *plaintext_data = reinterpret_cast<const uint8_t *>(buf);
   if (first_partial_block_bytes_count > 0) {
     if (block_index > 0) {
       plaintext_data += first_partial_block_bytes_count;
     }
     if (block_index > 1) {
-      plaintext_data += (block_index - 1) * kBlockLength;
+      plaintext_data += (block_index - 1) * block_length;
     }
   } else {
-    plaintext_data += block_index * kBlockLength;
+    plaintext_data += block_index * block_length;
   }
 
   return plaintext_data;
 }
 
 uint8_t *GetPlaintextBuffer(size_t first_partial_block_bytes_count,
-                            int64_t block_index, void *buf) {
+                            int64_t block_index, size_t block_length,
+                            void *buf) {
   return const_cast<uint8_t *>(
       GetPlaintextBuffer(first_partial_block_bytes_count, block_index,
-                         const_cast<const void *>(buf)));
+                         block_length, const_cast<const void *>(buf)));
+}
+
+// Reads the Merkle tree nodes at |positions| from the sidecar opened as |fd|
+// into |hashes|, reading up to kTagReadBatchSize nodes in a single exit.
+// Returns false on failure.
+bool ReadSidecarNodes(int fd, const std::vector<size_t> &positions,
+                      std::vector<std::string> *hashes) {
+  constexpr size_t kHashLength = MerkleTreeAuthenticatedDictionary::kHashLength;
+  std::vector<uint8_t> buffer(
+      std::min<size_t>(positions.size(), kTagReadBatchSize) * kHashLength);
+  for (size_t first = 0; first < positions.size();
+       first += kTagReadBatchSize) {
+    const size_t count =
+        std::min<size_t>(kTagReadBatchSize, positions.size() - first);
+    system_call::SystemCallBatch batch;
+    for (size_t idx = 0; idx < count; idx++) {
+      batch.Add(system_call::kSYS_pread64, fd,
+                buffer.data() + idx * kHashLength, kHashLength,
+                positions[first + idx] * kHashLength);
+    }
+    EnsureInitializedAndSubmitSyscallBatch(&batch);
+
+    for (size_t idx = 0; idx < count; idx++) {
+      if (batch.result(idx) != static_cast<int64_t>(kHashLength)) {
+        LOG(ERROR) << "Failed to read Merkle tree sidecar, bytes_read="
+                   << batch.result(idx);
+        return false;
+      }
+      hashes->emplace_back(
+          reinterpret_cast<const char *>(buffer.data()) + idx * kHashLength,
+          kHashLength);
+    }
+  }
+  return true;
 }
 
 }  // namespace
 
 using Tag = UnsafeBytes<kTagLength>;
 using Token = UnsafeBytes<kTokenLength>;
-using Block = UnsafeBytes<kBlockLength>;
-using Ciphertext = UnsafeBytes<kCipherBlockLength>;
-using SecureBlock = UnsafeBytes<kSecureBlockLength>;
 
 using TagView = ByteContainerView;
 using TokenView = ByteContainerView;
-using BlockView = ByteContainerView;
 using CiphertextView = ByteContainerView;
-using SecureBlockView = ByteContainerView;
 
-AeadHandler::AeadHandler()
-    : offset_translator_(OffsetTranslator::Create(
-          sizeof(FileHeader), kBlockLength, kSecureBlockLength)) {}
+AeadHandler::AeadHandler() {
+  for (size_t block_length = kMinBlockLength; block_length <= kMaxBlockLength;
+       block_length *= 2) {
+    offset_translators_.push_back(
+        OffsetTranslator::Create(sizeof(FileHeader), block_length,
+                                 block_length + kBlockMetadataLength));
+  }
+  legacy_offset_translator_ = OffsetTranslator::Create(
+      sizeof(LegacyFileHeader), kLegacyBlockLength,
+      kLegacyBlockLength + kBlockMetadataLength);
+}
+
+void AeadHandler::SetFileBlockLength(FileControl *file_ctrl,
+                                     size_t block_length) const {
+  file_ctrl->mu.AssertHeld();
+  file_ctrl->block_length = block_length;
+  file_ctrl->offset_translator =
+      offset_translators_[BlockLengthIndex(block_length)].get();
+  file_ctrl->block_cache.Clear();
+}
+
+void AeadHandler::SetLegacyLayout(FileControl *file_ctrl) const {
+  file_ctrl->mu.AssertHeld();
+  file_ctrl->version = kLegacyFileFormatVersion;
+  file_ctrl->block_length = kLegacyBlockLength;
+  file_ctrl->offset_translator = legacy_offset_translator_.get();
+  file_ctrl->block_cache.Clear();
+  // A sidecar is recognized by the versioned header of its file, so files of
+  // the legacy format are never given one.
+  file_ctrl->sidecar_failed = true;
+}
+
+bool AeadHandler::IsVersionedSecureFile(const char *path) {
+  int fd = enc_untrusted_open(path, O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+
+  FdCloser fd_closer(fd, &enc_untrusted_close);
+  uint64_t magic;
+  return read_all(fd, &magic, sizeof(magic)) ==
+             static_cast<ssize_t>(sizeof(magic)) &&
+         magic == kFileMagic;
+}
+
+bool AeadHandler::ReadFileHeader(int fd, const std::string &path,
+                                 FileHeader *header) const {
+  ssize_t bytes_read = read_all(fd, header->data(), sizeof(FileHeader));
+  if (bytes_read == sizeof(FileHeader) && header->magic == kFileMagic) {
+    if (header->version != kFileFormatVersion) {
+      LOG(ERROR) << "Unsupported secure file format version, path=" << path
+                 << ", version = " << header->version;
+      return false;
+    }
+    return true;
+  }
+
+  // Files written before the header was versioned start with the file hash.
+  // The hash authenticates the version below, so a versioned file passed off
+  // as a legacy one fails validation.
+  if (bytes_read < static_cast<ssize_t>(sizeof(LegacyFileHeader))) {
+    LOG(ERROR) << "Failed to read the file header, bytes read = "
+               << bytes_read;
+    return false;
+  }
+  LegacyFileHeader legacy_header;
+  std::copy_n(header->data(), sizeof(LegacyFileHeader), legacy_header.data());
+  VLOG(2) << "Reading secure file of legacy format, path = " << path;
+  header->magic = kFileMagic;
+  header->version = kLegacyFileFormatVersion;
+  header->file_hash = legacy_header.file_hash;
+  header->file_size = legacy_header.file_size;
+  header->block_length = kLegacyBlockLength;
+  return true;
+}
+
+int AeadHandler::GetHostFd(FileControl *file_ctrl) const {
+  file_ctrl->mu.AssertHeld();
+  if (file_ctrl->host_fd.get() != -1) {
+    return file_ctrl->host_fd.get();
+  }
+
+  int fd = enc_untrusted_open(file_ctrl->path.c_str(), O_RDWR);
+  if (fd == -1) {
+    LOG(ERROR) << "Failed to open file for reading and writing, path="
+               << file_ctrl->path << ", errno = " << errno;
+    return -1;
+  }
+
+  file_ctrl->host_fd.reset(fd);
+  return fd;
+}
 
 bool AeadHandler::Deserialize(FileControl *file_ctrl) {
   if (!file_ctrl) {
@@ -182,10 +387,31 @@ bool AeadHandler::Deserialize(FileControl *file_ctrl) {
 
   // Read the header with digest.
   FileHeader file_header;
-  ssize_t bytes_read = read_all(fd, file_header.data(), sizeof(FileHeader));
-  if (bytes_read != sizeof(FileHeader)) {
-    LOG(ERROR) << "Failed to read the file header, bytes read = " << bytes_read;
+  if (!ReadFileHeader(fd, file_ctrl->path, &file_header)) {
+    return false;
+  }
+
+  // The block length is validated together with the file size below.
+  if (file_header.version == kLegacyFileFormatVersion) {
+    SetLegacyLayout(file_ctrl);
+  } else if (!IsBlockLengthValid(file_header.block_length)) {
+    LOG(ERROR) << "Unsupported block length in the file header, path="
+               << file_ctrl->path
+               << ", block length = " << file_header.block_length;
     return false;
+  } else {
+    SetFileBlockLength(file_ctrl, file_header.block_length);
+  }
+  const size_t block_length = file_ctrl->block_length;
+  const size_t secure_block_length = file_ctrl->secure_block_length();
+
+  // Loading the Merkle tree from the sidecar avoids reading the tag of every
+  // block.
+  if (!file_ctrl->sidecar_failed &&
+      LoadMerkleTree(file_ctrl, file_header, *cryptor)) {
+    VLOG(2) << "Loaded Merkle tree from sidecar, path = " << file_ctrl->path;
+    file_ctrl->logical_size = file_header.file_size;
+    return true;
   }
 
   // In order to validate the integrity metadata and the file size have to first
@@ -193,65 +419,254 @@ bool AeadHandler::Deserialize(FileControl *file_ctrl) {
   // value of the file size - then validation of the hash of the file digest
   // confirms validity of both the file size and the integrity metadata.
   const int64_t blocks_count =
-      (file_header.file_size + kBlockLength - 1) / kBlockLength;
-  Tag tag;
-  for (int64_t block_index = 0; block_index < blocks_count; block_index++) {
-    off_t offset = enc_untrusted_lseek(fd, kBlockLength, SEEK_CUR);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek past block when collecting integrity metadata.";
-      return false;
+      (file_header.file_size + block_length - 1) / block_length;
+  std::vector<Tag> tags(std::min(blocks_count, kTagReadBatchSize));
+  for (int64_t first_block_index = 0; first_block_index < blocks_count;
+       first_block_index += kTagReadBatchSize) {
+    const int64_t batch_blocks_count =
+        std::min(kTagReadBatchSize, blocks_count - first_block_index);
+
+    // Read the auth tags of a run of blocks in a single exit.
+    system_call::SystemCallBatch batch;
+    for (int64_t idx = 0; idx < batch_blocks_count; idx++) {
+      const off_t tag_offset = file_ctrl->header_length() +
+                               (first_block_index + idx) * secure_block_length +
+                               block_length;
+      batch.Add(system_call::kSYS_pread64, fd, tags[idx].data(), kTagLength,
+                tag_offset);
     }
-
-    bytes_read = read_all(fd, tag.data(), kTagLength);
-    if (bytes_read != kTagLength) {
-      LOG(ERROR) << "Failed to read integrity metadata, bytes_read="
-                 << bytes_read;
-      return false;
+    EnsureInitializedAndSubmitSyscallBatch(&batch);
+
+    for (int64_t idx = 0; idx < batch_blocks_count; idx++) {
+      if (batch.result(idx) != static_cast<int64_t>(kTagLength)) {
+        LOG(ERROR) << "Failed to read integrity metadata, bytes_read="
+                   << batch.result(idx);
+        return false;
+      }
+
+      std::string tag_string(reinterpret_cast<char *>(tags[idx].data()),
+                             kTagLength);
+      VLOG(2) << "Adding auth tag as leaf to rebuild Merkle tree: "
+              << absl::BytesToHexString(tag_string);
+      file_ctrl->ad->AddLeaf(tag_string);
     }
+  }
 
-    std::string tag_string(reinterpret_cast<char *>(tag.data()), kTagLength);
-    VLOG(2) << "Adding auth tag as leaf to rebuild Merkle tree: "
-            << absl::BytesToHexString(tag_string);
-    file_ctrl->ad->AddLeaf(tag_string);
+  VLOG(2) << "Pushed block auth tags on initialization.";
 
-    offset = enc_untrusted_lseek(fd, kTokenLength, SEEK_CUR);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek past token when collecting integrity metadata.";
-      return false;
-    }
+  // Validate AD root, the file size and the block length.
+  if (!IsRootValid(file_ctrl->ad->CurrentRoot(), file_header, *cryptor)) {
+    LOG(ERROR) << "Failure validating integrity root for file "
+               << file_ctrl->path << ", current root: "
+               << absl::BytesToHexString(file_ctrl->ad->CurrentRoot());
+    return false;
   }
 
-  VLOG(2) << "Pushed block auth tags on initialization.";
+  file_ctrl->logical_size = file_header.file_size;
 
-  // Prepare file data digest.
+  // Save the rebuilt tree, so that the next open can load it. A failure only
+  // means the tree is rebuilt again.
+  system_call::SystemCallBatch batch;
+  std::vector<SidecarWrite> writes;
+  AddSidecarWrites(file_ctrl, &batch, &writes);
+  if (!writes.empty()) {
+    EnsureInitializedAndSubmitSyscallBatch(&batch);
+    CompleteSidecarWrites(file_ctrl, batch, writes);
+  }
+
+  return true;
+}
+
+bool AeadHandler::IsRootValid(const std::string &root,
+                              const FileHeader &header,
+                              const GcmCryptor &cryptor) const {
+  if (root.size() != kRootHashLength) {
+    return false;
+  }
+
+  // Prepare file data digest, in the layout of the version of the file.
   DataDigest data_digest;
-  std::copy_n(
-      reinterpret_cast<const uint8_t *>(file_ctrl->ad->CurrentRoot().data()),
-      kRootHashLength, data_digest.data());
-  data_digest.file_size = file_header.file_size;
-
-  // Validate AD root and the file size.
-  FileHash new_hash;
-  if (!cryptor->GetAuthTag(new_hash.data(), data_digest.data(),
-                           sizeof(DataDigest))) {
+  LegacyDataDigest legacy_data_digest;
+  uint8_t *digest_data;
+  size_t digest_length;
+  if (header.version == kLegacyFileFormatVersion) {
+    std::copy_n(reinterpret_cast<const uint8_t *>(root.data()),
+                kRootHashLength, legacy_data_digest.data());
+    legacy_data_digest.file_size = header.file_size;
+    digest_data = legacy_data_digest.data();
+    digest_length = sizeof(LegacyDataDigest);
+  } else {
+    std::copy_n(reinterpret_cast<const uint8_t *>(root.data()),
+                kRootHashLength, data_digest.data());
+    data_digest.version = header.version;
+    data_digest.file_size = header.file_size;
+    data_digest.block_length = header.block_length;
+    digest_data = data_digest.data();
+    digest_length = sizeof(DataDigest);
+  }
+
+  FileHash hash;
+  if (!cryptor.GetAuthTag(hash.data(), digest_data, digest_length)) {
     LOG(ERROR) << "Failed to generate CMAC for integrity verification, root="
-               << file_ctrl->ad->CurrentRoot();
+               << absl::BytesToHexString(root);
     return false;
   }
 
-  if (new_hash != file_header.file_hash) {
-    LOG(ERROR) << "Failure validating integrity root for file "
-               << file_ctrl->path << ", current root: "
-               << absl::BytesToHexString(file_ctrl->ad->CurrentRoot());
+  return hash == header.file_hash;
+}
+
+bool AeadHandler::LoadMerkleTree(FileControl *file_ctrl,
+                                 const FileHeader &header,
+                                 const GcmCryptor &cryptor) const {
+  file_ctrl->mu.AssertHeld();
+  int fd = enc_untrusted_open(file_ctrl->sidecar_path().c_str(), O_RDWR);
+  if (fd == -1) {
+    VLOG(2) << "No Merkle tree sidecar for file " << file_ctrl->path;
     return false;
   }
 
-  file_ctrl->logical_size = file_header.file_size;
+  FdCloser fd_closer(fd, &enc_untrusted_close);
+
+  // The sidecar and the file size are untrusted until the root of the loaded
+  // tree is validated against the header. Bound the size of the tree by the
+  // size of the sidecar before allocating it.
+  struct stat stat_buffer;
+  if (enc_untrusted_fstat(fd, &stat_buffer) == -1) {
+    VLOG(2) << "Failed to stat Merkle tree sidecar, path="
+            << file_ctrl->sidecar_path() << ", errno = " << errno;
+    return false;
+  }
+  const size_t sidecar_size = stat_buffer.st_size;
+  const size_t leaf_count =
+      (header.file_size + file_ctrl->block_length - 1) /
+      file_ctrl->block_length;
+  constexpr size_t kHashLength = MerkleTreeAuthenticatedDictionary::kHashLength;
+  if (leaf_count > sidecar_size / kHashLength ||
+      MerkleTreeAuthenticatedDictionary::SerializedNodeCount(leaf_count) *
+              kHashLength !=
+          sidecar_size) {
+    VLOG(2) << "Merkle tree sidecar size does not match file "
+            << file_ctrl->path;
+    return false;
+  }
+
+  // Nodes below the root are read from the sidecar when first accessed.
+  if (!file_ctrl->ad->Load(leaf_count,
+                           [fd](const std::vector<size_t> &positions,
+                                std::vector<std::string> *hashes) {
+                             return ReadSidecarNodes(fd, positions, hashes);
+                           }) ||
+      !IsRootValid(file_ctrl->ad->CurrentRoot(), header, cryptor)) {
+    VLOG(2) << "Stale Merkle tree sidecar for file " << file_ctrl->path;
+    file_ctrl->ad = absl::make_unique<MerkleTreeAuthenticatedDictionary>();
+    return false;
+  }
+
+  // The tree reads from the sidecar for as long as the file is open.
+  file_ctrl->sidecar_fd.reset(fd_closer.release());
   return true;
 }
 
+int AeadHandler::GetSidecarFd(FileControl *file_ctrl) const {
+  file_ctrl->mu.AssertHeld();
+  if (file_ctrl->sidecar_fd.get() != -1) {
+    return file_ctrl->sidecar_fd.get();
+  }
+
+  int fd = enc_untrusted_open(file_ctrl->sidecar_path().c_str(),
+                              O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    VLOG(2) << "Failed to open Merkle tree sidecar, path="
+            << file_ctrl->sidecar_path() << ", errno = " << errno;
+    return -1;
+  }
+
+  file_ctrl->sidecar_fd.reset(fd);
+  return fd;
+}
+
+void AeadHandler::AddSidecarWrites(FileControl *file_ctrl,
+                                   system_call::SystemCallBatch *batch,
+                                   std::vector<SidecarWrite> *writes) const {
+  file_ctrl->mu.AssertHeld();
+  if (file_ctrl->sidecar_failed) {
+    file_ctrl->ad->ClearModifiedNodes();
+    return;
+  }
+
+  const std::vector<size_t> positions = file_ctrl->ad->ModifiedNodes();
+  if (positions.empty()) {
+    return;
+  }
+
+  int fd = GetSidecarFd(file_ctrl);
+  if (fd == -1) {
+    file_ctrl->sidecar_failed = true;
+    return;
+  }
+
+  // Split the modified nodes into runs of consecutive nodes. The root is at
+  // the largest position of the form 2^k - 1 in the tree, so it is the largest
+  // such modified position if it was modified.
+  std::vector<std::pair<size_t, size_t>> runs;
+  size_t root_run = 0;
+  size_t root_position = 0;
+  for (size_t idx = 0; idx < positions.size(); idx++) {
+    if (idx == 0 || positions[idx] != positions[idx - 1] + 1) {
+      runs.emplace_back(idx, idx);
+    }
+    runs.back().second = idx + 1;
+    if (((positions[idx] + 1) & positions[idx]) == 0 &&
+        positions[idx] >= root_position) {
+      root_position = positions[idx];
+      root_run = runs.size() - 1;
+    }
+  }
+
+  // Write the run holding the root last, so that a sidecar with a valid root
+  // is never left with stale nodes below it.
+  std::rotate(runs.begin() + root_run, runs.begin() + root_run + 1,
+              runs.end());
+  for (const auto &run : runs) {
+    SidecarWrite write;
+    for (size_t idx = run.first; idx < run.second; idx++) {
+      const std::string hash = file_ctrl->ad->NodeHash(positions[idx]);
+      write.data.insert(write.data.end(), hash.begin(), hash.end());
+    }
+    writes->push_back(std::move(write));
+    SidecarWrite &queued = writes->back();
+    queued.offset =
+        positions[run.first] * MerkleTreeAuthenticatedDictionary::kHashLength;
+    queued.call_index =
+        batch->Add(system_call::kSYS_pwrite64, fd, queued.data.data(),
+                   queued.data.size(), queued.offset);
+  }
+}
+
+void AeadHandler::CompleteSidecarWrites(
+    FileControl *file_ctrl, const system_call::SystemCallBatch &batch,
+    const std::vector<SidecarWrite> &writes) const {
+  file_ctrl->mu.AssertHeld();
+  for (const SidecarWrite &write : writes) {
+    if (complete_batched_pwrite(batch, write.call_index,
+                                file_ctrl->sidecar_fd.get(), write.data.data(),
+                                write.data.size(), write.offset) == -1) {
+      LOG(ERROR) << "Failed to update Merkle tree sidecar, path="
+                 << file_ctrl->sidecar_path();
+      // The tree must not read from the sidecar once it is truncated.
+      if (!file_ctrl->ad->ReadAllNodes()) {
+        LOG(ERROR) << "Failed to read Merkle tree sidecar, path="
+                   << file_ctrl->sidecar_path();
+      }
+      enc_untrusted_ftruncate(file_ctrl->sidecar_fd.get(), 0);
+      file_ctrl->sidecar_failed = true;
+      return;
+    }
+  }
+
+  file_ctrl->ad->ClearModifiedNodes();
+}
+
 bool AeadHandler::InitializeFile(int fd, const char *path_name,
                                  bool is_new_file) {
   if (!IsPathNameValid(path_name)) {
@@ -277,7 +692,10 @@ bool AeadHandler::InitializeFile(int fd, const char *path_name,
   auto path_it = opened_files_.find(path_name);
   std::shared_ptr<FileControl> file_ctrl =
       (path_it == opened_files_.end())
-          ? std::make_shared<FileControl>(path_name, is_new_file)
+          ? std::make_shared<FileControl>(
+                path_name, is_new_file,
+                offset_translators_[BlockLengthIndex(kDefaultBlockLength)]
+                    .get())
           : path_it->second;
   fmap_.emplace(fd, file_ctrl);
   opened_files_.emplace(path_name, file_ctrl);
@@ -285,7 +703,9 @@ bool AeadHandler::InitializeFile(int fd, const char *path_name,
   return true;
 }
 
-bool AeadHandler::RetrieveLogicalOffset(int fd, off_t *logical_offset) const {
+bool AeadHandler::RetrieveLogicalOffset(int fd, const FileControl &file_ctrl,
+                                        off_t *logical_offset) const {
+  file_ctrl.mu.AssertHeld();
   if (fd < 0) {
     errno = EINVAL;
     return false;
@@ -297,7 +717,8 @@ bool AeadHandler::RetrieveLogicalOffset(int fd, off_t *logical_offset) const {
     return false;
   }
 
-  *logical_offset = offset_translator_->PhysicalToLogical(physical_offset);
+  *logical_offset =
+      file_ctrl.offset_translator->PhysicalToLogical(physical_offset);
   if (*logical_offset == OffsetTranslator::kInvalidOffset) {
     LOG(ERROR) << "The file is corrupted, fd = " << fd;
     return false;
@@ -306,6 +727,20 @@ bool AeadHandler::RetrieveLogicalOffset(int fd, off_t *logical_offset) const {
   return true;
 }
 
+bool AeadHandler::StoreLogicalOffset(int fd, const FileControl &file_ctrl,
+                                     off_t logical_offset) const {
+  file_ctrl.mu.AssertHeld();
+  const off_t physical_offset =
+      file_ctrl.offset_translator->LogicalToPhysical(logical_offset);
+  if (enc_untrusted_lseek(fd, physical_offset, SEEK_SET) == -1) {
+    LOG(ERROR) << "Failed to move cursor on descriptor: " << fd
+               << ", logical offset = " << logical_offset;
+    return false;
+  }
+
+  return true;
+}
+
 GcmCryptor *AeadHandler::GetGcmCryptor(const FileControl &file_ctrl) const {
   file_ctrl.mu.AssertHeld();
   if (!file_ctrl.master_key) {
@@ -314,7 +749,7 @@ GcmCryptor *AeadHandler::GetGcmCryptor(const FileControl &file_ctrl) const {
   }
 
   GcmCryptor *cryptor = GcmCryptorRegistry::GetInstance().GetGcmCryptor(
-      kBlockLength, *file_ctrl.master_key);
+      file_ctrl.block_length, *file_ctrl.master_key);
   if (!cryptor) {
     LOG(ERROR) << "Unable to instantiate GCM cryptor.";
   }
@@ -328,11 +763,6 @@ ssize_t AeadHandler::DecryptAndVerify(int fd, void *buf, size_t count) {
     return -1;
   }
 
-  off_t logical_offset;
-  if (!RetrieveLogicalOffset(fd, &logical_offset)) {
-    return -1;
-  }
-
   std::shared_ptr<FileControl> file_ctrl;
   {
     absl::MutexLock global_lock(&mu_);
@@ -348,7 +778,22 @@ ssize_t AeadHandler::DecryptAndVerify(int fd, void *buf, size_t count) {
   }
 
   absl::MutexLock lock(&file_ctrl->mu);
-  return DecryptAndVerifyInternal(fd, buf, count, *file_ctrl, logical_offset);
+
+  off_t logical_offset;
+  if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_offset)) {
+    return -1;
+  }
+
+  ssize_t read_count =
+      DecryptAndVerifyInternal(fd, buf, count, *file_ctrl, logical_offset);
+
+  // Move cursor to the position of the end of the read range.
+  if (read_count > 0 &&
+      !StoreLogicalOffset(fd, *file_ctrl, logical_offset + read_count)) {
+    return -1;
+  }
+
+  return read_count;
 }
 
 ssize_t AeadHandler::DecryptAndVerifyInternal(int fd, void *buf, size_t count,
@@ -369,42 +814,36 @@ ssize_t AeadHandler::DecryptAndVerifyInternal(int fd, void *buf, size_t count,
     count = file_ctrl.logical_size - logical_offset;
   }
 
+  const size_t block_length = file_ctrl.block_length;
+  const size_t secure_block_length = file_ctrl.secure_block_length();
+
   // Determine data breakdown into logical blocks.
   size_t first_partial_block_bytes_count;
   size_t last_partial_block_bytes_count;
   size_t full_inclusive_blocks_bytes_count;
-  offset_translator_->ReduceLogicalRangeToFullLogicalBlocks(
+  file_ctrl.offset_translator->ReduceLogicalRangeToFullLogicalBlocks(
       logical_offset, count, &first_partial_block_bytes_count,
       &last_partial_block_bytes_count, &full_inclusive_blocks_bytes_count);
 
   // Use single read buffer to minimize the number of read calls to the host.
   std::vector<uint8_t> buffer;
-  const size_t physical_bytes_count =
-      (full_inclusive_blocks_bytes_count / kBlockLength) * kSecureBlockLength;
+  const int64_t blocks_count = full_inclusive_blocks_bytes_count / block_length;
+  const size_t physical_bytes_count = blocks_count * secure_block_length;
   buffer.resize(physical_bytes_count);
 
-  // Move cursor to the first full block to read.
-  const off_t first_logical_block_offset =
-      (first_partial_block_bytes_count > 0)
-          ? (logical_offset + first_partial_block_bytes_count - kBlockLength)
-          : logical_offset;
+  // Locate the first full block to read. The range starts at
+  // |first_block_offset| within that block.
+  const size_t first_block_offset = logical_offset % block_length;
+  const off_t first_logical_block_offset = logical_offset - first_block_offset;
   const off_t first_physical_block_offset =
-      offset_translator_->LogicalToPhysical(first_logical_block_offset);
-  if (first_partial_block_bytes_count > 0) {
-    off_t offset =
-        enc_untrusted_lseek(fd, first_physical_block_offset, SEEK_SET);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek to the fist block offset when reading file data.";
-      return -1;
-    }
-  }
+      file_ctrl.offset_translator->LogicalToPhysical(
+          first_logical_block_offset);
 
   // Perform the read. Read may have been requested beyond EOF - cannot require
   // that bytes_read is equal to physical_bytes_count. The read was not
   // requested at EOF - checked this above.
-  ssize_t bytes_read =
-      enc_untrusted_read(fd, buffer.data(), physical_bytes_count);
+  ssize_t bytes_read = enc_untrusted_pread64(
+      fd, buffer.data(), physical_bytes_count, first_physical_block_offset);
   if (bytes_read <= 0) {
     LOG(ERROR) << "Cannot verify data - data has not been read, fd = " << fd;
     return -1;
@@ -412,73 +851,77 @@ ssize_t AeadHandler::DecryptAndVerifyInternal(int fd, void *buf, size_t count,
 
   // Process only complete blocks read, since need per-block metadata to decrypt
   // the block.
-  bytes_read = (bytes_read / kSecureBlockLength) * kSecureBlockLength;
+  bytes_read = (bytes_read / secure_block_length) * secure_block_length;
   if (bytes_read == 0) {
     LOG(ERROR) << "Cannot verify data - data has not been read, fd = " << fd;
     return -1;
   }
 
-  // Move cursor to the position of the end of the read range.
-  off_t new_cur_logical_offset = logical_offset + count;
-  if (bytes_read != physical_bytes_count) {
-    int64_t blocks_not_read =
-        (physical_bytes_count - bytes_read) / kSecureBlockLength;
-    if (last_partial_block_bytes_count > 0) {
-      new_cur_logical_offset -= last_partial_block_bytes_count;
-      blocks_not_read--;
-    }
-    new_cur_logical_offset -= blocks_not_read * kBlockLength;
-  }
-  const off_t new_cur_physical_offset =
-      offset_translator_->LogicalToPhysical(new_cur_logical_offset);
-  off_t offset = enc_untrusted_lseek(fd, new_cur_physical_offset, SEEK_SET);
-  if (offset == -1) {
-    LOG(ERROR) << "Failed lseek to the end of read range.";
-    return -1;
-  }
-
   GcmCryptor *cryptor = GetGcmCryptor(file_ctrl);
   if (!cryptor) {
     return -1;
   }
 
   // Cycle through blocks.
-  const int64_t blocks_read = bytes_read / kSecureBlockLength;
-  const int64_t blocks_read_max = physical_bytes_count / kSecureBlockLength;
+  const int64_t blocks_read = bytes_read / secure_block_length;
   const off_t first_block_index =
-      (first_physical_block_offset - sizeof(FileHeader)) / kSecureBlockLength;
+      (first_physical_block_offset - file_ctrl.header_length()) /
+      secure_block_length;
+  // Bounce blocks for reading partial blocks at the ends of the full range.
+  std::vector<uint8_t> first_bounce_block;
+  std::vector<uint8_t> last_bounce_block;
+  uint8_t *first_plaintext_data = nullptr;
+  uint8_t *last_plaintext_data = nullptr;
+  size_t first_range_offset = 0;
+  size_t first_range_bytes_count = 0;
+  size_t last_range_bytes_count = 0;
+
+  // Blocks to decrypt, collected for a single batch decryption.
+  std::vector<const uint8_t *> ciphertext_blocks;
+  std::vector<const uint8_t *> tokens;
+  std::vector<uint8_t *> decrypt_targets;
+  ciphertext_blocks.reserve(blocks_read);
+  tokens.reserve(blocks_read);
+  decrypt_targets.reserve(blocks_read);
   size_t read_count = 0;
   for (int64_t block_index = 0; block_index < blocks_read; block_index++) {
     const size_t merkle_block_idx = first_block_index + block_index + 1;
 
-    uint8_t *plaintext_data =
-        GetPlaintextBuffer(first_partial_block_bytes_count, block_index, buf);
+    uint8_t *plaintext_data = GetPlaintextBuffer(
+        first_partial_block_bytes_count, block_index, block_length, buf);
+
+    // Determine the part of the block within the requested range.
+    const bool is_first_partial_block =
+        block_index == 0 && first_partial_block_bytes_count > 0;
+    const bool is_last_partial_block = block_index == blocks_count - 1 &&
+                                       last_partial_block_bytes_count > 0;
+    size_t range_offset = 0;
+    size_t range_bytes_count = block_length;
+    if (is_first_partial_block) {
+      range_offset = first_block_offset;
+      range_bytes_count = first_partial_block_bytes_count;
+    } else if (is_last_partial_block) {
+      range_bytes_count = last_partial_block_bytes_count;
+    }
 
     // Detect full blocks that belong to sparse regions in the file - no need to
     // decrypt.
     if (file_ctrl.ad->LeafHash(merkle_block_idx) == file_ctrl.zero_hash) {
       VLOG(2) << "A sparse region block detected.";
-      memset(plaintext_data, 0, kBlockLength);
-      read_count += kBlockLength;
+      memset(plaintext_data, 0, range_bytes_count);
+      read_count += range_bytes_count;
       continue;
     }
 
-    CiphertextView ciphertext(buffer.data() + block_index * kSecureBlockLength,
-                              kCipherBlockLength);
-    VLOG(2) << "Ciphertext read: "
-            << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(ciphertext.data()),
-                   kCipherBlockLength));
-
-    TagView tag(buffer.data() + block_index * kSecureBlockLength + kBlockLength,
-                kTagLength);
+    const uint8_t *secure_block =
+        buffer.data() + block_index * secure_block_length;
+    CiphertextView ciphertext(secure_block, block_length + kTagLength);
+    TagView tag(secure_block + block_length, kTagLength);
     VLOG(2) << "Auth tag read: "
             << absl::BytesToHexString(absl::string_view(
                    reinterpret_cast<const char *>(tag.data()), kTagLength));
 
-    TokenView token(
-        buffer.data() + block_index * kSecureBlockLength + kCipherBlockLength,
-        kTokenLength);
+    TokenView token(secure_block + block_length + kTagLength, kTokenLength);
     VLOG(2) << "Token read: "
             << absl::BytesToHexString(absl::string_view(
                    reinterpret_cast<const char *>(token.data()), kTokenLength));
@@ -493,42 +936,44 @@ ssize_t AeadHandler::DecryptAndVerifyInternal(int fd, void *buf, size_t count,
       return -1;
     }
 
-    // Bounce block for reading partial blocks at the ends of the full range.
-    Block bounce_block;
-    // Target for decryption - bounce block or the supplied buffer.
-    uint8_t *decrypt_target;
-    // Determine the target depending on whether the read block is at the end of
-    // the full range.
-    if ((block_index == 0 && first_partial_block_bytes_count > 0) ||
-        (block_index == blocks_read_max - 1 &&
-         last_partial_block_bytes_count > 0)) {
-      decrypt_target = bounce_block.data();
-    } else {
-      decrypt_target = plaintext_data;
+    // Target for decryption - bounce block or the supplied buffer, depending on
+    // whether the read block is at the end of the full range.
+    uint8_t *decrypt_target = plaintext_data;
+    if (is_first_partial_block) {
+      first_bounce_block.resize(block_length);
+      decrypt_target = first_bounce_block.data();
+      first_plaintext_data = plaintext_data;
+      first_range_offset = range_offset;
+      first_range_bytes_count = range_bytes_count;
+    } else if (is_last_partial_block) {
+      last_bounce_block.resize(block_length);
+      decrypt_target = last_bounce_block.data();
+      last_plaintext_data = plaintext_data;
+      last_range_bytes_count = range_bytes_count;
     }
 
-    // Decrypt the block.
-    if (!cryptor->DecryptBlock(ciphertext.data(), token.data(),
-                               decrypt_target)) {
-      LOG(ERROR) << "Decryption failed, fd = " << fd;
-      return -1;
-    }
+    ciphertext_blocks.push_back(ciphertext.data());
+    tokens.push_back(token.data());
+    decrypt_targets.push_back(decrypt_target);
+    read_count += range_bytes_count;
+  }
 
-    // Copy content from the bounce buffer, if used. Increment the count of read
-    // bytes.
-    if (block_index == 0 && first_partial_block_bytes_count > 0) {
-      std::copy_n(
-          bounce_block.begin() + kBlockLength - first_partial_block_bytes_count,
-          first_partial_block_bytes_count, plaintext_data);
-      read_count += first_partial_block_bytes_count;
-    } else if (block_index == blocks_read_max - 1 &&
-               last_partial_block_bytes_count > 0) {
-      std::copy_n(bounce_block.begin(), last_partial_block_bytes_count,
-                  plaintext_data);
-      read_count += last_partial_block_bytes_count;
-    } else {
-      read_count += kBlockLength;
-    }
+  // Decrypt all the verified blocks.
+  if (!cryptor->DecryptBlocks(ciphertext_blocks.size(),
+                              ciphertext_blocks.data(), tokens.data(),
+                              decrypt_targets.data())) {
+    LOG(ERROR) << "Decryption failed, fd = " << fd;
+    return -1;
+  }
+
+  // Copy content from the bounce blocks, if used.
+  if (first_plaintext_data) {
+    std::copy_n(first_bounce_block.begin() + first_range_offset,
+                first_range_bytes_count, first_plaintext_data);
+  }
+  if (last_plaintext_data) {
+    std::copy_n(last_bounce_block.begin(), last_range_bytes_count,
+                last_plaintext_data);
   }
 
   VLOG(2) << "Verified read blocks, blocks_read = " << blocks_read
@@ -544,15 +989,11 @@ bool AeadHandler::UpdateDigest(FileControl *file_ctrl,
   }
   file_ctrl->mu.AssertHeld();
 
-  int fd = enc_untrusted_open(file_ctrl->path.c_str(), O_WRONLY);
+  int fd = GetHostFd(file_ctrl);
   if (fd == -1) {
-    LOG(ERROR) << "Failed to open file to save data digest, path="
-               << file_ctrl->path << ", errno = " << errno;
     return false;
   }
 
-  FdCloser fd_closer(fd, &enc_untrusted_close);
-
   std::string root = file_ctrl->ad->CurrentRoot();
   if (root.size() != kRootHashLength) {
     LOG(ERROR) << "Unexpected size of root hash encountered, size="
@@ -564,68 +1005,74 @@ bool AeadHandler::UpdateDigest(FileControl *file_ctrl,
   DataDigest data_digest;
   std::copy_n(reinterpret_cast<const uint8_t *>(root.data()), kRootHashLength,
               data_digest.data());
+  data_digest.version = kFileFormatVersion;
   data_digest.file_size = file_ctrl->logical_size;
+  data_digest.block_length = file_ctrl->block_length;
 
   FileHeader header;
-  if (!cryptor.GetAuthTag(header.data(), data_digest.data(),
+  if (!cryptor.GetAuthTag(header.file_hash.data(), data_digest.data(),
                           sizeof(DataDigest))) {
     LOG(ERROR) << "Failed to generate CMAC, root = " << root;
     return false;
   }
+  header.magic = kFileMagic;
+  header.version = kFileFormatVersion;
   header.file_size = file_ctrl->logical_size;
+  header.block_length = file_ctrl->block_length;
 
   VLOG(2) << "Updating the digest for file: " << file_ctrl->path
           << ", root hash: " << absl::BytesToHexString(root);
-  ssize_t bytes_written = write_all(fd, header.data(), sizeof(FileHeader));
+  // Write the modified nodes of the Merkle tree and the header in a single
+  // exit.
+  system_call::SystemCallBatch batch;
+  std::vector<SidecarWrite> writes;
+  AddSidecarWrites(file_ctrl, &batch, &writes);
+  size_t header_call = batch.Add(system_call::kSYS_pwrite64, fd, header.data(),
+                                 sizeof(FileHeader), 0);
+  EnsureInitializedAndSubmitSyscallBatch(&batch);
+  CompleteSidecarWrites(file_ctrl, batch, writes);
+
+  ssize_t bytes_written = complete_batched_pwrite(
+      batch, header_call, fd, header.data(), sizeof(FileHeader), 0);
   if (bytes_written != sizeof(FileHeader)) {
     LOG(ERROR) << "Failed to write full digest to file, path="
                << file_ctrl->path << ", bytes written = " << bytes_written;
     return false;
   }
 
-  if (!fd_closer.reset()) {
-    LOG(ERROR) << "Failed to close the file after digest update, path="
-               << file_ctrl->path;
-    return false;
-  }
-
   return true;
 }
 
-bool AeadHandler::ReadFullBlock(const FileControl &file_ctrl,
-                                off_t logical_offset, Block *block) const {
-  file_ctrl.mu.AssertHeld();
-  if (logical_offset < 0 || logical_offset % kBlockLength != 0) {
+bool AeadHandler::ReadFullBlock(FileControl *file_ctrl, off_t logical_offset,
+                                uint8_t *block) const {
+  file_ctrl->mu.AssertHeld();
+  const size_t block_length = file_ctrl->block_length;
+  if (logical_offset < 0 || logical_offset % block_length != 0) {
     errno = EINVAL;
     return false;
   }
 
-  int fd = enc_untrusted_open(file_ctrl.path.c_str(), O_RDONLY);
-  if (fd == -1) {
-    LOG(ERROR) << "Failed to open file to read a block, path=" << file_ctrl.path
-               << ", errno = " << errno;
-    return false;
+  const int64_t block_index = logical_offset / block_length;
+  if (file_ctrl->block_cache.Lookup(block_index, block, block_length)) {
+    return true;
   }
 
-  FdCloser fd_closer(fd, &enc_untrusted_close);
-
-  off_t physical_offset = offset_translator_->LogicalToPhysical(logical_offset);
-  off_t offset = enc_untrusted_lseek(fd, physical_offset, SEEK_SET);
-  if (offset == -1) {
-    LOG(ERROR) << "Failed lseek when reading a full block.";
+  int fd = GetHostFd(file_ctrl);
+  if (fd == -1) {
     return false;
   }
 
-  ssize_t bytes_read = DecryptAndVerifyInternal(fd, block->data(), kBlockLength,
-                                                file_ctrl, logical_offset);
+  ssize_t bytes_read = DecryptAndVerifyInternal(fd, block, block_length,
+                                                *file_ctrl, logical_offset);
   if (bytes_read == -1) {
-    return -1;
+    return false;
   }
 
-  if (bytes_read < kBlockLength) {
-    memset(block->data() + bytes_read, 0, kBlockLength - bytes_read);
+  if (bytes_read < block_length) {
+    memset(block + bytes_read, 0, block_length - bytes_read);
   }
 
+  file_ctrl->block_cache.Insert(block_index, block, block_length);
   return true;
 }
 
@@ -635,11 +1082,6 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
     return -1;
   }
 
-  off_t logical_offset;
-  if (!RetrieveLogicalOffset(fd, &logical_offset)) {
-    return -1;
-  }
-
   std::shared_ptr<FileControl> file_ctrl;
   {
     absl::MutexLock global_lock(&mu_);
@@ -660,38 +1102,60 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
 
   absl::MutexLock lock(&file_ctrl->mu);
 
+  // Files of the legacy layout are only read. They can be migrated by copying
+  // them to a new secure file.
+  if (file_ctrl->version == kLegacyFileFormatVersion) {
+    LOG(ERROR) << "Attempt made to write to a secure file of legacy format, "
+                  "path = "
+               << file_ctrl->path;
+    errno = EROFS;
+    return -1;
+  }
+
+  off_t logical_offset;
+  if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_offset)) {
+    return -1;
+  }
+
+  const size_t block_length = file_ctrl->block_length;
+  const size_t secure_block_length = file_ctrl->secure_block_length();
+
   // Determine data breakdown into logical blocks.
   size_t first_partial_block_bytes_count;
   size_t last_partial_block_bytes_count;
   size_t full_inclusive_blocks_bytes_count;
-  offset_translator_->ReduceLogicalRangeToFullLogicalBlocks(
+  file_ctrl->offset_translator->ReduceLogicalRangeToFullLogicalBlocks(
       logical_offset, count, &first_partial_block_bytes_count,
       &last_partial_block_bytes_count, &full_inclusive_blocks_bytes_count);
 
+  // The range starts at |first_block_offset| within its first block.
+  const size_t first_block_offset = logical_offset % block_length;
+  const off_t first_logical_block_offset = logical_offset - first_block_offset;
+
   // Bounce block for writing the first partial block in the range, if any.
-  Block first_block;
+  std::vector<uint8_t> first_block;
   if (first_partial_block_bytes_count > 0) {
-    if (!ReadFullBlock(
-            *file_ctrl,
-            logical_offset + first_partial_block_bytes_count - kBlockLength,
-            &first_block)) {
+    first_block.resize(block_length);
+    if (!ReadFullBlock(file_ctrl.get(), first_logical_block_offset,
+                       first_block.data())) {
       LOG(ERROR)
           << "failed to read the first misaligned block when writing, fd = "
           << fd;
       return -1;
     }
 
-    std::copy_n(
-        reinterpret_cast<const uint8_t *>(buf), first_partial_block_bytes_count,
-        first_block.data() + kBlockLength - first_partial_block_bytes_count);
+    std::copy_n(reinterpret_cast<const uint8_t *>(buf),
+                first_partial_block_bytes_count,
+                first_block.data() + first_block_offset);
   }
 
   // Bounce block for writing the last partial block in the range, if any.
-  Block last_block;
+  std::vector<uint8_t> last_block;
   if (last_partial_block_bytes_count > 0) {
-    if (!ReadFullBlock(*file_ctrl,
+    last_block.resize(block_length);
+    if (!ReadFullBlock(file_ctrl.get(),
                        logical_offset + count - last_partial_block_bytes_count,
-                       &last_block)) {
+                       last_block.data())) {
       LOG(ERROR)
           << "failed to read the last misaligned block when writing, fd = "
           << fd;
@@ -703,30 +1167,30 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
                 last_partial_block_bytes_count, last_block.data());
   }
 
-  const off_t first_logical_block_offset =
-      (first_partial_block_bytes_count > 0)
-          ? (logical_offset + first_partial_block_bytes_count - kBlockLength)
-          : logical_offset;
   const off_t first_physical_block_offset =
-      offset_translator_->LogicalToPhysical(first_logical_block_offset);
+      file_ctrl->offset_translator->LogicalToPhysical(
+          first_logical_block_offset);
   const int64_t eof_block_index = file_ctrl->ad->LeafCount();
   int64_t start_block_to_write = 0;
   if (first_physical_block_offset > file_ctrl->physical_size()) {
     // Append leafs to the Merkle Tree to account for sparse region blocks.
     int64_t sparse_blocks_count =
         (first_physical_block_offset - file_ctrl->physical_size()) /
-        kSecureBlockLength;
+        secure_block_length;
     for (int64_t idx = 0; idx < sparse_blocks_count; idx++) {
       VLOG(2) << "Adding an empty auth tag to AD for a block "
                  "from a sparse region: "
               << absl::BytesToHexString(file_ctrl->zero_hash);
-      file_ctrl->ad->AddLeafHash(file_ctrl->zero_hash);
+      if (file_ctrl->ad->AddLeafHash(file_ctrl->zero_hash) == 0) {
+        LOG(ERROR) << "Integrity verification failed, fd = " << fd;
+        return -1;
+      }
     }
     start_block_to_write = eof_block_index + sparse_blocks_count;
   } else {
     int64_t blocks_to_eof =
         (file_ctrl->physical_size() - first_physical_block_offset) /
-        kSecureBlockLength;
+        secure_block_length;
     start_block_to_write = eof_block_index - blocks_to_eof;
   }
 
@@ -740,15 +1204,17 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
   // Use single write buffer to minimize the number of write calls to the host.
   std::vector<uint8_t> buffer;
   const int64_t blocks_to_write =
-      full_inclusive_blocks_bytes_count / kBlockLength;
-  const size_t physical_bytes_count = blocks_to_write * kSecureBlockLength;
+      full_inclusive_blocks_bytes_count / block_length;
+  const size_t physical_bytes_count = blocks_to_write * secure_block_length;
   buffer.resize(physical_bytes_count);
 
-  // Cycle through blocks.
-  std::vector<Tag> tags;
+  // Collect the blocks to encrypt in a single batch.
+  std::vector<const uint8_t *> encrypt_sources(blocks_to_write);
+  std::vector<uint8_t *> tokens(blocks_to_write);
+  std::vector<uint8_t *> ciphertexts(blocks_to_write);
   for (int64_t block_index = 0; block_index < blocks_to_write; block_index++) {
-    const uint8_t *plaintext_data =
-        GetPlaintextBuffer(first_partial_block_bytes_count, block_index, buf);
+    const uint8_t *plaintext_data = GetPlaintextBuffer(
+        first_partial_block_bytes_count, block_index, block_length, buf);
 
     // Source for encryption - bounce block or the supplied buffer.
     const uint8_t *encrypt_source;
@@ -763,44 +1229,34 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
       encrypt_source = plaintext_data;
     }
 
-    Ciphertext *ciphertext =
-        Ciphertext::Place(&buffer, block_index * kSecureBlockLength);
-    Token *token = Token::Place(
-        &buffer, block_index * kSecureBlockLength + kCipherBlockLength);
+    encrypt_sources[block_index] = encrypt_source;
+    ciphertexts[block_index] =
+        buffer.data() + block_index * secure_block_length;
+    tokens[block_index] = ciphertexts[block_index] + block_length + kTagLength;
+  }
 
-    // Encrypt the block.
-    if (!cryptor->EncryptBlock(encrypt_source, token->data(),
-                               ciphertext->data())) {
-      LOG(ERROR) << "Encryption failed, fd = " << fd;
-      return -1;
-    }
-    VLOG(2) << "Ciphertext generated: "
-            << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(ciphertext->data()),
-                   kBlockLength));
+  // Encrypt the blocks.
+  if (!cryptor->EncryptBlocks(blocks_to_write, encrypt_sources.data(),
+                              tokens.data(), ciphertexts.data())) {
+    LOG(ERROR) << "Encryption failed, fd = " << fd;
+    return -1;
+  }
+
+  std::vector<Tag> tags;
+  for (int64_t block_index = 0; block_index < blocks_to_write; block_index++) {
+    const uint8_t *ciphertext = ciphertexts[block_index];
+    const uint8_t *token = tokens[block_index];
     VLOG(2) << "Token generated: "
             << absl::BytesToHexString(absl::string_view(
-                   reinterpret_cast<const char *>(token->data()),
-                   kTokenLength));
+                   reinterpret_cast<const char *>(token), kTokenLength));
 
-    TagView tag(ciphertext->data() + kBlockLength, kTagLength);
+    TagView tag(ciphertext + block_length, kTagLength);
     tags.push_back(tag);
     VLOG(2) << "Auth tag generated: "
             << absl::BytesToHexString(absl::string_view(
                    reinterpret_cast<const char *>(tag.data()), kTagLength));
   }
 
-  // Move cursor to the first full block to write.
-  if (first_partial_block_bytes_count > 0) {
-    off_t offset =
-        enc_untrusted_lseek(fd, first_physical_block_offset, SEEK_SET);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek to the fist block offset when writing file data.";
-      return -1;
-    }
-  }
-
   // Note: with block alignment constraint in place, partial block writes are
   // not permissible - complete blocks must be written. Thus, the options are:
   // 1. Allow partial yet block-aligned writes - this would require truncating
@@ -809,7 +1265,8 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
   //    on error or when all data has been written, following the POSIX model -
   //    this may lead to "long" writes when "large" amount of data is written.
   // In this code optimize operation for full writes - i.e. the option #2.
-  ssize_t bytes_written = write_all(fd, buffer.data(), physical_bytes_count);
+  ssize_t bytes_written = pwrite_all(fd, buffer.data(), physical_bytes_count,
+                                     first_physical_block_offset);
   if (bytes_written != physical_bytes_count) {
     LOG(ERROR) << "Failed to write encrypted data to file, path="
                << file_ctrl->path << ", bytes written = " << bytes_written;
@@ -817,16 +1274,8 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
   }
 
   // Move cursor to the position of the end of the write range.
-  if (last_partial_block_bytes_count > 0) {
-    off_t new_cur_logical_offset = logical_offset + count;
-    off_t new_cur_physical_offset =
-        offset_translator_->LogicalToPhysical(new_cur_logical_offset);
-    off_t offset = enc_untrusted_lseek(fd, new_cur_physical_offset, SEEK_SET);
-    if (offset == -1) {
-      LOG(ERROR)
-          << "Failed lseek to the last block offset when reading file data.";
-      return -1;
-    }
+  if (!StoreLogicalOffset(fd, *file_ctrl, logical_offset + count)) {
+    return -1;
   }
 
   for (int64_t idx = 0; idx < tags.size(); idx++) {
@@ -836,15 +1285,40 @@ ssize_t AeadHandler::EncryptAndPersist(int fd, const void *buf, size_t count) {
     if (block_index < eof_block_index) {
       VLOG(2) << "Updating auth tag on AD: "
               << absl::BytesToHexString(tag_string);
-      file_ctrl->ad->UpdateLeaf(block_index + 1, tag_string);
+      if (!file_ctrl->ad->UpdateLeaf(block_index + 1, tag_string)) {
+        LOG(ERROR) << "Integrity verification failed, fd = " << fd;
+        return -1;
+      }
     } else {
       VLOG(2) << "Appending auth tag to AD: "
               << absl::BytesToHexString(tag_string);
-      file_ctrl->ad->AddLeaf(tag_string);
+      if (file_ctrl->ad->AddLeaf(tag_string) == 0) {
+        LOG(ERROR) << "Integrity verification failed, fd = " << fd;
+        return -1;
+      }
+    }
+  }
+
+  // Keep the partial blocks just written in the block cache, since adjacent
+  // writes are likely to modify them again. Drop the stale plaintext of the
+  // full blocks that were overwritten.
+  const int64_t first_written_block = first_logical_block_offset / block_length;
+  for (int64_t idx = 0; idx < blocks_to_write; idx++) {
+    if (idx == 0 && first_partial_block_bytes_count > 0) {
+      file_ctrl->block_cache.Insert(first_written_block, first_block.data(),
+                                    block_length);
+    } else if (idx == blocks_to_write - 1 &&
+               last_partial_block_bytes_count > 0) {
+      file_ctrl->block_cache.Insert(first_written_block + idx,
+                                    last_block.data(), block_length);
+    } else {
+      file_ctrl->block_cache.Erase(first_written_block + idx);
     }
   }
 
-  file_ctrl->logical_size = logical_offset + count;
+  // A write inside the file does not shrink it.
+  file_ctrl->logical_size =
+      std::max<size_t>(file_ctrl->logical_size, logical_offset + count);
 
   if (!UpdateDigest(file_ctrl.get(), *cryptor)) {
     return -1;
@@ -921,6 +1395,14 @@ int AeadHandler::SetMasterKey(int fd, const uint8_t *key_data,
     return 0;
   }
 
+  // The layout of an existing file is only known once its header is read, so
+  // keep the logical cursor offset of |fd| across a change of layout.
+  off_t logical_offset;
+  if (!RetrieveLogicalOffset(fd, *file_ctrl, &logical_offset)) {
+    return -1;
+  }
+  const OffsetTranslator *offset_translator = file_ctrl->offset_translator;
+
   file_ctrl->master_key =
       absl::make_unique<GcmCryptorKey>(key_data, key_length);
   if (!Deserialize(file_ctrl.get())) {
@@ -929,12 +1411,61 @@ int AeadHandler::SetMasterKey(int fd, const uint8_t *key_data,
     return -1;
   }
 
+  if (file_ctrl->offset_translator != offset_translator &&
+      !StoreLogicalOffset(fd, *file_ctrl, logical_offset)) {
+    return -1;
+  }
+
   file_ctrl->is_deserialized = true;
   return 0;
 }
 
-const OffsetTranslator &AeadHandler::GetOffsetTranslator() const {
-  return *offset_translator_;
+int AeadHandler::SetBlockLength(int fd, size_t block_length) {
+  if (!IsBlockLengthValid(block_length)) {
+    LOG(ERROR) << "Attempt made to set an unsupported block length: "
+               << block_length;
+    errno = EINVAL;
+    return -1;
+  }
+
+  std::shared_ptr<FileControl> file_ctrl;
+  {
+    absl::MutexLock global_lock(&mu_);
+
+    auto entry = fmap_.find(fd);
+    if (entry == fmap_.end()) {
+      LOG(ERROR) << "Attempt made to set block length on an unopened file, fd="
+                 << fd;
+      errno = ENOENT;
+      return -1;
+    }
+
+    file_ctrl = entry->second;
+  }
+
+  absl::MutexLock lock(&file_ctrl->mu);
+
+  // The block length of a file is fixed once its header has been written.
+  if (!file_ctrl->is_new || file_ctrl->is_deserialized) {
+    LOG(ERROR) << "Attempt made to set block length on an existing file, fd = "
+               << fd;
+    errno = EPERM;
+    return -1;
+  }
+
+  SetFileBlockLength(file_ctrl.get(), block_length);
+  return 0;
+}
+
+const OffsetTranslator &AeadHandler::GetOffsetTranslator(int fd) {
+  absl::MutexLock global_lock(&mu_);
+  auto entry = fmap_.find(fd);
+  if (entry == fmap_.end()) {
+    return *offset_translators_[BlockLengthIndex(kDefaultBlockLength)];
+  }
+
+  absl::MutexLock lock(&entry->second->mu);
+  return *entry->second->offset_translator;
 }
 
 off_t AeadHandler::GetLogicalFileSize(int fd) {
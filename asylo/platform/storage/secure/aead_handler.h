@@ -24,14 +24,18 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/synchronization/mutex.h"
 #include "asylo/crypto/util/bytes.h"
 #include "asylo/platform/crypto/gcmlib/gcm_cryptor.h"
-#include "asylo/platform/storage/secure/authenticated_dictionary.h"
-#include "asylo/platform/storage/secure/ctmmt_authenticated_dictionary.h"
+#include "asylo/platform/host_call/trusted/host_calls.h"
+#include "asylo/platform/storage/secure/merkle_tree_authenticated_dictionary.h"
+#include "asylo/platform/storage/utils/block_cache.h"
+#include "asylo/platform/storage/utils/fd_closer.h"
 #include "asylo/platform/storage/utils/offset_translator.h"
+#include "asylo/platform/system_call/system_call.h"
 
 namespace asylo {
 namespace platform {
@@ -43,9 +47,35 @@ using crypto::gcmlib::kKeyLength;
 using crypto::gcmlib::kTagLength;
 using crypto::gcmlib::kTokenLength;
 
-// Length of file blocks to encrypt/decrypt.
-constexpr size_t kBlockLength = 128;
-using Block = UnsafeBytes<kBlockLength>;
+// Range of lengths of file blocks to encrypt/decrypt. The block length of a
+// file is a power of two in this range, chosen when the file is created and
+// recorded in the file header.
+constexpr size_t kMinBlockLength = 4 * 1024;
+constexpr size_t kMaxBlockLength = 64 * 1024;
+
+// Block length of files created without choosing one with SetBlockLength.
+constexpr size_t kDefaultBlockLength = kMinBlockLength;
+
+// Identifies a versioned secure file header ("ASYLO_SF" in little-endian byte
+// order).
+constexpr uint64_t kFileMagic = 0x46535f4f4c595341;
+
+// Version of the layout of secure files written by this implementation.
+constexpr uint32_t kFileFormatVersion = 1;
+
+// Version assigned to files written before the file header was versioned. Such
+// files have a header holding only the file hash and the file size, and blocks
+// of kLegacyBlockLength bytes. They can be read, but not written.
+constexpr uint32_t kLegacyFileFormatVersion = 0;
+constexpr size_t kLegacyBlockLength = 128;
+
+// Maximum length of the decrypted blocks of a file cached in the enclave.
+constexpr size_t kBlockCacheCapacity = 256 * 1024;
+
+// Suffix appended to the path of a secure file to name its Merkle tree sidecar.
+// The sidecar holds the nodes of the Merkle tree of the file, so that opening
+// the file does not need to read the tag of every block.
+constexpr char kSidecarSuffix[] = ".mtree";
 
 // Length of the file digest (of the AD root).
 constexpr int64_t kRootHashLength = 32;
@@ -56,8 +86,7 @@ constexpr int64_t kFileHashLength = 16;
 // Constants for the secure block structure - the secure block consists of
 // the ciphertext of the same length as the original plaintext, followed by the
 // integrity tag, followed by the encryption token.
-constexpr size_t kCipherBlockLength = kBlockLength + kTagLength;
-constexpr size_t kSecureBlockLength = kCipherBlockLength + kTokenLength;
+constexpr size_t kBlockMetadataLength = kTagLength + kTokenLength;
 
 using FileHash = UnsafeBytes<kFileHashLength>;
 using FileDigest = UnsafeBytes<kRootHashLength>;
@@ -103,14 +132,41 @@ class AeadHandler {
   int SetMasterKey(int fd, const uint8_t *key_data, uint32_t key_length)
       ABSL_LOCKS_EXCLUDED(mu_);
 
+  // Sets the block length of a newly created file. Must be called before the
+  // master key is set. |block_length| must be a power of two between
+  // kMinBlockLength and kMaxBlockLength. Returns 0 on success, or -1 on
+  // failure.
+  int SetBlockLength(int fd, size_t block_length) ABSL_LOCKS_EXCLUDED(mu_);
+
   // Returns the logical file size, or -1 on failure.
   off_t GetLogicalFileSize(int fd) ABSL_LOCKS_EXCLUDED(mu_);
 
-  const OffsetTranslator &GetOffsetTranslator() const;
+  // Returns the offset translator for the layout of the file opened as |fd|.
+  // Files whose block length is not known yet, including files not yet
+  // initialized, are translated assuming kDefaultBlockLength. The cursor of a
+  // file descriptor is carried over to the layout of the file once its header
+  // is read.
+  const OffsetTranslator &GetOffsetTranslator(int fd) ABSL_LOCKS_EXCLUDED(mu_);
+
+  // Returns the path of the Merkle tree sidecar of the secure file at |path|.
+  static std::string SidecarPath(const std::string &path) {
+    return path + kSidecarSuffix;
+  }
+
+  // Returns true if the file at |path| starts with a versioned secure file
+  // header. Only such files have a Merkle tree sidecar.
+  static bool IsVersionedSecureFile(const char *path);
 
  private:
   // Structure represents the file header layout.
   struct FileHeader {
+    // Identifies a versioned header - always kFileMagic.
+    uint64_t magic;
+
+    // Version of the file layout - is incorporated into DataDigest and is
+    // protected by FileHash.
+    uint32_t version;
+
     // Hash of the DataDigest.
     FileHash file_hash;
 
@@ -118,7 +174,25 @@ class AeadHandler {
     // FileHash.
     size_t file_size;
 
+    // Length of the file blocks - is incorporated into DataDigest and is
+    // protected by FileHash.
+    uint32_t block_length;
+
     // Returns the address of the FileHeader instance.
+    uint8_t *data() { return reinterpret_cast<uint8_t *>(&magic); }
+  } ABSL_ATTRIBUTE_PACKED;
+
+  // Structure represents the file header layout of files of version
+  // kLegacyFileFormatVersion.
+  struct LegacyFileHeader {
+    // Hash of the LegacyDataDigest.
+    FileHash file_hash;
+
+    // Logical file size - is incorporated into LegacyDataDigest and is
+    // protected by FileHash.
+    size_t file_size;
+
+    // Returns the address of the LegacyFileHeader instance.
     uint8_t *data() { return file_hash.data(); }
   } ABSL_ATTRIBUTE_PACKED;
 
@@ -128,32 +202,80 @@ class AeadHandler {
     // AD digest of the file data.
     FileDigest file_digest;
 
+    // Version of the file layout.
+    uint32_t version;
+
     // Logical file size.
     size_t file_size;
 
+    // Length of the file blocks.
+    uint32_t block_length;
+
     // Returns the address of the DataDigest instance.
     uint8_t *data() { return file_digest.data(); }
   } ABSL_ATTRIBUTE_PACKED;
 
+  // Structure represents the file data digest of files of version
+  // kLegacyFileFormatVersion.
+  struct LegacyDataDigest {
+    // AD digest of the file data.
+    FileDigest file_digest;
+
+    // Logical file size.
+    size_t file_size;
+
+    // Returns the address of the LegacyDataDigest instance.
+    uint8_t *data() { return file_digest.data(); }
+  } ABSL_ATTRIBUTE_PACKED;
+
   // File (data set) control structure for an opened file.
   struct FileControl {
     const std::string path;
     size_t logical_size;
+    size_t block_length;
+    const OffsetTranslator *offset_translator;
+    uint32_t version;
     bool is_new;
     bool is_deserialized;
-    std::unique_ptr<AuthenticatedDictionary> ad;
+    std::unique_ptr<MerkleTreeAuthenticatedDictionary> ad;
     std::string zero_hash;
     std::unique_ptr<GcmCryptorKey> master_key;
 
+    // Host descriptor of the file opened for reading and writing, used for
+    // block reads and header updates made while writing to the file. Opened on
+    // first use and closed with the FileControl instance.
+    FdCloser host_fd;
+
+    // Verified plaintext of recently read or written blocks, keyed on block
+    // index. Serves the read part of read-modify-write of partial blocks.
+    BlockCache block_cache;
+
+    // Host descriptor of the Merkle tree sidecar of the file, opened for
+    // reading and writing when the tree is loaded from it or first saved to it,
+    // and closed with the FileControl instance.
+    FdCloser sidecar_fd;
+
+    // Set when the sidecar cannot be kept up to date, or the file is of the
+    // legacy format and has no sidecar, to stop writing to it.
+    bool sidecar_failed;
+
     // Mutex for protecting FileControl instance.
     absl::Mutex mu;
 
-    FileControl(const char *path_name, bool is_new_file)
+    FileControl(const char *path_name, bool is_new_file,
+                const OffsetTranslator *default_offset_translator)
         : path(path_name),
           logical_size(0),
+          block_length(kDefaultBlockLength),
+          offset_translator(default_offset_translator),
+          version(kFileFormatVersion),
           is_new(is_new_file),
           is_deserialized(false),
-          ad(absl::make_unique<CTMMTAuthenticatedDictionary>()) {
+          ad(absl::make_unique<MerkleTreeAuthenticatedDictionary>()),
+          host_fd(-1, &enc_untrusted_close),
+          block_cache(kBlockCacheCapacity),
+          sidecar_fd(-1, &enc_untrusted_close),
+          sidecar_failed(false) {
       UnsafeBytes<kTagLength> tag;
       memset(tag.data(), 0, kTagLength);
       std::string tag_string(reinterpret_cast<char *>(tag.data()), kTagLength);
@@ -164,7 +286,21 @@ class AeadHandler {
     // metadata is placed after the block data, hence, only full blocks are
     // written - there are no partial blocks.
     size_t physical_size() {
-      return sizeof(FileHeader) + ad->LeafCount() * kSecureBlockLength;
+      return header_length() + ad->LeafCount() * secure_block_length();
+    }
+
+    // Length of the file header.
+    size_t header_length() const {
+      return version == kLegacyFileFormatVersion ? sizeof(LegacyFileHeader)
+                                                 : sizeof(FileHeader);
+    }
+
+    // Path of the Merkle tree sidecar of the file.
+    std::string sidecar_path() const { return SidecarPath(path); }
+
+    // Length of a block together with its metadata.
+    size_t secure_block_length() const {
+      return block_length + kBlockMetadataLength;
     }
   };
 
@@ -178,9 +314,85 @@ class AeadHandler {
 
   // Retrieves logical cursor offset associated with a file descriptor |fd|.
   // Returns false on failure.
-  bool RetrieveLogicalOffset(int fd, off_t *logical_offset) const;
+  bool RetrieveLogicalOffset(int fd, const FileControl &file_ctrl,
+                             off_t *logical_offset) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Moves the cursor associated with a file descriptor |fd| to
+  // |logical_offset|. Returns false on failure.
+  bool StoreLogicalOffset(int fd, const FileControl &file_ctrl,
+                          off_t logical_offset) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+
+  // Sets the block length of a file, and the offset translator for its layout.
+  void SetFileBlockLength(FileControl *file_ctrl, size_t block_length) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Sets the layout of a file to the layout of version
+  // kLegacyFileFormatVersion.
+  void SetLegacyLayout(FileControl *file_ctrl) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Reads the header of the file at |path| opened as |fd| into |header|. The
+  // header of a file of version kLegacyFileFormatVersion is returned with its
+  // version and block length filled in. Returns false on failure.
+  bool ReadFileHeader(int fd, const std::string &path,
+                      FileHeader *header) const;
+
+  // Returns the host descriptor of the file opened for reading and writing,
+  // opening it if needed, or -1 on failure.
+  int GetHostFd(FileControl *file_ctrl) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
 
-  // Updates digest of the file data in the secure file header.
+  // A write of a run of Merkle tree nodes to the sidecar of a file.
+  struct SidecarWrite {
+    // Index of the write in the system call batch.
+    size_t call_index;
+
+    // Offset of the run in the sidecar.
+    off_t offset;
+
+    // Hashes of the nodes in the run.
+    std::vector<uint8_t> data;
+  };
+
+  // Returns true if |root| is the root of the file authenticated by |header|.
+  bool IsRootValid(const std::string &root, const FileHeader &header,
+                   const GcmCryptor &cryptor) const;
+
+  // Loads the Merkle tree of a file from its sidecar, if the size of the
+  // sidecar matches the file size in |header| and the root of the sidecar is
+  // the root authenticated by |header|. The other nodes are read from the
+  // sidecar and verified lazily, on first access. Returns false if the tree
+  // cannot be loaded, in which case it has to be rebuilt from the block tags.
+  bool LoadMerkleTree(FileControl *file_ctrl, const FileHeader &header,
+                      const GcmCryptor &cryptor) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Returns the host descriptor of the Merkle tree sidecar of the file opened
+  // for reading and writing, opening or creating it if needed, or -1 on
+  // failure.
+  int GetSidecarFd(FileControl *file_ctrl) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Adds writes of the Merkle tree nodes modified since the sidecar of a file
+  // was last updated to |batch|, one for each run of consecutive nodes, with
+  // the run holding the root last. The written data is held in |writes|.
+  void AddSidecarWrites(FileControl *file_ctrl,
+                        system_call::SystemCallBatch *batch,
+                        std::vector<SidecarWrite> *writes) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Checks the results of the |writes| submitted in |batch|, completing any
+  // short writes. If any of them failed, truncates the sidecar so that it does
+  // not verify, and stops updating it.
+  void CompleteSidecarWrites(FileControl *file_ctrl,
+                             const system_call::SystemCallBatch &batch,
+                             const std::vector<SidecarWrite> &writes) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
+
+  // Updates digest of the file data in the secure file header, together with
+  // the Merkle tree sidecar.
   bool UpdateDigest(FileControl *file_ctrl, const GcmCryptor &cryptor) const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
 
@@ -190,18 +402,21 @@ class AeadHandler {
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
 
   // Similar to DecryptAndVerify, but is called by internal implementation, and
-  // as such does not take a file lock. The cursor associated with the file
-  // descriptor |fd| is expected to be at the position of |logical_offset|.
+  // as such does not take a file lock. Reads the data at |logical_offset| with
+  // a single positional read, and does not move the cursor associated with the
+  // file descriptor |fd|.
   ssize_t DecryptAndVerifyInternal(int fd, void *buf, size_t count,
                                    const FileControl &file_ctrl,
                                    off_t logical_offset) const
       ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
 
-  // Reads a single full block of a file at a specified logical offset. Returns
-  // false on failure.
-  bool ReadFullBlock(const FileControl &file_ctrl, off_t logical_offset,
-                     Block *block) const
-      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl.mu);
+  // Reads a single full block of a file at a specified logical offset into
+  // |block|, which must hold the block length of the file. Serves the block
+  // from the block cache of the file if possible, and caches it otherwise.
+  // Returns false on failure.
+  bool ReadFullBlock(FileControl *file_ctrl, off_t logical_offset,
+                     uint8_t *block) const
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(file_ctrl->mu);
 
   // Map of file (data set) controls for opened files keyed on int identity of
   // files. Avoid using absl based containers which may perform system calls, as
@@ -217,8 +432,13 @@ class AeadHandler {
   std::unordered_map<std::string, std::shared_ptr<FileControl>> opened_files_
       ABSL_GUARDED_BY(mu_);
 
-  // An instance that performs operations on untrusted file offset.
-  std::unique_ptr<OffsetTranslator> offset_translator_;
+  // Instances that perform operations on untrusted file offset, one for each
+  // supported block length, from kMinBlockLength up.
+  std::vector<std::unique_ptr<OffsetTranslator>> offset_translators_;
+
+  // Instance that performs operations on untrusted file offset in files of
+  // version kLegacyFileFormatVersion.
+  std::unique_ptr<OffsetTranslator> legacy_offset_translator_;
 
   // Mutex for protecting map members of the class.
   absl::Mutex mu_;
@@ -24,6 +24,10 @@
 // IO syscall interface constants.
 #include <fcntl.h>
 #include <stdarg.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <string>
 
 #include "asylo/util/logging.h"
 #include "asylo/platform/host_call/trusted/host_calls.h"
@@ -34,6 +38,35 @@
 namespace asylo {
 namespace platform {
 namespace storage {
+namespace {
+
+// Removes the Merkle tree sidecar at |sidecar_path| if there is one, preserving
+// errno. A missing sidecar only means that the Merkle tree of the file is
+// rebuilt from the block tags on the next open.
+void RemoveSidecar(const std::string &sidecar_path) {
+  int saved_errno = errno;
+  if (enc_untrusted_unlink(sidecar_path.c_str()) != 0 && errno != ENOENT) {
+    LOG(WARNING) << "Failed to remove Merkle tree sidecar, path="
+                 << sidecar_path << ", errno = " << errno;
+  }
+  errno = saved_errno;
+}
+
+// Returns true if there is a Merkle tree sidecar for |pathname| and
+// |pathname| is a secure file, so that the sidecar belongs to it. Checking for
+// the sidecar first keeps the cost for other files to a single host call.
+// Preserves errno.
+bool HasSidecar(const char *pathname) {
+  int saved_errno = errno;
+  bool has_sidecar =
+      enc_untrusted_access(AeadHandler::SidecarPath(pathname).c_str(), F_OK) ==
+          0 &&
+      AeadHandler::IsVersionedSecureFile(pathname);
+  errno = saved_errno;
+  return has_sidecar;
+}
+
+}  // namespace
 
 int secure_open(const char *pathname, int flags, ...) {
   if ((flags & O_APPEND) || (flags & O_TRUNC)) {
@@ -62,15 +95,17 @@ int secure_open(const char *pathname, int flags, ...) {
 
   FdCloser fd_closer(fd, &enc_untrusted_close);
 
-  // Set cursor to the logical offset of 0.
-  if (secure_lseek(fd, 0, SEEK_SET) == -1) {
-    LOG(ERROR) << "Failed to initialize cursor to the logical offset of 0, fd="
-               << fd;
+  if (!AeadHandler::GetInstance().InitializeFile(fd, pathname, is_new_file)) {
+    LOG(ERROR) << "Failed to initialize secure handling of file: " << pathname;
     return -1;
   }
 
-  if (!AeadHandler::GetInstance().InitializeFile(fd, pathname, is_new_file)) {
-    LOG(ERROR) << "Failed to initialize secure handling of file: " << pathname;
+  // Set cursor to the logical offset of 0, in the layout of the file if it is
+  // already open.
+  if (secure_lseek(fd, 0, SEEK_SET) == -1) {
+    LOG(ERROR) << "Failed to initialize cursor to the logical offset of 0, fd="
+               << fd;
+    AeadHandler::GetInstance().FinalizeFile(fd);
     return -1;
   }
 
@@ -97,7 +132,7 @@ off_t secure_lseek(int fd, off_t offset, int whence) {
   }
 
   const OffsetTranslator &offset_translator =
-      AeadHandler::GetInstance().GetOffsetTranslator();
+      AeadHandler::GetInstance().GetOffsetTranslator(fd);
 
   // The net logical offset to which lseek has been requested.
   off_t logical_offset;
@@ -143,6 +178,42 @@ int secure_fstat(int fd, struct stat *st) {
   return ret;
 }
 
+int secure_unlink(const char *pathname) {
+  bool has_sidecar = HasSidecar(pathname);
+  if (enc_untrusted_unlink(pathname) != 0) {
+    return -1;
+  }
+  if (has_sidecar) {
+    RemoveSidecar(AeadHandler::SidecarPath(pathname));
+  }
+  return 0;
+}
+
+int secure_rename(const char *oldpath, const char *newpath) {
+  bool old_has_sidecar = HasSidecar(oldpath);
+  bool new_has_sidecar = HasSidecar(newpath);
+  if (enc_untrusted_rename(oldpath, newpath) != 0) {
+    return -1;
+  }
+
+  const std::string old_sidecar_path = AeadHandler::SidecarPath(oldpath);
+  const std::string new_sidecar_path = AeadHandler::SidecarPath(newpath);
+  int saved_errno = errno;
+  if (!old_has_sidecar || enc_untrusted_rename(old_sidecar_path.c_str(),
+                                               new_sidecar_path.c_str()) != 0) {
+    // The renamed file has no sidecar to take along, so it must not keep the
+    // sidecar of the secure file it replaced.
+    if (new_has_sidecar) {
+      RemoveSidecar(new_sidecar_path);
+    }
+    if (old_has_sidecar) {
+      RemoveSidecar(old_sidecar_path);
+    }
+  }
+  errno = saved_errno;
+  return 0;
+}
+
 }  // namespace storage
 }  // namespace platform
 }  // namespace asylo
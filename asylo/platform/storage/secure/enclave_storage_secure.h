@@ -50,6 +50,18 @@ off_t secure_lseek(int fd, off_t offset, int whence);
 // |st->st_size| will be set to logical file size on success.
 int secure_fstat(int fd, struct stat* st);
 
+// Removes the file at |pathname|, together with its Merkle tree sidecar if it
+// is a secure file. Other files are removed as by unlink(), leaving any file
+// named like a sidecar in place.
+int secure_unlink(const char *pathname);
+
+// Renames the file at |oldpath| to |newpath|, together with its Merkle tree
+// sidecar if it is a secure file. The sidecar of a secure file replaced by the
+// rename is removed, so that it is never taken for the sidecar of the renamed
+// file. Files named like a sidecar of a file which is not a secure file are
+// left in place.
+int secure_rename(const char *oldpath, const char *newpath);
+
 }  // namespace storage
 }  // namespace platform
 }  // namespace asylo
@@ -24,6 +24,12 @@
 #include <fcntl.h>
 #include <openssl/rand.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/base/macros.h"
@@ -42,16 +48,25 @@
 namespace asylo {
 namespace {
 
+using platform::crypto::gcmlib::GcmCryptor;
+using platform::crypto::gcmlib::GcmCryptorKey;
 using platform::crypto::gcmlib::kKeyLength;
 using platform::storage::AeadHandler;
-using platform::storage::kBlockLength;
-using platform::storage::kCipherBlockLength;
+using platform::storage::kBlockMetadataLength;
+using platform::storage::kDefaultBlockLength;
 using platform::storage::kFileHashLength;
+using platform::storage::kLegacyBlockLength;
+using platform::storage::kMaxBlockLength;
+using platform::storage::kMinBlockLength;
+using platform::storage::kTagLength;
+using platform::storage::MerkleTreeAuthenticatedDictionary;
 using platform::storage::secure_close;
 using platform::storage::secure_fstat;
 using platform::storage::secure_lseek;
 using platform::storage::secure_open;
 using platform::storage::secure_read;
+using platform::storage::secure_rename;
+using platform::storage::secure_unlink;
 using platform::storage::secure_write;
 using ::testing::Not;
 
@@ -66,7 +81,9 @@ class EnclaveStorageSecureTest : public ::testing::Test,
   Status OpenWriteClose(off_t offset);
   Status OpenReadVerifyClose(off_t offset, size_t bytes_expected);
 
-  const int64_t kFileHeaderLength = kFileHashLength + sizeof(size_t);
+  const int64_t kFileHeaderLength = sizeof(uint64_t) + sizeof(uint32_t) +
+                                    kFileHashLength + sizeof(size_t) +
+                                    sizeof(uint32_t);
   const std::string &GetPath() const { return path_; }
   const void *GetWriteBuffer() const {
     return reinterpret_cast<const void *>(write_buffer_);
@@ -79,6 +96,9 @@ class EnclaveStorageSecureTest : public ::testing::Test,
     return AeadHandler::GetInstance().SetMasterKey(fd, key_.data(),
                                                    key_.size());
   }
+  int EmulateSetBlockLengthIoctl(int fd, size_t block_length) const {
+    return AeadHandler::GetInstance().SetBlockLength(fd, block_length);
+  }
 
   size_t test_buf_len_;
   std::string path_;
@@ -101,6 +121,7 @@ void EnclaveStorageSecureTest::PrepareTest() {
   // occasionally the test is executed on the same (virtual) machine.
   LOG(INFO) << "Cleaning up test file if present, path = " << path_;
   remove(path_.c_str());
+  remove(AeadHandler::SidecarPath(path_).c_str());
 
   // Generate the test key.
   key_.resize(kKeyLength);
@@ -439,7 +460,7 @@ TEST_P(EnclaveStorageSecureTest, ModificationWriteSuccessTest) {
   EXPECT_THAT(OpenWriteClose(0), IsOk());
   EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
 
-  if (test_buf_len_ / kBlockLength != 1) {
+  if (test_buf_len_ / kDefaultBlockLength != 1) {
     // Test mixed update-append write: lseek to the middle of written range -
     // the next write will include both updated and appended file data.
     off_t offset = test_buf_len_ / 2;
@@ -470,15 +491,15 @@ TEST_P(EnclaveStorageSecureTest, ModificationWriteSuccessTest) {
 
 TEST_P(EnclaveStorageSecureTest, SimpleMisalignedWriteSuccess) {
   EXPECT_THAT(OpenWriteClose(0), IsOk());
-  // Lseek to the middle of the last block.
-  off_t offset = test_buf_len_ - kBlockLength / 2;
+  // Lseek to the middle of the written data in the last block.
+  off_t offset = test_buf_len_ / 2;
   EXPECT_THAT(OpenWriteClose(offset), IsOk());
 }
 
 TEST_P(EnclaveStorageSecureTest, SimpleMisalignedReadSuccess) {
   EXPECT_THAT(OpenWriteClose(0), IsOk());
-  // Lseek to the middle of the first block.
-  off_t offset = kBlockLength / 2;
+  // Lseek to the middle of the written data in the first block.
+  off_t offset = test_buf_len_ / 2;
   EXPECT_THAT(OpenReadVerifyClose(offset, test_buf_len_ - offset), IsOk());
 }
 
@@ -503,6 +524,196 @@ TEST_P(EnclaveStorageSecureTest, LseekEndSuccess) {
   EXPECT_EQ(secure_close(fd), 0);
 }
 
+TEST_P(EnclaveStorageSecureTest, CustomBlockLengthSuccess) {
+  for (size_t block_length : {kMinBlockLength, 4 * kMinBlockLength,
+                              kMaxBlockLength}) {
+    PrepareTest();
+
+    // Write enough data to span more than two blocks.
+    const size_t chunks_count = 2 * block_length / test_buf_len_ + 1;
+    int fd = secure_open(GetPath().c_str(), O_RDWR | O_CREAT,
+                         S_IRWXU | S_IRWXG | S_IRWXO);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(EmulateSetBlockLengthIoctl(fd, block_length), 0);
+    ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+    std::vector<uint8_t> expected;
+    for (size_t chunk = 0; chunk < chunks_count; chunk++) {
+      ASSERT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_),
+                test_buf_len_);
+      expected.insert(expected.end(), write_buffer_,
+                      write_buffer_ + test_buf_len_);
+    }
+    EXPECT_EQ(secure_close(fd), 0);
+
+    // The file holds the header followed by whole blocks of the chosen length.
+    fd = enc_untrusted_open(GetPath().c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    const size_t blocks_count =
+        (expected.size() + block_length - 1) / block_length;
+    EXPECT_EQ(enc_untrusted_lseek(fd, 0, SEEK_END),
+              kFileHeaderLength +
+                  blocks_count * (block_length + kBlockMetadataLength));
+    EXPECT_EQ(enc_untrusted_close(fd), 0);
+
+    // Reopen, and read the data back across block boundaries.
+    fd = secure_open(GetPath().c_str(), O_RDONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+    std::vector<uint8_t> actual(expected.size());
+    EXPECT_EQ(secure_read(fd, actual.data(), actual.size()), actual.size());
+    EXPECT_EQ(actual, expected);
+
+    const off_t offset = block_length - test_buf_len_ / 2;
+    EXPECT_EQ(secure_lseek(fd, offset, SEEK_SET), offset);
+    EXPECT_EQ(secure_read(fd, GetReadBuffer(), test_buf_len_), test_buf_len_);
+    EXPECT_EQ(memcmp(GetReadBuffer(), expected.data() + offset, test_buf_len_),
+              0);
+    EXPECT_EQ(secure_close(fd), 0);
+  }
+}
+
+TEST_P(EnclaveStorageSecureTest, UnlinkRemovesSidecar) {
+  EXPECT_THAT(OpenWriteClose(0), IsOk());
+  const std::string sidecar_path = AeadHandler::SidecarPath(GetPath());
+  ASSERT_EQ(enc_untrusted_access(sidecar_path.c_str(), F_OK), 0);
+
+  EXPECT_EQ(secure_unlink(GetPath().c_str()), 0);
+  EXPECT_EQ(enc_untrusted_access(GetPath().c_str(), F_OK), -1);
+  EXPECT_EQ(enc_untrusted_access(sidecar_path.c_str(), F_OK), -1);
+}
+
+TEST_P(EnclaveStorageSecureTest, RenameMovesSidecar) {
+  const std::string old_path = GetPath();
+  const std::string new_path = absl::StrCat(old_path, ".renamed");
+  remove(new_path.c_str());
+  remove(AeadHandler::SidecarPath(new_path).c_str());
+
+  // Write a different secure file at the destination, whose sidecar must not
+  // survive the rename.
+  path_ = new_path;
+  ASSERT_THAT(OpenWriteClose(test_buf_len_), IsOk());
+  path_ = old_path;
+  ASSERT_THAT(OpenWriteClose(0), IsOk());
+
+  EXPECT_EQ(secure_rename(old_path.c_str(), new_path.c_str()), 0);
+  EXPECT_EQ(
+      enc_untrusted_access(AeadHandler::SidecarPath(old_path).c_str(), F_OK),
+      -1);
+  EXPECT_EQ(
+      enc_untrusted_access(AeadHandler::SidecarPath(new_path).c_str(), F_OK),
+      0);
+
+  // The renamed file reads back through its own sidecar.
+  path_ = new_path;
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+  EXPECT_EQ(secure_unlink(new_path.c_str()), 0);
+}
+
+// Creates a plain file at |path| holding |contents|.
+void WritePlainFile(const std::string &path, const std::string &contents) {
+  int fd = enc_untrusted_open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+                              S_IRUSR | S_IWUSR);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(enc_untrusted_write(fd, contents.data(), contents.size()),
+            contents.size());
+  ASSERT_EQ(enc_untrusted_close(fd), 0);
+}
+
+TEST_P(EnclaveStorageSecureTest, UnlinkPlainFileKeepsFileNamedLikeSidecar) {
+  const std::string sidecar_path = AeadHandler::SidecarPath(GetPath());
+  WritePlainFile(GetPath(), "plain file");
+  WritePlainFile(sidecar_path, "unrelated file");
+
+  EXPECT_EQ(secure_unlink(GetPath().c_str()), 0);
+  EXPECT_EQ(enc_untrusted_access(GetPath().c_str(), F_OK), -1);
+  EXPECT_EQ(enc_untrusted_access(sidecar_path.c_str(), F_OK), 0);
+  remove(sidecar_path.c_str());
+}
+
+TEST_P(EnclaveStorageSecureTest, RenamePlainFileKeepsFilesNamedLikeSidecars) {
+  const std::string old_path = GetPath();
+  const std::string new_path = absl::StrCat(old_path, ".renamed");
+  const std::string old_sidecar_path = AeadHandler::SidecarPath(old_path);
+  const std::string new_sidecar_path = AeadHandler::SidecarPath(new_path);
+  WritePlainFile(old_path, "plain file");
+  WritePlainFile(new_path, "replaced plain file");
+  WritePlainFile(new_sidecar_path, "unrelated file");
+
+  EXPECT_EQ(secure_rename(old_path.c_str(), new_path.c_str()), 0);
+  EXPECT_EQ(enc_untrusted_access(old_path.c_str(), F_OK), -1);
+  EXPECT_EQ(enc_untrusted_access(new_path.c_str(), F_OK), 0);
+  EXPECT_EQ(enc_untrusted_access(new_sidecar_path.c_str(), F_OK), 0);
+
+  // A plain file named like the sidecar of a plain file is not moved either.
+  WritePlainFile(old_path, "plain file");
+  WritePlainFile(old_sidecar_path, "another unrelated file");
+  EXPECT_EQ(secure_rename(old_path.c_str(), new_path.c_str()), 0);
+  EXPECT_EQ(enc_untrusted_access(old_sidecar_path.c_str(), F_OK), 0);
+  EXPECT_EQ(enc_untrusted_access(new_sidecar_path.c_str(), F_OK), 0);
+
+  remove(new_path.c_str());
+  remove(old_sidecar_path.c_str());
+  remove(new_sidecar_path.c_str());
+}
+
+TEST_P(EnclaveStorageSecureTest, LegacyFormatReadSuccess) {
+  // Lay out the file as written before the header was versioned: the file hash
+  // and the file size, followed by blocks of kLegacyBlockLength bytes.
+  const size_t file_size = test_buf_len_;
+  const size_t blocks_count =
+      (file_size + kLegacyBlockLength - 1) / kLegacyBlockLength;
+  const size_t secure_block_length = kLegacyBlockLength + kBlockMetadataLength;
+  std::unique_ptr<GcmCryptor> cryptor = GcmCryptor::Create(
+      kLegacyBlockLength, GcmCryptorKey(key_.data(), key_.size()));
+  ASSERT_NE(cryptor, nullptr);
+
+  MerkleTreeAuthenticatedDictionary tree;
+  std::vector<uint8_t> blocks(blocks_count * secure_block_length);
+  for (size_t block = 0; block < blocks_count; block++) {
+    std::vector<uint8_t> plaintext(kLegacyBlockLength, 0);
+    const size_t offset = block * kLegacyBlockLength;
+    memcpy(plaintext.data(), write_buffer_ + offset,
+           std::min(kLegacyBlockLength, file_size - offset));
+    uint8_t *ciphertext = blocks.data() + block * secure_block_length;
+    ASSERT_TRUE(cryptor->EncryptBlock(
+        plaintext.data(), ciphertext + kLegacyBlockLength + kTagLength,
+        ciphertext));
+    tree.AddLeaf(std::string(
+        reinterpret_cast<const char *>(ciphertext + kLegacyBlockLength),
+        kTagLength));
+  }
+
+  // The legacy data digest holds the root of the tree and the file size.
+  std::string digest = tree.CurrentRoot();
+  digest.append(reinterpret_cast<const char *>(&file_size), sizeof(file_size));
+  std::vector<uint8_t> header(kFileHashLength);
+  ASSERT_TRUE(cryptor->GetAuthTag(
+      header.data(), reinterpret_cast<const uint8_t *>(digest.data()),
+      digest.size()));
+  header.insert(header.end(), reinterpret_cast<const uint8_t *>(&file_size),
+                reinterpret_cast<const uint8_t *>(&file_size + 1));
+
+  int fd = enc_untrusted_open(GetPath().c_str(), O_WRONLY | O_CREAT,
+                              S_IRUSR | S_IWUSR);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(enc_untrusted_write(fd, header.data(), header.size()),
+            header.size());
+  EXPECT_EQ(enc_untrusted_write(fd, blocks.data(), blocks.size()),
+            blocks.size());
+  ASSERT_EQ(enc_untrusted_close(fd), 0);
+
+  EXPECT_THAT(OpenReadVerifyClose(0, test_buf_len_), IsOk());
+
+  // Files of the legacy format are read-only.
+  fd = secure_open(GetPath().c_str(), O_RDWR);
+  ASSERT_GE(fd, 0);
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(secure_lseek(fd, 0, SEEK_END), file_size);
+  EXPECT_EQ(secure_write(fd, GetWriteBuffer(), test_buf_len_), -1);
+  EXPECT_EQ(errno, EROFS);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
 //
 // Failure cases.
 //
@@ -540,7 +751,8 @@ TEST_P(EnclaveStorageSecureTest, ReadWriteAuthTagsModified) {
   // Modify an auth tag - form of tampering.
   int fd = enc_untrusted_open(GetPath().c_str(), O_WRONLY);
   ASSERT_GE(fd, 0);
-  EXPECT_GT(enc_untrusted_lseek(fd, kFileHeaderLength + kBlockLength, SEEK_SET),
+  EXPECT_GT(enc_untrusted_lseek(fd, kFileHeaderLength + kDefaultBlockLength,
+                                SEEK_SET),
             0);
   EXPECT_GT(enc_untrusted_write(fd, kTamperData, ABSL_ARRAYSIZE(kTamperData)),
             0);
@@ -556,9 +768,10 @@ TEST_P(EnclaveStorageSecureTest, ReadWriteTokensModified) {
   // Modify a token - form of tampering.
   int fd = enc_untrusted_open(GetPath().c_str(), O_WRONLY);
   ASSERT_GE(fd, 0);
-  EXPECT_GT(
-      enc_untrusted_lseek(fd, kFileHeaderLength + kCipherBlockLength, SEEK_SET),
-      0);
+  EXPECT_GT(enc_untrusted_lseek(
+                fd, kFileHeaderLength + kDefaultBlockLength + kTagLength,
+                SEEK_SET),
+            0);
   EXPECT_GT(enc_untrusted_write(fd, kTamperData, ABSL_ARRAYSIZE(kTamperData)),
             0);
   ASSERT_EQ(enc_untrusted_fsync(fd), 0) << strerror(errno);
@@ -606,6 +819,32 @@ TEST_P(EnclaveStorageSecureTest, RedundantIoctlFailure) {
   EXPECT_EQ(secure_close(fd), 0);
 }
 
+TEST_P(EnclaveStorageSecureTest, SetBlockLengthFailure) {
+  int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
+                       S_IRWXU | S_IRWXG | S_IRWXO);
+  ASSERT_GE(fd, 0);
+
+  // Unsupported block lengths.
+  for (size_t block_length : {kMinBlockLength / 2, 2 * kMaxBlockLength,
+                              kMinBlockLength + 16}) {
+    EXPECT_EQ(EmulateSetBlockLengthIoctl(fd, block_length), -1);
+    EXPECT_EQ(errno, EINVAL);
+  }
+
+  // The block length cannot change once the key is set.
+  ASSERT_EQ(EmulateSetKeyIoctl(fd), 0);
+  EXPECT_EQ(EmulateSetBlockLengthIoctl(fd, kMaxBlockLength), -1);
+  EXPECT_EQ(errno, EPERM);
+  EXPECT_EQ(secure_close(fd), 0);
+
+  // Nor can it change on an existing file.
+  fd = secure_open(GetPath().c_str(), O_WRONLY);
+  ASSERT_GE(fd, 0);
+  EXPECT_EQ(EmulateSetBlockLengthIoctl(fd, kMaxBlockLength), -1);
+  EXPECT_EQ(errno, EPERM);
+  EXPECT_EQ(secure_close(fd), 0);
+}
+
 TEST_P(EnclaveStorageSecureTest, UnknownFdIoctlFailure) {
   // Open for write.
   int fd = secure_open(GetPath().c_str(), O_WRONLY | O_CREAT,
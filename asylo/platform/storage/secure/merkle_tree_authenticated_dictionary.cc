@@ -0,0 +1,406 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/merkle_tree_authenticated_dictionary.h"
+
+#include <openssl/sha.h>
+
+#include <memory>
+#include <utility>
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+// Domain separation prefixes of leaf and interior node hashes (RFC 6962).
+constexpr uint8_t kLeafHashPrefix = 0x00;
+constexpr uint8_t kNodeHashPrefix = 0x01;
+
+static_assert(MerkleTreeAuthenticatedDictionary::kHashLength ==
+                  SHA256_DIGEST_LENGTH,
+              "Merkle tree hashes are SHA-256 digests");
+
+std::string Sha256(const uint8_t *prefix, const std::string &first,
+                   const std::string &second) {
+  SHA256_CTX context;
+  SHA256_Init(&context);
+  if (prefix) {
+    SHA256_Update(&context, prefix, sizeof(*prefix));
+  }
+  SHA256_Update(&context, first.data(), first.size());
+  SHA256_Update(&context, second.data(), second.size());
+  std::string digest(SHA256_DIGEST_LENGTH, '\0');
+  SHA256_Final(reinterpret_cast<uint8_t *>(&digest[0]), &context);
+  return digest;
+}
+
+std::string HashChildren(const std::string &left, const std::string &right) {
+  return Sha256(&kNodeHashPrefix, left, right);
+}
+
+// Returns the number of trailing one bits of |value|.
+size_t CountTrailingOnes(size_t value) {
+  size_t count = 0;
+  while (value & 1) {
+    value >>= 1;
+    count++;
+  }
+  return count;
+}
+
+}  // namespace
+
+constexpr size_t MerkleTreeAuthenticatedDictionary::kHashLength;
+
+MerkleTreeAuthenticatedDictionary::MerkleTreeAuthenticatedDictionary()
+    : corrupted_(false) {}
+
+size_t MerkleTreeAuthenticatedDictionary::SerializedNodeCount(
+    size_t leaf_count) {
+  // A tree with n leaves has n - 1 nodes with two children.
+  return leaf_count == 0 ? 0 : 2 * leaf_count - 1;
+}
+
+size_t MerkleTreeAuthenticatedDictionary::LeafCount() const {
+  return levels_.empty() ? 0 : levels_[0].size();
+}
+
+size_t MerkleTreeAuthenticatedDictionary::AddLeaf(const std::string &data) {
+  return AddLeafHash(LeafHash(data));
+}
+
+size_t MerkleTreeAuthenticatedDictionary::AddLeafHash(const std::string &hash) {
+  if (levels_.empty()) {
+    levels_.emplace_back();
+    verified_.emplace_back();
+    dirty_.emplace_back();
+  } else if (!VerifyPath(levels_[0].size() - 1)) {
+    // The nodes on the right edge of the tree are about to be recomputed from
+    // their children, so they must be verified first.
+    return 0;
+  }
+
+  const size_t index = levels_[0].size();
+  levels_[0].push_back(hash);
+  verified_[0].push_back(true);
+  modified_.insert(Position(0, index));
+
+  // Grow the levels above to cover the new leaf.
+  for (size_t level = 1; levels_[level - 1].size() > 1; level++) {
+    if (level == levels_.size()) {
+      levels_.emplace_back();
+      verified_.emplace_back();
+      dirty_.emplace_back();
+    }
+    if (levels_[level].size() < (levels_[level - 1].size() + 1) / 2) {
+      levels_[level].emplace_back();
+      verified_[level].push_back(true);
+    }
+  }
+  MarkParentDirty(0, index);
+
+  return levels_[0].size();
+}
+
+std::string MerkleTreeAuthenticatedDictionary::CurrentRoot() {
+  if (levels_.empty()) {
+    return Sha256(nullptr, "", "");
+  }
+
+  for (size_t level = 1; level < levels_.size(); level++) {
+    for (size_t index : dirty_[level]) {
+      levels_[level][index] = ComputeNode(level, index);
+      if (HasTwoChildren(level, index)) {
+        modified_.insert(Position(level, index));
+      }
+      MarkParentDirty(level, index);
+    }
+    dirty_[level].clear();
+  }
+
+  return levels_.back()[0];
+}
+
+std::string MerkleTreeAuthenticatedDictionary::LeafHash(size_t leaf) const {
+  if (leaf == 0 || leaf > LeafCount() || !VerifyPath(leaf - 1)) {
+    return "";
+  }
+
+  return levels_[0][leaf - 1];
+}
+
+std::string MerkleTreeAuthenticatedDictionary::LeafHash(
+    const std::string &data) const {
+  return Sha256(&kLeafHashPrefix, data, "");
+}
+
+bool MerkleTreeAuthenticatedDictionary::UpdateLeaf(size_t leaf,
+                                                   const std::string &data) {
+  return UpdateLeafHash(leaf, LeafHash(data));
+}
+
+bool MerkleTreeAuthenticatedDictionary::UpdateLeafHash(
+    size_t leaf, const std::string &hash) {
+  // The siblings on the path to the leaf are used to recompute the path, so
+  // they must be verified first.
+  if (leaf == 0 || leaf > LeafCount() || !VerifyPath(leaf - 1)) {
+    return false;
+  }
+
+  levels_[0][leaf - 1] = hash;
+  modified_.insert(Position(0, leaf - 1));
+  MarkParentDirty(0, leaf - 1);
+  return true;
+}
+
+bool MerkleTreeAuthenticatedDictionary::Load(size_t leaf_count,
+                                             NodeReader reader) {
+  levels_.clear();
+  verified_.clear();
+  dirty_.clear();
+  modified_.clear();
+  corrupted_ = false;
+  reader_ = std::move(reader);
+  if (leaf_count == 0) {
+    return true;
+  }
+
+  levels_.emplace_back(leaf_count);
+  for (size_t level = 1; levels_[level - 1].size() > 1; level++) {
+    levels_.emplace_back((levels_[level - 1].size() + 1) / 2);
+  }
+  for (const auto &level_nodes : levels_) {
+    verified_.emplace_back(level_nodes.size(), false);
+  }
+  dirty_.resize(levels_.size());
+
+  // The root is authenticated by the caller.
+  if (!ReadNodes({{levels_.size() - 1, 0}})) {
+    levels_.clear();
+    verified_.clear();
+    dirty_.clear();
+    return false;
+  }
+  verified_.back()[0] = true;
+  return true;
+}
+
+bool MerkleTreeAuthenticatedDictionary::LoadNodes(size_t leaf_count,
+                                                  const uint8_t *nodes,
+                                                  size_t nodes_length) {
+  if (nodes_length < SerializedNodeCount(leaf_count) * kHashLength) {
+    return false;
+  }
+
+  auto buffer =
+      std::make_shared<std::vector<uint8_t>>(nodes, nodes + nodes_length);
+  return Load(leaf_count, [buffer](const std::vector<size_t> &positions,
+                                   std::vector<std::string> *hashes) {
+    for (size_t position : positions) {
+      hashes->emplace_back(
+          reinterpret_cast<const char *>(buffer->data()) +
+              position * kHashLength,
+          kHashLength);
+    }
+    return true;
+  });
+}
+
+bool MerkleTreeAuthenticatedDictionary::ReadAllNodes() {
+  // Nodes to be recomputed are not in the serialized form yet.
+  CurrentRoot();
+
+  std::vector<std::pair<size_t, size_t>> unread;
+  for (size_t level = 0; level < levels_.size(); level++) {
+    for (size_t index = 0; index < levels_[level].size(); index++) {
+      if (levels_[level][index].empty()) {
+        unread.emplace_back(level, index);
+      }
+    }
+  }
+  if (!ReadNodes(unread)) {
+    return false;
+  }
+
+  reader_ = nullptr;
+  return true;
+}
+
+std::vector<size_t> MerkleTreeAuthenticatedDictionary::ModifiedNodes() {
+  CurrentRoot();
+  return std::vector<size_t>(modified_.begin(), modified_.end());
+}
+
+std::string MerkleTreeAuthenticatedDictionary::NodeHash(
+    size_t position) const {
+  const size_t level = CountTrailingOnes(position);
+  const size_t index = position >> (level + 1);
+  if (level >= levels_.size() || index >= levels_[level].size()) {
+    return "";
+  }
+
+  return levels_[level][index];
+}
+
+void MerkleTreeAuthenticatedDictionary::ClearModifiedNodes() {
+  modified_.clear();
+}
+
+void MerkleTreeAuthenticatedDictionary::MarkAllNodesModified() {
+  for (size_t level = 0; level < levels_.size(); level++) {
+    for (size_t index = 0; index < levels_[level].size(); index++) {
+      if (level == 0 || HasTwoChildren(level, index)) {
+        modified_.insert(Position(level, index));
+      }
+    }
+  }
+}
+
+size_t MerkleTreeAuthenticatedDictionary::Position(size_t level,
+                                                   size_t index) {
+  return (index << (level + 1)) + ((size_t{1} << level) - 1);
+}
+
+bool MerkleTreeAuthenticatedDictionary::HasTwoChildren(size_t level,
+                                                       size_t index) const {
+  return 2 * index + 1 < levels_[level - 1].size();
+}
+
+std::string MerkleTreeAuthenticatedDictionary::ComputeNode(
+    size_t level, size_t index) const {
+  const std::vector<std::string> &children = levels_[level - 1];
+  if (!HasTwoChildren(level, index)) {
+    return children[2 * index];
+  }
+
+  return HashChildren(children[2 * index], children[2 * index + 1]);
+}
+
+void MerkleTreeAuthenticatedDictionary::SerializedNode(size_t *level,
+                                                       size_t *index) const {
+  while (*level > 0 && !HasTwoChildren(*level, *index)) {
+    (*level)--;
+    *index *= 2;
+  }
+}
+
+bool MerkleTreeAuthenticatedDictionary::ReadNodes(
+    const std::vector<std::pair<size_t, size_t>> &level_indices) const {
+  std::vector<std::pair<size_t, size_t>> unread;
+  std::set<size_t> unique_positions;
+  for (const auto &node : level_indices) {
+    if (!levels_[node.first][node.second].empty()) {
+      continue;
+    }
+    unread.push_back(node);
+    size_t level = node.first;
+    size_t index = node.second;
+    SerializedNode(&level, &index);
+    if (levels_[level][index].empty()) {
+      unique_positions.insert(Position(level, index));
+    }
+  }
+  if (unread.empty()) {
+    return true;
+  }
+
+  const std::vector<size_t> positions(unique_positions.begin(),
+                                      unique_positions.end());
+  if (!positions.empty()) {
+    std::vector<std::string> hashes;
+    if (!reader_ || !reader_(positions, &hashes) ||
+        hashes.size() != positions.size()) {
+      return false;
+    }
+    for (size_t idx = 0; idx < positions.size(); idx++) {
+      if (hashes[idx].size() != kHashLength) {
+        return false;
+      }
+      const size_t level = CountTrailingOnes(positions[idx]);
+      levels_[level][positions[idx] >> (level + 1)] = std::move(hashes[idx]);
+    }
+  }
+
+  // A node with a single child is not serialized, and has the hash of the
+  // serialized node below it.
+  for (const auto &node : unread) {
+    size_t level = node.first;
+    size_t index = node.second;
+    SerializedNode(&level, &index);
+    levels_[node.first][node.second] = levels_[level][index];
+  }
+  return true;
+}
+
+void MerkleTreeAuthenticatedDictionary::MarkParentDirty(size_t level,
+                                                        size_t index) {
+  if (level + 1 < levels_.size()) {
+    dirty_[level + 1].insert(index / 2);
+  }
+}
+
+bool MerkleTreeAuthenticatedDictionary::VerifyPath(size_t leaf_index) const {
+  if (corrupted_) {
+    return false;
+  }
+
+  // Read the nodes about to be verified, in a single call to the reader.
+  std::vector<std::pair<size_t, size_t>> unverified;
+  for (size_t level = levels_.size() - 1; level > 0; level--) {
+    const size_t index = leaf_index >> level;
+    const size_t left = 2 * index;
+    if (!verified_[level - 1][left]) {
+      unverified.emplace_back(level - 1, left);
+      if (HasTwoChildren(level, index)) {
+        unverified.emplace_back(level - 1, left + 1);
+      }
+    }
+  }
+  if (!ReadNodes(unverified)) {
+    corrupted_ = true;
+    return false;
+  }
+
+  // Walk down from the root. Each node on the path has been verified by the
+  // previous step, so verifying its children against it extends the verified
+  // part of the tree by one level. Nodes that need to be recomputed always
+  // have verified children, so their stale hashes are never compared.
+  for (size_t level = levels_.size() - 1; level > 0; level--) {
+    const size_t index = leaf_index >> level;
+    const size_t left = 2 * index;
+    if (verified_[level - 1][left]) {
+      continue;
+    }
+
+    if (ComputeNode(level, index) != levels_[level][index]) {
+      corrupted_ = true;
+      return false;
+    }
+    verified_[level - 1][left] = true;
+    if (HasTwoChildren(level, index)) {
+      verified_[level - 1][left + 1] = true;
+    }
+  }
+
+  return true;
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
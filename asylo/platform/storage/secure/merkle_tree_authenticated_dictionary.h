@@ -0,0 +1,179 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_SECURE_MERKLE_TREE_AUTHENTICATED_DICTIONARY_H_
+#define ASYLO_PLATFORM_STORAGE_SECURE_MERKLE_TREE_AUTHENTICATED_DICTIONARY_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "asylo/platform/storage/secure/authenticated_dictionary.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// Authenticated Dictionary implementation backed by a binary Merkle tree with
+// the same leaf, node and root hashes as the Certificate Transparency Merkle
+// tree (RFC 6962). Keeps the hashes of all interior nodes, and on CurrentRoot()
+// recomputes only the nodes on the paths from the leaves modified since the
+// previous call.
+//
+// The nodes of the tree can be serialized to and loaded from untrusted storage.
+// The serialized form holds the hashes of the leaves and of the interior nodes
+// with two children, at fixed positions given by an in-order numbering of the
+// nodes of a complete tree: the node at |level| (0 for leaves) with index
+// |index| in its level is at position (index << (level + 1)) + (1 << level) -
+// 1. A loaded tree reads only its root when it is loaded, and trusts only the
+// root. The other nodes are read the first time a leaf below them is accessed,
+// along the path to that leaf, and verified against the root.
+class MerkleTreeAuthenticatedDictionary : public AuthenticatedDictionary {
+ public:
+  // Length of the hashes of the tree.
+  static constexpr size_t kHashLength = 32;
+
+  MerkleTreeAuthenticatedDictionary();
+
+  // Returns the number of node hashes in the serialized form of a tree with
+  // |leaf_count| leaves.
+  static size_t SerializedNodeCount(size_t leaf_count);
+
+  size_t LeafCount() const final;
+
+  // Returns 0 if the path to the last leaf of a loaded tree fails verification.
+  size_t AddLeaf(const std::string &data) final;
+
+  // Returns 0 if the path to the last leaf of a loaded tree fails verification.
+  size_t AddLeafHash(const std::string &hash) final;
+
+  std::string CurrentRoot() final;
+
+  // Returns an empty string if the path to the leaf fails verification.
+  std::string LeafHash(size_t leaf) const final;
+
+  std::string LeafHash(const std::string &data) const final;
+
+  bool UpdateLeaf(size_t leaf, const std::string &data) final;
+
+  // Updates the |leaf|th leaf in the tree to |hash|. Indexing starts from 1.
+  // Returns false if update fails.
+  bool UpdateLeafHash(size_t leaf, const std::string &hash);
+
+  // Reads the hashes of the nodes at |positions| in the serialized form of a
+  // tree into |hashes|, in the same order. Returns false on failure.
+  using NodeReader = std::function<bool(const std::vector<size_t> &positions,
+                                        std::vector<std::string> *hashes)>;
+
+  // Replaces the tree with a tree of |leaf_count| leaves whose serialized form
+  // is read through |reader|. Only the root is read here, the other nodes are
+  // read on first access. The read nodes are untrusted: the caller must
+  // authenticate CurrentRoot() before using the tree. Returns false if the root
+  // cannot be read. A node that cannot be read later fails verification.
+  bool Load(size_t leaf_count, NodeReader reader);
+
+  // Replaces the tree with a tree of |leaf_count| leaves loaded from the
+  // |nodes_length| bytes at |nodes| holding its serialized form, as Load()
+  // does. Returns false if |nodes| is too short.
+  bool LoadNodes(size_t leaf_count, const uint8_t *nodes, size_t nodes_length);
+
+  // Reads all nodes of a loaded tree not read yet, so that the tree no longer
+  // depends on its serialized form. The nodes are still verified on first
+  // access. Returns false if any node cannot be read.
+  bool ReadAllNodes();
+
+  // Updates the root, and returns the positions in the serialized form of the
+  // nodes modified since the last call to ClearModifiedNodes(), in increasing
+  // order.
+  std::vector<size_t> ModifiedNodes();
+
+  // Returns the hash of the node at |position| in the serialized form, or an
+  // empty string if the tree has no such node.
+  std::string NodeHash(size_t position) const;
+
+  // Forgets the modified nodes, once the caller has persisted them.
+  void ClearModifiedNodes();
+
+  // Marks all nodes of the tree as modified, so that the next call to
+  // ModifiedNodes() returns the complete serialized form. All nodes of a loaded
+  // tree must have been read with ReadAllNodes().
+  void MarkAllNodesModified();
+
+ private:
+  // Returns the position in the serialized form of the node at |level| with
+  // index |index| in its level.
+  static size_t Position(size_t level, size_t index);
+
+  // Returns true if the node at |level| with index |index| has two children.
+  bool HasTwoChildren(size_t level, size_t index) const;
+
+  // Returns the hash of the node at |level| with index |index| computed from
+  // its children.
+  std::string ComputeNode(size_t level, size_t index) const;
+
+  // Marks the parent of the node at |level| with index |index| as needing to
+  // be recomputed.
+  void MarkParentDirty(size_t level, size_t index);
+
+  // Returns the node which holds the hash of the node at |level| with index
+  // |index| in the serialized form, by walking down from a node with a single
+  // child to its descendants. Updates |level| and |index| in place.
+  void SerializedNode(size_t *level, size_t *index) const;
+
+  // Reads the nodes not read yet among the nodes given by their level and
+  // index in |level_indices| through |reader_|. Returns false on failure.
+  bool ReadNodes(
+      const std::vector<std::pair<size_t, size_t>> &level_indices) const;
+
+  // Verifies the nodes on the path from the root to the leaf with 0-based
+  // |leaf_index|, and their siblings, against the root. Returns false if any
+  // of the nodes fails verification, in which case the tree stays unusable.
+  bool VerifyPath(size_t leaf_index) const;
+
+  // Node hashes, by level from the leaves up to the root. A node with a single
+  // child has the hash of its child. Nodes of a loaded tree not read yet are
+  // empty.
+  mutable std::vector<std::vector<std::string>> levels_;
+
+  // Reads nodes of a loaded tree not read yet.
+  NodeReader reader_;
+
+  // Whether each node has been verified against the root, by level.
+  mutable std::vector<std::vector<bool>> verified_;
+
+  // Indices of the nodes that need to be recomputed from their children, by
+  // level.
+  std::vector<std::set<size_t>> dirty_;
+
+  // Positions in the serialized form of the nodes modified since the last
+  // call to ClearModifiedNodes().
+  std::set<size_t> modified_;
+
+  // Set when a loaded node fails verification.
+  mutable bool corrupted_;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_SECURE_MERKLE_TREE_AUTHENTICATED_DICTIONARY_H_
@@ -0,0 +1,249 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/secure/merkle_tree_authenticated_dictionary.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include "absl/strings/escaping.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+// Leaf inputs and the roots of the trees of their prefixes, from the test
+// vectors of the Certificate Transparency Merkle tree.
+constexpr const char *kLeafInputs[] = {
+    "", "00", "10", "2021", "3031", "40414243", "5051525354555657",
+    "606162636465666768696a6b6c6d6e6f"};
+
+constexpr const char *kRoots[] = {
+    "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d",
+    "fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125",
+    "aeb6bcfe274b70a14fb067a5e5578264db0fa9b51af5e0ba159158f329e06e77",
+    "d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7",
+    "4e3bbb1f7b478dcfe71fb631631519a3bca12c9aefca1612bfce4c13a86264d4",
+    "76e67dadbcdf1e10e1b74ddc608abd2f98dfb16fbce75277b5232a127f2087ef",
+    "ddb89be403809e325750d3d263cd78929c2942b7942a34b77e122c9594a74c8c",
+    "5dc9da79a70659a9ad559cb701ded9a2ab9d823aad2f4960cfe370eff4604328"};
+
+constexpr size_t kLeafCount = sizeof(kLeafInputs) / sizeof(kLeafInputs[0]);
+
+std::string Leaf(size_t index) {
+  return absl::HexStringToBytes(kLeafInputs[index]);
+}
+
+// Returns the serialized form of all nodes of |tree|.
+std::vector<uint8_t> Serialize(MerkleTreeAuthenticatedDictionary *tree) {
+  tree->MarkAllNodesModified();
+  std::vector<uint8_t> nodes(
+      MerkleTreeAuthenticatedDictionary::SerializedNodeCount(
+          tree->LeafCount()) *
+      MerkleTreeAuthenticatedDictionary::kHashLength);
+  for (size_t position : tree->ModifiedNodes()) {
+    std::string hash = tree->NodeHash(position);
+    std::copy(hash.begin(), hash.end(),
+              nodes.begin() +
+                  position * MerkleTreeAuthenticatedDictionary::kHashLength);
+  }
+  tree->ClearModifiedNodes();
+  return nodes;
+}
+
+TEST(MerkleTreeAuthenticatedDictionaryTest, EmptyRoot) {
+  MerkleTreeAuthenticatedDictionary tree;
+  EXPECT_EQ(tree.LeafCount(), 0);
+  EXPECT_EQ(absl::BytesToHexString(tree.CurrentRoot()),
+            "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+}
+
+TEST(MerkleTreeAuthenticatedDictionaryTest, RootsMatchTestVectors) {
+  MerkleTreeAuthenticatedDictionary tree;
+  for (size_t i = 0; i < kLeafCount; i++) {
+    EXPECT_EQ(tree.AddLeaf(Leaf(i)), i + 1);
+    EXPECT_EQ(absl::BytesToHexString(tree.CurrentRoot()), kRoots[i]);
+  }
+}
+
+TEST(MerkleTreeAuthenticatedDictionaryTest, UpdateLeafRecomputesRoot) {
+  MerkleTreeAuthenticatedDictionary tree;
+  MerkleTreeAuthenticatedDictionary expected_tree;
+  for (size_t i = 0; i < kLeafCount; i++) {
+    tree.AddLeaf("placeholder");
+    expected_tree.AddLeaf(Leaf(i));
+  }
+  tree.CurrentRoot();
+
+  for (size_t i = 0; i < kLeafCount; i++) {
+    ASSERT_TRUE(tree.UpdateLeaf(i + 1, Leaf(i)));
+    EXPECT_EQ(tree.LeafHash(i + 1), expected_tree.LeafHash(i + 1));
+  }
+  EXPECT_EQ(absl::BytesToHexString(tree.CurrentRoot()), kRoots[kLeafCount - 1]);
+  EXPECT_FALSE(tree.UpdateLeaf(0, Leaf(0)));
+  EXPECT_FALSE(tree.UpdateLeaf(kLeafCount + 1, Leaf(0)));
+}
+
+TEST(MerkleTreeAuthenticatedDictionaryTest, ModifiedNodesCoverUpdatedPath) {
+  MerkleTreeAuthenticatedDictionary tree;
+  for (size_t i = 0; i < kLeafCount; i++) {
+    tree.AddLeaf(Leaf(i));
+  }
+  EXPECT_EQ(tree.ModifiedNodes().size(),
+            MerkleTreeAuthenticatedDictionary::SerializedNodeCount(kLeafCount));
+  tree.ClearModifiedNodes();
+
+  // Leaf 3 (index 2) and its ancestors at positions 5, 3 and 7.
+  ASSERT_TRUE(tree.UpdateLeaf(3, "updated"));
+  EXPECT_EQ(tree.ModifiedNodes(), (std::vector<size_t>{3, 4, 5, 7}));
+}
+
+TEST(MerkleTreeAuthenticatedDictionaryTest, LoadedTreeMatchesOriginal) {
+  for (size_t leaf_count = 1; leaf_count <= kLeafCount; leaf_count++) {
+    MerkleTreeAuthenticatedDictionary tree;
+    for (size_t i = 0; i < leaf_count; i++) {
+      tree.AddLeaf(Leaf(i));
+    }
+    std::vector<uint8_t> nodes = Serialize(&tree);
+
+    MerkleTreeAuthenticatedDictionary loaded_tree;
+    ASSERT_TRUE(loaded_tree.LoadNodes(leaf_count, nodes.data(), nodes.size()));
+    EXPECT_EQ(loaded_tree.LeafCount(), leaf_count);
+    EXPECT_EQ(loaded_tree.CurrentRoot(), tree.CurrentRoot());
+    for (size_t i = 1; i <= leaf_count; i++) {
+      EXPECT_EQ(loaded_tree.LeafHash(i), tree.LeafHash(i));
+    }
+
+    // The loaded tree keeps growing like the original one.
+    loaded_tree.AddLeaf("next");
+    tree.AddLeaf("next");
+    EXPECT_EQ(loaded_tree.CurrentRoot(), tree.CurrentRoot());
+  }
+}
+
+TEST(MerkleTreeAuthenticatedDictionaryTest, LoadNodesFailsOnShortInput) {
+  MerkleTreeAuthenticatedDictionary tree;
+  std::vector<uint8_t> nodes(
+      MerkleTreeAuthenticatedDictionary::SerializedNodeCount(kLeafCount) *
+          MerkleTreeAuthenticatedDictionary::kHashLength -
+      1);
+  EXPECT_FALSE(tree.LoadNodes(kLeafCount, nodes.data(), nodes.size()));
+}
+
+TEST(MerkleTreeAuthenticatedDictionaryTest, TamperedNodeFailsVerification) {
+  MerkleTreeAuthenticatedDictionary tree;
+  for (size_t i = 0; i < kLeafCount; i++) {
+    tree.AddLeaf(Leaf(i));
+  }
+  std::vector<uint8_t> nodes = Serialize(&tree);
+
+  // Tamper with leaf 6 (index 5, at position 10).
+  nodes[10 * MerkleTreeAuthenticatedDictionary::kHashLength] ^= 1;
+
+  MerkleTreeAuthenticatedDictionary loaded_tree;
+  ASSERT_TRUE(loaded_tree.LoadNodes(kLeafCount, nodes.data(), nodes.size()));
+  EXPECT_EQ(loaded_tree.CurrentRoot(), tree.CurrentRoot());
+
+  // Leaves in the other half of the tree verify before the tampered leaf is
+  // reached.
+  EXPECT_EQ(loaded_tree.LeafHash(1), tree.LeafHash(1));
+  EXPECT_EQ(loaded_tree.LeafHash(6), "");
+
+  // Once tampering is detected, the tree is unusable.
+  EXPECT_EQ(loaded_tree.LeafHash(1), "");
+  EXPECT_FALSE(loaded_tree.UpdateLeaf(1, Leaf(0)));
+  EXPECT_EQ(loaded_tree.AddLeaf(Leaf(0)), 0);
+}
+
+TEST(MerkleTreeAuthenticatedDictionaryTest, LoadReadsNodesOnPathOnly) {
+  constexpr size_t kLargeLeafCount = 1000;
+  MerkleTreeAuthenticatedDictionary tree;
+  for (size_t i = 0; i < kLargeLeafCount; i++) {
+    tree.AddLeaf(std::to_string(i));
+  }
+  std::vector<uint8_t> nodes = Serialize(&tree);
+
+  size_t reads = 0;
+  size_t nodes_read = 0;
+  MerkleTreeAuthenticatedDictionary loaded_tree;
+  ASSERT_TRUE(loaded_tree.Load(
+      kLargeLeafCount,
+      [&](const std::vector<size_t> &positions,
+          std::vector<std::string> *hashes) {
+        reads++;
+        nodes_read += positions.size();
+        for (size_t position : positions) {
+          hashes->emplace_back(
+              reinterpret_cast<const char *>(nodes.data()) +
+                  position * MerkleTreeAuthenticatedDictionary::kHashLength,
+              MerkleTreeAuthenticatedDictionary::kHashLength);
+        }
+        return true;
+      }));
+  EXPECT_EQ(loaded_tree.CurrentRoot(), tree.CurrentRoot());
+  EXPECT_EQ(nodes_read, 1);
+
+  // Verifying a leaf reads its path and the siblings on it in a single call.
+  EXPECT_EQ(loaded_tree.LeafHash(500), tree.LeafHash(500));
+  EXPECT_EQ(reads, 2);
+  EXPECT_LE(nodes_read, 1 + 2 * 10);
+
+  // All nodes read from the serialized form keep verifying.
+  ASSERT_TRUE(loaded_tree.ReadAllNodes());
+  EXPECT_EQ(nodes_read,
+            MerkleTreeAuthenticatedDictionary::SerializedNodeCount(
+                kLargeLeafCount));
+  for (size_t i = 1; i <= kLargeLeafCount; i++) {
+    ASSERT_EQ(loaded_tree.LeafHash(i), tree.LeafHash(i));
+  }
+}
+
+TEST(MerkleTreeAuthenticatedDictionaryTest, UnreadableNodeFailsVerification) {
+  MerkleTreeAuthenticatedDictionary tree;
+  for (size_t i = 0; i < kLeafCount; i++) {
+    tree.AddLeaf(Leaf(i));
+  }
+  std::vector<uint8_t> nodes = Serialize(&tree);
+
+  bool root_read = false;
+  MerkleTreeAuthenticatedDictionary loaded_tree;
+  ASSERT_TRUE(loaded_tree.Load(
+      kLeafCount, [&](const std::vector<size_t> &positions,
+                      std::vector<std::string> *hashes) {
+        if (root_read) {
+          return false;
+        }
+        root_read = true;
+        hashes->emplace_back(
+            reinterpret_cast<const char *>(nodes.data()) +
+                positions[0] * MerkleTreeAuthenticatedDictionary::kHashLength,
+            MerkleTreeAuthenticatedDictionary::kHashLength);
+        return true;
+      }));
+  EXPECT_EQ(loaded_tree.CurrentRoot(), tree.CurrentRoot());
+  EXPECT_EQ(loaded_tree.LeafHash(1), "");
+  EXPECT_FALSE(loaded_tree.UpdateLeaf(1, Leaf(0)));
+}
+
+}  // namespace
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
@@ -0,0 +1,79 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/utils/block_cache.h"
+
+#include <algorithm>
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+BlockCache::BlockCache(size_t capacity)
+    : capacity_(capacity), cached_bytes_(0) {}
+
+bool BlockCache::Lookup(int64_t index, uint8_t *block, size_t block_length) {
+  auto it = blocks_.find(index);
+  if (it == blocks_.end() || it->second->data.size() != block_length) {
+    return false;
+  }
+
+  lru_.splice(lru_.begin(), lru_, it->second);
+  std::copy_n(it->second->data.begin(), block_length, block);
+  return true;
+}
+
+void BlockCache::Insert(int64_t index, const uint8_t *block,
+                        size_t block_length) {
+  Erase(index);
+  if (block_length > capacity_) {
+    return;
+  }
+
+  while (cached_bytes_ + block_length > capacity_) {
+    Remove(std::prev(lru_.end()));
+  }
+
+  lru_.push_front(Entry{index, CleansingVector<uint8_t>(
+                                   block, block + block_length)});
+  blocks_.emplace(index, lru_.begin());
+  cached_bytes_ += block_length;
+}
+
+void BlockCache::Erase(int64_t index) {
+  auto it = blocks_.find(index);
+  if (it != blocks_.end()) {
+    Remove(it->second);
+  }
+}
+
+void BlockCache::Clear() {
+  lru_.clear();
+  blocks_.clear();
+  cached_bytes_ = 0;
+}
+
+void BlockCache::Remove(std::list<Entry>::iterator it) {
+  cached_bytes_ -= it->data.size();
+  blocks_.erase(it->index);
+  lru_.erase(it);
+}
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
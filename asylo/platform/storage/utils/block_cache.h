@@ -0,0 +1,89 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef ASYLO_PLATFORM_STORAGE_UTILS_BLOCK_CACHE_H_
+#define ASYLO_PLATFORM_STORAGE_UTILS_BLOCK_CACHE_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <unordered_map>
+
+#include "asylo/util/cleansing_types.h"
+
+namespace asylo {
+namespace platform {
+namespace storage {
+
+// Bounded least-recently-used cache of the plaintext of file blocks, keyed on
+// the block index. Holds at most |capacity| bytes of block data, and cleanses
+// the data of evicted blocks. Blocks of different lengths may be cached
+// together; a lookup only hits a block cached with the same length.
+//
+// The class is not thread-safe - the caller is expected to synchronize access
+// to an instance. Avoids using absl based containers which may perform system
+// calls, as the class is expected to be used in the trusted primitives layer.
+class BlockCache {
+ public:
+  explicit BlockCache(size_t capacity);
+
+  // Copies the cached block at |index| into |block|, which must hold
+  // |block_length| bytes, and marks it most recently used. Returns false if the
+  // block is not cached with |block_length|.
+  bool Lookup(int64_t index, uint8_t *block, size_t block_length);
+
+  // Caches a copy of |block_length| bytes of |block| at |index|, replacing the
+  // block cached at |index|, if any, and evicting least recently used blocks
+  // as needed. A block longer than the capacity is not cached.
+  void Insert(int64_t index, const uint8_t *block, size_t block_length);
+
+  // Drops the block cached at |index|, if any.
+  void Erase(int64_t index);
+
+  // Drops all cached blocks.
+  void Clear();
+
+  // Returns the number of cached blocks.
+  size_t size() const { return blocks_.size(); }
+
+ private:
+  struct Entry {
+    int64_t index;
+    CleansingVector<uint8_t> data;
+  };
+
+  // Removes the entry at |it| from the cache.
+  void Remove(std::list<Entry>::iterator it);
+
+  const size_t capacity_;
+
+  // Total length of the cached blocks.
+  size_t cached_bytes_;
+
+  // Cached blocks, most recently used first.
+  std::list<Entry> lru_;
+
+  // Positions in |lru_| of cached blocks, keyed on block index.
+  std::unordered_map<int64_t, std::list<Entry>::iterator> blocks_;
+};
+
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
+
+#endif  // ASYLO_PLATFORM_STORAGE_UTILS_BLOCK_CACHE_H_
@@ -0,0 +1,121 @@
+/*
+ *
+ * Copyright 2021 Asylo authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "asylo/platform/storage/utils/block_cache.h"
+
+#include <cstdint>
+#include <vector>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+namespace asylo {
+namespace platform {
+namespace storage {
+namespace {
+
+using ::testing::ElementsAreArray;
+
+constexpr size_t kBlockLength = 16;
+
+std::vector<uint8_t> MakeBlock(uint8_t value, size_t length = kBlockLength) {
+  return std::vector<uint8_t>(length, value);
+}
+
+TEST(BlockCacheTest, LookupReturnsInsertedBlock) {
+  BlockCache cache(4 * kBlockLength);
+  std::vector<uint8_t> block = MakeBlock(1);
+  cache.Insert(7, block.data(), block.size());
+
+  std::vector<uint8_t> result(kBlockLength);
+  ASSERT_TRUE(cache.Lookup(7, result.data(), result.size()));
+  EXPECT_THAT(result, ElementsAreArray(block));
+  EXPECT_FALSE(cache.Lookup(8, result.data(), result.size()));
+}
+
+TEST(BlockCacheTest, InsertReplacesBlock) {
+  BlockCache cache(4 * kBlockLength);
+  std::vector<uint8_t> old_block = MakeBlock(1);
+  std::vector<uint8_t> new_block = MakeBlock(2);
+  cache.Insert(0, old_block.data(), old_block.size());
+  cache.Insert(0, new_block.data(), new_block.size());
+  EXPECT_EQ(cache.size(), 1);
+
+  std::vector<uint8_t> result(kBlockLength);
+  ASSERT_TRUE(cache.Lookup(0, result.data(), result.size()));
+  EXPECT_THAT(result, ElementsAreArray(new_block));
+}
+
+TEST(BlockCacheTest, LookupRequiresMatchingLength) {
+  BlockCache cache(4 * kBlockLength);
+  std::vector<uint8_t> block = MakeBlock(1);
+  cache.Insert(0, block.data(), block.size());
+
+  std::vector<uint8_t> result(2 * kBlockLength);
+  EXPECT_FALSE(cache.Lookup(0, result.data(), result.size()));
+}
+
+TEST(BlockCacheTest, EvictsLeastRecentlyUsedBlock) {
+  BlockCache cache(2 * kBlockLength);
+  std::vector<uint8_t> block = MakeBlock(1);
+  std::vector<uint8_t> result(kBlockLength);
+  cache.Insert(0, block.data(), block.size());
+  cache.Insert(1, block.data(), block.size());
+
+  // Use block 0, so that block 1 is evicted next.
+  ASSERT_TRUE(cache.Lookup(0, result.data(), result.size()));
+  cache.Insert(2, block.data(), block.size());
+
+  EXPECT_EQ(cache.size(), 2);
+  EXPECT_TRUE(cache.Lookup(0, result.data(), result.size()));
+  EXPECT_FALSE(cache.Lookup(1, result.data(), result.size()));
+  EXPECT_TRUE(cache.Lookup(2, result.data(), result.size()));
+}
+
+TEST(BlockCacheTest, DoesNotCacheBlocksLongerThanCapacity) {
+  BlockCache cache(kBlockLength);
+  std::vector<uint8_t> block = MakeBlock(1, 2 * kBlockLength);
+  cache.Insert(0, block.data(), block.size());
+  EXPECT_EQ(cache.size(), 0);
+}
+
+TEST(BlockCacheTest, EraseAndClearDropBlocks) {
+  BlockCache cache(4 * kBlockLength);
+  std::vector<uint8_t> block = MakeBlock(1);
+  std::vector<uint8_t> result(kBlockLength);
+  cache.Insert(0, block.data(), block.size());
+  cache.Insert(1, block.data(), block.size());
+
+  cache.Erase(0);
+  EXPECT_FALSE(cache.Lookup(0, result.data(), result.size()));
+  EXPECT_TRUE(cache.Lookup(1, result.data(), result.size()));
+
+  cache.Clear();
+  EXPECT_EQ(cache.size(), 0);
+  EXPECT_FALSE(cache.Lookup(1, result.data(), result.size()));
+
+  // The capacity freed by clearing is available again.
+  cache.Insert(2, block.data(), block.size());
+  cache.Insert(3, block.data(), block.size());
+  EXPECT_EQ(cache.size(), 2);
+}
+
+}  // namespace
+}  // namespace storage
+}  // namespace platform
+}  // namespace asylo
@@ -73,6 +73,8 @@ std::string FormatMessage(primitives::Extent extent) {
     std::string str = absl::StrCat(i, ": ", parameter.name());
     if (parameter.is_scalar()) {
       absl::StrAppend(&str, " [scalar ", reader.parameter<uint64_t>(i), "]");
+    } else if (reader.parameter_is_bulk(i)) {
+      absl::StrAppend(&str, " [bulk]");
     } else if (reader.parameter_size(i) == 0) {
       absl::StrAppend(&str, " [nullptr]");
     } else if (parameter.is_string()) {
@@ -99,7 +101,7 @@ bool MessageReader::IsValidParameterSize(int index) const {
 
   SystemCallDescriptor syscall(sysno());
   ParameterDescriptor parameter = syscall.parameter(index);
-  if (parameter.is_scalar()) {
+  if (parameter.is_scalar() || parameter_is_bulk(index)) {
     return header()->size[index] == sizeof(uint64_t);
   }
 
@@ -174,6 +176,13 @@ primitives::PrimitiveStatus MessageReader::Validate() const {
 
   for (int i = 0; i < kParameterMax; i++) {
     ParameterDescriptor parameter = syscall.parameter(i);
+    if (parameter_is_bulk(i) &&
+        (!parameter.is_valid() || !parameter.is_bounded())) {
+      return invalid_argument_status(
+          absl::StrCat("Message malformed: parameter under index ", i,
+                       " cannot be a bulk parameter"));
+    }
+
     if (!parameter_is_used(parameter)) {
       continue;
     }
@@ -211,6 +220,12 @@ bool MessageReader::parameter_is_used(ParameterDescriptor parameter) const {
     return false;
   }
 
+  // Bulk parameters are included in the encoding of both requests and
+  // responses.
+  if (parameter_is_bulk(parameter.index())) {
+    return true;
+  }
+
   // Output-only parameters are not included in the encoding of requests.
   if (is_request() && !parameter.is_in()) {
     return false;
@@ -232,12 +247,14 @@ bool MessageReader::parameter_is_used(int index) const {
 
 MessageWriter::MessageWriter(
     int sysno, uint64_t result, uint64_t error_number, bool is_request,
-    const std::array<uint64_t, kParameterMax> &parameters)
+    const std::array<uint64_t, kParameterMax> &parameters,
+    uint32_t bulk_parameters)
     : sysno_(sysno),
       result_(result),
       error_number_(error_number),
       is_request_(is_request),
-      parameters_(parameters) {
+      parameters_(parameters),
+      bulk_parameters_(bulk_parameters) {
   SystemCallDescriptor syscall{sysno};
   for (int i = 0; i < kParameterMax; i++) {
     parameter_size_[i] = ParameterSize(syscall.parameter(i));
@@ -245,14 +262,17 @@ MessageWriter::MessageWriter(
 }
 
 MessageWriter MessageWriter::RequestWriter(
-    int sysno, const std::array<uint64_t, kParameterMax> &parameters) {
-  return MessageWriter(sysno, 0, 0, true, parameters);
+    int sysno, const std::array<uint64_t, kParameterMax> &parameters,
+    uint32_t bulk_parameters) {
+  return MessageWriter(sysno, 0, 0, true, parameters, bulk_parameters);
 }
 
 MessageWriter MessageWriter::ResponseWriter(
     int sysno, uint64_t result, uint64_t error_number,
-    const std::array<uint64_t, kParameterMax> &parameters) {
-  return MessageWriter(sysno, result, error_number, false, parameters);
+    const std::array<uint64_t, kParameterMax> &parameters,
+    uint32_t bulk_parameters) {
+  return MessageWriter(sysno, result, error_number, false, parameters,
+                       bulk_parameters);
 }
 
 size_t MessageWriter::MessageSize() const {
@@ -268,6 +288,12 @@ bool MessageWriter::parameter_is_used(ParameterDescriptor parameter) const {
     return false;
   }
 
+  // Bulk parameters are included in the encoding of both requests and
+  // responses.
+  if (parameter_is_bulk(parameter)) {
+    return true;
+  }
+
   // Output-only parameters are not included in the encoding of requests.
   if (is_request() && !parameter.is_in()) {
     return false;
@@ -295,8 +321,8 @@ size_t MessageWriter::ParameterSize(ParameterDescriptor parameter) const {
     return 0;
   }
 
-  // All scalar values are encoded using 64 bits.
-  if (parameter.is_scalar()) {
+  // All scalar values and bulk parameter addresses are encoded using 64 bits.
+  if (parameter.is_scalar() || parameter_is_bulk(parameter)) {
     return sizeof(uint64_t);
   }
 
@@ -328,6 +354,7 @@ bool MessageWriter::Write(primitives::Extent *message) const {
   auto *header = reinterpret_cast<MessageHeader *>(message->data());
   header->magic = kMessageMagic;
   header->flags = is_request_ ? kSystemCallRequest : kSystemCallResponse;
+  header->flags |= bulk_parameters_;
   header->sysno = sysno_;
 
   // If this is a response message, add the result value to the message header.
@@ -348,8 +375,8 @@ bool MessageWriter::Write(primitives::Extent *message) const {
 
     // If this parameter is a pointer and not null, then copy its contents into
     // the body of the message. Null pointers are encoded as having a size of
-    // zero.
-    if (parameter.is_pointer()) {
+    // zero. Bulk parameters are encoded by address, as scalars.
+    if (parameter.is_pointer() && !parameter_is_bulk(parameter)) {
       if (void *src = reinterpret_cast<void *>(parameters_[i])) {
         memcpy(message->As<uint8_t>() + next_offset, src, parameter_size_[i]);
       }
@@ -34,9 +34,22 @@ namespace system_call {
 // Serialized system call flag values.
 enum MessageFlags : uint32_t {
   kSystemCallRequest = 0x1,
-  kSystemCallResponse = 0x2
+  kSystemCallResponse = 0x2,
+  // Flag marking the parameter at index 0 as a bulk parameter. The flag for the
+  // parameter at index i is shifted left by i bits, see BulkParameterFlag().
+  kSystemCallBulkParameter = 0x100
 };
 
+// Returns the flag marking the parameter at |index| as a bulk parameter.
+//
+// A bulk parameter is a bounded buffer whose contents are not carried by the
+// message. Instead, the message encodes the address of an untrusted buffer
+// holding the contents as a 64-bit value, in both requests and responses, and
+// the host reads and writes that buffer in place.
+constexpr uint32_t BulkParameterFlag(int index) {
+  return kSystemCallBulkParameter << index;
+}
+
 // Message magic number = "syscal\0".
 constexpr uint64_t kMessageMagic = 0x1006c6163737973;
 
@@ -96,6 +109,12 @@ class MessageReader {
   // result is -1.
   uint64_t error_number() const { return header()->error_number; }
 
+  // Returns true if the parameter at offset |index| into the parameter list is
+  // encoded as a bulk parameter.
+  bool parameter_is_bulk(int index) const {
+    return header()->flags & BulkParameterFlag(index);
+  }
+
   // Checks the validity of this message, returning an OK status on success.
   primitives::PrimitiveStatus Validate() const;
 
@@ -151,14 +170,20 @@ class MessageReader {
 // Write operations on a system call request or response message.
 class MessageWriter {
  public:
-  // Construct a response writer for a system call with a parameter list.
+  // Construct a response writer for a system call with a parameter list. The
+  // parameters flagged in |bulk_parameters| are encoded as bulk parameters,
+  // with their values in |parameters| holding the untrusted buffer addresses.
   static MessageWriter RequestWriter(
-      int sysno, const std::array<uint64_t, kParameterMax> &parameters);
+      int sysno, const std::array<uint64_t, kParameterMax> &parameters,
+      uint32_t bulk_parameters = 0);
 
-  // Construct a response writer for a system call with a parameter list.
+  // Construct a response writer for a system call with a parameter list. The
+  // parameters flagged in |bulk_parameters| are encoded as bulk parameters,
+  // with their values in |parameters| holding the untrusted buffer addresses.
   static MessageWriter ResponseWriter(
       int sysno, uint64_t result, uint64_t error_number,
-      const std::array<uint64_t, kParameterMax> &parameters);
+      const std::array<uint64_t, kParameterMax> &parameters,
+      uint32_t bulk_parameters = 0);
 
   // Returns the size of the configured message.
   size_t MessageSize() const;
@@ -170,7 +195,8 @@ class MessageWriter {
  private:
   MessageWriter(int sysno, uint64_t result, uint64_t error_number,
                 bool is_request,
-                const std::array<uint64_t, kParameterMax> &parameters);
+                const std::array<uint64_t, kParameterMax> &parameters,
+                uint32_t bulk_parameters);
 
   // Returns true if the parameter into the parameters list is used by this
   // encoding.
@@ -180,6 +206,11 @@ class MessageWriter {
   // used by this encoding.
   bool parameter_is_used(int index) const;
 
+  // Returns true if the parameter is encoded as a bulk parameter.
+  bool parameter_is_bulk(ParameterDescriptor parameter) const {
+    return bulk_parameters_ & BulkParameterFlag(parameter.index());
+  }
+
   // Returns the encoding size of a parameter.
   size_t ParameterSize(ParameterDescriptor parameter) const;
 
@@ -192,6 +223,7 @@ class MessageWriter {
   uint64_t error_number_;
   bool is_request_;
   const std::array<uint64_t, kParameterMax> parameters_;
+  const uint32_t bulk_parameters_;
   std::array<size_t, kParameterMax> parameter_size_;
 };
 
@@ -156,6 +156,32 @@ TEST(MessageTest, BoundedOutTest) {
       StrEq("response: read [returns: 0]  [errno: 0] (1: buf [bounded 1024])"));
 }
 
+TEST(MessageTest, BulkParameterTest) {
+  char buffer[8192];
+  std::array<uint64_t, 6> parameters;
+  CollectParameters(&parameters[0], 1, buffer, sizeof(buffer));
+  for (bool is_request : {true, false}) {
+    auto writer =
+        is_request
+            ? MessageWriter::RequestWriter(SYS_read, parameters,
+                                           BulkParameterFlag(1))
+            : MessageWriter::ResponseWriter(SYS_read, sizeof(buffer), 0,
+                                            parameters, BulkParameterFlag(1));
+    std::vector<uint8_t> message_buffer(writer.MessageSize());
+    EXPECT_THAT(message_buffer.size(), Eq(sizeof(MessageHeader) +
+                                          (is_request ? 3 : 1) *
+                                              sizeof(uint64_t)));
+    primitives::Extent message{message_buffer.data(), message_buffer.size()};
+    writer.Write(&message);
+
+    MessageReader reader(message);
+    ASSERT_TRUE(reader.Validate().ok());
+    EXPECT_TRUE(reader.parameter_is_bulk(1));
+    EXPECT_FALSE(reader.parameter_is_bulk(0));
+    EXPECT_THAT(reader.parameter<uint64_t>(1), Eq(CastToWord(buffer)));
+  }
+}
+
 TEST(MessageTest, MessageHeaderNotCompleteTest) {
   uint8_t *response_buffer = nullptr;
   MessageReader reader({response_buffer, 0});
@@ -281,6 +307,25 @@ TEST(MessageTest, StringDataSizeMisMatchTest) {
                                  "0 size mismatched")));
 }
 
+TEST(MessageTest, BulkScalarParameterTest) {
+  std::array<uint64_t, 6> parameters;
+  CollectParameters(&parameters[0], 1234);
+  auto writer = MessageWriter::RequestWriter(SYS_close, parameters);
+  std::vector<uint8_t> buffer(writer.MessageSize());
+  primitives::Extent message{buffer.data(), buffer.size()};
+  writer.Write(&message);
+  reinterpret_cast<MessageHeader *>(message.data())->flags |=
+      BulkParameterFlag(0);
+  MessageReader reader(message);
+  primitives::PrimitiveStatus status = reader.Validate();
+  EXPECT_THAT(status.error_code(),
+              Eq(primitives::AbslStatusCode::kInvalidArgument));
+  EXPECT_THAT(
+      status.error_message(),
+      StrEq("Message malformed: parameter under index 0 cannot be a bulk "
+            "parameter"));
+}
+
 TEST(MessageTest, NonNullTerminatedStringParameterTest) {
   const char *path = "abc";
   int length = 3;
@@ -43,6 +43,12 @@ typename T::value_type Sum(const T &values) {
 primitives::PrimitiveStatus SerializeRequest(
     int sysno, const std::array<uint64_t, kParameterMax> &parameters,
     primitives::Extent *request) {
+  return SerializeRequest(sysno, parameters, /*bulk_parameters=*/0, request);
+}
+
+primitives::PrimitiveStatus SerializeRequest(
+    int sysno, const std::array<uint64_t, kParameterMax> &parameters,
+    uint32_t bulk_parameters, primitives::Extent *request) {
   SystemCallDescriptor descriptor{sysno};
   if (!descriptor.is_valid()) {
     return primitives::PrimitiveStatus{
@@ -51,7 +57,8 @@ primitives::PrimitiveStatus SerializeRequest(
                      sysno, ") provided.")};
   }
 
-  auto writer = MessageWriter::RequestWriter(sysno, parameters);
+  auto writer =
+      MessageWriter::RequestWriter(sysno, parameters, bulk_parameters);
   size_t size = writer.MessageSize();
 
   *request = {reinterpret_cast<uint8_t *>(malloc(size)), size};
@@ -64,6 +71,14 @@ primitives::PrimitiveStatus SerializeResponse(
     int sysno, uint64_t result, uint64_t error_number,
     const std::array<uint64_t, kParameterMax> &parameters,
     primitives::Extent *response) {
+  return SerializeResponse(sysno, result, error_number, parameters,
+                           /*bulk_parameters=*/0, response);
+}
+
+primitives::PrimitiveStatus SerializeResponse(
+    int sysno, uint64_t result, uint64_t error_number,
+    const std::array<uint64_t, kParameterMax> &parameters,
+    uint32_t bulk_parameters, primitives::Extent *response) {
   SystemCallDescriptor descriptor{sysno};
 
   if (!descriptor.is_valid()) {
@@ -73,8 +88,8 @@ primitives::PrimitiveStatus SerializeResponse(
                      sysno, ") provided.")};
   }
 
-  auto writer =
-      MessageWriter::ResponseWriter(sysno, result, error_number, parameters);
+  auto writer = MessageWriter::ResponseWriter(sysno, result, error_number,
+                                              parameters, bulk_parameters);
   size_t size = writer.MessageSize();
 
   *response = {reinterpret_cast<uint8_t *>(malloc(size)), size};
@@ -38,6 +38,15 @@ primitives::PrimitiveStatus SerializeRequest(int sysno,
                                              const ParameterList &parameters,
                                              primitives::Extent *request);
 
+// Serializes a system call request as above, encoding the parameters flagged in
+// |bulk_parameters| as bulk parameters. The values of bulk parameters in
+// |parameters| are the addresses of the untrusted buffers holding their
+// contents.
+primitives::PrimitiveStatus SerializeRequest(int sysno,
+                                             const ParameterList &parameters,
+                                             uint32_t bulk_parameters,
+                                             primitives::Extent *request);
+
 // Serializes a system call response specified by a system call number, a return
 // code, and a list of parameters into a buffer. On success, `response` is
 // populated with a buffer allocated by malloc and owned by the caller.
@@ -46,6 +55,14 @@ primitives::PrimitiveStatus SerializeResponse(int sysno, uint64_t result,
                                               const ParameterList &parameters,
                                               primitives::Extent *response);
 
+// Serializes a system call response as above, encoding the parameters flagged
+// in |bulk_parameters| as bulk parameters.
+primitives::PrimitiveStatus SerializeResponse(int sysno, uint64_t result,
+                                              uint64_t error_number,
+                                              const ParameterList &parameters,
+                                              uint32_t bulk_parameters,
+                                              primitives::Extent *response);
+
 }  // namespace system_call
 }  // namespace asylo
 
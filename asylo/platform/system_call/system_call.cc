@@ -23,8 +23,11 @@
 #include <array>
 #include <cstdarg>
 #include <cstdint>
+#include <cstring>
 #include <memory>
+#include <vector>
 
+#include "asylo/platform/primitives/util/message.h"
 #include "asylo/platform/system_call/metadata.h"
 #include "asylo/platform/system_call/serialize.h"
 #include "asylo/platform/system_call/type_conversions/manual_types_functions.h"
@@ -41,80 +44,159 @@ struct MallocDeleter {
 void default_error_handler(const char *message) { abort(); }
 
 syscall_dispatch_callback global_syscall_callback = nullptr;
+syscall_batch_dispatch_callback global_syscall_batch_callback = nullptr;
+syscall_bulk_alloc_callback global_bulk_alloc_callback = nullptr;
+syscall_bulk_free_callback global_bulk_free_callback = nullptr;
 void (*error_handler)(const char *message) = nullptr;
 
-}  // namespace
+// Largest bulk region retained by a thread between system calls. Larger regions
+// are freed once the call they were allocated for completes.
+constexpr size_t kBulkRegionMaxRetainedSize = 1024 * 1024;
 
-extern "C" bool enc_is_syscall_dispatcher_set() {
-  return global_syscall_callback != nullptr;
-}
+// Untrusted memory staging the contents of the bulk parameters of the system
+// calls made by a thread. The region is freed when the thread exits.
+struct BulkRegion {
+  ~BulkRegion() { Free(); }
 
-extern "C" bool enc_is_error_handler_set() { return error_handler != nullptr; }
+  // Frees the region with the callback of the allocator it was allocated by,
+  // which remains valid if the allocator is replaced afterwards.
+  void Free() {
+    if (data) {
+      free_callback(data);
+    }
+    data = nullptr;
+    size = 0;
+  }
 
-extern "C" void enc_set_dispatch_syscall(syscall_dispatch_callback callback) {
-  global_syscall_callback = callback;
-}
+  uint8_t *data = nullptr;
+  size_t size = 0;
+  syscall_bulk_free_callback free_callback = nullptr;
 
-extern "C" void enc_set_error_handler(
-    void (*abort_handler)(const char *message)) {
-  error_handler = abort_handler;
-}
+  // Whether a system call using the region is in progress. A system call made
+  // while the region is in use, for instance from a signal handler, copies its
+  // parameters through the serialized messages.
+  bool in_use = false;
+};
 
-extern "C" int64_t enc_untrusted_syscall(int sysno, ...) {
-  if (!enc_is_error_handler_set()) {
-    enc_set_error_handler(default_error_handler);
+thread_local BulkRegion bulk_region;
+
+// Returns the smallest multiple of 8 greater than or equal to |value|.
+size_t RoundUpToMultipleOf8(size_t value) { return (value + 7) & ~size_t{7}; }
+
+// Stages the contents of the bounded buffer parameters of system call |sysno|
+// of at least kBulkParameterThreshold bytes in the bulk region of the calling
+// thread, and replaces their values in |parameters| with their staged
+// addresses. Returns the flags of the parameters staged, or zero if none were,
+// in which case the calling thread's bulk region is not acquired.
+uint32_t AcquireBulkParameters(int sysno,
+                               asylo::system_call::ParameterList *parameters) {
+  if (!enc_is_syscall_bulk_allocator_set() || bulk_region.in_use) {
+    return 0;
   }
 
   asylo::system_call::SystemCallDescriptor descriptor{sysno};
-  if (!descriptor.is_valid()) {
-    error_handler("system_call.cc: Invalid SystemCallDescriptor encountered.");
+  uint32_t bulk_parameters = 0;
+  std::array<size_t, asylo::system_call::kParameterMax> offsets;
+  std::array<size_t, asylo::system_call::kParameterMax> sizes;
+  size_t region_size = 0;
+  for (int i = 0; i < asylo::system_call::kParameterMax; i++) {
+    asylo::system_call::ParameterDescriptor parameter = descriptor.parameter(i);
+    if (!parameter.is_valid() || !parameter.is_bounded() ||
+        (*parameters)[i] == 0) {
+      continue;
+    }
+    uint64_t count = (*parameters)[parameter.bounding_parameter().index()];
+    if (count > (SIZE_MAX - region_size - 7) / parameter.element_size()) {
+      continue;
+    }
+    size_t size = count * parameter.element_size();
+    if (size < asylo::system_call::kBulkParameterThreshold) {
+      continue;
+    }
+    offsets[i] = region_size;
+    sizes[i] = size;
+    region_size += RoundUpToMultipleOf8(size);
+    bulk_parameters |= asylo::system_call::BulkParameterFlag(i);
   }
-
-  // Collect the passed parameter list into an array.
-  std::array<uint64_t, asylo::system_call::kParameterMax> parameters;
-  va_list args;
-  va_start(args, sysno);
-  for (int i = 0; i < descriptor.parameter_count(); i++) {
-    parameters[i] = va_arg(args, uint64_t);
+  if (bulk_parameters == 0) {
+    return 0;
   }
-  va_end(args);
 
-  // Allocate a buffer for the serialized request.
-  asylo::primitives::Extent request;
-  asylo::primitives::PrimitiveStatus status;
-  status = asylo::system_call::SerializeRequest(sysno, parameters, &request);
-  if (!status.ok()) {
-    error_handler(
-        "system_call.cc: Encountered serialization error when serializing "
-        "syscall parameters.");
+  if (region_size > bulk_region.size) {
+    auto *data =
+        reinterpret_cast<uint8_t *>(global_bulk_alloc_callback(region_size));
+    if (!data) {
+      return 0;
+    }
+    bulk_region.Free();
+    bulk_region.data = data;
+    bulk_region.size = region_size;
+    bulk_region.free_callback = global_bulk_free_callback;
   }
+  bulk_region.in_use = true;
 
-  std::unique_ptr<uint8_t, MallocDeleter> request_owner(request.As<uint8_t>());
+  for (int i = 0; i < asylo::system_call::kParameterMax; i++) {
+    if (!(bulk_parameters & asylo::system_call::BulkParameterFlag(i))) {
+      continue;
+    }
+    uint8_t *staged = bulk_region.data + offsets[i];
+    if (descriptor.parameter(i).is_in()) {
+      memcpy(staged, reinterpret_cast<const void *>((*parameters)[i]),
+             sizes[i]);
+    }
+    (*parameters)[i] = reinterpret_cast<uintptr_t>(staged);
+  }
+  return bulk_parameters;
+}
 
-  // Invoke the system call dispatch callback to execute the system call.
-  uint8_t *response_buffer;
-  size_t response_size;
+// Releases the bulk region of the calling thread acquired by
+// AcquireBulkParameters(), freeing it if it is too large to be retained.
+void ReleaseBulkParameters() {
+  bulk_region.in_use = false;
+  if (bulk_region.size > kBulkRegionMaxRetainedSize) {
+    bulk_region.Free();
+  }
+}
 
-  if (!enc_is_syscall_dispatcher_set()) {
-    error_handler("system_.cc: system call dispatcher not set.");
+// Serializes a request to execute system call |sysno| with |parameters|,
+// encoding the parameters flagged in |bulk_parameters| as bulk parameters. The
+// returned request is allocated by malloc() and owned by the caller.
+asylo::primitives::Extent SerializeRequestOrAbort(
+    int sysno, const asylo::system_call::ParameterList &parameters,
+    uint32_t bulk_parameters = 0) {
+  asylo::system_call::SystemCallDescriptor descriptor{sysno};
+  if (!descriptor.is_valid()) {
+    error_handler("system_call.cc: Invalid SystemCallDescriptor encountered.");
   }
-  status = global_syscall_callback(request.As<uint8_t>(), request.size(),
-                                   &response_buffer, &response_size);
+
+  asylo::primitives::Extent request;
+  asylo::primitives::PrimitiveStatus status =
+      asylo::system_call::SerializeRequest(sysno, parameters, bulk_parameters,
+                                           &request);
   if (!status.ok()) {
     error_handler(
-        "system_call.cc: Callback from syscall dispatcher was unsuccessful.");
+        "system_call.cc: Encountered serialization error when serializing "
+        "syscall parameters.");
   }
+  return request;
+}
 
-  std::unique_ptr<uint8_t, MallocDeleter> response_owner(response_buffer);
-
-  if (!response_buffer) {
+// Applies the serialized |response| to a call of system call |sysno| with
+// |parameters|, copying outputs back into pointer parameters. The outputs of
+// the parameters flagged in |bulk_parameters| are copied from the staged
+// addresses in |request_parameters|. Returns the result of the system call and
+// stores the enclave errno value it reported, or zero, in |error_number|.
+int64_t ApplyResponseOrAbort(
+    int sysno, const asylo::system_call::ParameterList &parameters,
+    const asylo::system_call::ParameterList &request_parameters,
+    uint32_t bulk_parameters, asylo::primitives::Extent response,
+    int *error_number) {
+  if (!response.data()) {
     error_handler(
         "system_call.cc: null response buffer received for the syscall.");
   }
 
-  // Copy outputs back into pointer parameters.
-  auto response_reader =
-      asylo::system_call::MessageReader({response_buffer, response_size});
+  auto response_reader = asylo::system_call::MessageReader(response);
   if (response_reader.sysno() != sysno) {
     error_handler("system_call.cc: Unexpected sysno in response");
   }
@@ -126,6 +208,7 @@ extern "C" int64_t enc_untrusted_syscall(int sysno, ...) {
         "reader.");
   }
 
+  asylo::system_call::SystemCallDescriptor descriptor{sysno};
   for (int i = 0; i < asylo::system_call::kParameterMax; i++) {
     asylo::system_call::ParameterDescriptor parameter = descriptor.parameter(i);
     if (parameter.is_out()) {
@@ -135,7 +218,14 @@ extern "C" int64_t enc_untrusted_syscall(int sysno, ...) {
       } else {
         size = parameters[parameter.size()] * parameter.element_size();
       }
-      const void *src = response_reader.parameter_address(i);
+      const bool is_bulk =
+          bulk_parameters & asylo::system_call::BulkParameterFlag(i);
+      if (response_reader.parameter_is_bulk(i) != is_bulk) {
+        error_handler("system_call.cc: Unexpected bulk parameter in response");
+      }
+      const void *src =
+          is_bulk ? reinterpret_cast<const void *>(request_parameters[i])
+                  : response_reader.parameter_address(i);
       void *dst = reinterpret_cast<void *>(parameters[i]);
       if (dst != nullptr) {
         memcpy(dst, src, size);
@@ -143,6 +233,7 @@ extern "C" int64_t enc_untrusted_syscall(int sysno, ...) {
     }
   }
 
+  *error_number = 0;
   uint64_t result = response_reader.header()->result;
   if (static_cast<int64_t>(result) == -1) {
     int klinux_errno = response_reader.header()->error_number;
@@ -152,8 +243,192 @@ extern "C" int64_t enc_untrusted_syscall(int sysno, ...) {
     // successful (eg., lseek). The reliable way to check for syscall failure is
     // to therefore check both return value and presence of a non-zero errno.
     if (klinux_errno != 0) {
-      errno = FromkLinuxErrno(klinux_errno);
+      *error_number = FromkLinuxErrno(klinux_errno);
     }
   }
   return result;
 }
+
+// Executes system call |sysno| with |parameters| through the system call
+// dispatch callback, with the serialized |request| built from
+// |request_parameters| and |bulk_parameters|. Returns the result of the system
+// call and stores the errno value it reported, or zero, in |error_number|.
+int64_t DispatchOrAbort(
+    int sysno, const asylo::system_call::ParameterList &parameters,
+    const asylo::system_call::ParameterList &request_parameters,
+    uint32_t bulk_parameters, asylo::primitives::Extent request,
+    int *error_number) {
+  // Invoke the system call dispatch callback to execute the system call.
+  uint8_t *response_buffer;
+  size_t response_size;
+
+  if (!enc_is_syscall_dispatcher_set()) {
+    error_handler("system_.cc: system call dispatcher not set.");
+  }
+  asylo::primitives::PrimitiveStatus status =
+      global_syscall_callback(request.As<uint8_t>(), request.size(),
+                              &response_buffer, &response_size);
+  if (!status.ok()) {
+    error_handler(
+        "system_call.cc: Callback from syscall dispatcher was unsuccessful.");
+  }
+
+  std::unique_ptr<uint8_t, MallocDeleter> response_owner(response_buffer);
+  return ApplyResponseOrAbort(sysno, parameters, request_parameters,
+                              bulk_parameters, {response_buffer, response_size},
+                              error_number);
+}
+
+}  // namespace
+
+extern "C" bool enc_is_syscall_dispatcher_set() {
+  return global_syscall_callback != nullptr;
+}
+
+extern "C" bool enc_is_syscall_batch_dispatcher_set() {
+  return global_syscall_batch_callback != nullptr;
+}
+
+extern "C" bool enc_is_syscall_bulk_allocator_set() {
+  return global_bulk_alloc_callback != nullptr &&
+         global_bulk_free_callback != nullptr;
+}
+
+extern "C" bool enc_is_error_handler_set() { return error_handler != nullptr; }
+
+extern "C" void enc_set_dispatch_syscall(syscall_dispatch_callback callback) {
+  global_syscall_callback = callback;
+}
+
+extern "C" void enc_set_dispatch_syscall_batch(
+    syscall_batch_dispatch_callback callback) {
+  global_syscall_batch_callback = callback;
+}
+
+extern "C" void enc_set_syscall_bulk_allocator(
+    syscall_bulk_alloc_callback alloc, syscall_bulk_free_callback free) {
+  global_bulk_alloc_callback = alloc;
+  global_bulk_free_callback = free;
+}
+
+extern "C" void enc_set_error_handler(
+    void (*abort_handler)(const char *message)) {
+  error_handler = abort_handler;
+}
+
+extern "C" int64_t enc_untrusted_syscall(int sysno, ...) {
+  if (!enc_is_error_handler_set()) {
+    enc_set_error_handler(default_error_handler);
+  }
+
+  asylo::system_call::SystemCallDescriptor descriptor{sysno};
+  if (!descriptor.is_valid()) {
+    error_handler("system_call.cc: Invalid SystemCallDescriptor encountered.");
+  }
+
+  // Collect the passed parameter list into an array.
+  asylo::system_call::ParameterList parameters;
+  va_list args;
+  va_start(args, sysno);
+  for (int i = 0; i < descriptor.parameter_count(); i++) {
+    parameters[i] = va_arg(args, uint64_t);
+  }
+  va_end(args);
+
+  // Stage large buffers in untrusted memory, then allocate a buffer for the
+  // serialized request.
+  asylo::system_call::ParameterList request_parameters = parameters;
+  uint32_t bulk_parameters =
+      AcquireBulkParameters(sysno, &request_parameters);
+  asylo::primitives::Extent request =
+      SerializeRequestOrAbort(sysno, request_parameters, bulk_parameters);
+  std::unique_ptr<uint8_t, MallocDeleter> request_owner(request.As<uint8_t>());
+
+  int error_number;
+  int64_t result =
+      DispatchOrAbort(sysno, parameters, request_parameters, bulk_parameters,
+                      request, &error_number);
+  if (bulk_parameters != 0) {
+    ReleaseBulkParameters();
+  }
+  if (error_number != 0) {
+    errno = error_number;
+  }
+  return result;
+}
+
+namespace asylo {
+namespace system_call {
+
+SystemCallBatch::~SystemCallBatch() {
+  for (size_t i = submitted_; i < calls_.size(); i++) {
+    free(calls_[i].request.data());
+  }
+}
+
+size_t SystemCallBatch::AddRequest(int sysno, const ParameterList &parameters) {
+  if (!enc_is_error_handler_set()) {
+    enc_set_error_handler(default_error_handler);
+  }
+  Call call;
+  call.sysno = sysno;
+  call.parameters = parameters;
+  call.request = SerializeRequestOrAbort(sysno, parameters);
+  call.result = -1;
+  call.error_number = 0;
+  calls_.push_back(call);
+  return calls_.size() - 1;
+}
+
+void SystemCallBatch::Submit() {
+  if (submitted_ == calls_.size()) {
+    return;
+  }
+  size_t begin = submitted_;
+  submitted_ = calls_.size();
+
+  if (!enc_is_syscall_batch_dispatcher_set()) {
+    for (size_t i = begin; i < calls_.size(); i++) {
+      Call &call = calls_[i];
+      std::unique_ptr<uint8_t, MallocDeleter> request_owner(
+          call.request.As<uint8_t>());
+      call.result =
+          DispatchOrAbort(call.sysno, call.parameters, call.parameters,
+                          /*bulk_parameters=*/0, call.request,
+                          &call.error_number);
+    }
+    return;
+  }
+
+  std::vector<primitives::Extent> requests;
+  requests.reserve(calls_.size() - begin);
+  for (size_t i = begin; i < calls_.size(); i++) {
+    requests.push_back(calls_[i].request);
+  }
+
+  primitives::MessageReader responses;
+  primitives::PrimitiveStatus status = global_syscall_batch_callback(
+      requests.data(), requests.size(), &responses);
+  for (auto &request : requests) {
+    free(request.data());
+  }
+  if (!status.ok()) {
+    error_handler(
+        "system_call.cc: Callback from syscall batch dispatcher was "
+        "unsuccessful.");
+  }
+  if (responses.size() != requests.size()) {
+    error_handler(
+        "system_call.cc: Unexpected number of responses for syscall batch.");
+  }
+
+  for (size_t i = begin; i < calls_.size(); i++) {
+    Call &call = calls_[i];
+    call.result = ApplyResponseOrAbort(call.sysno, call.parameters,
+                                       call.parameters, /*bulk_parameters=*/0,
+                                       responses.next(), &call.error_number);
+  }
+}
+
+}  // namespace system_call
+}  // namespace asylo
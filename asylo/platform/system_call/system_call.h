@@ -21,8 +21,13 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <type_traits>
+#include <vector>
 
+#include "asylo/platform/primitives/extent.h"
 #include "asylo/platform/primitives/primitive_status.h"
+#include "asylo/platform/primitives/util/message.h"
+#include "asylo/platform/system_call/serialize.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -37,9 +42,35 @@ typedef asylo::primitives::PrimitiveStatus (*syscall_dispatch_callback)(
     const uint8_t *request_buffer, size_t request_size,
     uint8_t **response_buffer, size_t *response_size);
 
+// Callback type installed at runtime to dispatch a batch of system calls across
+// the enclave boundary in a single round trip. `requests` designates an array of
+// `request_count` serialized system call requests owned by the caller. On
+// success `responses` is populated with exactly one serialized response per
+// request, in request order.
+typedef asylo::primitives::PrimitiveStatus (*syscall_batch_dispatch_callback)(
+    const asylo::primitives::Extent *requests, size_t request_count,
+    asylo::primitives::MessageReader *responses);
+
+// Callback types installed at runtime to allocate and free untrusted memory
+// holding the contents of bulk system call parameters. The allocation callback
+// returns nullptr on failure.
+typedef void *(*syscall_bulk_alloc_callback)(size_t size);
+typedef void (*syscall_bulk_free_callback)(void *buffer);
+
 // Installs a callback as dispatch function for serialized system calls.
 void enc_set_dispatch_syscall(syscall_dispatch_callback callback);
 
+// Installs a callback as dispatch function for batches of serialized system
+// calls.
+void enc_set_dispatch_syscall_batch(syscall_batch_dispatch_callback callback);
+
+// Installs the callbacks used to allocate and free untrusted memory for bulk
+// system call parameters. Until they are installed, all parameters are copied
+// through the serialized messages. Memory allocated for a thread is freed with
+// |free| when the thread exits.
+void enc_set_syscall_bulk_allocator(syscall_bulk_alloc_callback alloc,
+                                    syscall_bulk_free_callback free);
+
 // Installs an error handler function that aborts with a message in case of a
 // failure.
 void enc_set_error_handler(void (*abort_handler)(const char *message));
@@ -48,15 +79,116 @@ void enc_set_error_handler(void (*abort_handler)(const char *message));
 // calls.
 bool enc_is_syscall_dispatcher_set();
 
+// Returns whether a dispatch function has been registered for making batches of
+// system calls.
+bool enc_is_syscall_batch_dispatcher_set();
+
+// Returns whether callbacks have been registered for allocating untrusted
+// memory for bulk system call parameters.
+bool enc_is_syscall_bulk_allocator_set();
+
 // Returns whether an error handler function has been registered.
 bool enc_is_error_handler_set();
 
 // Invokes a system call on the host via the installed system call dispatch
 // callback.
+//
+// If a bulk allocator is installed, bounded buffer parameters of at least
+// asylo::system_call::kBulkParameterThreshold bytes are passed as bulk
+// parameters: their contents are staged in an untrusted region owned by the
+// calling thread and reused across calls, which the host reads and writes in
+// place, so that they cross the enclave boundary with a single copy.
 int64_t enc_untrusted_syscall(int sysno, ...);
 
 #ifdef __cplusplus
 }
 #endif
 
+namespace asylo {
+namespace system_call {
+
+// Size in bytes from which the bounded buffer parameters of
+// enc_untrusted_syscall() are passed as bulk parameters. Smaller buffers are
+// copied through the serialized messages.
+constexpr size_t kBulkParameterThreshold = 4096;
+
+// A batch of independent system calls which are dispatched to the host
+// together, crossing the enclave boundary once instead of once per call.
+//
+// System calls are queued with Add() and executed on the host in the order they
+// were added when Submit() is called. Since all calls of a batch are serialized
+// before any is executed, a call may not depend on the outcome of an earlier
+// call in the same batch. Output parameters are copied back and per-call results
+// become available once Submit() returns. If no batch dispatch callback is
+// installed, the calls are dispatched one at a time through the regular system
+// call dispatch callback. Buffers of batched calls are always copied through
+// the serialized messages.
+//
+// Errors in serialization or dispatch are reported through the installed error
+// handler, exactly as for enc_untrusted_syscall().
+class SystemCallBatch {
+ public:
+  SystemCallBatch() = default;
+  ~SystemCallBatch();
+
+  SystemCallBatch(const SystemCallBatch &other) = delete;
+  SystemCallBatch &operator=(const SystemCallBatch &other) = delete;
+
+  // Queues the system call |sysno| with arguments |args|, which must be
+  // integers or pointers. Memory referenced by pointer arguments must remain
+  // valid until Submit() returns. Returns the index of the call in the batch.
+  template <typename... Ts>
+  size_t Add(int sysno, Ts... args) {
+    static_assert(sizeof...(Ts) <= kParameterMax,
+                  "Too many system call parameters");
+    ParameterList parameters{{ToParameter(args)...}};
+    return AddRequest(sysno, parameters);
+  }
+
+  // Dispatches all calls queued since the last call to Submit().
+  void Submit();
+
+  // Returns the number of calls added to the batch.
+  size_t size() const { return calls_.size(); }
+
+  // Returns the return value of the submitted call at |index|.
+  int64_t result(size_t index) const { return calls_[index].result; }
+
+  // Returns the errno value reported by the submitted call at |index|, or zero
+  // if none was reported.
+  int error_number(size_t index) const { return calls_[index].error_number; }
+
+ private:
+  struct Call {
+    int sysno;
+    ParameterList parameters;
+    primitives::Extent request;  // Serialized request, allocated by malloc.
+    int64_t result;
+    int error_number;
+  };
+
+  template <typename T>
+  static uint64_t ToParameter(T *value) {
+    return reinterpret_cast<uintptr_t>(value);
+  }
+
+  template <typename T>
+  static typename std::enable_if<std::is_integral<T>::value, uint64_t>::type
+  ToParameter(T value) {
+    return static_cast<uint64_t>(value);
+  }
+
+  static uint64_t ToParameter(std::nullptr_t value) { return 0; }
+
+  size_t AddRequest(int sysno, const ParameterList &parameters);
+
+  std::vector<Call> calls_;
+
+  // Number of calls already dispatched by Submit().
+  size_t submitted_ = 0;
+};
+
+}  // namespace system_call
+}  // namespace asylo
+
 #endif  // ASYLO_PLATFORM_SYSTEM_CALL_SYSTEM_CALL_H_
@@ -25,9 +25,12 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cerrno>
 #include <cstring>
+#include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <gmock/gmock.h>
@@ -37,6 +40,7 @@
 #include "absl/strings/str_cat.h"
 #include "asylo/platform/primitives/primitive_status.h"
 #include "asylo/platform/primitives/untrusted_primitives.h"
+#include "asylo/platform/primitives/util/message.h"
 #include "asylo/platform/system_call/sysno.h"
 #include "asylo/platform/system_call/type_conversions/types.h"
 #include "asylo/platform/system_call/type_conversions/types_functions.h"
@@ -89,6 +93,32 @@ asylo::primitives::PrimitiveStatus InvalidResponseDispatcher(
   return asylo::primitives::PrimitiveStatus::OkStatus();
 }
 
+// A system call batch dispatch function which invokes each request message
+// locally and serializes the responses into |responses|.
+asylo::primitives::PrimitiveStatus SystemCallBatchDispatcher(
+    const primitives::Extent *requests, size_t request_count,
+    primitives::MessageReader *responses) {
+  primitives::MessageWriter writer;
+  for (size_t i = 0; i < request_count; i++) {
+    primitives::Extent response;
+    ASYLO_RETURN_IF_ERROR(UntrustedInvoke(requests[i], &response));
+    writer.PushByCopy(response);
+    free(response.data());
+  }
+  size_t size = writer.MessageSize();
+  std::unique_ptr<char[]> buffer(new char[size]);
+  writer.Serialize(buffer.get());
+  responses->Deserialize(std::move(buffer), size);
+  return asylo::primitives::PrimitiveStatus::OkStatus();
+}
+
+// A system call batch dispatch function that drops the last response.
+asylo::primitives::PrimitiveStatus TruncatingBatchDispatcher(
+    const primitives::Extent *requests, size_t request_count,
+    primitives::MessageReader *responses) {
+  return SystemCallBatchDispatcher(requests, request_count - 1, responses);
+}
+
 // A system call dispatch function that always fails.
 asylo::primitives::PrimitiveStatus AlwaysFailingDispatcher(
     const uint8_t *request_buffer, size_t request_size,
@@ -298,6 +328,172 @@ TEST(SystemCallTest, BoundedBufferByParamLenTest) {
   EXPECT_THAT(fds_actual[1].revents, Eq(fds_actual[1].revents));
 }
 
+// Number of untrusted regions allocated for bulk parameters.
+std::atomic<int> bulk_allocations(0);
+std::atomic<int> bulk_frees(0);
+
+// A bulk allocator backed by malloc() which counts its allocations.
+void *CountingBulkAlloc(size_t size) {
+  bulk_allocations++;
+  return malloc(size);
+}
+
+void BulkFree(void *buffer) {
+  bulk_frees++;
+  free(buffer);
+}
+
+// Invokes system calls with buffers large enough to be passed as bulk
+// parameters, and checks that the bulk region is reused across calls.
+TEST(SystemCallTest, BulkParameterTest) {
+  enc_set_dispatch_syscall(SystemCallDispatcher);
+  enc_set_syscall_bulk_allocator(CountingBulkAlloc, BulkFree);
+  bulk_allocations = 0;
+  std::string path = absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir),
+                                  "/bulk_parameter_test.tmp");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_GE(fd, 0);
+
+  std::vector<char> expected(4 * kBulkParameterThreshold);
+  for (size_t i = 0; i < expected.size(); i++) {
+    expected[i] = static_cast<char>(i % 251);
+  }
+  EXPECT_THAT(enc_untrusted_syscall(SYS_write, fd, expected.data(),
+                                    expected.size()),
+              Eq(expected.size()));
+
+  std::vector<char> actual(expected.size());
+  EXPECT_THAT(enc_untrusted_syscall(SYS_pread64, fd, actual.data(),
+                                    actual.size(), 0),
+              Eq(actual.size()));
+  EXPECT_THAT(actual, Eq(expected));
+
+  // Buffers under the threshold are copied through the messages.
+  char small[16];
+  EXPECT_THAT(
+      enc_untrusted_syscall(SYS_pread64, fd, small, sizeof(small), 16),
+      Eq(sizeof(small)));
+  EXPECT_THAT(memcmp(small, expected.data() + 16, sizeof(small)), Eq(0));
+
+  EXPECT_THAT(bulk_allocations.load(), Eq(1));
+
+  close(fd);
+  enc_set_syscall_bulk_allocator(nullptr, nullptr);
+}
+
+// Checks that the bulk region of a thread is freed when the thread exits.
+TEST(SystemCallTest, BulkRegionFreedOnThreadExit) {
+  enc_set_dispatch_syscall(SystemCallDispatcher);
+  enc_set_syscall_bulk_allocator(CountingBulkAlloc, BulkFree);
+  bulk_allocations = 0;
+  bulk_frees = 0;
+  std::string path = absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir),
+                                  "/bulk_region_thread_exit_test.tmp");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_GE(fd, 0);
+
+  std::vector<char> buffer(2 * kBulkParameterThreshold, 'a');
+  int64_t result = 0;
+  std::thread writer([fd, &buffer, &result] {
+    result = enc_untrusted_syscall(SYS_write, fd, buffer.data(), buffer.size());
+  });
+  writer.join();
+
+  EXPECT_THAT(result, Eq(buffer.size()));
+  EXPECT_THAT(bulk_allocations.load(), Eq(1));
+  EXPECT_THAT(bulk_frees.load(), Eq(1));
+
+  close(fd);
+  enc_set_syscall_bulk_allocator(nullptr, nullptr);
+}
+
+// Submits a batch of system calls with a batch dispatcher installed and checks
+// per-call results, errno values and output parameters.
+TEST(SystemCallBatchTest, SubmitBatch) {
+  enc_set_dispatch_syscall(SystemCallDispatcher);
+  enc_set_dispatch_syscall_batch(SystemCallBatchDispatcher);
+
+  char buffer_expected[2048];
+  char buffer_actual[2048];
+  EXPECT_THAT(getcwd(buffer_expected, sizeof(buffer_expected)), Not(IsNull()));
+
+  SystemCallBatch batch;
+  size_t getpid_call = batch.Add(SYS_getpid);
+  size_t getcwd_call =
+      batch.Add(SYS_getcwd, buffer_actual, sizeof(buffer_actual));
+  size_t failing_call = batch.Add(SYS_getcwd, nullptr, 1);
+  EXPECT_THAT(batch.size(), Eq(3));
+  batch.Submit();
+
+  EXPECT_THAT(batch.result(getpid_call), Eq(getpid()));
+  EXPECT_THAT(batch.error_number(getpid_call), Eq(0));
+  EXPECT_THAT(batch.result(getcwd_call), Not(Eq(-1)));
+  EXPECT_THAT(&buffer_expected[0], StrEq(buffer_actual));
+  EXPECT_THAT(batch.result(failing_call), Eq(-1));
+  EXPECT_THAT(batch.error_number(failing_call), Eq(ERANGE));
+
+  enc_set_dispatch_syscall_batch(nullptr);
+}
+
+// Checks that a batch is executed in order, that calls added after a Submit()
+// are dispatched by the next Submit(), and that unsubmitted calls are released.
+TEST(SystemCallBatchTest, SubmitInOrder) {
+  enc_set_dispatch_syscall(SystemCallDispatcher);
+  enc_set_dispatch_syscall_batch(SystemCallBatchDispatcher);
+
+  std::string path =
+      absl::StrCat(absl::GetFlag(FLAGS_test_tmpdir), "/batch_order_test.tmp");
+  int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  ASSERT_GE(fd, 0);
+
+  const char kData[] = "batched";
+  SystemCallBatch batch;
+  size_t write_call = batch.Add(SYS_pwrite64, fd, kData, sizeof(kData), 0);
+  size_t fsync_call = batch.Add(SYS_fsync, fd);
+  batch.Submit();
+  EXPECT_THAT(batch.result(write_call), Eq(sizeof(kData)));
+  EXPECT_THAT(batch.result(fsync_call), Eq(0));
+
+  size_t close_call = batch.Add(SYS_close, fd);
+  batch.Submit();
+  EXPECT_THAT(batch.result(write_call), Eq(sizeof(kData)));
+  EXPECT_THAT(batch.result(close_call), Eq(0));
+  EXPECT_THAT(fcntl(fd, F_GETFD), Eq(-1));
+
+  SystemCallBatch unsubmitted;
+  unsubmitted.Add(SYS_getpid);
+
+  enc_set_dispatch_syscall_batch(nullptr);
+}
+
+// Submits a batch of system calls without a batch dispatcher installed, which
+// dispatches the calls one at a time.
+TEST(SystemCallBatchTest, FallBackWithoutBatchDispatcher) {
+  enc_set_dispatch_syscall(SystemCallDispatcher);
+  enc_set_dispatch_syscall_batch(nullptr);
+  EXPECT_THAT(enc_is_syscall_batch_dispatcher_set(), Eq(false));
+
+  SystemCallBatch batch;
+  size_t getpid_call = batch.Add(SYS_getpid);
+  size_t failing_call = batch.Add(SYS_getcwd, nullptr, 1);
+  batch.Submit();
+
+  EXPECT_THAT(batch.result(getpid_call), Eq(getpid()));
+  EXPECT_THAT(batch.result(failing_call), Eq(-1));
+  EXPECT_THAT(batch.error_number(failing_call), Eq(ERANGE));
+}
+
+// Ensure that submitting a batch aborts if a response is missing.
+TEST(SystemCallBatchTest, AbortOnMissingResponse) {
+  enc_set_error_handler(error_handler);
+  enc_set_dispatch_syscall_batch(TruncatingBatchDispatcher);
+  SystemCallBatch batch;
+  batch.Add(SYS_getpid);
+  batch.Add(SYS_getpid);
+  EXPECT_EXIT(batch.Submit(), ::testing::KilledBySignal(SIGABRT), ".*");
+  enc_set_dispatch_syscall_batch(nullptr);
+}
+
 }  // namespace
 }  // namespace system_call
 }  // namespace asylo
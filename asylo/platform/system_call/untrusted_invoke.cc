@@ -44,9 +44,16 @@ primitives::PrimitiveStatus UntrustedInvoke(primitives::Extent request,
   // A vector of buffers allocated for output params.
   std::vector<std::unique_ptr<char[]>> output_buffers;
 
+  // Parameters whose contents are read and written in place in untrusted
+  // memory rather than carried by the messages.
+  uint32_t bulk_parameters = 0;
+
   for (int i = 0; i < kParameterMax; i++) {
     ParameterDescriptor parameter = descriptor.parameter(i);
-    if (parameter.is_in()) {
+    if (reader.parameter_is_bulk(i)) {
+      params[i] = reader.parameter<uint64_t>(i);
+      bulk_parameters |= BulkParameterFlag(i);
+    } else if (parameter.is_in()) {
       // Read an input parameter from the request.
       if (parameter.is_pointer()) {
         params[i] = reader.parameter_address<uint64_t>(i);
@@ -73,7 +80,8 @@ primitives::PrimitiveStatus UntrustedInvoke(primitives::Extent request,
                             params[3], params[4], params[5]);
 
   // Build the response message.
-  return SerializeResponse(reader.sysno(), result, errno, params, response);
+  return SerializeResponse(reader.sysno(), result, errno, params,
+                           bulk_parameters, response);
 }
 
 }  // namespace system_call
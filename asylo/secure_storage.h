@@ -35,6 +35,14 @@
 #define ENCLAVE_STORAGE_SET_KEY (ENCLAVE_STORAGE_IOCTL_TYPE | 0x00000001)
 #endif
 
+// IOCTL to set the block length of a newly created secure file. Must be issued
+// before the key is set. The argument points to a uint32_t holding a power of
+// two between 4 KiB and 64 KiB.
+#ifndef ENCLAVE_STORAGE_SET_BLOCK_LENGTH
+#define ENCLAVE_STORAGE_SET_BLOCK_LENGTH \
+  (ENCLAVE_STORAGE_IOCTL_TYPE | 0x00000002)
+#endif
+
 struct key_info {
   uint32_t length;
   uint8_t *data;
@@ -17,10 +17,14 @@
  */
 
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
+#include <thread>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/common/time_util.h"
 #include "asylo/test/util/pthread_test_util.h"
@@ -254,5 +258,127 @@ TEST(EnclaveCondVar, Timeout) {
   ASSERT_EQ(pthread_cond_destroy(&cv), 0);
 }
 
+// Deadline of waits that are expected to be signaled.
+constexpr absl::Duration kSignaledTimeout = absl::Seconds(10);
+
+// Deadline of waits that are expected to time out, or to race a signal.
+constexpr absl::Duration kShortTimeout = absl::Milliseconds(20);
+
+// Controls the number of rounds in which a signal races a timeout.
+constexpr int kNumRaceIterations = 20;
+
+// Waits on |cv| with |mu| until |deadline| after setting |*waiting|, and
+// returns the result of the wait.
+int TimedWait(pthread_cond_t *cv, pthread_mutex_t *mu, bool *waiting,
+              absl::Time deadline) {
+  timespec deadline_ts = absl::ToTimespec(deadline);
+  EXPECT_EQ(pthread_mutex_lock(mu), 0);
+  *waiting = true;
+  int ret = pthread_cond_timedwait(cv, mu, &deadline_ts);
+  EXPECT_EQ(pthread_mutex_unlock(mu), 0);
+  return ret;
+}
+
+// Blocks until |*waiting| is set under |mu|. A waiter in TimedWait() releases
+// |mu| only once it is queued on its condition variable, so it is queued, or
+// has already timed out, when this returns.
+void AwaitWaiter(pthread_mutex_t *mu, const bool *waiting) {
+  while (true) {
+    ASSERT_EQ(pthread_mutex_lock(mu), 0);
+    bool queued = *waiting;
+    ASSERT_EQ(pthread_mutex_unlock(mu), 0);
+    if (queued) {
+      return;
+    }
+    sched_yield();
+  }
+}
+
+TEST(EnclaveCondVar, TimedWaitReturnsWhenSignaled) {
+  // Test to ensure a timed wait returns 0 as soon as it is signaled.
+  pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
+  pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
+  bool waiting = false;
+  int result = -1;
+
+  absl::Time deadline = absl::Now() + kSignaledTimeout;
+  std::thread waiter(
+      [&]() { result = TimedWait(&cv, &mu, &waiting, deadline); });
+  AwaitWaiter(&mu, &waiting);
+  EXPECT_EQ(pthread_cond_signal(&cv), 0);
+  waiter.join();
+
+  EXPECT_EQ(result, 0);
+  EXPECT_LT(absl::Now(), deadline);
+  ASSERT_EQ(pthread_mutex_destroy(&mu), 0);
+  ASSERT_EQ(pthread_cond_destroy(&cv), 0);
+}
+
+TEST(EnclaveCondVar, TimedOutWaiterLeavesQueue) {
+  // Test to ensure a waiter that timed out no longer receives signals, so the
+  // next signal wakes the waiter queued after it.
+  pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
+  pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
+  bool first_waiting = false;
+  bool second_waiting = false;
+  int second_result = -1;
+
+  EXPECT_EQ(TimedWait(&cv, &mu, &first_waiting, absl::Now() + kShortTimeout),
+            ETIMEDOUT);
+
+  std::thread second([&]() {
+    second_result = TimedWait(&cv, &mu, &second_waiting,
+                              absl::Now() + kSignaledTimeout);
+  });
+  AwaitWaiter(&mu, &second_waiting);
+  EXPECT_EQ(pthread_cond_signal(&cv), 0);
+  second.join();
+
+  EXPECT_EQ(second_result, 0);
+  ASSERT_EQ(pthread_mutex_destroy(&mu), 0);
+  ASSERT_EQ(pthread_cond_destroy(&cv), 0);
+}
+
+TEST(EnclaveCondVar, SignalRacesTimeout) {
+  // Test to ensure a signal that races the deadline of the first waiter is
+  // never lost: either the first waiter consumes it and returns 0, or it times
+  // out and the signal wakes the second waiter.
+  pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
+  pthread_mutex_t mu = PTHREAD_MUTEX_INITIALIZER;
+
+  for (int i = 0; i < kNumRaceIterations; ++i) {
+    bool first_waiting = false;
+    bool second_waiting = false;
+    int first_result = -1;
+    int second_result = -1;
+
+    absl::Time first_deadline = absl::Now() + kShortTimeout;
+    std::thread first([&]() {
+      first_result = TimedWait(&cv, &mu, &first_waiting, first_deadline);
+    });
+    AwaitWaiter(&mu, &first_waiting);
+    std::thread second([&]() {
+      second_result = TimedWait(&cv, &mu, &second_waiting,
+                                absl::Now() + kSignaledTimeout);
+    });
+    AwaitWaiter(&mu, &second_waiting);
+
+    absl::SleepFor(first_deadline - absl::Now());
+    EXPECT_EQ(pthread_cond_signal(&cv), 0);
+    first.join();
+    if (first_result == 0) {
+      // The first waiter consumed the signal, so release the second one.
+      EXPECT_EQ(pthread_cond_signal(&cv), 0);
+    } else {
+      EXPECT_EQ(first_result, ETIMEDOUT);
+    }
+    second.join();
+    EXPECT_EQ(second_result, 0);
+  }
+
+  ASSERT_EQ(pthread_mutex_destroy(&mu), 0);
+  ASSERT_EQ(pthread_cond_destroy(&cv), 0);
+}
+
 }  // namespace
 }  // namespace asylo
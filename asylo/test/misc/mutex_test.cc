@@ -18,10 +18,16 @@
 
 #include <pthread.h>
 #include <stdio.h>
+#include <numeric>
+#include <thread>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/synchronization/mutex.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "asylo/util/logging.h"
 #include "asylo/test/util/pthread_test_util.h"
 #include "asylo/test/util/status_matchers.h"
@@ -39,6 +45,13 @@ const int kNumLoops = 50000;
 // The expected final value of a counter.
 const int kExpectedResult = kNumThreads * kNumLoops;
 
+// Controls the number of threads queued on a mutex in the handoff test.
+const int kNumQueuedThreads = 4;
+
+// Time given to a thread that blocks on a mutex to exhaust its spin budget and
+// queue on the mutex.
+const absl::Duration kQueueDelay = absl::Milliseconds(100);
+
 // Mutex used in the Mutex-enabled routine.
 absl::Mutex mu;
 
@@ -150,5 +163,51 @@ TEST(RunWithTryLockTest, EnclaveMutex) {
   ASSERT_EQ(counter, kExpectedResult);
 }
 
+// Ensure that threads queued on a pthread mutex acquire it in the order they
+// queued, and that unlocking hands the mutex to the first of them before the
+// unlocking thread can take it back.
+TEST(QueuedThreadsTest, EnclaveMutex) {
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  ASSERT_EQ(pthread_mutex_lock(&mutex), 0);
+
+  // The order in which the queued threads acquired |mutex|, guarded by
+  // |mutex|.
+  std::vector<int> order;
+  absl::Notification started[kNumQueuedThreads];
+  absl::Notification release_first;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kNumQueuedThreads; ++i) {
+    threads.emplace_back([&, i]() {
+      started[i].Notify();
+      EXPECT_EQ(pthread_mutex_lock(&mutex), 0);
+      order.push_back(i);
+      if (i == 0) {
+        release_first.WaitForNotification();
+      }
+      EXPECT_EQ(pthread_mutex_unlock(&mutex), 0);
+    });
+
+    // Wait for the thread to queue on the mutex before starting the next one.
+    started[i].WaitForNotification();
+    absl::SleepFor(kQueueDelay);
+  }
+
+  EXPECT_EQ(pthread_mutex_unlock(&mutex), 0);
+  EXPECT_EQ(pthread_mutex_trylock(&mutex), EBUSY);
+
+  release_first.Notify();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  std::vector<int> expected_order(kNumQueuedThreads);
+  std::iota(expected_order.begin(), expected_order.end(), 0);
+  EXPECT_EQ(order, expected_order);
+
+  EXPECT_EQ(pthread_mutex_trylock(&mutex), 0);
+  EXPECT_EQ(pthread_mutex_unlock(&mutex), 0);
+  EXPECT_EQ(pthread_mutex_destroy(&mutex), 0);
+}
+
 }  // namespace
 }  // namespace asylo
@@ -17,14 +17,21 @@
  */
 
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
+
+#include <atomic>
+#include <cstdint>
 #include <functional>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/posix/pthread_impl.h"
+#include "asylo/platform/posix/threading/thread_manager.h"
 #include "asylo/test/util/status_matchers.h"
 
 namespace asylo {
@@ -344,6 +351,96 @@ TEST_F(PthreadCleanupTest, NestedCleanup) {
   });
 }
 
+// Time given to a joined thread to become idle inside the enclave.
+constexpr absl::Duration kIdleDelay = absl::Milliseconds(10);
+
+// Test fixture which lets threads stay idle inside the enclave after their
+// start routine returns, so that later threads reuse them.
+class ThreadPoolTest : public Test {
+ protected:
+  static constexpr int kNumThreads = 32;
+
+  void SetUp() override {
+    ThreadManager::ThreadPoolOptions options;
+    options.max_idle_threads = 2;
+    options.idle_timeout_us = 1000000;
+    ThreadManager::GetInstance()->SetThreadPoolOptions(options);
+  }
+
+  void TearDown() override {
+    ThreadManager::GetInstance()->SetThreadPoolOptions(
+        ThreadManager::ThreadPoolOptions());
+  }
+};
+
+TEST_F(ThreadPoolTest, ReusedThreadsReturnTheirResults) {
+  size_t donated_threads = ThreadManager::GetInstance()->DonatedThreadCount();
+  for (uintptr_t i = 0; i < kNumThreads; ++i) {
+    pthread_t pthread;
+    ASSERT_EQ(pthread_create(
+                  &pthread, nullptr, [](void *arg) -> void * { return arg; },
+                  reinterpret_cast<void *>(i)),
+              0);
+    void *result = nullptr;
+    ASSERT_EQ(pthread_join(pthread, &result), 0);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(result), i);
+
+    // Give the joined thread time to become idle, so that the next
+    // pthread_create() can reuse it.
+    absl::SleepFor(kIdleDelay);
+  }
+
+  // Start routines which ran on reused threads did not need a thread to be
+  // donated.
+  donated_threads =
+      ThreadManager::GetInstance()->DonatedThreadCount() - donated_threads;
+  EXPECT_LT(donated_threads, static_cast<size_t>(kNumThreads));
+}
+
+TEST_F(ThreadPoolTest, ConcurrentThreadsHaveDistinctIds) {
+  pthread_t pthreads[kNumThreads];
+  for (uintptr_t i = 0; i < kNumThreads; ++i) {
+    ASSERT_EQ(pthread_create(
+                  &pthreads[i], nullptr,
+                  [](void *arg) -> void * { return arg; },
+                  reinterpret_cast<void *>(i)),
+              0);
+  }
+  // Threads which are done but not yet joined must not be reused.
+  for (int i = 0; i < kNumThreads; ++i) {
+    for (int j = 0; j < i; ++j) {
+      EXPECT_FALSE(pthread_equal(pthreads[i], pthreads[j]));
+    }
+  }
+  for (uintptr_t i = 0; i < kNumThreads; ++i) {
+    void *result = nullptr;
+    ASSERT_EQ(pthread_join(pthreads[i], &result), 0);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(result), i);
+  }
+}
+
+TEST_F(ThreadPoolTest, ReusedThreadsRunDetachedStartRoutines) {
+  static std::atomic<int> completed;
+  completed = 0;
+  pthread_attr_t attr;
+  ASSERT_EQ(pthread_attr_init(&attr), 0);
+  ASSERT_EQ(pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED), 0);
+  for (int i = 0; i < kNumThreads; ++i) {
+    pthread_t pthread;
+    ASSERT_EQ(pthread_create(&pthread, &attr,
+                             [](void *) -> void * {
+                               completed.fetch_add(1);
+                               return nullptr;
+                             },
+                             nullptr),
+              0);
+  }
+  ASSERT_EQ(pthread_attr_destroy(&attr), 0);
+  while (completed.load() < kNumThreads) {
+    sched_yield();
+  }
+}
+
 }  // namespace
 }  // namespace pthread_impl
 }  // namespace asylo
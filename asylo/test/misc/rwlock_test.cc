@@ -24,6 +24,9 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "absl/synchronization/barrier.h"
+#include "absl/synchronization/notification.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
 #include "asylo/util/logging.h"
 #include "asylo/platform/common/time_util.h"
 #include "asylo/test/util/pthread_test_util.h"
@@ -37,6 +40,10 @@ static constexpr int kNumThreads = 5;
 
 static constexpr int kCountsPerThread = 500;
 
+// Time given to a thread that blocks on a lock to exhaust its spin budget and
+// queue on the lock.
+static constexpr absl::Duration kQueueDelay = absl::Milliseconds(100);
+
 class RwLockTest : public ::testing::Test {
  protected:
   // Ensure that the counter is within the intended bounds.
@@ -146,5 +153,32 @@ TEST_F(RwLockTest, MultipleReaders) {
   EXPECT_EQ(pthread_rwlock_destroy(&rwlock_), 0);
 }
 
+TEST_F(RwLockTest, QueuedWriterIsHandedLock) {
+  // Ensure a writer queued behind a reader owns the lock as soon as the reader
+  // unlocks, before another reader can acquire it.
+  ASSERT_EQ(pthread_rwlock_rdlock(&rwlock_), 0);
+
+  absl::Notification writer_started;
+  absl::Notification release_writer;
+  std::thread writer([&]() {
+    writer_started.Notify();
+    EXPECT_EQ(pthread_rwlock_wrlock(&rwlock_), 0);
+    release_writer.WaitForNotification();
+    EXPECT_EQ(pthread_rwlock_unlock(&rwlock_), 0);
+  });
+
+  // Wait for the writer to queue on the lock.
+  writer_started.WaitForNotification();
+  absl::SleepFor(kQueueDelay);
+
+  EXPECT_EQ(pthread_rwlock_unlock(&rwlock_), 0);
+  EXPECT_EQ(pthread_rwlock_tryrdlock(&rwlock_), EBUSY);
+
+  release_writer.Notify();
+  writer.join();
+  EXPECT_EQ(pthread_rwlock_tryrdlock(&rwlock_), 0);
+  EXPECT_EQ(pthread_rwlock_unlock(&rwlock_), 0);
+}
+
 }  // namespace
 }  // namespace asylo
@@ -98,8 +98,28 @@ class RemoteProxyConfig {
     return connection_config_->server_creds();
   }
 
+  // Sets the number of persistent bidirectional streams the Communicator uses
+  // to send messages to its counterpart. Messages queued by concurrent threads
+  // are batched together on a stream. If |num_streams| is 0 (the default),
+  // each message is sent with its own unary RPC instead.
+  void set_communication_streams(int num_streams) {
+    communication_streams_ = num_streams;
+  }
+  int communication_streams() const { return communication_streams_; }
+
+  // Enables passing messages to the counterpart through a shared memory ring
+  // when both run on the same machine, bypassing gRPC. If the counterpart
+  // cannot map the ring, messages are sent over gRPC as configured above.
+  // Disabled by default.
+  void set_shared_memory_transport(bool enabled) {
+    shared_memory_transport_ = enabled;
+  }
+  bool shared_memory_transport() const { return shared_memory_transport_; }
+
  private:
   std::unique_ptr<RemoteProxyConnectionConfig> connection_config_;
+  int communication_streams_ = 0;
+  bool shared_memory_transport_ = false;
 };
 
 // |RemoteProxyClientConfig| provides |RemoteEnclaveProxyClient| with the